@@ -18,6 +18,7 @@ void ofApp::setup()
 			settings.enableLooping = true;		//default true
 			settings.enableAudio = true;		//default true, save resources by disabling
 			settings.enableTexture = i==1;		//default true
+			settings.clockGroup = &clockGroup;	//keep all players on the first one's clock
             
 			
 			ofxOMXPlayer* player = new ofxOMXPlayer();
@@ -69,6 +70,15 @@ void ofApp::keyPressed  (int key){
 	{
 		case 'c':
 		{
+			//make the next player the one the others follow
+			for (int i=0; i<omxPlayers.size(); i++) 
+			{
+				if (omxPlayers[i]->isClockMaster())
+				{
+					omxPlayers[(i+1) % omxPlayers.size()]->setClockMaster();
+					break;
+				}
+			}
 			break;
 		}
 	}
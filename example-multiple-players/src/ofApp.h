@@ -14,6 +14,7 @@ class ofApp : public ofBaseApp{
 	
 	
 	vector<ofxOMXPlayer*> omxPlayers; 
+	OMXClockGroup clockGroup;
 
 };
 
@@ -2,7 +2,8 @@
 
 //This app is a demo of the ability to play multiple files with the Non-Texture Player
 //It requires multiple video files to be in /home/pi/videos/current
-//There is a bit of glitching while the files switch
+//The next file is queued with queueMovie so it is opened while the current one plays.
+//Files with the same codec/resolution are joined without a gap, others restart the player.
 
 //This also demonstrates the ofxOMXPlayerListener pattern available
 
@@ -27,6 +28,30 @@ void ofApp::onVideoLoop(ofxOMXPlayer* player)
     
 }
 
+void ofApp::onPlaylistAdvance(ofxOMXPlayer* player)
+{
+    videoCounter = nextVideoIndex();
+    ofLog() << "onPlaylistAdvance: " << files[videoCounter].path();
+    queueNextMovie();
+}
+
+int ofApp::nextVideoIndex()
+{
+    if(videoCounter+1<files.size())
+    {
+        return videoCounter+1;
+    }
+    return 0;
+}
+
+void ofApp::queueNextMovie()
+{
+    if(files.size()>1)
+    {
+        omxPlayer.queueMovie(files[nextVideoIndex()].path());
+    }
+}
+
 
 void ofApp::onCharacterReceived(KeyListenerEventData& e)
 {
@@ -64,6 +89,7 @@ void ofApp::setup()
 			settings.enableTexture = true;		//default true
 			settings.listener = this;			//this app extends ofxOMXPlayerListener so it will receive events ;
 			omxPlayer.setup(settings);
+			queueNextMovie();
 		}		
 	}else
     {
@@ -74,20 +100,16 @@ void ofApp::setup()
 
 void ofApp::loadNextMovie()
 {
-	if(videoCounter+1<files.size())
-	{
-		videoCounter++;
-	}else
-	{
-		videoCounter = 0;
-	}
+	videoCounter = nextVideoIndex();
 	skipTimeStart = ofGetElapsedTimeMillis();
     ofLog() << "LOADING MOVIE" << files[videoCounter].path();
-	omxPlayer.loadMovie(files[videoCounter].path());
+	settings.videoPath = files[videoCounter].path();
+	omxPlayer.setup(settings);
 	skipTimeEnd = ofGetElapsedTimeMillis();
 	amountSkipped = skipTimeEnd-skipTimeStart;
 	totalAmountSkipped+=amountSkipped;
 	doLoadNextMovie = false;
+	queueNextMovie();
 }
 
 //--------------------------------------------------------------
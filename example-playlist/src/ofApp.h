@@ -19,6 +19,7 @@ class ofApp : public ofBaseApp, public ofxOMXPlayerListener, public KeyListener{
 	
 		void onVideoEnd(ofxOMXPlayer* player);
         void onVideoLoop(ofxOMXPlayer* player);
+        void onPlaylistAdvance(ofxOMXPlayer* player);
 
 		
 		vector<ofFile> files;
@@ -29,6 +30,8 @@ class ofApp : public ofBaseApp, public ofxOMXPlayerListener, public KeyListener{
 		ofxOMXPlayerSettings settings;
 	
 		void loadNextMovie();
+		void queueNextMovie();
+		int nextVideoIndex();
 	
 };
 
@@ -259,92 +259,6 @@ void CBitstreamConverter::parseh264_sps(uint8_t *sps, uint32_t sps_size, bool *i
   *max_ref_frames = sps_info.max_num_ref_frames;
 }
 
-const uint8_t *CBitstreamConverter::avc_find_startcode_internal(const uint8_t *p, const uint8_t *end)
-{
-  const uint8_t *a = p + 4 - ((intptr_t)p & 3);
-
-  for (end -= 3; p < a && p < end; p++)
-  {
-    if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-      return p;
-  }
-
-  for (end -= 3; p < end; p += 4)
-  {
-    uint32_t x = *(const uint32_t*)p;
-    if ((x - 0x01010101) & (~x) & 0x80808080) // generic
-    {
-      if (p[1] == 0)
-      {
-        if (p[0] == 0 && p[2] == 1)
-          return p;
-        if (p[2] == 0 && p[3] == 1)
-          return p+1;
-      }
-      if (p[3] == 0)
-      {
-        if (p[2] == 0 && p[4] == 1)
-          return p+2;
-        if (p[4] == 0 && p[5] == 1)
-          return p+3;
-      }
-    }
-  }
-
-  for (end += 3; p < end; p++)
-  {
-    if (p[0] == 0 && p[1] == 0 && p[2] == 1)
-      return p;
-  }
-
-  return end + 3;
-}
-
-const uint8_t *CBitstreamConverter::avc_find_startcode(const uint8_t *p, const uint8_t *end)
-{
-  const uint8_t *out= avc_find_startcode_internal(p, end);
-  if (p<out && out<end && !out[-1])
-    out--;
-  return out;
-}
-
-const int CBitstreamConverter::avc_parse_nal_units(AVIOContext *pb, const uint8_t *buf_in, int size)
-{
-  const uint8_t *p = buf_in;
-  const uint8_t *end = p + size;
-  const uint8_t *nal_start, *nal_end;
-
-  size = 0;
-  nal_start = avc_find_startcode(p, end);
-
-  for (;;) {
-    while (nal_start < end && !*(nal_start++));
-    if (nal_start == end)
-      break;
-
-    nal_end = avc_find_startcode(nal_start, end);
-    m_dllAvFormat->avio_wb32(pb, nal_end - nal_start);
-    m_dllAvFormat->avio_write(pb, nal_start, nal_end - nal_start);
-    size += 4 + nal_end - nal_start;
-    nal_start = nal_end;
-  }
-  return size;
-}
-
-const int CBitstreamConverter::avc_parse_nal_units_buf(const uint8_t *buf_in, uint8_t **buf, int *size)
-{
-  AVIOContext *pb;
-  int ret = m_dllAvFormat->avio_open_dyn_buf(&pb);
-  if (ret < 0)
-    return ret;
-
-  avc_parse_nal_units(pb, buf_in, *size);
-
-  m_dllAvUtil->av_freep(buf);
-  *size = m_dllAvFormat->avio_close_dyn_buf(pb, buf);
-  return 0;
-}
-
 const int CBitstreamConverter::isom_write_avcc(AVIOContext *pb, const uint8_t *data, int len)
 {
   // extradata from bytestream h264, convert to avcC atom data for bitstream
@@ -353,14 +267,15 @@ const int CBitstreamConverter::isom_write_avcc(AVIOContext *pb, const uint8_t *d
     /* check for h264 start code */
     if (OMX_RB32(data) == 0x00000001 || OMX_RB24(data) == 0x000001)
     {
-      uint8_t *buf=NULL, *end, *start;
+      CBitstreamBuffer nals;
+      uint8_t *buf, *end;
       uint32_t sps_size=0, pps_size=0;
       uint8_t *sps=0, *pps=0;
 
-      int ret = avc_parse_nal_units_buf(data, &buf, &len);
-      if (ret < 0)
-        return ret;
-      start = buf;
+      len = bitstream_annexb_to_avcc(&nals, data, len);
+      if (len < 0)
+        return len;
+      buf = nals.Data();
       end = buf + len;
 
       /* look for sps and pps */
@@ -401,7 +316,6 @@ const int CBitstreamConverter::isom_write_avcc(AVIOContext *pb, const uint8_t *d
         m_dllAvFormat->avio_wb16(pb, pps_size);
         m_dllAvFormat->avio_write(pb, pps, pps_size);
       }
-      m_dllAvUtil->av_free(start);
     }
     else
     {
@@ -414,8 +328,7 @@ const int CBitstreamConverter::isom_write_avcc(AVIOContext *pb, const uint8_t *d
 CBitstreamConverter::CBitstreamConverter()
 {
   m_convert_bitstream = false;
-  m_convertBuffer     = NULL;
-  m_convertSize       = 0;
+  m_converted         = false;
   m_inputBuffer       = NULL;
   m_inputSize         = 0;
   m_to_annexb         = false;
@@ -502,11 +415,6 @@ bool CBitstreamConverter::Open(enum AVCodecID codec, uint8_t *in_extradata, int
             CLog::Log(LOGINFO, "CBitstreamConverter::Open annexb to bitstream init 3 byte to 4 byte nal\n");
             // video content is from so silly encoder that think 3 byte NAL sizes
             // are valid, setup to convert 3 byte NAL sizes to 4 byte.
-            m_dllAvUtil = new DllAvUtil;
-            m_dllAvFormat = new DllAvFormat;
-            if (!m_dllAvUtil->Load() || !m_dllAvFormat->Load())
-              return false;
-
             in_extradata[4] = 0xFF;
             m_convert_3byteTo4byteNALSize = true;
            
@@ -535,20 +443,10 @@ void CBitstreamConverter::Close(void)
       free(m_sps_pps_context.sps_pps_data);
       m_sps_pps_context.sps_pps_data = NULL;
     }
-    if(m_convertBuffer)
-      free(m_convertBuffer);
-    m_convertSize       = 0;
   }
 
-  if (m_convert_bytestream)
-  {
-    if(m_convertBuffer)
-    {
-      m_dllAvUtil->av_free(m_convertBuffer);
-      m_convertBuffer = NULL;
-    }
-    m_convertSize = 0;
-  }
+  m_convertBuffer.Free();
+  m_converted = false;
 
   if(m_extradata)
     free(m_extradata);
@@ -560,6 +458,7 @@ void CBitstreamConverter::Close(void)
   m_convert_3byteTo4byteNALSize = false;
 
   m_convert_bitstream = false;
+  m_convert_bytestream = false;
 
   if (m_dllAvUtil)
   {
@@ -575,10 +474,8 @@ void CBitstreamConverter::Close(void)
 
 bool CBitstreamConverter::Convert(uint8_t *pData, int iSize)
 {
-  if(m_convertBuffer)
-    free(m_convertBuffer);
-  m_convertBuffer = NULL;
-  m_convertSize   = 0;
+  // the output buffer is kept, it only grows to the biggest packet seen
+  m_converted     = false;
   m_inputBuffer   = NULL;
   m_inputSize     = 0;
 
@@ -588,21 +485,12 @@ bool CBitstreamConverter::Convert(uint8_t *pData, int iSize)
     {
       if(m_to_annexb)
       {
-        int demuxer_bytes = iSize;
-  
-        uint8_t *demuxer_content = pData;
-
         if (m_convert_bitstream)
         {
           // convert demuxer packet from bitstream to bytestream (AnnexB)
-          int bytestream_size = 0;
-          uint8_t *bytestream_buff = NULL;
-
-          BitstreamConvert(demuxer_content, demuxer_bytes, &bytestream_buff, &bytestream_size);
-          if (bytestream_buff && (bytestream_size > 0))
+          if (BitstreamConvert(pData, iSize) && m_convertBuffer.Size() > 0)
           {
-            m_convertSize   = bytestream_size;
-            m_convertBuffer = bytestream_buff;
+            m_converted = true;
           }
           else
           {
@@ -627,50 +515,17 @@ bool CBitstreamConverter::Convert(uint8_t *pData, int iSize)
   
         if (m_convert_bytestream)
         {
-          if(m_convertBuffer)
-          {
-            m_dllAvUtil->av_free(m_convertBuffer);
-            m_convertBuffer = NULL;
-          }
-          m_convertSize = 0;
-
           // convert demuxer packet from bytestream (AnnexB) to bitstream
-          AVIOContext *pb;
-  
-          if(m_dllAvFormat->avio_open_dyn_buf(&pb) < 0)
-          {
+          if (bitstream_annexb_to_avcc(&m_convertBuffer, pData, iSize) < 0)
             return false;
-          }
-          m_convertSize = avc_parse_nal_units(pb, pData, iSize);
-          m_convertSize = m_dllAvFormat->avio_close_dyn_buf(pb, &m_convertBuffer);
+          m_converted = true;
         }
         else if (m_convert_3byteTo4byteNALSize)
         {
-          if(m_convertBuffer)
-          {
-            m_dllAvUtil->av_free(m_convertBuffer);
-            m_convertBuffer = NULL;
-          }
-          m_convertSize = 0;
-
           // convert demuxer packet from 3 byte NAL sizes to 4 byte
-          AVIOContext *pb;
-          if (m_dllAvFormat->avio_open_dyn_buf(&pb) < 0)
+          if (bitstream_nal3_to_nal4(&m_convertBuffer, pData, iSize) < 0)
             return false;
-
-          uint32_t nal_size;
-          uint8_t *end = pData + iSize;
-          uint8_t *nal_start = pData;
-          while (nal_start < end)
-          {
-            nal_size = OMX_RB24(nal_start);
-            m_dllAvFormat->avio_wb16(pb, nal_size);
-            nal_start += 3;
-            m_dllAvFormat->avio_write(pb, nal_start, nal_size);
-            nal_start += nal_size;
-          }
-  
-          m_convertSize = m_dllAvFormat->avio_close_dyn_buf(pb, &m_convertBuffer);
+          m_converted = true;
         }
         return true;
       }
@@ -683,16 +538,16 @@ bool CBitstreamConverter::Convert(uint8_t *pData, int iSize)
 
 uint8_t *CBitstreamConverter::GetConvertBuffer()
 {
-  if((m_convert_bitstream || m_convert_bytestream || m_convert_3byteTo4byteNALSize) && m_convertBuffer != NULL)
-    return m_convertBuffer;
+  if((m_convert_bitstream || m_convert_bytestream || m_convert_3byteTo4byteNALSize) && m_converted)
+    return m_convertBuffer.Data();
   else
     return m_inputBuffer;
 }
 
 int CBitstreamConverter::GetConvertSize()
 {
-  if((m_convert_bitstream || m_convert_bytestream || m_convert_3byteTo4byteNALSize) && m_convertBuffer != NULL)
-    return m_convertSize;
+  if((m_convert_bitstream || m_convert_bytestream || m_convert_3byteTo4byteNALSize) && m_converted)
+    return m_convertBuffer.Size();
   else
     return m_inputSize; 
 }
@@ -706,6 +561,41 @@ int CBitstreamConverter::GetExtraSize()
   return m_extrasize;
 }
 
+uint8_t *CBitstreamConverter::GetSpsPpsData()
+{
+  return m_convert_bitstream ? m_sps_pps_context.sps_pps_data : NULL;
+}
+int CBitstreamConverter::GetSpsPpsSize()
+{
+  return m_convert_bitstream ? m_sps_pps_context.size : 0;
+}
+
+bool CBitstreamConverter::ConvertBegin(uint8_t *pData, int iSize)
+{
+  if (m_codec != AV_CODEC_ID_H264 || !m_to_annexb || !m_convert_bitstream)
+    return false;
+
+  if (!m_writer.Begin(pData, iSize, m_sps_pps_context.length_size,
+    m_sps_pps_context.sps_pps_data, m_sps_pps_context.size, &m_sps_pps_context.first_idr))
+  {
+    CLog::Log(LOGERROR, "CBitstreamConverter::ConvertBegin broken packet of %d bytes\n", iSize);
+    return false;
+  }
+  return true;
+}
+
+int CBitstreamConverter::ConvertWrite(uint8_t *pDest, int iRoom)
+{
+  if (iRoom <= 0)
+    return 0;
+  return m_writer.Write(pDest, iRoom);
+}
+
+bool CBitstreamConverter::ConvertDone()
+{
+  return m_writer.IsDone();
+}
+
 bool CBitstreamConverter::BitstreamConvertInit(void *in_extradata, int in_extrasize)
 {
   // based on h264_mp4toannexb_bsf.c (ffmpeg)
@@ -765,97 +655,10 @@ bool CBitstreamConverter::BitstreamConvertInit(void *in_extradata, int in_extras
   return true;
 }
 
-bool CBitstreamConverter::BitstreamConvert(uint8_t* pData, int iSize, uint8_t **poutbuf, int *poutbuf_size)
+bool CBitstreamConverter::BitstreamConvert(uint8_t* pData, int iSize)
 {
-  // based on h264_mp4toannexb_bsf.c (ffmpeg)
-  // which is Copyright (c) 2007 Benoit Fouet <benoit.fouet@free.fr>
-  // and Licensed GPL 2.1 or greater
-
-
-  uint8_t *buf = pData;
-  uint32_t buf_size = iSize;
-  uint8_t  unit_type;
-  int32_t  nal_size;
-  uint32_t cumul_size = 0;
-  const uint8_t *buf_end = buf + buf_size;
-
-  do
-  {
-    if (buf + m_sps_pps_context.length_size > buf_end)
-      goto fail;
-
-    if (m_sps_pps_context.length_size == 1)
-      nal_size = buf[0];
-    else if (m_sps_pps_context.length_size == 2)
-      nal_size = buf[0] << 8 | buf[1];
-    else
-      nal_size = buf[0] << 24 | buf[1] << 16 | buf[2] << 8 | buf[3];
-
-    buf += m_sps_pps_context.length_size;
-    unit_type = *buf & 0x1f;
-
-    if (buf + nal_size > buf_end || nal_size < 0)
-      goto fail;
-
-    // prepend only to the first type 5 NAL unit of an IDR picture
-    if (m_sps_pps_context.first_idr && unit_type == 5)
-    {
-      BitstreamAllocAndCopy(poutbuf, poutbuf_size,
-        m_sps_pps_context.sps_pps_data, m_sps_pps_context.size, buf, nal_size);
-      m_sps_pps_context.first_idr = 0;
-    }
-    else
-    {
-      BitstreamAllocAndCopy(poutbuf, poutbuf_size, NULL, 0, buf, nal_size);
-      if (!m_sps_pps_context.first_idr && unit_type == 1)
-          m_sps_pps_context.first_idr = 1;
-    }
-
-    buf += nal_size;
-    cumul_size += nal_size + m_sps_pps_context.length_size;
-  } while (cumul_size < buf_size);
-
-  return true;
-
-fail:
-  free(*poutbuf);
-  *poutbuf = NULL;
-  *poutbuf_size = 0;
-  return false;
-}
-
-void CBitstreamConverter::BitstreamAllocAndCopy( uint8_t **poutbuf, int *poutbuf_size,
-    const uint8_t *sps_pps, uint32_t sps_pps_size, const uint8_t *in, uint32_t in_size)
-{
-  // based on h264_mp4toannexb_bsf.c (ffmpeg)
-  // which is Copyright (c) 2007 Benoit Fouet <benoit.fouet@free.fr>
-  // and Licensed GPL 2.1 or greater
-
-  #define CHD_WB32(p, d) { \
-    ((uint8_t*)(p))[3] = (d); \
-    ((uint8_t*)(p))[2] = (d) >> 8; \
-    ((uint8_t*)(p))[1] = (d) >> 16; \
-    ((uint8_t*)(p))[0] = (d) >> 24; }
-
-  uint32_t offset = *poutbuf_size;
-  uint8_t nal_header_size = offset ? 3 : 4;
-
-  *poutbuf_size += sps_pps_size + in_size + nal_header_size;
-  *poutbuf = (uint8_t*)realloc(*poutbuf, *poutbuf_size);
-  if (sps_pps)
-    memcpy(*poutbuf + offset, sps_pps, sps_pps_size);
-
-  memcpy(*poutbuf + sps_pps_size + nal_header_size + offset, in, in_size);
-  if (!offset)
-  {
-    CHD_WB32(*poutbuf + sps_pps_size, 1);
-  }
-  else
-  {
-    (*poutbuf + offset + sps_pps_size)[0] = 0;
-    (*poutbuf + offset + sps_pps_size)[1] = 0;
-    (*poutbuf + offset + sps_pps_size)[2] = 1;
-  }
+  // writes straight into m_convertBuffer, which only reallocates when a
+  // packet is bigger than any before it
+  return bitstream_avcc_to_annexb(&m_convertBuffer, pData, iSize, m_sps_pps_context.length_size,
+    m_sps_pps_context.sps_pps_data, m_sps_pps_context.size, &m_sps_pps_context.first_idr) >= 0;
 }
-
-
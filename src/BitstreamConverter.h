@@ -26,6 +26,7 @@
 #include "DllAvUtil.h"
 #include "DllAvFormat.h"
 #include "DllAvCodec.h"
+#include "BitstreamUtils.h"
 
 typedef struct {
   uint8_t *buffer, *start;
@@ -122,6 +123,15 @@ public:
   int GetConvertSize();
   uint8_t *GetExtraData(void);
   int GetExtraSize();
+  // Annex B SPS/PPS taken from the avcC extradata, NULL unless converting to Annex B
+  uint8_t *GetSpsPpsData(void);
+  int GetSpsPpsSize();
+  // bitstream to Annex B written straight into the caller's buffers, in place
+  // of Convert() and GetConvertBuffer(). pData has to stay valid until
+  // ConvertDone() returns true
+  bool ConvertBegin(uint8_t *pData, int iSize);
+  int ConvertWrite(uint8_t *pDest, int iRoom);
+  bool ConvertDone(void);
   void parseh264_sps(uint8_t *sps, uint32_t sps_size, bool *interlaced, int32_t *max_ref_frames);
 protected:
   // bytestream (Annex B) to bistream conversion support.
@@ -129,16 +139,10 @@ protected:
   uint32_t nal_bs_read(nal_bitstream *bs, int n);
   bool nal_bs_eos(nal_bitstream *bs);
   int nal_bs_read_ue(nal_bitstream *bs);
-  const uint8_t *avc_find_startcode_internal(const uint8_t *p, const uint8_t *end);
-  const uint8_t *avc_find_startcode(const uint8_t *p, const uint8_t *end);
-  const int avc_parse_nal_units(AVIOContext *pb, const uint8_t *buf_in, int size);
-  const int avc_parse_nal_units_buf(const uint8_t *buf_in, uint8_t **buf, int *size);
   const int isom_write_avcc(AVIOContext *pb, const uint8_t *data, int len);
   // bitstream to bytestream (Annex B) conversion support.
   bool BitstreamConvertInit(void *in_extradata, int in_extrasize);
-  bool BitstreamConvert(uint8_t* pData, int iSize, uint8_t **poutbuf, int *poutbuf_size);
-  void BitstreamAllocAndCopy( uint8_t **poutbuf, int *poutbuf_size,
-    const uint8_t *sps_pps, uint32_t sps_pps_size, const uint8_t *in, uint32_t in_size);
+  bool BitstreamConvert(uint8_t* pData, int iSize);
 
   typedef struct omx_bitstream_ctx {
       uint8_t  length_size;
@@ -147,8 +151,10 @@ protected:
       uint32_t size;
   } omx_bitstream_ctx;
 
-  uint8_t           *m_convertBuffer;
-  int               m_convertSize;
+  // reused for every packet, see CBitstreamBuffer
+  CBitstreamBuffer  m_convertBuffer;
+  bool              m_converted;
+  CBitstreamAnnexBWriter m_writer;
   uint8_t           *m_inputBuffer;
   int               m_inputSize;
 
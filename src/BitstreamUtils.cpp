@@ -0,0 +1,479 @@
+#include "BitstreamUtils.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "utils/CPUFeatures.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BITSTREAM_HAVE_SSE2
+#elif defined(CPU_HAVE_NEON_KERNELS)
+#define BITSTREAM_HAVE_NEON
+#endif
+
+#define BITSTREAM_RB24(x) \
+  ((((const uint8_t*)(x))[0] << 16) | \
+   (((const uint8_t*)(x))[1] <<  8) | \
+   ((const uint8_t*)(x))[2])
+
+static inline void bitstream_wb32(uint8_t *p, uint32_t d)
+{
+  p[0] = d >> 24;
+  p[1] = d >> 16;
+  p[2] = d >> 8;
+  p[3] = d;
+}
+
+CBitstreamBuffer::CBitstreamBuffer()
+{
+  m_data     = NULL;
+  m_size     = 0;
+  m_capacity = 0;
+  m_grows    = 0;
+}
+
+CBitstreamBuffer::~CBitstreamBuffer()
+{
+  Free();
+}
+
+bool CBitstreamBuffer::Reserve(size_t size)
+{
+  if(size <= m_capacity)
+    return true;
+
+  // grow by half at least so a stream settles after a few packets
+  size_t capacity = m_capacity + m_capacity / 2;
+  if(capacity < size)
+    capacity = size;
+
+  uint8_t *data = (uint8_t *)realloc(m_data, capacity + BITSTREAM_BUFFER_PADDING);
+  if(!data)
+    return false;
+
+  m_data     = data;
+  m_capacity = capacity;
+  m_grows++;
+  return true;
+}
+
+void CBitstreamBuffer::Free()
+{
+  free(m_data);
+  m_data     = NULL;
+  m_size     = 0;
+  m_capacity = 0;
+}
+
+static int bitstream_finish(CBitstreamBuffer *out, size_t size)
+{
+  if(!out->Reserve(size))
+    return -1;
+
+  if(out->Data())
+    memset(out->Data() + size, 0, BITSTREAM_BUFFER_PADDING);
+  out->SetSize(size);
+  return (int)size;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// start code scanners, all of them return the first 00 00 01 in [p, end)
+
+static const uint8_t *find_startcode_c(const uint8_t *p, const uint8_t *end)
+{
+  if(end - p < 3)
+    return end;
+
+  for(const uint8_t *last = end - 2; p < last; p++)
+  {
+    if(p[0] == 0 && p[1] == 0 && p[2] == 1)
+      return p;
+  }
+  return end;
+}
+
+static const uint8_t *find_startcode_word(const uint8_t *p, const uint8_t *end)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  const uint64_t low7 = 0x7f7f7f7f7f7f7f7fULL;
+
+  // every candidate reads up to two bytes past the word
+  while(end - p >= 10)
+  {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+
+    // 0x80 in every byte that is zero, exact unlike the usual haszero trick
+    uint64_t zero = ~(((x & low7) + low7) | x | low7);
+    if(zero)
+    {
+      // byte i and i + 1 both zero, the last byte pairs with the next word
+      uint64_t pairs = zero & (zero >> 8);
+      if((zero >> 56) && p[8] == 0)
+        pairs |= 0x8000000000000000ULL;
+
+      while(pairs)
+      {
+        int i = __builtin_ctzll(pairs) >> 3;
+        if(p[i + 2] == 1)
+          return p + i;
+        pairs &= pairs - 1;
+      }
+    }
+    p += 8;
+  }
+#endif
+  return find_startcode_c(p, end);
+}
+
+#if defined(BITSTREAM_HAVE_SSE2)
+static const uint8_t *find_startcode_simd(const uint8_t *p, const uint8_t *end)
+{
+  const __m128i zero = _mm_setzero_si128();
+
+  while(end - p >= 18)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    unsigned int z = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+    if(z)
+    {
+      unsigned int pairs = z & (z >> 1);
+      if((z & 0x8000) && p[16] == 0)
+        pairs |= 0x8000;
+
+      while(pairs)
+      {
+        int i = __builtin_ctz(pairs);
+        if(p[i + 2] == 1)
+          return p + i;
+        pairs &= pairs - 1;
+      }
+    }
+    p += 16;
+  }
+  return find_startcode_c(p, end);
+}
+
+static bool simd_supported(void)
+{
+  return __builtin_cpu_supports("sse2");
+}
+
+static const char *simd_name = "sse2";
+#elif defined(BITSTREAM_HAVE_NEON)
+// BitstreamUtilsNeon.cpp, the only file built with NEON enabled
+const uint8_t *bitstream_find_startcode_neon(const uint8_t *p, const uint8_t *end);
+
+static const uint8_t *find_startcode_simd(const uint8_t *p, const uint8_t *end)
+{
+  return bitstream_find_startcode_neon(p, end);
+}
+
+static bool simd_supported(void)
+{
+  return cpu_has_neon();
+}
+
+static const char *simd_name = "neon";
+#endif
+
+typedef const uint8_t *(*find_startcode_func)(const uint8_t *p, const uint8_t *end);
+
+static const uint8_t *find_startcode_select(const uint8_t *p, const uint8_t *end);
+
+static find_startcode_func find_startcode      = find_startcode_select;
+static const char         *find_startcode_name = "";
+
+// picks the scanner on first use
+static const uint8_t *find_startcode_select(const uint8_t *p, const uint8_t *end)
+{
+  bitstream_set_scanner(BITSTREAM_SCANNER_AUTO);
+  return find_startcode(p, end);
+}
+
+bool bitstream_set_scanner(BitstreamScanner scanner)
+{
+  switch(scanner)
+  {
+    case BITSTREAM_SCANNER_AUTO:
+#if defined(BITSTREAM_HAVE_SSE2) || defined(BITSTREAM_HAVE_NEON)
+      if(bitstream_set_scanner(BITSTREAM_SCANNER_SIMD))
+        return true;
+#endif
+      return bitstream_set_scanner(BITSTREAM_SCANNER_WORD);
+    case BITSTREAM_SCANNER_C:
+      find_startcode      = find_startcode_c;
+      find_startcode_name = "c";
+      return true;
+    case BITSTREAM_SCANNER_WORD:
+      find_startcode      = find_startcode_word;
+      find_startcode_name = "word";
+      return true;
+    case BITSTREAM_SCANNER_SIMD:
+#if defined(BITSTREAM_HAVE_SSE2) || defined(BITSTREAM_HAVE_NEON)
+      if(!simd_supported())
+        return false;
+      find_startcode      = find_startcode_simd;
+      find_startcode_name = simd_name;
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+const char *bitstream_get_scanner_name(void)
+{
+  if(find_startcode == find_startcode_select)
+    bitstream_set_scanner(BITSTREAM_SCANNER_AUTO);
+  return find_startcode_name;
+}
+
+const uint8_t *bitstream_find_startcode(const uint8_t *p, const uint8_t *end)
+{
+  return find_startcode(p, end);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// conversions, based on h264_mp4toannexb_bsf.c and avc.c (ffmpeg)
+// which are Copyright (c) 2007 Benoit Fouet <benoit.fouet@free.fr>
+// and Copyright (c) 2006 Baptiste Coudurier <baptiste.coudurier@smartjog.com>
+// and Licensed GPL 2.1 or greater
+
+static inline uint32_t read_nal_size(const uint8_t *p, int length_size)
+{
+  uint32_t nal_size = 0;
+  for(int i = 0; i < length_size; i++)
+    nal_size = (nal_size << 8) | p[i];
+  return nal_size;
+}
+
+CBitstreamAnnexBWriter::CBitstreamAnnexBWriter()
+{
+  m_in           = NULL;
+  m_end          = NULL;
+  m_length_size  = 4;
+  m_sps_pps      = NULL;
+  m_sps_pps_size = 0;
+  m_first_idr    = NULL;
+  m_size         = 0;
+  m_queued       = 0;
+  m_prefix       = NULL;
+  m_prefix_left  = 0;
+  m_header_pos   = 0;
+  m_header_size  = 0;
+  m_payload      = NULL;
+  m_payload_left = 0;
+}
+
+bool CBitstreamAnnexBWriter::Begin(const uint8_t *in, int size, int length_size,
+                                   const uint8_t *sps_pps, int sps_pps_size, uint8_t *first_idr)
+{
+  m_in = m_end = NULL;
+  m_prefix_left = m_header_size = m_header_pos = m_payload_left = 0;
+  m_size = m_queued = 0;
+
+  if(!in || size <= 0 || length_size < 1 || length_size > 4)
+    return false;
+
+  // walk the packet once so a broken one is refused before anything is
+  // written, working out the output size on the way
+  const uint8_t *buf     = in;
+  const uint8_t *buf_end = in + size;
+  uint8_t        idr     = *first_idr;
+  size_t         out     = 0;
+  do
+  {
+    if(buf_end - buf < length_size)
+      return false;
+
+    uint32_t nal_size = read_nal_size(buf, length_size);
+    buf += length_size;
+    if(nal_size > (uint32_t)(buf_end - buf))
+      return false;
+
+    uint8_t unit_type = nal_size ? (*buf & 0x1f) : 0;
+    size_t  prefix    = 0;
+    if(idr && unit_type == 5)
+    {
+      prefix = sps_pps_size;
+      idr = 0;
+    }
+    else if(!idr && unit_type == 1)
+    {
+      idr = 1;
+    }
+    out += prefix + (out ? 3 : 4) + nal_size;
+    buf += nal_size;
+  } while(buf < buf_end);
+
+  m_in           = in;
+  m_end          = buf_end;
+  m_length_size  = length_size;
+  m_sps_pps      = sps_pps;
+  m_sps_pps_size = sps_pps_size;
+  m_first_idr    = first_idr;
+  m_size         = out;
+  return true;
+}
+
+bool CBitstreamAnnexBWriter::NextNal()
+{
+  if(m_in >= m_end)
+    return false;
+
+  uint32_t nal_size = read_nal_size(m_in, m_length_size);
+  m_in += m_length_size;
+
+  uint8_t unit_type = nal_size ? (*m_in & 0x1f) : 0;
+  // prepend only to the first type 5 NAL unit of an IDR picture
+  if(*m_first_idr && unit_type == 5)
+  {
+    m_prefix      = m_sps_pps;
+    m_prefix_left = m_sps_pps_size;
+    *m_first_idr  = 0;
+  }
+  else if(!*m_first_idr && unit_type == 1)
+  {
+    *m_first_idr = 1;
+  }
+
+  // 4 byte start code on the first NAL unit of the packet, 3 after that
+  m_header_size = m_queued ? 3 : 4;
+  m_header_pos  = 0;
+  memset(m_header, 0, sizeof(m_header));
+  m_header[m_header_size - 1] = 1;
+
+  m_payload      = m_in;
+  m_payload_left = nal_size;
+  m_queued      += m_prefix_left + m_header_size + nal_size;
+  m_in          += nal_size;
+  return true;
+}
+
+size_t CBitstreamAnnexBWriter::Write(uint8_t *dst, size_t room)
+{
+  size_t written = 0;
+
+  while(written < room)
+  {
+    size_t n;
+    if(m_prefix_left)
+    {
+      n = std::min(room - written, m_prefix_left);
+      memcpy(dst + written, m_prefix, n);
+      m_prefix      += n;
+      m_prefix_left -= n;
+    }
+    else if(m_header_pos < m_header_size)
+    {
+      n = std::min(room - written, m_header_size - m_header_pos);
+      memcpy(dst + written, m_header + m_header_pos, n);
+      m_header_pos += n;
+    }
+    else if(m_payload_left)
+    {
+      n = std::min(room - written, m_payload_left);
+      memcpy(dst + written, m_payload, n);
+      m_payload      += n;
+      m_payload_left -= n;
+    }
+    else if(!NextNal())
+    {
+      break;
+    }
+    else
+    {
+      continue;
+    }
+    written += n;
+  }
+  return written;
+}
+
+bool CBitstreamAnnexBWriter::IsDone() const
+{
+  return m_in >= m_end && !m_prefix_left && m_header_pos >= m_header_size && !m_payload_left;
+}
+
+int bitstream_avcc_to_annexb(CBitstreamBuffer *out, const uint8_t *in, int size, int length_size,
+                             const uint8_t *sps_pps, int sps_pps_size, uint8_t *first_idr)
+{
+  CBitstreamAnnexBWriter writer;
+  if(!writer.Begin(in, size, length_size, sps_pps, sps_pps_size, first_idr))
+    return -1;
+
+  if(!out->Reserve(writer.GetSize()))
+    return -1;
+
+  size_t written = writer.Write(out->Data(), writer.GetSize());
+  return bitstream_finish(out, written);
+}
+
+// start code including a leading zero byte, like avc_find_startcode
+static const uint8_t *find_nal_startcode(const uint8_t *p, const uint8_t *end)
+{
+  const uint8_t *out = bitstream_find_startcode(p, end);
+  if(p < out && out < end && !out[-1])
+    out--;
+  return out;
+}
+
+int bitstream_annexb_to_avcc(CBitstreamBuffer *out, const uint8_t *in, int size)
+{
+  const uint8_t *end       = in + size;
+  const uint8_t *nal_start = find_nal_startcode(in, end);
+  const uint8_t *nal_end;
+  size_t         pos       = 0;
+
+  for(;;)
+  {
+    while(nal_start < end && !*(nal_start++));
+    if(nal_start == end)
+      break;
+
+    nal_end = find_nal_startcode(nal_start, end);
+    size_t nal_size = nal_end - nal_start;
+
+    if(!out->Reserve(pos + 4 + nal_size))
+      return -1;
+
+    bitstream_wb32(out->Data() + pos, nal_size);
+    memcpy(out->Data() + pos + 4, nal_start, nal_size);
+    pos += 4 + nal_size;
+    nal_start = nal_end;
+  }
+
+  return bitstream_finish(out, pos);
+}
+
+int bitstream_nal3_to_nal4(CBitstreamBuffer *out, const uint8_t *in, int size)
+{
+  const uint8_t *nal_start = in;
+  const uint8_t *end       = in + size;
+  size_t         pos       = 0;
+
+  while(nal_start < end)
+  {
+    if(end - nal_start < 3)
+      return -1;
+
+    uint32_t nal_size = BITSTREAM_RB24(nal_start);
+    nal_start += 3;
+    if(nal_size > (uint32_t)(end - nal_start))
+      return -1;
+
+    if(!out->Reserve(pos + 4 + nal_size))
+      return -1;
+
+    bitstream_wb32(out->Data() + pos, nal_size);
+    memcpy(out->Data() + pos + 4, nal_start, nal_size);
+    pos += 4 + nal_size;
+    nal_start += nal_size;
+  }
+
+  return bitstream_finish(out, pos);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+// H.264 NAL unit helpers used by CBitstreamConverter. Nothing in here depends
+// on ffmpeg or OMX so it can be built and benchmarked on its own.
+
+// zeroed bytes kept after the data, like AV_INPUT_BUFFER_PADDING_SIZE
+#define BITSTREAM_BUFFER_PADDING 64
+
+// Output buffer that is reused from packet to packet. It only ever grows, so
+// once it has seen the biggest packet of a stream converting doesn't allocate.
+class CBitstreamBuffer
+{
+public:
+  CBitstreamBuffer();
+  ~CBitstreamBuffer();
+
+  // make room for size bytes, keeping the current contents
+  bool Reserve(size_t size);
+  void Free();
+
+  uint8_t *Data() const         { return m_data; }
+  size_t   Size() const         { return m_size; }
+  void     SetSize(size_t size) { m_size = size; }
+  size_t   Capacity() const     { return m_capacity; }
+  unsigned Grows() const        { return m_grows; }
+
+private:
+  CBitstreamBuffer(const CBitstreamBuffer &);
+  CBitstreamBuffer &operator=(const CBitstreamBuffer &);
+
+  uint8_t  *m_data;
+  size_t    m_size;
+  size_t    m_capacity;
+  unsigned  m_grows;
+};
+
+enum BitstreamScanner
+{
+  BITSTREAM_SCANNER_AUTO = 0, // best one the cpu supports
+  BITSTREAM_SCANNER_C,        // byte by byte
+  BITSTREAM_SCANNER_WORD,     // 64 bit words, looks for two zero bytes at once
+  BITSTREAM_SCANNER_SIMD      // SSE2 or NEON
+};
+
+// first 00 00 01 in [p, end), end if there is none
+const uint8_t *bitstream_find_startcode(const uint8_t *p, const uint8_t *end);
+// false if the scanner isn't built in or the cpu can't run it
+bool bitstream_set_scanner(BitstreamScanner scanner);
+const char *bitstream_get_scanner_name(void);
+
+// Length prefixed (avcC) NAL units to Annex B. sps_pps is put in front of
+// the first IDR slice after a non-IDR one, *first_idr tracks that across
+// packets. Returns the output size or -1 if the packet is broken.
+int bitstream_avcc_to_annexb(CBitstreamBuffer *out, const uint8_t *in, int size, int length_size,
+                             const uint8_t *sps_pps, int sps_pps_size, uint8_t *first_idr);
+// Streaming form of bitstream_avcc_to_annexb(). The output is written piece by
+// piece into whatever buffers the caller has at hand, e.g. decoder input
+// buffers, so the packet is never converted into a buffer of its own first.
+class CBitstreamAnnexBWriter
+{
+public:
+  CBitstreamAnnexBWriter();
+
+  // checks the NAL lengths of the packet, false if it is broken. in, sps_pps
+  // and first_idr have to stay valid until IsDone()
+  bool Begin(const uint8_t *in, int size, int length_size,
+             const uint8_t *sps_pps, int sps_pps_size, uint8_t *first_idr);
+  // writes up to room bytes, returns how many were written
+  size_t Write(uint8_t *dst, size_t room);
+  bool IsDone() const;
+  // output size of the whole packet
+  size_t GetSize() const { return m_size; }
+
+private:
+  bool NextNal();
+
+  const uint8_t *m_in;
+  const uint8_t *m_end;
+  int            m_length_size;
+  const uint8_t *m_sps_pps;
+  int            m_sps_pps_size;
+  uint8_t       *m_first_idr;
+  size_t         m_size;
+  size_t         m_queued;   // output of the NAL units started so far
+
+  // what is left of the current NAL unit
+  const uint8_t *m_prefix;
+  size_t         m_prefix_left;
+  uint8_t        m_header[4];
+  size_t         m_header_pos;
+  size_t         m_header_size;
+  const uint8_t *m_payload;
+  size_t         m_payload_left;
+};
+
+// Annex B to 4 byte length prefixed NAL units
+int bitstream_annexb_to_avcc(CBitstreamBuffer *out, const uint8_t *in, int size);
+// 3 byte NAL length prefixes to 4 byte ones
+int bitstream_nal3_to_nal4(CBitstreamBuffer *out, const uint8_t *in, int size);
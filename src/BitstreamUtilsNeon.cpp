@@ -0,0 +1,52 @@
+#include "BitstreamUtils.h"
+
+// NEON start code scanner. BitstreamUtils.cpp only picks it once
+// cpu_has_neon() said yes, so this file alone is built with NEON enabled.
+
+#if defined(__arm__) || defined(__aarch64__)
+
+#if defined(__arm__) && !defined(__ARM_NEON)
+#pragma GCC target("fpu=neon")
+#endif
+#include <arm_neon.h>
+
+const uint8_t *bitstream_find_startcode_neon(const uint8_t *p, const uint8_t *end)
+{
+  const uint8x16_t zero = vdupq_n_u8(0);
+
+  while(end - p >= 18)
+  {
+    uint8x16_t eq = vceqq_u8(vld1q_u8(p), zero);
+#if defined(__aarch64__)
+    bool any = vmaxvq_u8(eq) != 0;
+#else
+    uint8x8_t m = vorr_u8(vget_low_u8(eq), vget_high_u8(eq));
+    m = vpmax_u8(m, m);
+    m = vpmax_u8(m, m);
+    m = vpmax_u8(m, m);
+    bool any = vget_lane_u8(m, 0) != 0;
+#endif
+    // no zero byte means no start code can begin in these 16 bytes
+    if(any)
+    {
+      for(int i = 0; i < 16; i++)
+      {
+        if(p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1)
+          return p + i;
+      }
+    }
+    p += 16;
+  }
+
+  // the tail is short, plain C
+  if(end - p < 3)
+    return end;
+  for(const uint8_t *last = end - 2; p < last; p++)
+  {
+    if(p[0] == 0 && p[1] == 0 && p[2] == 1)
+      return p;
+  }
+  return end;
+}
+
+#endif
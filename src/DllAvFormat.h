@@ -102,6 +102,9 @@ public:
   virtual int av_write_frame  (AVFormatContext *s, AVPacket *pkt)=0;
   virtual int avformat_network_init  (void)=0;
   virtual int avformat_network_deinit  (void)=0;
+  // AVStream::index_entries went private in 58.78, older versions read it directly
+  virtual int avformat_index_get_entries_count(const AVStream *st)=0;
+  virtual const AVIndexEntry *avformat_index_get_entry(AVStream *st, int idx)=0;
 };
 
 #if (defined USE_EXTERNAL_FFMPEG) || (defined TARGET_DARWIN) 
@@ -158,6 +161,13 @@ public:
   virtual int av_write_frame  (AVFormatContext *s, AVPacket *pkt) { return ::av_write_frame(s, pkt); }
   virtual int avformat_network_init  (void) { return ::avformat_network_init(); }
   virtual int avformat_network_deinit  (void) { return ::avformat_network_deinit(); }
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+  virtual int avformat_index_get_entries_count(const AVStream *st) { return ::avformat_index_get_entries_count(st); }
+  virtual const AVIndexEntry *avformat_index_get_entry(AVStream *st, int idx) { return ::avformat_index_get_entry(st, idx); }
+#else
+  virtual int avformat_index_get_entries_count(const AVStream *st) { return st->nb_index_entries; }
+  virtual const AVIndexEntry *avformat_index_get_entry(AVStream *st, int idx) { return idx >= 0 && idx < st->nb_index_entries ? &st->index_entries[idx] : NULL; }
+#endif
 
   // DLL faking.
   virtual bool ResolveExports() { return true; }
@@ -214,6 +224,10 @@ class DllAvFormat : public DllDynamic, DllAvFormatInterface
   DEFINE_METHOD2(int, av_write_frame  , (AVFormatContext *p1, AVPacket *p2))
   DEFINE_METHOD0(int, avformat_network_init)
   DEFINE_METHOD0(int, avformat_network_deinit)
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+  DEFINE_METHOD1(int, avformat_index_get_entries_count, (const AVStream *p1))
+  DEFINE_METHOD2(const AVIndexEntry *, avformat_index_get_entry, (AVStream *p1, int p2))
+#endif
   BEGIN_METHOD_RESOLVE()
     RESOLVE_METHOD_RENAME(av_register_all, av_register_all_dont_call)
     RESOLVE_METHOD(av_find_input_format)
@@ -250,6 +264,10 @@ class DllAvFormat : public DllDynamic, DllAvFormatInterface
     RESOLVE_METHOD(av_write_frame)
     RESOLVE_METHOD(avformat_network_init)
     RESOLVE_METHOD(avformat_network_deinit)
+#if LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT(58, 78, 100)
+    RESOLVE_METHOD(avformat_index_get_entries_count)
+    RESOLVE_METHOD(avformat_index_get_entry)
+#endif
   END_METHOD_RESOLVE()
 
   /* dependencies of libavformat */
@@ -265,6 +283,10 @@ public:
   {
     return avformat_find_stream_info_dont_call(ic, options);
   }
+#if LIBAVFORMAT_VERSION_INT < AV_VERSION_INT(58, 78, 100)
+  virtual int avformat_index_get_entries_count(const AVStream *st) { return st->nb_index_entries; }
+  virtual const AVIndexEntry *avformat_index_get_entry(AVStream *st, int idx) { return idx >= 0 && idx < st->nb_index_entries ? &st->index_entries[idx] : NULL; }
+#endif
 
   virtual bool Load()
   {
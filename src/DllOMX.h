@@ -60,7 +60,39 @@ public:
 
 };
 
-#if (defined USE_EXTERNAL_OMX)
+#if (defined USE_SOFT_OMX)
+#include "OMXSoftCore.h"
+
+class DllOMX : public DllDynamic, DllOMXInterface
+{
+public:
+  virtual OMX_ERRORTYPE OMX_Init(void) 
+    { return ::OMXSOFT_Init(); };
+  virtual OMX_ERRORTYPE OMX_Deinit(void) 
+    { return ::OMXSOFT_Deinit(); };
+  virtual OMX_ERRORTYPE OMX_GetHandle(OMX_HANDLETYPE *pHandle, OMX_STRING cComponentName, OMX_PTR pAppData, OMX_CALLBACKTYPE *pCallBacks)
+    { return ::OMXSOFT_GetHandle(pHandle, cComponentName, pAppData, pCallBacks); };
+  virtual OMX_ERRORTYPE OMX_FreeHandle(OMX_HANDLETYPE hComponent)
+    { return ::OMXSOFT_FreeHandle(hComponent); };
+  virtual OMX_ERRORTYPE OMX_GetComponentsOfRole(OMX_STRING role, OMX_U32 *pNumComps, OMX_U8 **compNames) 
+    { return OMX_ErrorNotImplemented; };
+  virtual OMX_ERRORTYPE OMX_GetRolesOfComponent(OMX_STRING compName, OMX_U32 *pNumRoles, OMX_U8 **roles)
+    { return OMX_ErrorNotImplemented; };
+  virtual OMX_ERRORTYPE OMX_ComponentNameEnum(OMX_STRING cComponentName, OMX_U32 nNameLength, OMX_U32 nIndex)
+    { return OMX_ErrorNotImplemented; };
+  virtual OMX_ERRORTYPE OMX_SetupTunnel(OMX_HANDLETYPE hOutput, OMX_U32 nPortOutput, OMX_HANDLETYPE hInput, OMX_U32 nPortInput)
+    { return ::OMXSOFT_SetupTunnel(hOutput, nPortOutput, hInput, nPortInput); };
+  virtual bool ResolveExports() 
+    { return true; }
+  virtual bool Load() 
+  {
+    CLog::Log(LOGDEBUG, "DllOMX: Using software omx core");
+    return true;
+  }
+  virtual void Unload() {}
+  static DllOMX *GetDllOMX() { static DllOMX static_dll_omx; return &static_dll_omx; }
+};
+#elif (defined USE_EXTERNAL_OMX)
 class DllOMX : public DllDynamic, DllOMXInterface
 {
 public:
@@ -21,6 +21,7 @@
 #include "linux/PlatformDefs.h"
 #include <iostream>
 #include <stdio.h>
+#include <sys/mman.h>
 #include "utils/StdString.h"
 
 #include "File.h"
@@ -42,13 +43,18 @@ CFile::CFile()
   m_flags = 0;
   m_iLength = 0;
   m_bPipe = false;
+  m_fd = -1;
+  m_pMap = NULL;
+  m_iMapPosition = 0;
+  m_iAdviseStart = 0;
+  m_iAdviseEnd = 0;
+  memset(&m_readStats, 0, sizeof(m_readStats));
 }
 
 //*********************************************************************************************
 CFile::~CFile()
 {
-  if(m_pFile && !m_bPipe)
-    fclose(m_pFile);
+  Close();
 }
 
 //*********************************************************************************************
@@ -63,6 +69,10 @@ bool CFile::Open(const CStdString& strFileName, unsigned int flags)
     m_iLength = 0;
     return true;
   }
+
+  if((flags & READ_MMAP) && OpenMapped(strFileName))
+    return true;
+
   m_pFile = fopen64(strFileName.c_str(), "r");
   if(!m_pFile)
     return false;
@@ -74,6 +84,66 @@ bool CFile::Open(const CStdString& strFileName, unsigned int flags)
   return true;
 }
 
+bool CFile::OpenMapped(const CStdString& strFileName)
+{
+  int fd = open(strFileName.c_str(), O_RDONLY | O_LARGEFILE);
+  if(fd < 0)
+    return false;
+
+  struct stat64 st;
+  if(fstat64(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+     (uint64_t)st.st_size > (size_t)-1)
+  {
+    close(fd);
+    return false;
+  }
+
+  // on 32 bit a big file may not fit into the address space, fall back to stdio then
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if(map == MAP_FAILED)
+  {
+    close(fd);
+    return false;
+  }
+
+  madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+  m_fd = fd;
+  m_pMap = (uint8_t *)map;
+  m_iLength = st.st_size;
+  m_iMapPosition = 0;
+  m_iAdviseStart = 0;
+  m_iAdviseEnd = 0;
+  AdviseWindow();
+
+  return true;
+}
+
+// keep MMAP_READAHEAD_WINDOW bytes ahead of the read position paged in. the
+// window is only moved once half of it has been consumed so this costs one
+// madvise per couple of MB read
+void CFile::AdviseWindow()
+{
+  if(m_iMapPosition >= m_iLength)
+    return;
+
+  bool outside = m_iMapPosition < m_iAdviseStart || m_iMapPosition >= m_iAdviseEnd;
+  bool half_used = m_iAdviseEnd < m_iLength && m_iMapPosition >= m_iAdviseEnd - MMAP_READAHEAD_WINDOW / 2;
+
+  if(outside || half_used)
+  {
+    long page = sysconf(_SC_PAGESIZE);
+    int64_t start = m_iMapPosition & ~((int64_t)page - 1);
+    int64_t end = m_iMapPosition + MMAP_READAHEAD_WINDOW;
+    if(end > m_iLength)
+      end = m_iLength;
+
+    madvise(m_pMap + start, end - start, MADV_WILLNEED);
+    m_iAdviseStart = start;
+    m_iAdviseEnd = end;
+  }
+}
+
 bool CFile::OpenForWrite(const CStdString& strFileName, bool bOverWrite)
 {
   return false;
@@ -100,17 +170,49 @@ unsigned int CFile::Read(void *lpBuf, int64_t uiBufSize)
 {
   unsigned int ret = 0;
 
+  if(m_pMap)
+  {
+    if(uiBufSize <= 0 || m_iMapPosition >= m_iLength)
+      return 0;
+
+    m_readStats.reads++;
+    if(uiBufSize > m_iLength - m_iMapPosition)
+      uiBufSize = m_iLength - m_iMapPosition;
+    else
+      m_readStats.full_reads++;
+
+    memcpy(lpBuf, m_pMap + m_iMapPosition, uiBufSize);
+    m_iMapPosition += uiBufSize;
+    AdviseWindow();
+
+    m_readStats.bytes += uiBufSize;
+    return uiBufSize;
+  }
+
   if(!m_pFile)
     return 0;
 
   ret = fread(lpBuf, 1, uiBufSize, m_pFile);
 
+  m_readStats.reads++;
+  m_readStats.stdio_reads++;
+  if(ret == uiBufSize)
+    m_readStats.full_reads++;
+  m_readStats.bytes += ret;
+
   return ret;
 }
 
 //*********************************************************************************************
 void CFile::Close()
 {
+  if(m_pMap)
+  {
+    munmap(m_pMap, m_iLength);
+    close(m_fd);
+    m_pMap = NULL;
+    m_fd = -1;
+  }
   if(m_pFile && !m_bPipe)
     fclose(m_pFile);
   m_pFile = NULL;
@@ -119,6 +221,24 @@ void CFile::Close()
 //*********************************************************************************************
 int64_t CFile::Seek(int64_t iFilePosition, int iWhence)
 {
+  if (m_pMap)
+  {
+    int64_t pos = iFilePosition;
+    if (iWhence == SEEK_CUR)
+      pos += m_iMapPosition;
+    else if (iWhence == SEEK_END)
+      pos += m_iLength;
+    else if (iWhence != SEEK_SET)
+      return -1;
+
+    if (pos < 0)
+      return -1;
+
+    m_iMapPosition = pos;
+    AdviseWindow();
+    return 0;
+  }
+
   if (!m_pFile)
     return -1;
 
@@ -134,6 +254,9 @@ int64_t CFile::GetLength()
 //*********************************************************************************************
 int64_t CFile::GetPosition()
 {
+  if (m_pMap)
+    return m_iMapPosition;
+
   if (!m_pFile)
     return -1;
 
@@ -148,6 +271,9 @@ int CFile::Write(const void* lpBuf, int64_t uiBufSize)
 
 int CFile::IoControl(EIoControl request, void* param)
 {
+  if(request == IOCTRL_SEEK_POSSIBLE && m_pMap)
+    return 1;
+
   if(request == IOCTRL_SEEK_POSSIBLE && m_pFile)
   {
     if (m_bPipe)
@@ -165,6 +291,9 @@ int CFile::IoControl(EIoControl request, void* param)
 
 bool CFile::IsEOF()
 {
+  if (m_pMap)
+    return m_iMapPosition >= m_iLength;
+
   if (!m_pFile)
     return -1;
 
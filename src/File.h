@@ -49,6 +49,12 @@ namespace XFILE
 /* calcuate bitrate for file while reading */
 #define READ_BITRATE   0x10
 
+/* map regular files into memory instead of going through stdio */
+#define READ_MMAP      0x20
+
+/* size of the region ahead of the read position that is prefaulted with MADV_WILLNEED */
+#define MMAP_READAHEAD_WINDOW (4 * 1024 * 1024)
+
 typedef enum {
   IOCTRL_NATIVE        = 1, /**< SNativeIoControl structure, containing what should be passed to native ioctrl */
   IOCTRL_SEEK_POSSIBLE = 2, /**< return 0 if known not to work, 1 if it should work */
@@ -56,6 +62,14 @@ typedef enum {
   IOCTRL_CACHE_SETRATE = 4, /**< unsigned int with with speed limit for caching in bytes per second */
 } EIoControl;
 
+typedef struct SReadStats
+{
+  int64_t reads;      /**< Read() calls */
+  int64_t stdio_reads;/**< Read() calls that went through fread(), mapped reads don't */
+  int64_t full_reads; /**< Read() calls that filled the whole buffer */
+  int64_t bytes;      /**< bytes returned by Read() */
+} SReadStats;
+
 class CFile
 {
 public:
@@ -74,11 +88,24 @@ public:
   int GetChunkSize() { return 6144 /*FFMPEG_FILE_BUFFER_SIZE*/; };
   int IoControl(EIoControl request, void* param);
   bool IsEOF();
+  bool IsMapped() { return m_pMap != NULL; };
+  SReadStats GetReadStats() { return m_readStats; };
 private:
+  bool OpenMapped(const CStdString& strFileName);
+  void AdviseWindow();
+
   unsigned int m_flags;
   FILE  *m_pFile;
   int64_t m_iLength;
   bool m_bPipe;
+  SReadStats m_readStats;
+
+  // READ_MMAP
+  int m_fd;
+  uint8_t *m_pMap;
+  int64_t m_iMapPosition;
+  int64_t m_iAdviseStart;
+  int64_t m_iAdviseEnd;
 };
 
 };
@@ -11,17 +11,8 @@
  * - timeouts for state transition failures
  */
 
-#include <time.h>
-#include <stdio.h>
-#include <stdint.h>
-#include <stddef.h>
-#include <string.h>
-#include <stdlib.h>
-#include <pthread.h>
+#include <errno.h>
 #include <alsa/asoundlib.h>
-#include <IL/OMX_Core.h>
-#include <IL/OMX_Component.h>
-#include <IL/OMX_Broadcom.h>
 
 extern "C" {
 #include <libavutil/channel_layout.h>
@@ -29,834 +20,8 @@ extern "C" {
 #include <libswresample/swresample.h>
 }
 
-#define ARRAY_SIZE(x) (sizeof(x) / sizeof(x[0]))
-
-struct _GOMX_COMMAND;
-struct _GOMX_PORT;
-struct _GOMX_COMPONENT;
-
-template <class X> static inline X max(X a, X b)
-{
-	return (a > b) ? a : b;
-}
-
-template <class X> static OMX_ERRORTYPE omx_cast(X* &toptr, OMX_PTR fromptr)
-{
-	toptr = (X*) fromptr;
-	if (toptr->nSize < sizeof(X)) return OMX_ErrorBadParameter;
-	if (toptr->nVersion.nVersion != OMX_VERSION) return OMX_ErrorVersionMismatch;
-	return OMX_ErrorNone;
-}
-
-template <class X> static void omx_init(X &omx)
-{
-	omx.nSize = sizeof(X);
-	omx.nVersion.nVersion = OMX_VERSION;
-}
-
-#if 1
-#include <utils/log.h>
-#define CLOG(notice, comp, port, msg, ...) do { \
-	struct _GOMX_PORT *_port = (struct _GOMX_PORT *) port; \
-	if (_port) CLog::Log(notice ? LOGNOTICE : LOGDEBUG, "[%p port %d]: %s: " msg "\n", comp, _port->def.nPortIndex, __func__ , ##__VA_ARGS__); \
-	else CLog::Log(notice ? LOGNOTICE : LOGDEBUG, "[%p] %s: " msg "\n", comp, __func__ , ##__VA_ARGS__); \
-} while (0)
-#else
-#define CLOG(notice, comp, port, msg, ...) do { \
-	struct _GOMX_PORT *_port = (struct _GOMX_PORT *) port; \
-	if (_port) fprintf(stderr, "[%p port %d]: %s: " msg "\n", comp, _port->def.nPortIndex, __func__ , ##__VA_ARGS__); \
-	else fprintf(stderr, "[%p] %s: " msg "\n", comp, __func__ , ##__VA_ARGS__); \
-} while (0)
-#endif
-
-#define CINFO(comp, port, msg, ...) CLOG(1, comp, port, msg , ##__VA_ARGS__)
-#define CDEBUG(comp, port, msg, ...) CLOG(0, comp, port, msg , ##__VA_ARGS__)
-
-/* Generic OMX helpers */
-
-typedef struct _GOMX_QUEUE {
-	void *head, *tail;
-	ptrdiff_t offset;
-	size_t num;
-} GOMX_QUEUE;
-
-static void gomxq_init(GOMX_QUEUE *q, ptrdiff_t offset)
-{
-	q->head = q->tail = 0;
-	q->offset = offset;
-	q->num = 0;
-}
-
-static void **gomxq_nextptr(GOMX_QUEUE *q, void *item)
-{
-	return (void**) ((uint8_t*)item + q->offset);
-}
-
-static void gomxq_enqueue(GOMX_QUEUE *q, void *item)
-{
-	*gomxq_nextptr(q, item) = 0;
-	if (q->tail) {
-		*gomxq_nextptr(q, q->tail) = item;
-		q->tail = item;
-	} else {
-		q->head = q->tail = item;
-	}
-	q->num++;
-}
-
-static void *gomxq_dequeue(GOMX_QUEUE *q)
-{
-	void *item = q->head;
-	if (item) {
-		q->head = *gomxq_nextptr(q, item);
-		if (!q->head) q->tail = 0;
-		q->num--;
-	}
-	return item;
-}
-
-typedef struct _GOMX_COMMAND {
-	void *next;
-	OMX_COMMANDTYPE cmd;
-	OMX_U32 param;
-	OMX_PTR data;
-} GOMX_COMMAND;
-
-typedef struct _GOMX_PORT {
-	OMX_BOOL new_enabled;
-	OMX_PARAM_PORTDEFINITIONTYPE def;
-
-	size_t num_buffers, num_buffers_old;
-	pthread_cond_t cond_no_buffers;
-	pthread_cond_t cond_populated;
-	pthread_cond_t cond_idle;
-
-	OMX_HANDLETYPE tunnel_comp;
-	OMX_U32 tunnel_port;
-	bool tunnel_supplier;
-	GOMX_QUEUE tunnel_supplierq;
-
-	OMX_ERRORTYPE (*do_buffer)(struct _GOMX_COMPONENT *, struct _GOMX_PORT *, OMX_BUFFERHEADERTYPE *);
-	OMX_ERRORTYPE (*flush)(struct _GOMX_COMPONENT *, struct _GOMX_PORT *);
-} GOMX_PORT;
-
-typedef struct _GOMX_COMPONENT {
-	OMX_COMPONENTTYPE omx;
-	OMX_CALLBACKTYPE cb;
-	OMX_STATETYPE state, wanted_state;
-
-	pthread_t component_thread, worker_thread;
-	pthread_mutex_t mutex;
-	pthread_cond_t cond;
-
-	const char *name;
-	size_t nports;
-	GOMX_PORT *ports;
-	GOMX_QUEUE cmdq;
-
-	void* (*worker)(void *);
-	OMX_ERRORTYPE (*statechange)(struct _GOMX_COMPONENT *);
-} GOMX_COMPONENT;
-
-static GOMX_PORT *gomx_get_port(GOMX_COMPONENT *comp, size_t idx)
-{
-	if (idx < 0 || idx >= comp->nports) return 0;
-	return &comp->ports[idx];
-}
-
-OMX_ERRORTYPE gomx_get_component_version(
-		OMX_HANDLETYPE hComponent, OMX_STRING pComponentName,
-		OMX_VERSIONTYPE *pComponentVersion, OMX_VERSIONTYPE *pSpecVersion, OMX_UUIDTYPE *pComponentUUID)
-{
-	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
-	CDEBUG(comp, 0, "enter");
-	strcpy(pComponentName, comp->name);
-	pComponentVersion->nVersion = OMX_VERSION;
-	pSpecVersion->nVersion = OMX_VERSION;
-	memcpy(pComponentUUID, &hComponent, sizeof hComponent);
-	return OMX_ErrorNone;
-}
-
-static OMX_ERRORTYPE gomx_get_parameter(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nParamIndex, OMX_PTR pComponentParameterStructure)
-{
-	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
-	GOMX_PORT *port;
-	OMX_PORT_PARAM_TYPE *ppt;
-	OMX_PARAM_PORTDEFINITIONTYPE *pdt;
-	OMX_ERRORTYPE r;
-	OMX_PORTDOMAINTYPE domain;
-
-	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
-
-	CDEBUG(comp, 0, "called %x, %p", nParamIndex, pComponentParameterStructure);
-	switch (nParamIndex) {
-	case OMX_IndexParamAudioInit:
-		domain = OMX_PortDomainAudio;
-		goto param_init;
-	case OMX_IndexParamVideoInit:
-		domain = OMX_PortDomainVideo;
-		goto param_init;
-	case OMX_IndexParamImageInit:
-		domain = OMX_PortDomainImage;
-		goto param_init;
-	case OMX_IndexParamOtherInit:
-		domain = OMX_PortDomainOther;
-		goto param_init;
-	param_init:
-		if ((r = omx_cast(ppt, pComponentParameterStructure))) return r;
-		ppt->nPorts = 0;
-		ppt->nStartPortNumber = 0;
-		for (size_t i = 0; i < comp->nports; i++) {
-			if (comp->ports[i].def.eDomain != domain)
-				continue;
-			if (!ppt->nPorts)
-				ppt->nStartPortNumber = i;
-			ppt->nPorts++;
-		}
-		break;
-	case OMX_IndexParamPortDefinition:
-		if ((r = omx_cast(pdt, pComponentParameterStructure))) return r;
-		if (!(port = gomx_get_port(comp, pdt->nPortIndex))) return OMX_ErrorBadPortIndex;
-		memcpy(pComponentParameterStructure, &port->def, sizeof *pdt);
-		break;
-	default:
-		CINFO(comp, 0, "UNSUPPORTED %x, %p", nParamIndex, pComponentParameterStructure);
-		return OMX_ErrorNotImplemented;
-	}
-	return OMX_ErrorNone;
-}
-
-static OMX_ERRORTYPE gomx_get_state(OMX_HANDLETYPE hComponent, OMX_STATETYPE *pState)
-{
-	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
-	*pState = comp->state;
-	return OMX_ErrorNone;
-}
-
-static OMX_ERRORTYPE gomx_component_tunnel_request(
-		OMX_HANDLETYPE hComponent, OMX_U32 nPort,
-		OMX_HANDLETYPE hTunneledComp, OMX_U32 nTunneledPort, OMX_TUNNELSETUPTYPE* pTunnelSetup)
-{
-	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
-	GOMX_PORT *port = 0;
-
-	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
-	if (!(port = gomx_get_port(comp, nPort))) return OMX_ErrorBadPortIndex;
-	if (comp->state != OMX_StateLoaded && port->def.bEnabled)
-		return OMX_ErrorIncorrectStateOperation;
-
-	if (hTunneledComp == 0 || pTunnelSetup == 0) {
-		port->tunnel_comp = 0;
-		return OMX_ErrorNone;
-	}
-
-	if (port->def.eDir == OMX_DirInput) {
-		/* Negotiate parameters */
-		OMX_PARAM_PORTDEFINITIONTYPE param;
-		omx_init(param);
-		param.nPortIndex = nTunneledPort;
-		if (OMX_GetParameter(hTunneledComp, OMX_IndexParamPortDefinition, &param))
-			goto not_compatible;
-		if (param.eDomain != port->def.eDomain)
-			goto not_compatible;
-
-		param.nBufferCountActual = ::max(param.nBufferCountMin, port->def.nBufferCountMin);
-		param.nBufferSize = ::max(port->def.nBufferSize, param.nBufferSize);
-		param.nBufferAlignment = ::max(port->def.nBufferAlignment, param.nBufferAlignment);
-		port->def.nBufferCountActual = param.nBufferCountActual;
-		port->def.nBufferSize = param.nBufferSize;
-		port->def.nBufferAlignment = param.nBufferAlignment;
-		if (OMX_SetParameter(hTunneledComp, OMX_IndexParamPortDefinition, &param))
-			goto not_compatible;
-
-		/* Negotiate buffer supplier */
-		OMX_PARAM_BUFFERSUPPLIERTYPE suppl;
-		omx_init(suppl);
-		suppl.nPortIndex = nTunneledPort;
-		if (OMX_GetParameter(hTunneledComp, OMX_IndexParamCompBufferSupplier, &suppl))
-			goto not_compatible;
-
-		/* Being supplier is not supported so ask the other side to be it */
-		suppl.eBufferSupplier =
-			(pTunnelSetup->eSupplier == OMX_BufferSupplyOutput)
-			? OMX_BufferSupplyOutput : OMX_BufferSupplyInput;
-		if (OMX_SetParameter(hTunneledComp, OMX_IndexParamCompBufferSupplier, &suppl))
-			goto not_compatible;
-
-		port->tunnel_comp = hTunneledComp;
-		port->tunnel_port = nTunneledPort;
-		port->tunnel_supplier = (suppl.eBufferSupplier == OMX_BufferSupplyInput);
-		pTunnelSetup->eSupplier = suppl.eBufferSupplier;
-		CINFO(comp, port, "ComponentTunnnelRequest: %p %d", hTunneledComp, nTunneledPort);
-	} else {
-		CINFO(comp, port, "OUTPUT TUNNEL UNSUPPORTED: %p, %d, %p", hTunneledComp, nTunneledPort, pTunnelSetup);
-		return OMX_ErrorNotImplemented;
-	}
-	return OMX_ErrorNone;
-
-not_compatible:
-	CINFO(comp, port, "ComponentTunnnelRequest: %p %d - NOT COMPATIBLE", hTunneledComp, nTunneledPort);
-	return OMX_ErrorPortsNotCompatible;
-}
-
-static void __gomx_event(GOMX_COMPONENT *comp, OMX_EVENTTYPE eEvent, OMX_U32 nData1, OMX_U32 nData2, OMX_PTR pEventData)
-{
-	if (!comp->cb.EventHandler) return;
-	pthread_mutex_unlock(&comp->mutex);
-	comp->cb.EventHandler((OMX_HANDLETYPE) comp, comp->omx.pApplicationPrivate, eEvent, nData1, nData2, pEventData);
-	pthread_mutex_lock(&comp->mutex);
-}
-
-static void __gomx_port_update_buffer_state(GOMX_COMPONENT *comp, GOMX_PORT *port)
-{
-	if (port->num_buffers_old == port->num_buffers)
-		return;
-
-	port->def.bPopulated = (port->num_buffers >= port->def.nBufferCountActual) ? OMX_TRUE : OMX_FALSE;
-	if (port->num_buffers == 0)
-		pthread_cond_signal(&port->cond_no_buffers);
-	else if (port->num_buffers == port->def.nBufferCountActual)
-		pthread_cond_signal(&port->cond_populated);
-}
-
-static OMX_ERRORTYPE gomx_use_buffer(OMX_HANDLETYPE hComponent, OMX_BUFFERHEADERTYPE **ppBufferHdr,
-				     OMX_U32 nPortIndex, OMX_PTR pAppPrivate, OMX_U32 nSizeBytes, OMX_U8* pBuffer)
-{
-	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
-	OMX_BUFFERHEADERTYPE *hdr;
-	GOMX_PORT *port;
-	void *buf;
-
-	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
-	if (!(port = gomx_get_port(comp, nPortIndex))) return OMX_ErrorBadPortIndex;
-
-	if (!((comp->state == OMX_StateLoaded && comp->wanted_state == OMX_StateIdle) ||
-	      (port->def.bEnabled == OMX_FALSE &&
-			(comp->state == OMX_StateExecuting ||
-			 comp->state == OMX_StatePause ||
-			 comp->state == OMX_StateIdle))))
-		return OMX_ErrorIncorrectStateOperation;
-
-	buf = malloc(sizeof(OMX_BUFFERHEADERTYPE) + (pBuffer ? 0 : nSizeBytes));
-	if (!buf) return OMX_ErrorInsufficientResources;
-
-	hdr = (OMX_BUFFERHEADERTYPE *) buf;
-	memset(hdr, 0, sizeof *hdr);
-	omx_init(*hdr);
-	hdr->pBuffer = pBuffer ? (OMX_U8*)pBuffer : (OMX_U8*)((char*)buf + nSizeBytes);
-	hdr->nAllocLen = nSizeBytes;
-	hdr->pAppPrivate = pAppPrivate;
-	if (port->def.eDir == OMX_DirInput) {
-		hdr->nInputPortIndex = nPortIndex;
-		hdr->pOutputPortPrivate = pAppPrivate;
-	} else {
-		hdr->nOutputPortIndex = nPortIndex;
-		hdr->pInputPortPrivate = pAppPrivate;
-	}
-	pthread_mutex_lock(&comp->mutex);
-	port->num_buffers++;
-	__gomx_port_update_buffer_state(comp, port);
-	pthread_mutex_unlock(&comp->mutex);
-
-	CDEBUG(comp, port, "allocated: %d, %p, %u, %p", nPortIndex, pAppPrivate, nSizeBytes, pBuffer);
-	*ppBufferHdr = hdr;
-
-	return OMX_ErrorNone;
-}
-
-static OMX_ERRORTYPE gomx_allocate_buffer(OMX_HANDLETYPE hComponent, OMX_BUFFERHEADERTYPE **ppBufferHdr,
-					  OMX_U32 nPortIndex, OMX_PTR pAppPrivate, OMX_U32 nSizeBytes)
-{
-	return gomx_use_buffer(hComponent, ppBufferHdr, nPortIndex, pAppPrivate, nSizeBytes, 0);
-}
-
-static OMX_ERRORTYPE gomx_free_buffer(OMX_HANDLETYPE hComponent, OMX_U32 nPortIndex, OMX_BUFFERHEADERTYPE* pBuffer)
-{
-	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
-	GOMX_PORT *port;
-
-	if (!(port = gomx_get_port(comp, nPortIndex))) return OMX_ErrorBadPortIndex;
-
-	/* Freeing buffer is allowed in all states, so destructor can
-	 * synchronize successfully. */
-
-	pthread_mutex_lock(&comp->mutex);
-
-	if (!((comp->state == OMX_StateIdle && comp->wanted_state == OMX_StateLoaded) ||
-	      (port->def.bEnabled == OMX_FALSE &&
-			(comp->state == OMX_StateExecuting ||
-			 comp->state == OMX_StatePause ||
-			 comp->state == OMX_StateIdle)))) {
-		/* In unexpected states the port unpopulated error is sent. */
-		if (port->num_buffers == port->def.nBufferCountActual)
-			__gomx_event(comp, OMX_EventError, OMX_ErrorPortUnpopulated, nPortIndex, 0);
-		/* FIXME? should we mark the port also down */
-	}
-
-	port->num_buffers--;
-	__gomx_port_update_buffer_state(comp, port);
-
-	pthread_mutex_unlock(&comp->mutex);
-
-	free(pBuffer);
-
-	return OMX_ErrorNone;
-}
-
-static void __gomx_port_queue_supplier_buffer(GOMX_PORT *port, OMX_BUFFERHEADERTYPE *hdr)
-{
-	gomxq_enqueue(&port->tunnel_supplierq, (void *) hdr);
-	if (port->tunnel_supplierq.num == port->num_buffers)
-		pthread_cond_broadcast(&port->cond_idle);
-}
-
-static OMX_ERRORTYPE __gomx_empty_buffer_done(GOMX_COMPONENT *comp, OMX_BUFFERHEADERTYPE *hdr)
-{
-	GOMX_PORT *port = gomx_get_port(comp, hdr->nInputPortIndex);
-	OMX_ERRORTYPE r;
-
-	if (port->tunnel_comp) {
-		/* Buffers are sent to the tunneled port once emptied as long as
-		 * the component is in the OMX_StateExecuting state */
-		if ((comp->state == OMX_StateExecuting && port->def.bEnabled) ||
-		    !port->tunnel_supplier) {
-			pthread_mutex_unlock(&comp->mutex);
-			r = OMX_FillThisBuffer(port->tunnel_comp, hdr);
-			pthread_mutex_lock(&comp->mutex);
-		} else {
-			r = OMX_ErrorIncorrectStateOperation;
-		}
-	} else {
-		pthread_mutex_unlock(&comp->mutex);
-		r = comp->cb.EmptyBufferDone((OMX_HANDLETYPE) comp, hdr->pAppPrivate, hdr);
-		pthread_mutex_lock(&comp->mutex);
-	}
-
-	if (r != OMX_ErrorNone && port->tunnel_supplier) {
-		__gomx_port_queue_supplier_buffer(port, hdr);
-		r = OMX_ErrorNone;
-	}
-
-	return r;
-}
-
-static OMX_ERRORTYPE gomx_empty_this_buffer(OMX_HANDLETYPE hComponent, OMX_BUFFERHEADERTYPE* pBuffer)
-{
-	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
-	GOMX_PORT *port;
-	OMX_ERRORTYPE r;
-
-	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
-	if (comp->state != OMX_StatePause && comp->state != OMX_StateExecuting &&
-	    comp->wanted_state != OMX_StateExecuting)
-		return OMX_ErrorIncorrectStateOperation;
-
-	if (!(port = gomx_get_port(comp, pBuffer->nInputPortIndex)))
-		return OMX_ErrorBadPortIndex;
-
-	pthread_mutex_lock(&comp->mutex);
-	if (port->def.bEnabled) {
-		if (port->do_buffer)
-			r = port->do_buffer(comp, port, pBuffer);
-		else
-			r = __gomx_empty_buffer_done(comp, pBuffer);
-	} else {
-		if (port->tunnel_supplier) {
-			__gomx_port_queue_supplier_buffer(port, pBuffer);
-			r = OMX_ErrorNone;
-		} else {
-			r = OMX_ErrorIncorrectStateOperation;
-		}
-	}
-	pthread_mutex_unlock(&comp->mutex);
-	return r;
-}
-
-static OMX_ERRORTYPE gomx_fill_this_buffer(OMX_HANDLETYPE hComponent, OMX_BUFFERHEADERTYPE* pBuffer)
-{
-	CDEBUG(hComponent, 0, "stub");
-	return OMX_ErrorNotImplemented;
-}
-
-static void __gomx_process_mark(GOMX_COMPONENT *comp, OMX_BUFFERHEADERTYPE *hdr)
-{
-	if (hdr->hMarkTargetComponent == (OMX_HANDLETYPE) comp) {
-		__gomx_event(comp, OMX_EventMark, 0, 0, hdr->pMarkData);
-		hdr->hMarkTargetComponent = 0;
-		hdr->pMarkData = 0;
-	}
-}
-
-static OMX_ERRORTYPE __gomx_port_unpopulate(GOMX_COMPONENT *comp, GOMX_PORT *port)
-{
-	OMX_BUFFERHEADERTYPE *hdr;
-	void *buf;
-
-	if (port->tunnel_supplier) {
-		CINFO(comp, port, "waiting for supplier buffers (%d / %d)",
-			(int)port->tunnel_supplierq.num, (int)port->num_buffers);
-		while (port->tunnel_supplierq.num != port->num_buffers)
-			pthread_cond_wait(&port->cond_idle, &comp->mutex);
-
-		CINFO(comp, port, "free tunnel buffers");
-		while ((hdr = (OMX_BUFFERHEADERTYPE*)gomxq_dequeue(&port->tunnel_supplierq)) != 0) {
-			buf = hdr->pBuffer;
-			OMX_FreeBuffer(port->tunnel_comp, port->tunnel_port, hdr);
-			free(buf);
-			port->num_buffers--;
-			__gomx_port_update_buffer_state(comp, port);
-		}
-	} else {
-		/* Wait client / tunnel supplier to allocate buffers */
-		CINFO(comp, port, "waiting %d buffers to be freed", (int)port->num_buffers);
-		while (port->num_buffers > 0)
-			pthread_cond_wait(&port->cond_no_buffers, &comp->mutex);
-	}
-
-	CINFO(comp, port, "UNPOPULATED");
-	return OMX_ErrorNone;
-}
-
-static OMX_ERRORTYPE __gomx_port_populate(GOMX_COMPONENT *comp, GOMX_PORT *port)
-{
-	OMX_ERRORTYPE r;
-	OMX_BUFFERHEADERTYPE *hdr;
-	void *buf;
-
-	if (port->tunnel_supplier) {
-		CINFO(comp, port, "Allocating tunnel buffers");
-		while (port->num_buffers < port->def.nBufferCountActual) {
-			pthread_mutex_unlock(&comp->mutex);
-			r = OMX_ErrorInsufficientResources;
-			buf = malloc(port->def.nBufferSize);
-			if (buf) {
-				r = OMX_UseBuffer(port->tunnel_comp, &hdr,
-						port->tunnel_port, 0,
-						port->def.nBufferSize, (OMX_U8*) buf);
-				if (r != OMX_ErrorNone) free(buf);
-			}
-			if (r == OMX_ErrorInvalidState ||
-			    r == OMX_ErrorIncorrectStateOperation) {
-				/* Non-supplier is not transitioned yet.
-				 * Wait for a bit and retry */
-				usleep(1000);
-				pthread_mutex_lock(&comp->mutex);
-				continue;
-			}
-			pthread_mutex_lock(&comp->mutex);
-
-			if (r != OMX_ErrorNone) {
-				/* Hard error. Cancel and bail out */
-				__gomx_port_unpopulate(comp, port);
-				return r;
-			}
-
-			if (port->def.eDir == OMX_DirInput)
-				hdr->nInputPortIndex = port->def.nPortIndex;
-			else
-				hdr->nOutputPortIndex = port->def.nPortIndex;
-			gomxq_enqueue(&port->tunnel_supplierq, (void*) hdr);
-			port->num_buffers++;
-			__gomx_port_update_buffer_state(comp, port);
-		}
-	} else {
-		/* Wait client / tunnel supplier to allocate buffers */
-		CINFO(comp, port, "waiting buffers");
-		while (!port->def.bPopulated)
-			pthread_cond_wait(&port->cond_populated, &comp->mutex);
-	}
-
-	CINFO(comp, port, "POPULATED");
-	return OMX_ErrorNone;
-}
-
-static OMX_ERRORTYPE gomx_send_command(OMX_HANDLETYPE hComponent, OMX_COMMANDTYPE Cmd, OMX_U32 nParam1, OMX_PTR pCmdData)
-{
-	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
-	GOMX_COMMAND *c;
-
-	/* OMX IL Specification is unclear which errors can be returned
-	 * inline and which need to be reported with a callback.
-	 * This just does minimal state checking, and queues everything
-	 * to worker and reports any real errors via the callback. */
-	if (!hComponent) return OMX_ErrorInvalidComponent;
-	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
-	if (!comp->cb.EventHandler) return OMX_ErrorNotReady;
-
-	c = (GOMX_COMMAND*) malloc(sizeof(GOMX_COMMAND));
-	if (!c) return OMX_ErrorInsufficientResources;
-
-	CINFO(comp, 0, "SendCommand %x, %x, %p", Cmd, nParam1, pCmdData);
-	c->cmd = Cmd;
-	c->param = nParam1;
-	c->data = pCmdData;
-
-	pthread_mutex_lock(&comp->mutex);
-	gomxq_enqueue(&comp->cmdq, (void*) c);
-	pthread_cond_signal(&comp->cond);
-	pthread_mutex_unlock(&comp->mutex);
-
-	return OMX_ErrorNone;
-}
-
-#define GOMX_TRANS(a,b) ((((uint32_t)a) << 16) | (uint32_t)b)
-
-static OMX_ERRORTYPE gomx_do_set_state(GOMX_COMPONENT *comp, GOMX_COMMAND *cmd)
-{
-	OMX_STATETYPE new_state = (OMX_STATETYPE) cmd->param;
-	OMX_ERRORTYPE r;
-	GOMX_PORT *port;
-	size_t i;
-
-	if (comp->state == new_state) return OMX_ErrorSameState;
-
-	if (new_state == OMX_StateInvalid) {
-		/* Transition to invalid state is always valid and immediate */
-		comp->state = new_state;
-		return OMX_ErrorNone;
-	}
-
-	CDEBUG(comp, 0, "starting transition to state %d", new_state);
-
-	comp->wanted_state = new_state;
-
-	if (comp->statechange) {
-		r = comp->statechange(comp);
-		if (r != OMX_ErrorNone) goto err;
-	}
-
-	switch (GOMX_TRANS(comp->state, new_state)) {
-	case GOMX_TRANS(OMX_StateLoaded, OMX_StateIdle):
-		/* populate or wait for all enabled ports to be populated */
-		for (i = 0; i < comp->nports; i++) {
-			if (!comp->ports[i].def.bEnabled) continue;
-			r = __gomx_port_populate(comp, &comp->ports[i]);
-			if (r) goto err;
-		}
-		break;
-	case GOMX_TRANS(OMX_StateIdle, OMX_StateLoaded):
-		/* free or wait all ports to be unpopulated */
-		for (i = 0; i < comp->nports; i++) {
-			r = __gomx_port_unpopulate(comp, &comp->ports[i]);
-			if (r) goto err;
-		}
-		break;
-	case GOMX_TRANS(OMX_StateIdle, OMX_StateExecuting):
-		/* start threads */
-		r = OMX_ErrorInsufficientResources;
-		if (comp->worker &&
-		    pthread_create(&comp->worker_thread, 0, comp->worker, comp) != 0)
-			goto err;
-		break;
-	case GOMX_TRANS(OMX_StateExecuting, OMX_StateIdle):
-		/* stop/join threads & wait buffers to be returned to suppliers */
-		if (comp->worker_thread) {
-			pthread_mutex_unlock(&comp->mutex);
-			pthread_join(comp->worker_thread, 0);
-			pthread_mutex_lock(&comp->mutex);
-			comp->worker_thread = 0;
-		}
-		for (i = 0; i < comp->nports; i++) {
-			port = &comp->ports[i];
-			if (!port->tunnel_supplier || !port->def.bEnabled) continue;
-			while (port->tunnel_supplierq.num != port->num_buffers)
-				pthread_cond_wait(&port->cond_idle, &comp->mutex);
-		}
-		break;
-	default:
-		/* FIXME: Pause and WaitForResources states not supported */
-		r = OMX_ErrorIncorrectStateTransition;
-		goto err;
-	}
-	comp->state = new_state;
-	CDEBUG(comp, 0, "transition to state %d: success", new_state);
-	return OMX_ErrorNone;
-err:
-	comp->wanted_state = comp->state;
-	CDEBUG(comp, 0, "transition to state %d: result %x", new_state, r);
-	return r;
-}
-
-static OMX_ERRORTYPE gomx_do_port_command(GOMX_COMPONENT *comp, GOMX_PORT *port, GOMX_COMMAND *cmd)
-{
-	OMX_ERRORTYPE r = OMX_ErrorNone;
-
-	switch (cmd->cmd) {
-	case OMX_CommandFlush:
-		if (port->flush) r = port->flush(comp, port);
-		break;
-	case OMX_CommandPortEnable:
-		port->def.bEnabled = OMX_TRUE;
-		r = __gomx_port_populate(comp, port);
-		if (r != OMX_ErrorNone)
-			port->def.bEnabled = OMX_FALSE;
-		break;
-	case OMX_CommandPortDisable:
-		port->def.bEnabled = OMX_FALSE;
-		if (port->flush) port->flush(comp, port);
-		r = __gomx_port_unpopulate(comp, port);
-		break;
-	default:
-		r = OMX_ErrorNotImplemented;
-		break;
-	}
-	return r;
-}
-
-static OMX_ERRORTYPE gomx_do_command(GOMX_COMPONENT *comp, GOMX_COMMAND *cmd)
-{
-	GOMX_PORT *port;
-
-	switch (cmd->cmd) {
-	case OMX_CommandStateSet:
-		CINFO(comp, 0, "state %x", cmd->param);
-		return gomx_do_set_state(comp, cmd);
-	case OMX_CommandFlush:
-	case OMX_CommandPortEnable:
-	case OMX_CommandPortDisable:
-		/* FIXME: OMX_ALL is not supported (but not used in omxplayer) */
-		if (!(port = gomx_get_port(comp, cmd->param)))
-			return OMX_ErrorBadPortIndex;
-		CINFO(comp, port, "command %x", cmd->cmd);
-		return gomx_do_port_command(comp, port, cmd);
-	case OMX_CommandMarkBuffer:
-		/* FIXME: Not implemented (but not used in omxplayer) */
-	default:
-		CINFO(comp, 0, "UNSUPPORTED %x, %x, %p", cmd->cmd, cmd->param, cmd->data);
-		return OMX_ErrorNotImplemented;
-	}
-}
-
-static void *gomx_worker(void *ptr)
-{
-	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) ptr;
-	GOMX_PORT *port;
-	GOMX_COMMAND *cmd;
-	OMX_BUFFERHEADERTYPE *hdr;
-	OMX_ERRORTYPE r;
-
-	CINFO(comp, 0, "start");
-	pthread_mutex_lock(&comp->mutex);
-	while (comp->state != OMX_StateInvalid) {
-		cmd = (GOMX_COMMAND *) gomxq_dequeue(&comp->cmdq);
-		if (cmd) {
-			r = gomx_do_command(comp, cmd);
-			if (r == OMX_ErrorNone)
-				__gomx_event(comp, OMX_EventCmdComplete,
-					     cmd->cmd, cmd->param, cmd->data);
-			else
-				__gomx_event(comp, OMX_EventError, r, 0, 0);
-		} else {
-			pthread_cond_wait(&comp->cond, &comp->mutex);
-		}
-
-		if (comp->state != OMX_StateExecuting)
-			continue;
-
-		/* FIXME: Rate limit and retry if needed suppplier buffer enqueuing */
-		for (size_t i = 0; i < comp->nports; i++) {
-			port = &comp->ports[i];
-			while ((hdr = (OMX_BUFFERHEADERTYPE*)gomxq_dequeue(&port->tunnel_supplierq)) != 0) {
-				pthread_mutex_unlock(&comp->mutex);
-				r = OMX_FillThisBuffer(port->tunnel_comp, hdr);
-				pthread_mutex_lock(&comp->mutex);
-				if (r != OMX_ErrorNone) {
-					__gomx_port_queue_supplier_buffer(port, hdr);
-					break;
-				}
-			}
-		}
-	}
-	pthread_mutex_unlock(&comp->mutex);
-	/* FIXME: make sure all buffers are returned and worker threads stopped */
-	CINFO(comp, 0, "stop");
-	return 0;
-}
-
-static OMX_ERRORTYPE gomx_set_callbacks(OMX_HANDLETYPE hComponent, OMX_CALLBACKTYPE* pCallbacks, OMX_PTR pAppData)
-{
-	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
-	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
-	if (comp->state != OMX_StateLoaded) return OMX_ErrorIncorrectStateOperation;
-	pthread_mutex_lock(&comp->mutex);
-	comp->omx.pApplicationPrivate = pAppData;
-	comp->cb = *pCallbacks;
-	pthread_mutex_unlock(&comp->mutex);
-	return OMX_ErrorNone;
-}
-
-static OMX_ERRORTYPE gomx_use_egl_image(OMX_HANDLETYPE hComponent,
-		OMX_BUFFERHEADERTYPE** ppBufferHdr, OMX_U32 nPortIndex,
-		OMX_PTR pAppPrivate, void* eglImage)
-{
-	return OMX_ErrorNotImplemented;
-}
-
-static OMX_ERRORTYPE gomx_component_role_enum(OMX_HANDLETYPE hComponent, OMX_U8 *cRole, OMX_U32 nIndex)
-{
-	return OMX_ErrorNotImplemented;
-}
-
-static void gomx_init(GOMX_COMPONENT *comp, const char *name, OMX_PTR pAppData, OMX_CALLBACKTYPE* pCallbacks, GOMX_PORT *ports, size_t nports)
-{
-	comp->omx.nSize = sizeof comp->omx;
-	comp->omx.nVersion.nVersion = OMX_VERSION;
-	comp->omx.pApplicationPrivate = pAppData;
-	comp->omx.GetComponentVersion = gomx_get_component_version;
-	comp->omx.SendCommand = gomx_send_command;
-	comp->omx.GetParameter = gomx_get_parameter;
-	comp->omx.GetState = gomx_get_state;
-	comp->omx.ComponentTunnelRequest = gomx_component_tunnel_request;
-	comp->omx.UseBuffer = gomx_use_buffer;
-	comp->omx.AllocateBuffer = gomx_allocate_buffer;
-	comp->omx.FreeBuffer = gomx_free_buffer;
-	comp->omx.EmptyThisBuffer = gomx_empty_this_buffer;
-	comp->omx.FillThisBuffer = gomx_fill_this_buffer;
-	comp->omx.SetCallbacks = gomx_set_callbacks;
-	comp->omx.UseEGLImage = gomx_use_egl_image;
-	comp->omx.ComponentRoleEnum = gomx_component_role_enum;
-
-	comp->name = name;
-	comp->cb = *pCallbacks;
-	comp->state = OMX_StateLoaded;
-	comp->nports = nports;
-	comp->ports = ports;
-
-	gomxq_init(&comp->cmdq, offsetof(GOMX_COMMAND, next));
-	pthread_cond_init(&comp->cond, 0);
-	pthread_mutex_init(&comp->mutex, 0);
-	pthread_create(&comp->component_thread, 0, gomx_worker, comp);
-
-	for (size_t i = 0; i < comp->nports; i++) {
-		GOMX_PORT *port = &comp->ports[i];
-		pthread_cond_init(&port->cond_no_buffers, 0);
-		pthread_cond_init(&port->cond_populated, 0);
-		pthread_cond_init(&port->cond_idle, 0);
-		gomxq_init(&port->tunnel_supplierq,
-			port->def.eDir == OMX_DirInput
-			? offsetof(OMX_BUFFERHEADERTYPE, pInputPortPrivate)
-			: offsetof(OMX_BUFFERHEADERTYPE, pOutputPortPrivate));
-	}
-}
-
-static void gomx_fini(GOMX_COMPONENT *comp)
-{
-	CINFO(comp, 0, "destroying");
-	pthread_mutex_lock(&comp->mutex);
-	comp->state = OMX_StateInvalid;
-	pthread_cond_broadcast(&comp->cond);
-	pthread_mutex_unlock(&comp->mutex);
-	pthread_join(comp->component_thread, 0);
-
-	for (size_t i = 0; i < comp->nports; i++) {
-		GOMX_PORT *port = &comp->ports[i];
-		pthread_cond_destroy(&port->cond_no_buffers);
-		pthread_cond_destroy(&port->cond_populated);
-		pthread_cond_destroy(&port->cond_idle);
-	}
-	pthread_mutex_destroy(&comp->mutex);
-	pthread_cond_destroy(&comp->cond);
-}
+#include "OMXGeneric.h"
+#include "OMXAlsa.h"
 
 /* ALSA Sink OMX Component */
 
@@ -874,7 +39,12 @@ typedef struct _OMX_ALSASINK {
 	OMX_AUDIO_PARAM_PCMMODETYPE pcm;
 	snd_pcm_format_t pcm_format;
 	snd_pcm_state_t pcm_state;
-	snd_pcm_sframes_t pcm_delay;
+	snd_pcm_sframes_t pcm_delay, pcm_hw_delay, pcm_delay_max;
+	snd_pcm_uframes_t buffer_size, period_size;
+	unsigned int xruns;
+	int mmap_active, resampling;
+	OMX_U32 buffer_time, period_time;
+	OMX_BOOL mmap;
 	char device_name[16];
 } OMX_ALSASINK;
 
@@ -940,8 +110,7 @@ static OMX_ERRORTYPE omxalsasink_set_parameter(OMX_HANDLETYPE hComponent, OMX_IN
 		sink->pcm_format = pcm_format;
 		break;
 	default:
-		CINFO(comp, 0, "UNSUPPORTED %x, %p", nParamIndex, pComponentParameterStructure);
-		return OMX_ErrorNotImplemented;
+		return gomx_set_parameter(hComponent, nParamIndex, pComponentParameterStructure);
 	}
 	return OMX_ErrorNone;
 }
@@ -951,14 +120,15 @@ static OMX_ERRORTYPE omxalsasink_get_config(OMX_HANDLETYPE hComponent, OMX_INDEX
 	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
 	OMX_ALSASINK *sink = (OMX_ALSASINK *) hComponent;
 	OMX_PARAM_U32TYPE *u32param;
+	OMX_CONFIG_ALSALATENCYTYPE *lat;
 	OMX_ERRORTYPE r;
 
 	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
-	if (!sink->frame_size) return OMX_ErrorInvalidState;
 
-	switch (nIndex) {
+	switch ((OMX_U32) nIndex) {
 	case OMX_IndexConfigAudioRenderingLatency:
 		if ((r = omx_cast(u32param, pComponentConfigStructure))) return r;
+		if (!sink->frame_size) return OMX_ErrorInvalidState;
 		/* Number of samples received but not played */
 		pthread_mutex_lock(&comp->mutex);
 		u32param->nU32 = sink->play_queue_size / sink->frame_size;
@@ -967,6 +137,23 @@ static OMX_ERRORTYPE omxalsasink_get_config(OMX_HANDLETYPE hComponent, OMX_INDEX
 		pthread_mutex_unlock(&comp->mutex);
 		CDEBUG(comp, 0, "OMX_IndexConfigAudioRenderingLatency %d", u32param->nU32);
 		break;
+	case OMX_IndexConfigAlsaLatency:
+		if ((r = omx_cast(lat, pComponentConfigStructure))) return r;
+		/* Everything but the requested times is zero until Executing */
+		pthread_mutex_lock(&comp->mutex);
+		lat->nBufferTime = sink->buffer_time;
+		lat->nPeriodTime = sink->period_time;
+		lat->bMmap = sink->mmap;
+		lat->nSampleRate = sink->sample_rate;
+		lat->nBufferSize = sink->buffer_size;
+		lat->nPeriodSize = sink->period_size;
+		lat->nDelay = sink->pcm_state == SND_PCM_STATE_RUNNING ? sink->pcm_hw_delay : 0;
+		lat->nDelayMax = sink->pcm_delay_max;
+		lat->nXruns = sink->xruns;
+		lat->bMmapActive = sink->mmap_active ? OMX_TRUE : OMX_FALSE;
+		lat->bResampling = sink->resampling ? OMX_TRUE : OMX_FALSE;
+		pthread_mutex_unlock(&comp->mutex);
+		break;
 	default:
 		CINFO(comp, 0, "UNSUPPORTED %x, %p", nIndex, pComponentConfigStructure);
 		return OMX_ErrorNotImplemented;
@@ -980,11 +167,12 @@ static OMX_ERRORTYPE omxalsasink_set_config(OMX_HANDLETYPE hComponent, OMX_INDEX
 	OMX_ALSASINK *sink = (OMX_ALSASINK*) hComponent;
 	OMX_CONFIG_BOOLEANTYPE *bt;
 	OMX_CONFIG_BRCMAUDIODESTINATIONTYPE *adest;
+	OMX_CONFIG_ALSALATENCYTYPE *lat;
 	OMX_ERRORTYPE r;
 
 	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
 
-	switch (nIndex) {
+	switch ((OMX_U32) nIndex) {
 	case OMX_IndexConfigBrcmClockReferenceSource:
 		if ((r = omx_cast(bt, pComponentConfigStructure))) return r;
 		CDEBUG(comp, 0, "OMX_IndexConfigBrcmClockReferenceSource %d", bt->bEnabled);
@@ -994,6 +182,15 @@ static OMX_ERRORTYPE omxalsasink_set_config(OMX_HANDLETYPE hComponent, OMX_INDEX
 		strncpy(sink->device_name, (const char*) adest->sName, sizeof sink->device_name - 1);
 		CDEBUG(comp, 0, "OMX_IndexConfigBrcmAudioDestination %s", adest->sName);
 		break;
+	case OMX_IndexConfigAlsaLatency:
+		if ((r = omx_cast(lat, pComponentConfigStructure))) return r;
+		/* Read when the worker opens the device */
+		sink->buffer_time = lat->nBufferTime;
+		sink->period_time = lat->nPeriodTime;
+		sink->mmap = lat->bMmap;
+		CDEBUG(comp, 0, "OMX_IndexConfigAlsaLatency buffer %u us, period %u us, mmap %d",
+			lat->nBufferTime, lat->nPeriodTime, lat->bMmap);
+		break;
 	default:
 		CINFO(comp, 0, "UNSUPPORTED %x, %p", nIndex, pComponentConfigStructure);
 		return OMX_ErrorNotImplemented;
@@ -1001,13 +198,6 @@ static OMX_ERRORTYPE omxalsasink_set_config(OMX_HANDLETYPE hComponent, OMX_INDEX
 	return OMX_ErrorNone;
 }
 
-static OMX_ERRORTYPE omxalsasink_get_extension_index(OMX_HANDLETYPE hComponent, OMX_STRING cParameterName, OMX_INDEXTYPE *pIndexType)
-{
-	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
-	CINFO(comp, 0, "UNSUPPORTED '%s', %p", cParameterName, pIndexType);
-	return OMX_ErrorNotImplemented;
-}
-
 static OMX_ERRORTYPE omxalsasink_deinit(OMX_HANDLETYPE hComponent)
 {
 	OMX_ALSASINK *sink = (OMX_ALSASINK *) hComponent;
@@ -1016,6 +206,98 @@ static OMX_ERRORTYPE omxalsasink_deinit(OMX_HANDLETYPE hComponent)
 	return OMX_ErrorNone;
 }
 
+static enum AVSampleFormat omxalsasink_swr_format(snd_pcm_format_t fmt)
+{
+	switch (fmt) {
+	case SND_PCM_FORMAT_U8:  return AV_SAMPLE_FMT_U8;
+	case SND_PCM_FORMAT_S16: return AV_SAMPLE_FMT_S16;
+	case SND_PCM_FORMAT_S32: return AV_SAMPLE_FMT_S32;
+	default:                 return AV_SAMPLE_FMT_NONE;
+	}
+}
+
+static SwrContext *omxalsasink_resampler_open(OMX_ALSASINK *sink, unsigned int in_rate, unsigned int out_rate)
+{
+	enum AVSampleFormat fmt = omxalsasink_swr_format(sink->pcm_format);
+	uint64_t layout = av_get_default_channel_layout(sink->pcm.nChannels);
+	SwrContext *resampler;
+
+	if (fmt == AV_SAMPLE_FMT_NONE || !sink->pcm.bInterleaved) return 0;
+
+	resampler = swr_alloc_set_opts(NULL,
+		/*out*/ layout, fmt, out_rate,
+		/*in*/ layout, fmt, in_rate,
+		0, NULL);
+	if (!resampler) return 0;
+
+	av_opt_set_double(resampler, "cutoff", 0.985, 0);
+	av_opt_set_int(resampler,"filter_size", 64, 0);
+	if (swr_init(resampler) < 0) swr_free(&resampler);
+	return resampler;
+}
+
+/* snd_pcm_writei() for MMAP_INTERLEAVED access: copies straight into the
+ * ring buffer and starts the stream once something is queued. */
+static snd_pcm_sframes_t omxalsasink_mmap_writei(snd_pcm_t *dev, const uint8_t *ptr, snd_pcm_uframes_t len, size_t frame_size)
+{
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_uframes_t offset, frames, done = 0;
+	snd_pcm_sframes_t n = 0;
+
+	while (done < len) {
+		n = snd_pcm_avail_update(dev);
+		if (n < 0) break;
+		if (n == 0) {
+			/* Ring buffer full before the stream was started */
+			if (snd_pcm_state(dev) == SND_PCM_STATE_PREPARED && (n = snd_pcm_start(dev)) < 0)
+				break;
+			if ((n = snd_pcm_wait(dev, 1000)) < 0) break;
+			continue;
+		}
+
+		frames = len - done;
+		if ((n = snd_pcm_mmap_begin(dev, &areas, &offset, &frames)) < 0) break;
+		memcpy((uint8_t *) areas[0].addr + (areas[0].first >> 3) + offset * (areas[0].step >> 3),
+		       ptr + done * frame_size, frames * frame_size);
+		n = snd_pcm_mmap_commit(dev, offset, frames);
+		if (n < 0) break;
+		if ((snd_pcm_uframes_t) n != frames) {
+			n = -EPIPE;
+			break;
+		}
+		done += n;
+
+		if (snd_pcm_state(dev) == SND_PCM_STATE_PREPARED && (n = snd_pcm_start(dev)) < 0)
+			break;
+	}
+	return done ? (snd_pcm_sframes_t) done : n;
+}
+
+static void omxalsasink_write(OMX_ALSASINK *sink, snd_pcm_t *dev, uint8_t *ptr, snd_pcm_sframes_t len)
+{
+	GOMX_COMPONENT *comp = &sink->gcomp;
+	snd_pcm_sframes_t n;
+
+	while (len > 0) {
+		if (sink->mmap_active)
+			n = omxalsasink_mmap_writei(dev, ptr, len, sink->frame_size);
+		else
+			n = snd_pcm_writei(dev, ptr, len);
+		if (n < 0) {
+			CINFO(comp, 0, "alsa error: %ld: %s", n, snd_strerror(n));
+			if (n == -EPIPE) {
+				pthread_mutex_lock(&comp->mutex);
+				sink->xruns++;
+				pthread_mutex_unlock(&comp->mutex);
+			}
+			snd_pcm_recover(dev, n, 1);
+			n = 0;
+		}
+		len -= n;
+		ptr += n * sink->frame_size;
+	}
+}
+
 static void *omxalsasink_worker(void *ptr)
 {
 	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) ptr;
@@ -1025,13 +307,12 @@ static void *omxalsasink_worker(void *ptr)
 	GOMX_PORT *audio_port = &comp->ports[OMXALSA_PORT_AUDIO];
 	GOMX_PORT *clock_port = &comp->ports[OMXALSA_PORT_CLOCK];
 	snd_pcm_t *dev = 0;
-	snd_pcm_sframes_t n, delay;
+	snd_pcm_sframes_t delay;
 	snd_pcm_hw_params_t *hwp;
 	snd_pcm_uframes_t buffer_size, period_size, period_size_max;
 	SwrContext *resampler = 0;
 	uint8_t *resample_buf = 0;
 	int32_t timescale;
-	uint64_t layout;
 	size_t resample_bufsz;
 	unsigned int in_sample_rate;
 	unsigned int rate;
@@ -1045,16 +326,25 @@ static void *omxalsasink_worker(void *ptr)
 
 	in_sample_rate = sink->pcm.nSamplingRate;
 	rate = sink->pcm.nSamplingRate;
-	buffer_size = rate / 5;
-	period_size = buffer_size / 4;
-	period_size_max = buffer_size / 3;
+	buffer_size = sink->buffer_time ? (uint64_t) rate * sink->buffer_time / 1000000 : rate / 5;
+	period_size = sink->period_time ? (uint64_t) rate * sink->period_time / 1000000 : buffer_size / 4;
+	period_size_max = max(period_size, buffer_size / 3);
 
 	snd_pcm_hw_params_alloca(&hwp);
 	snd_pcm_hw_params_any(dev, hwp);
 	err = snd_pcm_hw_params_set_channels(dev, hwp, sink->pcm.nChannels);
 	if (err) goto alsa_error;
-	err = snd_pcm_hw_params_set_access(dev, hwp, sink->pcm.bInterleaved ? SND_PCM_ACCESS_RW_INTERLEAVED : SND_PCM_ACCESS_RW_NONINTERLEAVED);
-	if (err) goto alsa_error;
+	sink->mmap_active = 0;
+	if (sink->mmap && sink->pcm.bInterleaved) {
+		if (snd_pcm_hw_params_set_access(dev, hwp, SND_PCM_ACCESS_MMAP_INTERLEAVED) == 0)
+			sink->mmap_active = 1;
+		else
+			CINFO(comp, 0, "%s has no mmap access, using writei", sink->device_name);
+	}
+	if (!sink->mmap_active) {
+		err = snd_pcm_hw_params_set_access(dev, hwp, sink->pcm.bInterleaved ? SND_PCM_ACCESS_RW_INTERLEAVED : SND_PCM_ACCESS_RW_NONINTERLEAVED);
+		if (err) goto alsa_error;
+	}
 	err = snd_pcm_hw_params_set_rate_near(dev, hwp, &rate, 0);
 	if (err) goto alsa_error;
 	err = snd_pcm_hw_params_set_format(dev, hwp, sink->pcm_format);
@@ -1067,27 +357,32 @@ static void *omxalsasink_worker(void *ptr)
 	if (err) goto alsa_error;
 	err = snd_pcm_hw_params(dev, hwp);
 	if (err) goto alsa_error;
+	snd_pcm_hw_params_get_buffer_size(hwp, &buffer_size);
+	snd_pcm_hw_params_get_period_size(hwp, &period_size, 0);
 
 	sink->pcm.nSamplingRate = rate;
 	sink->frame_size = (sink->pcm.nChannels * sink->pcm.nBitPerSample) >> 3;
 	sink->sample_rate = rate;
-
-	layout = av_get_default_channel_layout(sink->pcm.nChannels);
-	resampler = swr_alloc_set_opts(NULL,
-		/*out*/ layout, AV_SAMPLE_FMT_S16, rate,
-		/*in*/ layout, AV_SAMPLE_FMT_S16, in_sample_rate,
-		0, NULL);
-	if (!resampler) goto err;
-
-	av_opt_set_double(resampler, "cutoff", 0.985, 0);
-	av_opt_set_int(resampler,"filter_size", 64, 0);
-	if (swr_init(resampler) < 0) goto err;
-
-	resample_bufsz = audio_port->def.nBufferSize * 2;
+	sink->buffer_size = buffer_size;
+	sink->period_size = period_size;
+	sink->resampling = 0;
+	sink->pcm_delay_max = 0;
+	sink->xruns = 0;
+
+	/* Only needed for a rate change or clock compensation, otherwise the
+	 * buffers go to the device untouched */
+	resample_bufsz = ((uint64_t) audio_port->def.nBufferSize * rate / in_sample_rate + 64 * sink->frame_size) * 2;
 	resample_buf = (uint8_t *) malloc(resample_bufsz);
 	if (!resample_buf) goto err;
+	if (rate != in_sample_rate) {
+		resampler = omxalsasink_resampler_open(sink, in_sample_rate, rate);
+		if (!resampler) goto err;
+		sink->resampling = 1;
+	}
 
-	CINFO(comp, 0, "sample_rate %d, frame_size %d", rate, sink->frame_size);
+	CINFO(comp, 0, "sample_rate %d, frame_size %d, buffer %lu, period %lu, %s%s",
+		rate, sink->frame_size, buffer_size, period_size,
+		sink->mmap_active ? "mmap" : "writei", sink->resampling ? ", resampling" : "");
 
 	pthread_mutex_lock(&comp->mutex);
 	while (comp->wanted_state == OMX_StateExecuting) {
@@ -1095,8 +390,11 @@ static void *omxalsasink_worker(void *ptr)
 		sink->pcm_state = snd_pcm_state(dev);
 		delay = 0;
 		snd_pcm_delay(dev, &delay);
-		if (resampler) delay += swr_get_delay(resampler, rate);
+		if (sink->resampling) delay += swr_get_delay(resampler, rate);
 		sink->pcm_delay = delay;
+		sink->pcm_hw_delay = delay;
+		if (sink->pcm_state == SND_PCM_STATE_RUNNING && delay > sink->pcm_delay_max)
+			sink->pcm_delay_max = delay;
 
 		/* Wait for buffer, or timeout to refresh state */
 		buf = 0;
@@ -1146,16 +444,32 @@ static void *omxalsasink_worker(void *ptr)
 		} else {
 			uint8_t *out_ptr, *in_ptr;
 			int in_len, out_len;
+			int compensate, resampling = sink->resampling;
 
 			pthread_mutex_unlock(&comp->mutex);
 
 			in_ptr = (uint8_t *)(buf->pBuffer + buf->nOffset);
 			in_len = buf->nFilledLen / sink->frame_size;
 
-			if (resampler) {
+			compensate = timescale != 0x10000 && timescale >= 0x0100 && timescale <= 0x20000;
+			if (compensate && !resampler)
+				resampler = omxalsasink_resampler_open(sink, in_sample_rate, rate);
+			if (resampling && !compensate && rate == in_sample_rate) {
+				/* Play what is left in the filter and go back to
+				 * writing the buffers directly */
+				out_ptr = resample_buf;
+				out_len = swr_convert(resampler, &out_ptr, resample_bufsz / sink->frame_size, NULL, 0);
+				if (out_len > 0) omxalsasink_write(sink, dev, out_ptr, out_len);
+				swr_init(resampler);
+				resampling = 0;
+			} else {
+				resampling = resampler && (compensate || rate != in_sample_rate);
+			}
+
+			if (resampling) {
 				int delta = 0;
 
-				if (timescale != 0x10000 && timescale >= 0x0100 && timescale <= 0x20000)
+				if (compensate)
 					delta = ((int64_t)in_len*(0x10000-timescale))>>16;
 
 				out_len = resample_bufsz / sink->frame_size;
@@ -1174,19 +488,10 @@ static void *omxalsasink_worker(void *ptr)
 			pthread_mutex_lock(&comp->mutex);
 			sink->play_queue_size -= buf->nFilledLen;
 			sink->pcm_delay += out_len;
+			sink->resampling = resampling;
 			pthread_mutex_unlock(&comp->mutex);
 
-			while (out_len > 0) {
-				n = snd_pcm_writei(dev, out_ptr, out_len);
-				if (n < 0) {
-					CINFO(comp, 0, "alsa error: %ld: %s", n, snd_strerror(n));
-					snd_pcm_recover(dev, n, 1);
-					n = 0;
-				}
-				out_len -= n;
-				n *= sink->frame_size;
-				out_ptr += n;
-			}
+			omxalsasink_write(sink, dev, out_ptr, out_len);
 			pthread_mutex_lock(&comp->mutex);
 		}
 
@@ -1206,7 +511,7 @@ static void *omxalsasink_worker(void *ptr)
 	pthread_mutex_unlock(&comp->mutex);
 cleanup:
 	if (dev) snd_pcm_close(dev);
-	if (resampler) swr_close(resampler);
+	if (resampler) swr_free(&resampler);
 	free(resample_buf);
 	CINFO(comp, 0, "worker stopped");
 	return 0;
@@ -1322,7 +627,6 @@ static OMX_ERRORTYPE omxalsasink_create(OMX_HANDLETYPE *pHandle, OMX_PTR pAppDat
 	sink->gcomp.omx.SetParameter = omxalsasink_set_parameter;
 	sink->gcomp.omx.GetConfig = omxalsasink_get_config;
 	sink->gcomp.omx.SetConfig = omxalsasink_set_config;
-	sink->gcomp.omx.GetExtensionIndex = omxalsasink_get_extension_index;
 	sink->gcomp.omx.ComponentDeInit = omxalsasink_deinit;
 	sink->gcomp.worker = omxalsasink_worker;
 	sink->gcomp.statechange = omxalsasink_statechange;
@@ -1338,13 +642,21 @@ static OMX_ERRORTYPE omxalsasink_create(OMX_HANDLETYPE *pHandle, OMX_PTR pAppDat
 
 /* OMX Glue to get the handle */
 
-#include <OMXAlsa.h>
+#include <OMXSoftCore.h>
+
+bool OMXALSA_IsComponent(const char *cComponentName)
+{
+	return strncmp(cComponentName, "OMX.alsa.", 9) == 0 ||
+	       strncmp(cComponentName, "OMX.soft.", 9) == 0;
+}
 
 OMX_ERRORTYPE OMXALSA_GetHandle(OMX_OUT OMX_HANDLETYPE* pHandle, OMX_IN OMX_STRING cComponentName,
 				OMX_IN  OMX_PTR pAppData, OMX_IN OMX_CALLBACKTYPE* pCallbacks)
 {
 	if (strcmp(cComponentName, "OMX.alsa.audio_render") == 0)
 		return omxalsasink_create(pHandle, pAppData, pCallbacks);
+	if (strncmp(cComponentName, "OMX.soft.", 9) == 0)
+		return OMXSOFT_GetHandle(pHandle, cComponentName, pAppData, pCallbacks);
 
 	return OMX_ErrorComponentNotFound;
 }
@@ -1,6 +1,10 @@
 #pragma once
 #include <IL/OMX_Core.h>
 
+/* true for the components OMXALSA_GetHandle creates: OMX.alsa.audio_render
+ * and the OMX.soft.* software components of OMXSoftCore.cpp */
+bool OMXALSA_IsComponent(const char *cComponentName);
+
 OMX_API OMX_ERRORTYPE OMX_APIENTRY OMXALSA_GetHandle(
     OMX_OUT OMX_HANDLETYPE* pHandle,
     OMX_IN  OMX_STRING cComponentName,
@@ -9,3 +13,26 @@ OMX_API OMX_ERRORTYPE OMX_APIENTRY OMXALSA_GetHandle(
 
 OMX_API OMX_ERRORTYPE OMX_APIENTRY OMXALSA_FreeHandle(
     OMX_IN  OMX_HANDLETYPE hComponent);
+
+/* Device buffering of OMX.alsa.audio_render. SetConfig before the component
+ * goes to Idle picks the buffer and period lengths and the write method,
+ * GetConfig reads back what the device accepted and the measured latency.
+ * The index sits well above the Broadcom vendor indexes. */
+#define OMX_IndexConfigAlsaLatency ((OMX_INDEXTYPE)(OMX_IndexVendorStartUnused + 0xA15A00))
+
+typedef struct OMX_CONFIG_ALSALATENCYTYPE {
+    OMX_U32 nSize;
+    OMX_VERSIONTYPE nVersion;
+    OMX_U32 nBufferTime;    /* us, 0 = 200 ms */
+    OMX_U32 nPeriodTime;    /* us, 0 = a quarter of the buffer */
+    OMX_BOOL bMmap;         /* write through snd_pcm_mmap_begin/commit, falls back to writei */
+    /* read only */
+    OMX_U32 nSampleRate;
+    OMX_U32 nBufferSize;    /* frames */
+    OMX_U32 nPeriodSize;    /* frames */
+    OMX_U32 nDelay;         /* frames between the write pointer and the speaker */
+    OMX_U32 nDelayMax;      /* largest nDelay seen while running */
+    OMX_U32 nXruns;
+    OMX_BOOL bMmapActive;
+    OMX_BOOL bResampling;   /* swr_convert runs for rate change or clock compensation */
+} OMX_CONFIG_ALSALATENCYTYPE;
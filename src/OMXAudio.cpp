@@ -25,6 +25,8 @@
 #endif
 
 #include "OMXAudio.h"
+#include "OMXAlsa.h"
+#include "PCMUtils.h"
 #include "utils/log.h"
 
 #define CLASSNAME "COMXAudio"
@@ -70,7 +72,9 @@ COMXAudio::COMXAudio() :
   m_eEncoding       (OMX_AUDIO_CodingPCM),
   m_last_pts        (DVD_NOPTS_VALUE),
   m_submitted_eos   (false  ),
-  m_failed_eos      (false  )
+  m_failed_eos      (false  ),
+  m_soft_remap      (false  ),
+  m_remap_gain      (1.0f   )
 {
 }
 
@@ -92,7 +96,7 @@ bool COMXAudio::PortSettingsChanged()
     return true;
   }
 
-  if(!m_config.passthrough)
+  if(!m_config.passthrough && !m_soft_remap)
   {
     if(!m_omx_mixer.Initialize("OMX.broadcom.audio_mixer", OMX_IndexParamAudioInit))
       return false;
@@ -204,6 +208,27 @@ bool COMXAudio::PortSettingsChanged()
       }
     }
   }
+  else if( m_soft_remap && m_omx_render_analog.IsInitialized() )
+  {
+    /* already mixed by AddPackets(), the render takes the decoder output as is */
+    OMX_INIT_STRUCTURE(m_pcm_output);
+    m_pcm_output.nPortIndex = m_omx_decoder.GetOutputPort();
+    omx_err = m_omx_decoder.GetParameter(OMX_IndexParamAudioPcm, &m_pcm_output);
+    if(omx_err != OMX_ErrorNone)
+    {
+      CLog::Log(LOGERROR, "%s::%s - error m_omx_decoder GetParameter omx_err(0x%08x)", CLASSNAME, __func__, omx_err);
+      return false;
+    }
+
+    memcpy(m_pcm_output.eChannelMapping, m_output_channels, sizeof(m_output_channels));
+    m_pcm_output.nPortIndex = m_omx_render_analog.GetInputPort();
+    omx_err = m_omx_render_analog.SetParameter(OMX_IndexParamAudioPcm, &m_pcm_output);
+    if(omx_err != OMX_ErrorNone)
+    {
+      CLog::Log(LOGERROR, "%s::%s - error m_omx_render_analog SetParameter omx_err(0x%08x)", CLASSNAME, __func__, omx_err);
+      return false;
+    }
+  }
   if( m_omx_render_analog.IsInitialized() )
   {
     m_omx_tunnel_clock_analog.Initialize(m_omx_clock, m_omx_clock->GetInputPort(),
@@ -253,6 +278,21 @@ bool COMXAudio::PortSettingsChanged()
       CLog::Log(LOGERROR, "%s::%s - m_omx_render_analog.SetConfig omx_err(0x%08x)", CLASSNAME, __func__, omx_err);
       return false;
     }
+
+    if (m_config.device == "omx:alsa")
+    {
+      OMX_CONFIG_ALSALATENCYTYPE alsaLatency;
+      OMX_INIT_STRUCTURE(alsaLatency);
+      alsaLatency.nBufferTime = m_config.alsa_buffer_ms * 1000;
+      alsaLatency.nPeriodTime = m_config.alsa_period_ms * 1000;
+      alsaLatency.bMmap = m_config.alsa_mmap ? OMX_TRUE : OMX_FALSE;
+      omx_err = m_omx_render_analog.SetConfig(OMX_IndexConfigAlsaLatency, &alsaLatency);
+      if (omx_err != OMX_ErrorNone)
+      {
+        CLog::Log(LOGERROR, "%s::%s - m_omx_render_analog.SetConfig OMX_IndexConfigAlsaLatency omx_err(0x%08x)", CLASSNAME, __func__, omx_err);
+        return false;
+      }
+    }
   }
 
   if( m_omx_render_hdmi.IsInitialized() )
@@ -451,47 +491,61 @@ bool COMXAudio::Initialize(OMXClock *clock, const OMXAudioConfig &config, uint64
   m_wave_header.Format.nChannels  = 2;
   m_wave_header.dwChannelMask     = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT;
 
+  m_remap.Reset();
+
   // set the input format, and get the channel layout so we know what we need to open
   if (!m_config.passthrough && channelMap)
   {
-    enum PCMChannels inLayout[OMX_AUDIO_MAXCHANNELS];
-    enum PCMChannels outLayout[OMX_AUDIO_MAXCHANNELS];
+    enum PCMChannels inLayout[PCM_MAX_CH];
+    enum PCMChannels outLayout[PCM_MAX_CH];
     // force out layout to stereo if input is not multichannel - it gives the receiver a chance to upmix
     if (channelMap == (AV_CH_FRONT_LEFT | AV_CH_FRONT_RIGHT) || channelMap == AV_CH_FRONT_CENTER)
       m_config.layout = PCM_LAYOUT_2_0;
-    BuildChannelMap(inLayout, channelMap);
-    m_OutputChannels = BuildChannelMapCEA(outLayout, GetChannelLayout(m_config.layout));
-    CPCMRemap m_remap;
-    m_remap.Reset();
+    pcm_build_channel_map(inLayout, channelMap);
+    m_OutputChannels = pcm_build_channel_map_cea(outLayout, pcm_get_channel_layout(m_config.layout));
     /*outLayout = */m_remap.SetInputFormat (m_InputChannels, inLayout, uiBitsPerSample / 8, m_config.hints.samplerate, m_config.layout, m_config.boostOnDownmix);
     m_remap.SetOutputFormat(m_OutputChannels, outLayout);
     m_remap.GetDownmixMatrix(m_downmix_matrix);
     m_wave_header.dwChannelMask = channelMap;
     BuildChannelMapOMX(m_input_channels, channelMap);
-    BuildChannelMapOMX(m_output_channels, GetChannelLayout(m_config.layout));
+    BuildChannelMapOMX(m_output_channels, pcm_get_channel_layout(m_config.layout));
   }
 
   m_BitsPerSample = uiBitsPerSample;
 
-  m_BytesPerSec   = m_config.hints.samplerate * 2 << rounded_up_channels_shift[m_InputChannels];
+  // optionally mix down in AddPackets() instead of the audio_mixer in front of
+  // the alsa render and feed audio_decode S16 that is already in the output layout
+  m_soft_remap = m_config.soft_downmix && m_config.device == "omx:alsa" && !m_config.passthrough && !m_config.hwdecode &&
+                 m_remap.CanRemap() && m_InputChannels <= PCM_MAX_CH;
+  m_remap_gain = 1.0f;
+  unsigned int decodeChannels = m_soft_remap ? m_OutputChannels : m_InputChannels;
+  unsigned int decodeBits     = m_soft_remap ? 16 : m_BitsPerSample;
+  if (m_soft_remap)
+  {
+    m_wave_header.dwChannelMask = pcm_get_channel_layout(m_config.layout);
+    CLog::Log(LOGINFO, "COMXAudio::Initialize - software downmix %d -> %d channels", m_InputChannels, m_OutputChannels);
+  }
+
+  m_BytesPerSec   = m_config.hints.samplerate * 2 << rounded_up_channels_shift[decodeChannels];
   m_BufferLen     = m_BytesPerSec * AUDIO_BUFFER_SECONDS;
-  m_InputBytesPerSec = m_config.hints.samplerate * m_BitsPerSample * m_InputChannels >> 3;
+  m_InputBytesPerSec = m_config.hints.samplerate * decodeBits * decodeChannels >> 3;
 
   // should be big enough that common formats (e.g. 6 channel DTS) fit in a single packet.
   // we don't mind less common formats being split (e.g. ape/wma output large frames)
   // 6 channel 32bpp float to 8 channel 16bpp in, so a full 48K input buffer will fit the output buffer
-  m_ChunkLen = AUDIO_DECODE_OUTPUT_BUFFER * (m_InputChannels * m_BitsPerSample) >> (rounded_up_channels_shift[m_InputChannels] + 4);
+  m_ChunkLen = AUDIO_DECODE_OUTPUT_BUFFER * (decodeChannels * decodeBits) >> (rounded_up_channels_shift[decodeChannels] + 4);
 
   m_wave_header.Samples.wSamplesPerBlock    = 0;
-  m_wave_header.Format.nChannels            = m_InputChannels;
-  m_wave_header.Format.nBlockAlign          = m_InputChannels *
-    (m_BitsPerSample >> 3);
-  // 0x8000 is custom format interpreted by GPU as WAVE_FORMAT_IEEE_FLOAT_PLANAR
-  m_wave_header.Format.wFormatTag           = m_BitsPerSample == 32 ? 0x8000 : WAVE_FORMAT_PCM;
+  m_wave_header.Format.nChannels            = decodeChannels;
+  m_wave_header.Format.nBlockAlign          = decodeChannels *
+    (decodeBits >> 3);
+  // 0x8000 is custom format interpreted by GPU as WAVE_FORMAT_IEEE_FLOAT_PLANAR,
+  // with pack_s32 AddFrame() converts float frames to plain S32 PCM instead
+  m_wave_header.Format.wFormatTag           = decodeBits == 32 && !m_config.pack_s32 ? 0x8000 : WAVE_FORMAT_PCM;
   m_wave_header.Format.nSamplesPerSec       = m_config.hints.samplerate;
   m_wave_header.Format.nAvgBytesPerSec      = m_BytesPerSec;
-  m_wave_header.Format.wBitsPerSample       = m_BitsPerSample;
-  m_wave_header.Samples.wValidBitsPerSample = m_BitsPerSample;
+  m_wave_header.Format.wBitsPerSample       = decodeBits;
+  m_wave_header.Samples.wValidBitsPerSample = decodeBits;
   m_wave_header.Format.cbSize               = 0;
   m_wave_header.SubFormat                   = KSDATAFORMAT_SUBTYPE_PCM;
 
@@ -594,7 +648,7 @@ bool COMXAudio::Initialize(OMXClock *clock, const OMXAudioConfig &config, uint64
     }
 
     omx_buffer->nOffset = 0;
-    omx_buffer->nFilledLen  = std::min(sizeof(m_wave_header), omx_buffer->nAllocLen);
+    omx_buffer->nFilledLen  = std::min((OMX_U32)sizeof(m_wave_header), omx_buffer->nAllocLen);
 
     memset((unsigned char *)omx_buffer->pBuffer, 0x0, omx_buffer->nAllocLen);
     memcpy((unsigned char *)omx_buffer->pBuffer, &m_wave_header, omx_buffer->nFilledLen);
@@ -644,13 +698,13 @@ bool COMXAudio::Initialize(OMXClock *clock, const OMXAudioConfig &config, uint64
 
   OMX_INIT_STRUCTURE(m_pcm_input);
   m_pcm_input.nPortIndex            = m_omx_decoder.GetInputPort();
-  memcpy(m_pcm_input.eChannelMapping, m_input_channels, sizeof(m_input_channels));
+  memcpy(m_pcm_input.eChannelMapping, m_soft_remap ? m_output_channels : m_input_channels, sizeof(m_input_channels));
   m_pcm_input.eNumData              = OMX_NumericalDataSigned;
   m_pcm_input.eEndian               = OMX_EndianLittle;
   m_pcm_input.bInterleaved          = OMX_TRUE;
-  m_pcm_input.nBitPerSample         = m_BitsPerSample;
+  m_pcm_input.nBitPerSample         = m_soft_remap ? 16 : m_BitsPerSample;
   m_pcm_input.ePCMMode              = OMX_AUDIO_PCMModeLinear;
-  m_pcm_input.nChannels             = m_InputChannels;
+  m_pcm_input.nChannels             = m_soft_remap ? m_OutputChannels : m_InputChannels;
   m_pcm_input.nSamplingRate         = m_config.hints.samplerate;
 
   m_Initialized   = true;
@@ -809,6 +863,14 @@ bool COMXAudio::ApplyVolume(void)
   // the analogue volume is too quiet for some. Allow use of an advancedsetting to boost this (at risk of distortion) (deprecated)
   double gain = pow(10, (m_ac3Gain - 12.0f) / 20.0);
 
+  if (m_soft_remap)
+  {
+    // no mixer in the chain, AddPackets() applies this while it mixes
+    m_remap_gain = gain * fVolume * m_amplification * m_attenuation;
+    CLog::Log(LOGINFO, "%s::%s - Volume=%.2f (* %.2f * %.2f) in software\n", CLASSNAME, __func__, fVolume, m_amplification, m_attenuation);
+    return true;
+  }
+
   const float* coeff = m_downmix_matrix;
 
   OMX_CONFIG_BRCMAUDIODOWNMIXCOEFFICIENTS8x8 mix;
@@ -851,11 +913,11 @@ bool COMXAudio::ApplyVolume(void)
 //***********************************************************************************************
 unsigned int COMXAudio::AddPackets(const void* data, unsigned int len)
 {
-  return AddPackets(data, len, 0, 0, 0);
+  return AddPackets(data, len, 0, 0);
 }
 
 //***********************************************************************************************
-unsigned int COMXAudio::AddPackets(const void* data, unsigned int len, double dts, double pts, unsigned int frame_size)
+unsigned int COMXAudio::AddPackets(const void* data, unsigned int len, double dts, double pts)
 {
   CSingleLock lock (m_critSection);
 
@@ -866,12 +928,12 @@ unsigned int COMXAudio::AddPackets(const void* data, unsigned int len, double dt
   }
 
   unsigned pitch = (m_config.passthrough || m_config.hwdecode) ? 1:(m_BitsPerSample >> 3) * m_InputChannels;
+  // bytes per sample in the decoder input buffers, S16 in the output layout when mixing in software
+  unsigned out_pitch = m_soft_remap ? m_OutputChannels * sizeof(int16_t) : pitch;
   unsigned int demuxer_samples = len / pitch;
   unsigned int demuxer_samples_sent = 0;
   uint8_t *demuxer_content = (uint8_t *)data;
 
-  OMX_ERRORTYPE omx_err;
-
   OMX_BUFFERHEADERTYPE *omx_buffer = NULL;
 
   while(demuxer_samples_sent < demuxer_samples)
@@ -891,106 +953,177 @@ unsigned int COMXAudio::AddPackets(const void* data, unsigned int len, double dt
 
     // we want audio_decode output buffer size to be no more than AUDIO_DECODE_OUTPUT_BUFFER.
     // it will be 16-bit and rounded up to next power of 2 in channels
-    unsigned int max_buffer = AUDIO_DECODE_OUTPUT_BUFFER * (m_InputChannels * m_BitsPerSample) >> (rounded_up_channels_shift[m_InputChannels] + 4);
+    unsigned int max_buffer = m_ChunkLen;
 
     unsigned int remaining = demuxer_samples-demuxer_samples_sent;
-    unsigned int samples_space = std::min(max_buffer, omx_buffer->nAllocLen)/pitch;
+    unsigned int samples_space = std::min(max_buffer, omx_buffer->nAllocLen)/out_pitch;
     unsigned int samples = std::min(remaining, samples_space);
 
-    omx_buffer->nFilledLen = samples * pitch;
+    omx_buffer->nFilledLen = samples * out_pitch;
+
+    if (m_soft_remap)
+      m_remap.Remap((const int16_t *)(demuxer_content + demuxer_samples_sent * pitch), (int16_t *)omx_buffer->pBuffer, samples, m_remap_gain);
+    else
+      memcpy(omx_buffer->pBuffer, demuxer_content + demuxer_samples_sent * pitch, omx_buffer->nFilledLen);
+
+    SetTimeStamp(omx_buffer, pts);
+
+    demuxer_samples_sent += samples;
+
+    if(demuxer_samples_sent == demuxer_samples)
+      omx_buffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+
+    if(!SubmitBuffer(omx_buffer))
+      return 0;
+  }
+  m_submitted += (float)demuxer_samples / m_config.hints.samplerate;
+  UpdateAttenuation();
+  return len;
+}
+
+//***********************************************************************************************
+unsigned int COMXAudio::AddFrame(uint8_t *const *planes, unsigned int samples, double dts, double pts)
+{
+  CSingleLock lock (m_critSection);
 
-    unsigned int frames = frame_size ? len/frame_size:0;
-    if ((samples < demuxer_samples || frames > 1) && m_BitsPerSample==32 && !(m_config.passthrough || m_config.hwdecode))
+  if(!m_Initialized)
+  {
+    CLog::Log(LOGERROR,"COMXAudio::AddFrame - sanity failed. no valid play handle!");
+    return samples;
+  }
+
+  // bytes per sample in the decoder input buffers
+  const unsigned int out_pitch = m_soft_remap ? m_OutputChannels * sizeof(int16_t) : m_InputChannels * (m_BitsPerSample >> 3);
+  unsigned int sent = 0;
+
+  // every call submits all it packs, so GetDelay() and m_submitted never miss
+  // samples sitting in a half filled buffer
+  while(sent < samples)
+  {
+    // 200ms timeout
+    OMX_BUFFERHEADERTYPE *omx_buffer = m_omx_decoder.GetInputBuffer(200);
+    if(omx_buffer == NULL)
     {
-      const unsigned int sample_pitch   = m_BitsPerSample >> 3;
-      const unsigned int frame_samples  = frame_size / pitch;
-      const unsigned int plane_size     = frame_samples * sample_pitch;
-      const unsigned int out_plane_size = samples * sample_pitch;
-      //CLog::Log(LOGDEBUG, "%s::%s samples:%d/%d ps:%d ops:%d fs:%d pitch:%d filled:%d frames=%d", CLASSNAME, __func__, samples, demuxer_samples, plane_size, out_plane_size, frame_size, pitch, omx_buffer
-      for (unsigned int sample = 0; sample < samples; )
-      {
-        unsigned int frame = (demuxer_samples_sent + sample) / frame_samples;
-        unsigned int sample_in_frame = (demuxer_samples_sent + sample) - frame * frame_samples;
-        int out_remaining = std::min(std::min(frame_samples - sample_in_frame, samples), samples-sample);
-        uint8_t *src = demuxer_content + frame*frame_size + sample_in_frame * sample_pitch;
-        uint8_t *dst = (uint8_t *)omx_buffer->pBuffer + sample * sample_pitch;
-        for (unsigned int channel = 0; channel < m_InputChannels; channel++)
-        {
-          //CLog::Log(LOGDEBUG, "%s::%s copy(%d,%d,%d) (s:%d f:%d sin:%d c:%d)", CLASSNAME, __func__, dst-(uint8_t *)omx_buffer->pBuffer, src-demuxer_content, out_remaining, sample, frame, sample_in_frame
-          memcpy(dst, src, out_remaining * sample_pitch);
-          src += plane_size;
-          dst += out_plane_size;
-        }
-        sample += out_remaining;
-      }
+      CLog::Log(LOGERROR, "COMXAudio::AddFrame timeout\n");
+      return sent;
     }
-    else
+
+    // we want audio_decode output buffer size to be no more than AUDIO_DECODE_OUTPUT_BUFFER
+    unsigned int count = std::min(samples - sent, std::min(m_ChunkLen, omx_buffer->nAllocLen) / out_pitch);
+    if(count == 0)
     {
-       uint8_t *dst = omx_buffer->pBuffer;
-       uint8_t *src = demuxer_content + demuxer_samples_sent * pitch;
-       memcpy(dst, src, omx_buffer->nFilledLen);
+      CLog::Log(LOGERROR, "%s::%s - %u byte samples don't fit a %u byte buffer, dropping the frame\n", CLASSNAME, __func__,
+                out_pitch, std::min(m_ChunkLen, omx_buffer->nAllocLen));
+      omx_buffer->nFilledLen = 0;
+      m_omx_decoder.DecoderEmptyBufferDone(m_omx_decoder.GetComponent(), omx_buffer);
+      return samples;
     }
 
-    uint64_t val  = (uint64_t)(pts == DVD_NOPTS_VALUE) ? 0 : pts;
+    omx_buffer->nOffset    = 0;
+    omx_buffer->nFlags     = 0;
+    omx_buffer->nFilledLen = count * out_pitch;
+    PackFrame(planes, sent, count, omx_buffer->pBuffer);
+    SetTimeStamp(omx_buffer, pts);
+    sent += count;
 
-    if(m_setStartTime)
-    {
-      omx_buffer->nFlags = OMX_BUFFERFLAG_STARTTIME;
+    if(sent == samples)
+      omx_buffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
 
-      m_last_pts = pts;
+    if(!SubmitBuffer(omx_buffer))
+      return 0;
+  }
+  m_submitted += (float)samples / m_config.hints.samplerate;
+  UpdateAttenuation();
+  return samples;
+}
 
-      CLog::Log(LOGDEBUG, "COMXAudio::Decode ADec : setStartTime %f\n", (float)val / DVD_TIME_BASE);
-      m_setStartTime = false;
-    }
+// planes[][offset..offset+samples) into a decoder buffer, converted on the way
+// when the GPU doesn't take the decoder's format
+void COMXAudio::PackFrame(uint8_t *const *planes, unsigned int offset, unsigned int samples, uint8_t *dst)
+{
+  if(m_BitsPerSample == 16)
+  {
+    const int16_t *src = (const int16_t *)planes[0] + offset * m_InputChannels;
+    if(m_soft_remap)
+      m_remap.Remap(src, (int16_t *)dst, samples, m_remap_gain);
     else
-    {
-      if(pts == DVD_NOPTS_VALUE)
-      {
-        omx_buffer->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
-        m_last_pts = pts;
-      }
-      else if (m_last_pts != pts)
-      {
-        if(pts > m_last_pts)
-          m_last_pts = pts;
-        else
-          omx_buffer->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
-      }
-      else if (m_last_pts == pts)
-      {
-        omx_buffer->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
-      }
-    }
+      memcpy(dst, src, samples * m_InputChannels * sizeof(int16_t));
+    return;
+  }
 
-    omx_buffer->nTimeStamp = ToOMXTime(val);
+  const float *src[PCM_MAX_CH];
+  unsigned int channels = std::min(m_InputChannels, (unsigned int)PCM_MAX_CH);
+  for(unsigned int channel = 0; channel < channels; channel++)
+    src[channel] = (const float *)planes[channel] + offset;
 
-    demuxer_samples_sent += samples;
+  if(m_soft_remap)
+    m_remap.Remap(src, (int16_t *)dst, samples, m_remap_gain);
+  else if(m_config.pack_s32)
+    pcm_planar_to_s32((int32_t *)dst, src, channels, samples);
+  else
+  {
+    // planar float, one block of samples per channel
+    for(unsigned int channel = 0; channel < channels; channel++)
+      memcpy(dst + channel * samples * sizeof(float), src[channel], samples * sizeof(float));
+  }
+}
 
-    if(demuxer_samples_sent == demuxer_samples)
-      omx_buffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+void COMXAudio::SetTimeStamp(OMX_BUFFERHEADERTYPE *omx_buffer, double pts)
+{
+  uint64_t val  = (uint64_t)(pts == DVD_NOPTS_VALUE) ? 0 : pts;
 
-    omx_err = m_omx_decoder.EmptyThisBuffer(omx_buffer);
-    if (omx_err != OMX_ErrorNone)
+  if(m_setStartTime)
+  {
+    omx_buffer->nFlags = OMX_BUFFERFLAG_STARTTIME;
+
+    m_last_pts = pts;
+
+    CLog::Log(LOGDEBUG, "COMXAudio::Decode ADec : setStartTime %f\n", (float)val / DVD_TIME_BASE);
+    m_setStartTime = false;
+  }
+  else
+  {
+    if(pts == DVD_NOPTS_VALUE)
     {
-      CLog::Log(LOGERROR, "%s::%s - OMX_EmptyThisBuffer() failed with result(0x%x)\n", CLASSNAME, __func__, omx_err);
-      printf("%s::%s - OMX_EmptyThisBuffer() failed with result(0x%x)\n", CLASSNAME, __func__, omx_err);
-      m_omx_decoder.DecoderEmptyBufferDone(m_omx_decoder.GetComponent(), omx_buffer);
-      return 0;
+      omx_buffer->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
+      m_last_pts = pts;
+    }
+    else if (m_last_pts != pts)
+    {
+      if(pts > m_last_pts)
+        m_last_pts = pts;
+      else
+        omx_buffer->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
+    }
+    else if (m_last_pts == pts)
+    {
+      omx_buffer->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
     }
-    //CLog::Log(LOGINFO, "AudiD: dts:%.0f pts:%.0f size:%d\n", dts, pts, len);
+  }
+
+  omx_buffer->nTimeStamp = ToOMXTime(val);
+}
+
+bool COMXAudio::SubmitBuffer(OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+  OMX_ERRORTYPE omx_err = m_omx_decoder.EmptyThisBuffer(omx_buffer);
+  if (omx_err != OMX_ErrorNone)
+  {
+    CLog::Log(LOGERROR, "%s::%s - OMX_EmptyThisBuffer() failed with result(0x%x)\n", CLASSNAME, __func__, omx_err);
+    printf("%s::%s - OMX_EmptyThisBuffer() failed with result(0x%x)\n", CLASSNAME, __func__, omx_err);
+    m_omx_decoder.DecoderEmptyBufferDone(m_omx_decoder.GetComponent(), omx_buffer);
+    return false;
+  }
 
-    omx_err = m_omx_decoder.WaitForEvent(OMX_EventPortSettingsChanged, 0);
-    if (omx_err == OMX_ErrorNone)
+  omx_err = m_omx_decoder.WaitForEvent(OMX_EventPortSettingsChanged, 0);
+  if (omx_err == OMX_ErrorNone)
+  {
+    if(!PortSettingsChanged())
     {
-      if(!PortSettingsChanged())
-      {
-        CLog::Log(LOGERROR, "%s::%s - error PortSettingsChanged omx_err(0x%08x)\n", CLASSNAME, __func__, omx_err);
-      }
+      CLog::Log(LOGERROR, "%s::%s - error PortSettingsChanged omx_err(0x%08x)\n", CLASSNAME, __func__, omx_err);
     }
   }
-  m_submitted += (float)demuxer_samples / m_config.hints.samplerate;
-  UpdateAttenuation();
-  return len;
+  return true;
 }
 
 void COMXAudio::UpdateAttenuation()
@@ -1070,6 +1203,16 @@ unsigned int COMXAudio::GetSpace()
   return free;
 }
 
+bool COMXAudio::WaitForSpace(unsigned int size, long timeout)
+{
+  return m_omx_decoder.WaitForInputSpace(size, timeout);
+}
+
+void COMXAudio::CancelWait(bool cancel)
+{
+  m_omx_decoder.CancelInputWait(cancel);
+}
+
 float COMXAudio::GetDelay()
 {
   CSingleLock lock (m_critSection);
@@ -1149,6 +1292,30 @@ unsigned int COMXAudio::GetAudioRenderingLatency()
   return param.nU32;
 }
 
+bool COMXAudio::GetOutputStats(OMXAudioOutputStats &stats)
+{
+  CSingleLock lock (m_critSection);
+
+  if(!m_Initialized || m_config.device != "omx:alsa" || !m_omx_render_analog.IsInitialized())
+    return false;
+
+  OMX_CONFIG_ALSALATENCYTYPE param;
+  OMX_INIT_STRUCTURE(param);
+
+  OMX_ERRORTYPE omx_err = m_omx_render_analog.GetConfig(OMX_IndexConfigAlsaLatency, &param);
+  if(omx_err != OMX_ErrorNone || !param.nSampleRate)
+    return false;
+
+  stats.latency     = (float)param.nDelay / param.nSampleRate;
+  stats.latency_max = (float)param.nDelayMax / param.nSampleRate;
+  stats.buffer      = (float)param.nBufferSize / param.nSampleRate;
+  stats.period      = (float)param.nPeriodSize / param.nSampleRate;
+  stats.xruns       = param.nXruns;
+  stats.mmap        = param.bMmapActive == OMX_TRUE;
+  stats.resampling  = param.bResampling == OMX_TRUE;
+  return true;
+}
+
 float COMXAudio::GetMaxLevel(double &pts)
 {
   CSingleLock lock (m_critSection);
@@ -1389,56 +1556,6 @@ void COMXAudio::PrintPCM(OMX_AUDIO_PARAM_PCMMODETYPE *pcm, std::string direction
   PrintChannels(pcm->eChannelMapping);
 }
 
-void COMXAudio::BuildChannelMap(enum PCMChannels *channelMap, uint64_t layout)
-{
-  int index = 0;
-  if (layout & AV_CH_FRONT_LEFT           ) channelMap[index++] = PCM_FRONT_LEFT           ;
-  if (layout & AV_CH_FRONT_RIGHT          ) channelMap[index++] = PCM_FRONT_RIGHT          ;
-  if (layout & AV_CH_FRONT_CENTER         ) channelMap[index++] = PCM_FRONT_CENTER         ;
-  if (layout & AV_CH_LOW_FREQUENCY        ) channelMap[index++] = PCM_LOW_FREQUENCY        ;
-  if (layout & AV_CH_BACK_LEFT            ) channelMap[index++] = PCM_BACK_LEFT            ;
-  if (layout & AV_CH_BACK_RIGHT           ) channelMap[index++] = PCM_BACK_RIGHT           ;
-  if (layout & AV_CH_FRONT_LEFT_OF_CENTER ) channelMap[index++] = PCM_FRONT_LEFT_OF_CENTER ;
-  if (layout & AV_CH_FRONT_RIGHT_OF_CENTER) channelMap[index++] = PCM_FRONT_RIGHT_OF_CENTER;
-  if (layout & AV_CH_BACK_CENTER          ) channelMap[index++] = PCM_BACK_CENTER          ;
-  if (layout & AV_CH_SIDE_LEFT            ) channelMap[index++] = PCM_SIDE_LEFT            ;
-  if (layout & AV_CH_SIDE_RIGHT           ) channelMap[index++] = PCM_SIDE_RIGHT           ;
-  if (layout & AV_CH_TOP_CENTER           ) channelMap[index++] = PCM_TOP_CENTER           ;
-  if (layout & AV_CH_TOP_FRONT_LEFT       ) channelMap[index++] = PCM_TOP_FRONT_LEFT       ;
-  if (layout & AV_CH_TOP_FRONT_CENTER     ) channelMap[index++] = PCM_TOP_FRONT_CENTER     ;
-  if (layout & AV_CH_TOP_FRONT_RIGHT      ) channelMap[index++] = PCM_TOP_FRONT_RIGHT      ;
-  if (layout & AV_CH_TOP_BACK_LEFT        ) channelMap[index++] = PCM_TOP_BACK_LEFT        ;
-  if (layout & AV_CH_TOP_BACK_CENTER      ) channelMap[index++] = PCM_TOP_BACK_CENTER      ;
-  if (layout & AV_CH_TOP_BACK_RIGHT       ) channelMap[index++] = PCM_TOP_BACK_RIGHT       ;
-  while (index<OMX_AUDIO_MAXCHANNELS)
-    channelMap[index++] = PCM_INVALID;
-}
-
-// See CEA spec: Table 20, Audio InfoFrame data byte 4 for the ordering here
-int COMXAudio::BuildChannelMapCEA(enum PCMChannels *channelMap, uint64_t layout)
-{
-  int index = 0;
-  if (layout & AV_CH_FRONT_LEFT           ) channelMap[index++] = PCM_FRONT_LEFT;
-  if (layout & AV_CH_FRONT_RIGHT          ) channelMap[index++] = PCM_FRONT_RIGHT;
-  if (layout & AV_CH_LOW_FREQUENCY        ) channelMap[index++] = PCM_LOW_FREQUENCY;
-  if (layout & AV_CH_FRONT_CENTER         ) channelMap[index++] = PCM_FRONT_CENTER;
-  if (layout & AV_CH_BACK_LEFT            ) channelMap[index++] = PCM_BACK_LEFT;
-  if (layout & AV_CH_BACK_RIGHT           ) channelMap[index++] = PCM_BACK_RIGHT;
-  if (layout & AV_CH_SIDE_LEFT            ) channelMap[index++] = PCM_SIDE_LEFT;
-  if (layout & AV_CH_SIDE_RIGHT           ) channelMap[index++] = PCM_SIDE_RIGHT;
-
-  while (index<OMX_AUDIO_MAXCHANNELS)
-    channelMap[index++] = PCM_INVALID;
-
-  int num_channels = 0;
-  for (index=0; index<OMX_AUDIO_MAXCHANNELS; index++)
-    if (channelMap[index] != PCM_INVALID)
-       num_channels = index+1;
-  // round up to power of 2
-  num_channels = num_channels > 4 ? 8 : num_channels > 2 ? 4 : num_channels;
-  return num_channels;
-}
-
 void COMXAudio::BuildChannelMapOMX(enum OMX_AUDIO_CHANNELTYPE *	channelMap, uint64_t layout)
 {
   int index = 0;
@@ -1466,20 +1583,3 @@ void COMXAudio::BuildChannelMapOMX(enum OMX_AUDIO_CHANNELTYPE *	channelMap, uint
   while (index<OMX_AUDIO_MAXCHANNELS)
     channelMap[index++] = OMX_AUDIO_ChannelNone;
 }
-
-uint64_t COMXAudio::GetChannelLayout(enum PCMLayout layout)
-{
-  uint64_t layouts[] = {
-    /* 2.0 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT,
-    /* 2.1 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_LOW_FREQUENCY,
-    /* 3.0 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER,
-    /* 3.1 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER | 1<<PCM_LOW_FREQUENCY,
-    /* 4.0 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT,
-    /* 4.1 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT | 1<<PCM_LOW_FREQUENCY,
-    /* 5.0 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT,
-    /* 5.1 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT | 1<<PCM_LOW_FREQUENCY,
-    /* 7.0 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER | 1<<PCM_SIDE_LEFT | 1<<PCM_SIDE_RIGHT | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT,
-    /* 7.1 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER | 1<<PCM_SIDE_LEFT | 1<<PCM_SIDE_RIGHT | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT | 1<<PCM_LOW_FREQUENCY
-  };
-  return (int)layout < 10 ? layouts[(int)layout] : 0;
-}
@@ -54,6 +54,11 @@ public:
   bool is_live;
   float queue_size;
   float fifo_size;
+  int alsa_buffer_ms;  // omx:alsa device buffer, 0 = 200 ms
+  int alsa_period_ms;  // 0 = a quarter of the buffer
+  bool alsa_mmap;      // write to the device through mmap
+  bool soft_downmix;   // omx:alsa only, mix down on the CPU instead of the GPU audio_mixer
+  bool pack_s32;       // send float audio as S32 interleaved instead of the GPU's planar float
 
   OMXAudioConfig()
   {
@@ -65,9 +70,25 @@ public:
     is_live = false;
     queue_size = 3.0f;
     fifo_size = 2.0f;
+    alsa_buffer_ms = 0;
+    alsa_period_ms = 0;
+    alsa_mmap = false;
+    soft_downmix = false;
+    pack_s32 = false;
   }
 };
 
+typedef struct OMXAudioOutputStats
+{
+  float         latency;     // seconds queued in the device, as ALSA measures it
+  float         latency_max; // largest latency seen while playing
+  float         buffer;      // device buffer and period length in seconds
+  float         period;
+  unsigned int  xruns;
+  bool          mmap;        // writes go through snd_pcm_mmap_begin/commit
+  bool          resampling;  // swr runs for a rate change or clock compensation
+} OMXAudioOutputStats;
+
 class COMXAudio
 {
 public:
@@ -85,6 +106,8 @@ public:
   float GetCacheTime();
   float GetCacheTotal();
   unsigned int GetAudioRenderingLatency();
+  // omx:alsa only, false for the firmware renderers
+  bool GetOutputStats(OMXAudioOutputStats &stats);
   float GetMaxLevel(double &pts);
   COMXAudio();
   bool Initialize(OMXClock *clock, const OMXAudioConfig &config, uint64_t channelMap, unsigned int uiBitsPerSample);
@@ -92,8 +115,14 @@ public:
   bool PortSettingsChanged();
 
   unsigned int AddPackets(const void* data, unsigned int len);
-  unsigned int AddPackets(const void* data, unsigned int len, double dts, double pts, unsigned int frame_size);
+  unsigned int AddPackets(const void* data, unsigned int len, double dts, double pts);
+  // a decoded frame as COMXAudioCodecOMX::GetFrame() hands it out: S16 interleaved
+  // in planes[0] at 16 bits, one float plane per channel at 32 bits. Packed straight
+  // into the decoder input buffers, several frames to a buffer. Returns samples taken.
+  unsigned int AddFrame(uint8_t *const *planes, unsigned int samples, double dts, double pts);
   unsigned int GetSpace();
+  bool WaitForSpace(unsigned int size, long timeout);
+  void CancelWait(bool cancel);
   bool Deinitialize();
 
   void SetVolume(float nVolume);
@@ -116,12 +145,13 @@ public:
   void PrintChannels(OMX_AUDIO_CHANNELTYPE eChannelMapping[]);
   void PrintPCM(OMX_AUDIO_PARAM_PCMMODETYPE *pcm, std::string direction);
   void UpdateAttenuation();
-  void BuildChannelMap(enum PCMChannels *channelMap, uint64_t layout);
-  int BuildChannelMapCEA(enum PCMChannels *channelMap, uint64_t layout);
   void BuildChannelMapOMX(enum OMX_AUDIO_CHANNELTYPE *channelMap, uint64_t layout);
-  uint64_t GetChannelLayout(enum PCMLayout layout);
 
 private:
+  void SetTimeStamp(OMX_BUFFERHEADERTYPE *omx_buffer, double pts);
+  bool SubmitBuffer(OMX_BUFFERHEADERTYPE *omx_buffer);
+  void PackFrame(uint8_t *const *planes, unsigned int offset, unsigned int samples, uint8_t *dst);
+
   bool          m_Initialized;
   float         m_CurrentVolume;
   bool          m_Mute;
@@ -160,6 +190,11 @@ private:
   } amplitudes_t;
   std::deque<amplitudes_t> m_ampqueue;
   float m_downmix_matrix[OMX_AUDIO_MAXCHANNELS*OMX_AUDIO_MAXCHANNELS];
+  // omx:alsa has no audio_mixer in front of it, so AddPackets() downmixes
+  // into the decoder buffers and the gain goes into the remap instead
+  bool          m_soft_remap;
+  float         m_remap_gain;
+  CPCMRemap     m_remap;
 
 protected:
   COMXCoreComponent m_omx_render_analog;
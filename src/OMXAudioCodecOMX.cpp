@@ -27,15 +27,10 @@
 
 #include "utils/PCMRemap.h"
 
-// the size of the audio_render output port buffers
-#define AUDIO_DECODE_OUTPUT_BUFFER (32*1024)
-static const char rounded_up_channels_shift[] = {0,0,1,2,2,3,3,3,3};
-
 COMXAudioCodecOMX::COMXAudioCodecOMX()
 {
   m_pBufferOutput = NULL;
   m_iBufferOutputAlloced = 0;
-  m_iBufferOutputUsed = 0;
 
   m_pCodecContext = NULL;
   m_pConvert = NULL;
@@ -43,9 +38,7 @@ COMXAudioCodecOMX::COMXAudioCodecOMX()
 
   m_channels = 0;
   m_pFrame1 = NULL;
-  m_frameSize = 0;
   m_bGotFrame = false;
-  m_bNoConcatenate = false;
   m_iSampleFormat = AV_SAMPLE_FMT_NONE;
   m_desiredSampleFormat = AV_SAMPLE_FMT_NONE;
 }
@@ -55,7 +48,6 @@ COMXAudioCodecOMX::~COMXAudioCodecOMX()
   m_dllAvUtil.av_free(m_pBufferOutput);
   m_pBufferOutput = NULL;
   m_iBufferOutputAlloced = 0;
-  m_iBufferOutputUsed = 0;
   Dispose();
 }
 
@@ -164,13 +156,10 @@ int COMXAudioCodecOMX::Decode(BYTE* pData, int iSize, double dts, double pts)
   if (!m_pCodecContext) return -1;
 
   AVPacket avpkt;
-  if (!m_iBufferOutputUsed)
-  {
-    m_dts = dts;
-    m_pts = pts;
-  }
   if (m_bGotFrame)
     return 0;
+  m_dts = dts;
+  m_pts = pts;
 
   m_dllAvCodec.av_init_packet(&avpkt);
   avpkt.data = pData;
@@ -202,103 +191,84 @@ int COMXAudioCodecOMX::Decode(BYTE* pData, int iSize, double dts, double pts)
   return iBytesUsed;
 }
 
-int COMXAudioCodecOMX::GetData(BYTE** dst, double &dts, double &pts)
+int COMXAudioCodecOMX::GetFrame(uint8_t ***planes, double &dts, double &pts)
 {
   if (!m_bGotFrame)
     return 0;
-  int inLineSize, outLineSize;
-  /* input audio is aligned */
-  int inputSize = m_dllAvUtil.av_samples_get_buffer_size(&inLineSize, m_pCodecContext->channels, m_pFrame1->nb_samples, m_pCodecContext->sample_fmt, 0);
-  /* output audio will be packed */
-  int outputSize = m_dllAvUtil.av_samples_get_buffer_size(&outLineSize, m_pCodecContext->channels, m_pFrame1->nb_samples, m_desiredSampleFormat, 1);
+  m_bGotFrame = false;
+  dts = m_dts;
+  pts = m_pts;
 
-  if (!m_bNoConcatenate && m_iBufferOutputUsed && (int)m_frameSize != outputSize)
-  {
-    CLog::Log(LOGINFO, "COMXAudioCodecOMX::GetData Unexpected change of size (%d->%d)", m_frameSize, outputSize);
-    m_bNoConcatenate = true;
-  }
+  int samples = m_pFrame1->nb_samples;
 
-  // if this buffer won't fit then flush out what we have
-  int desired_size = AUDIO_DECODE_OUTPUT_BUFFER * (m_pCodecContext->channels * GetBitsPerSample()) >> (rounded_up_channels_shift[m_pCodecContext->channels] + 4);
-  if (m_iBufferOutputUsed && (m_iBufferOutputUsed + outputSize > desired_size || m_bNoConcatenate))
+  /* S16 and planar float go out as the decoder left them, COMXAudio packs them */
+  if(m_pCodecContext->sample_fmt == m_desiredSampleFormat)
   {
-     int ret = m_iBufferOutputUsed;
-     m_iBufferOutputUsed = 0;
-     m_bNoConcatenate = false;
-     dts = m_dts;
-     pts = m_pts;
-     *dst = m_pBufferOutput;
-     return ret;
+    if (m_bFirstFrame)
+    {
+      CLog::Log(LOGDEBUG, "COMXAudioCodecOMX::GetFrame samples=%d line=%d", samples, m_pFrame1->linesize[0]);
+      m_bFirstFrame = false;
+    }
+    *planes = m_pFrame1->extended_data;
+    return samples;
   }
-  m_frameSize = outputSize;
 
-  if (m_iBufferOutputAlloced < m_iBufferOutputUsed + outputSize)
+  /* need to convert format */
+  if(m_pConvert && (m_pCodecContext->sample_fmt != m_iSampleFormat || m_channels != m_pCodecContext->channels))
   {
-     m_pBufferOutput = (BYTE*)m_dllAvUtil.av_realloc(m_pBufferOutput, m_iBufferOutputUsed + outputSize + AV_INPUT_BUFFER_PADDING_SIZE);
-     m_iBufferOutputAlloced = m_iBufferOutputUsed + outputSize;
+    m_dllSwResample.swr_free(&m_pConvert);
+    m_channels = m_pCodecContext->channels;
   }
 
-  /* need to convert format */
-  if(m_pCodecContext->sample_fmt != m_desiredSampleFormat)
+  if(!m_pConvert)
   {
-    if(m_pConvert && (m_pCodecContext->sample_fmt != m_iSampleFormat || m_channels != m_pCodecContext->channels))
-    {
-      m_dllSwResample.swr_free(&m_pConvert);
-      m_channels = m_pCodecContext->channels;
-    }
-
-    if(!m_pConvert)
+    m_iSampleFormat = m_pCodecContext->sample_fmt;
+    m_pConvert = m_dllSwResample.swr_alloc_set_opts(NULL,
+                    m_dllAvUtil.av_get_default_channel_layout(m_pCodecContext->channels), 
+                    m_desiredSampleFormat, m_pCodecContext->sample_rate,
+                    m_dllAvUtil.av_get_default_channel_layout(m_pCodecContext->channels), 
+                    m_pCodecContext->sample_fmt, m_pCodecContext->sample_rate,
+                    0, NULL);
+
+    if(!m_pConvert || m_dllSwResample.swr_init(m_pConvert) < 0)
     {
-      m_iSampleFormat = m_pCodecContext->sample_fmt;
-      m_pConvert = m_dllSwResample.swr_alloc_set_opts(NULL,
-                      m_dllAvUtil.av_get_default_channel_layout(m_pCodecContext->channels), 
-                      m_desiredSampleFormat, m_pCodecContext->sample_rate,
-                      m_dllAvUtil.av_get_default_channel_layout(m_pCodecContext->channels), 
-                      m_pCodecContext->sample_fmt, m_pCodecContext->sample_rate,
-                      0, NULL);
-
-      if(!m_pConvert || m_dllSwResample.swr_init(m_pConvert) < 0)
-      {
-        CLog::Log(LOGINFO, "COMXAudioCodecOMX::Decode - Unable to initialise convert format %d to %d", m_pCodecContext->sample_fmt, m_desiredSampleFormat);
-        return 0;
-      }
+      CLog::Log(LOGINFO, "COMXAudioCodecOMX::GetFrame - Unable to initialise convert format %d to %d", m_pCodecContext->sample_fmt, m_desiredSampleFormat);
+      return 0;
     }
+  }
 
-    /* use unaligned flag to keep output packed */
-    uint8_t *out_planes[m_pCodecContext->channels];
-    if(m_dllAvUtil.av_samples_fill_arrays(out_planes, NULL, m_pBufferOutput + m_iBufferOutputUsed, m_pCodecContext->channels, m_pFrame1->nb_samples, m_desiredSampleFormat, 1) < 0 ||
-       m_dllSwResample.swr_convert(m_pConvert, out_planes, m_pFrame1->nb_samples, (const uint8_t **)m_pFrame1->data, m_pFrame1->nb_samples) < 0)
-    {
-      CLog::Log(LOGINFO, "COMXAudioCodecOMX::Decode - Unable to convert format %d to %d", (int)m_pCodecContext->sample_fmt, m_desiredSampleFormat);
-      outputSize = 0;
-    }
+  /* output audio will be packed, only grows when the frames do */
+  int outputSize = m_dllAvUtil.av_samples_get_buffer_size(NULL, m_pCodecContext->channels, samples, m_desiredSampleFormat, 1);
+  if (m_iBufferOutputAlloced < outputSize)
+  {
+     m_dllAvUtil.av_free(m_pBufferOutput);
+     m_pBufferOutput = (BYTE*)m_dllAvUtil.av_malloc(outputSize + AV_INPUT_BUFFER_PADDING_SIZE);
+     m_iBufferOutputAlloced = m_pBufferOutput ? outputSize : 0;
   }
-  else
+
+  /* use unaligned flag to keep output packed */
+  m_convertPlanes.resize(m_pCodecContext->channels);
+  if(!m_pBufferOutput ||
+     m_dllAvUtil.av_samples_fill_arrays(&m_convertPlanes[0], NULL, m_pBufferOutput, m_pCodecContext->channels, samples, m_desiredSampleFormat, 1) < 0 ||
+     m_dllSwResample.swr_convert(m_pConvert, &m_convertPlanes[0], samples, (const uint8_t **)m_pFrame1->extended_data, samples) < 0)
   {
-    /* copy to a contiguous buffer */
-    uint8_t *out_planes[m_pCodecContext->channels];
-    if (m_dllAvUtil.av_samples_fill_arrays(out_planes, NULL, m_pBufferOutput + m_iBufferOutputUsed, m_pCodecContext->channels, m_pFrame1->nb_samples, m_desiredSampleFormat, 1) < 0 ||
-      m_dllAvUtil.av_samples_copy(out_planes, m_pFrame1->data, 0, 0, m_pFrame1->nb_samples, m_pCodecContext->channels, m_desiredSampleFormat) < 0 )
-    {
-      outputSize = 0;
-    }
+    CLog::Log(LOGINFO, "COMXAudioCodecOMX::GetFrame - Unable to convert format %d to %d", (int)m_pCodecContext->sample_fmt, m_desiredSampleFormat);
+    return 0;
   }
-  m_bGotFrame = false;
 
   if (m_bFirstFrame)
   {
-    CLog::Log(LOGDEBUG, "COMXAudioCodecOMX::GetData size=%d/%d line=%d/%d buf=%p, desired=%d", inputSize, outputSize, inLineSize, outLineSize, m_pBufferOutput, desired_size);
+    CLog::Log(LOGDEBUG, "COMXAudioCodecOMX::GetFrame samples=%d size=%d converted from format %d", samples, outputSize, m_pCodecContext->sample_fmt);
     m_bFirstFrame = false;
   }
-  m_iBufferOutputUsed += outputSize;
-  return 0;
+  *planes = &m_convertPlanes[0];
+  return samples;
 }
 
 void COMXAudioCodecOMX::Reset()
 {
   if (m_pCodecContext) m_dllAvCodec.avcodec_flush_buffers(m_pCodecContext);
   m_bGotFrame = false;
-  m_iBufferOutputUsed = 0;
 }
 
 int COMXAudioCodecOMX::GetChannels()
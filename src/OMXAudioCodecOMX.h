@@ -21,6 +21,8 @@
  *
  */
 
+#include <vector>
+
 #include "DllAvCodec.h"
 #include "DllAvFormat.h"
 #include "DllAvUtil.h"
@@ -38,7 +40,10 @@ public:
   bool Open(COMXStreamInfo &hints, enum PCMLayout layout);
   void Dispose();
   int Decode(BYTE* pData, int iSize, double dts, double pts);
-  int GetData(BYTE** dst, double &dts, double &pts);
+  // samples in the frame from the last Decode(), 0 if there is none. S16 comes
+  // interleaved in (*planes)[0], anything else as one float plane per channel.
+  // The planes stay valid until the next Decode().
+  int GetFrame(uint8_t ***planes, double &dts, double &pts);
   void Reset();
   int GetChannels();
   uint64_t GetChannelMap();
@@ -46,7 +51,6 @@ public:
   int GetBitsPerSample();
   static const char* GetName() { return "FFmpeg"; }
   int GetBitRate();
-  unsigned int GetFrameSize() { return m_frameSize; }
 
 protected:
   AVCodecContext* m_pCodecContext;
@@ -56,9 +60,10 @@ protected:
 
   AVFrame* m_pFrame1;
 
+  // one converted frame when the decoder doesn't output S16 or planar float
   BYTE *m_pBufferOutput;
-  int   m_iBufferOutputUsed;
   int   m_iBufferOutputAlloced;
+  std::vector<uint8_t *> m_convertPlanes;
 
   bool m_bOpenedCodec;
 
@@ -66,8 +71,6 @@ protected:
 
   bool m_bFirstFrame;
   bool m_bGotFrame;
-  bool m_bNoConcatenate;
-  unsigned int  m_frameSize;
   double m_dts, m_pts;
   DllAvCodec m_dllAvCodec;
   DllAvUtil m_dllAvUtil;
@@ -34,6 +34,8 @@
 
 #include "OMXClock.h"
 
+#include <sched.h>
+
 #define OMX_PRE_ROLL 200
 #define TP(speed) ((speed) < 0 || (speed) > 4*DVD_PLAYSPEED_NORMAL)
 
@@ -47,8 +49,13 @@ OMXClock::OMXClock()
   m_WaitMask = 0;
   m_eState = OMX_TIME_ClockStateStopped;
   m_eClock = OMX_TIME_RefClockNone;
-  m_last_media_time = 0.0f;
-  m_last_media_time_read = 0.0f;
+
+  m_snap_seq = 0;
+  m_snap_valid = false;
+  m_snap_media = 0.0;
+  m_snap_host = 0.0;
+  m_snap_speed = 0.0;
+  ResetStats();
 
   pthread_mutex_init(&m_lock, NULL);
 }
@@ -119,7 +126,6 @@ bool OMXClock::OMXSetReferenceClock(bool has_audio, bool lock /* = true */)
     }
     m_eClock = refClock.eClock;
   }
-  m_last_media_time = 0.0f;
   if(lock)
     UnLock();
 
@@ -147,7 +153,7 @@ void OMXClock::OMXDeinitialize()
   m_omx_clock.Deinitialize();
 
   m_omx_speed = DVD_PLAYSPEED_NORMAL;
-  m_last_media_time = 0.0f;
+  PublishSnapshot(false, 0.0, 0.0);
 }
 
 bool OMXClock::OMXStateExecute(bool lock /* = true */)
@@ -175,7 +181,7 @@ bool OMXClock::OMXStateExecute(bool lock /* = true */)
     }
   }
 
-  m_last_media_time = 0.0f;
+  UpdateSnapshot(false);
   if(lock)
     UnLock();
 
@@ -193,7 +199,7 @@ void OMXClock::OMXStateIdle(bool lock /* = true */)
   if(m_omx_clock.GetState() != OMX_StateIdle)
     m_omx_clock.SetStateForComponent(OMX_StateIdle);
 
-  m_last_media_time = 0.0f;
+  PublishSnapshot(false, 0.0, 0.0);
   if(lock)
     UnLock();
 }
@@ -230,7 +236,7 @@ bool  OMXClock::OMXStop(bool lock /* = true */)
   }
   m_eState = clock.eState;
 
-  m_last_media_time = 0.0f;
+  UpdateSnapshot(false);
   if(lock)
     UnLock();
 
@@ -261,7 +267,7 @@ bool OMXClock::OMXStep(int steps /* = 1 */, bool lock /* = true */)
     return false;
   }
 
-  m_last_media_time = 0.0f;
+  UpdateSnapshot(false);
   if(lock)
     UnLock();
 
@@ -312,55 +318,139 @@ bool OMXClock::OMXReset(bool has_video, bool has_audio, bool lock /* = true */)
     }
   }
 
-  m_last_media_time = 0.0f;
+  UpdateSnapshot(false);
   if(lock)
     UnLock();
 
   return true;
 }
 
+bool OMXClock::ReadSnapshot(double &media, double &host, double &speed)
+{
+  bool valid;
+  for(;;)
+  {
+    uint32_t seq = m_snap_seq.load(std::memory_order_acquire);
+    if(seq & 1)
+    {
+      // an update is a handful of stores, just let the writer finish
+      m_retries++;
+      sched_yield();
+      continue;
+    }
+    valid = m_snap_valid.load(std::memory_order_relaxed);
+    media = m_snap_media.load(std::memory_order_relaxed);
+    host  = m_snap_host.load(std::memory_order_relaxed);
+    speed = m_snap_speed.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(m_snap_seq.load(std::memory_order_relaxed) == seq)
+      break;
+    m_retries++;
+  }
+  return valid;
+}
+
+// must be called with m_lock held
+void OMXClock::PublishSnapshot(bool valid, double media, double host)
+{
+  // a clock that is still waiting for its start time reads 0, don't run it on
+  double speed = 0.0;
+  if(!m_pause && !TP(m_omx_speed) && media != 0.0)
+    speed = (double)m_omx_speed / DVD_PLAYSPEED_NORMAL;
+
+  uint32_t seq = m_snap_seq.load(std::memory_order_relaxed);
+  m_snap_seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  m_snap_valid.store(valid, std::memory_order_relaxed);
+  m_snap_media.store(media, std::memory_order_relaxed);
+  m_snap_host.store(host, std::memory_order_relaxed);
+  m_snap_speed.store(speed, std::memory_order_relaxed);
+  m_snap_seq.store(seq + 2, std::memory_order_release);
+}
+
+// Read the media time from the clock component and publish it. With measure
+// set the previous snapshot is interpolated to the same instant and the
+// difference is accounted as the interpolation error. Must be called with
+// m_lock held.
+bool OMXClock::UpdateSnapshot(bool measure)
+{
+  if(m_omx_clock.GetComponent() == NULL)
+    return false;
+
+  OMX_ERRORTYPE omx_err = OMX_ErrorNone;
+
+  OMX_TIME_CONFIG_TIMESTAMPTYPE timeStamp;
+  OMX_INIT_STRUCTURE(timeStamp);
+  timeStamp.nPortIndex = m_omx_clock.GetInputPort();
+
+  double before = GetAbsoluteClock();
+  omx_err = m_omx_clock.GetConfig(OMX_IndexConfigTimeCurrentMediaTime, &timeStamp);
+  double after = GetAbsoluteClock();
+  if(omx_err != OMX_ErrorNone)
+  {
+    CLog::Log(LOGNOTICE, "OMXClock::MediaTime error getting OMX_IndexConfigTimeCurrentMediaTime\n");
+    // a periodic sample keeps interpolating from the last good one, after a
+    // state change the old value is meaningless
+    if(!measure)
+      PublishSnapshot(false, 0.0, 0.0);
+    return false;
+  }
+
+  double pts = FromOMXTime(timeStamp.nTimestamp);
+  // the component was read somewhere during the call, take the middle
+  double now = before + (after - before) * 0.5;
+
+  // nothing to predict from while the clock still waits to start at 0
+  double media, host, speed;
+  if(measure && ReadSnapshot(media, host, speed) && media != 0.0)
+  {
+    double error = media + (now - host) * speed - pts;
+    double abs_error = error < 0.0 ? -error : error;
+
+    m_error = error;
+    if(abs_error > m_error_max)
+      m_error_max = abs_error;
+    m_error_sum = m_error_sum + abs_error;
+    m_measured++;
+  }
+  m_samples++;
+
+  //CLog::Log(LOGINFO, "OMXClock::MediaTime %.2f (%.2f)", pts, now);
+  PublishSnapshot(true, pts, now);
+  return true;
+}
+
 double OMXClock::OMXMediaTime(bool lock /* = true */)
 {
-  double pts = 0.0;
   if(m_omx_clock.GetComponent() == NULL)
     return 0;
 
-  double now = GetAbsoluteClock();
-  if (now - m_last_media_time_read > DVD_MSEC_TO_TIME(100) || m_last_media_time == 0.0)
-  {
-    if(lock)
-      Lock();
+  double media, host, speed;
+  if(!ReadSnapshot(media, host, speed))
+    return 0;
 
-    OMX_ERRORTYPE omx_err = OMX_ErrorNone;
+  return media + (GetAbsoluteClock() - host) * speed;
+}
+
+double OMXClock::OMXSampleMediaTime(bool lock /* = true */)
+{
+  if(m_omx_clock.GetComponent() == NULL)
+    return 0;
 
-    OMX_TIME_CONFIG_TIMESTAMPTYPE timeStamp;
-    OMX_INIT_STRUCTURE(timeStamp);
-    timeStamp.nPortIndex = m_omx_clock.GetInputPort();
+  double media, host, speed;
+  bool valid = ReadSnapshot(media, host, speed);
 
-    omx_err = m_omx_clock.GetConfig(OMX_IndexConfigTimeCurrentMediaTime, &timeStamp);
-    if(omx_err != OMX_ErrorNone)
-    {
-      CLog::Log(LOGNOTICE, "OMXClock::MediaTime error getting OMX_IndexConfigTimeCurrentMediaTime\n");
-      if(lock)
-        UnLock();
-      return 0;
-    }
+  if(!valid || media == 0.0 || GetAbsoluteClock() - host > DVD_MSEC_TO_TIME(100))
+  {
+    if(lock)
+      Lock();
 
-    pts = FromOMXTime(timeStamp.nTimestamp);
-    //CLog::Log(LOGINFO, "OMXClock::MediaTime %.2f (%.2f, %.2f)", pts, m_last_media_time, now - m_last_media_time_read);
-    m_last_media_time = pts;
-    m_last_media_time_read = now;
+    UpdateSnapshot(valid);
 
     if(lock)
       UnLock();
   }
-  else
-  {
-    double speed = m_pause ? 0.0 : (double)m_omx_speed / DVD_PLAYSPEED_NORMAL;
-    pts = m_last_media_time + (now - m_last_media_time_read) * speed;
-    //CLog::Log(LOGINFO, "OMXClock::MediaTime cached %.2f (%.2f, %.2f)", pts, m_last_media_time, now - m_last_media_time_read);
-  }
-  return pts;
+  return OMXMediaTime(false);
 }
 
 double OMXClock::OMXClockAdjustment(bool lock /* = true */)
@@ -432,7 +522,7 @@ bool OMXClock::OMXMediaTime(double pts, bool lock /* = true*/)
   CLog::Log(LOGDEBUG, "OMXClock::OMXMediaTime set config %s = %.2f", index == OMX_IndexConfigTimeCurrentAudioReference ?
        "OMX_IndexConfigTimeCurrentAudioReference":"OMX_IndexConfigTimeCurrentVideoReference", pts);
 
-  m_last_media_time = 0.0f;
+  UpdateSnapshot(false);
   if(lock)
     UnLock();
 
@@ -452,7 +542,7 @@ bool OMXClock::OMXPause(bool lock /* = true */)
     if (OMXSetSpeed(0, false, true))
       m_pause = true;
 
-    m_last_media_time = 0.0f;
+    PublishSnapshot(m_snap_valid, OMXMediaTime(false), GetAbsoluteClock());
     if(lock)
       UnLock();
   }
@@ -472,7 +562,7 @@ bool OMXClock::OMXResume(bool lock /* = true */)
     if (OMXSetSpeed(m_omx_speed, false, true))
       m_pause = false;
 
-    m_last_media_time = 0.0f;
+    PublishSnapshot(m_snap_valid, OMXMediaTime(false), GetAbsoluteClock());
     if(lock)
       UnLock();
   }
@@ -509,9 +599,15 @@ bool OMXClock::OMXSetSpeed(int speed, bool lock /* = true */, bool pause_resume
     }
   }
   if (!pause_resume)
+  {
+    // the clock component isn't touched, just carry on at the new speed
+    double pts = OMXMediaTime(false);
     m_omx_speed = speed;
+    PublishSnapshot(m_snap_valid, pts, GetAbsoluteClock());
+  }
+  else
+    UpdateSnapshot(false);
 
-  m_last_media_time = 0.0f;
   if(lock)
     UnLock();
 
@@ -548,7 +644,7 @@ bool OMXClock::HDMIClockSync(bool lock /* = true */)
     return false;
   }
 
-  m_last_media_time = 0.0f;
+  UpdateSnapshot(false);
   if(lock)
     UnLock();
 
@@ -580,5 +676,26 @@ double OMXClock::GetClock(bool interpolated /*= true*/)
 {
   return GetAbsoluteClock();
 }
+
+OMXClockStats OMXClock::GetStats()
+{
+  OMXClockStats stats;
+  stats.samples   = m_samples;
+  stats.retries   = m_retries;
+  stats.error     = m_error;
+  stats.error_max = m_error_max;
+  stats.error_avg = m_measured ? m_error_sum / m_measured : 0.0;
+  return stats;
+}
+
+void OMXClock::ResetStats()
+{
+  m_samples   = 0;
+  m_retries   = 0;
+  m_measured  = 0;
+  m_error     = 0.0;
+  m_error_max = 0.0;
+  m_error_sum = 0.0;
+}
 #endif
 
@@ -2,6 +2,7 @@
 
 #include "OMXCore.h"
 
+#include <atomic>
 
 #include "DllAvFormat.h"
 #include <IL/OMX_Core.h>
@@ -41,21 +42,46 @@ static inline int64_t FromOMXTime(OMX_TICKS ticks)
 #define ToOMXTime(x) (x)
 #endif
 
+typedef struct OMXClockStats
+{
+  uint64_t samples;     // media time reads from the clock component
+  uint64_t retries;     // snapshot reads that raced an update and went again
+  double   error;       // interpolated minus sampled media time at the last sample, us
+  double   error_max;   // largest |error| seen
+  double   error_avg;   // mean |error| over all samples
+} OMXClockStats;
+
 class OMXClock
 {
 public:
-  bool              m_pause;
+  // read without the lock by OMXClockGroup/OMXNetSync on other players' threads
+  std::atomic<bool> m_pause;
   pthread_mutex_t   m_lock;
-  int               m_omx_speed;
+  std::atomic<int>  m_omx_speed;
   OMX_U32           m_WaitMask;
   OMX_TIME_CLOCKSTATE   m_eState;
   OMX_TIME_REFCLOCKTYPE m_eClock;
 
   COMXCoreComponent m_omx_clock;
-  double            m_last_media_time;
-  double            m_last_media_time_read;
   DllAvFormat       m_dllAvFormat;
 
+  // Last media time read from the clock component together with the host
+  // time it was read at and the speed the clock was running at. Only written
+  // with m_lock held, read without any lock: m_snap_seq is odd while an update
+  // is in progress and readers retry when it changed under them.
+  std::atomic<uint32_t> m_snap_seq;
+  std::atomic<bool>     m_snap_valid;
+  std::atomic<double>   m_snap_media;
+  std::atomic<double>   m_snap_host;
+  std::atomic<double>   m_snap_speed;
+
+  std::atomic<uint64_t> m_samples;
+  std::atomic<uint64_t> m_retries;
+  std::atomic<uint64_t> m_measured;
+  std::atomic<double>   m_error;
+  std::atomic<double>   m_error_max;
+  std::atomic<double>   m_error_sum;
+
 
   OMXClock();
   ~OMXClock();
@@ -69,7 +95,12 @@ public:
   bool OMXStop(bool lock = true);
   bool OMXStep(int steps = 1, bool lock = true);
   bool OMXReset(bool has_video, bool has_audio, bool lock = true);
+  // interpolated from the last sample, never blocks or calls into OMX
   double OMXMediaTime(bool lock = true);
+  // refresh the snapshot from the clock component when it is older than
+  // 100ms or the clock hadn't started yet, called periodically by a single
+  // thread (the engine loop)
+  double OMXSampleMediaTime(bool lock = true);
   double OMXClockAdjustment(bool lock = true);
   bool OMXMediaTime(double pts, bool lock = true);
   bool OMXPause(bool lock = true);
@@ -83,5 +114,13 @@ public:
   int64_t GetAbsoluteClock();
   double GetClock(bool interpolated = true);
   static void OMXSleep(unsigned int dwMilliSeconds);
+
+  OMXClockStats GetStats();
+  void ResetStats();
+
+private:
+  bool ReadSnapshot(double &media, double &host, double &speed);
+  void PublishSnapshot(bool valid, double media, double host);
+  bool UpdateSnapshot(bool measure);
 };
 
@@ -0,0 +1,347 @@
+#include "OMXClockGroup.h"
+#include "OMXClock.h"
+
+#include <math.h>
+#include <algorithm>
+
+// how much of each new drift measurement goes into the smoothed value, Sync()
+// runs every 20ms so this settles within a few hundred ms
+#define OMX_CLOCK_GROUP_SMOOTHING 0.1
+
+OMXClockFollower::OMXClockFollower()
+{
+  m_snap_us = OMX_CLOCK_GROUP_SNAP_US;
+  m_stats.speed = 1.0f;
+  ResetStats(0.0);
+}
+
+void OMXClockFollower::Restart()
+{
+  m_smoothed = 0.0;
+}
+
+void OMXClockFollower::Seeking()
+{
+  m_smoothed = 0.0;
+  m_stats.seeks++;
+  m_stats.locked = false;
+}
+
+void OMXClockFollower::ResetStats(double now)
+{
+  float speed = m_stats.speed;
+
+  m_smoothed      = 0.0;
+  m_drift_sum     = 0.0;
+  m_locked_checks = 0;
+  m_start_time    = now;
+  m_stats.drift     = 0.0;
+  m_stats.drift_avg = 0.0;
+  m_stats.drift_max = 0.0;
+  m_stats.checks    = 0;
+  m_stats.nudges    = 0;
+  m_stats.snaps     = 0;
+  m_stats.seeks     = 0;
+  m_stats.lock_time = 0.0;
+  m_stats.speed     = speed;
+  m_stats.locked    = false;
+  m_stats.master    = false;
+}
+
+void OMXClockFollower::Release(OMXClock *clock)
+{
+  if(m_stats.speed == 1.0f)
+    return;
+
+  int want = (int)(clock->OMXPlaySpeed() / m_stats.speed + 0.5f);
+  clock->OMXSetSpeed(want);
+  clock->OMXSetSpeed(want, true, true);
+  m_stats.speed = 1.0f;
+}
+
+float OMXClockFollower::Steer(OMXClock *clock, double master_time, int master_speed, double frame_time)
+{
+  double time = clock->OMXMediaTime();
+  if(master_time <= 0.0 || time <= 0.0)
+  {
+    // one of them hasn't started yet
+    return m_stats.speed;
+  }
+
+  if(frame_time <= 0.0)
+    frame_time = DVD_TIME_BASE / 25.0;
+
+  double drift = time - master_time;
+  double abs_drift = fabs(drift);
+  float speed = 1.0f;
+
+  m_stats.drift = drift;
+  m_stats.checks++;
+
+  if(abs_drift > OMX_CLOCK_GROUP_IGNORE_US)
+  {
+    // one of them is seeking or looping, wait for the timelines to meet
+    m_smoothed = 0.0;
+    m_stats.locked = false;
+  }
+  else if(abs_drift > m_snap_us)
+  {
+    CLog::Log(LOGDEBUG, "OMXClockFollower::Steer %p is %.0fms off, moving to %.0f", clock, drift / 1000.0, master_time);
+    clock->OMXMediaTime(master_time);
+    m_smoothed = 0.0;
+    m_stats.snaps++;
+    m_stats.locked = false;
+  }
+  else
+  {
+    // start from scratch after joining, a snap or a discontinuity
+    if(m_smoothed == 0.0)
+      m_smoothed = drift;
+    else
+      m_smoothed += (drift - m_smoothed) * OMX_CLOCK_GROUP_SMOOTHING;
+
+    // 1% catches up 10ms a second, 0.1% is enough to hold against crystal
+    // drift once inside the window
+    double smoothed = m_smoothed;
+    if(smoothed > 0.5*frame_time)
+      speed = 0.990f;
+    else if(smoothed < -0.5*frame_time)
+      speed = 1.010f;
+    else if(fabs(smoothed) > 0.25*frame_time ||
+            (m_stats.speed != 1.0f && fabs(smoothed) > 0.1*frame_time))
+      // keep going until well inside the window, so it doesn't flap at the edge
+      speed = smoothed > 0.0 ? 0.999f : 1.001f;
+
+    m_stats.locked = abs_drift <= frame_time;
+    if(m_stats.locked)
+    {
+      if(m_stats.lock_time == 0.0)
+        m_stats.lock_time = clock->GetAbsoluteClock() - m_start_time;
+      m_locked_checks++;
+      m_drift_sum += abs_drift;
+      m_stats.drift_avg = m_drift_sum / m_locked_checks;
+      if(abs_drift > m_stats.drift_max)
+        m_stats.drift_max = abs_drift;
+    }
+  }
+
+  // follows the master's speed changes as well as our own
+  int want = (int)(master_speed * speed + 0.5f);
+  if(speed != m_stats.speed || clock->OMXPlaySpeed() != want)
+  {
+    if(speed != 1.0f && speed != m_stats.speed)
+      m_stats.nudges++;
+    clock->OMXSetSpeed(want);
+    clock->OMXSetSpeed(want, true, true);
+    m_stats.speed = speed;
+  }
+
+  return speed;
+}
+
+OMXClockGroup::OMXClockGroup()
+{
+  m_master = NULL;
+  m_seek_us = OMX_CLOCK_GROUP_SEEK_US;
+  pthread_mutex_init(&m_lock, NULL);
+}
+
+OMXClockGroup::~OMXClockGroup()
+{
+  pthread_mutex_destroy(&m_lock);
+}
+
+OMXClockGroup::Member *OMXClockGroup::Find(OMXClock *clock)
+{
+  for(size_t i = 0; i < m_members.size(); i++)
+  {
+    if(m_members[i].clock == clock)
+      return &m_members[i];
+  }
+  return NULL;
+}
+
+bool OMXClockGroup::Join(OMXClock *clock)
+{
+  if(!clock)
+    return false;
+
+  pthread_mutex_lock(&m_lock);
+  if(!Find(clock))
+  {
+    Member member;
+    member.clock = clock;
+    member.seek_pending = false;
+    member.seek_holdoff = 0.0;
+    member.follower.SetSnapThreshold(std::max(m_seek_us, OMX_CLOCK_GROUP_SNAP_US));
+    member.follower.ResetStats(clock->GetAbsoluteClock());
+    m_members.push_back(member);
+  }
+  if(!m_master)
+    m_master = clock;
+  pthread_mutex_unlock(&m_lock);
+  return true;
+}
+
+void OMXClockGroup::Leave(OMXClock *clock)
+{
+  pthread_mutex_lock(&m_lock);
+  for(size_t i = 0; i < m_members.size(); i++)
+  {
+    if(m_members[i].clock == clock)
+    {
+      m_members[i].follower.Release(clock);
+      m_members.erase(m_members.begin() + i);
+      break;
+    }
+  }
+  if(m_master == clock)
+    m_master = m_members.empty() ? NULL : m_members[0].clock;
+  pthread_mutex_unlock(&m_lock);
+}
+
+bool OMXClockGroup::SetMaster(OMXClock *clock)
+{
+  pthread_mutex_lock(&m_lock);
+  bool ret = Find(clock) != NULL;
+  if(ret)
+    m_master = clock;
+  pthread_mutex_unlock(&m_lock);
+  return ret;
+}
+
+bool OMXClockGroup::IsMaster(OMXClock *clock)
+{
+  pthread_mutex_lock(&m_lock);
+  bool ret = clock && m_master == clock;
+  pthread_mutex_unlock(&m_lock);
+  return ret;
+}
+
+unsigned int OMXClockGroup::GetMemberCount()
+{
+  pthread_mutex_lock(&m_lock);
+  unsigned int count = m_members.size();
+  pthread_mutex_unlock(&m_lock);
+  return count;
+}
+
+void OMXClockGroup::SetSeekThreshold(double us)
+{
+  pthread_mutex_lock(&m_lock);
+  m_seek_us = us;
+  // members seek where they used to snap, keep the follower's snap out of the way
+  for(size_t i = 0; i < m_members.size(); i++)
+    m_members[i].follower.SetSnapThreshold(std::max(us, OMX_CLOCK_GROUP_SNAP_US));
+  pthread_mutex_unlock(&m_lock);
+}
+
+float OMXClockGroup::Sync(OMXClock *clock, double frame_time)
+{
+  pthread_mutex_lock(&m_lock);
+
+  Member *member = Find(clock);
+  if(member && m_master == clock)
+  {
+    // was a follower until SetMaster(), drop the correction it was running with
+    member->follower.Release(clock);
+  }
+  if(!member || !m_master || m_master == clock)
+  {
+    pthread_mutex_unlock(&m_lock);
+    return 1.0f;
+  }
+
+  OMXClock *master = m_master;
+  int master_speed = master->OMXPlaySpeed();
+  float speed = member->follower.GetStats().speed;
+
+  // only compare while both clocks run and the master isn't in trickplay
+  if(!master->OMXIsPaused() && !clock->OMXIsPaused() &&
+     master_speed > 0 && master_speed <= 4*DVD_PLAYSPEED_NORMAL)
+  {
+    double master_time = master->OMXMediaTime();
+    double time = clock->OMXMediaTime();
+    double drift = fabs(time - master_time);
+    if(master_time > 0.0 && time > 0.0 && drift > m_seek_us && drift <= OMX_CLOCK_GROUP_IGNORE_US)
+    {
+      // moving the clock alone would leave the decoders on the old position
+      double now = clock->GetAbsoluteClock();
+      if(!member->seek_pending && now >= member->seek_holdoff)
+      {
+        CLog::Log(LOGDEBUG, "OMXClockGroup::Sync %p is %.0fms off the master, seeking", clock, (time - master_time) / 1000.0);
+        member->seek_pending = true;
+        member->seek_holdoff = now + OMX_CLOCK_GROUP_HOLDOFF_US;
+        member->follower.Seeking();
+      }
+    }
+    else
+    {
+      speed = member->follower.Steer(clock, master_time, master_speed, frame_time);
+    }
+  }
+
+  pthread_mutex_unlock(&m_lock);
+  return speed;
+}
+
+bool OMXClockGroup::GetSeek(OMXClock *clock, double &media_time)
+{
+  pthread_mutex_lock(&m_lock);
+  Member *member = Find(clock);
+  bool ret = member && member->seek_pending && m_master && m_master != clock;
+  if(ret)
+    media_time = m_master->OMXMediaTime();
+  if(member)
+    member->seek_pending = false;
+  pthread_mutex_unlock(&m_lock);
+  return ret;
+}
+
+bool OMXClockGroup::GetStats(OMXClock *clock, OMXClockGroupMemberStats &stats)
+{
+  pthread_mutex_lock(&m_lock);
+  Member *member = Find(clock);
+  if(member)
+  {
+    stats = member->follower.GetStats();
+    stats.master = m_master == clock;
+  }
+  pthread_mutex_unlock(&m_lock);
+  return member != NULL;
+}
+
+std::vector<OMXClockGroupMemberStats> OMXClockGroup::GetStats()
+{
+  std::vector<OMXClockGroupMemberStats> stats;
+  pthread_mutex_lock(&m_lock);
+  for(size_t i = 0; i < m_members.size(); i++)
+  {
+    stats.push_back(m_members[i].follower.GetStats());
+    stats.back().master = m_master == m_members[i].clock;
+  }
+  pthread_mutex_unlock(&m_lock);
+  return stats;
+}
+
+double OMXClockGroup::GetMaxDrift()
+{
+  double drift = 0.0;
+  pthread_mutex_lock(&m_lock);
+  for(size_t i = 0; i < m_members.size(); i++)
+  {
+    double member_drift = fabs(m_members[i].follower.GetStats().drift);
+    if(m_members[i].clock != m_master && member_drift > drift)
+      drift = member_drift;
+  }
+  pthread_mutex_unlock(&m_lock);
+  return drift;
+}
+
+void OMXClockGroup::ResetStats()
+{
+  pthread_mutex_lock(&m_lock);
+  for(size_t i = 0; i < m_members.size(); i++)
+    m_members[i].follower.ResetStats(m_members[i].clock->GetAbsoluteClock());
+  pthread_mutex_unlock(&m_lock);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>
+#include <pthread.h>
+#include <vector>
+
+class OMXClock;
+
+// drift beyond this is corrected by moving the member's media time at once
+#define OMX_CLOCK_GROUP_SNAP_US     500000.0
+// drift beyond this is taken for a seek or loop in progress and left alone
+#define OMX_CLOCK_GROUP_IGNORE_US   5000000.0
+// OMXClockGroup members this far off the master seek instead of snapping,
+// the decoders hold data for the old position that the clock can't skip
+#define OMX_CLOCK_GROUP_SEEK_US     500000.0
+// host time a member's seek gets to land before it is asked for another one
+#define OMX_CLOCK_GROUP_HOLDOFF_US  3000000.0
+
+typedef struct OMXClockGroupMemberStats
+{
+  double   drift;       // member minus master media time at the last Sync(), us
+  double   drift_avg;   // mean |drift| while locked
+  double   drift_max;   // largest |drift| while locked
+  uint64_t checks;      // Sync() calls that compared against the master
+  uint64_t nudges;      // times the member was put off the master's speed
+  uint64_t snaps;       // times the member's media time was set to the master's
+  uint64_t seeks;       // times the member was asked to seek to the master
+  double   lock_time;   // host time it took to get within a frame the first time, us
+  float    speed;       // speed factor currently applied on top of the master's
+  bool     locked;      // within a frame of the master at the last Sync()
+  bool     master;
+} OMXClockGroupMemberStats;
+
+// Steers one clock onto a master timeline by nudging its speed, the same way
+// the live latency loop in ofxOMXPlayerEngine steers the audio fifo, and
+// moves its media time outright when it is too far off for that. Used by
+// OMXClockGroup for players in one process and by OMXNetSync across hosts.
+// Not locked, the owner serialises the calls.
+class OMXClockFollower
+{
+public:
+  OMXClockFollower();
+
+  void SetSnapThreshold(double us) { m_snap_us = us; }
+
+  // master_time is the master's media time now and master_speed its
+  // OMXPlaySpeed(), frame_time the follower's frame duration in us. returns
+  // the speed factor applied on top of the master's
+  float Steer(OMXClock *clock, double master_time, int master_speed, double frame_time);
+  // back to the master's speed, for when the clock stops following
+  void  Release(OMXClock *clock);
+  // forget the smoothed drift, after a seek on either side
+  void  Restart();
+  // the owner asked the player to seek onto the master, counted in the stats
+  void  Seeking();
+  void  ResetStats(double now);
+
+  const OMXClockGroupMemberStats &GetStats() const { return m_stats; }
+
+private:
+  double   m_smoothed;
+  double   m_drift_sum;
+  uint64_t m_locked_checks;
+  double   m_start_time;
+  double   m_snap_us;
+  OMXClockGroupMemberStats m_stats;
+};
+
+// Keeps the OMXClocks of several players on the master's media time.
+//
+// Every player runs its own clock component, the others are steered onto the
+// master with an OMXClockFollower. Members are expected to play the same
+// timeline, e.g. the parts of a video wall.
+//
+// Sync() is called by each member from its own engine thread after it
+// sampled its clock. It only reads the master through the lock-free
+// OMXClock::OMXMediaTime() and never blocks on the master's thread. A member
+// more than the seek threshold off is not steered, GetSeek() then hands the
+// member's engine the master's media time to seek to.
+// Join()/Leave() may be called from any thread, a clock must leave before it
+// is destroyed.
+class OMXClockGroup
+{
+public:
+  OMXClockGroup();
+  ~OMXClockGroup();
+
+  // the first clock to join becomes the master
+  bool Join(OMXClock *clock);
+  void Leave(OMXClock *clock);
+  bool SetMaster(OMXClock *clock);
+  bool IsMaster(OMXClock *clock);
+  unsigned int GetMemberCount();
+
+  void SetSeekThreshold(double us);
+
+  // steer clock towards the master, frame_time is the member's frame
+  // duration in us and sets the tolerance. returns the speed factor applied
+  float Sync(OMXClock *clock, double frame_time);
+  // true once when clock is too far off to be steered, media_time is the
+  // master's media time in us to seek to
+  bool  GetSeek(OMXClock *clock, double &media_time);
+
+  bool GetStats(OMXClock *clock, OMXClockGroupMemberStats &stats);
+  std::vector<OMXClockGroupMemberStats> GetStats();
+  // largest |drift| of any follower at its last Sync(), us
+  double GetMaxDrift();
+  void ResetStats();
+
+private:
+  struct Member
+  {
+    OMXClock        *clock;
+    OMXClockFollower follower;
+    bool             seek_pending;
+    double           seek_holdoff;
+  };
+
+  Member *Find(OMXClock *clock);
+
+  pthread_mutex_t     m_lock;
+  OMXClock           *m_master;
+  std::vector<Member> m_members;
+  double              m_seek_us;
+};
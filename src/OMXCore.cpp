@@ -303,12 +303,15 @@ COMXCoreComponent::COMXCoreComponent()
   m_input_alignment     = 0;
   m_input_buffer_size  = 0;
   m_input_buffer_count  = 0;
+  m_input_block_size    = 0;
+  m_input_blocks_busy   = 0;
 
   m_output_alignment    = 0;
   m_output_buffer_size  = 0;
   m_output_buffer_count = 0;
   m_flush_input         = false;
   m_flush_output        = false;
+  m_input_wait_cancel   = false;
   m_resource_error      = false;
 
   m_eos                 = false;
@@ -317,6 +320,7 @@ COMXCoreComponent::COMXCoreComponent()
 
   m_omx_input_use_buffers  = false;
   m_omx_output_use_buffers = false;
+  m_input_release          = NULL;
 
   m_omx_events.clear();
   m_ignore_error = OMX_ErrorNone;
@@ -540,7 +544,7 @@ OMX_ERRORTYPE COMXCoreComponent::WaitForInputDone(long timeout /*=200*/)
   struct timespec endtime;
   clock_gettime(CLOCK_REALTIME, &endtime);
   add_timespecs(endtime, timeout);
-  while (m_input_buffer_count != m_omx_input_avaliable.size())
+  while (m_input_buffer_count != m_omx_input_avaliable.size() || m_input_blocks_busy)
   {
     if (m_resource_error)
       break;
@@ -557,6 +561,42 @@ OMX_ERRORTYPE COMXCoreComponent::WaitForInputDone(long timeout /*=200*/)
 }
 
 
+bool COMXCoreComponent::WaitForInputSpace(unsigned int size, long timeout /*=200*/)
+{
+  bool ret = false;
+
+  if(!m_handle)
+    return ret;
+
+  pthread_mutex_lock(&m_omx_input_mutex);
+  struct timespec endtime;
+  clock_gettime(CLOCK_REALTIME, &endtime);
+  add_timespecs(endtime, timeout);
+  while (!m_input_wait_cancel)
+  {
+    // DecoderEmptyBufferDone signals m_input_buffer_cond for every returned buffer
+    if(m_omx_input_avaliable.size() * m_input_buffer_size >= size)
+    {
+      ret = true;
+      break;
+    }
+
+    if(pthread_cond_timedwait(&m_input_buffer_cond, &m_omx_input_mutex, &endtime) != 0)
+      break;
+  }
+  pthread_mutex_unlock(&m_omx_input_mutex);
+  return ret;
+}
+
+void COMXCoreComponent::CancelInputWait(bool cancel)
+{
+  pthread_mutex_lock(&m_omx_input_mutex);
+  m_input_wait_cancel = cancel;
+  if(cancel)
+    pthread_cond_broadcast(&m_input_buffer_cond);
+  pthread_mutex_unlock(&m_omx_input_mutex);
+}
+
 OMX_ERRORTYPE COMXCoreComponent::WaitForOutputDone(long timeout /*=200*/)
 {
   OMX_ERRORTYPE omx_err = OMX_ErrorNone;
@@ -582,7 +622,7 @@ OMX_ERRORTYPE COMXCoreComponent::WaitForOutputDone(long timeout /*=200*/)
 }
 
 
-OMX_ERRORTYPE COMXCoreComponent::AllocInputBuffers(bool use_buffers /* = false **/)
+OMX_ERRORTYPE COMXCoreComponent::AllocInputBuffers(bool use_buffers /* = false **/, const std::vector<OMX_U8*> *blocks /* = NULL */, unsigned int block_size /* = 0 */)
 {
   OMX_ERRORTYPE omx_err = OMX_ErrorNone;
 
@@ -607,13 +647,22 @@ OMX_ERRORTYPE COMXCoreComponent::AllocInputBuffers(bool use_buffers /* = false *
     SetStateForComponent(OMX_StateIdle);
   }
 
+  size_t block_count = blocks ? blocks->size() : 0;
+  if(block_count >= portFormat.nBufferCountActual || (block_count && block_size < portFormat.nBufferSize))
+  {
+    CLog::Log(LOGERROR, "COMXCoreComponent::AllocInputBuffers component(%s) - %u blocks of %u bytes don't fit %u buffers of %u\n",
+              m_componentName.c_str(), (unsigned int)block_count, block_size, portFormat.nBufferCountActual, portFormat.nBufferSize);
+    return OMX_ErrorBadParameter;
+  }
+
   omx_err = EnablePort(m_input_port, false);
   if(omx_err != OMX_ErrorNone)
     return omx_err;
 
   m_input_alignment     = portFormat.nBufferAlignment;
-  m_input_buffer_count  = portFormat.nBufferCountActual;
+  m_input_buffer_count  = portFormat.nBufferCountActual - block_count;
   m_input_buffer_size   = portFormat.nBufferSize;
+  m_input_block_size    = block_size;
 
   CLog::Log(LOGDEBUG, "COMXCoreComponent::AllocInputBuffers component(%s) - port(%d), nBufferCountMin(%u), nBufferCountActual(%u), nBufferSize(%u), nBufferAlignmen(%u)\n",
             m_componentName.c_str(), GetInputPort(), portFormat.nBufferCountMin,
@@ -624,7 +673,14 @@ OMX_ERRORTYPE COMXCoreComponent::AllocInputBuffers(bool use_buffers /* = false *
     OMX_BUFFERHEADERTYPE *buffer = NULL;
     OMX_U8* data = NULL;
 
-    if(m_omx_input_use_buffers)
+    bool own = i < m_input_buffer_count;
+
+    if(!own)
+    {
+      OMX_U8 *block = (*blocks)[i - m_input_buffer_count];
+      omx_err = OMX_UseBuffer(m_handle, &buffer, m_input_port, NULL, block_size, block);
+    }
+    else if(m_omx_input_use_buffers)
     {
       data = (OMX_U8*)_aligned_malloc(portFormat.nBufferSize, m_input_alignment);
       omx_err = OMX_UseBuffer(m_handle, &buffer, m_input_port, NULL, portFormat.nBufferSize, data);
@@ -648,7 +704,12 @@ OMX_ERRORTYPE COMXCoreComponent::AllocInputBuffers(bool use_buffers /* = false *
     buffer->nOffset         = 0;
     buffer->pAppPrivate     = (void*)i;  
     m_omx_input_buffers.push_back(buffer);
-    m_omx_input_avaliable.push(buffer);
+    if(own)
+      m_omx_input_avaliable.push(buffer);
+    else
+      m_omx_input_blocks[buffer->pBuffer] = i;
+    m_omx_input_data.push_back(data);
+    m_omx_input_attached.push_back(NULL);
   }
 
   omx_err = WaitForCommand(OMX_CommandPortEnable, m_input_port);
@@ -763,7 +824,8 @@ OMX_ERRORTYPE COMXCoreComponent::FreeInputBuffers()
 
   for (size_t i = 0; i < m_omx_input_buffers.size(); i++)
   {
-    uint8_t *buf = m_omx_input_buffers[i]->pBuffer;
+    // NULL for the caller's blocks
+    uint8_t *buf = m_omx_input_data[i];
 
     omx_err = OMX_FreeBuffer(m_handle, m_input_port, m_omx_input_buffers[i]);
 
@@ -786,9 +848,19 @@ OMX_ERRORTYPE COMXCoreComponent::FreeInputBuffers()
   WaitForInputDone(1000);
 
   pthread_mutex_lock(&m_omx_input_mutex);
-  assert(m_omx_input_buffers.size() == m_omx_input_avaliable.size());
+  assert(m_input_buffer_count == m_omx_input_avaliable.size());
+
+  // buffers that came back after Deinitialize() set m_exit still hold their data
+  for (size_t i = 0; i < m_omx_input_attached.size(); i++)
+  {
+    if(m_omx_input_attached[i] && m_input_release)
+      m_input_release(m_omx_input_attached[i]);
+  }
 
   m_omx_input_buffers.clear();
+  m_omx_input_data.clear();
+  m_omx_input_attached.clear();
+  m_omx_input_blocks.clear();
 
   while (!m_omx_input_avaliable.empty())
     m_omx_input_avaliable.pop();
@@ -796,6 +868,8 @@ OMX_ERRORTYPE COMXCoreComponent::FreeInputBuffers()
   m_input_alignment     = 0;
   m_input_buffer_size   = 0;
   m_input_buffer_count  = 0;
+  m_input_block_size    = 0;
+  m_input_blocks_busy   = 0;
 
   pthread_mutex_unlock(&m_omx_input_mutex);
 
@@ -1399,12 +1473,15 @@ bool COMXCoreComponent::Initialize( const std::string &component_name, OMX_INDEX
   m_input_alignment     = 0;
   m_input_buffer_size  = 0;
   m_input_buffer_count  = 0;
+  m_input_block_size    = 0;
+  m_input_blocks_busy   = 0;
 
   m_output_alignment    = 0;
   m_output_buffer_size  = 0;
   m_output_buffer_count = 0;
   m_flush_input         = false;
   m_flush_output        = false;
+  m_input_wait_cancel   = false;
   m_resource_error      = false;
 
   m_eos                 = false;
@@ -1413,6 +1490,7 @@ bool COMXCoreComponent::Initialize( const std::string &component_name, OMX_INDEX
 
   m_omx_input_use_buffers  = false;
   m_omx_output_use_buffers = false;
+  m_input_release          = NULL;
 
   m_omx_events.clear();
   m_ignore_error = OMX_ErrorNone;
@@ -1437,7 +1515,7 @@ bool COMXCoreComponent::Initialize( const std::string &component_name, OMX_INDEX
   if(!m_handle)
   {
 #ifdef TARGET_LINUX
-    if (strncmp("OMX.alsa.", component_name.c_str(), 9) == 0)
+    if (OMXALSA_IsComponent(component_name.c_str()))
       omx_err = OMXALSA_GetHandle(&m_handle, (char*) component_name.c_str(), this, &m_callbacks);
     else
 #endif
@@ -1518,7 +1596,7 @@ bool COMXCoreComponent::Deinitialize()
     CLog::Log(LOGDEBUG, "COMXCoreComponent::Deinitialize : %s handle %p\n",
         m_componentName.c_str(), m_handle);
 #ifdef TARGET_LINUX
-    if (strncmp("OMX.alsa.", m_componentName.c_str(), 9) == 0)
+    if (OMXALSA_IsComponent(m_componentName.c_str()))
       omx_err = OMXALSA_FreeHandle(m_handle);
     else
 #endif
@@ -1606,17 +1684,59 @@ OMX_ERRORTYPE COMXCoreComponent::DecoderEmptyBufferDone(OMX_HANDLETYPE hComponen
   #if defined(OMX_DEBUG_EVENTHANDLER)
   CLog::Log(LOGDEBUG, "COMXCoreComponent::DecoderEmptyBufferDone component(%s) %p %d/%d\n", m_componentName.c_str(), pBuffer, m_omx_input_avaliable.size(), m_input_buffer_count);
   #endif
+  void *attached = NULL;
+
   pthread_mutex_lock(&m_omx_input_mutex);
-  m_omx_input_avaliable.push(pBuffer);
+  size_t index = (size_t)pBuffer->pAppPrivate;
+  if(index < m_omx_input_attached.size() && m_omx_input_attached[index])
+  {
+    attached = m_omx_input_attached[index];
+    m_omx_input_attached[index] = NULL;
+  }
+  // the caller's blocks wait for their data to come round again
+  if(index < m_input_buffer_count)
+    m_omx_input_avaliable.push(pBuffer);
+  else if(m_input_blocks_busy)
+    m_input_blocks_busy--;
 
   // this allows (all) blocked tasks to be awoken
   pthread_cond_broadcast(&m_input_buffer_cond);
 
   pthread_mutex_unlock(&m_omx_input_mutex);
 
+  // the component is done reading the caller's data
+  if(attached && m_input_release)
+    m_input_release(attached);
+
   return OMX_ErrorNone;
 }
 
+OMX_BUFFERHEADERTYPE *COMXCoreComponent::AttachInputData(OMX_U8 *data, unsigned int size, void *opaque)
+{
+  if(!m_input_release || !opaque || size == 0 || size > m_input_block_size)
+    return NULL;
+
+  OMX_BUFFERHEADERTYPE *buffer = NULL;
+
+  pthread_mutex_lock(&m_omx_input_mutex);
+  std::map<const OMX_U8*, size_t>::const_iterator it = m_omx_input_blocks.find(data);
+  if(it != m_omx_input_blocks.end() && !m_omx_input_attached[it->second] && !m_flush_input)
+  {
+    buffer = m_omx_input_buffers[it->second];
+    m_omx_input_attached[it->second] = opaque;
+    m_input_blocks_busy++;
+  }
+  pthread_mutex_unlock(&m_omx_input_mutex);
+
+  if(buffer)
+  {
+    // pBuffer stays what it was registered with
+    buffer->nOffset    = 0;
+    buffer->nFilledLen = size;
+  }
+  return buffer;
+}
+
 OMX_ERRORTYPE COMXCoreComponent::DecoderFillBufferDone(OMX_HANDLETYPE hComponent, OMX_BUFFERHEADERTYPE* pBuffer)
 {
   if(m_exit)
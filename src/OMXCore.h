@@ -24,6 +24,7 @@
 
 #include <string>
 #include <queue>
+#include <map>
 
 // TODO: should this be in configure
 #ifndef OMX_SKIP64BIT
@@ -155,13 +156,28 @@ public:
   OMX_BUFFERHEADERTYPE *GetInputBuffer(long timeout=200);
   OMX_BUFFERHEADERTYPE *GetOutputBuffer(long timeout=200);
 
-  OMX_ERRORTYPE AllocInputBuffers(bool use_buffers = false);
+  OMX_ERRORTYPE AllocInputBuffers(bool use_buffers = false, const std::vector<OMX_U8*> *blocks = NULL, unsigned int block_size = 0);
   OMX_ERRORTYPE AllocOutputBuffers(bool use_buffers = false);
 
   OMX_ERRORTYPE FreeInputBuffers();
   OMX_ERRORTYPE FreeOutputBuffers();
 
+  // blocks of memory the caller owns, passed to AllocInputBuffers(), get a
+  // buffer each registered with OMX_UseBuffer, on top of the port's own
+  // buffers and never handed out by GetInputBuffer(). The port's
+  // nBufferCountActual has to count them. AttachInputData() returns the
+  // buffer of the block data starts, filled in for EmptyThisBuffer(), or NULL
+  // if there is none or it is still in flight. release(opaque) is called
+  // once the component has handed it back, or when the buffers are freed
+  typedef void (*InputDataRelease)(void *opaque);
+  void SetInputDataRelease(InputDataRelease release) { m_input_release = release; }
+  OMX_BUFFERHEADERTYPE *AttachInputData(OMX_U8 *data, unsigned int size, void *opaque);
+
   OMX_ERRORTYPE WaitForInputDone(long timeout=200);
+  // block until size bytes of input buffers are free, the timeout expires or
+  // CancelInputWait(true) is called. returns true when the space is there
+  bool WaitForInputSpace(unsigned int size, long timeout=200);
+  void CancelInputWait(bool cancel);
   OMX_ERRORTYPE WaitForOutputDone(long timeout=200);
 
   bool IsEOS() const { return m_eos; }
@@ -189,6 +205,12 @@ private:
   unsigned int  m_input_buffer_size;
   unsigned int  m_input_buffer_count;
   bool          m_omx_input_use_buffers;
+  std::vector<OMX_U8*> m_omx_input_data;     // own memory of the use_buffers mode buffers
+  std::vector<void*>   m_omx_input_attached; // caller data in flight, per buffer
+  std::map<const OMX_U8*, size_t> m_omx_input_blocks; // caller blocks to their buffer
+  unsigned int         m_input_block_size;
+  unsigned int         m_input_blocks_busy;
+  InputDataRelease     m_input_release;
 
   // OMXCore output buffers (video frames)
   pthread_mutex_t   m_omx_output_mutex;
@@ -206,6 +228,7 @@ private:
   pthread_cond_t    m_omx_event_cond;
   bool          m_eos;
   bool          m_flush_input;
+  bool          m_input_wait_cancel;
   bool          m_flush_output;
   bool          m_resource_error;
 };
@@ -0,0 +1,848 @@
+/*
+ * Generic OMX IL component framework
+ * Copyright (c) 2016 Timo Teräs
+ *
+ * This Program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * TODO:
+ * - timeouts for state transition failures
+ */
+
+#include <unistd.h>
+#include "OMXGeneric.h"
+
+GOMX_PORT *gomx_get_port(GOMX_COMPONENT *comp, size_t idx)
+{
+	size_t base = comp->nports ? comp->ports[0].def.nPortIndex : 0;
+	if (idx < base || idx - base >= comp->nports) return 0;
+	return &comp->ports[idx - base];
+}
+
+OMX_ERRORTYPE gomx_get_component_version(
+		OMX_HANDLETYPE hComponent, OMX_STRING pComponentName,
+		OMX_VERSIONTYPE *pComponentVersion, OMX_VERSIONTYPE *pSpecVersion, OMX_UUIDTYPE *pComponentUUID)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	CDEBUG(comp, 0, "enter");
+	strcpy(pComponentName, comp->name);
+	pComponentVersion->nVersion = OMX_VERSION;
+	pSpecVersion->nVersion = OMX_VERSION;
+	memcpy(pComponentUUID, &hComponent, sizeof hComponent);
+	return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE gomx_get_parameter(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nParamIndex, OMX_PTR pComponentParameterStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	GOMX_PORT *port;
+	OMX_PORT_PARAM_TYPE *ppt;
+	OMX_PARAM_PORTDEFINITIONTYPE *pdt;
+	OMX_PARAM_BUFFERSUPPLIERTYPE *bst;
+	OMX_ERRORTYPE r;
+	OMX_PORTDOMAINTYPE domain;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	CDEBUG(comp, 0, "called %x, %p", nParamIndex, pComponentParameterStructure);
+	switch (nParamIndex) {
+	case OMX_IndexParamAudioInit:
+		domain = OMX_PortDomainAudio;
+		goto param_init;
+	case OMX_IndexParamVideoInit:
+		domain = OMX_PortDomainVideo;
+		goto param_init;
+	case OMX_IndexParamImageInit:
+		domain = OMX_PortDomainImage;
+		goto param_init;
+	case OMX_IndexParamOtherInit:
+		domain = OMX_PortDomainOther;
+		goto param_init;
+	param_init:
+		if ((r = omx_cast(ppt, pComponentParameterStructure))) return r;
+		ppt->nPorts = 0;
+		ppt->nStartPortNumber = 0;
+		for (size_t i = 0; i < comp->nports; i++) {
+			if (comp->ports[i].def.eDomain != domain)
+				continue;
+			if (!ppt->nPorts)
+				ppt->nStartPortNumber = comp->ports[i].def.nPortIndex;
+			ppt->nPorts++;
+		}
+		break;
+	case OMX_IndexParamPortDefinition:
+		if ((r = omx_cast(pdt, pComponentParameterStructure))) return r;
+		if (!(port = gomx_get_port(comp, pdt->nPortIndex))) return OMX_ErrorBadPortIndex;
+		memcpy(pComponentParameterStructure, &port->def, sizeof *pdt);
+		break;
+	case OMX_IndexParamCompBufferSupplier:
+		if ((r = omx_cast(bst, pComponentParameterStructure))) return r;
+		if (!(port = gomx_get_port(comp, bst->nPortIndex))) return OMX_ErrorBadPortIndex;
+		if (port->def.eDir == OMX_DirInput)
+			bst->eBufferSupplier = port->tunnel_supplier ? OMX_BufferSupplyInput : OMX_BufferSupplyOutput;
+		else
+			bst->eBufferSupplier = port->tunnel_supplier ? OMX_BufferSupplyOutput : OMX_BufferSupplyInput;
+		break;
+	default:
+		CINFO(comp, 0, "UNSUPPORTED %x, %p", nParamIndex, pComponentParameterStructure);
+		return OMX_ErrorNotImplemented;
+	}
+	return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE gomx_set_parameter(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nParamIndex, OMX_PTR pComponentParameterStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	GOMX_PORT *port;
+	OMX_PARAM_PORTDEFINITIONTYPE *pdt;
+	OMX_PARAM_BUFFERSUPPLIERTYPE *bst;
+	OMX_ERRORTYPE r;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	switch (nParamIndex) {
+	case OMX_IndexParamPortDefinition:
+		if ((r = omx_cast(pdt, pComponentParameterStructure))) return r;
+		if (!(port = gomx_get_port(comp, pdt->nPortIndex))) return OMX_ErrorBadPortIndex;
+		if (comp->state != OMX_StateLoaded && port->def.bEnabled)
+			return OMX_ErrorIncorrectStateOperation;
+		if (pdt->nBufferCountActual < port->def.nBufferCountMin)
+			return OMX_ErrorBadParameter;
+		port->def.nBufferCountActual = pdt->nBufferCountActual;
+		if (pdt->nBufferSize)
+			port->def.nBufferSize = pdt->nBufferSize;
+		if (pdt->nBufferAlignment > port->def.nBufferAlignment)
+			port->def.nBufferAlignment = pdt->nBufferAlignment;
+		if (port->def.eDomain == OMX_PortDomainVideo && pdt->eDomain == OMX_PortDomainVideo) {
+			port->def.format.video.nFrameWidth = pdt->format.video.nFrameWidth;
+			port->def.format.video.nFrameHeight = pdt->format.video.nFrameHeight;
+		}
+		break;
+	case OMX_IndexParamCompBufferSupplier:
+		if ((r = omx_cast(bst, pComponentParameterStructure))) return r;
+		if (!(port = gomx_get_port(comp, bst->nPortIndex))) return OMX_ErrorBadPortIndex;
+		if (comp->state != OMX_StateLoaded && port->def.bEnabled)
+			return OMX_ErrorIncorrectStateOperation;
+		if (port->def.eDir == OMX_DirInput)
+			port->tunnel_supplier = (bst->eBufferSupplier == OMX_BufferSupplyInput);
+		else
+			port->tunnel_supplier = (bst->eBufferSupplier == OMX_BufferSupplyOutput);
+		break;
+	default:
+		CINFO(comp, 0, "UNSUPPORTED %x, %p", nParamIndex, pComponentParameterStructure);
+		return OMX_ErrorNotImplemented;
+	}
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE gomx_get_config(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nIndex, OMX_PTR pComponentConfigStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	CINFO(comp, 0, "UNSUPPORTED %x, %p", nIndex, pComponentConfigStructure);
+	return OMX_ErrorNotImplemented;
+}
+
+static OMX_ERRORTYPE gomx_set_config(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nIndex, OMX_PTR pComponentConfigStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	CINFO(comp, 0, "UNSUPPORTED %x, %p", nIndex, pComponentConfigStructure);
+	return OMX_ErrorNotImplemented;
+}
+
+static OMX_ERRORTYPE gomx_get_extension_index(OMX_HANDLETYPE hComponent, OMX_STRING cParameterName, OMX_INDEXTYPE *pIndexType)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	CINFO(comp, 0, "UNSUPPORTED '%s', %p", cParameterName, pIndexType);
+	return OMX_ErrorNotImplemented;
+}
+
+static OMX_ERRORTYPE gomx_get_state(OMX_HANDLETYPE hComponent, OMX_STATETYPE *pState)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	*pState = comp->state;
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE gomx_component_tunnel_request(
+		OMX_HANDLETYPE hComponent, OMX_U32 nPort,
+		OMX_HANDLETYPE hTunneledComp, OMX_U32 nTunneledPort, OMX_TUNNELSETUPTYPE* pTunnelSetup)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	GOMX_PORT *port = 0;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+	if (!(port = gomx_get_port(comp, nPort))) return OMX_ErrorBadPortIndex;
+	if (comp->state != OMX_StateLoaded && port->def.bEnabled)
+		return OMX_ErrorIncorrectStateOperation;
+
+	if (hTunneledComp == 0 || pTunnelSetup == 0) {
+		port->tunnel_comp = 0;
+		port->tunnel_supplier = false;
+		return OMX_ErrorNone;
+	}
+
+	if (port->def.eDir == OMX_DirInput) {
+		/* Negotiate parameters */
+		OMX_PARAM_PORTDEFINITIONTYPE param;
+		omx_init(param);
+		param.nPortIndex = nTunneledPort;
+		if (OMX_GetParameter(hTunneledComp, OMX_IndexParamPortDefinition, &param))
+			goto not_compatible;
+		if (param.eDomain != port->def.eDomain)
+			goto not_compatible;
+
+		param.nBufferCountActual = ::max(param.nBufferCountActual, port->def.nBufferCountMin);
+		param.nBufferSize = ::max(port->def.nBufferSize, param.nBufferSize);
+		param.nBufferAlignment = ::max(port->def.nBufferAlignment, param.nBufferAlignment);
+		port->def.nBufferCountActual = param.nBufferCountActual;
+		port->def.nBufferSize = param.nBufferSize;
+		port->def.nBufferAlignment = param.nBufferAlignment;
+		if (OMX_SetParameter(hTunneledComp, OMX_IndexParamPortDefinition, &param))
+			goto not_compatible;
+
+		/* Negotiate buffer supplier */
+		OMX_PARAM_BUFFERSUPPLIERTYPE suppl;
+		omx_init(suppl);
+		suppl.nPortIndex = nTunneledPort;
+		if (OMX_GetParameter(hTunneledComp, OMX_IndexParamCompBufferSupplier, &suppl))
+			goto not_compatible;
+
+		/* Being supplier is not supported so ask the other side to be it */
+		suppl.eBufferSupplier =
+			(pTunnelSetup->eSupplier == OMX_BufferSupplyOutput)
+			? OMX_BufferSupplyOutput : OMX_BufferSupplyInput;
+		if (OMX_SetParameter(hTunneledComp, OMX_IndexParamCompBufferSupplier, &suppl))
+			goto not_compatible;
+
+		port->tunnel_comp = hTunneledComp;
+		port->tunnel_port = nTunneledPort;
+		port->tunnel_supplier = (suppl.eBufferSupplier == OMX_BufferSupplyInput);
+		pTunnelSetup->eSupplier = suppl.eBufferSupplier;
+		CINFO(comp, port, "ComponentTunnnelRequest: %p %d", hTunneledComp, nTunneledPort);
+	} else {
+		/* Called first by OMX_SetupTunnel(). Offer to supply the buffers,
+		 * the input side has the final say through
+		 * OMX_IndexParamCompBufferSupplier. */
+		port->tunnel_comp = hTunneledComp;
+		port->tunnel_port = nTunneledPort;
+		port->tunnel_supplier = true;
+		pTunnelSetup->nTunnelFlags = 0;
+		pTunnelSetup->eSupplier = OMX_BufferSupplyOutput;
+		CINFO(comp, port, "ComponentTunnnelRequest: %p %d (output)", hTunneledComp, nTunneledPort);
+	}
+	return OMX_ErrorNone;
+
+not_compatible:
+	CINFO(comp, port, "ComponentTunnnelRequest: %p %d - NOT COMPATIBLE", hTunneledComp, nTunneledPort);
+	return OMX_ErrorPortsNotCompatible;
+}
+
+void __gomx_event(GOMX_COMPONENT *comp, OMX_EVENTTYPE eEvent, OMX_U32 nData1, OMX_U32 nData2, OMX_PTR pEventData)
+{
+	if (!comp->cb.EventHandler) return;
+	pthread_mutex_unlock(&comp->mutex);
+	comp->cb.EventHandler((OMX_HANDLETYPE) comp, comp->omx.pApplicationPrivate, eEvent, nData1, nData2, pEventData);
+	pthread_mutex_lock(&comp->mutex);
+}
+
+static void __gomx_port_update_buffer_state(GOMX_COMPONENT *comp, GOMX_PORT *port)
+{
+	if (port->num_buffers_old == port->num_buffers)
+		return;
+	port->num_buffers_old = port->num_buffers;
+
+	port->def.bPopulated = (port->num_buffers >= port->def.nBufferCountActual) ? OMX_TRUE : OMX_FALSE;
+	if (port->num_buffers == 0)
+		pthread_cond_signal(&port->cond_no_buffers);
+	else if (port->num_buffers == port->def.nBufferCountActual)
+		pthread_cond_signal(&port->cond_populated);
+}
+
+static OMX_ERRORTYPE gomx_use_buffer(OMX_HANDLETYPE hComponent, OMX_BUFFERHEADERTYPE **ppBufferHdr,
+				     OMX_U32 nPortIndex, OMX_PTR pAppPrivate, OMX_U32 nSizeBytes, OMX_U8* pBuffer)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	OMX_BUFFERHEADERTYPE *hdr;
+	GOMX_PORT *port;
+	void *buf;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+	if (!(port = gomx_get_port(comp, nPortIndex))) return OMX_ErrorBadPortIndex;
+
+	/* the component thread changes these while enabling the port */
+	pthread_mutex_lock(&comp->mutex);
+	if (!((comp->state == OMX_StateLoaded && comp->wanted_state == OMX_StateIdle) ||
+	      ((port->def.bEnabled == OMX_FALSE || port->new_enabled) &&
+			(comp->state == OMX_StateExecuting ||
+			 comp->state == OMX_StatePause ||
+			 comp->state == OMX_StateIdle)))) {
+		pthread_mutex_unlock(&comp->mutex);
+		return OMX_ErrorIncorrectStateOperation;
+	}
+	pthread_mutex_unlock(&comp->mutex);
+
+	buf = malloc(sizeof(OMX_BUFFERHEADERTYPE) + (pBuffer ? 0 : nSizeBytes));
+	if (!buf) return OMX_ErrorInsufficientResources;
+
+	hdr = (OMX_BUFFERHEADERTYPE *) buf;
+	memset(hdr, 0, sizeof *hdr);
+	omx_init(*hdr);
+	hdr->pBuffer = pBuffer ? (OMX_U8*)pBuffer : (OMX_U8*)(hdr + 1);
+	/* the client may not point a header elsewhere, see gomx_empty_this_buffer */
+	hdr->pPlatformPrivate = hdr->pBuffer;
+	hdr->nAllocLen = nSizeBytes;
+	hdr->pAppPrivate = pAppPrivate;
+	if (port->def.eDir == OMX_DirInput) {
+		hdr->nInputPortIndex = nPortIndex;
+		hdr->pOutputPortPrivate = pAppPrivate;
+	} else {
+		hdr->nOutputPortIndex = nPortIndex;
+		hdr->pInputPortPrivate = pAppPrivate;
+	}
+	pthread_mutex_lock(&comp->mutex);
+	port->num_buffers++;
+	__gomx_port_update_buffer_state(comp, port);
+	pthread_mutex_unlock(&comp->mutex);
+
+	CDEBUG(comp, port, "allocated: %d, %p, %u, %p", nPortIndex, pAppPrivate, nSizeBytes, pBuffer);
+	*ppBufferHdr = hdr;
+
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE gomx_allocate_buffer(OMX_HANDLETYPE hComponent, OMX_BUFFERHEADERTYPE **ppBufferHdr,
+					  OMX_U32 nPortIndex, OMX_PTR pAppPrivate, OMX_U32 nSizeBytes)
+{
+	return gomx_use_buffer(hComponent, ppBufferHdr, nPortIndex, pAppPrivate, nSizeBytes, 0);
+}
+
+static OMX_ERRORTYPE gomx_free_buffer(OMX_HANDLETYPE hComponent, OMX_U32 nPortIndex, OMX_BUFFERHEADERTYPE* pBuffer)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	GOMX_PORT *port;
+
+	if (!(port = gomx_get_port(comp, nPortIndex))) return OMX_ErrorBadPortIndex;
+
+	/* Freeing buffer is allowed in all states, so destructor can
+	 * synchronize successfully. */
+
+	pthread_mutex_lock(&comp->mutex);
+
+	if (!((comp->state == OMX_StateIdle && comp->wanted_state == OMX_StateLoaded) ||
+	      (port->def.bEnabled == OMX_FALSE &&
+			(comp->state == OMX_StateExecuting ||
+			 comp->state == OMX_StatePause ||
+			 comp->state == OMX_StateIdle)))) {
+		/* In unexpected states the port unpopulated error is sent. */
+		if (port->num_buffers == port->def.nBufferCountActual)
+			__gomx_event(comp, OMX_EventError, OMX_ErrorPortUnpopulated, nPortIndex, 0);
+		/* FIXME? should we mark the port also down */
+	}
+
+	port->num_buffers--;
+	__gomx_port_update_buffer_state(comp, port);
+
+	pthread_mutex_unlock(&comp->mutex);
+
+	free(pBuffer);
+
+	return OMX_ErrorNone;
+}
+
+void __gomx_port_queue_supplier_buffer(GOMX_PORT *port, OMX_BUFFERHEADERTYPE *hdr)
+{
+	gomxq_enqueue(&port->tunnel_supplierq, (void *) hdr);
+	if (port->tunnel_supplierq.num == port->num_buffers)
+		pthread_cond_broadcast(&port->cond_idle);
+}
+
+OMX_ERRORTYPE __gomx_empty_buffer_done(GOMX_COMPONENT *comp, OMX_BUFFERHEADERTYPE *hdr)
+{
+	GOMX_PORT *port = gomx_get_port(comp, hdr->nInputPortIndex);
+	OMX_ERRORTYPE r;
+
+	if (port->tunnel_comp) {
+		/* Buffers are sent to the tunneled port once emptied as long as
+		 * the component is in the OMX_StateExecuting state */
+		if ((comp->state == OMX_StateExecuting && port->def.bEnabled) ||
+		    !port->tunnel_supplier) {
+			pthread_mutex_unlock(&comp->mutex);
+			r = OMX_FillThisBuffer(port->tunnel_comp, hdr);
+			pthread_mutex_lock(&comp->mutex);
+		} else {
+			r = OMX_ErrorIncorrectStateOperation;
+		}
+	} else {
+		pthread_mutex_unlock(&comp->mutex);
+		r = comp->cb.EmptyBufferDone((OMX_HANDLETYPE) comp, comp->omx.pApplicationPrivate, hdr);
+		pthread_mutex_lock(&comp->mutex);
+	}
+
+	if (r != OMX_ErrorNone && port->tunnel_supplier) {
+		__gomx_port_queue_supplier_buffer(port, hdr);
+		r = OMX_ErrorNone;
+	}
+
+	return r;
+}
+
+static OMX_ERRORTYPE gomx_empty_this_buffer(OMX_HANDLETYPE hComponent, OMX_BUFFERHEADERTYPE* pBuffer)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	GOMX_PORT *port;
+	OMX_ERRORTYPE r;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+	if (comp->state != OMX_StatePause && comp->state != OMX_StateExecuting &&
+	    comp->wanted_state != OMX_StateExecuting)
+		return OMX_ErrorIncorrectStateOperation;
+
+	if (!(port = gomx_get_port(comp, pBuffer->nInputPortIndex)))
+		return OMX_ErrorBadPortIndex;
+	if (pBuffer->pBuffer != pBuffer->pPlatformPrivate) {
+		CINFO(comp, port, "buffer %p moved from %p to %p", pBuffer, pBuffer->pPlatformPrivate, pBuffer->pBuffer);
+		return OMX_ErrorBadParameter;
+	}
+
+	pthread_mutex_lock(&comp->mutex);
+	if (port->def.bEnabled) {
+		if (port->do_buffer)
+			r = port->do_buffer(comp, port, pBuffer);
+		else
+			r = __gomx_empty_buffer_done(comp, pBuffer);
+	} else {
+		if (port->tunnel_supplier) {
+			__gomx_port_queue_supplier_buffer(port, pBuffer);
+			r = OMX_ErrorNone;
+		} else {
+			r = OMX_ErrorIncorrectStateOperation;
+		}
+	}
+	pthread_mutex_unlock(&comp->mutex);
+	return r;
+}
+
+static OMX_ERRORTYPE gomx_fill_this_buffer(OMX_HANDLETYPE hComponent, OMX_BUFFERHEADERTYPE* pBuffer)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	GOMX_PORT *port;
+	OMX_ERRORTYPE r = OMX_ErrorNone;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+	if (!(port = gomx_get_port(comp, pBuffer->nOutputPortIndex)))
+		return OMX_ErrorBadPortIndex;
+	if (port->def.eDir != OMX_DirOutput)
+		return OMX_ErrorBadPortIndex;
+	if (pBuffer->pBuffer != pBuffer->pPlatformPrivate) {
+		CINFO(comp, port, "buffer %p moved from %p to %p", pBuffer, pBuffer->pPlatformPrivate, pBuffer->pBuffer);
+		return OMX_ErrorBadParameter;
+	}
+
+	/* Supplied buffers come back in any state, the port can only be
+	 * disabled and the component stopped once all of them did. */
+	pthread_mutex_lock(&comp->mutex);
+	if (port->do_buffer)
+		r = port->do_buffer(comp, port, pBuffer);
+	else if (port->tunnel_supplier)
+		__gomx_port_queue_supplier_buffer(port, pBuffer);
+	else
+		r = OMX_ErrorNotImplemented;
+	pthread_mutex_unlock(&comp->mutex);
+	return r;
+}
+
+void __gomx_process_mark(GOMX_COMPONENT *comp, OMX_BUFFERHEADERTYPE *hdr)
+{
+	if (hdr->hMarkTargetComponent == (OMX_HANDLETYPE) comp) {
+		__gomx_event(comp, OMX_EventMark, 0, 0, hdr->pMarkData);
+		hdr->hMarkTargetComponent = 0;
+		hdr->pMarkData = 0;
+	}
+}
+
+static OMX_ERRORTYPE __gomx_port_unpopulate(GOMX_COMPONENT *comp, GOMX_PORT *port)
+{
+	OMX_BUFFERHEADERTYPE *hdr;
+	void *buf;
+
+	if (port->tunnel_supplier) {
+		CINFO(comp, port, "waiting for supplier buffers (%d / %d)",
+			(int)port->tunnel_supplierq.num, (int)port->num_buffers);
+		while (port->tunnel_supplierq.num != port->num_buffers)
+			pthread_cond_wait(&port->cond_idle, &comp->mutex);
+
+		CINFO(comp, port, "free tunnel buffers");
+		while ((hdr = (OMX_BUFFERHEADERTYPE*)gomxq_dequeue(&port->tunnel_supplierq)) != 0) {
+			buf = hdr->pBuffer;
+			OMX_FreeBuffer(port->tunnel_comp, port->tunnel_port, hdr);
+			free(buf);
+			port->num_buffers--;
+			__gomx_port_update_buffer_state(comp, port);
+		}
+	} else {
+		/* Wait client / tunnel supplier to allocate buffers */
+		CINFO(comp, port, "waiting %d buffers to be freed", (int)port->num_buffers);
+		while (port->num_buffers > 0)
+			pthread_cond_wait(&port->cond_no_buffers, &comp->mutex);
+	}
+
+	CINFO(comp, port, "UNPOPULATED");
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE __gomx_port_populate(GOMX_COMPONENT *comp, GOMX_PORT *port)
+{
+	OMX_ERRORTYPE r;
+	OMX_BUFFERHEADERTYPE *hdr;
+	void *buf;
+
+	if (port->tunnel_supplier) {
+		CINFO(comp, port, "Allocating tunnel buffers");
+		while (port->num_buffers < port->def.nBufferCountActual) {
+			pthread_mutex_unlock(&comp->mutex);
+			r = OMX_ErrorInsufficientResources;
+			buf = malloc(port->def.nBufferSize);
+			if (buf) {
+				r = OMX_UseBuffer(port->tunnel_comp, &hdr,
+						port->tunnel_port, 0,
+						port->def.nBufferSize, (OMX_U8*) buf);
+				if (r != OMX_ErrorNone) free(buf);
+			}
+			if (r == OMX_ErrorInvalidState ||
+			    r == OMX_ErrorIncorrectStateOperation) {
+				/* Non-supplier is not transitioned yet.
+				 * Wait for a bit and retry */
+				usleep(1000);
+				pthread_mutex_lock(&comp->mutex);
+				continue;
+			}
+			pthread_mutex_lock(&comp->mutex);
+
+			if (r != OMX_ErrorNone) {
+				/* Hard error. Cancel and bail out */
+				__gomx_port_unpopulate(comp, port);
+				return r;
+			}
+
+			if (port->def.eDir == OMX_DirInput)
+				hdr->nInputPortIndex = port->def.nPortIndex;
+			else
+				hdr->nOutputPortIndex = port->def.nPortIndex;
+			gomxq_enqueue(&port->tunnel_supplierq, (void*) hdr);
+			port->num_buffers++;
+			__gomx_port_update_buffer_state(comp, port);
+		}
+	} else {
+		/* Wait client / tunnel supplier to allocate buffers */
+		CINFO(comp, port, "waiting buffers");
+		while (!port->def.bPopulated)
+			pthread_cond_wait(&port->cond_populated, &comp->mutex);
+	}
+
+	CINFO(comp, port, "POPULATED");
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE gomx_send_command(OMX_HANDLETYPE hComponent, OMX_COMMANDTYPE Cmd, OMX_U32 nParam1, OMX_PTR pCmdData)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	GOMX_COMMAND *c;
+
+	/* OMX IL Specification is unclear which errors can be returned
+	 * inline and which need to be reported with a callback.
+	 * This just does minimal state checking, and queues everything
+	 * to worker and reports any real errors via the callback. */
+	if (!hComponent) return OMX_ErrorInvalidComponent;
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+	if (!comp->cb.EventHandler) return OMX_ErrorNotReady;
+
+	c = (GOMX_COMMAND*) malloc(sizeof(GOMX_COMMAND));
+	if (!c) return OMX_ErrorInsufficientResources;
+
+	CINFO(comp, 0, "SendCommand %x, %x, %p", Cmd, nParam1, pCmdData);
+	c->cmd = Cmd;
+	c->param = nParam1;
+	c->data = pCmdData;
+
+	pthread_mutex_lock(&comp->mutex);
+	gomxq_enqueue(&comp->cmdq, (void*) c);
+	pthread_cond_signal(&comp->cond);
+	pthread_mutex_unlock(&comp->mutex);
+
+	return OMX_ErrorNone;
+}
+
+#define GOMX_TRANS(a,b) ((((uint32_t)a) << 16) | (uint32_t)b)
+
+static OMX_ERRORTYPE gomx_do_set_state(GOMX_COMPONENT *comp, GOMX_COMMAND *cmd)
+{
+	OMX_STATETYPE new_state = (OMX_STATETYPE) cmd->param;
+	OMX_ERRORTYPE r;
+	GOMX_PORT *port;
+	size_t i;
+
+	if (comp->state == new_state) return OMX_ErrorSameState;
+
+	if (new_state == OMX_StateInvalid) {
+		/* Transition to invalid state is always valid and immediate */
+		comp->state = new_state;
+		return OMX_ErrorNone;
+	}
+
+	CDEBUG(comp, 0, "starting transition to state %d", new_state);
+
+	comp->wanted_state = new_state;
+
+	if (comp->statechange) {
+		r = comp->statechange(comp);
+		if (r != OMX_ErrorNone) goto err;
+	}
+
+	switch (GOMX_TRANS(comp->state, new_state)) {
+	case GOMX_TRANS(OMX_StateLoaded, OMX_StateIdle):
+		/* populate or wait for all enabled ports to be populated */
+		for (i = 0; i < comp->nports; i++) {
+			if (!comp->ports[i].def.bEnabled) continue;
+			r = __gomx_port_populate(comp, &comp->ports[i]);
+			if (r) goto err;
+		}
+		break;
+	case GOMX_TRANS(OMX_StateIdle, OMX_StateLoaded):
+		/* free or wait all ports to be unpopulated */
+		for (i = 0; i < comp->nports; i++) {
+			r = __gomx_port_unpopulate(comp, &comp->ports[i]);
+			if (r) goto err;
+		}
+		break;
+	case GOMX_TRANS(OMX_StateIdle, OMX_StateExecuting):
+		/* start threads */
+		r = OMX_ErrorInsufficientResources;
+		if (comp->worker &&
+		    pthread_create(&comp->worker_thread, 0, comp->worker, comp) != 0)
+			goto err;
+		break;
+	case GOMX_TRANS(OMX_StateExecuting, OMX_StateIdle):
+		/* stop/join threads & wait buffers to be returned to suppliers */
+		if (comp->worker_thread) {
+			pthread_mutex_unlock(&comp->mutex);
+			pthread_join(comp->worker_thread, 0);
+			pthread_mutex_lock(&comp->mutex);
+			comp->worker_thread = 0;
+		}
+		for (i = 0; i < comp->nports; i++) {
+			port = &comp->ports[i];
+			if (!port->tunnel_supplier || !port->def.bEnabled) continue;
+			while (port->tunnel_supplierq.num != port->num_buffers)
+				pthread_cond_wait(&port->cond_idle, &comp->mutex);
+		}
+		break;
+	default:
+		/* FIXME: Pause and WaitForResources states not supported */
+		r = OMX_ErrorIncorrectStateTransition;
+		goto err;
+	}
+	comp->state = new_state;
+	CDEBUG(comp, 0, "transition to state %d: success", new_state);
+	return OMX_ErrorNone;
+err:
+	comp->wanted_state = comp->state;
+	CDEBUG(comp, 0, "transition to state %d: result %x", new_state, r);
+	return r;
+}
+
+static OMX_ERRORTYPE gomx_do_port_command(GOMX_COMPONENT *comp, GOMX_PORT *port, GOMX_COMMAND *cmd)
+{
+	OMX_ERRORTYPE r = OMX_ErrorNone;
+
+	switch (cmd->cmd) {
+	case OMX_CommandFlush:
+		if (port->flush) r = port->flush(comp, port);
+		break;
+	case OMX_CommandPortEnable:
+		port->def.bEnabled = OMX_TRUE;
+		/* In Loaded the buffers come with the transition to Idle */
+		if (comp->state == OMX_StateLoaded && comp->wanted_state == OMX_StateLoaded)
+			break;
+		port->new_enabled = OMX_TRUE;
+		r = __gomx_port_populate(comp, port);
+		port->new_enabled = OMX_FALSE;
+		if (r != OMX_ErrorNone)
+			port->def.bEnabled = OMX_FALSE;
+		break;
+	case OMX_CommandPortDisable:
+		port->def.bEnabled = OMX_FALSE;
+		if (port->flush) port->flush(comp, port);
+		r = __gomx_port_unpopulate(comp, port);
+		break;
+	default:
+		r = OMX_ErrorNotImplemented;
+		break;
+	}
+	return r;
+}
+
+static OMX_ERRORTYPE gomx_do_command(GOMX_COMPONENT *comp, GOMX_COMMAND *cmd)
+{
+	GOMX_PORT *port;
+
+	switch (cmd->cmd) {
+	case OMX_CommandStateSet:
+		CINFO(comp, 0, "state %x", cmd->param);
+		return gomx_do_set_state(comp, cmd);
+	case OMX_CommandFlush:
+	case OMX_CommandPortEnable:
+	case OMX_CommandPortDisable:
+		/* FIXME: OMX_ALL is not supported (but not used in omxplayer) */
+		if (!(port = gomx_get_port(comp, cmd->param)))
+			return OMX_ErrorBadPortIndex;
+		CINFO(comp, port, "command %x", cmd->cmd);
+		return gomx_do_port_command(comp, port, cmd);
+	case OMX_CommandMarkBuffer:
+		/* FIXME: Not implemented (but not used in omxplayer) */
+	default:
+		CINFO(comp, 0, "UNSUPPORTED %x, %x, %p", cmd->cmd, cmd->param, cmd->data);
+		return OMX_ErrorNotImplemented;
+	}
+}
+
+static void *gomx_worker(void *ptr)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) ptr;
+	GOMX_PORT *port;
+	GOMX_COMMAND *cmd;
+	OMX_BUFFERHEADERTYPE *hdr;
+	OMX_ERRORTYPE r;
+
+	CINFO(comp, 0, "start");
+	pthread_mutex_lock(&comp->mutex);
+	while (comp->state != OMX_StateInvalid) {
+		cmd = (GOMX_COMMAND *) gomxq_dequeue(&comp->cmdq);
+		if (cmd) {
+			r = gomx_do_command(comp, cmd);
+			if (r == OMX_ErrorNone)
+				__gomx_event(comp, OMX_EventCmdComplete,
+					     cmd->cmd, cmd->param, cmd->data);
+			else
+				__gomx_event(comp, OMX_EventError, r, 0, 0);
+			free(cmd);
+		} else {
+			pthread_cond_wait(&comp->cond, &comp->mutex);
+		}
+
+		if (comp->state != OMX_StateExecuting)
+			continue;
+
+		/* FIXME: Rate limit and retry if needed suppplier buffer enqueuing */
+		for (size_t i = 0; i < comp->nports; i++) {
+			port = &comp->ports[i];
+			/* output supplier ports are fed by the component itself */
+			if (port->def.eDir != OMX_DirInput) continue;
+			while ((hdr = (OMX_BUFFERHEADERTYPE*)gomxq_dequeue(&port->tunnel_supplierq)) != 0) {
+				pthread_mutex_unlock(&comp->mutex);
+				r = OMX_FillThisBuffer(port->tunnel_comp, hdr);
+				pthread_mutex_lock(&comp->mutex);
+				if (r != OMX_ErrorNone) {
+					__gomx_port_queue_supplier_buffer(port, hdr);
+					break;
+				}
+			}
+		}
+	}
+	pthread_mutex_unlock(&comp->mutex);
+	/* FIXME: make sure all buffers are returned and worker threads stopped */
+	CINFO(comp, 0, "stop");
+	return 0;
+}
+
+static OMX_ERRORTYPE gomx_set_callbacks(OMX_HANDLETYPE hComponent, OMX_CALLBACKTYPE* pCallbacks, OMX_PTR pAppData)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+	if (comp->state != OMX_StateLoaded) return OMX_ErrorIncorrectStateOperation;
+	pthread_mutex_lock(&comp->mutex);
+	comp->omx.pApplicationPrivate = pAppData;
+	comp->cb = *pCallbacks;
+	pthread_mutex_unlock(&comp->mutex);
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE gomx_use_egl_image(OMX_HANDLETYPE hComponent,
+		OMX_BUFFERHEADERTYPE** ppBufferHdr, OMX_U32 nPortIndex,
+		OMX_PTR pAppPrivate, void* eglImage)
+{
+	return OMX_ErrorNotImplemented;
+}
+
+static OMX_ERRORTYPE gomx_component_role_enum(OMX_HANDLETYPE hComponent, OMX_U8 *cRole, OMX_U32 nIndex)
+{
+	return OMX_ErrorNotImplemented;
+}
+
+void gomx_init(GOMX_COMPONENT *comp, const char *name, OMX_PTR pAppData, OMX_CALLBACKTYPE* pCallbacks, GOMX_PORT *ports, size_t nports)
+{
+	comp->omx.nSize = sizeof comp->omx;
+	comp->omx.nVersion.nVersion = OMX_VERSION;
+	comp->omx.pApplicationPrivate = pAppData;
+	comp->omx.GetComponentVersion = gomx_get_component_version;
+	comp->omx.SendCommand = gomx_send_command;
+	comp->omx.GetParameter = gomx_get_parameter;
+	comp->omx.SetParameter = gomx_set_parameter;
+	comp->omx.GetConfig = gomx_get_config;
+	comp->omx.SetConfig = gomx_set_config;
+	comp->omx.GetExtensionIndex = gomx_get_extension_index;
+	comp->omx.GetState = gomx_get_state;
+	comp->omx.ComponentTunnelRequest = gomx_component_tunnel_request;
+	comp->omx.UseBuffer = gomx_use_buffer;
+	comp->omx.AllocateBuffer = gomx_allocate_buffer;
+	comp->omx.FreeBuffer = gomx_free_buffer;
+	comp->omx.EmptyThisBuffer = gomx_empty_this_buffer;
+	comp->omx.FillThisBuffer = gomx_fill_this_buffer;
+	comp->omx.SetCallbacks = gomx_set_callbacks;
+	comp->omx.UseEGLImage = gomx_use_egl_image;
+	comp->omx.ComponentRoleEnum = gomx_component_role_enum;
+
+	comp->name = name;
+	comp->cb = *pCallbacks;
+	comp->state = comp->wanted_state = OMX_StateLoaded;
+	comp->nports = nports;
+	comp->ports = ports;
+
+	gomxq_init(&comp->cmdq, offsetof(GOMX_COMMAND, next));
+	pthread_cond_init(&comp->cond, 0);
+	pthread_mutex_init(&comp->mutex, 0);
+
+	for (size_t i = 0; i < comp->nports; i++) {
+		GOMX_PORT *port = &comp->ports[i];
+		pthread_cond_init(&port->cond_no_buffers, 0);
+		pthread_cond_init(&port->cond_populated, 0);
+		pthread_cond_init(&port->cond_idle, 0);
+		gomxq_init(&port->tunnel_supplierq,
+			port->def.eDir == OMX_DirInput
+			? offsetof(OMX_BUFFERHEADERTYPE, pInputPortPrivate)
+			: offsetof(OMX_BUFFERHEADERTYPE, pOutputPortPrivate));
+	}
+
+	/* the ports must be set up before commands can be processed */
+	pthread_create(&comp->component_thread, 0, gomx_worker, comp);
+}
+
+void gomx_fini(GOMX_COMPONENT *comp)
+{
+	CINFO(comp, 0, "destroying");
+	pthread_mutex_lock(&comp->mutex);
+	comp->state = OMX_StateInvalid;
+	pthread_cond_broadcast(&comp->cond);
+	pthread_mutex_unlock(&comp->mutex);
+	pthread_join(comp->component_thread, 0);
+
+	for (size_t i = 0; i < comp->nports; i++) {
+		GOMX_PORT *port = &comp->ports[i];
+		pthread_cond_destroy(&port->cond_no_buffers);
+		pthread_cond_destroy(&port->cond_populated);
+		pthread_cond_destroy(&port->cond_idle);
+	}
+	pthread_mutex_destroy(&comp->mutex);
+	pthread_cond_destroy(&comp->cond);
+}
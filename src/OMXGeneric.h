@@ -0,0 +1,180 @@
+#pragma once
+/*
+ * Generic OMX IL component framework
+ * Copyright (c) 2016 Timo Teräs
+ *
+ * This Program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * Shared by the ALSA sink (OMXAlsa.cpp) and the software components
+ * (OMXSoftCore.cpp). A component embeds GOMX_COMPONENT as its first member,
+ * fills in its ports and calls gomx_init(); the framework then runs the
+ * state machine, port enable/disable, buffer population and tunnels on the
+ * component thread. Port numbers start at ports[0].def.nPortIndex and are
+ * contiguous, so components can use the firmware's numbering.
+ */
+
+#include <time.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <IL/OMX_Core.h>
+#include <IL/OMX_Component.h>
+#include <IL/OMX_Broadcom.h>
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof(x[0]))
+
+struct _GOMX_COMMAND;
+struct _GOMX_PORT;
+struct _GOMX_COMPONENT;
+
+template <class X> static inline X max(X a, X b)
+{
+	return (a > b) ? a : b;
+}
+
+template <class X> static OMX_ERRORTYPE omx_cast(X* &toptr, OMX_PTR fromptr)
+{
+	toptr = (X*) fromptr;
+	if (toptr->nSize < sizeof(X)) return OMX_ErrorBadParameter;
+	if (toptr->nVersion.nVersion != OMX_VERSION) return OMX_ErrorVersionMismatch;
+	return OMX_ErrorNone;
+}
+
+template <class X> static void omx_init(X &omx)
+{
+	omx.nSize = sizeof(X);
+	omx.nVersion.nVersion = OMX_VERSION;
+}
+
+#if 1
+#include <utils/log.h>
+#define CLOG(notice, comp, port, msg, ...) do { \
+	struct _GOMX_PORT *_port = (struct _GOMX_PORT *) port; \
+	if (_port) CLog::Log(notice ? LOGNOTICE : LOGDEBUG, "[%p port %d]: %s: " msg "\n", comp, _port->def.nPortIndex, __func__ , ##__VA_ARGS__); \
+	else CLog::Log(notice ? LOGNOTICE : LOGDEBUG, "[%p] %s: " msg "\n", comp, __func__ , ##__VA_ARGS__); \
+} while (0)
+#else
+#define CLOG(notice, comp, port, msg, ...) do { \
+	struct _GOMX_PORT *_port = (struct _GOMX_PORT *) port; \
+	if (_port) fprintf(stderr, "[%p port %d]: %s: " msg "\n", comp, _port->def.nPortIndex, __func__ , ##__VA_ARGS__); \
+	else fprintf(stderr, "[%p] %s: " msg "\n", comp, __func__ , ##__VA_ARGS__); \
+} while (0)
+#endif
+
+#define CINFO(comp, port, msg, ...) CLOG(1, comp, port, msg , ##__VA_ARGS__)
+#define CDEBUG(comp, port, msg, ...) CLOG(0, comp, port, msg , ##__VA_ARGS__)
+
+/* Intrusive singly linked FIFO, the link lives at offset inside the item */
+
+typedef struct _GOMX_QUEUE {
+	void *head, *tail;
+	ptrdiff_t offset;
+	size_t num;
+} GOMX_QUEUE;
+
+static inline void gomxq_init(GOMX_QUEUE *q, ptrdiff_t offset)
+{
+	q->head = q->tail = 0;
+	q->offset = offset;
+	q->num = 0;
+}
+
+static inline void **gomxq_nextptr(GOMX_QUEUE *q, void *item)
+{
+	return (void**) ((uint8_t*)item + q->offset);
+}
+
+static inline void gomxq_enqueue(GOMX_QUEUE *q, void *item)
+{
+	*gomxq_nextptr(q, item) = 0;
+	if (q->tail) {
+		*gomxq_nextptr(q, q->tail) = item;
+		q->tail = item;
+	} else {
+		q->head = q->tail = item;
+	}
+	q->num++;
+}
+
+static inline void *gomxq_dequeue(GOMX_QUEUE *q)
+{
+	void *item = q->head;
+	if (item) {
+		q->head = *gomxq_nextptr(q, item);
+		if (!q->head) q->tail = 0;
+		q->num--;
+	}
+	return item;
+}
+
+typedef struct _GOMX_COMMAND {
+	void *next;
+	OMX_COMMANDTYPE cmd;
+	OMX_U32 param;
+	OMX_PTR data;
+} GOMX_COMMAND;
+
+typedef struct _GOMX_PORT {
+	OMX_BOOL new_enabled;
+	OMX_PARAM_PORTDEFINITIONTYPE def;
+
+	size_t num_buffers, num_buffers_old;
+	pthread_cond_t cond_no_buffers;
+	pthread_cond_t cond_populated;
+	pthread_cond_t cond_idle;
+
+	OMX_HANDLETYPE tunnel_comp;
+	OMX_U32 tunnel_port;
+	bool tunnel_supplier;
+	/* buffers of a supplier port that are back with us: empty ones for
+	 * an output port, ones waiting to be sent out for an input port */
+	GOMX_QUEUE tunnel_supplierq;
+
+	/* input port: EmptyThisBuffer, output port: FillThisBuffer. Both are
+	 * called with the component mutex held. */
+	OMX_ERRORTYPE (*do_buffer)(struct _GOMX_COMPONENT *, struct _GOMX_PORT *, OMX_BUFFERHEADERTYPE *);
+	OMX_ERRORTYPE (*flush)(struct _GOMX_COMPONENT *, struct _GOMX_PORT *);
+} GOMX_PORT;
+
+typedef struct _GOMX_COMPONENT {
+	OMX_COMPONENTTYPE omx;
+	OMX_CALLBACKTYPE cb;
+	OMX_STATETYPE state, wanted_state;
+
+	pthread_t component_thread, worker_thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+
+	const char *name;
+	size_t nports;
+	GOMX_PORT *ports;
+	GOMX_QUEUE cmdq;
+
+	void* (*worker)(void *);
+	OMX_ERRORTYPE (*statechange)(struct _GOMX_COMPONENT *);
+} GOMX_COMPONENT;
+
+GOMX_PORT *gomx_get_port(GOMX_COMPONENT *comp, size_t idx);
+
+OMX_ERRORTYPE gomx_get_component_version(
+		OMX_HANDLETYPE hComponent, OMX_STRING pComponentName,
+		OMX_VERSIONTYPE *pComponentVersion, OMX_VERSIONTYPE *pSpecVersion, OMX_UUIDTYPE *pComponentUUID);
+OMX_ERRORTYPE gomx_get_parameter(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nParamIndex, OMX_PTR pComponentParameterStructure);
+/* port definitions and buffer supplier, the parameters tunnel setup needs */
+OMX_ERRORTYPE gomx_set_parameter(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nParamIndex, OMX_PTR pComponentParameterStructure);
+
+/* The __ helpers are called with the component mutex held. The callbacks
+ * and calls into tunneled components are made with it released. */
+void __gomx_event(GOMX_COMPONENT *comp, OMX_EVENTTYPE eEvent, OMX_U32 nData1, OMX_U32 nData2, OMX_PTR pEventData);
+OMX_ERRORTYPE __gomx_empty_buffer_done(GOMX_COMPONENT *comp, OMX_BUFFERHEADERTYPE *hdr);
+void __gomx_port_queue_supplier_buffer(GOMX_PORT *port, OMX_BUFFERHEADERTYPE *hdr);
+void __gomx_process_mark(GOMX_COMPONENT *comp, OMX_BUFFERHEADERTYPE *hdr);
+
+void gomx_init(GOMX_COMPONENT *comp, const char *name, OMX_PTR pAppData, OMX_CALLBACKTYPE* pCallbacks, GOMX_PORT *ports, size_t nports);
+void gomx_fini(GOMX_COMPONENT *comp);
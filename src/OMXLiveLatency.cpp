@@ -0,0 +1,253 @@
+#include "OMXLiveLatency.h"
+
+#include <math.h>
+#include <algorithm>
+
+// longest gap between two Update() calls taken into account, a stall of the
+// engine thread shouldn't become a big step of the filter or the integral
+#define OMX_LIVE_LATENCY_MAX_DT 0.5
+
+OMXLiveLatency::OMXLiveLatency()
+{
+  pthread_mutex_init(&m_lock, NULL);
+  m_config = Defaults();
+  m_trace = NULL;
+  Reset();
+  ResetStats();
+}
+
+OMXLiveLatency::~OMXLiveLatency()
+{
+  StopTrace();
+  pthread_mutex_destroy(&m_lock);
+}
+
+OMXLiveLatencyConfig OMXLiveLatency::Defaults()
+{
+  OMXLiveLatencyConfig config;
+  config.target       = 0.7;
+  config.target_max   = 0.7;
+  // critically damped with ki = kp^2/4, settles a step in about 4/kp
+  config.kp           = 0.05;
+  config.ki           = 0.000625;
+  config.max_ratio    = 0.01;
+  // DVD_PLAYSPEED_NORMAL is 1000, OMXClock can't go finer
+  config.ratio_step   = 0.001;
+  config.filter       = 2.0;
+  config.pause_level  = 0.1;
+  config.pause_hold   = 0.06;
+  config.resume_level = 1.0;
+  return config;
+}
+
+void OMXLiveLatency::SetConfig(const OMXLiveLatencyConfig &config)
+{
+  pthread_mutex_lock(&m_lock);
+  m_config = config;
+  m_config.target     = std::max(m_config.target, 0.0);
+  m_config.target_max = std::max(m_config.target_max, m_config.target);
+  m_config.max_ratio  = std::min(std::max(m_config.max_ratio, 0.0), 0.5);
+  m_config.ratio_step = std::max(m_config.ratio_step, 0.0);
+  m_target = std::min(std::max(m_target, m_config.target), m_config.target_max);
+  m_integral = std::min(std::max(m_integral, -m_config.max_ratio), m_config.max_ratio);
+  m_stats.target = m_target;
+  pthread_mutex_unlock(&m_lock);
+}
+
+OMXLiveLatencyConfig OMXLiveLatency::GetConfig()
+{
+  pthread_mutex_lock(&m_lock);
+  OMXLiveLatencyConfig config = m_config;
+  pthread_mutex_unlock(&m_lock);
+  return config;
+}
+
+void OMXLiveLatency::Reset()
+{
+  pthread_mutex_lock(&m_lock);
+  m_target        = m_config.target;
+  m_measured      = 0.0;
+  m_have_measured = false;
+  m_integral      = 0.0;
+  m_ratio         = 1.0;
+  m_applied       = 1.0;
+  m_last_time     = -1.0;
+  m_low_time      = 0.0;
+  m_started       = false;
+  m_underrun      = false;
+  m_stats.target   = m_target;
+  m_stats.ratio    = 1.0;
+  m_stats.applied  = 1.0;
+  m_stats.integral = 0.0;
+  pthread_mutex_unlock(&m_lock);
+}
+
+void OMXLiveLatency::ResetStats()
+{
+  pthread_mutex_lock(&m_lock);
+  m_error_sum   = 0.0;
+  m_error_count = 0;
+  m_stats.target        = m_target;
+  m_stats.measured      = m_measured;
+  m_stats.latency       = 0.0;
+  m_stats.error_avg     = 0.0;
+  m_stats.error_max     = 0.0;
+  m_stats.ratio         = m_ratio;
+  m_stats.applied       = m_applied;
+  m_stats.integral      = m_integral;
+  m_stats.updates       = 0;
+  m_stats.underruns     = 0;
+  m_stats.resumes       = 0;
+  m_stats.ratio_changes = 0;
+  m_stats.paused_time   = 0.0;
+  m_stats.paused        = false;
+  pthread_mutex_unlock(&m_lock);
+}
+
+OMXLiveLatencyAction OMXLiveLatency::Update(double now, double media, double latency, bool paused, bool blocked)
+{
+  pthread_mutex_lock(&m_lock);
+
+  if(m_trace)
+    fprintf(m_trace, "%.6f %.6f %.6f %d %.4f\n", now, media, latency, paused ? 1 : 0, m_applied);
+
+  double dt = 0.0;
+  if(m_last_time >= 0.0)
+    dt = std::min(std::max(now - m_last_time, 0.0), OMX_LIVE_LATENCY_MAX_DT);
+  m_last_time = now;
+
+  OMXLiveLatencyAction action = OMX_LIVE_LATENCY_HOLD;
+  m_stats.latency = latency;
+  m_stats.updates++;
+
+  if(latency >= m_target * m_config.resume_level)
+    m_started = true;
+
+  if(paused)
+  {
+    if(m_underrun)
+      m_stats.paused_time += dt;
+    m_low_time = 0.0;
+    // the gap between pause_level and the target keeps it from pausing
+    // again right away
+    if(latency >= m_target * m_config.resume_level || blocked)
+    {
+      m_measured      = latency;
+      m_have_measured = true;
+      m_underrun      = false;
+      m_stats.resumes++;
+      action = OMX_LIVE_LATENCY_RESUME;
+    }
+  }
+  else
+  {
+    if(latency < m_config.pause_level && !blocked)
+      m_low_time += dt;
+    else
+      m_low_time = 0.0;
+
+    if(m_low_time > 0.0 && m_low_time >= m_config.pause_hold)
+    {
+      // before playback got going it is just buffering, not an underrun
+      if(m_started)
+      {
+        m_stats.underruns++;
+        m_target = std::min(m_target * 2.0, m_config.target_max);
+      }
+      m_low_time = 0.0;
+      m_underrun = true;
+      action = OMX_LIVE_LATENCY_PAUSE;
+    }
+    else
+    {
+      if(!m_have_measured || m_config.filter <= 0.0)
+        m_measured = latency;
+      else
+        m_measured += (latency - m_measured) * (1.0 - exp(-dt / m_config.filter));
+      m_have_measured = true;
+
+      double error = m_measured - m_target;
+      double proportional = m_config.kp * error;
+      double max_ratio = m_config.max_ratio;
+
+      // anti-windup: leave the integral alone while the output is already
+      // at the bound the error pushes it to
+      double unbounded = proportional + m_integral;
+      if(!(unbounded >= max_ratio && error > 0.0) && !(unbounded <= -max_ratio && error < 0.0))
+        m_integral = std::min(std::max(m_integral + m_config.ki * error * dt, -max_ratio), max_ratio);
+
+      m_ratio = 1.0 + std::min(std::max(proportional + m_integral, -max_ratio), max_ratio);
+
+      double step = m_config.ratio_step;
+      if(step <= 0.0)
+      {
+        if(m_ratio != m_applied)
+          m_stats.ratio_changes++;
+        m_applied = m_ratio;
+      }
+      else if(fabs(m_ratio - m_applied) > 0.75 * step)
+      {
+        m_applied = 1.0 + floor((m_ratio - 1.0) / step + 0.5) * step;
+        m_stats.ratio_changes++;
+      }
+
+      if(m_started)
+      {
+        m_error_sum += fabs(error);
+        m_error_count++;
+        m_stats.error_avg = m_error_sum / m_error_count;
+        m_stats.error_max = std::max(m_stats.error_max, fabs(error));
+      }
+    }
+  }
+
+  m_stats.target   = m_target;
+  m_stats.measured = m_measured;
+  m_stats.ratio    = m_ratio;
+  m_stats.applied  = m_applied;
+  m_stats.integral = m_integral;
+  m_stats.paused   = action == OMX_LIVE_LATENCY_PAUSE || (paused && action != OMX_LIVE_LATENCY_RESUME);
+
+  pthread_mutex_unlock(&m_lock);
+  return action;
+}
+
+double OMXLiveLatency::GetRatio()
+{
+  pthread_mutex_lock(&m_lock);
+  double ratio = m_applied;
+  pthread_mutex_unlock(&m_lock);
+  return ratio;
+}
+
+OMXLiveLatencyStats OMXLiveLatency::GetStats()
+{
+  pthread_mutex_lock(&m_lock);
+  OMXLiveLatencyStats stats = m_stats;
+  pthread_mutex_unlock(&m_lock);
+  return stats;
+}
+
+bool OMXLiveLatency::StartTrace(const std::string &path)
+{
+  StopTrace();
+  FILE *trace = fopen(path.c_str(), "w");
+  if(!trace)
+    return false;
+  fprintf(trace, "# time media latency paused ratio\n");
+
+  pthread_mutex_lock(&m_lock);
+  m_trace = trace;
+  pthread_mutex_unlock(&m_lock);
+  return true;
+}
+
+void OMXLiveLatency::StopTrace()
+{
+  pthread_mutex_lock(&m_lock);
+  FILE *trace = m_trace;
+  m_trace = NULL;
+  pthread_mutex_unlock(&m_lock);
+  if(trace)
+    fclose(trace);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <string>
+
+typedef enum OMXLiveLatencyAction
+{
+  OMX_LIVE_LATENCY_HOLD,    // carry on at GetRatio()
+  OMX_LIVE_LATENCY_PAUSE,   // the fifo ran dry, pause the clock
+  OMX_LIVE_LATENCY_RESUME   // refilled, or the input can't take more, resume
+} OMXLiveLatencyAction;
+
+typedef struct OMXLiveLatencyConfig
+{
+  double target;        // fifo to hold, s
+  double target_max;    // every underrun doubles the target up to this, s
+  double kp;            // ratio per s of latency error
+  double ki;            // ratio per s of error and s it lasted
+  double max_ratio;     // largest |ratio - 1|
+  double ratio_step;    // resolution of the clock speed, 0 for none
+  double filter;        // time constant of the latency filter, s
+  double pause_level;   // pause when the fifo stays under this...
+  double pause_hold;    // ...for this long, s
+  double resume_level;  // resume once the fifo is back to this part of the target
+} OMXLiveLatencyConfig;
+
+typedef struct OMXLiveLatencyStats
+{
+  double   target;        // s, raised by underruns up to target_max
+  double   measured;      // filtered fifo, s
+  double   latency;       // fifo at the last Update(), s
+  double   error_avg;     // mean |measured - target| while playing, s
+  double   error_max;
+  double   ratio;         // controller output before it is quantised
+  double   applied;       // speed factor for the clock
+  double   integral;      // part of the ratio from the integral term
+  uint64_t updates;
+  uint64_t underruns;     // times the fifo ran dry after playback started
+  uint64_t resumes;
+  uint64_t ratio_changes; // times the applied ratio moved
+  double   paused_time;   // spent paused by underruns, s
+  bool     paused;
+} OMXLiveLatencyStats;
+
+// Holds the fifo of a live stream, and with it the latency from the source to
+// the screen, on a target by playing slightly faster or slower.
+//
+// A PI controller turns the filtered error into a resample ratio. The ratio
+// is bounded by max_ratio, the integral only runs while that bound leaves it
+// room so it doesn't wind up through a burst, and the ratio handed out moves
+// in ratio_step steps with some hysteresis so the clock isn't touched on every
+// call. When the fifo stays under pause_level the clock is paused until it has
+// refilled to the target, or until the input can't take more.
+//
+// Update() is called from the player's engine thread, the rest from any.
+// StartTrace() records every Update() for tools/live-latency-replay.
+class OMXLiveLatency
+{
+public:
+  OMXLiveLatency();
+  ~OMXLiveLatency();
+
+  static OMXLiveLatencyConfig Defaults();
+
+  void SetConfig(const OMXLiveLatencyConfig &config);
+  OMXLiveLatencyConfig GetConfig();
+  // forget the fifo and the ratio, for a newly opened stream
+  void Reset();
+
+  // now is the host time, media the clock's media time and latency the fifo,
+  // all in s. paused is the clock's state, blocked says the input is full or
+  // at its end
+  OMXLiveLatencyAction Update(double now, double media, double latency, bool paused, bool blocked);
+  // speed factor to run the clock at
+  double GetRatio();
+
+  OMXLiveLatencyStats GetStats();
+  void ResetStats();
+
+  bool StartTrace(const std::string &path);
+  void StopTrace();
+
+private:
+  pthread_mutex_t      m_lock;
+  OMXLiveLatencyConfig m_config;
+  double   m_target;
+  double   m_measured;
+  bool     m_have_measured;
+  double   m_integral;
+  double   m_ratio;
+  double   m_applied;
+  double   m_last_time;
+  double   m_low_time;
+  bool     m_started;
+  bool     m_underrun;
+  double   m_error_sum;
+  uint64_t m_error_count;
+  FILE    *m_trace;
+  OMXLiveLatencyStats m_stats;
+};
@@ -0,0 +1,668 @@
+#include "OMXNetSync.h"
+#include "OMXClock.h"
+
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <algorithm>
+
+#define OMX_NET_SYNC_MAGIC        0x4f4d5853 // OMXS
+#define OMX_NET_SYNC_VERSION      2
+#define OMX_NET_SYNC_BEACON       1
+#define OMX_NET_SYNC_REQUEST      2
+#define OMX_NET_SYNC_RESPONSE     3
+#define OMX_NET_SYNC_PACKET_SIZE  60
+
+// the quickest offset measurement of every 2s is kept, for about a minute
+#define OMX_NET_SYNC_BUCKET_US    2000000.0
+#define OMX_NET_SYNC_BUCKETS      32
+// the skew is only fitted over measurements spanning at least this
+#define OMX_NET_SYNC_SKEW_SPAN_US 10000000.0
+#define OMX_NET_SYNC_MAX_SKEW     0.0005
+// a response later than this belongs to an exchange we gave up on
+#define OMX_NET_SYNC_STALE_US     1000000.0
+// no beacon for this long and the follower plays on its own
+#define OMX_NET_SYNC_TIMEOUT_US   2000000.0
+// after asking for a seek, give the player this long before asking again
+#define OMX_NET_SYNC_HOLDOFF_US   3000000.0
+
+static int64_t CurrentHostCounter(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return( ((int64_t)now.tv_sec * 1000000000L) + now.tv_nsec );
+}
+
+// fields go out big endian, whatever the hosts are
+static uint8_t *Put16(uint8_t *p, uint16_t v) { v = htobe16(v); memcpy(p, &v, 2); return p + 2; }
+static uint8_t *Put32(uint8_t *p, uint32_t v) { v = htobe32(v); memcpy(p, &v, 4); return p + 4; }
+static uint8_t *Put64(uint8_t *p, int64_t v)  { uint64_t u = htobe64((uint64_t)v); memcpy(p, &u, 8); return p + 8; }
+static const uint8_t *Get16(const uint8_t *p, uint16_t &v) { memcpy(&v, p, 2); v = be16toh(v); return p + 2; }
+static const uint8_t *Get32(const uint8_t *p, uint32_t &v) { memcpy(&v, p, 4); v = be32toh(v); return p + 4; }
+static const uint8_t *Get64(const uint8_t *p, int64_t &v)  { uint64_t u; memcpy(&u, p, 8); v = (int64_t)be64toh(u); return p + 8; }
+
+// a nonblocking UDP socket on port, any port for 0
+static int OpenSocket(int port, bool shared)
+{
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if(fd < 0)
+    return -1;
+
+  int on = 1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if((shared && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0) ||
+     setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on)) != 0 ||
+     bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+     fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+OMXNetSync::OMXNetSync()
+{
+  m_running = false;
+  m_stop = false;
+  m_leader = false;
+  m_socket = -1;
+  m_request_socket = -1;
+  m_seed = (unsigned int)CurrentHostCounter();
+  memset(&m_faults, 0, sizeof(m_faults));
+  m_seek_us = OMX_NET_SYNC_SEEK_US;
+  m_follower.SetSnapThreshold(OMX_CLOCK_GROUP_SNAP_US);
+  pthread_mutex_init(&m_lock, NULL);
+  Stop();
+  ResetStats();
+}
+
+OMXNetSync::~OMXNetSync()
+{
+  Stop();
+  pthread_mutex_destroy(&m_lock);
+}
+
+double OMXNetSync::Now()
+{
+  double now = (double)(CurrentHostCounter() / 1000);
+  return now + now * m_faults.skew_ppm * 1e-6;
+}
+
+void OMXNetSync::SetFaults(const OMXNetSyncFaults &faults)
+{
+  pthread_mutex_lock(&m_lock);
+  m_faults = faults;
+  pthread_mutex_unlock(&m_lock);
+}
+
+void OMXNetSync::SetSeekThreshold(double us)
+{
+  pthread_mutex_lock(&m_lock);
+  m_seek_us = us;
+  pthread_mutex_unlock(&m_lock);
+}
+
+bool OMXNetSync::StartLeader(const std::string &address, int port)
+{
+  return Start(true, address, port);
+}
+
+bool OMXNetSync::StartFollower(const std::string &address, int port)
+{
+  return Start(false, address, port);
+}
+
+bool OMXNetSync::Start(bool leader, const std::string &address, int port)
+{
+  Stop();
+
+  memset(&m_address, 0, sizeof(m_address));
+  m_address.sin_family = AF_INET;
+  m_address.sin_port = htons(port);
+  if(!inet_aton(address.c_str(), &m_address.sin_addr))
+  {
+    CLog::Log(LOGERROR, "OMXNetSync::Start bad address %s", address.c_str());
+    return false;
+  }
+  bool multicast = IN_MULTICAST(ntohl(m_address.sin_addr.s_addr));
+
+  bool ok;
+  if(leader)
+  {
+    // followers answer to wherever the beacons come from
+    unsigned char ttl = 1;
+    unsigned char loop = 1;
+    m_socket = OpenSocket(0, false);
+    ok = m_socket >= 0 &&
+         (!multicast ||
+          (setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) == 0 &&
+           setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) == 0));
+  }
+  else
+  {
+    // several followers on one host share the beacon port, their requests
+    // go out on a socket of their own so the answers come back to them
+    m_socket = OpenSocket(port, true);
+    m_request_socket = OpenSocket(0, false);
+    ok = m_socket >= 0 && m_request_socket >= 0;
+    if(ok && multicast)
+    {
+      struct ip_mreq mreq;
+      mreq.imr_multiaddr = m_address.sin_addr;
+      mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+      ok = setsockopt(m_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) == 0;
+    }
+  }
+  if(!ok)
+  {
+    CLog::Log(LOGERROR, "OMXNetSync::Start %s %s:%d failed %s", leader ? "leader" : "follower",
+              address.c_str(), port, strerror(errno));
+    CloseSockets();
+    return false;
+  }
+
+  m_leader = leader;
+  m_stop = false;
+  m_next_beacon = m_next_request = Now();
+  if(pthread_create(&m_thread, NULL, Run, this) != 0)
+  {
+    CLog::Log(LOGERROR, "OMXNetSync::Start could not create thread");
+    CloseSockets();
+    return false;
+  }
+  m_running = true;
+
+  CLog::Log(LOGINFO, "OMXNetSync::Start %s on %s:%d", leader ? "leader" : "follower", address.c_str(), port);
+  return true;
+}
+
+void OMXNetSync::Stop()
+{
+  if(m_running)
+  {
+    m_stop = true;
+    pthread_join(m_thread, NULL);
+    m_running = false;
+  }
+  CloseSockets();
+
+  pthread_mutex_lock(&m_lock);
+  m_pending.clear();
+  m_have_leader = false;
+  m_have_state = false;
+  m_media = m_host = m_speed = 0.0;
+  m_item = 0;
+  m_generation = 0;
+  m_seq = 0;
+  m_have_beacon = false;
+  memset(&m_beacon, 0, sizeof(m_beacon));
+  m_beacon_speed = 0.0;
+  m_beacon_time = 0.0;
+  m_last_seq = 0;
+  m_samples.clear();
+  m_bucket_start = 0.0;
+  m_have_offset = false;
+  m_offset = m_offset_time = m_skew = m_delay = 0.0;
+  m_applied_generation = 0;
+  m_seek_holdoff = 0.0;
+  m_seek_pending = false;
+  m_follower.Restart();
+  pthread_mutex_unlock(&m_lock);
+}
+
+void OMXNetSync::CloseSockets()
+{
+  if(m_socket >= 0)
+    close(m_socket);
+  if(m_request_socket >= 0)
+    close(m_request_socket);
+  m_socket = -1;
+  m_request_socket = -1;
+}
+
+void *OMXNetSync::Run(void *arg)
+{
+  ((OMXNetSync *)arg)->Process();
+  return NULL;
+}
+
+void OMXNetSync::Process()
+{
+  while(!m_stop)
+  {
+    pthread_mutex_lock(&m_lock);
+    double now = Now();
+    double next = now + 10000.0;
+
+    if(m_leader && m_have_state && now >= m_next_beacon)
+    {
+      Packet packet;
+      memset(&packet, 0, sizeof(packet));
+      packet.type = OMX_NET_SYNC_BEACON;
+      packet.seq = ++m_seq;
+      packet.generation = m_generation;
+      packet.item = m_item;
+      packet.media = (int64_t)m_media;
+      packet.speed = (int64_t)(m_speed * 1000000.0);
+      packet.t1 = (int64_t)m_host;
+      Send(packet, m_address, now);
+      m_stats.beacons_sent++;
+      m_next_beacon = now + OMX_NET_SYNC_BEACON_MS * 1000.0;
+    }
+    if(!m_leader && m_have_leader && now >= m_next_request)
+    {
+      Packet packet;
+      memset(&packet, 0, sizeof(packet));
+      packet.type = OMX_NET_SYNC_REQUEST;
+      Send(packet, m_leader_addr, now);
+      m_stats.requests++;
+      m_next_request = now + OMX_NET_SYNC_REQUEST_MS * 1000.0;
+    }
+    Flush(now);
+
+    if(m_leader && m_have_state)
+      next = std::min(next, m_next_beacon);
+    if(!m_leader && m_have_leader)
+      next = std::min(next, m_next_request);
+    for(size_t i = 0; i < m_pending.size(); i++)
+      next = std::min(next, m_pending[i].due);
+    pthread_mutex_unlock(&m_lock);
+
+    // the leader has no request socket, poll skips it
+    struct pollfd fds[2];
+    fds[0].fd = m_socket;
+    fds[1].fd = m_request_socket;
+    fds[0].events = fds[1].events = POLLIN;
+    fds[0].revents = fds[1].revents = 0;
+    int timeout = (int)ceil((next - now) / 1000.0);
+    if(poll(fds, 2, std::max(1, std::min(timeout, 10))) > 0)
+    {
+      pthread_mutex_lock(&m_lock);
+      for(int i = 0; i < 2; i++)
+      {
+        if(fds[i].revents & POLLIN)
+          Receive(fds[i].fd, Now());
+      }
+      pthread_mutex_unlock(&m_lock);
+    }
+  }
+}
+
+void OMXNetSync::Send(Packet &packet, const struct sockaddr_in &to, double now)
+{
+  // stamped as it leaves, the injected delay stands for the network's
+  if(packet.type == OMX_NET_SYNC_REQUEST)
+    packet.t1 = (int64_t)Now();
+  else if(packet.type == OMX_NET_SYNC_RESPONSE)
+    packet.t3 = (int64_t)Now();
+
+  if(m_faults.loss > 0.0f && (float)rand_r(&m_seed) / RAND_MAX < m_faults.loss)
+  {
+    m_stats.dropped++;
+    return;
+  }
+  double delay = m_faults.delay;
+  if(m_faults.jitter > 0.0)
+    delay += m_faults.jitter * rand_r(&m_seed) / RAND_MAX;
+  if(delay <= 0.0)
+  {
+    Transmit(packet, to);
+    return;
+  }
+
+  Pending pending;
+  pending.due = now + delay;
+  pending.packet = packet;
+  pending.to = to;
+  m_pending.push_back(pending);
+}
+
+void OMXNetSync::Flush(double now)
+{
+  // jitter lets later packets overtake earlier ones, like on a real network
+  for(size_t i = 0; i < m_pending.size();)
+  {
+    if(m_pending[i].due <= now)
+    {
+      Transmit(m_pending[i].packet, m_pending[i].to);
+      m_pending.erase(m_pending.begin() + i);
+    }
+    else
+      i++;
+  }
+}
+
+void OMXNetSync::Transmit(Packet &packet, const struct sockaddr_in &to)
+{
+  packet.magic = OMX_NET_SYNC_MAGIC;
+  packet.version = OMX_NET_SYNC_VERSION;
+
+  uint8_t buffer[OMX_NET_SYNC_PACKET_SIZE];
+  uint8_t *p = buffer;
+  p = Put32(p, packet.magic);
+  *p++ = packet.version;
+  *p++ = packet.type;
+  p = Put16(p, packet.reserved);
+  p = Put32(p, packet.seq);
+  p = Put32(p, packet.generation);
+  p = Put32(p, packet.item);
+  p = Put64(p, packet.media);
+  p = Put64(p, packet.speed);
+  p = Put64(p, packet.t1);
+  p = Put64(p, packet.t2);
+  p = Put64(p, packet.t3);
+
+  int fd = packet.type == OMX_NET_SYNC_REQUEST ? m_request_socket : m_socket;
+  if(sendto(fd, buffer, sizeof(buffer), 0, (const struct sockaddr *)&to, sizeof(to)) < 0)
+    CLog::Log(LOGDEBUG, "OMXNetSync::Transmit failed %s", strerror(errno));
+}
+
+void OMXNetSync::Receive(int fd, double now)
+{
+  uint8_t buffer[OMX_NET_SYNC_PACKET_SIZE];
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof(from);
+  ssize_t len;
+
+  while((len = recvfrom(fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &from_len)) >= 0)
+  {
+    from_len = sizeof(from);
+    if(len != OMX_NET_SYNC_PACKET_SIZE)
+      continue;
+
+    Packet packet;
+    const uint8_t *p = buffer;
+    p = Get32(p, packet.magic);
+    packet.version = *p++;
+    packet.type = *p++;
+    p = Get16(p, packet.reserved);
+    p = Get32(p, packet.seq);
+    p = Get32(p, packet.generation);
+    p = Get32(p, packet.item);
+    p = Get64(p, packet.media);
+    p = Get64(p, packet.speed);
+    p = Get64(p, packet.t1);
+    p = Get64(p, packet.t2);
+    p = Get64(p, packet.t3);
+    if(packet.magic != OMX_NET_SYNC_MAGIC || packet.version != OMX_NET_SYNC_VERSION)
+      continue;
+
+    if(m_leader && packet.type == OMX_NET_SYNC_REQUEST)
+    {
+      Packet response = packet;
+      response.type = OMX_NET_SYNC_RESPONSE;
+      response.t2 = (int64_t)now;
+      Send(response, from, now);
+    }
+    else if(!m_leader && packet.type == OMX_NET_SYNC_BEACON)
+    {
+      bool same_leader = m_have_leader &&
+                         from.sin_addr.s_addr == m_leader_addr.sin_addr.s_addr &&
+                         from.sin_port == m_leader_addr.sin_port;
+      if(same_leader && m_have_beacon && (int32_t)(packet.seq - m_last_seq) <= 0)
+      {
+        // overtaken by a newer one
+        continue;
+      }
+      if(!same_leader)
+      {
+        CLog::Log(LOGINFO, "OMXNetSync leader is %s:%d", inet_ntoa(from.sin_addr), ntohs(from.sin_port));
+        m_leader_addr = from;
+        m_have_leader = true;
+        m_have_offset = false;
+        m_samples.clear();
+        m_applied_generation = packet.generation;
+        m_next_request = now;
+      }
+      else if(m_have_beacon)
+        m_stats.beacons_lost += packet.seq - m_last_seq - 1;
+
+      m_beacon = packet;
+      m_beacon_speed = packet.speed / 1000000.0;
+      m_beacon_time = now;
+      m_last_seq = packet.seq;
+      m_have_beacon = true;
+      m_stats.beacons_received++;
+    }
+    else if(!m_leader && packet.type == OMX_NET_SYNC_RESPONSE)
+    {
+      if(now - packet.t1 > OMX_NET_SYNC_STALE_US || now < packet.t1 || packet.t3 < packet.t2)
+        continue;
+      m_stats.responses++;
+      AddSample(packet.t1, packet.t2, packet.t3, now);
+    }
+  }
+}
+
+void OMXNetSync::AddSample(double t1, double t2, double t3, double t4)
+{
+  Sample sample;
+  sample.time   = (t1 + t4) * 0.5;
+  sample.offset = ((t2 - t1) + (t3 - t4)) * 0.5;
+  sample.delay  = (t4 - t1) - (t3 - t2);
+
+  // the less an exchange was delayed the less asymmetric delay can be in its
+  // offset, so only the quickest of each bucket is kept
+  if(m_samples.empty() || sample.time - m_bucket_start >= OMX_NET_SYNC_BUCKET_US)
+  {
+    m_samples.push_back(sample);
+    m_bucket_start = sample.time;
+    if(m_samples.size() > OMX_NET_SYNC_BUCKETS)
+      m_samples.erase(m_samples.begin());
+  }
+  else if(sample.delay < m_samples.back().delay)
+    m_samples.back() = sample;
+  else if(m_have_offset)
+    return;
+
+  // and of those only the quicker half, leaving out congested stretches
+  size_t best = 0;
+  std::vector<double> delays;
+  for(size_t i = 0; i < m_samples.size(); i++)
+  {
+    if(m_samples[i].delay < m_samples[best].delay)
+      best = i;
+    delays.push_back(m_samples[i].delay);
+  }
+  size_t keep = std::min(delays.size(), std::max((size_t)4, delays.size() / 2));
+  std::nth_element(delays.begin(), delays.begin() + keep - 1, delays.end());
+  double limit = delays[keep - 1];
+
+  double n = 0.0, sum_t = 0.0, sum_o = 0.0;
+  for(size_t i = 0; i < m_samples.size(); i++)
+  {
+    if(m_samples[i].delay > limit)
+      continue;
+    n++;
+    sum_t += m_samples[i].time;
+    sum_o += m_samples[i].offset;
+  }
+  double mean_t = sum_t / n;
+  double mean_o = sum_o / n;
+
+  double skew = 0.0;
+  if(n >= 4 && m_samples.back().time - m_samples.front().time >= OMX_NET_SYNC_SKEW_SPAN_US)
+  {
+    // least squares through them
+    double sxx = 0.0, sxy = 0.0;
+    for(size_t i = 0; i < m_samples.size(); i++)
+    {
+      if(m_samples[i].delay > limit)
+        continue;
+      double dt = m_samples[i].time - mean_t;
+      sxx += dt * dt;
+      sxy += dt * (m_samples[i].offset - mean_o);
+    }
+    if(sxx > 0.0)
+      skew = std::max(-OMX_NET_SYNC_MAX_SKEW, std::min(OMX_NET_SYNC_MAX_SKEW, sxy / sxx));
+    m_offset = mean_o;
+    m_offset_time = mean_t;
+  }
+  else
+  {
+    m_offset = m_samples[best].offset;
+    m_offset_time = m_samples[best].time;
+  }
+  m_skew = skew;
+  m_delay = m_samples[best].delay;
+  m_have_offset = true;
+}
+
+double OMXNetSync::LeaderTime(double now)
+{
+  return now + m_offset + (now - m_offset_time) * m_skew;
+}
+
+float OMXNetSync::Sync(OMXClock *clock, double frame_time, double item_offset, uint32_t item)
+{
+  pthread_mutex_lock(&m_lock);
+  double now = Now();
+
+  if(m_leader)
+  {
+    double time = clock->OMXMediaTime();
+    double media = time - item_offset;
+    double speed = (double)clock->OMXPlaySpeed() / DVD_PLAYSPEED_NORMAL;
+    if(clock->OMXIsPaused() || speed < 0.0)
+      speed = 0.0;
+
+    if(time <= 0.0)
+    {
+      // not started, nothing to send
+      m_have_state = false;
+    }
+    else
+    {
+      // moving on to the next movie is no seek, the followers get there on
+      // their own
+      double predicted = m_media + (now - m_host) * m_speed;
+      if(!m_have_state || (item == m_item && fabs(media - predicted) > OMX_CLOCK_GROUP_SNAP_US))
+      {
+        m_generation++;
+        CLog::Log(LOGDEBUG, "OMXNetSync::Sync generation %u at %.0f of %08x", m_generation, media, item);
+      }
+      m_item = item;
+      m_media = media;
+      m_host = now;
+      m_speed = speed;
+      m_have_state = true;
+    }
+    pthread_mutex_unlock(&m_lock);
+    return 1.0f;
+  }
+
+  float speed = m_follower.GetStats().speed;
+  if(!m_have_beacon || !m_have_offset || now - m_beacon_time > OMX_NET_SYNC_TIMEOUT_US)
+  {
+    // play on our own until the leader is back
+    m_follower.Release(clock);
+    pthread_mutex_unlock(&m_lock);
+    return 1.0f;
+  }
+
+  if(m_beacon.item != item)
+  {
+    // between movies one of us got to the next one first, or we play
+    // different ones, their times have nothing to do with each other
+    m_applied_generation = m_beacon.generation;
+    m_follower.Release(clock);
+    pthread_mutex_unlock(&m_lock);
+    return 1.0f;
+  }
+
+  if(m_beacon.generation != m_applied_generation)
+  {
+    // the leader seeked, follow it there, the old smoothing is meaningless
+    CLog::Log(LOGDEBUG, "OMXNetSync::Sync leader generation %u, seeking", m_beacon.generation);
+    m_applied_generation = m_beacon.generation;
+    m_seek_pending = true;
+    m_seek_holdoff = now + OMX_NET_SYNC_HOLDOFF_US;
+    m_follower.Restart();
+    m_stats.seeks++;
+    pthread_mutex_unlock(&m_lock);
+    return speed;
+  }
+
+  int master_speed = (int)(m_beacon_speed * DVD_PLAYSPEED_NORMAL + 0.5);
+  if(clock->OMXIsPaused() || master_speed <= 0 || master_speed > 4*DVD_PLAYSPEED_NORMAL)
+  {
+    pthread_mutex_unlock(&m_lock);
+    return speed;
+  }
+
+  // the leader's position on our clock's timeline
+  double master_time = m_beacon.media + (LeaderTime(now) - m_beacon.t1) * m_beacon_speed + item_offset;
+  double time = clock->OMXMediaTime();
+  if(time > 0.0 && fabs(time - master_time) > m_seek_us)
+  {
+    if(!m_seek_pending && now >= m_seek_holdoff)
+    {
+      CLog::Log(LOGDEBUG, "OMXNetSync::Sync %.0fms off the leader, seeking", (time - master_time) / 1000.0);
+      m_seek_pending = true;
+      m_seek_holdoff = now + OMX_NET_SYNC_HOLDOFF_US;
+      m_follower.Restart();
+      m_stats.seeks++;
+    }
+    pthread_mutex_unlock(&m_lock);
+    return speed;
+  }
+
+  speed = m_follower.Steer(clock, master_time, master_speed, frame_time);
+  pthread_mutex_unlock(&m_lock);
+  return speed;
+}
+
+bool OMXNetSync::GetSeek(double &media_time)
+{
+  pthread_mutex_lock(&m_lock);
+  bool ret = m_seek_pending;
+  if(ret)
+  {
+    media_time = m_beacon.media + (LeaderTime(Now()) - m_beacon.t1) * m_beacon_speed;
+    m_seek_pending = false;
+  }
+  pthread_mutex_unlock(&m_lock);
+  return ret;
+}
+
+OMXNetSyncStats OMXNetSync::GetStats()
+{
+  pthread_mutex_lock(&m_lock);
+  OMXNetSyncStats stats = m_stats;
+  stats.leader       = m_leader;
+  stats.synced       = !m_leader && m_have_beacon && m_have_offset;
+  stats.generation   = m_leader ? m_generation : m_beacon.generation;
+  stats.item         = m_leader ? m_item : m_beacon.item;
+  double now = Now();
+  stats.offset       = m_have_offset ? LeaderTime(now) - now : 0.0;
+  stats.skew         = m_skew * 1000000.0;
+  stats.delay        = m_delay;
+  stats.leader_media = m_leader ? m_media : (double)m_beacon.media;
+  stats.leader_host  = m_leader ? m_host : (double)m_beacon.t1;
+  stats.leader_speed = m_leader ? m_speed : m_beacon_speed;
+  stats.follower     = m_follower.GetStats();
+  pthread_mutex_unlock(&m_lock);
+  return stats;
+}
+
+void OMXNetSync::ResetStats()
+{
+  pthread_mutex_lock(&m_lock);
+  memset(&m_stats, 0, sizeof(m_stats));
+  // lock times are measured on the clock's host time, not ours
+  m_follower.ResetStats((double)(CurrentHostCounter() / 1000));
+  pthread_mutex_unlock(&m_lock);
+}
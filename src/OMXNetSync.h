@@ -0,0 +1,192 @@
+#pragma once
+
+#include "OMXClockGroup.h"
+
+#include <stdint.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <atomic>
+#include <deque>
+#include <string>
+#include <vector>
+
+class OMXClock;
+
+#define OMX_NET_SYNC_ADDRESS      "239.255.50.50"
+#define OMX_NET_SYNC_PORT         50550
+// how often the leader sends its clock and a follower measures the offset
+#define OMX_NET_SYNC_BEACON_MS    100
+#define OMX_NET_SYNC_REQUEST_MS   200
+// drift beyond this makes the follower seek instead of catching up
+#define OMX_NET_SYNC_SEEK_US      2000000.0
+
+// Packet loss and delay added to everything this node sends, and an error
+// on its host clock, to try the sync on a single machine
+typedef struct OMXNetSyncFaults
+{
+  float  loss;      // fraction of packets dropped, 0..1
+  double delay;     // added to every packet, us
+  double jitter;    // random extra delay up to this, us
+  double skew_ppm;  // how much faster this node's host clock runs
+} OMXNetSyncFaults;
+
+typedef struct OMXNetSyncStats
+{
+  bool     leader;
+  bool     synced;            // follower has heard the leader and knows the offset
+  uint32_t generation;        // leader's seek generation, bumped on every seek or loop
+  uint32_t item;              // the movie the leader plays, see Sync()
+  uint64_t beacons_sent;
+  uint64_t beacons_received;
+  uint64_t beacons_lost;      // gaps in the beacon sequence
+  uint64_t requests;          // offset measurements sent
+  uint64_t responses;         // and answered in time
+  uint64_t dropped;           // packets dropped by the fault injection
+  uint64_t seeks;             // seeks requested from the follower's player
+  double   offset;            // leader host time minus ours, us
+  double   skew;              // ppm the leader's host clock runs faster than ours
+  double   delay;             // round trip of the best recent measurement, us
+  double   leader_media;      // last beacon: leader media time within its movie, us
+  double   leader_host;       // at this leader host time
+  double   leader_speed;      // 1.0 is normal play, 0 when paused
+  OMXClockGroupMemberStats follower;
+} OMXNetSyncStats;
+
+// Keeps players on several hosts on the media time of a leader, e.g. the Pis
+// of a video wall each drawing their slice with drawCropped().
+//
+// The leader sends a beacon with its media time within the movie it plays, an
+// id of that movie, the host time it was taken at, its speed and a seek
+// generation every OMX_NET_SYNC_BEACON_MS, by
+// default to a multicast group so every follower on the network and on the
+// same host hears it. Followers measure the offset to the leader's host clock
+// NTP-style with a request/response exchange, keep the least delayed
+// measurements and fit the skew through them. With that they know the
+// leader's media time at any moment and steer onto it with an
+// OMXClockFollower, like the players of an OMXClockGroup, as long as they
+// play the same movie. When they are more than the seek threshold off, or the
+// leader seeked, GetSeek() hands the player a position to seek to.
+//
+// Sync() and GetSeek() are called from the player's engine thread, the
+// network runs on a thread of its own.
+class OMXNetSync
+{
+public:
+  OMXNetSync();
+  ~OMXNetSync();
+
+  // address is a multicast group, a broadcast or a unicast address the
+  // followers listen on
+  bool StartLeader(const std::string &address = OMX_NET_SYNC_ADDRESS, int port = OMX_NET_SYNC_PORT);
+  bool StartFollower(const std::string &address = OMX_NET_SYNC_ADDRESS, int port = OMX_NET_SYNC_PORT);
+  void Stop();
+  bool IsRunning() { return m_running; }
+  bool IsLeader() { return m_leader; }
+
+  void SetFaults(const OMXNetSyncFaults &faults);
+  void SetSeekThreshold(double us);
+
+  // leader: take the clock's time for the next beacon. follower: steer the
+  // clock onto the leader. item_offset is how far the clock is ahead of the
+  // position in the current movie, e.g. after gapless playlist splices, and
+  // item tells the movies apart the same way on every host. returns the speed
+  // factor applied
+  float Sync(OMXClock *clock, double frame_time, double item_offset = 0.0, uint32_t item = 0);
+  // follower: true once for each seek it needs, media_time is where the
+  // leader is now within the movie
+  bool GetSeek(double &media_time);
+
+  OMXNetSyncStats GetStats();
+  void ResetStats();
+
+  // host time in the sync's time base, us
+  double Now();
+
+private:
+  struct Packet
+  {
+    uint32_t magic;
+    uint8_t  version;
+    uint8_t  type;
+    uint16_t reserved;
+    uint32_t seq;
+    uint32_t generation;
+    uint32_t item;
+    int64_t  media;   // within the item
+    int64_t  speed;   // play speed in millionths
+    int64_t  t1;      // beacon: host time of media. request/response: sent
+    int64_t  t2;      // response: request received
+    int64_t  t3;      // response: sent
+  };
+
+  struct Pending
+  {
+    double             due;
+    Packet             packet;
+    struct sockaddr_in to;
+  };
+
+  struct Sample
+  {
+    double time;      // our host time halfway through the exchange
+    double offset;
+    double delay;
+  };
+
+  bool Start(bool leader, const std::string &address, int port);
+  static void *Run(void *arg);
+  void Process();
+  void CloseSockets();
+  void Receive(int fd, double now);
+  void Send(Packet &packet, const struct sockaddr_in &to, double now);
+  void Transmit(Packet &packet, const struct sockaddr_in &to);
+  void Flush(double now);
+  void AddSample(double t1, double t2, double t3, double t4);
+  double LeaderTime(double now);
+
+  pthread_t          m_thread;
+  pthread_mutex_t    m_lock;
+  std::atomic<bool>  m_running;
+  std::atomic<bool>  m_stop;
+  bool               m_leader;
+  int                m_socket;         // beacons
+  int                m_request_socket; // follower's offset measurements
+  struct sockaddr_in m_address;     // where beacons go
+  struct sockaddr_in m_leader_addr; // where requests go, learned from the beacons
+  bool               m_have_leader;
+  unsigned int       m_seed;
+  OMXNetSyncFaults   m_faults;
+  std::deque<Pending> m_pending;
+
+  // leader, written by Sync()
+  bool     m_have_state;
+  double   m_media;
+  double   m_host;
+  double   m_speed;
+  uint32_t m_item;
+  uint32_t m_generation;
+  uint32_t m_seq;
+
+  // follower
+  bool     m_have_beacon;
+  Packet   m_beacon;
+  double   m_beacon_speed;
+  double   m_beacon_time;   // our host time it arrived at
+  uint32_t m_last_seq;
+  std::vector<Sample> m_samples;     // quickest exchange of each bucket
+  double   m_bucket_start;
+  bool     m_have_offset;
+  double   m_offset;
+  double   m_offset_time;
+  double   m_skew;
+  double   m_delay;
+  uint32_t m_applied_generation;
+  double   m_seek_us;
+  double   m_seek_holdoff;
+  bool     m_seek_pending;
+  OMXClockFollower m_follower;
+
+  double   m_next_beacon;
+  double   m_next_request;
+  OMXNetSyncStats m_stats;
+};
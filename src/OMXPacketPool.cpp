@@ -0,0 +1,315 @@
+#include "OMXPacketPool.h"
+#include "OMXReader.h"
+#include "OMXClock.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// payload starts on a 16 byte boundary right after the packet header
+#define OMX_PACKET_HEADER_SIZE ((sizeof(OMXPacket) + 15) & ~(size_t)15)
+
+pthread_mutex_t OMXPacketPool::s_avcodec_lock = PTHREAD_MUTEX_INITIALIZER;
+int             OMXPacketPool::s_avcodec_users = 0;
+
+OMXPacketPool::OMXPacketPool()
+{
+  Init();
+}
+
+OMXPacketPool::OMXPacketPool(unsigned int block_size, unsigned int count)
+{
+  Init();
+  m_block_size = block_size;
+
+  // all of them in class 0, in the free list from the start
+  for(unsigned int i = 0; i < count; i++)
+  {
+    OMXPacket *pkt = NewBlock(this, 0, block_size);
+    if(!pkt)
+      break;
+    pkt->pool_next = m_free[0];
+    m_free[0] = pkt;
+    m_bytes_held += block_size;
+    m_blocks.push_back((uint8_t *)pkt + OMX_PACKET_HEADER_SIZE);
+  }
+}
+
+void OMXPacketPool::Init()
+{
+  for(int i = 0; i <= OMX_PACKET_POOL_CLASSES; i++)
+  {
+    m_free[i] = NULL;
+    m_returned[i] = NULL;
+  }
+  ResetStats();
+  m_bytes_held = 0;
+  m_bytes_in_use = 0;
+  m_refs = 1;
+  m_block_size = 0;
+  pthread_mutex_init(&m_fixed_lock, NULL);
+
+  pthread_mutex_lock(&s_avcodec_lock);
+  if(s_avcodec_users++ == 0)
+    AvCodec().Load();
+  pthread_mutex_unlock(&s_avcodec_lock);
+}
+
+// only once the owner and every packet let go
+OMXPacketPool::~OMXPacketPool()
+{
+  if(m_block_size)
+  {
+    for(size_t i = 0; i < m_blocks.size(); i++)
+      FreeBlock((OMXPacket *)(m_blocks[i] - OMX_PACKET_HEADER_SIZE));
+  }
+  else
+    Trim();
+  pthread_mutex_destroy(&m_fixed_lock);
+
+  pthread_mutex_lock(&s_avcodec_lock);
+  if(--s_avcodec_users == 0)
+    AvCodec().Unload();
+  pthread_mutex_unlock(&s_avcodec_lock);
+}
+
+void OMXPacketPool::Ref()
+{
+  m_refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void OMXPacketPool::Unref()
+{
+  if(m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    delete this;
+}
+
+// constructed on first use, pools can be members of static objects
+DllAvCodec &OMXPacketPool::AvCodec()
+{
+  static DllAvCodec dll;
+  return dll;
+}
+
+int OMXPacketPool::SizeClass(int size)
+{
+  for(int i = 0; i < OMX_PACKET_POOL_CLASSES; i++)
+  {
+    if(size <= (1 << (OMX_PACKET_POOL_MIN_SHIFT + i)))
+      return i;
+  }
+  return -1;
+}
+
+OMXPacket *OMXPacketPool::NewBlock(OMXPacketPool *pool, int size_class, unsigned int capacity)
+{
+  void *block = NULL;
+  size_t payload = size_class == OMX_PACKET_POOL_ADOPT_CLASS ? 0 : capacity + AV_INPUT_BUFFER_PADDING_SIZE;
+  if(posix_memalign(&block, 16, OMX_PACKET_HEADER_SIZE + payload) != 0)
+    return NULL;
+
+  OMXPacket *pkt = (OMXPacket *)block;
+  memset(pkt, 0, sizeof(OMXPacket));
+  pkt->capacity   = capacity;
+  pkt->pool       = pool;
+  pkt->pool_class = size_class;
+  return pkt;
+}
+
+void OMXPacketPool::FreeBlock(OMXPacket *pkt)
+{
+  free(pkt);
+}
+
+// a block of size_class from the free lists, or a new one. Resets everything
+// but the pool bookkeeping, data is left NULL
+OMXPacket *OMXPacketPool::Take(int size_class, unsigned int capacity)
+{
+  OMXPacket *pkt = NULL;
+
+  if(size_class < 0)
+  {
+    pkt = NewBlock(this, -1, capacity);
+    m_oversized++;
+  }
+  else
+  {
+    // a fixed pool is shared by the readers, the free list needs the lock
+    if(m_block_size)
+      pthread_mutex_lock(&m_fixed_lock);
+
+    if(!m_free[size_class])
+      m_free[size_class] = m_returned[size_class].exchange(NULL, std::memory_order_acquire);
+
+    pkt = m_free[size_class];
+    if(pkt)
+    {
+      m_free[size_class] = pkt->pool_next;
+      m_bytes_held -= pkt->capacity;
+      m_hits++;
+    }
+    else
+    {
+      pkt = m_block_size ? NULL : NewBlock(this, size_class, capacity);
+      m_misses++;
+    }
+
+    if(m_block_size)
+      pthread_mutex_unlock(&m_fixed_lock);
+  }
+
+  if(!pkt)
+    return NULL;
+
+  // every packet out keeps the pool alive
+  Ref();
+  m_allocs++;
+  m_bytes_in_use += pkt->capacity;
+
+  capacity = pkt->capacity;
+  memset(pkt, 0, sizeof(OMXPacket));
+  pkt->capacity   = capacity;
+  pkt->pool       = this;
+  pkt->pool_class = size_class;
+  pkt->dts        = DVD_NOPTS_VALUE;
+  pkt->pts        = DVD_NOPTS_VALUE;
+  pkt->now        = DVD_NOPTS_VALUE;
+  pkt->duration   = DVD_NOPTS_VALUE;
+
+  return pkt;
+}
+
+OMXPacket *OMXPacketPool::Alloc(int size)
+{
+  if(size < 0)
+    return NULL;
+
+  if(m_block_size)
+  {
+    if((unsigned int)size > m_block_size)
+      return NULL;
+    OMXPacket *pkt = Take(0, m_block_size);
+    if(!pkt)
+      return NULL;
+    pkt->data = (uint8_t *)pkt + OMX_PACKET_HEADER_SIZE;
+    memset(pkt->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    pkt->size = size;
+    return pkt;
+  }
+
+  int size_class = SizeClass(size);
+  OMXPacket *pkt = Take(size_class, size_class < 0 ? size : 1 << (OMX_PACKET_POOL_MIN_SHIFT + size_class));
+  if(!pkt)
+    return NULL;
+
+  pkt->data = (uint8_t *)pkt + OMX_PACKET_HEADER_SIZE;
+  memset(pkt->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+  pkt->size = size;
+
+  return pkt;
+}
+
+OMXPacket *OMXPacketPool::AllocAdopted()
+{
+  if(m_block_size)
+    return NULL;
+  return Take(OMX_PACKET_POOL_ADOPT_CLASS, 0);
+}
+
+void OMXPacketPool::Return(OMXPacket *pkt)
+{
+  m_bytes_in_use -= pkt->capacity;
+
+  if(!m_block_size && (pkt->pool_class < 0 || m_bytes_held + pkt->capacity > OMX_PACKET_POOL_MAX_HELD))
+  {
+    FreeBlock(pkt);
+    Unref();
+    return;
+  }
+
+  m_bytes_held += pkt->capacity;
+
+  std::atomic<OMXPacket *> &head = m_returned[pkt->pool_class];
+  OMXPacket *next = head.load(std::memory_order_relaxed);
+  do
+  {
+    pkt->pool_next = next;
+  } while(!head.compare_exchange_weak(next, pkt, std::memory_order_release, std::memory_order_relaxed));
+
+  Unref();
+}
+
+void OMXPacketPool::Release(OMXPacket *pkt)
+{
+  if(!pkt)
+    return;
+
+  // only the pool hands out adopted packets, see OMXReader::Read
+  if(pkt->adopted && pkt->pool)
+  {
+    AvCodec().av_packet_unref(&pkt->avpkt);
+    pkt->adopted = false;
+    pkt->data    = NULL;
+  }
+
+  if(pkt->pool)
+  {
+    pkt->pool->Return(pkt);
+    return;
+  }
+
+  // packet from OMXReader::AllocPacket
+  if(pkt->data)
+    free(pkt->data);
+  free(pkt);
+}
+
+void OMXPacketPool::Trim()
+{
+  // the blocks of a fixed pool are registered, they stay until it goes
+  if(m_block_size)
+    return;
+
+  for(int i = 0; i <= OMX_PACKET_POOL_CLASSES; i++)
+  {
+    OMXPacket *lists[2] = { m_free[i], m_returned[i].exchange(NULL, std::memory_order_acquire) };
+    m_free[i] = NULL;
+
+    for(int j = 0; j < 2; j++)
+    {
+      OMXPacket *pkt = lists[j];
+      while(pkt)
+      {
+        OMXPacket *next = pkt->pool_next;
+        m_bytes_held -= pkt->capacity;
+        FreeBlock(pkt);
+        pkt = next;
+      }
+    }
+  }
+}
+
+OMXPacketPoolStats OMXPacketPool::GetStats() const
+{
+  OMXPacketPoolStats stats;
+  stats.allocs       = m_allocs;
+  stats.hits         = m_hits;
+  stats.misses       = m_misses;
+  stats.oversized    = m_oversized;
+  stats.bytes_held   = m_bytes_held > 0 ? m_bytes_held.load() : 0;
+  stats.bytes_in_use = m_bytes_in_use > 0 ? m_bytes_in_use.load() : 0;
+  return stats;
+}
+
+double OMXPacketPool::GetHitRate() const
+{
+  uint64_t allocs = m_allocs;
+  return allocs ? (double)m_hits / allocs : 0.0;
+}
+
+void OMXPacketPool::ResetStats()
+{
+  m_allocs    = 0;
+  m_hits      = 0;
+  m_misses    = 0;
+  m_oversized = 0;
+}
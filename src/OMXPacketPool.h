@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+
+#include "DllAvCodec.h"
+
+struct OMXPacket;
+
+// size classes are powers of two, 1 KB .. 8 MB. anything larger bypasses the pool
+#define OMX_PACKET_POOL_MIN_SHIFT   10
+#define OMX_PACKET_POOL_CLASSES     14
+// headers without a payload, for packets that adopt the demuxer's buffer
+#define OMX_PACKET_POOL_ADOPT_CLASS OMX_PACKET_POOL_CLASSES
+// upper bound for memory kept around in the free lists of one pool
+#define OMX_PACKET_POOL_MAX_HELD    (32 * 1024 * 1024)
+
+typedef struct OMXPacketPoolStats
+{
+  uint64_t allocs;      // packets handed out
+  uint64_t hits;        // served from a free list
+  uint64_t misses;      // needed a fresh heap allocation, or a fixed pool had none left
+  uint64_t oversized;   // larger than the biggest size class
+  uint64_t bytes_held;  // bytes sitting in the free lists
+  uint64_t bytes_in_use;// bytes owned by packets currently in flight
+} OMXPacketPoolStats;
+
+// Size-classed packet arena owned by OMXReader.
+//
+// Alloc() is only called from the thread that demuxes, i.e. the one running
+// OMXReader::Read(), or the read-ahead thread when prefetching. Release()
+// may be called from any thread (the OMXPlayerVideo/OMXPlayerAudio decode
+// threads, the engine thread) and pushes the block onto a per class lock-free
+// return stack, which Alloc() takes over in one exchange once its private free
+// list runs dry. Because only a single thread ever pops, the stack is ABA safe.
+//
+// The pool is reference counted: its owner holds one reference and every
+// packet out of it another, so a packet can still be released after the
+// reader that demuxed it is gone. Owners drop theirs with Unref(). Adopted
+// packets are unreferenced through one libavcodec handle shared by all pools.
+//
+// A pool made with a block size and count is fixed. It allocates its blocks
+// up front and never more, for memory registered with a component once, see
+// COMXCoreComponent::AllocInputBuffers(). Alloc() returns NULL while they are
+// all out and may be called from several threads.
+class OMXPacketPool
+{
+public:
+  OMXPacketPool();
+  OMXPacketPool(unsigned int block_size, unsigned int count);
+
+  void Ref();
+  void Unref();
+
+  OMXPacket *Alloc(int size);
+  // header only, the caller points data at an AVPacket it references
+  OMXPacket *AllocAdopted();
+  static void Release(OMXPacket *pkt);
+
+  // drop everything in the free lists, only call from the Alloc() thread
+  void Trim();
+
+  // fixed pools: the payload of every block
+  unsigned int GetBlockSize() const { return m_block_size; };
+  const std::vector<uint8_t *> &GetBlocks() const { return m_blocks; };
+
+  OMXPacketPoolStats GetStats() const;
+  double GetHitRate() const;
+  void ResetStats();
+
+private:
+  ~OMXPacketPool();
+  void Init();
+  static int SizeClass(int size);
+  static OMXPacket *NewBlock(OMXPacketPool *pool, int size_class, unsigned int capacity);
+  static void FreeBlock(OMXPacket *pkt);
+  static DllAvCodec &AvCodec();
+  OMXPacket *Take(int size_class, unsigned int capacity);
+  void Return(OMXPacket *pkt);
+
+  static pthread_mutex_t     s_avcodec_lock;
+  static int                 s_avcodec_users;
+
+  std::atomic<int>           m_refs;
+  unsigned int               m_block_size;   // fixed pools only
+  std::vector<uint8_t *>     m_blocks;
+  pthread_mutex_t            m_fixed_lock;
+
+  OMXPacket                 *m_free[OMX_PACKET_POOL_CLASSES + 1];
+  std::atomic<OMXPacket *>   m_returned[OMX_PACKET_POOL_CLASSES + 1];
+
+  std::atomic<uint64_t>      m_allocs;
+  std::atomic<uint64_t>      m_hits;
+  std::atomic<uint64_t>      m_misses;
+  std::atomic<uint64_t>      m_oversized;
+  std::atomic<int64_t>       m_bytes_held;
+  std::atomic<int64_t>       m_bytes_in_use;
+};
@@ -0,0 +1,197 @@
+#include "OMXPacketQueue.h"
+
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static inline void futex_wait(std::atomic<int> *addr, int val, const struct timespec *timeout = NULL)
+{
+  syscall(SYS_futex, (int *)addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+static inline void futex_wake(std::atomic<int> *addr)
+{
+  syscall(SYS_futex, (int *)addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+static inline int64_t monotonic_us()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+OMXPacketQueue::OMXPacketQueue()
+{
+  for(int i = 0; i < OMX_PACKET_QUEUE_SLOTS; i++)
+  {
+    m_slots[i].pkt  = NULL;
+    m_slots[i].size = 0;
+  }
+
+  m_head          = 0;
+  m_tail          = 0;
+  m_bytes         = 0;
+  m_max_bytes     = 0;
+  m_seq           = 0;
+  m_waiting       = 0;
+  m_abort         = false;
+  m_space_seq     = 0;
+  m_space_waiting = 0;
+  ResetStats();
+}
+
+OMXPacketQueue::~OMXPacketQueue()
+{
+}
+
+bool OMXPacketQueue::Push(OMXPacket *pkt, int size)
+{
+  if(!pkt)
+    return false;
+
+  if(!HasSpace(size))
+  {
+    m_rejected++;
+    return false;
+  }
+
+  uint32_t tail = m_tail.load(std::memory_order_relaxed);
+
+  Slot &slot = m_slots[tail & (OMX_PACKET_QUEUE_SLOTS - 1)];
+  slot.pkt  = pkt;
+  slot.size = size;
+  m_bytes += size;
+  m_tail.store(tail + 1, std::memory_order_seq_cst);
+  m_pushed++;
+
+  Notify();
+  return true;
+}
+
+OMXPacket *OMXPacketQueue::Pop()
+{
+  uint32_t head = m_head.load(std::memory_order_relaxed);
+  uint32_t tail = m_tail.load(std::memory_order_acquire);
+
+  if(head == tail)
+    return NULL;
+
+  const Slot &slot = m_slots[head & (OMX_PACKET_QUEUE_SLOTS - 1)];
+  OMXPacket *pkt = slot.pkt;
+  m_bytes -= slot.size;
+  m_head.store(head + 1, std::memory_order_seq_cst);
+  m_popped++;
+
+  if(m_space_waiting.load())
+  {
+    m_space_seq++;
+    futex_wake(&m_space_seq);
+  }
+  return pkt;
+}
+
+bool OMXPacketQueue::HasSpace(int size) const
+{
+  uint32_t tail = m_tail.load(std::memory_order_relaxed);
+  uint32_t head = m_head.load(std::memory_order_acquire);
+
+  return tail - head < OMX_PACKET_QUEUE_SLOTS &&
+         (uint64_t)(m_bytes.load(std::memory_order_relaxed) + size) < m_max_bytes;
+}
+
+bool OMXPacketQueue::WaitForSpace(int size, long timeout)
+{
+  if(HasSpace(size))
+    return true;
+
+  int64_t start = monotonic_us();
+  int64_t end   = start + (int64_t)timeout * 1000;
+  int64_t now   = start;
+
+  m_stalls++;
+  m_space_waiting++;
+  // every Pop() bumps m_space_seq while we wait, so a pop between loading
+  // the sequence and going to sleep makes the futex return immediately
+  while(now < end)
+  {
+    int seq = m_space_seq.load();
+    if(HasSpace(size) || m_abort)
+      break;
+
+    struct timespec ts;
+    ts.tv_sec  = (end - now) / 1000000;
+    ts.tv_nsec = ((end - now) % 1000000) * 1000;
+    futex_wait(&m_space_seq, seq, &ts);
+    now = monotonic_us();
+  }
+  m_space_waiting--;
+
+  m_blocked_us += monotonic_us() - start;
+  return HasSpace(size);
+}
+
+void OMXPacketQueue::Wait()
+{
+  m_waiting++;
+  int seq = m_seq.load();
+
+  // a push or Abort() after loading seq changes the futex word, so the wait
+  // below returns straight away instead of missing the wakeup
+  if(!m_abort && IsEmpty())
+  {
+    m_parks++;
+    futex_wait(&m_seq, seq);
+  }
+
+  m_waiting--;
+}
+
+void OMXPacketQueue::Notify()
+{
+  m_seq++;
+  if(m_waiting.load())
+    futex_wake(&m_seq);
+}
+
+void OMXPacketQueue::Abort()
+{
+  m_abort = true;
+  Notify();
+  m_space_seq++;
+  futex_wake(&m_space_seq);
+}
+
+void OMXPacketQueue::ClearAbort()
+{
+  m_abort = false;
+}
+
+unsigned int OMXPacketQueue::GetCount() const
+{
+  return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+}
+
+OMXPacketQueueStats OMXPacketQueue::GetStats() const
+{
+  OMXPacketQueueStats stats;
+  stats.pushed     = m_pushed;
+  stats.popped     = m_popped;
+  stats.rejected   = m_rejected;
+  stats.parks      = m_parks;
+  stats.stalls     = m_stalls;
+  stats.blocked_us = m_blocked_us;
+  return stats;
+}
+
+void OMXPacketQueue::ResetStats()
+{
+  m_pushed     = 0;
+  m_popped     = 0;
+  m_rejected   = 0;
+  m_parks      = 0;
+  m_stalls     = 0;
+  m_blocked_us = 0;
+}
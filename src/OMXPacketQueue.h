@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+struct OMXPacket;
+
+// number of slots in the ring, must be a power of two
+#define OMX_PACKET_QUEUE_SLOTS 8192
+
+typedef struct OMXPacketQueueStats
+{
+  uint64_t pushed;      // packets accepted by Push()
+  uint64_t popped;      // packets taken by Pop()
+  uint64_t rejected;    // Push() calls refused because the queue was full
+  uint64_t parks;       // times the consumer went to sleep on an empty queue
+  uint64_t stalls;      // times the producer had to wait in WaitForSpace()
+  uint64_t blocked_us;  // time the producer spent waiting in WaitForSpace()
+} OMXPacketQueueStats;
+
+// Bounded single producer / single consumer packet ring used between the
+// demux thread and OMXPlayerVideo/OMXPlayerAudio.
+//
+// Push() is only called from the thread that reads packets, Pop() and Wait()
+// only from the decode thread. The queue is bounded by the number of slots and
+// by the sum of the packet sizes. When the ring is empty the consumer parks on
+// a futex and the producer only makes a syscall when somebody is parked. The
+// same goes the other way round for a producer blocked in WaitForSpace().
+//
+// Draining the queue from another thread (OMXPlayerVideo::Flush) is fine as
+// long as the caller excludes the consumer while doing so.
+class OMXPacketQueue
+{
+public:
+  OMXPacketQueue();
+  ~OMXPacketQueue();
+
+  void SetMaxBytes(uint64_t max_bytes) { m_max_bytes = max_bytes; }
+  uint64_t GetMaxBytes() const         { return m_max_bytes; }
+
+  // producer side, size is the packet's payload bytes; the queue never looks
+  // into the packets so it builds without the ffmpeg headers
+  bool Push(OMXPacket *pkt, int size);
+  // wait until a packet of size bytes fits or timeout ms passed
+  bool WaitForSpace(int size, long timeout);
+
+  // consumer side
+  OMXPacket *Pop();
+  void Wait();
+
+  // make Wait() return until ClearAbort() is called
+  void Abort();
+  void ClearAbort();
+
+  unsigned int GetCount() const;
+  unsigned int GetBytes() const  { return m_bytes > 0 ? (unsigned int)m_bytes.load() : 0; }
+  bool IsEmpty() const           { return GetCount() == 0; }
+  bool HasSpace(int size) const;
+
+  OMXPacketQueueStats GetStats() const;
+  void ResetStats();
+
+private:
+  void Notify();
+
+  struct Slot
+  {
+    OMXPacket *pkt;
+    int        size;
+  };
+
+  Slot                      m_slots[OMX_PACKET_QUEUE_SLOTS];
+  // keep head and tail on different cache lines so producer and consumer
+  // don't keep stealing the line from each other
+  std::atomic<uint32_t>     m_head;
+  char                      m_pad_head[64];
+  std::atomic<uint32_t>     m_tail;
+  char                      m_pad_tail[64];
+  std::atomic<int64_t>      m_bytes;
+  std::atomic<uint64_t>     m_max_bytes;
+
+  // futex word, bumped on every push and on Abort()
+  std::atomic<int>          m_seq;
+  std::atomic<int>          m_waiting;
+  std::atomic<bool>         m_abort;
+
+  // futex word, bumped on Pop() while the producer waits for space
+  std::atomic<int>          m_space_seq;
+  std::atomic<int>          m_space_waiting;
+
+  std::atomic<uint64_t>     m_pushed;
+  std::atomic<uint64_t>     m_popped;
+  std::atomic<uint64_t>     m_rejected;
+  std::atomic<uint64_t>     m_parks;
+  std::atomic<uint64_t>     m_stalls;
+  std::atomic<uint64_t>     m_blocked_us;
+};
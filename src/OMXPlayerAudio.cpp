@@ -39,19 +39,21 @@ OMXPlayerAudio::OMXPlayerAudio()
   m_pStream       = NULL;
   m_av_clock      = NULL;
   m_omx_reader    = NULL;
+  m_next_reader   = NULL;
+  m_next_reader_mark = 0;
+  m_hints_generation = 0;
   m_decoder       = NULL;
   m_flush         = false;
   m_flush_requested = false;
-  m_cached_size   = 0;
+  m_decoder_stalls  = 0;
+  m_decoder_blocked_us = 0;
   m_pAudioCodec   = NULL;
   m_player_error  = true;
   m_CurrentVolume = 0.0f;
   m_amplification = 0;
   m_mute          = false;
 
-  pthread_cond_init(&m_packet_cond, NULL);
   pthread_cond_init(&m_audio_cond, NULL);
-  pthread_mutex_init(&m_lock, NULL);
   pthread_mutex_init(&m_lock_decoder, NULL);
 }
 
@@ -60,33 +62,47 @@ OMXPlayerAudio::~OMXPlayerAudio()
   Close();
 
   pthread_cond_destroy(&m_audio_cond);
-  pthread_cond_destroy(&m_packet_cond);
-  pthread_mutex_destroy(&m_lock);
   pthread_mutex_destroy(&m_lock_decoder);
 }
 
-void OMXPlayerAudio::Lock()
+void OMXPlayerAudio::LockDecoder()
 {
   if(m_config.use_thread)
-    pthread_mutex_lock(&m_lock);
+    pthread_mutex_lock(&m_lock_decoder);
 }
 
-void OMXPlayerAudio::UnLock()
+void OMXPlayerAudio::UnLockDecoder()
 {
   if(m_config.use_thread)
-    pthread_mutex_unlock(&m_lock);
+    pthread_mutex_unlock(&m_lock_decoder);
 }
 
-void OMXPlayerAudio::LockDecoder()
+void OMXPlayerAudio::SetReader(OMXReader *omx_reader, uint64_t mark)
 {
-  if(m_config.use_thread)
-    pthread_mutex_lock(&m_lock_decoder);
+  LockDecoder();
+  m_next_reader      = omx_reader;
+  m_next_reader_mark = mark;
+  if(m_packets.GetStats().popped > mark)
+    SwitchReader();
+  UnLockDecoder();
 }
 
-void OMXPlayerAudio::UnLockDecoder()
+// called with the decoder lock held
+void OMXPlayerAudio::SwitchReader()
 {
-  if(m_config.use_thread)
-    pthread_mutex_unlock(&m_lock_decoder);
+  m_omx_reader  = m_next_reader;
+  m_next_reader = NULL;
+}
+
+// the hints point into the reader, which frees them on Close()
+void OMXPlayerAudio::CopyExtraData()
+{
+  const uint8_t *extradata = (const uint8_t *)m_config.hints.extradata;
+  if(extradata && m_config.hints.extrasize)
+    m_extradata.assign(extradata, extradata + m_config.hints.extrasize);
+  else
+    m_extradata.clear();
+  m_config.hints.extradata = m_extradata.empty() ? NULL : &m_extradata[0];
 }
 
 bool OMXPlayerAudio::Open(OMXClock *av_clock, const OMXAudioConfig &config, OMXReader *omx_reader)
@@ -100,16 +116,23 @@ bool OMXPlayerAudio::Open(OMXClock *av_clock, const OMXAudioConfig &config, OMXR
   m_dllAvFormat.av_register_all();
 
   m_config      = config;
+  CopyExtraData();
   m_av_clock    = av_clock;
   m_omx_reader  = omx_reader;
+  m_next_reader = NULL;
+  m_hints_generation = 0;
   m_passthrough = false;
   m_hw_decode   = false;
   m_iCurrentPts = DVD_NOPTS_VALUE;
   m_bAbort      = false;
   m_flush       = false;
   m_flush_requested = false;
-  m_cached_size = 0;
   m_pAudioCodec = NULL;
+  m_packets.SetMaxBytes((uint64_t)m_config.queue_size * 1024 * 1024);
+  m_packets.ClearAbort();
+  m_packets.ResetStats();
+  m_decoder_stalls     = 0;
+  m_decoder_blocked_us = 0;
 
   m_player_error = OpenAudioCodec();
   if(!m_player_error)
@@ -141,10 +164,7 @@ bool OMXPlayerAudio::Close()
 
   if(ThreadHandle())
   {
-    Lock();
-    pthread_cond_broadcast(&m_packet_cond);
-    UnLock();
-
+    m_packets.Abort();
     StopThread();
   }
 
@@ -164,6 +184,24 @@ bool OMXPlayerAudio::Close()
 }
 
 
+// blocks until the decoder has returned enough input buffers. returns false
+// when a flush was requested in the meantime
+bool OMXPlayerAudio::WaitForDecoderSpace(unsigned int size)
+{
+  if(m_decoder->GetSpace() >= size)
+    return true;
+
+  int64_t start = m_av_clock->GetAbsoluteClock();
+  m_decoder_stalls++;
+
+  while(m_decoder->GetSpace() < size && !m_flush_requested)
+    m_decoder->WaitForSpace(size, 100);
+
+  m_decoder_blocked_us += m_av_clock->GetAbsoluteClock() - start;
+
+  return !m_flush_requested;
+}
+
 bool OMXPlayerAudio::Decode(OMXPacket *pkt)
 {
   if(!pkt)
@@ -176,42 +214,53 @@ bool OMXPlayerAudio::Decode(OMXPacket *pkt)
   if(!m_omx_reader->IsActive(OMXSTREAM_AUDIO, pkt->stream_index))
     return true; 
 
-  int channels = pkt->hints.channels;
+  // the reader caches hints per stream, only look at them when they changed
+  if(pkt->hints_generation != m_hints_generation)
+  {
+    COMXStreamInfo hints;
+    if(!m_omx_reader->GetStreamHints(pkt->stream_index, hints))
+      return true;
 
-  unsigned int old_bitrate = m_config.hints.bitrate;
-  unsigned int new_bitrate = pkt->hints.bitrate;
+    m_hints_generation = pkt->hints_generation;
 
-  /* only check bitrate changes on AV_CODEC_ID_DTS, AV_CODEC_ID_AC3, AV_CODEC_ID_EAC3 */
-  if(m_config.hints.codec != AV_CODEC_ID_DTS && m_config.hints.codec != AV_CODEC_ID_AC3 && m_config.hints.codec != AV_CODEC_ID_EAC3)
-  {
-    new_bitrate = old_bitrate = 0;
-  }
+    int channels = hints.channels;
 
-  // for passthrough we only care about the codec and the samplerate
-  bool minor_change = channels                 != m_config.hints.channels ||
-                      pkt->hints.bitspersample != m_config.hints.bitspersample ||
-                      old_bitrate              != new_bitrate;
+    unsigned int old_bitrate = m_config.hints.bitrate;
+    unsigned int new_bitrate = hints.bitrate;
 
-  if(pkt->hints.codec          != m_config.hints.codec ||
-     pkt->hints.samplerate     != m_config.hints.samplerate ||
-     (!m_passthrough && minor_change))
-  {
-    printf("C : %d %d %d %d %d\n", m_config.hints.codec, m_config.hints.channels, m_config.hints.samplerate, m_config.hints.bitrate, m_config.hints.bitspersample);
-    printf("N : %d %d %d %d %d\n", pkt->hints.codec, channels, pkt->hints.samplerate, pkt->hints.bitrate, pkt->hints.bitspersample);
+    /* only check bitrate changes on AV_CODEC_ID_DTS, AV_CODEC_ID_AC3, AV_CODEC_ID_EAC3 */
+    if(m_config.hints.codec != AV_CODEC_ID_DTS && m_config.hints.codec != AV_CODEC_ID_AC3 && m_config.hints.codec != AV_CODEC_ID_EAC3)
+    {
+      new_bitrate = old_bitrate = 0;
+    }
+
+    // for passthrough we only care about the codec and the samplerate
+    bool minor_change = channels             != m_config.hints.channels ||
+                        hints.bitspersample  != m_config.hints.bitspersample ||
+                        old_bitrate          != new_bitrate;
+
+    if(hints.codec          != m_config.hints.codec ||
+       hints.samplerate     != m_config.hints.samplerate ||
+       (!m_passthrough && minor_change))
+    {
+      printf("C : %d %d %d %d %d\n", m_config.hints.codec, m_config.hints.channels, m_config.hints.samplerate, m_config.hints.bitrate, m_config.hints.bitspersample);
+      printf("N : %d %d %d %d %d\n", hints.codec, channels, hints.samplerate, hints.bitrate, hints.bitspersample);
 
 
-    CloseDecoder();
-    CloseAudioCodec();
+      CloseDecoder();
+      CloseAudioCodec();
 
-    m_config.hints = pkt->hints;
+      m_config.hints = hints;
+      CopyExtraData();
 
-    m_player_error = OpenAudioCodec();
-    if(!m_player_error)
-      return false;
+      m_player_error = OpenAudioCodec();
+      if(!m_player_error)
+        return false;
 
-    m_player_error = OpenDecoder();
-    if(!m_player_error)
-      return false;
+      m_player_error = OpenDecoder();
+      if(!m_player_error)
+        return false;
+    }
   }
 
   CLog::Log(LOGINFO, "CDVDPlayerAudio::Decode dts:%.0f pts:%.0f size:%d", pkt->dts, pkt->pts, pkt->size);
@@ -239,36 +288,29 @@ bool OMXPlayerAudio::Decode(OMXPacket *pkt)
       data_dec+= len;
       data_len -= len;
 
-      uint8_t *decoded;
-      int decoded_size = m_pAudioCodec->GetData(&decoded, dts, pts);
+      uint8_t **planes;
+      int samples = m_pAudioCodec->GetFrame(&planes, dts, pts);
 
-      if(decoded_size <=0)
+      if(samples <=0)
         continue;
 
-      while((int) m_decoder->GetSpace() < decoded_size)
-      {
-        OMXClock::OMXSleep(10);
-        if(m_flush_requested) return true;
-      }
-
-      int ret = 0;
+      int decoded_size = samples * m_pAudioCodec->GetChannels() * m_pAudioCodec->GetBitsPerSample() >> 3;
+      if(!WaitForDecoderSpace(decoded_size))
+        return true;
 
-      ret = m_decoder->AddPackets(decoded, decoded_size, dts, pts, m_pAudioCodec->GetFrameSize());
-      if(ret != decoded_size)
+      int ret = m_decoder->AddFrame(planes, samples, dts, pts);
+      if(ret != samples)
       {
-        printf("error ret %d decoded_size %d\n", ret, decoded_size);
+        printf("error ret %d samples %d\n", ret, samples);
       }
     }
   }
   else
   {
-    while((int) m_decoder->GetSpace() < pkt->size)
-    {
-      OMXClock::OMXSleep(10);
-      if(m_flush_requested) return true;
-    }
+    if(!WaitForDecoderSpace(pkt->size))
+      return true;
 
-    m_decoder->AddPackets(pkt->data, pkt->size, pkt->dts, pkt->pts, 0);
+    m_decoder->AddPackets(pkt->data, pkt->size, pkt->dts, pkt->pts);
   }
 
   return true;
@@ -280,38 +322,33 @@ void OMXPlayerAudio::Process()
 
   while(true)
   {
-    Lock();
-    if(!(m_bStop || m_bAbort) && m_packets.empty())
-      pthread_cond_wait(&m_packet_cond, &m_lock);
+    if(!(m_bStop || m_bAbort) && m_packets.IsEmpty())
+      m_packets.Wait();
 
     if (m_bStop || m_bAbort)
-    {
-      UnLock();
       break;
-    }
 
-    if(m_flush && omx_pkt)
+    // packets are only popped with the decoder lock held, so Flush() can
+    // drain the queue from the reader thread without racing us
+    LockDecoder();
+    if(m_flush)
     {
-      OMXReader::FreePacket(omx_pkt);
-      omx_pkt = NULL;
+      if(omx_pkt)
+      {
+        OMXReader::FreePacket(omx_pkt);
+        omx_pkt = NULL;
+      }
       m_flush = false;
     }
-    else if(!omx_pkt && !m_packets.empty())
-    {
-      omx_pkt = m_packets.front();
-      m_cached_size -= omx_pkt->size;
-      m_packets.pop_front();
-    }
-    UnLock();
-    
-    LockDecoder();
-    if(m_flush && omx_pkt)
+
+    if(!omx_pkt)
     {
-      OMXReader::FreePacket(omx_pkt);
-      omx_pkt = NULL;
-      m_flush = false;
+      omx_pkt = m_packets.Pop();
+      if(omx_pkt && m_next_reader && m_packets.GetStats().popped > m_next_reader_mark)
+        SwitchReader();
     }
-    else if(omx_pkt && Decode(omx_pkt))
+
+    if(omx_pkt && Decode(omx_pkt))
     {
       OMXReader::FreePacket(omx_pkt);
       omx_pkt = NULL;
@@ -326,47 +363,51 @@ void OMXPlayerAudio::Process()
 void OMXPlayerAudio::Flush()
 {
   m_flush_requested = true;
-  Lock();
+  if(m_decoder)
+    m_decoder->CancelWait(true);
   LockDecoder();
   if(m_pAudioCodec)
     m_pAudioCodec->Reset();
   m_flush_requested = false;
+  if(m_decoder)
+    m_decoder->CancelWait(false);
   m_flush = true;
-  while (!m_packets.empty())
-  {
-    OMXPacket *pkt = m_packets.front(); 
-    m_packets.pop_front();
+  OMXPacket *pkt;
+  while((pkt = m_packets.Pop()) != NULL)
     OMXReader::FreePacket(pkt);
-  }
+  if(m_next_reader)
+    SwitchReader();
   m_iCurrentPts = DVD_NOPTS_VALUE;
-  m_cached_size = 0;
   if(m_decoder)
     m_decoder->Flush();
   UnLockDecoder();
-  UnLock();
 }
 
 bool OMXPlayerAudio::AddPacket(OMXPacket *pkt)
 {
-  bool ret = false;
-
   if(!pkt)
-    return ret;
+    return false;
 
   if(m_bStop || m_bAbort)
-    return ret;
+    return false;
 
-  if((m_cached_size + pkt->size) < m_config.queue_size * 1024 * 1024)
+  return m_packets.Push(pkt, pkt->size);
+}
+
+// called by the reader thread after AddPacket() failed, returns as soon as the
+// decode thread made room instead of sleeping a fixed interval
+bool OMXPlayerAudio::WaitForSpace(OMXPacket *pkt, long timeout)
+{
+  if(!pkt)
+    return false;
+
+  if(m_bStop || m_bAbort)
   {
-    Lock();
-    m_cached_size += pkt->size;
-    m_packets.push_back(pkt);
-    UnLock();
-    ret = true;
-    pthread_cond_broadcast(&m_packet_cond);
+    OMXClock::OMXSleep(timeout);
+    return false;
   }
 
-  return ret;
+  return m_packets.WaitForSpace(pkt->size, timeout);
 }
 
 bool OMXPlayerAudio::OpenAudioCodec()
@@ -490,6 +531,14 @@ double OMXPlayerAudio::GetCacheTotal()
     return 0;
 }
 
+bool OMXPlayerAudio::GetOutputStats(OMXAudioOutputStats &stats)
+{
+  if(m_decoder)
+    return m_decoder->GetOutputStats(stats);
+  else
+    return false;
+}
+
 void OMXPlayerAudio::SubmitEOS()
 {
   if(m_decoder)
@@ -498,6 +547,6 @@ void OMXPlayerAudio::SubmitEOS()
 
 bool OMXPlayerAudio::IsEOS()
 {
-  return m_packets.empty() && (!m_decoder || m_decoder->IsEOS());
+  return m_packets.IsEmpty() && (!m_decoder || m_decoder->IsEOS());
 }
 
@@ -34,9 +34,10 @@
 #include "OMXAudio.h"
 #include "OMXAudioCodecOMX.h"
 #include "OMXThread.h"
+#include "OMXPacketQueue.h"
 
-#include <deque>
 #include <string>
+#include <vector>
 #include <atomic>
 #include <sys/types.h>
 
@@ -47,19 +48,21 @@ class OMXPlayerAudio : public OMXThread
 protected:
   AVStream                  *m_pStream;
   int                       m_stream_id;
-  std::deque<OMXPacket *>   m_packets;
+  OMXPacketQueue            m_packets;
   DllAvUtil                 m_dllAvUtil;
   DllAvCodec                m_dllAvCodec;
   DllAvFormat               m_dllAvFormat;
   bool                      m_open;
   COMXStreamInfo            m_hints;
+  int                       m_hints_generation;
   double                    m_iCurrentPts;
-  pthread_cond_t            m_packet_cond;
   pthread_cond_t            m_audio_cond;
-  pthread_mutex_t           m_lock;
   pthread_mutex_t           m_lock_decoder;
   OMXClock                  *m_av_clock;
   OMXReader                 *m_omx_reader;
+  OMXReader                 *m_next_reader;
+  uint64_t                  m_next_reader_mark;
+  std::vector<uint8_t>      m_extradata;
   COMXAudio                 *m_decoder;
   std::string               m_codec_name;
   std::string               m_device;
@@ -69,7 +72,8 @@ protected:
   bool                      m_bAbort;
   bool                      m_flush;
   std::atomic<bool>         m_flush_requested;
-  unsigned int              m_cached_size;
+  std::atomic<uint64_t>     m_decoder_stalls;
+  std::atomic<uint64_t>     m_decoder_blocked_us;
   OMXAudioConfig            m_config;
   COMXAudioCodecOMX         *m_pAudioCodec;
   float                     m_CurrentVolume;
@@ -77,8 +81,9 @@ protected:
   bool                      m_mute;
   bool   m_player_error;
 
-  void Lock();
-  void UnLock();
+  bool WaitForDecoderSpace(unsigned int size);
+  void CopyExtraData();
+  void SwitchReader();
   void LockDecoder();
   void UnLockDecoder();
 private:
@@ -86,11 +91,15 @@ public:
   OMXPlayerAudio();
   ~OMXPlayerAudio();
   bool Open(OMXClock *av_clock, const OMXAudioConfig &config, OMXReader *omx_reader);
+  // switch to another reader with matching streams once the packet queue popped
+  // past mark, the packets queued before it still belong to the current reader
+  void SetReader(OMXReader *omx_reader, uint64_t mark);
   bool Close();
   bool Decode(OMXPacket *pkt);
   void Process();
   void Flush();
   bool AddPacket(OMXPacket *pkt);
+  bool WaitForSpace(OMXPacket *pkt, long timeout);
   bool OpenAudioCodec();
   void CloseAudioCodec();      
   bool IsPassthrough(COMXStreamInfo hints);
@@ -99,12 +108,16 @@ public:
   double GetDelay();
   double GetCacheTime();
   double GetCacheTotal();
+  bool GetOutputStats(OMXAudioOutputStats &stats);
   double GetCurrentPTS() { return m_iCurrentPts; };
   void SubmitEOS();
   bool IsEOS();
-  unsigned int GetCached() { return m_cached_size; };
+  unsigned int GetCached() { return m_packets.GetBytes(); };
   unsigned int GetMaxCached() { return m_config.queue_size * 1024 * 1024; };
-  unsigned int GetLevel() { return m_config.queue_size ? 100.0f * m_cached_size / (m_config.queue_size * 1024.0f * 1024.0f) : 0; };
+  OMXPacketQueueStats GetQueueStats() { return m_packets.GetStats(); };
+  uint64_t GetDecoderStalls() { return m_decoder_stalls; };
+  double GetDecoderBlockedTime() { return m_decoder_blocked_us / 1000000.0; };
+  unsigned int GetLevel() { return m_config.queue_size ? 100.0f * m_packets.GetBytes() / (m_config.queue_size * 1024.0f * 1024.0f) : 0; };
   void SetVolume(float fVolume)                          { m_CurrentVolume = fVolume; if(m_decoder) m_decoder->SetVolume(fVolume); }
   float GetVolume()                                      { return m_CurrentVolume; }
   void SetMute(bool bOnOff)                              { m_mute = bOnOff; if(m_decoder) m_decoder->SetMute(bOnOff); }
@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <string.h>
 
 #include "linux/XMemUtils.h"
 
@@ -39,17 +40,20 @@ OMXPlayerVideo::OMXPlayerVideo()
   m_stream_id     = -1;
   m_pStream       = NULL;
   m_av_clock      = NULL;
+  m_omx_reader    = NULL;
+  m_next_reader   = NULL;
+  m_next_reader_mark = 0;
+  m_hints_generation = 0;
   m_decoder       = NULL;
   m_fps           = 25.0f;
   m_flush         = false;
   m_flush_requested = false;
-  m_cached_size   = 0;
+  m_decoder_stalls  = 0;
+  m_decoder_blocked_us = 0;
   m_iVideoDelay   = 0;
   m_iCurrentPts   = 0;
 
-  pthread_cond_init(&m_packet_cond, NULL);
   pthread_cond_init(&m_picture_cond, NULL);
-  pthread_mutex_init(&m_lock, NULL);
   pthread_mutex_init(&m_lock_decoder, NULL);
 }
 
@@ -57,37 +61,65 @@ OMXPlayerVideo::~OMXPlayerVideo()
 {
   Close();
 
-  pthread_cond_destroy(&m_packet_cond);
   pthread_cond_destroy(&m_picture_cond);
-  pthread_mutex_destroy(&m_lock);
   pthread_mutex_destroy(&m_lock_decoder);
 }
 
-void OMXPlayerVideo::Lock()
+void OMXPlayerVideo::LockDecoder()
 {
   if(m_config.use_thread)
-    pthread_mutex_lock(&m_lock);
+    pthread_mutex_lock(&m_lock_decoder);
 }
 
-void OMXPlayerVideo::UnLock()
+void OMXPlayerVideo::UnLockDecoder()
 {
   if(m_config.use_thread)
-    pthread_mutex_unlock(&m_lock);
+    pthread_mutex_unlock(&m_lock_decoder);
 }
 
-void OMXPlayerVideo::LockDecoder()
+// the hints point into the reader, which frees them on Close(). A spliced
+// movie keeps this decoder after its reader is gone
+void OMXPlayerVideo::CopyExtraData()
 {
-  if(m_config.use_thread)
-    pthread_mutex_lock(&m_lock_decoder);
+  const uint8_t *extradata = (const uint8_t *)m_config.hints.extradata;
+  if(extradata && m_config.hints.extrasize)
+    m_extradata.assign(extradata, extradata + m_config.hints.extrasize);
+  else
+    m_extradata.clear();
+  m_config.hints.extradata = m_extradata.empty() ? NULL : &m_extradata[0];
 }
 
-void OMXPlayerVideo::UnLockDecoder()
+void OMXPlayerVideo::SetReader(OMXReader *omx_reader, uint64_t mark)
 {
-  if(m_config.use_thread)
-    pthread_mutex_unlock(&m_lock_decoder);
+  LockDecoder();
+  m_next_reader      = omx_reader;
+  m_next_reader_mark = mark;
+  if(m_packets.GetStats().popped > mark)
+    SwitchReader();
+  UnLockDecoder();
 }
 
-bool OMXPlayerVideo::Open(OMXClock *av_clock, const OMXVideoConfig &config)
+// called with the decoder lock held
+void OMXPlayerVideo::SwitchReader()
+{
+  m_omx_reader  = m_next_reader;
+  m_next_reader = NULL;
+}
+
+// anything the decoder was configured with, the rest is only informational
+bool OMXPlayerVideo::HintsChanged(const COMXStreamInfo &hints)
+{
+  if(hints.codec     != m_config.hints.codec ||
+     hints.profile   != m_config.hints.profile ||
+     hints.width     != m_config.hints.width ||
+     hints.height    != m_config.hints.height ||
+     hints.extrasize != m_config.hints.extrasize)
+    return true;
+
+  return hints.extrasize && memcmp(hints.extradata, m_config.hints.extradata, hints.extrasize) != 0;
+}
+
+bool OMXPlayerVideo::Open(OMXClock *av_clock, const OMXVideoConfig &config, OMXReader *omx_reader)
 {
 
   if (!m_dllAvUtil.Load() || !m_dllAvCodec.Load() || !m_dllAvFormat.Load() || !av_clock)
@@ -99,14 +131,22 @@ bool OMXPlayerVideo::Open(OMXClock *av_clock, const OMXVideoConfig &config)
   m_dllAvFormat.av_register_all();
 
   m_config      = config;
+  CopyExtraData();
   m_av_clock    = av_clock;
+  m_omx_reader  = omx_reader;
+  m_next_reader = NULL;
+  m_hints_generation = 0;
   m_fps         = 25.0f;
   m_frametime   = 0;
   m_iCurrentPts = DVD_NOPTS_VALUE;
   m_bAbort      = false;
   m_flush       = false;
-  m_cached_size = 0;
   m_iVideoDelay = 0;
+  m_packets.SetMaxBytes((uint64_t)m_config.queue_size * 1024 * 1024);
+  m_packets.ClearAbort();
+  m_packets.ResetStats();
+  m_decoder_stalls     = 0;
+  m_decoder_blocked_us = 0;
   if(!OpenDecoder())
   {
     Close();
@@ -135,7 +175,6 @@ bool OMXPlayerVideo::Reset()
   m_bAbort            = false;
   m_flush             = false;
   m_flush_requested   = false;
-  m_cached_size       = 0;
   m_iVideoDelay       = 0;
   // Keep consistency with old Close/Open logic by continuing to return a bool
   // with the success/failure of this call.  Although little can go wrong
@@ -152,10 +191,7 @@ bool OMXPlayerVideo::Close()
 
   if(ThreadHandle())
   {
-    Lock();
-    pthread_cond_broadcast(&m_packet_cond);
-    UnLock();
-
+    m_packets.Abort();
     StopThread();
   }
 
@@ -205,11 +241,64 @@ void OMXPlayerVideo::SetFilter(OMX_IMAGEFILTERTYPE filterType)
 
 }
 
+// blocks until the decoder has returned enough input buffers. returns false
+// when a flush was requested in the meantime
+bool OMXPlayerVideo::WaitForDecoderSpace(unsigned int size)
+{
+  if(m_decoder->GetFreeSpace() >= size)
+    return true;
+
+  int64_t start = m_av_clock->GetAbsoluteClock();
+  m_decoder_stalls++;
+
+  while(m_decoder->GetFreeSpace() < size && !m_flush_requested)
+    m_decoder->WaitForFreeSpace(size, 100);
+
+  m_decoder_blocked_us += m_av_clock->GetAbsoluteClock() - start;
+
+  return !m_flush_requested;
+}
+
+// takes pkt over when it returns true
 bool OMXPlayerVideo::Decode(OMXPacket *pkt)
 {
   if(!pkt)
     return false;
 
+  /* last decoder reinit went wrong */
+  if(!m_decoder)
+  {
+    OMXReader::FreePacket(pkt);
+    return true;
+  }
+
+  // the reader caches hints per stream, only look at them when they changed
+  if(pkt->hints_generation != m_hints_generation)
+  {
+    COMXStreamInfo hints;
+    if(m_omx_reader && m_omx_reader->GetStreamHints(pkt->stream_index, hints))
+    {
+      m_hints_generation = pkt->hints_generation;
+
+      if(HintsChanged(hints))
+      {
+        printf("C : %d %dx%d profile %d extrasize %d\n", m_config.hints.codec, m_config.hints.width, m_config.hints.height, m_config.hints.profile, m_config.hints.extrasize);
+        printf("N : %d %dx%d profile %d extrasize %d\n", hints.codec, hints.width, hints.height, hints.profile, hints.extrasize);
+
+        CloseDecoder();
+
+        m_config.hints = hints;
+        CopyExtraData();
+
+        if(!OpenDecoder())
+        {
+          OMXReader::FreePacket(pkt);
+          return true;
+        }
+      }
+    }
+  }
+
   double dts = pkt->dts;
   double pts = pkt->pts;
 
@@ -219,17 +308,18 @@ bool OMXPlayerVideo::Decode(OMXPacket *pkt)
   if (pts != DVD_NOPTS_VALUE)
     pts += m_iVideoDelay;
 
-  if(pts != DVD_NOPTS_VALUE)
+  if(pts != DVD_NOPTS_VALUE && !pkt->decode_only)
     m_iCurrentPts = pts;
 
-  while((int) m_decoder->GetFreeSpace() < pkt->size)
+  if(!WaitForDecoderSpace(pkt->size))
   {
-    OMXClock::OMXSleep(10);
-    if(m_flush_requested) return true;
+    OMXReader::FreePacket(pkt);
+    return true;
   }
 
   CLog::Log(LOGINFO, "CDVDPlayerVideo::Decode dts:%.0f pts:%.0f cur:%.0f, size:%d", pkt->dts, pkt->pts, m_iCurrentPts, pkt->size);
-  m_decoder->Decode(pkt->data, pkt->size, dts, pts);
+  // frees the packet, right away or once the decoder has read it
+  m_decoder->DecodePacket(pkt, dts, pts);
   return true;
 }
 
@@ -239,42 +329,34 @@ void OMXPlayerVideo::Process()
 
   while(true)
   {
-    Lock();
-    if(!(m_bStop || m_bAbort) && m_packets.empty())
-      pthread_cond_wait(&m_packet_cond, &m_lock);
+    if(!(m_bStop || m_bAbort) && m_packets.IsEmpty())
+      m_packets.Wait();
 
     if (m_bStop || m_bAbort)
-    {
-      UnLock();
       break;
-    }
 
-    if(m_flush && omx_pkt)
+    // packets are only popped with the decoder lock held, so Flush() can
+    // drain the queue from the reader thread without racing us
+    LockDecoder();
+    if(m_flush)
     {
-      OMXReader::FreePacket(omx_pkt);
-      omx_pkt = NULL;
+      if(omx_pkt)
+      {
+        OMXReader::FreePacket(omx_pkt);
+        omx_pkt = NULL;
+      }
       m_flush = false;
     }
-    else if(!omx_pkt && !m_packets.empty())
-    {
-      omx_pkt = m_packets.front();
-      m_cached_size -= omx_pkt->size;
-      m_packets.pop_front();
-    }
-    UnLock();
 
-    LockDecoder();
-    if(m_flush && omx_pkt)
+    if(!omx_pkt)
     {
-      OMXReader::FreePacket(omx_pkt);
-      omx_pkt = NULL;
-      m_flush = false;
+      omx_pkt = m_packets.Pop();
+      if(omx_pkt && m_next_reader && m_packets.GetStats().popped > m_next_reader_mark)
+        SwitchReader();
     }
-    else if(omx_pkt && Decode(omx_pkt))
-    {
-      OMXReader::FreePacket(omx_pkt);
+
+    if(omx_pkt && Decode(omx_pkt))
       omx_pkt = NULL;
-    }
     UnLockDecoder();
   }
 
@@ -285,45 +367,49 @@ void OMXPlayerVideo::Process()
 void OMXPlayerVideo::Flush()
 {
   m_flush_requested = true;
-  Lock();
+  if(m_decoder)
+    m_decoder->CancelWait(true);
   LockDecoder();
   m_flush_requested = false;
+  if(m_decoder)
+    m_decoder->CancelWait(false);
   m_flush = true;
-  while (!m_packets.empty())
-  {
-    OMXPacket *pkt = m_packets.front(); 
-    m_packets.pop_front();
+  OMXPacket *pkt;
+  while((pkt = m_packets.Pop()) != NULL)
     OMXReader::FreePacket(pkt);
-  }
+  if(m_next_reader)
+    SwitchReader();
   m_iCurrentPts = DVD_NOPTS_VALUE;
-  m_cached_size = 0;
   if(m_decoder)
     m_decoder->Reset();
   UnLockDecoder();
-  UnLock();
 }
 
 bool OMXPlayerVideo::AddPacket(OMXPacket *pkt)
 {
-  bool ret = false;
-
   if(!pkt)
-    return ret;
+    return false;
 
   if(m_bStop || m_bAbort)
-    return ret;
+    return false;
 
-  if((m_cached_size + pkt->size) < m_config.queue_size * 1024 * 1024)
+  return m_packets.Push(pkt, pkt->size);
+}
+
+// called by the reader thread after AddPacket() failed, returns as soon as the
+// decode thread made room instead of sleeping a fixed interval
+bool OMXPlayerVideo::WaitForSpace(OMXPacket *pkt, long timeout)
+{
+  if(!pkt)
+    return false;
+
+  if(m_bStop || m_bAbort)
   {
-    Lock();
-    m_cached_size += pkt->size;
-    m_packets.push_back(pkt);
-    UnLock();
-    ret = true;
-    pthread_cond_broadcast(&m_packet_cond);
+    OMXClock::OMXSleep(timeout);
+    return false;
   }
 
-  return ret;
+  return m_packets.WaitForSpace(pkt->size, timeout);
 }
 
 
@@ -393,7 +479,7 @@ bool OMXPlayerVideo::IsEOS()
 {
   if(!m_decoder)
     return false;
-  return m_packets.empty() && (!m_decoder || m_decoder->IsEOS());
+  return m_packets.IsEmpty() && (!m_decoder || m_decoder->IsEOS());
 }
 
 int OMXPlayerVideo::getFrameNumber()
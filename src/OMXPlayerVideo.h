@@ -31,11 +31,12 @@
 #include "OMXStreamInfo.h"
 #include "OMXVideo.h"
 #include "OMXThread.h"
+#include "OMXPacketQueue.h"
 
-#include <deque>
 #include <sys/types.h>
 
 #include <string>
+#include <vector>
 #include <atomic>
 
 using namespace std;
@@ -45,17 +46,19 @@ class OMXPlayerVideo : public OMXThread
 public:
     AVStream                  *m_pStream;
     int                       m_stream_id;
-    std::deque<OMXPacket *>   m_packets;
+    OMXPacketQueue            m_packets;
     DllAvUtil                 m_dllAvUtil;
     DllAvCodec                m_dllAvCodec;
     DllAvFormat               m_dllAvFormat;
     bool                      m_open;
     double                    m_iCurrentPts;
-    pthread_cond_t            m_packet_cond;
     pthread_cond_t            m_picture_cond;
-    pthread_mutex_t           m_lock;
     pthread_mutex_t           m_lock_decoder;
     OMXClock                  *m_av_clock;
+    OMXReader                 *m_omx_reader;
+    OMXReader                 *m_next_reader;
+    uint64_t                  m_next_reader_mark;
+    int                       m_hints_generation;
     COMXVideo                 *m_decoder;
     float                     m_fps;
     double                    m_frametime;
@@ -63,34 +66,45 @@ public:
     bool                      m_bAbort;
     bool                      m_flush;
     std::atomic<bool>         m_flush_requested;
-    unsigned int              m_cached_size;
+    std::atomic<uint64_t>     m_decoder_stalls;
+    std::atomic<uint64_t>     m_decoder_blocked_us;
     double                    m_iVideoDelay;
     OMXVideoConfig            m_config;
+    std::vector<uint8_t>      m_extradata;
     
-    void Lock();
-    void UnLock();
+    bool WaitForDecoderSpace(unsigned int size);
+    void CopyExtraData();
+    bool HintsChanged(const COMXStreamInfo &hints);
+    void SwitchReader();
     void LockDecoder();
     void UnLockDecoder();
     
     
     OMXPlayerVideo();
     ~OMXPlayerVideo();
-    bool Open(OMXClock *av_clock, const OMXVideoConfig &config);
+    bool Open(OMXClock *av_clock, const OMXVideoConfig &config, OMXReader *omx_reader);
+    // switch to another reader with matching streams once the packet queue popped
+    // past mark, the packets queued before it still belong to the current reader
+    void SetReader(OMXReader *omx_reader, uint64_t mark);
     bool Close();
     bool Reset();
     bool Decode(OMXPacket *pkt);
     void Process();
     void Flush();
     bool AddPacket(OMXPacket *pkt);
+    bool WaitForSpace(OMXPacket *pkt, long timeout);
     bool OpenDecoder();
     bool CloseDecoder();
     int  GetDecoderBufferSize();
     int  GetDecoderFreeSpace();
     double GetCurrentPTS() { return m_iCurrentPts; };
     double GetFPS() { return m_fps; };
-    unsigned int GetCached() { return m_cached_size; };
+    unsigned int GetCached() { return m_packets.GetBytes(); };
     unsigned int GetMaxCached() { return m_config.queue_size * 1024 * 1024; };
-    unsigned int GetLevel() { return m_config.queue_size ? 100.0f * m_cached_size / (m_config.queue_size * 1024.0f * 1024.0f) : 0; };
+    OMXPacketQueueStats GetQueueStats() { return m_packets.GetStats(); };
+    uint64_t GetDecoderStalls() { return m_decoder_stalls; };
+    double GetDecoderBlockedTime() { return m_decoder_blocked_us / 1000000.0; };
+    unsigned int GetLevel() { return m_config.queue_size ? 100.0f * m_packets.GetBytes() / (m_config.queue_size * 1024.0f * 1024.0f) : 0; };
     void SubmitEOS();
     bool IsEOS();
     void SetDelay(double delay) { m_iVideoDelay = delay; }
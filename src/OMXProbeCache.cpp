@@ -0,0 +1,162 @@
+#include "OMXProbeCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define OMX_PROBE_CACHE_MAGIC   "OMXPRB01"
+// anything bigger is not extradata we know about, treat the entry as broken
+#define OMX_PROBE_MAX_EXTRASIZE (1024 * 1024)
+
+typedef struct OMXProbeHeader
+{
+  char     magic[8];
+  int64_t  file_size;
+  int64_t  file_mtime;
+  int64_t  start_time;
+  int64_t  duration;
+  int64_t  bit_rate;
+  double   probe_ms;
+  char     format[32];
+  uint32_t path_size;   // media path follows the header
+  uint32_t count;
+  uint32_t stream_size;
+} OMXProbeHeader;
+
+OMXProbeInfo::OMXProbeInfo()
+{
+  Clear();
+}
+
+OMXProbeInfo::~OMXProbeInfo()
+{
+}
+
+void OMXProbeInfo::Clear()
+{
+  format.clear();
+  start_time = 0;
+  duration   = 0;
+  bit_rate   = 0;
+  probe_ms   = 0;
+  streams.clear();
+  extradata.clear();
+}
+
+std::string OMXProbeInfo::EntryPath(const std::string &dir, const std::string &path)
+{
+  // FNV-1a, only has to spread paths over file names, the entry holds the full path
+  uint64_t hash = 14695981039346656037ULL;
+  for(size_t i = 0; i < path.size(); i++)
+  {
+    hash ^= (uint8_t)path[i];
+    hash *= 1099511628211ULL;
+  }
+
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.omxprobe", (unsigned long long)hash);
+  return dir + "/" + name;
+}
+
+bool OMXProbeInfo::Load(const std::string &dir, const std::string &path, int64_t file_size, int64_t file_mtime)
+{
+  Clear();
+
+  FILE *fp = fopen(EntryPath(dir, path).c_str(), "rb");
+  if(!fp)
+    return false;
+
+  OMXProbeHeader header;
+  bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+            memcmp(header.magic, OMX_PROBE_CACHE_MAGIC, sizeof(header.magic)) == 0 &&
+            header.file_size   == file_size &&
+            header.file_mtime  == file_mtime &&
+            header.stream_size == sizeof(OMXProbeStream) &&
+            header.path_size   == path.size() &&
+            header.count > 0;
+
+  if(ok)
+  {
+    std::string stored(header.path_size, '\0');
+    ok = fread(&stored[0], 1, header.path_size, fp) == header.path_size && stored == path;
+  }
+
+  for(uint32_t i = 0; ok && i < header.count; i++)
+  {
+    OMXProbeStream stream;
+    ok = fread(&stream, sizeof(stream), 1, fp) == 1 && stream.extrasize <= OMX_PROBE_MAX_EXTRASIZE;
+    if(!ok)
+      break;
+
+    std::vector<uint8_t> extra(stream.extrasize);
+    if(stream.extrasize)
+      ok = fread(&extra[0], 1, stream.extrasize, fp) == stream.extrasize;
+
+    streams.push_back(stream);
+    extradata.push_back(extra);
+  }
+  fclose(fp);
+
+  if(!ok)
+  {
+    Clear();
+    return false;
+  }
+
+  header.format[sizeof(header.format) - 1] = '\0';
+  format     = header.format;
+  start_time = header.start_time;
+  duration   = header.duration;
+  bit_rate   = header.bit_rate;
+  probe_ms   = header.probe_ms;
+  return true;
+}
+
+bool OMXProbeInfo::Save(const std::string &dir, const std::string &path, int64_t file_size, int64_t file_mtime) const
+{
+  if(streams.empty() || streams.size() != extradata.size() || format.size() >= sizeof(((OMXProbeHeader *)0)->format))
+    return false;
+
+  mkdir(dir.c_str(), 0755);
+
+  // write to a temporary name first so a reader never sees half a file
+  std::string entry = EntryPath(dir, path);
+  std::string tmp = entry + ".tmp";
+  FILE *fp = fopen(tmp.c_str(), "wb");
+  if(!fp)
+    return false;
+
+  OMXProbeHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, OMX_PROBE_CACHE_MAGIC, sizeof(header.magic));
+  header.file_size   = file_size;
+  header.file_mtime  = file_mtime;
+  header.start_time  = start_time;
+  header.duration    = duration;
+  header.bit_rate    = bit_rate;
+  header.probe_ms    = probe_ms;
+  strncpy(header.format, format.c_str(), sizeof(header.format) - 1);
+  header.path_size   = path.size();
+  header.count       = streams.size();
+  header.stream_size = sizeof(OMXProbeStream);
+
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            fwrite(path.data(), 1, path.size(), fp) == path.size();
+
+  for(size_t i = 0; ok && i < streams.size(); i++)
+  {
+    OMXProbeStream stream = streams[i];
+    stream.extrasize = extradata[i].size();
+    ok = fwrite(&stream, sizeof(stream), 1, fp) == 1;
+    if(ok && stream.extrasize)
+      ok = fwrite(&extradata[i][0], 1, stream.extrasize, fp) == stream.extrasize;
+  }
+  ok = (fclose(fp) == 0) && ok;
+
+  if(ok)
+    ok = rename(tmp.c_str(), entry.c_str()) == 0;
+  if(!ok)
+    remove(tmp.c_str());
+  return ok;
+}
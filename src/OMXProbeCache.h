@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// codec parameters of one stream as avformat_find_stream_info() left them
+typedef struct OMXProbeStream
+{
+  int32_t  codec_type;
+  int32_t  codec_id;
+  uint32_t codec_tag;
+  int32_t  width;
+  int32_t  height;
+  int32_t  profile;
+  int32_t  level;
+  int32_t  channels;
+  int32_t  sample_rate;
+  int32_t  block_align;
+  int32_t  bits_per_coded_sample;
+  int64_t  bit_rate;
+  int32_t  sar_num;           // stream sample aspect ratio
+  int32_t  sar_den;
+  int32_t  codec_sar_num;     // codec sample aspect ratio
+  int32_t  codec_sar_den;
+  int32_t  r_frame_rate_num;
+  int32_t  r_frame_rate_den;
+  int32_t  avg_frame_rate_num;
+  int32_t  avg_frame_rate_den;
+  int64_t  start_time;        // in the stream time base
+  int64_t  duration;
+  uint32_t extrasize;         // extradata follows the stream record in the file
+} OMXProbeStream;
+
+// Result of probing a media file, cached on disk so OMXReader::Open() can
+// skip most of avformat_find_stream_info() the next time the same file is
+// opened.
+//
+// Entries live in one directory, named after a hash of the media path. The
+// entry records path, size and mtime of the file it was made from so a
+// changed or different file is never matched.
+class OMXProbeInfo
+{
+public:
+  OMXProbeInfo();
+  ~OMXProbeInfo();
+
+  void Clear();
+  bool IsEmpty() const { return streams.empty(); }
+
+  bool Load(const std::string &dir, const std::string &path, int64_t file_size, int64_t file_mtime);
+  bool Save(const std::string &dir, const std::string &path, int64_t file_size, int64_t file_mtime) const;
+
+  std::string                         format;     // AVInputFormat short name
+  int64_t                             start_time; // in AV_TIME_BASE
+  int64_t                             duration;
+  int64_t                             bit_rate;
+  double                              probe_ms;   // time the full probe took
+  std::vector<OMXProbeStream>         streams;
+  std::vector<std::vector<uint8_t> >  extradata;
+
+private:
+  static std::string EntryPath(const std::string &dir, const std::string &path);
+};
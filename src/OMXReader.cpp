@@ -30,6 +30,8 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
 
 #include "linux/XMemUtils.h"
 
@@ -70,6 +72,32 @@ OMXReader::OMXReader()
     m_eof           = false;
     m_chapter_count = 0;
     m_iCurrentPts   = DVD_NOPTS_VALUE;
+    m_zero_copy     = false;
+    m_packet_pool   = new OMXPacketPool();
+    m_video_pool    = NULL;
+    m_mmap          = false;
+    m_io_buffer_size = FFMPEG_FILE_BUFFER_SIZE;
+    m_io_adaptive   = false;
+    m_io_last_check = 0;
+    memset(&m_io_stats, 0, sizeof(m_io_stats));
+    memset(&m_io_last_reads, 0, sizeof(m_io_last_reads));
+    m_hints_generation = 0;
+    m_prefetch      = false;
+    m_prefetch_stop = false;
+    m_prefetch_bytes       = 0;
+    m_prefetch_max_bytes   = 0;
+    m_prefetch_max_seconds = 0;
+    m_prefetch_underruns   = 0;
+    m_seek_generation = 0;
+    m_read_generation = 0;
+    memset(&m_probe_stats, 0, sizeof(m_probe_stats));
+    for(int i = 0; i <= OMXSTREAM_SUBTITLE; i++)
+        m_stream_enabled[i] = true;
+    m_seek_index_enabled   = false;
+    m_seek_index_bytes     = false;
+    m_index_thread_running = false;
+    m_index_stop           = false;
+    ResetCopyStats();
     
     for(int i = 0; i < MAX_STREAMS; i++)
         m_streams[i].extradata = NULL;
@@ -77,13 +105,20 @@ OMXReader::OMXReader()
     ClearStreams();
     
     pthread_mutex_init(&m_lock, NULL);
+    pthread_mutex_init(&m_prefetch_lock, NULL);
+    pthread_cond_init(&m_prefetch_cond, NULL);
 }
 
 OMXReader::~OMXReader()
 {
     Close();
+    SetVideoPacketPool(NULL);
+    // packets still out keep it alive
+    m_packet_pool->Unref();
     
     pthread_mutex_destroy(&m_lock);
+    pthread_mutex_destroy(&m_prefetch_lock);
+    pthread_cond_destroy(&m_prefetch_cond);
 }
 
 void OMXReader::Lock()
@@ -158,6 +193,13 @@ bool OMXReader::Open(std::string filename, bool dump_format, bool live /* =false
     AVInputFormat *iformat  = NULL;
     unsigned char *buffer   = NULL;
     unsigned int  flags     = READ_TRUNCATED | READ_BITRATE | READ_CHUNKED;
+    if(m_mmap)
+        flags |= READ_MMAP;
+    
+    int64_t probe_start  = CurrentHostCounter();
+    bool    probe_cached = false;
+    memset(&m_probe_stats, 0, sizeof(m_probe_stats));
+    m_probe_info.Clear();
     
     m_pFormatContext     = m_dllAvFormat.avformat_alloc_context();
     
@@ -251,16 +293,39 @@ bool OMXReader::Open(std::string filename, bool dump_format, bool live /* =false
             return false;
         }
         
-        buffer = (unsigned char*)m_dllAvUtil.av_malloc(FFMPEG_FILE_BUFFER_SIZE);
-        m_ioContext = m_dllAvFormat.avio_alloc_context(buffer, FFMPEG_FILE_BUFFER_SIZE, 0, m_pFile, dvd_file_read, NULL, dvd_file_seek);
+        if(m_mmap && !m_pFile->IsMapped())
+            CLog::Log(LOGWARNING, "COMXPlayer::OpenFile - could not map %s, using stdio", m_filename.c_str());
+        
+        if(m_io_buffer_size < 4096)
+            m_io_buffer_size = 4096;
+        if(m_io_buffer_size > OMX_IO_BUFFER_MAX_SIZE)
+            m_io_buffer_size = OMX_IO_BUFFER_MAX_SIZE;
+        
+        memset(&m_io_stats, 0, sizeof(m_io_stats));
+        memset(&m_io_last_reads, 0, sizeof(m_io_last_reads));
+        m_io_stats.buffer_size = m_io_buffer_size;
+        m_io_last_check = CurrentHostCounter();
+        
+        buffer = (unsigned char*)m_dllAvUtil.av_malloc(m_io_buffer_size);
+        m_ioContext = m_dllAvFormat.avio_alloc_context(buffer, m_io_buffer_size, 0, m_pFile, dvd_file_read, NULL, dvd_file_seek);
         m_ioContext->max_packet_size = 6144;
         if(m_ioContext->max_packet_size)
-            m_ioContext->max_packet_size *= FFMPEG_FILE_BUFFER_SIZE / m_ioContext->max_packet_size;
+            m_ioContext->max_packet_size *= m_io_buffer_size / m_ioContext->max_packet_size;
         
         if(m_pFile->IoControl(IOCTRL_SEEK_POSSIBLE, NULL) == 0)
             m_ioContext->seekable = 0;
         
-        m_dllAvFormat.av_probe_input_buffer(m_ioContext, &iformat, m_filename.c_str(), NULL, 0, 0);
+        int64_t file_size, file_mtime;
+        if(!m_probe_cache_dir.empty() && GetFileStat(&file_size, &file_mtime) &&
+           m_probe_info.Load(m_probe_cache_dir, m_filename, file_size, file_mtime))
+        {
+            // the format is known, no need to sniff the start of the file
+            iformat = m_dllAvFormat.av_find_input_format(m_probe_info.format.c_str());
+            probe_cached = iformat != NULL;
+        }
+        
+        if(!iformat)
+            m_dllAvFormat.av_probe_input_buffer(m_ioContext, &iformat, m_filename.c_str(), NULL, 0, 0);
         
         if(!iformat)
         {
@@ -292,19 +357,62 @@ bool OMXReader::Open(std::string filename, bool dump_format, bool live /* =false
     if (live)
         m_pFormatContext->flags |= AVFMT_FLAG_NOBUFFER;
     
+    int64_t probesize    = m_pFormatContext->probesize;
+    int64_t analyze      = m_pFormatContext->max_analyze_duration;
+    
+    if(probe_cached && !MatchProbeInfo(false))
+        probe_cached = false;
+    
+    // the cache has everything avformat_find_stream_info would work out,
+    // only let it look at the very start of the file
+    if(probe_cached)
+    {
+        m_pFormatContext->probesize = 32;
+        m_pFormatContext->max_analyze_duration = 1;
+    }
+    
     result = m_dllAvFormat.avformat_find_stream_info(m_pFormatContext, NULL);
+    
+    if(probe_cached && (result < 0 || !MatchProbeInfo(true)))
+    {
+        CLog::Log(LOGDEBUG, "COMXPlayer::OpenFile - cached probe of %s does not match, probing again", m_filename.c_str());
+        probe_cached = false;
+        m_pFormatContext->probesize = probesize;
+        m_pFormatContext->max_analyze_duration = analyze;
+        result = m_dllAvFormat.avformat_find_stream_info(m_pFormatContext, NULL);
+    }
+    
     if(result < 0)
     {
         Close();
         return false;
     }
     
+    if(probe_cached)
+        ApplyProbeInfo();
+    
     if(!GetStreams())
     {
         Close();
         return false;
     }
     
+    m_probe_stats.probe_ms = (CurrentHostCounter() - probe_start) / 1000000.0;
+    if(probe_cached)
+    {
+        m_probe_stats.cache_hit = true;
+        m_probe_stats.saved_ms  = std::max(0.0, m_probe_info.probe_ms - m_probe_stats.probe_ms);
+        CLog::Log(LOGDEBUG, "COMXPlayer::OpenFile - probe cache hit for %s, %.1f ms saved", m_filename.c_str(), m_probe_stats.saved_ms);
+    }
+    else if(m_pFile && !m_probe_cache_dir.empty())
+    {
+        CaptureProbeInfo(m_probe_stats.probe_ms);
+        
+        int64_t file_size, file_mtime;
+        if(GetFileStat(&file_size, &file_mtime) && !m_probe_info.Save(m_probe_cache_dir, m_filename, file_size, file_mtime))
+            CLog::Log(LOGDEBUG, "COMXPlayer::OpenFile - could not write probe cache for %s", m_filename.c_str());
+    }
+    
     if(m_pFile)
     {
         int64_t len = m_pFile->GetLength();
@@ -326,6 +434,9 @@ bool OMXReader::Open(std::string filename, bool dump_format, bool live /* =false
     
     UpdateCurrentPTS();
     
+    if(m_seek_index_enabled)
+        BuildSeekIndex();
+    
     m_open        = true;
     
     return true;
@@ -355,6 +466,7 @@ void OMXReader::ClearStreams()
         m_streams[i].extrasize  = 0;
         m_streams[i].index      = 0;
         m_streams[i].id         = 0;
+        m_streams[i].hints_generation = 0;
     }
     
     m_program     = UINT_MAX;
@@ -362,6 +474,12 @@ void OMXReader::ClearStreams()
 
 bool OMXReader::Close()
 {
+    StopPrefetch();
+    StopIndexScan();
+    m_seek_index.Clear();
+    m_seek_index_bytes = false;
+    m_probe_info.Clear();
+    
     if (m_pFormatContext)
     {
         if (m_ioContext && m_pFormatContext->pb && m_pFormatContext->pb != m_ioContext)
@@ -411,6 +529,10 @@ bool OMXReader::Close()
     
     ClearStreams();
     
+    for(unsigned int i = 0; i < m_side_extradata.size(); i++)
+        free(m_side_extradata[i]);
+    m_side_extradata.clear();
+    
     return true;
 }
 
@@ -450,7 +572,26 @@ bool OMXReader::SeekTime(int time, bool backwords, double *startpts)
         seek_pts += m_pFormatContext->start_time;
     
     RESET_TIMEOUT(1);
-    int ret = m_dllAvFormat.av_seek_frame(m_pFormatContext, -1, seek_pts, backwords ? AVSEEK_FLAG_BACKWARD : 0);
+    int ret = -1;
+    const OMXSeekIndexEntry *entry = NULL;
+    if(m_video_index >= 0)
+        entry = m_seek_index.Find(DVD_MSEC_TO_TIME(time));
+    
+    if(entry)
+    {
+        // go straight to the keyframe before the target, the caller decodes up to it
+        int stream_index = m_streams[m_video_index].id;
+        if(m_seek_index_bytes && entry->pos >= 0)
+            ret = m_dllAvFormat.av_seek_frame(m_pFormatContext, stream_index, entry->pos, AVSEEK_FLAG_BYTE);
+        else
+            ret = m_dllAvFormat.av_seek_frame(m_pFormatContext, stream_index, entry->ts, AVSEEK_FLAG_BACKWARD);
+        
+        if(ret < 0)
+            CLog::Log(LOGDEBUG, "OMXReader::SeekTime(%d) - index seek to frame %d failed", time, entry->frame);
+    }
+    
+    if(ret < 0)
+        ret = m_dllAvFormat.av_seek_frame(m_pFormatContext, -1, seek_pts, backwords ? AVSEEK_FLAG_BACKWARD : 0);
     
     if(ret >= 0)
         UpdateCurrentPTS();
@@ -469,11 +610,318 @@ bool OMXReader::SeekTime(int time, bool backwords, double *startpts)
     
     CLog::Log(LOGDEBUG, "OMXReader::SeekTime(%d) - seek ended up on time %d",time,(int)(m_iCurrentPts / DVD_TIME_BASE * 1000));
     
+    // anything read ahead is from before the seek
+    m_seek_generation++;
+    if(m_prefetch)
+        PrefetchClear();
+    
     UnLock();
     
     return (ret >= 0);
 }
 
+int OMXReader::IndexFrame(AVStream *stream, double pts)
+{
+    AVRational rate = stream->avg_frame_rate;
+    if(!rate.num || !rate.den)
+        rate = stream->r_frame_rate;
+    if(!rate.num || !rate.den || pts == DVD_NOPTS_VALUE)
+        return -1;
+    
+    return (int)(pts * rate.num / rate.den / DVD_TIME_BASE + 0.5);
+}
+
+bool OMXReader::GetFileStat(int64_t *size, int64_t *mtime)
+{
+    struct stat64 st;
+    if(stat64(m_filename.c_str(), &st) != 0)
+        return false;
+    
+    *size  = st.st_size;
+    *mtime = st.st_mtime;
+    return true;
+}
+
+void OMXReader::BuildSeekIndex()
+{
+    m_seek_index.Clear();
+    m_seek_index_bytes = false;
+    
+    if(m_video_index < 0)
+        return;
+    
+    AVStream *stream = m_streams[m_video_index].stream;
+    
+    // mp4/mov, mkv with cues and indexed avi come with one
+    int count = m_dllAvFormat.avformat_index_get_entries_count(stream);
+    for(int i = 0; i < count; i++)
+    {
+        const AVIndexEntry *e = m_dllAvFormat.avformat_index_get_entry(stream, i);
+        if(!e || !(e->flags & AVINDEX_KEYFRAME))
+            continue;
+        
+        double pts = ConvertTimestamp(e->timestamp, stream->time_base.den, stream->time_base.num);
+        m_seek_index.Add(e->pos, e->timestamp, pts, IndexFrame(stream, pts));
+    }
+    m_seek_index.Finish();
+    
+    // formats without an index of their own only have the keyframes lavf came
+    // across while probing, don't trust that unless it covers the whole file
+    int length = GetStreamLength();
+    if(!m_seek_index.IsEmpty() && length > 0)
+    {
+        const OMXSeekIndexEntry *last = m_seek_index.Find(DVD_MSEC_TO_TIME(length));
+        if(!last || last->pts < DVD_MSEC_TO_TIME(length) - std::max(DVD_MSEC_TO_TIME(10000), DVD_MSEC_TO_TIME(length / 10)))
+            m_seek_index.Clear();
+    }
+    
+    if(!m_seek_index.IsEmpty())
+    {
+        CLog::Log(LOGDEBUG, "OMXReader::BuildSeekIndex - %d keyframes from the container", (int)m_seek_index.Size());
+        return;
+    }
+    
+    // only local files get a cached index or a scan
+    int64_t size, mtime;
+    if(!m_pFile || !GetFileStat(&size, &mtime))
+        return;
+    
+    if(!m_seek_index_dir.empty() && m_seek_index.Load(m_seek_index_dir, m_filename, size, mtime))
+    {
+        m_seek_index_bytes = true;
+        CLog::Log(LOGDEBUG, "OMXReader::BuildSeekIndex - %d keyframes for %s from %s", (int)m_seek_index.Size(), m_filename.c_str(), m_seek_index_dir.c_str());
+        return;
+    }
+    
+    m_index_stop = false;
+    if(pthread_create(&m_index_thread, NULL, IndexRun, this) == 0)
+        m_index_thread_running = true;
+}
+
+void *OMXReader::IndexRun(void *arg)
+{
+    OMXReader *reader = (OMXReader *)arg;
+    reader->IndexScan();
+    return NULL;
+}
+
+// runs on its own thread with a second demuxer, so playback isn't held up
+void OMXReader::IndexScan()
+{
+    AVFormatContext *context = NULL;
+    if(m_dllAvFormat.avformat_open_input(&context, m_filename.c_str(), NULL, NULL) < 0)
+    {
+        CLog::Log(LOGWARNING, "OMXReader::IndexScan - could not open %s", m_filename.c_str());
+        return;
+    }
+    
+    Lock();
+    AVStream *video = m_video_index >= 0 ? m_streams[m_video_index].stream : NULL;
+    int video_id    = video ? video->id : 0;
+    int video_index = video ? m_streams[m_video_index].id : -1;
+    UnLock();
+    
+    if(!video)
+    {
+        m_dllAvFormat.avformat_close_input(&context);
+        return;
+    }
+    
+    OMXSeekIndex index;
+    AVPacket pkt;
+    m_dllAvCodec.av_init_packet(&pkt);
+    pkt.data = NULL;
+    pkt.size = 0;
+    
+    while(!m_index_stop && m_dllAvFormat.av_read_frame(context, &pkt) >= 0)
+    {
+        AVStream *stream = context->streams[pkt.stream_index];
+        // match by id (the pid in ts) as the second demuxer may number its streams differently
+        bool is_video = video_id ? stream->id == video_id : pkt.stream_index == video_index;
+        
+        if(is_video && (pkt.flags & AV_PKT_FLAG_KEY))
+        {
+            int64_t ts = pkt.pts != (int64_t)AV_NOPTS_VALUE ? pkt.pts : pkt.dts;
+            if(ts != (int64_t)AV_NOPTS_VALUE)
+            {
+                double pts = ConvertTimestamp(ts, stream->time_base.den, stream->time_base.num);
+                index.Add(pkt.pos, ts, pts, IndexFrame(stream, pts));
+            }
+        }
+        m_dllAvCodec.av_packet_unref(&pkt);
+    }
+    m_dllAvFormat.avformat_close_input(&context);
+    
+    if(m_index_stop || index.IsEmpty())
+        return;
+    
+    index.Finish();
+    
+    int64_t size, mtime;
+    if(!m_seek_index_dir.empty() && GetFileStat(&size, &mtime) && !index.Save(m_seek_index_dir, m_filename, size, mtime))
+        CLog::Log(LOGDEBUG, "OMXReader::IndexScan - could not write the index of %s to %s", m_filename.c_str(), m_seek_index_dir.c_str());
+    
+    CLog::Log(LOGDEBUG, "OMXReader::IndexScan - %d keyframes in %s", (int)index.Size(), m_filename.c_str());
+    
+    Lock();
+    m_seek_index       = index;
+    m_seek_index_bytes = true;
+    UnLock();
+}
+
+void OMXReader::StopIndexScan()
+{
+    if(!m_index_thread_running)
+        return;
+    
+    m_index_stop = true;
+    pthread_join(m_index_thread, NULL);
+    m_index_thread_running = false;
+}
+
+size_t OMXReader::GetSeekIndexSize()
+{
+    Lock();
+    size_t size = m_seek_index.Size();
+    UnLock();
+    return size;
+}
+
+bool OMXReader::MatchProbeInfo(bool all_streams)
+{
+    if(m_probe_info.format != m_pFormatContext->iformat->name)
+        return false;
+    
+    unsigned int count = m_probe_info.streams.size();
+    if(m_pFormatContext->nb_streams > count || (all_streams && m_pFormatContext->nb_streams != count))
+        return false;
+    
+    // streams the demuxer has already seen must be the ones in the cache
+    for(unsigned int i = 0; i < m_pFormatContext->nb_streams; i++)
+    {
+        AVCodecContext *codec = m_pFormatContext->streams[i]->codec;
+        if(codec->codec_type != AVMEDIA_TYPE_UNKNOWN && codec->codec_type != m_probe_info.streams[i].codec_type)
+            return false;
+        if(codec->codec_id != AV_CODEC_ID_NONE && codec->codec_id != m_probe_info.streams[i].codec_id)
+            return false;
+    }
+    return true;
+}
+
+// fill in what the shortened avformat_find_stream_info didn't get to
+void OMXReader::ApplyProbeInfo()
+{
+    if(m_pFormatContext->start_time == (int64_t)AV_NOPTS_VALUE)
+        m_pFormatContext->start_time = m_probe_info.start_time;
+    if(m_pFormatContext->duration == (int64_t)AV_NOPTS_VALUE || m_pFormatContext->duration <= 0)
+        m_pFormatContext->duration = m_probe_info.duration;
+    if(!m_pFormatContext->bit_rate)
+        m_pFormatContext->bit_rate = m_probe_info.bit_rate;
+    
+    for(unsigned int i = 0; i < m_pFormatContext->nb_streams; i++)
+    {
+        const OMXProbeStream &info = m_probe_info.streams[i];
+        AVStream *stream = m_pFormatContext->streams[i];
+        AVCodecContext *codec = stream->codec;
+        
+        codec->codec_type = (AVMediaType)info.codec_type;
+        codec->codec_id   = (AVCodecID)info.codec_id;
+        if(!codec->codec_tag)             codec->codec_tag             = info.codec_tag;
+        if(!codec->width)                 codec->width                 = info.width;
+        if(!codec->height)                codec->height                = info.height;
+        if(codec->profile == FF_PROFILE_UNKNOWN) codec->profile        = info.profile;
+        if(codec->level == FF_LEVEL_UNKNOWN)     codec->level          = info.level;
+        if(!codec->channels)              codec->channels              = info.channels;
+        if(!codec->sample_rate)           codec->sample_rate           = info.sample_rate;
+        if(!codec->block_align)           codec->block_align           = info.block_align;
+        if(!codec->bits_per_coded_sample) codec->bits_per_coded_sample = info.bits_per_coded_sample;
+        if(!codec->bit_rate)              codec->bit_rate              = info.bit_rate;
+        
+        if(!codec->sample_aspect_ratio.num)
+        {
+            codec->sample_aspect_ratio.num = info.codec_sar_num;
+            codec->sample_aspect_ratio.den = info.codec_sar_den;
+        }
+        if(!stream->sample_aspect_ratio.num)
+        {
+            stream->sample_aspect_ratio.num = info.sar_num;
+            stream->sample_aspect_ratio.den = info.sar_den;
+        }
+        if(!stream->r_frame_rate.num || !stream->r_frame_rate.den)
+        {
+            stream->r_frame_rate.num = info.r_frame_rate_num;
+            stream->r_frame_rate.den = info.r_frame_rate_den;
+        }
+        if(!stream->avg_frame_rate.num || !stream->avg_frame_rate.den)
+        {
+            stream->avg_frame_rate.num = info.avg_frame_rate_num;
+            stream->avg_frame_rate.den = info.avg_frame_rate_den;
+        }
+        if(stream->start_time == (int64_t)AV_NOPTS_VALUE)
+            stream->start_time = info.start_time;
+        if(stream->duration == (int64_t)AV_NOPTS_VALUE || stream->duration <= 0)
+            stream->duration = info.duration;
+        
+        const std::vector<uint8_t> &extra = m_probe_info.extradata[i];
+        if(codec->extradata_size <= 0 && !extra.empty())
+        {
+            codec->extradata = (uint8_t *)m_dllAvUtil.av_mallocz(extra.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+            if(codec->extradata)
+            {
+                memcpy(codec->extradata, &extra[0], extra.size());
+                codec->extradata_size = extra.size();
+            }
+        }
+    }
+}
+
+void OMXReader::CaptureProbeInfo(double probe_ms)
+{
+    m_probe_info.Clear();
+    m_probe_info.format     = m_pFormatContext->iformat->name;
+    m_probe_info.start_time = m_pFormatContext->start_time;
+    m_probe_info.duration   = m_pFormatContext->duration;
+    m_probe_info.bit_rate   = m_pFormatContext->bit_rate;
+    m_probe_info.probe_ms   = probe_ms;
+    
+    for(unsigned int i = 0; i < m_pFormatContext->nb_streams; i++)
+    {
+        AVStream *stream = m_pFormatContext->streams[i];
+        AVCodecContext *codec = stream->codec;
+        
+        OMXProbeStream info;
+        memset(&info, 0, sizeof(info));
+        info.codec_type            = codec->codec_type;
+        info.codec_id              = codec->codec_id;
+        info.codec_tag             = codec->codec_tag;
+        info.width                 = codec->width;
+        info.height                = codec->height;
+        info.profile               = codec->profile;
+        info.level                 = codec->level;
+        info.channels              = codec->channels;
+        info.sample_rate           = codec->sample_rate;
+        info.block_align           = codec->block_align;
+        info.bits_per_coded_sample = codec->bits_per_coded_sample;
+        info.bit_rate              = codec->bit_rate;
+        info.sar_num               = stream->sample_aspect_ratio.num;
+        info.sar_den               = stream->sample_aspect_ratio.den;
+        info.codec_sar_num         = codec->sample_aspect_ratio.num;
+        info.codec_sar_den         = codec->sample_aspect_ratio.den;
+        info.r_frame_rate_num      = stream->r_frame_rate.num;
+        info.r_frame_rate_den      = stream->r_frame_rate.den;
+        info.avg_frame_rate_num    = stream->avg_frame_rate.num;
+        info.avg_frame_rate_den    = stream->avg_frame_rate.den;
+        info.start_time            = stream->start_time;
+        info.duration              = stream->duration;
+        m_probe_info.streams.push_back(info);
+        
+        std::vector<uint8_t> extra;
+        if(codec->extradata && codec->extradata_size > 0)
+            extra.assign(codec->extradata, codec->extradata + codec->extradata_size);
+        m_probe_info.extradata.push_back(extra);
+    }
+}
+
 AVMediaType OMXReader::PacketType(OMXPacket *pkt)
 {
     if(!m_pFormatContext || !pkt)
@@ -483,6 +931,248 @@ AVMediaType OMXReader::PacketType(OMXPacket *pkt)
 }
 
 OMXPacket *OMXReader::Read()
+{
+    if(!m_prefetch)
+        return ReadPacket();
+    
+    OMXPacket *pkt = NULL;
+    
+    pthread_mutex_lock(&m_prefetch_lock);
+    if(m_prefetch_packets.empty() && !m_eof)
+    {
+        m_prefetch_underruns++;
+        
+        // give the read-ahead thread a moment to finish the packet it is on
+        struct timespec endtime;
+        clock_gettime(CLOCK_REALTIME, &endtime);
+        endtime.tv_nsec += 20 * 1000000;
+        if(endtime.tv_nsec >= 1000000000)
+        {
+            endtime.tv_sec++;
+            endtime.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&m_prefetch_cond, &m_prefetch_lock, &endtime);
+    }
+    
+    if(!m_prefetch_packets.empty())
+    {
+        pkt = m_prefetch_packets.front();
+        m_prefetch_packets.pop_front();
+        m_prefetch_bytes -= pkt->size;
+        pthread_cond_broadcast(&m_prefetch_cond);
+    }
+    pthread_mutex_unlock(&m_prefetch_lock);
+    
+    return pkt;
+}
+
+// called with m_lock held, once per packet. recomputes the rates once a second
+void OMXReader::UpdateIOStats()
+{
+    int64_t now = CurrentHostCounter();
+    double elapsed = (now - m_io_last_check) / 1e9;
+    if(elapsed < 1.0)
+        return;
+    
+    XFILE::SReadStats reads = m_pFile->GetReadStats();
+    int64_t count = reads.reads - m_io_last_reads.reads;
+    int64_t full  = reads.full_reads - m_io_last_reads.full_reads;
+    
+    m_io_stats.reads_per_sec       = count / elapsed;
+    m_io_stats.stdio_reads_per_sec = (reads.stdio_reads - m_io_last_reads.stdio_reads) / elapsed;
+    m_io_stats.kb_per_sec          = (reads.bytes - m_io_last_reads.bytes) / elapsed / 1024.0;
+    m_io_stats.full_ratio          = count ? (double)full / count : 0.0;
+    
+    m_io_last_reads = reads;
+    m_io_last_check = now;
+    
+    // a small buffer that is refilled completely more than 50 times a second
+    // means the input bitrate outruns it, double it
+    if(m_io_adaptive && m_ioContext && m_io_stats.full_ratio > 0.9 &&
+       m_io_stats.reads_per_sec > 50 && m_io_buffer_size < OMX_IO_BUFFER_MAX_SIZE)
+    {
+        if(ResizeIOBuffer(m_io_buffer_size * 2))
+        {
+            m_io_stats.grows++;
+            CLog::Log(LOGDEBUG, "OMXReader::UpdateIOStats - AVIO buffer grown to %u bytes at %.0f KB/s", m_io_buffer_size, m_io_stats.kb_per_sec);
+        }
+    }
+}
+
+// called between packets. Opens a new AVIO context with the bigger buffer at
+// the position the demuxer has read up to, the old one drops its unread bytes
+bool OMXReader::ResizeIOBuffer(unsigned int size)
+{
+    if(m_pFormatContext->pb != m_ioContext || !m_ioContext->seekable)
+        return false;
+    
+    int64_t pos = m_dllAvFormat.avio_seek(m_ioContext, 0, SEEK_CUR);
+    if(pos < 0)
+        return false;
+    
+    unsigned char *buffer = (unsigned char*)m_dllAvUtil.av_malloc(size);
+    if(!buffer)
+        return false;
+    
+    AVIOContext *context = m_dllAvFormat.avio_alloc_context(buffer, size, 0, m_pFile, dvd_file_read, NULL, dvd_file_seek);
+    if(!context)
+    {
+        m_dllAvUtil.av_free(buffer);
+        return false;
+    }
+    context->max_packet_size = 6144 * (size / 6144);
+    context->seekable        = m_ioContext->seekable;
+    
+    // a new context assumes the file is at 0, short seeks are done by reading
+    if(dvd_file_seek(m_pFile, 0, SEEK_SET) != 0 || m_dllAvFormat.avio_seek(context, pos, SEEK_SET) != pos)
+    {
+        // put the file back where the old context expects it
+        dvd_file_seek(m_pFile, m_ioContext->pos, SEEK_SET);
+        m_dllAvUtil.av_free(context->buffer);
+        m_dllAvUtil.av_free(context);
+        return false;
+    }
+    
+    m_dllAvUtil.av_free(m_ioContext->buffer);
+    m_dllAvUtil.av_free(m_ioContext);
+    m_ioContext = context;
+    m_pFormatContext->pb = m_ioContext;
+    
+    m_io_buffer_size = size;
+    m_io_stats.buffer_size = size;
+    return true;
+}
+
+bool OMXReader::StartPrefetch(unsigned int max_bytes, double max_seconds)
+{
+    if(m_prefetch || !m_pFormatContext)
+        return false;
+    
+    m_prefetch_max_bytes   = max_bytes;
+    m_prefetch_max_seconds = max_seconds;
+    m_prefetch_underruns   = 0;
+    m_prefetch_stop        = false;
+    
+    if(pthread_create(&m_prefetch_thread, NULL, &OMXReader::PrefetchRun, this) != 0)
+    {
+        CLog::Log(LOGERROR, "OMXReader::StartPrefetch - could not create read-ahead thread");
+        return false;
+    }
+    
+    m_prefetch = true;
+    return true;
+}
+
+void OMXReader::StopPrefetch()
+{
+    if(!m_prefetch)
+        return;
+    
+    pthread_mutex_lock(&m_prefetch_lock);
+    m_prefetch_stop = true;
+    pthread_cond_broadcast(&m_prefetch_cond);
+    pthread_mutex_unlock(&m_prefetch_lock);
+    
+    pthread_join(m_prefetch_thread, NULL);
+    
+    m_prefetch = false;
+    PrefetchClear();
+}
+
+void *OMXReader::PrefetchRun(void *arg)
+{
+    static_cast<OMXReader *>(arg)->PrefetchProcess();
+    return NULL;
+}
+
+void OMXReader::PrefetchProcess()
+{
+    while(true)
+    {
+        pthread_mutex_lock(&m_prefetch_lock);
+        while(!m_prefetch_stop && (m_eof || PrefetchFull()))
+            pthread_cond_wait(&m_prefetch_cond, &m_prefetch_lock);
+        bool stop = m_prefetch_stop;
+        pthread_mutex_unlock(&m_prefetch_lock);
+        
+        if(stop)
+            break;
+        
+        OMXPacket *pkt = ReadPacket();
+        
+        pthread_mutex_lock(&m_prefetch_lock);
+        if(pkt && m_read_generation == m_seek_generation)
+        {
+            m_prefetch_packets.push_back(pkt);
+            m_prefetch_bytes += pkt->size;
+        }
+        else if(pkt)
+        {
+            // a seek happened while we were reading this one
+            FreePacket(pkt);
+        }
+        pthread_cond_broadcast(&m_prefetch_cond);
+        pthread_mutex_unlock(&m_prefetch_lock);
+    }
+}
+
+// called with m_prefetch_lock held
+bool OMXReader::PrefetchFull()
+{
+    if(m_prefetch_max_bytes && m_prefetch_bytes >= m_prefetch_max_bytes)
+        return true;
+    
+    if(m_prefetch_max_seconds > 0 && PrefetchSeconds() >= m_prefetch_max_seconds)
+        return true;
+    
+    return false;
+}
+
+// called with m_prefetch_lock held
+double OMXReader::PrefetchSeconds()
+{
+    if(m_prefetch_packets.size() < 2)
+        return 0;
+    
+    OMXPacket *first = m_prefetch_packets.front();
+    OMXPacket *last  = m_prefetch_packets.back();
+    double start = first->dts != DVD_NOPTS_VALUE ? first->dts : first->pts;
+    double end   = last->dts  != DVD_NOPTS_VALUE ? last->dts  : last->pts;
+    
+    if(start == DVD_NOPTS_VALUE || end == DVD_NOPTS_VALUE || end < start)
+        return 0;
+    
+    return (end - start) / DVD_TIME_BASE;
+}
+
+void OMXReader::PrefetchClear()
+{
+    pthread_mutex_lock(&m_prefetch_lock);
+    while(!m_prefetch_packets.empty())
+    {
+        FreePacket(m_prefetch_packets.front());
+        m_prefetch_packets.pop_front();
+    }
+    m_prefetch_bytes = 0;
+    pthread_cond_broadcast(&m_prefetch_cond);
+    pthread_mutex_unlock(&m_prefetch_lock);
+}
+
+OMXReaderPrefetchStats OMXReader::GetPrefetchStats()
+{
+    OMXReaderPrefetchStats stats;
+    
+    pthread_mutex_lock(&m_prefetch_lock);
+    stats.packets   = m_prefetch_packets.size();
+    stats.bytes     = m_prefetch_bytes;
+    stats.seconds   = PrefetchSeconds();
+    stats.underruns = m_prefetch_underruns;
+    pthread_mutex_unlock(&m_prefetch_lock);
+    
+    return stats;
+}
+
+OMXPacket *OMXReader::ReadPacket()
 {
     AVPacket  pkt;
     OMXPacket *m_omx_pkt = NULL;
@@ -493,54 +1183,60 @@ OMXPacket *OMXReader::Read()
     
     Lock();
     
+    m_read_generation = m_seek_generation;
+    
+    if(m_pFile)
+        UpdateIOStats();
+    
     // assume we are not eof
     if(m_pFormatContext->pb)
         m_pFormatContext->pb->eof_reached = 0;
     
-    // keep track if ffmpeg doesn't always set these
-    pkt.size = 0;
-    pkt.data = NULL;
-    pkt.stream_index = MAX_OMX_STREAMS;
-    
-    RESET_TIMEOUT(1);
-    result = m_dllAvFormat.av_read_frame(m_pFormatContext, &pkt);
-    if (result < 0)
-    {
-        m_eof = true;
-        //FlushRead();
-        //m_dllAvCodec.av_free_packet(&pkt);
-        UnLock();
-        return NULL;
-    }
-    
-    if (pkt.size < 0 || pkt.stream_index >= MAX_OMX_STREAMS || interrupt_cb(NULL))
+    for(;;)
     {
-        // XXX, in some cases ffmpeg returns a negative packet size
-        if(m_pFormatContext->pb && !m_pFormatContext->pb->eof_reached)
+        // keep track if ffmpeg doesn't always set these
+        pkt.size = 0;
+        pkt.data = NULL;
+        pkt.stream_index = MAX_OMX_STREAMS;
+        
+        RESET_TIMEOUT(1);
+        result = m_dllAvFormat.av_read_frame(m_pFormatContext, &pkt);
+        if (result < 0)
         {
-            CLog::Log(LOGERROR, "OMXReader::Read no valid packet");
+            m_eof = true;
             //FlushRead();
+            //m_dllAvCodec.av_free_packet(&pkt);
+            UnLock();
+            return NULL;
         }
         
-        m_dllAvCodec.av_free_packet(&pkt);
+        if (pkt.size < 0 || pkt.stream_index >= MAX_OMX_STREAMS || interrupt_cb(NULL))
+        {
+            // XXX, in some cases ffmpeg returns a negative packet size
+            if(m_pFormatContext->pb && !m_pFormatContext->pb->eof_reached)
+            {
+                CLog::Log(LOGERROR, "OMXReader::Read no valid packet");
+                //FlushRead();
+            }
+            
+            m_dllAvCodec.av_free_packet(&pkt);
+            
+            m_eof = true;
+            UnLock();
+            return NULL;
+        }
         
-        m_eof = true;
-        UnLock();
-        return NULL;
+        /* only read packets for active streams, most demuxers already skip
+           them because of AVDISCARD_ALL but not all of them do */
+        if(IsActive(pkt.stream_index))
+            break;
+        
+        m_copy_stats.bytes_dropped += pkt.size;
+        m_dllAvCodec.av_free_packet(&pkt);
     }
     
     AVStream *pStream = m_pFormatContext->streams[pkt.stream_index];
     
-    /* only read packets for active streams */
-    /*
-     if(!IsActive(pkt.stream_index))
-     {
-     m_dllAvCodec.av_free_packet(&pkt);
-     UnLock();
-     return NULL;
-     }
-     */
-    
     // lavf sometimes bugs out and gives 0 dts/pts instead of no dts/pts
     // since this could only happens on initial frame under normal
     // circomstances, let's assume it is wrong all the time
@@ -573,7 +1269,23 @@ OMXPacket *OMXReader::Read()
         pkt.pts = AV_NOPTS_VALUE;
     }
     
-    m_omx_pkt = AllocPacket(pkt.size);
+    // only ref-counted packets can be adopted, anything else is copied
+    bool adopt = m_zero_copy && pkt.buf && pkt.data;
+    
+    m_omx_pkt = NULL;
+    if(m_video_pool && pStream->codec->codec_type == AVMEDIA_TYPE_VIDEO)
+    {
+        // straight into memory the decoder registered, no copy after this one
+        m_omx_pkt = m_video_pool->Alloc(pkt.size);
+        if(m_omx_pkt)
+        {
+            adopt = false;
+        }
+    }
+    if(!m_omx_pkt)
+    {
+        m_omx_pkt = adopt ? m_packet_pool->AllocAdopted() : m_packet_pool->Alloc(pkt.size);
+    }
     /* oom error allocation av packet */
     if(!m_omx_pkt)
     {
@@ -585,19 +1297,53 @@ OMXPacket *OMXReader::Read()
     
     m_omx_pkt->codec_type = pStream->codec->codec_type;
     
-    /* copy content into our own packet */
-    m_omx_pkt->size = pkt.size;
-    
-    if (pkt.data)
-        memcpy(m_omx_pkt->data, pkt.data, m_omx_pkt->size);
+    if(adopt)
+    {
+        /* reference the demuxer buffer, released again in FreePacket */
+        if(m_dllAvCodec.av_packet_ref(&m_omx_pkt->avpkt, &pkt) < 0)
+        {
+            FreePacket(m_omx_pkt);
+            m_omx_pkt = NULL;
+            m_eof = true;
+            m_dllAvCodec.av_free_packet(&pkt);
+            UnLock();
+            return NULL;
+        }
+        m_omx_pkt->adopted = true;
+        m_omx_pkt->data    = m_omx_pkt->avpkt.data;
+        m_omx_pkt->size    = m_omx_pkt->avpkt.size;
+        m_copy_stats.bytes_adopted += m_omx_pkt->size;
+    }
+    else
+    {
+        /* copy content into our own packet */
+        m_omx_pkt->size = pkt.size;
+        
+        if (pkt.data)
+            memcpy(m_omx_pkt->data, pkt.data, m_omx_pkt->size);
+        m_copy_stats.bytes_copied += m_omx_pkt->size;
+    }
     
     m_omx_pkt->stream_index = pkt.stream_index;
-    GetHints(pStream, &m_omx_pkt->hints);
+    
+    // hints are cached per stream, only change them when the demuxer signals it
+    if(pkt.side_data_elems)
+    {
+        int extrasize = 0, param_size = 0;
+        uint8_t *extradata = m_dllAvCodec.av_packet_get_side_data(&pkt, AV_PKT_DATA_NEW_EXTRADATA, &extrasize);
+        uint8_t *param = m_dllAvCodec.av_packet_get_side_data(&pkt, AV_PKT_DATA_PARAM_CHANGE, &param_size);
+        if(extradata || param)
+            ApplyStreamSideData(pkt.stream_index, extradata, extrasize, param, param_size);
+    }
+    m_omx_pkt->hints_generation = m_streams[pkt.stream_index].hints_generation;
     
     m_omx_pkt->dts = ConvertTimestamp(pkt.dts, pStream->time_base.den, pStream->time_base.num);
     m_omx_pkt->pts = ConvertTimestamp(pkt.pts, pStream->time_base.den, pStream->time_base.num);
     m_omx_pkt->duration = DVD_SEC_TO_TIME((double)pkt.duration * pStream->time_base.num / pStream->time_base.den);
     
+    if(IsActive(m_video_index != -1 ? OMXSTREAM_VIDEO : OMXSTREAM_AUDIO, pkt.stream_index))
+        m_copy_stats.media_seconds += (double)pkt.duration * pStream->time_base.num / pStream->time_base.den;
+    
     // used to guess streamlength
     if (m_omx_pkt->dts != DVD_NOPTS_VALUE && (m_omx_pkt->dts > m_iCurrentPts || m_iCurrentPts == DVD_NOPTS_VALUE))
         m_iCurrentPts = m_omx_pkt->dts;
@@ -735,7 +1481,7 @@ void OMXReader::AddStream(int id)
             m_streams[id].codec_name  = GetStreamCodecName(pStream);
             m_streams[id].id          = id;
             m_audio_count++;
-            GetHints(pStream, &m_streams[id].hints);
+            UpdateStreamHints(id);
             break;
         case AVMEDIA_TYPE_VIDEO:
             m_streams[id].stream      = pStream;
@@ -744,7 +1490,7 @@ void OMXReader::AddStream(int id)
             m_streams[id].codec_name  = GetStreamCodecName(pStream);
             m_streams[id].id          = id;
             m_video_count++;
-            GetHints(pStream, &m_streams[id].hints);
+            UpdateStreamHints(id);
             break;
         case AVMEDIA_TYPE_SUBTITLE:
             m_streams[id].stream      = pStream;
@@ -753,7 +1499,7 @@ void OMXReader::AddStream(int id)
             m_streams[id].codec_name  = GetStreamCodecName(pStream);
             m_streams[id].id          = id;
             m_subtitle_count++;
-            GetHints(pStream, &m_streams[id].hints);
+            UpdateStreamHints(id);
             break;
         default:
             return;
@@ -783,6 +1529,104 @@ void OMXReader::AddStream(int id)
     }
 }
 
+void OMXReader::UpdateStreamHints(int id)
+{
+    if(id < 0 || id >= MAX_STREAMS || !m_streams[id].stream)
+        return;
+    
+    GetHints(m_streams[id].stream, &m_streams[id].hints);
+    m_streams[id].hints_generation = ++m_hints_generation;
+}
+
+static bool ReadSideDataLE32(const uint8_t *&data, const uint8_t *end, uint32_t &value)
+{
+    if(end - data < 4)
+        return false;
+    value = data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+    data += 4;
+    return true;
+}
+
+// the stream's codec context isn't updated by the demuxer for these, the
+// packet's side data is the only place the new parameters show up
+void OMXReader::ApplyStreamSideData(int id, const uint8_t *extradata, int extrasize, const uint8_t *param, int param_size)
+{
+    if(id < 0 || id >= MAX_STREAMS || !m_streams[id].stream)
+        return;
+    
+    COMXStreamInfo &hints = m_streams[id].hints;
+    bool changed = false;
+    
+    if(extradata && extrasize > 0 &&
+       ((unsigned int)extrasize != hints.extrasize || !hints.extradata ||
+        memcmp(hints.extradata, extradata, extrasize) != 0))
+    {
+        void *copy = malloc(extrasize + AV_INPUT_BUFFER_PADDING_SIZE);
+        if(copy)
+        {
+            memcpy(copy, extradata, extrasize);
+            memset((uint8_t *)copy + extrasize, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+            m_side_extradata.push_back(copy);
+            hints.extradata = copy;
+            hints.extrasize = extrasize;
+            changed = true;
+        }
+    }
+    
+    // le32 flags, then the fields the flags name in this order: le32 channel
+    // count, le64 channel layout, le32 sample rate, le32 width and height
+    if(param)
+    {
+        const uint8_t *data = param;
+        const uint8_t *end  = param + param_size;
+        uint32_t flags = 0, value = 0, height = 0;
+        
+        if(!ReadSideDataLE32(data, end, flags))
+            flags = 0;
+        
+        if(flags & AV_SIDE_DATA_PARAM_CHANGE_CHANNEL_COUNT)
+        {
+            if(!ReadSideDataLE32(data, end, value))
+                flags = 0;
+            else if(value > 0 && (int)value != hints.channels)
+            {
+                hints.channels = value;
+                changed = true;
+            }
+        }
+        if(flags & AV_SIDE_DATA_PARAM_CHANGE_CHANNEL_LAYOUT)
+        {
+            if(end - data < 8)
+                flags = 0;
+            else
+                data += 8;
+        }
+        if(flags & AV_SIDE_DATA_PARAM_CHANGE_SAMPLE_RATE)
+        {
+            if(!ReadSideDataLE32(data, end, value))
+                flags = 0;
+            else if(value > 0 && (int)value != hints.samplerate)
+            {
+                hints.samplerate = value;
+                changed = true;
+            }
+        }
+        if(flags & AV_SIDE_DATA_PARAM_CHANGE_DIMENSIONS)
+        {
+            if(ReadSideDataLE32(data, end, value) && ReadSideDataLE32(data, end, height) &&
+               value > 0 && height > 0 && ((int)value != hints.width || (int)height != hints.height))
+            {
+                hints.width  = value;
+                hints.height = height;
+                changed = true;
+            }
+        }
+    }
+    
+    if(changed)
+        m_streams[id].hints_generation = ++m_hints_generation;
+}
+
 bool OMXReader::SetActiveStreamInternal(OMXStreamType type, unsigned int index)
 {
     bool ret = false;
@@ -847,16 +1691,39 @@ bool OMXReader::SetActiveStreamInternal(OMXStreamType type, unsigned int index)
         }
     }
     
+    UpdateDiscard();
+    
     return ret;
 }
 
+void OMXReader::SetStreamEnabled(OMXStreamType type, bool enable)
+{
+    if(type <= OMXSTREAM_NONE || type > OMXSTREAM_SUBTITLE)
+        return;
+    
+    Lock();
+    m_stream_enabled[type] = enable;
+    UpdateDiscard();
+    UnLock();
+}
+
+// let the demuxer skip everything we don't play instead of handing it out
+void OMXReader::UpdateDiscard()
+{
+    if(!m_pFormatContext)
+        return;
+    
+    for(unsigned int i = 0; i < m_pFormatContext->nb_streams; i++)
+        m_pFormatContext->streams[i]->discard = IsActive(i) ? AVDISCARD_DEFAULT : AVDISCARD_ALL;
+}
+
 bool OMXReader::IsActive(int stream_index)
 {
-    if((m_audio_index != -1)    && m_streams[m_audio_index].id      == stream_index)
+    if((m_audio_index != -1)    && m_stream_enabled[OMXSTREAM_AUDIO]    && m_streams[m_audio_index].id      == stream_index)
         return true;
-    if((m_video_index != -1)    && m_streams[m_video_index].id      == stream_index)
+    if((m_video_index != -1)    && m_stream_enabled[OMXSTREAM_VIDEO]    && m_streams[m_video_index].id      == stream_index)
         return true;
-    if((m_subtitle_index != -1) && m_streams[m_subtitle_index].id   == stream_index)
+    if((m_subtitle_index != -1) && m_stream_enabled[OMXSTREAM_SUBTITLE] && m_streams[m_subtitle_index].id   == stream_index)
         return true;
     
     return false;
@@ -864,11 +1731,11 @@ bool OMXReader::IsActive(int stream_index)
 
 bool OMXReader::IsActive(OMXStreamType type, int stream_index)
 {
-    if((m_audio_index != -1)    && m_streams[m_audio_index].id      == stream_index && m_streams[m_audio_index].type == type)
+    if((m_audio_index != -1)    && m_stream_enabled[OMXSTREAM_AUDIO]    && m_streams[m_audio_index].id      == stream_index && m_streams[m_audio_index].type == type)
         return true;
-    if((m_video_index != -1)    && m_streams[m_video_index].id      == stream_index && m_streams[m_video_index].type == type)
+    if((m_video_index != -1)    && m_stream_enabled[OMXSTREAM_VIDEO]    && m_streams[m_video_index].id      == stream_index && m_streams[m_video_index].type == type)
         return true;
-    if((m_subtitle_index != -1) && m_streams[m_subtitle_index].id   == stream_index && m_streams[m_subtitle_index].type == type)
+    if((m_subtitle_index != -1) && m_stream_enabled[OMXSTREAM_SUBTITLE] && m_streams[m_subtitle_index].id   == stream_index && m_streams[m_subtitle_index].type == type)
         return true;
     
     return false;
@@ -966,7 +1833,7 @@ bool OMXReader::GetHints(OMXStreamType type, unsigned int index, COMXStreamInfo
 {
     for(unsigned int i = 0; i < MAX_STREAMS; i++)
     {
-        if(m_streams[i].type == type && m_streams[i].index == i)
+        if(m_streams[i].type == type && m_streams[i].index == index)
         {
             hints = m_streams[i].hints;
             return true;
@@ -976,6 +1843,26 @@ bool OMXReader::GetHints(OMXStreamType type, unsigned int index, COMXStreamInfo
     return false;
 }
 
+bool OMXReader::GetStreamHints(int stream_index, COMXStreamInfo &hints, int *generation)
+{
+    bool ret = false;
+    
+    if(stream_index < 0 || stream_index >= MAX_STREAMS)
+        return ret;
+    
+    Lock();
+    if(m_streams[stream_index].type != OMXSTREAM_NONE)
+    {
+        hints = m_streams[stream_index].hints;
+        if(generation)
+            *generation = m_streams[stream_index].hints_generation;
+        ret = true;
+    }
+    UnLock();
+    
+    return ret;
+}
+
 bool OMXReader::GetHints(OMXStreamType type, COMXStreamInfo &hints)
 {
     bool ret = false;
@@ -1012,17 +1899,35 @@ bool OMXReader::GetHints(OMXStreamType type, COMXStreamInfo &hints)
 
 bool OMXReader::IsEof()
 {
-    return m_eof;
+    if(!m_prefetch)
+        return m_eof;
+    
+    // only at the end once the read-ahead queue has been handed out too
+    pthread_mutex_lock(&m_prefetch_lock);
+    bool eof = m_eof && m_prefetch_packets.empty();
+    pthread_mutex_unlock(&m_prefetch_lock);
+    
+    return eof;
 }
 
 void OMXReader::FreePacket(OMXPacket *pkt)
 {
-    if(pkt)
+    OMXPacketPool::Release(pkt);
+}
+
+void OMXReader::SetVideoPacketPool(OMXPacketPool *pool)
+{
+    Lock();
+    if(pool)
     {
-        if(pkt->data)
-            free(pkt->data);
-        free(pkt);
+        pool->Ref();
     }
+    if(m_video_pool)
+    {
+        m_video_pool->Unref();
+    }
+    m_video_pool = pool;
+    UnLock();
 }
 
 OMXPacket *OMXReader::AllocPacket(int size)
@@ -1042,6 +1947,7 @@ OMXPacket *OMXReader::AllocPacket(int size)
         {
             memset(pkt->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
             pkt->size = size;
+            pkt->capacity = size;
             pkt->dts  = DVD_NOPTS_VALUE;
             pkt->pts  = DVD_NOPTS_VALUE;
             pkt->now  = DVD_NOPTS_VALUE;
@@ -1150,7 +2056,8 @@ void OMXReader::UpdateCurrentPTS()
     for(unsigned int i = 0; i < m_pFormatContext->nb_streams; i++)
     {
         AVStream *stream = m_pFormatContext->streams[i];
-        if(stream && stream->cur_dts != (int64_t)AV_NOPTS_VALUE)
+        // discarded streams don't move, their cur_dts would hold us back
+        if(stream && stream->discard != AVDISCARD_ALL && stream->cur_dts != (int64_t)AV_NOPTS_VALUE)
         {
             double ts = ConvertTimestamp(stream->cur_dts, stream->time_base.den, stream->time_base.num);
             if(m_iCurrentPts == DVD_NOPTS_VALUE || m_iCurrentPts > ts )
@@ -27,7 +27,13 @@
 #include "DllAvCodec.h"
 #include "OMXStreamInfo.h"
 #include "OMXThread.h"
+#include "OMXPacketPool.h"
+#include "OMXSeekIndex.h"
+#include "OMXProbeCache.h"
 #include <queue>
+#include <deque>
+#include <vector>
+#include <atomic>
 
 #include "OMXStreamInfo.h"
 
@@ -68,10 +74,25 @@ typedef struct OMXPacket
   int       size;
   uint8_t   *data;
   int       stream_index;
-  COMXStreamInfo hints;
+  int       hints_generation; // OMXStream::hints_generation when the packet was read
+  bool      decode_only; // needed as a reference after an exact seek but not shown
   enum AVMediaType codec_type;
+  unsigned int capacity; // usable bytes behind data
+  int       pool_class;
+  OMXPacketPool *pool;   // NULL if not allocated from a pool
+  struct OMXPacket *pool_next;
+  AVPacket  avpkt;       // demuxer packet data points into when adopted
+  bool      adopted;
 } OMXPacket;
 
+typedef struct OMXReaderCopyStats
+{
+  uint64_t bytes_copied;   // payload bytes memcpy'd out of AVPackets
+  uint64_t bytes_adopted;  // payload bytes referenced without copying
+  uint64_t bytes_dropped;  // payload bytes of inactive streams dropped before allocation
+  double   media_seconds;  // media duration covered by the packets read
+} OMXReaderCopyStats;
+
 enum OMXStreamType
 {
   OMXSTREAM_NONE      = 0,
@@ -80,6 +101,34 @@ enum OMXStreamType
   OMXSTREAM_SUBTITLE  = 3
 };
 
+// adaptive AVIO buffer never grows beyond this
+#define OMX_IO_BUFFER_MAX_SIZE (1024 * 1024)
+
+typedef struct OMXReaderIOStats
+{
+  unsigned int  buffer_size;          // current AVIO buffer size in bytes
+  unsigned int  grows;                // times the adaptive mode grew the buffer
+  double        reads_per_sec;        // AVIO read callbacks over the last second
+  double        stdio_reads_per_sec;  // of those, fread() calls. stdio buffers them, mapped reads don't count
+  double        kb_per_sec;           // input bitrate over the last second
+  double        full_ratio;           // share of reads that filled the whole buffer
+} OMXReaderIOStats;
+
+typedef struct OMXReaderPrefetchStats
+{
+  unsigned int  packets;    // packets waiting in the prefetch queue
+  unsigned int  bytes;      // payload bytes waiting in the prefetch queue
+  double        seconds;    // media time spanned by the queued packets
+  uint64_t      underruns;  // Read() found the queue empty before eof
+} OMXReaderPrefetchStats;
+
+typedef struct OMXReaderProbeStats
+{
+  bool          cache_hit;  // stream layout came from the probe cache
+  double        probe_ms;   // time spent probing on the last Open()
+  double        saved_ms;   // full probe time minus probe_ms on a cache hit
+} OMXReaderProbeStats;
+
 typedef struct OMXStream
 {
   char language[4];
@@ -92,6 +141,7 @@ typedef struct OMXStream
   unsigned int extrasize;
   unsigned int index;
   COMXStreamInfo hints;
+  int         hints_generation; // bumped whenever hints are rebuilt
 } OMXStream;
 
 class OMXReader
@@ -113,7 +163,8 @@ protected:
   XFILE::CFile              *m_pFile;
   AVFormatContext           *m_pFormatContext;
   AVIOContext               *m_ioContext;
-  bool                      m_eof;
+  // written under m_lock by whoever demuxes, read under m_prefetch_lock too
+  std::atomic<bool>         m_eof;
   OMXChapter                m_chapters[MAX_OMX_CHAPTERS];
   OMXStream                 m_streams[MAX_STREAMS];
   int                       m_chapter_count;
@@ -124,10 +175,73 @@ protected:
   double                    m_aspect;
   int                       m_width;
   int                       m_height;
+  OMXPacketPool            *m_packet_pool;
+  OMXPacketPool            *m_video_pool;
+  bool                      m_zero_copy;
+  bool                      m_mmap;
+  unsigned int              m_io_buffer_size;
+  bool                      m_io_adaptive;
+  OMXReaderIOStats          m_io_stats;
+  XFILE::SReadStats         m_io_last_reads;
+  int64_t                   m_io_last_check;
+  void UpdateIOStats();
+  bool ResizeIOBuffer(unsigned int size);
+  OMXReaderCopyStats        m_copy_stats;
   void Lock();
   void UnLock();
   bool SetActiveStreamInternal(OMXStreamType type, unsigned int index);
+  bool                      m_stream_enabled[OMXSTREAM_SUBTITLE + 1];
+  void UpdateDiscard();
   bool                      m_seek;
+  int                       m_hints_generation;
+  void UpdateStreamHints(int id);
+  void ApplyStreamSideData(int id, const uint8_t *extradata, int extrasize, const uint8_t *param, int param_size);
+  // NEW_EXTRADATA copies, hints handed out to the players point at them
+  std::vector<void *>       m_side_extradata;
+  OMXPacket *ReadPacket();
+
+  // read-ahead thread, see StartPrefetch()
+  bool                      m_prefetch;
+  bool                      m_prefetch_stop;
+  pthread_t                 m_prefetch_thread;
+  pthread_mutex_t           m_prefetch_lock;
+  pthread_cond_t            m_prefetch_cond;
+  std::deque<OMXPacket *>   m_prefetch_packets;
+  unsigned int              m_prefetch_bytes;
+  unsigned int              m_prefetch_max_bytes;
+  double                    m_prefetch_max_seconds;
+  uint64_t                  m_prefetch_underruns;
+  // bumped by SeekTime() with m_lock held, packets read before a seek are dropped
+  std::atomic<int>          m_seek_generation;
+  int                       m_read_generation;
+  static void *PrefetchRun(void *arg);
+  void PrefetchProcess();
+  bool PrefetchFull();
+  double PrefetchSeconds();
+  void PrefetchClear();
+
+  // keyframe index of the video stream, see SetSeekIndex()
+  bool                      m_seek_index_enabled;
+  std::string               m_seek_index_dir;
+  OMXSeekIndex              m_seek_index;
+  bool                      m_seek_index_bytes; // built by scanning the file, seek by byte offset
+  pthread_t                 m_index_thread;
+  bool                      m_index_thread_running;
+  std::atomic<bool>         m_index_stop;
+  void BuildSeekIndex();
+  static void *IndexRun(void *arg);
+  void IndexScan();
+  void StopIndexScan();
+  bool GetFileStat(int64_t *size, int64_t *mtime);
+  int IndexFrame(AVStream *stream, double pts);
+
+  // probe results cached on disk, see SetProbeCache()
+  std::string               m_probe_cache_dir;
+  OMXProbeInfo              m_probe_info;
+  OMXReaderProbeStats       m_probe_stats;
+  bool MatchProbeInfo(bool all_streams);
+  void ApplyProbeInfo();
+  void CaptureProbeInfo(double probe_ms);
 private:
 public:
   OMXReader();
@@ -139,6 +253,12 @@ public:
   bool SeekTime(int time, bool backwords, double *startpts);
   AVMediaType PacketType(OMXPacket *pkt);
   OMXPacket *Read();
+  // demux on a separate thread, Read() then hands out packets from a queue
+  // bounded by max_bytes and max_seconds of media
+  bool StartPrefetch(unsigned int max_bytes, double max_seconds);
+  void StopPrefetch();
+  bool IsPrefetching() { return m_prefetch; };
+  OMXReaderPrefetchStats GetPrefetchStats();
   void Process();
   bool GetStreams();
   void AddStream(int id);
@@ -148,11 +268,15 @@ public:
   bool GetHints(AVStream *stream, COMXStreamInfo *hints);
   bool GetHints(OMXStreamType type, unsigned int index, COMXStreamInfo &hints);
   bool GetHints(OMXStreamType type, COMXStreamInfo &hints);
+  bool GetStreamHints(int stream_index, COMXStreamInfo &hints, int *generation = NULL);
   bool IsEof();
   int  AudioStreamCount() { return m_audio_count; };
   int  VideoStreamCount() { return m_video_count; };
   int  SubtitleStreamCount() { return m_subtitle_count; };
   bool SetActiveStream(OMXStreamType type, unsigned int index);
+  // a disabled type is never active, its packets are discarded by the demuxer
+  // like those of every other stream that isn't selected
+  void SetStreamEnabled(OMXStreamType type, bool enable);
   int  GetChapterCount() { return m_chapter_count; };
   double GetAspectRatio() { return m_aspect; };
   int GetWidth() { return m_width; };
@@ -160,6 +284,36 @@ public:
   OMXChapter GetChapter(unsigned int chapter) { return m_chapters[(chapter > MAX_OMX_CHAPTERS) ? MAX_OMX_CHAPTERS : chapter]; };
   static void FreePacket(OMXPacket *pkt);
   static OMXPacket *AllocPacket(int size);
+  OMXPacketPoolStats GetPacketPoolStats() const { return m_packet_pool->GetStats(); };
+  double GetPacketPoolHitRate() const { return m_packet_pool->GetHitRate(); };
+  // demux video packets into the blocks of this fixed pool while it has one
+  // free, e.g. the ones the video decoder registered, NULL to stop
+  void SetVideoPacketPool(OMXPacketPool *pool);
+  // hold a reference on the demuxer's AVBufferRef instead of copying packet payloads
+  void SetZeroCopy(bool zero_copy) { m_zero_copy = zero_copy; };
+  bool IsZeroCopy() const { return m_zero_copy; };
+  OMXReaderCopyStats GetCopyStats() const { return m_copy_stats; };
+  // read local files through a memory mapping instead of stdio, takes effect on Open()
+  void SetMmap(bool mmap) { m_mmap = mmap; };
+  bool IsMmap() const { return m_mmap; };
+  // keep a keyframe index of the video stream so SeekTime() goes straight to
+  // the keyframe before the target. Taken from the container when it has a
+  // complete one, otherwise loaded from dir or built by scanning local files
+  // on a background thread and saved to dir. An empty dir keeps scanned
+  // indexes in memory only. Takes effect on Open()
+  void SetSeekIndex(bool enable, const std::string &dir) { m_seek_index_enabled = enable; m_seek_index_dir = dir; };
+  size_t GetSeekIndexSize();
+  // keep the result of probing local files in dir, keyed by path, size and
+  // mtime. Reopening a cached file skips most of avformat_find_stream_info().
+  // Empty disables the cache, takes effect on Open()
+  void SetProbeCache(const std::string &dir) { m_probe_cache_dir = dir; };
+  OMXReaderProbeStats GetProbeStats() const { return m_probe_stats; };
+  // AVIO buffer for local files, takes effect on Open(). adaptive doubles it
+  // while reads keep filling it at a high rate
+  void SetIOBufferSize(unsigned int size) { m_io_buffer_size = size; };
+  void SetAdaptiveIOBuffer(bool adaptive) { m_io_adaptive = adaptive; };
+  OMXReaderIOStats GetIOStats() const { return m_io_stats; };
+  void ResetCopyStats() { memset(&m_copy_stats, 0, sizeof(m_copy_stats)); };
   void SetSpeed(int iSpeed);
   void UpdateCurrentPTS();
   double ConvertTimestamp(int64_t pts, int den, int num);
@@ -0,0 +1,161 @@
+#include "OMXSeekIndex.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#define OMX_SEEK_INDEX_MAGIC    "OMXIDX02"
+
+// followed by path_size bytes of media path, then count entries
+typedef struct OMXSeekIndexHeader
+{
+  char     magic[8];
+  int64_t  file_size;
+  int64_t  file_mtime;
+  uint32_t count;
+  uint32_t entry_size;
+  uint32_t path_size;
+  uint32_t reserved;
+} OMXSeekIndexHeader;
+
+static bool ComparePts(const OMXSeekIndexEntry &a, const OMXSeekIndexEntry &b)
+{
+  return a.pts < b.pts;
+}
+
+static bool SamePts(const OMXSeekIndexEntry &a, const OMXSeekIndexEntry &b)
+{
+  return a.pts == b.pts;
+}
+
+OMXSeekIndex::OMXSeekIndex()
+{
+}
+
+OMXSeekIndex::~OMXSeekIndex()
+{
+}
+
+void OMXSeekIndex::Clear()
+{
+  m_entries.clear();
+}
+
+void OMXSeekIndex::Add(int64_t pos, int64_t ts, double pts, int frame)
+{
+  OMXSeekIndexEntry entry;
+  entry.pos   = pos;
+  entry.ts    = ts;
+  entry.pts   = pts;
+  entry.frame = frame;
+  m_entries.push_back(entry);
+}
+
+void OMXSeekIndex::Finish()
+{
+  std::stable_sort(m_entries.begin(), m_entries.end(), ComparePts);
+  m_entries.erase(std::unique(m_entries.begin(), m_entries.end(), SamePts), m_entries.end());
+}
+
+const OMXSeekIndexEntry *OMXSeekIndex::Find(double pts) const
+{
+  if(m_entries.empty() || pts < m_entries.front().pts)
+    return NULL;
+
+  OMXSeekIndexEntry key;
+  key.pts = pts;
+  std::vector<OMXSeekIndexEntry>::const_iterator it = std::upper_bound(m_entries.begin(), m_entries.end(), key, ComparePts);
+  return &*(it - 1);
+}
+
+std::string OMXSeekIndex::EntryPath(const std::string &dir, const std::string &path)
+{
+  // FNV-1a, only has to spread paths over file names, the entry holds the full path
+  uint64_t hash = 14695981039346656037ULL;
+  for(size_t i = 0; i < path.size(); i++)
+  {
+    hash ^= (uint8_t)path[i];
+    hash *= 1099511628211ULL;
+  }
+
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.omxidx", (unsigned long long)hash);
+  return dir + "/" + name;
+}
+
+bool OMXSeekIndex::Load(const std::string &dir, const std::string &path, int64_t file_size, int64_t file_mtime)
+{
+  FILE *fp = fopen(EntryPath(dir, path).c_str(), "rb");
+  if(!fp)
+    return false;
+
+  OMXSeekIndexHeader header;
+  bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+            memcmp(header.magic, OMX_SEEK_INDEX_MAGIC, sizeof(header.magic)) == 0 &&
+            header.file_size  == file_size &&
+            header.file_mtime == file_mtime &&
+            header.entry_size == sizeof(OMXSeekIndexEntry) &&
+            header.path_size  == path.size() &&
+            header.count > 0;
+
+  // the count comes from the file, a truncated or damaged entry must not
+  // size the allocation. Save() writes exactly count entries after the path
+  if(ok)
+  {
+    struct stat st;
+    ok = fstat(fileno(fp), &st) == 0 &&
+         (uint64_t)st.st_size == sizeof(header) + header.path_size + (uint64_t)header.count * sizeof(OMXSeekIndexEntry);
+  }
+  if(ok)
+  {
+    std::string stored(header.path_size, '\0');
+    ok = fread(&stored[0], 1, header.path_size, fp) == header.path_size && stored == path;
+  }
+  if(ok)
+  {
+    m_entries.resize(header.count);
+    ok = fread(&m_entries[0], sizeof(OMXSeekIndexEntry), header.count, fp) == header.count &&
+         std::is_sorted(m_entries.begin(), m_entries.end(), ComparePts);
+  }
+  fclose(fp);
+
+  if(!ok)
+    m_entries.clear();
+  return ok;
+}
+
+bool OMXSeekIndex::Save(const std::string &dir, const std::string &path, int64_t file_size, int64_t file_mtime) const
+{
+  if(m_entries.empty())
+    return false;
+
+  mkdir(dir.c_str(), 0755);
+
+  // write to a temporary name first so a reader never sees half a file
+  std::string entry = EntryPath(dir, path);
+  std::string tmp = entry + ".tmp";
+  FILE *fp = fopen(tmp.c_str(), "wb");
+  if(!fp)
+    return false;
+
+  OMXSeekIndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, OMX_SEEK_INDEX_MAGIC, sizeof(header.magic));
+  header.file_size  = file_size;
+  header.file_mtime = file_mtime;
+  header.count      = m_entries.size();
+  header.entry_size = sizeof(OMXSeekIndexEntry);
+  header.path_size  = path.size();
+
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            fwrite(path.data(), 1, path.size(), fp) == path.size() &&
+            fwrite(&m_entries[0], sizeof(OMXSeekIndexEntry), m_entries.size(), fp) == m_entries.size();
+  ok = (fclose(fp) == 0) && ok;
+
+  if(ok)
+    ok = rename(tmp.c_str(), entry.c_str()) == 0;
+  if(!ok)
+    remove(tmp.c_str());
+  return ok;
+}
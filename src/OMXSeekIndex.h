@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+typedef struct OMXSeekIndexEntry
+{
+  int64_t pos;    // byte offset of the keyframe packet, -1 if unknown
+  int64_t ts;     // timestamp in the video stream time base, what av_seek_frame wants
+  double  pts;    // same in DVD_TIME_BASE, relative to the start of the file
+  int     frame;  // frame number at the nominal frame rate of the stream
+} OMXSeekIndexEntry;
+
+// Keyframe index of the video stream used by OMXReader::SeekTime().
+//
+// Entries are kept sorted by pts. The index can be written to a cache
+// directory and read back on the next open, named after a hash of the media
+// path like the probe cache. The header records path, size and mtime of the
+// file it was built from so a stale or colliding entry is ignored.
+class OMXSeekIndex
+{
+public:
+  OMXSeekIndex();
+  ~OMXSeekIndex();
+
+  void Clear();
+  void Add(int64_t pos, int64_t ts, double pts, int frame);
+  // sort by pts and drop duplicates, call after the last Add()
+  void Finish();
+
+  // last keyframe at or before pts, NULL if there is none
+  const OMXSeekIndexEntry *Find(double pts) const;
+
+  bool Load(const std::string &dir, const std::string &path, int64_t file_size, int64_t file_mtime);
+  bool Save(const std::string &dir, const std::string &path, int64_t file_size, int64_t file_mtime) const;
+
+  size_t Size() const   { return m_entries.size(); }
+  bool IsEmpty() const  { return m_entries.empty(); }
+
+private:
+  static std::string EntryPath(const std::string &dir, const std::string &path);
+
+  std::vector<OMXSeekIndexEntry> m_entries;
+};
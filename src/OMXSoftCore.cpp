@@ -0,0 +1,1897 @@
+/*
+ * Software OMX IL core
+ *
+ * This Program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * Nothing is really decoded or displayed. Compressed input is read byte by
+ * byte (so buffers handed back too early show up under valgrind/ASan) and
+ * turned into small frame descriptors, which travel down the tunnels the
+ * way the firmware passes opaque image handles. Audio is PCM only and goes
+ * to a null device paced by its sample rate. All waits run against a
+ * simulated clock that OMXSOFT_CONFIG.speed can run faster than real time.
+ */
+
+#include <math.h>
+#include <unistd.h>
+#include "OMXGeneric.h"
+#include "OMXSoftCore.h"
+
+#define OMXSOFT_MAX_REORDER	4
+#define OMXSOFT_LATE_US		20000
+#define OMXSOFT_MAX_WAIT_US	10000
+#define OMXSOFT_FRAME_MAGIC	0x534f4654	/* 'SOFT' */
+
+/* Core wide configuration, statistics and simulated time */
+
+static pthread_mutex_t omxsoft_lock = PTHREAD_MUTEX_INITIALIZER;
+static OMXSOFT_CONFIG omxsoft_config = { 2000, 60, 40, 1.0, 0 };
+static OMXSOFT_STATS omxsoft_stats;
+static int64_t omxsoft_base_mono, omxsoft_base_time;
+static int omxsoft_refcount;
+
+#define OMXSOFT_STAT_ADD(field, n) do { \
+	pthread_mutex_lock(&omxsoft_lock); \
+	omxsoft_stats.field += (n); \
+	pthread_mutex_unlock(&omxsoft_lock); \
+} while (0)
+
+static int64_t omxsoft_mono_us(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t __omxsoft_now(void)
+{
+	return omxsoft_base_time + (int64_t)((omxsoft_mono_us() - omxsoft_base_mono) * omxsoft_config.speed);
+}
+
+/* Simulated time in microseconds */
+static int64_t omxsoft_now(void)
+{
+	int64_t now;
+	pthread_mutex_lock(&omxsoft_lock);
+	now = __omxsoft_now();
+	pthread_mutex_unlock(&omxsoft_lock);
+	return now;
+}
+
+static OMXSOFT_CONFIG omxsoft_get_config(void)
+{
+	OMXSOFT_CONFIG config;
+	pthread_mutex_lock(&omxsoft_lock);
+	config = omxsoft_config;
+	pthread_mutex_unlock(&omxsoft_lock);
+	return config;
+}
+
+/* Sleep for simulated time, without the component lock */
+static void omxsoft_sleep(int64_t us)
+{
+	double speed = omxsoft_get_config().speed;
+	if (us > 0) usleep((useconds_t)(us / speed));
+}
+
+void OMXSOFT_SetConfig(const OMXSOFT_CONFIG *config)
+{
+	pthread_mutex_lock(&omxsoft_lock);
+	/* re-anchor so the simulated clock stays continuous */
+	omxsoft_base_time = __omxsoft_now();
+	omxsoft_base_mono = omxsoft_mono_us();
+	omxsoft_config = *config;
+	if (!(omxsoft_config.speed > 0)) omxsoft_config.speed = 1.0;
+	if (!omxsoft_config.display_hz) omxsoft_config.display_hz = 60;
+	pthread_mutex_unlock(&omxsoft_lock);
+}
+
+void OMXSOFT_GetConfig(OMXSOFT_CONFIG *config)
+{
+	*config = omxsoft_get_config();
+}
+
+void OMXSOFT_GetStats(OMXSOFT_STATS *stats)
+{
+	pthread_mutex_lock(&omxsoft_lock);
+	*stats = omxsoft_stats;
+	pthread_mutex_unlock(&omxsoft_lock);
+}
+
+void OMXSOFT_ResetStats(void)
+{
+	pthread_mutex_lock(&omxsoft_lock);
+	memset(&omxsoft_stats, 0, sizeof omxsoft_stats);
+	pthread_mutex_unlock(&omxsoft_lock);
+}
+
+/* What video_decode puts in its output buffers instead of pixels */
+
+typedef struct _OMXSOFT_FRAME {
+	uint32_t magic;
+	uint32_t width, height;
+	uint32_t checksum;
+	uint64_t seq;
+	int64_t pts;
+	OMX_U32 flags;
+} OMXSOFT_FRAME;
+
+/* Clock port state of a clock consumer, from OMX_TIME_MEDIATIMETYPE updates */
+
+typedef struct _OMXSOFT_TIMEREF {
+	OMX_TIME_CLOCKSTATE state;
+	OMX_S32 scale;
+	int64_t media, wall;
+} OMXSOFT_TIMEREF;
+
+static int64_t omxsoft_timeref_media(const OMXSOFT_TIMEREF *ref, int64_t now)
+{
+	if (ref->state != OMX_TIME_ClockStateRunning)
+		return ref->media;
+	return ref->media + (now - ref->wall) * ref->scale / 0x10000;
+}
+
+/* Simulated time until the media time reaches pts, or -1 if it never does */
+static int64_t omxsoft_timeref_until(const OMXSOFT_TIMEREF *ref, int64_t pts, int64_t now)
+{
+	int64_t media = omxsoft_timeref_media(ref, now);
+	if (pts <= media) return 0;
+	if (ref->state != OMX_TIME_ClockStateRunning || ref->scale <= 0) return -1;
+	return (pts - media) * 0x10000 / ref->scale;
+}
+
+/* Common part of the components: worker wakeup, the input queue of the
+ * data port and the buffer being worked on. While busy is set the worker
+ * runs without the lock and owns cur, flushes wait for it. */
+
+typedef struct _OMX_SOFTCOMP {
+	GOMX_COMPONENT gcomp;
+	pthread_cond_t cond;
+	pthread_cond_t cond_busy;
+	GOMX_QUEUE inq;
+	OMX_BUFFERHEADERTYPE *cur;
+	bool busy;
+	OMXSOFT_TIMEREF timeref;
+	GOMX_PORT *clock_port;
+	OMXSOFT_CONFIG config;
+} OMX_SOFTCOMP;
+
+static void omxsoft_wait(OMX_SOFTCOMP *sc, int64_t us)
+{
+	GOMX_COMPONENT *comp = &sc->gcomp;
+	struct timespec ts;
+
+	if (us < 0 || us > OMXSOFT_MAX_WAIT_US * sc->config.speed)
+		us = OMXSOFT_MAX_WAIT_US;
+	else
+		us = (int64_t)(us / sc->config.speed);
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ts.tv_nsec += us * 1000;
+	while (ts.tv_nsec >= 1000000000L) {
+		ts.tv_nsec -= 1000000000L;
+		ts.tv_sec++;
+	}
+	pthread_cond_timedwait(&sc->cond, &comp->mutex, &ts);
+}
+
+static void __omxsoft_set_busy(OMX_SOFTCOMP *sc, bool busy)
+{
+	sc->busy = busy;
+	if (!busy) pthread_cond_broadcast(&sc->cond_busy);
+}
+
+/* Next empty buffer of an output supplier port, if it can be used */
+static OMX_BUFFERHEADERTYPE *__omxsoft_get_output(GOMX_PORT *port)
+{
+	if (!port->def.bEnabled || !port->def.bPopulated || port->new_enabled)
+		return 0;
+	if (!port->tunnel_comp || !port->tunnel_supplier)
+		return 0;
+	return (OMX_BUFFERHEADERTYPE *) gomxq_dequeue(&port->tunnel_supplierq);
+}
+
+/* Pass a filled buffer down the tunnel. If the peer does not take it yet
+ * (not executing, port being enabled) it goes back to the free list. */
+static OMX_ERRORTYPE __omxsoft_send(GOMX_COMPONENT *comp, GOMX_PORT *port, OMX_BUFFERHEADERTYPE *hdr)
+{
+	OMX_ERRORTYPE r = OMX_ErrorIncorrectStateOperation;
+
+	if (port->def.bEnabled && port->tunnel_comp) {
+		pthread_mutex_unlock(&comp->mutex);
+		r = OMX_EmptyThisBuffer(port->tunnel_comp, hdr);
+		pthread_mutex_lock(&comp->mutex);
+	}
+	if (r != OMX_ErrorNone)
+		__gomx_port_queue_supplier_buffer(port, hdr);
+	return r;
+}
+
+static void __omxsoft_input_done(OMX_SOFTCOMP *sc)
+{
+	OMX_BUFFERHEADERTYPE *buf = sc->cur;
+	sc->cur = 0;
+	__gomx_process_mark(&sc->gcomp, buf);
+	__gomx_empty_buffer_done(&sc->gcomp, buf);
+}
+
+static OMX_ERRORTYPE omxsoft_input_do_buffer(GOMX_COMPONENT *comp, GOMX_PORT *port, OMX_BUFFERHEADERTYPE *buf)
+{
+	OMX_SOFTCOMP *sc = (OMX_SOFTCOMP *) comp;
+	gomxq_enqueue(&sc->inq, (void *) buf);
+	pthread_cond_signal(&sc->cond);
+	return OMX_ErrorNone;
+}
+
+/* An empty buffer back from the peer of an output port */
+static OMX_ERRORTYPE omxsoft_output_do_buffer(GOMX_COMPONENT *comp, GOMX_PORT *port, OMX_BUFFERHEADERTYPE *buf)
+{
+	OMX_SOFTCOMP *sc = (OMX_SOFTCOMP *) comp;
+	__gomx_port_queue_supplier_buffer(port, buf);
+	pthread_cond_signal(&sc->cond);
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE omxsoft_input_flush(GOMX_COMPONENT *comp, GOMX_PORT *port)
+{
+	OMX_SOFTCOMP *sc = (OMX_SOFTCOMP *) comp;
+	OMX_BUFFERHEADERTYPE *buf;
+
+	while (sc->busy)
+		pthread_cond_wait(&sc->cond_busy, &comp->mutex);
+	if (sc->cur) {
+		buf = sc->cur;
+		sc->cur = 0;
+		__gomx_empty_buffer_done(comp, buf);
+	}
+	while ((buf = (OMX_BUFFERHEADERTYPE *) gomxq_dequeue(&sc->inq)) != 0)
+		__gomx_empty_buffer_done(comp, buf);
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE omxsoft_clock_do_buffer(GOMX_COMPONENT *comp, GOMX_PORT *port, OMX_BUFFERHEADERTYPE *buf)
+{
+	OMX_SOFTCOMP *sc = (OMX_SOFTCOMP *) comp;
+	OMX_TIME_MEDIATIMETYPE *mt;
+
+	if (omx_cast(mt, buf->pBuffer) == OMX_ErrorNone) {
+		sc->timeref.state = mt->eState;
+		sc->timeref.scale = mt->xScale;
+		sc->timeref.media = omx_ticks_to_s64(mt->nMediaTimestamp);
+		sc->timeref.wall = omx_ticks_to_s64(mt->nWallTimeAtMediaTime);
+		CDEBUG(comp, port, "clock state %d, scale %x, media %lld",
+			mt->eState, mt->xScale, (long long) sc->timeref.media);
+		pthread_cond_signal(&sc->cond);
+	}
+	__gomx_process_mark(comp, buf);
+	__gomx_empty_buffer_done(comp, buf);
+	return OMX_ErrorNone;
+}
+
+/* Tell the clock our start time, without the lock */
+static void __omxsoft_client_start_time(OMX_SOFTCOMP *sc, OMX_TICKS ts)
+{
+	OMX_TIME_CONFIG_TIMESTAMPTYPE tst;
+	GOMX_PORT *port = sc->clock_port;
+
+	omx_init(tst);
+	tst.nPortIndex = port->tunnel_port;
+	tst.nTimestamp = ts;
+	pthread_mutex_unlock(&sc->gcomp.mutex);
+	OMX_SetConfig(port->tunnel_comp, OMX_IndexConfigTimeClientStartTime, &tst);
+	pthread_mutex_lock(&sc->gcomp.mutex);
+}
+
+static OMX_ERRORTYPE omxsoft_statechange(GOMX_COMPONENT *comp)
+{
+	OMX_SOFTCOMP *sc = (OMX_SOFTCOMP *) comp;
+	pthread_cond_signal(&sc->cond);
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE omxsoft_deinit(OMX_HANDLETYPE hComponent)
+{
+	OMX_SOFTCOMP *sc = (OMX_SOFTCOMP *) hComponent;
+	gomx_fini(&sc->gcomp);
+	pthread_cond_destroy(&sc->cond);
+	pthread_cond_destroy(&sc->cond_busy);
+	free(sc);
+	return OMX_ErrorNone;
+}
+
+/* Parameters the firmware takes that make no difference here */
+static bool omxsoft_ignored_index(OMX_INDEXTYPE nIndex)
+{
+	switch ((int) nIndex) {
+	case OMX_IndexConfigRequestCallback:
+	case OMX_IndexParamBrcmVideoDecodeErrorConcealment:
+	case OMX_IndexParamNalStreamFormatSelect:
+	case OMX_IndexParamBrcmExtraBuffers:
+	case OMX_IndexParamBrcmDecoderPassThrough:
+	case OMX_IndexConfigBrcmAudioDownmixCoefficients:
+	case OMX_IndexConfigBrcmAudioDownmixCoefficients8x8:
+	case OMX_IndexConfigBrcmClockReferenceSource:
+	case OMX_IndexConfigBrcmAudioDestination:
+	case OMX_IndexConfigDisplayRegion:
+	case OMX_IndexConfigLatencyTarget:
+	case OMX_IndexConfigCommonImageFilterParameters:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static OMX_ERRORTYPE omxsoft_set_parameter(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nParamIndex, OMX_PTR pComponentParameterStructure)
+{
+	if (omxsoft_ignored_index(nParamIndex)) return OMX_ErrorNone;
+	return gomx_set_parameter(hComponent, nParamIndex, pComponentParameterStructure);
+}
+
+static OMX_ERRORTYPE omxsoft_set_config(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nIndex, OMX_PTR pComponentConfigStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+	if (omxsoft_ignored_index(nIndex)) return OMX_ErrorNone;
+	CINFO(comp, 0, "UNSUPPORTED %x, %p", nIndex, pComponentConfigStructure);
+	return OMX_ErrorNotImplemented;
+}
+
+static void omxsoft_port_init(GOMX_PORT *port, OMX_U32 index, OMX_DIRTYPE dir, OMX_PORTDOMAINTYPE domain,
+			      OMX_U32 count_min, OMX_U32 count, OMX_U32 size)
+{
+	port->def.nSize = sizeof port->def;
+	port->def.nVersion.nVersion = OMX_VERSION;
+	port->def.nPortIndex = index;
+	port->def.eDir = dir;
+	port->def.nBufferCountMin = count_min;
+	port->def.nBufferCountActual = count;
+	port->def.nBufferSize = size;
+	port->def.bEnabled = OMX_TRUE;
+	port->def.eDomain = domain;
+	port->def.nBufferAlignment = 16;
+	if (domain == OMX_PortDomainOther)
+		port->def.format.other.eFormat = OMX_OTHER_FormatTime;
+	if (dir == OMX_DirOutput)
+		port->do_buffer = omxsoft_output_do_buffer;
+}
+
+static void omxsoft_clock_port_init(OMX_SOFTCOMP *sc, GOMX_PORT *port, OMX_U32 index)
+{
+	omxsoft_port_init(port, index, OMX_DirInput, OMX_PortDomainOther, 1, 1, sizeof(OMX_TIME_MEDIATIMETYPE));
+	port->do_buffer = omxsoft_clock_do_buffer;
+	sc->clock_port = port;
+}
+
+static void omxsoft_comp_init(OMX_SOFTCOMP *sc, const char *name, OMX_PTR pAppData, OMX_CALLBACKTYPE *pCallbacks,
+			      GOMX_PORT *ports, size_t nports, void* (*worker)(void *))
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sc->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_cond_init(&sc->cond_busy, 0);
+	gomxq_init(&sc->inq, offsetof(OMX_BUFFERHEADERTYPE, pInputPortPrivate));
+	sc->timeref.state = OMX_TIME_ClockStateStopped;
+	sc->config = omxsoft_get_config();
+
+	gomx_init(&sc->gcomp, name, pAppData, pCallbacks, ports, nports);
+	sc->gcomp.omx.SetParameter = omxsoft_set_parameter;
+	sc->gcomp.omx.SetConfig = omxsoft_set_config;
+	sc->gcomp.omx.ComponentDeInit = omxsoft_deinit;
+	sc->gcomp.worker = worker;
+	sc->gcomp.statechange = omxsoft_statechange;
+}
+
+/* Clock
+ *
+ * Six output ports (80-85) each supplying one OMX_TIME_MEDIATIMETYPE buffer,
+ * sent whenever the state, scale or anchor of the media time changes. */
+
+#define OMXSOFT_CLOCK_PORT	80
+#define OMXSOFT_CLOCK_NPORTS	6
+
+typedef struct _OMX_SOFTCLOCK {
+	OMX_SOFTCOMP sc;
+	GOMX_PORT port_data[OMXSOFT_CLOCK_NPORTS];
+	OMX_TIME_CONFIG_CLOCKSTATETYPE clock_state;
+	OMX_TIME_REFCLOCKTYPE ref_clock;
+	OMX_S32 scale;
+	int64_t rate;		/* scale including the configured drift */
+	int64_t media, wall;
+	int64_t start_time[OMXSOFT_CLOCK_NPORTS];
+	OMX_U32 start_mask;
+	OMX_U32 dirty;
+} OMX_SOFTCLOCK;
+
+static int64_t __omxsoftclock_media(OMX_SOFTCLOCK *clk, int64_t now)
+{
+	if (clk->clock_state.eState != OMX_TIME_ClockStateRunning)
+		return clk->media;
+	return clk->media + (now - clk->wall) * clk->rate / 0x10000;
+}
+
+static void __omxsoftclock_set_scale(OMX_SOFTCLOCK *clk, OMX_S32 scale)
+{
+	clk->scale = scale;
+	clk->rate = (int64_t) scale * (1000000 + clk->sc.config.clock_drift_ppm) / 1000000;
+}
+
+static void __omxsoftclock_anchor(OMX_SOFTCLOCK *clk, int64_t media)
+{
+	clk->media = media;
+	clk->wall = omxsoft_now();
+	clk->dirty = (1 << OMXSOFT_CLOCK_NPORTS) - 1;
+	pthread_cond_signal(&clk->sc.cond);
+}
+
+static void __omxsoftclock_check_start(OMX_SOFTCLOCK *clk)
+{
+	OMX_TIME_CONFIG_CLOCKSTATETYPE *cs = &clk->clock_state;
+	int64_t start = 0;
+	bool first = true;
+
+	if (cs->eState != OMX_TIME_ClockStateWaitingForStartTime) return;
+	if ((clk->start_mask & cs->nWaitMask) != cs->nWaitMask) return;
+
+	for (int i = 0; i < OMXSOFT_CLOCK_NPORTS; i++) {
+		if (!(cs->nWaitMask & (1 << i))) continue;
+		if (first || clk->start_time[i] < start) start = clk->start_time[i];
+		first = false;
+	}
+	CINFO(&clk->sc.gcomp, 0, "running from %lld", (long long) start);
+	cs->eState = OMX_TIME_ClockStateRunning;
+	cs->nStartTime = omx_ticks_from_s64(start);
+	__omxsoftclock_anchor(clk, start + omx_ticks_to_s64(cs->nOffset));
+}
+
+static OMX_ERRORTYPE omxsoftclock_get_config(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nIndex, OMX_PTR pComponentConfigStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	OMX_SOFTCLOCK *clk = (OMX_SOFTCLOCK *) hComponent;
+	OMX_TIME_CONFIG_CLOCKSTATETYPE *cst;
+	OMX_TIME_CONFIG_ACTIVEREFCLOCKTYPE *rct;
+	OMX_TIME_CONFIG_TIMESTAMPTYPE *tst;
+	OMX_TIME_CONFIG_SCALETYPE *sct;
+	OMX_ERRORTYPE r;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	pthread_mutex_lock(&comp->mutex);
+	switch (nIndex) {
+	case OMX_IndexConfigTimeClockState:
+		if ((r = omx_cast(cst, pComponentConfigStructure))) break;
+		cst->eState = clk->clock_state.eState;
+		cst->nStartTime = clk->clock_state.nStartTime;
+		cst->nOffset = clk->clock_state.nOffset;
+		cst->nWaitMask = clk->clock_state.nWaitMask;
+		break;
+	case OMX_IndexConfigTimeActiveRefClock:
+		if ((r = omx_cast(rct, pComponentConfigStructure))) break;
+		rct->eClock = clk->ref_clock;
+		break;
+	case OMX_IndexConfigTimeScale:
+		if ((r = omx_cast(sct, pComponentConfigStructure))) break;
+		sct->xScale = clk->scale;
+		break;
+	case OMX_IndexConfigTimeCurrentMediaTime:
+		if ((r = omx_cast(tst, pComponentConfigStructure))) break;
+		tst->nTimestamp = omx_ticks_from_s64(__omxsoftclock_media(clk, omxsoft_now()));
+		break;
+	case OMX_IndexConfigTimeCurrentWallTime:
+		if ((r = omx_cast(tst, pComponentConfigStructure))) break;
+		tst->nTimestamp = omx_ticks_from_s64(omxsoft_now());
+		break;
+	case OMX_IndexConfigClockAdjustment:
+		/* nothing slews this clock */
+		if ((r = omx_cast(tst, pComponentConfigStructure))) break;
+		tst->nTimestamp = omx_ticks_from_s64(0);
+		break;
+	default:
+		CINFO(comp, 0, "UNSUPPORTED %x, %p", nIndex, pComponentConfigStructure);
+		r = OMX_ErrorNotImplemented;
+		break;
+	}
+	pthread_mutex_unlock(&comp->mutex);
+	return r;
+}
+
+static OMX_ERRORTYPE omxsoftclock_set_config(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nIndex, OMX_PTR pComponentConfigStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	OMX_SOFTCLOCK *clk = (OMX_SOFTCLOCK *) hComponent;
+	OMX_TIME_CONFIG_CLOCKSTATETYPE *cst;
+	OMX_TIME_CONFIG_ACTIVEREFCLOCKTYPE *rct;
+	OMX_TIME_CONFIG_TIMESTAMPTYPE *tst;
+	OMX_TIME_CONFIG_SCALETYPE *sct;
+	OMX_ERRORTYPE r;
+	int64_t now, ts;
+	int i;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	pthread_mutex_lock(&comp->mutex);
+	now = omxsoft_now();
+	switch (nIndex) {
+	case OMX_IndexConfigTimeClockState:
+		if ((r = omx_cast(cst, pComponentConfigStructure))) break;
+		CINFO(comp, 0, "state %d, wait mask %x", cst->eState, cst->nWaitMask);
+		clk->clock_state.nOffset = cst->nOffset;
+		switch (cst->eState) {
+		case OMX_TIME_ClockStateRunning:
+			clk->clock_state.eState = OMX_TIME_ClockStateRunning;
+			clk->clock_state.nStartTime = cst->nStartTime;
+			__omxsoftclock_anchor(clk, omx_ticks_to_s64(cst->nStartTime));
+			break;
+		case OMX_TIME_ClockStateWaitingForStartTime:
+			clk->clock_state.eState = OMX_TIME_ClockStateWaitingForStartTime;
+			clk->clock_state.nWaitMask = cst->nWaitMask;
+			clk->start_mask = 0;
+			__omxsoftclock_anchor(clk, clk->media);
+			break;
+		case OMX_TIME_ClockStateStopped:
+			clk->media = __omxsoftclock_media(clk, now);
+			clk->clock_state.eState = OMX_TIME_ClockStateStopped;
+			__omxsoftclock_anchor(clk, clk->media);
+			break;
+		default:
+			r = OMX_ErrorBadParameter;
+			break;
+		}
+		break;
+	case OMX_IndexConfigTimeActiveRefClock:
+		if ((r = omx_cast(rct, pComponentConfigStructure))) break;
+		clk->ref_clock = rct->eClock;
+		break;
+	case OMX_IndexConfigTimeScale:
+		if ((r = omx_cast(sct, pComponentConfigStructure))) break;
+		ts = __omxsoftclock_media(clk, now);
+		__omxsoftclock_set_scale(clk, sct->xScale);
+		__omxsoftclock_anchor(clk, ts);
+		break;
+	case OMX_IndexConfigTimeClientStartTime:
+		if ((r = omx_cast(tst, pComponentConfigStructure))) break;
+		i = (int) tst->nPortIndex - OMXSOFT_CLOCK_PORT;
+		if (i < 0 || i >= OMXSOFT_CLOCK_NPORTS) {
+			r = OMX_ErrorBadPortIndex;
+			break;
+		}
+		ts = omx_ticks_to_s64(tst->nTimestamp);
+		CDEBUG(comp, 0, "client start time %lld from port %d", (long long) ts, (int) tst->nPortIndex);
+		if (!(clk->start_mask & (1 << i)) || ts < clk->start_time[i])
+			clk->start_time[i] = ts;
+		clk->start_mask |= 1 << i;
+		__omxsoftclock_check_start(clk);
+		break;
+	case OMX_IndexConfigTimeCurrentAudioReference:
+	case OMX_IndexConfigTimeCurrentVideoReference:
+		if ((r = omx_cast(tst, pComponentConfigStructure))) break;
+		if (clk->ref_clock != (nIndex == OMX_IndexConfigTimeCurrentAudioReference
+				       ? OMX_TIME_RefClockAudio : OMX_TIME_RefClockVideo))
+			break;
+		ts = omx_ticks_to_s64(tst->nTimestamp);
+		if (clk->clock_state.eState != OMX_TIME_ClockStateRunning) {
+			clk->media = ts;
+			break;
+		}
+		/* small corrections only re-anchor, the clients extrapolate */
+		if (llabs(ts - __omxsoftclock_media(clk, now)) > 2000) {
+			__omxsoftclock_anchor(clk, ts);
+		} else {
+			clk->media = ts;
+			clk->wall = now;
+		}
+		break;
+	case OMX_IndexConfigSingleStep:
+	case OMX_IndexConfigLatencyTarget:
+		r = OMX_ErrorNone;
+		break;
+	default:
+		CINFO(comp, 0, "UNSUPPORTED %x, %p", nIndex, pComponentConfigStructure);
+		r = OMX_ErrorNotImplemented;
+		break;
+	}
+	pthread_mutex_unlock(&comp->mutex);
+	return r;
+}
+
+static void *omxsoftclock_worker(void *ptr)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) ptr;
+	OMX_SOFTCLOCK *clk = (OMX_SOFTCLOCK *) comp;
+	OMX_BUFFERHEADERTYPE *hdr;
+	OMX_TIME_MEDIATIMETYPE *mt;
+	GOMX_PORT *port;
+	bool pending;
+
+	CINFO(comp, 0, "worker started");
+
+	pthread_mutex_lock(&comp->mutex);
+	while (comp->wanted_state == OMX_StateExecuting) {
+		pending = false;
+		for (int i = 0; i < OMXSOFT_CLOCK_NPORTS; i++) {
+			port = &clk->port_data[i];
+			/* a port enabled later picks up the current state */
+			if (!(clk->dirty & (1 << i)) || !port->def.bEnabled) continue;
+			if (!(hdr = __omxsoft_get_output(port))) {
+				pending = true;
+				continue;
+			}
+
+			mt = (OMX_TIME_MEDIATIMETYPE *) hdr->pBuffer;
+			memset(mt, 0, sizeof *mt);
+			omx_init(*mt);
+			mt->eUpdateType = OMX_TIME_UpdateClockStateChanged;
+			mt->eState = clk->clock_state.eState;
+			mt->xScale = (OMX_S32) clk->rate;
+			mt->nMediaTimestamp = omx_ticks_from_s64(clk->media);
+			mt->nWallTimeAtMediaTime = omx_ticks_from_s64(clk->wall);
+			mt->nOffset = clk->clock_state.nOffset;
+			hdr->nOffset = 0;
+			hdr->nFilledLen = sizeof *mt;
+			hdr->nFlags = 0;
+			hdr->nTimeStamp = mt->nMediaTimestamp;
+
+			clk->dirty &= ~(1 << i);
+			if (__omxsoft_send(comp, port, hdr) != OMX_ErrorNone) {
+				clk->dirty |= 1 << i;
+				pending = true;
+			}
+		}
+		omxsoft_wait(&clk->sc, pending ? 1000 : -1);
+	}
+	pthread_mutex_unlock(&comp->mutex);
+	CINFO(comp, 0, "worker stopped");
+	return 0;
+}
+
+static OMX_ERRORTYPE omxsoftclock_create(OMX_HANDLETYPE *pHandle, const char *name, OMX_PTR pAppData, OMX_CALLBACKTYPE *pCallbacks)
+{
+	OMX_SOFTCLOCK *clk;
+
+	clk = (OMX_SOFTCLOCK *) calloc(1, sizeof *clk);
+	if (!clk) return OMX_ErrorInsufficientResources;
+
+	for (int i = 0; i < OMXSOFT_CLOCK_NPORTS; i++)
+		omxsoft_port_init(&clk->port_data[i], OMXSOFT_CLOCK_PORT + i, OMX_DirOutput, OMX_PortDomainOther,
+				  1, 1, sizeof(OMX_TIME_MEDIATIMETYPE));
+
+	omx_init(clk->clock_state);
+	clk->clock_state.eState = OMX_TIME_ClockStateStopped;
+	clk->ref_clock = OMX_TIME_RefClockNone;
+
+	omxsoft_comp_init(&clk->sc, name, pAppData, pCallbacks, clk->port_data, ARRAY_SIZE(clk->port_data), omxsoftclock_worker);
+	__omxsoftclock_set_scale(clk, 0x10000);
+	clk->sc.gcomp.omx.GetConfig = omxsoftclock_get_config;
+	clk->sc.gcomp.omx.SetConfig = omxsoftclock_set_config;
+
+	*pHandle = (OMX_HANDLETYPE) clk;
+	return OMX_ErrorNone;
+}
+
+/* Video decoder
+ *
+ * Input 130, output 131. The first complete frame fixes the output format
+ * and raises OMX_EventPortSettingsChanged; frames then wait for the output
+ * port to be tunneled and enabled. Output is in pts order, holding back as
+ * many frames as the deepest reordering seen in the input. */
+
+#define OMXSOFT_VDEC_IN		0
+#define OMXSOFT_VDEC_OUT	1
+
+typedef struct _OMX_SOFTVDEC {
+	OMX_SOFTCOMP sc;
+	GOMX_PORT port_data[2];
+	OMXSOFT_FRAME frames[OMXSOFT_MAX_REORDER + 1];
+	size_t nframes, reorder;
+	OMXSOFT_FRAME next;
+	bool in_frame, settings_changed, eos;
+	int64_t last_pts;
+	uint32_t checksum;
+	uint64_t seq;
+} OMX_SOFTVDEC;
+
+static OMX_ERRORTYPE omxsoftvdec_get_parameter(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nParamIndex, OMX_PTR pComponentParameterStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	OMX_CONFIG_POINTTYPE *pt;
+	OMX_ERRORTYPE r;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	switch ((int) nParamIndex) {
+	case OMX_IndexParamBrcmPixelAspectRatio:
+		/* unknown, square pixels */
+		if ((r = omx_cast(pt, pComponentParameterStructure))) return r;
+		pt->nX = pt->nY = 0;
+		break;
+	default:
+		return gomx_get_parameter(hComponent, nParamIndex, pComponentParameterStructure);
+	}
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE omxsoftvdec_set_parameter(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nParamIndex, OMX_PTR pComponentParameterStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	OMX_VIDEO_PARAM_PORTFORMATTYPE *pft;
+	GOMX_PORT *port;
+	OMX_ERRORTYPE r;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	switch (nParamIndex) {
+	case OMX_IndexParamVideoPortFormat:
+		if ((r = omx_cast(pft, pComponentParameterStructure))) return r;
+		if (!(port = gomx_get_port(comp, pft->nPortIndex))) return OMX_ErrorBadPortIndex;
+		pthread_mutex_lock(&comp->mutex);
+		port->def.format.video.eCompressionFormat = pft->eCompressionFormat;
+		port->def.format.video.eColorFormat = pft->eColorFormat;
+		port->def.format.video.xFramerate = pft->xFramerate;
+		pthread_mutex_unlock(&comp->mutex);
+		break;
+	default:
+		return omxsoft_set_parameter(hComponent, nParamIndex, pComponentParameterStructure);
+	}
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE omxsoftvdec_get_config(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nIndex, OMX_PTR pComponentConfigStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	OMX_CONFIG_INTERLACETYPE *it;
+	OMX_ERRORTYPE r;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	switch ((int) nIndex) {
+	case OMX_IndexConfigCommonInterlace:
+		if ((r = omx_cast(it, pComponentConfigStructure))) return r;
+		it->eMode = OMX_InterlaceProgressive;
+		it->bRepeatFirstField = OMX_FALSE;
+		break;
+	default:
+		CINFO(comp, 0, "UNSUPPORTED %x, %p", nIndex, pComponentConfigStructure);
+		return OMX_ErrorNotImplemented;
+	}
+	return OMX_ErrorNone;
+}
+
+static void __omxsoftvdec_settings_changed(OMX_SOFTVDEC *dec)
+{
+	GOMX_PORT *in = &dec->port_data[OMXSOFT_VDEC_IN];
+	GOMX_PORT *out = &dec->port_data[OMXSOFT_VDEC_OUT];
+	OMX_VIDEO_PORTDEFINITIONTYPE *v = &out->def.format.video;
+	OMX_U32 width = in->def.format.video.nFrameWidth ? in->def.format.video.nFrameWidth : 1920;
+	OMX_U32 height = in->def.format.video.nFrameHeight ? in->def.format.video.nFrameHeight : 1080;
+
+	v->nFrameWidth = width;
+	v->nFrameHeight = height;
+	v->nStride = (width + 31) & ~31;
+	v->nSliceHeight = (height + 15) & ~15;
+	v->xFramerate = in->def.format.video.xFramerate;
+	v->eCompressionFormat = OMX_VIDEO_CodingUnused;
+	v->eColorFormat = OMX_COLOR_FormatYUV420PackedPlanar;
+	out->def.nBufferSize = v->nStride * v->nSliceHeight * 3 / 2;
+	dec->settings_changed = true;
+
+	CINFO(&dec->sc.gcomp, out, "%ux%u", (unsigned) width, (unsigned) height);
+	__gomx_event(&dec->sc.gcomp, OMX_EventPortSettingsChanged, out->def.nPortIndex, 0, 0);
+}
+
+static void __omxsoftvdec_add_frame(OMX_SOFTVDEC *dec)
+{
+	OMXSOFT_FRAME *f = &dec->next;
+	GOMX_PORT *in = &dec->port_data[OMXSOFT_VDEC_IN];
+
+	f->magic = OMXSOFT_FRAME_MAGIC;
+	f->width = in->def.format.video.nFrameWidth;
+	f->height = in->def.format.video.nFrameHeight;
+	f->checksum = dec->checksum;
+	f->seq = dec->seq++;
+
+	if (!(f->flags & OMX_BUFFERFLAG_TIME_UNKNOWN)) {
+		/* a pts going backwards means frames arrive in decode order */
+		if (dec->seq > 1 && f->pts < dec->last_pts && dec->reorder < OMXSOFT_MAX_REORDER)
+			dec->reorder++;
+		dec->last_pts = f->pts;
+	}
+	dec->frames[dec->nframes++] = *f;
+	dec->in_frame = false;
+	OMXSOFT_STAT_ADD(frames_decoded, 1);
+}
+
+/* Index of the frame to output next: lowest pts, unknown pts in order */
+static size_t omxsoftvdec_next_frame(OMX_SOFTVDEC *dec)
+{
+	size_t best = 0;
+	for (size_t i = 0; i < dec->nframes; i++) {
+		if (dec->frames[i].flags & OMX_BUFFERFLAG_TIME_UNKNOWN) break;
+		if (dec->frames[i].pts < dec->frames[best].pts) best = i;
+	}
+	return best;
+}
+
+static void __omxsoftvdec_remove_frame(OMX_SOFTVDEC *dec, size_t i)
+{
+	memmove(&dec->frames[i], &dec->frames[i + 1], (dec->nframes - i - 1) * sizeof dec->frames[0]);
+	dec->nframes--;
+}
+
+/* Sends one frame or the end of stream, true if something was done */
+static bool __omxsoftvdec_output(OMX_SOFTVDEC *dec)
+{
+	GOMX_COMPONENT *comp = &dec->sc.gcomp;
+	GOMX_PORT *out = &dec->port_data[OMXSOFT_VDEC_OUT];
+	OMX_BUFFERHEADERTYPE *hdr;
+	OMXSOFT_FRAME frame;
+	size_t i = 0;
+
+	if (dec->nframes > dec->reorder || (dec->eos && dec->nframes)) {
+		i = omxsoftvdec_next_frame(dec);
+		frame = dec->frames[i];
+		if (frame.flags & OMX_BUFFERFLAG_DECODEONLY) {
+			__omxsoftvdec_remove_frame(dec, i);
+			OMXSOFT_STAT_ADD(frames_dropped, 1);
+			return true;
+		}
+	} else if (dec->eos && !dec->in_frame) {
+		memset(&frame, 0, sizeof frame);
+		frame.flags = OMX_BUFFERFLAG_EOS | OMX_BUFFERFLAG_TIME_UNKNOWN;
+	} else {
+		return false;
+	}
+
+	if (!(hdr = __omxsoft_get_output(out)))
+		return false;
+
+	hdr->nOffset = 0;
+	hdr->nFilledLen = 0;
+	hdr->nFlags = frame.flags | OMX_BUFFERFLAG_ENDOFFRAME;
+	hdr->nTimeStamp = omx_ticks_from_s64(frame.pts);
+	if (frame.magic && hdr->nAllocLen >= sizeof frame) {
+		memcpy(hdr->pBuffer, &frame, sizeof frame);
+		hdr->nFilledLen = sizeof frame;
+	}
+
+	__omxsoft_set_busy(&dec->sc, true);
+	if (__omxsoft_send(comp, out, hdr) == OMX_ErrorNone) {
+		if (frame.magic)
+			__omxsoftvdec_remove_frame(dec, i);
+		else
+			dec->eos = false;
+		__omxsoft_set_busy(&dec->sc, false);
+		return true;
+	}
+	__omxsoft_set_busy(&dec->sc, false);
+	return false;
+}
+
+static void __omxsoftvdec_decode(OMX_SOFTVDEC *dec)
+{
+	GOMX_COMPONENT *comp = &dec->sc.gcomp;
+	OMX_BUFFERHEADERTYPE *buf = dec->sc.cur;
+	int64_t decode_us = 0;
+	bool frame_done = false;
+
+	if (!buf->pBuffer || buf->nOffset + buf->nFilledLen > buf->nAllocLen) {
+		CINFO(comp, 0, "%p: bad buffer %p, offset %u, %u of %u bytes",
+			buf, buf->pBuffer, buf->nOffset, buf->nFilledLen, buf->nAllocLen);
+		__gomx_event(comp, OMX_EventError, OMX_ErrorBadParameter, dec->port_data[OMXSOFT_VDEC_IN].def.nPortIndex, 0);
+		return;
+	}
+
+	if (!(buf->nFlags & OMX_BUFFERFLAG_CODECCONFIG)) {
+		if (!dec->in_frame) {
+			dec->next.pts = omx_ticks_to_s64(buf->nTimeStamp);
+			dec->next.flags = buf->nFlags & (OMX_BUFFERFLAG_TIME_UNKNOWN | OMX_BUFFERFLAG_DECODEONLY |
+							 OMX_BUFFERFLAG_STARTTIME | OMX_BUFFERFLAG_DISCONTINUITY);
+			dec->in_frame = buf->nFilledLen != 0;
+		}
+		if ((buf->nFlags & OMX_BUFFERFLAG_ENDOFFRAME) && dec->in_frame) {
+			decode_us = dec->sc.config.decode_us;
+			frame_done = true;
+		}
+	}
+
+	const uint8_t *p = buf->pBuffer + buf->nOffset;
+	uint32_t checksum = dec->checksum;
+
+	__omxsoft_set_busy(&dec->sc, true);
+	pthread_mutex_unlock(&comp->mutex);
+	/* FNV-1a over the payload stands in for the DMA to the decoder */
+	for (OMX_U32 i = 0; i < buf->nFilledLen; i++)
+		checksum = (checksum ^ p[i]) * 16777619u;
+	omxsoft_sleep(decode_us);
+	pthread_mutex_lock(&comp->mutex);
+	__omxsoft_set_busy(&dec->sc, false);
+
+	dec->checksum = checksum;
+	OMXSOFT_STAT_ADD(input_buffers, 1);
+	OMXSOFT_STAT_ADD(input_bytes, buf->nFilledLen);
+
+	if (frame_done) {
+		if (!dec->settings_changed)
+			__omxsoftvdec_settings_changed(dec);
+		__omxsoftvdec_add_frame(dec);
+	}
+	if (buf->nFlags & OMX_BUFFERFLAG_EOS)
+		dec->eos = true;
+}
+
+static void *omxsoftvdec_worker(void *ptr)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) ptr;
+	OMX_SOFTVDEC *dec = (OMX_SOFTVDEC *) comp;
+
+	CINFO(comp, 0, "worker started");
+
+	pthread_mutex_lock(&comp->mutex);
+	while (comp->wanted_state == OMX_StateExecuting) {
+		if (__omxsoftvdec_output(dec))
+			continue;
+
+		/* stall the input while the decoded frames have nowhere to go */
+		if (!dec->eos && dec->nframes <= dec->reorder &&
+		    (dec->sc.cur = (OMX_BUFFERHEADERTYPE *) gomxq_dequeue(&dec->sc.inq)) != 0) {
+			__omxsoftvdec_decode(dec);
+			if (dec->sc.cur) __omxsoft_input_done(&dec->sc);
+			continue;
+		}
+		omxsoft_wait(&dec->sc, -1);
+	}
+	CINFO(comp, 0, "worker stopped: %llu frames, checksum %08x",
+		(unsigned long long) dec->seq, dec->checksum);
+	pthread_mutex_unlock(&comp->mutex);
+	return 0;
+}
+
+/* Decoded frames survive the output port being disabled for the port
+ * settings change, only an input flush (a seek) drops them */
+static OMX_ERRORTYPE omxsoftvdec_flush(GOMX_COMPONENT *comp, GOMX_PORT *port)
+{
+	OMX_SOFTVDEC *dec = (OMX_SOFTVDEC *) comp;
+
+	while (dec->sc.busy)
+		pthread_cond_wait(&dec->sc.cond_busy, &comp->mutex);
+	if (port == &dec->port_data[OMXSOFT_VDEC_IN]) {
+		omxsoft_input_flush(comp, port);
+		dec->in_frame = false;
+		dec->eos = false;
+		dec->nframes = 0;
+	}
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE omxsoftvdec_create(OMX_HANDLETYPE *pHandle, const char *name, OMX_PTR pAppData, OMX_CALLBACKTYPE *pCallbacks)
+{
+	OMX_SOFTVDEC *dec;
+	GOMX_PORT *port;
+
+	dec = (OMX_SOFTVDEC *) calloc(1, sizeof *dec);
+	if (!dec) return OMX_ErrorInsufficientResources;
+
+	dec->checksum = 2166136261u;
+
+	/* Sized like the firmware decoder's defaults */
+	port = &dec->port_data[OMXSOFT_VDEC_IN];
+	omxsoft_port_init(port, 130, OMX_DirInput, OMX_PortDomainVideo, 1, 20, 80 * 1024);
+	port->def.format.video.cMIMEType = (char *) "video/avc";
+	port->def.format.video.eCompressionFormat = OMX_VIDEO_CodingAVC;
+	port->do_buffer = omxsoft_input_do_buffer;
+	port->flush = omxsoftvdec_flush;
+
+	port = &dec->port_data[OMXSOFT_VDEC_OUT];
+	omxsoft_port_init(port, 131, OMX_DirOutput, OMX_PortDomainVideo, 1, 3, 1920 * 1088 * 3 / 2);
+	port->def.format.video.cMIMEType = (char *) "video/x-raw-yuv";
+	port->def.format.video.eColorFormat = OMX_COLOR_FormatYUV420PackedPlanar;
+	port->flush = omxsoftvdec_flush;
+
+	omxsoft_comp_init(&dec->sc, name, pAppData, pCallbacks, dec->port_data, ARRAY_SIZE(dec->port_data), omxsoftvdec_worker);
+	dec->sc.gcomp.omx.GetParameter = omxsoftvdec_get_parameter;
+	dec->sc.gcomp.omx.SetParameter = omxsoftvdec_set_parameter;
+	dec->sc.gcomp.omx.GetConfig = omxsoftvdec_get_config;
+
+	*pHandle = (OMX_HANDLETYPE) dec;
+	return OMX_ErrorNone;
+}
+
+/* Video scheduler
+ *
+ * Input 10, output 11, clock 12. Holds each frame until the media time
+ * reaches its pts, reporting the first frame's start time to the clock. */
+
+#define OMXSOFT_SCHED_IN	0
+#define OMXSOFT_SCHED_OUT	1
+#define OMXSOFT_SCHED_CLOCK	2
+
+typedef struct _OMX_SOFTSCHED {
+	OMX_SOFTCOMP sc;
+	GOMX_PORT port_data[3];
+	bool start_sent, released;
+} OMX_SOFTSCHED;
+
+static void *omxsoftsched_worker(void *ptr)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) ptr;
+	OMX_SOFTSCHED *sched = (OMX_SOFTSCHED *) comp;
+	GOMX_PORT *out = &sched->port_data[OMXSOFT_SCHED_OUT];
+	GOMX_PORT *clock = &sched->port_data[OMXSOFT_SCHED_CLOCK];
+	OMX_BUFFERHEADERTYPE *buf, *hdr;
+	int64_t pts, now, wait;
+
+	CINFO(comp, 0, "worker started");
+
+	pthread_mutex_lock(&comp->mutex);
+	while (comp->wanted_state == OMX_StateExecuting) {
+		if (!sched->sc.cur) {
+			sched->sc.cur = (OMX_BUFFERHEADERTYPE *) gomxq_dequeue(&sched->sc.inq);
+			sched->start_sent = false;
+			sched->released = false;
+			if (!sched->sc.cur) {
+				omxsoft_wait(&sched->sc, -1);
+				continue;
+			}
+		}
+		buf = sched->sc.cur;
+		pts = omx_ticks_to_s64(buf->nTimeStamp);
+
+		if (clock->tunnel_comp && clock->def.bEnabled && !sched->released &&
+		    !(buf->nFlags & (OMX_BUFFERFLAG_TIME_UNKNOWN | OMX_BUFFERFLAG_EOS))) {
+			if ((buf->nFlags & OMX_BUFFERFLAG_STARTTIME) && !sched->start_sent) {
+				__omxsoft_set_busy(&sched->sc, true);
+				__omxsoft_client_start_time(&sched->sc, buf->nTimeStamp);
+				__omxsoft_set_busy(&sched->sc, false);
+				sched->start_sent = true;
+				continue;
+			}
+			now = omxsoft_now();
+			wait = omxsoft_timeref_until(&sched->sc.timeref, pts, now);
+			if (wait != 0) {
+				omxsoft_wait(&sched->sc, wait);
+				continue;
+			}
+			if (omxsoft_timeref_media(&sched->sc.timeref, now) - pts > OMXSOFT_LATE_US)
+				OMXSOFT_STAT_ADD(frames_late, 1);
+			sched->released = true;
+		}
+
+		if (!(hdr = __omxsoft_get_output(out))) {
+			omxsoft_wait(&sched->sc, -1);
+			continue;
+		}
+		hdr->nOffset = 0;
+		hdr->nFilledLen = buf->nFilledLen < hdr->nAllocLen ? buf->nFilledLen : hdr->nAllocLen;
+		memcpy(hdr->pBuffer, buf->pBuffer + buf->nOffset, hdr->nFilledLen);
+		hdr->nFlags = buf->nFlags;
+		hdr->nTimeStamp = buf->nTimeStamp;
+
+		__omxsoft_set_busy(&sched->sc, true);
+		if (__omxsoft_send(comp, out, hdr) == OMX_ErrorNone) {
+			__omxsoft_set_busy(&sched->sc, false);
+			__omxsoft_input_done(&sched->sc);
+		} else {
+			__omxsoft_set_busy(&sched->sc, false);
+			omxsoft_wait(&sched->sc, -1);
+		}
+	}
+	pthread_mutex_unlock(&comp->mutex);
+	CINFO(comp, 0, "worker stopped");
+	return 0;
+}
+
+static OMX_ERRORTYPE omxsoftsched_create(OMX_HANDLETYPE *pHandle, const char *name, OMX_PTR pAppData, OMX_CALLBACKTYPE *pCallbacks)
+{
+	OMX_SOFTSCHED *sched;
+	GOMX_PORT *port;
+
+	sched = (OMX_SOFTSCHED *) calloc(1, sizeof *sched);
+	if (!sched) return OMX_ErrorInsufficientResources;
+
+	port = &sched->port_data[OMXSOFT_SCHED_IN];
+	omxsoft_port_init(port, 10, OMX_DirInput, OMX_PortDomainVideo, 1, 1, sizeof(OMXSOFT_FRAME));
+	port->def.format.video.eColorFormat = OMX_COLOR_FormatYUV420PackedPlanar;
+	port->do_buffer = omxsoft_input_do_buffer;
+	port->flush = omxsoft_input_flush;
+
+	port = &sched->port_data[OMXSOFT_SCHED_OUT];
+	omxsoft_port_init(port, 11, OMX_DirOutput, OMX_PortDomainVideo, 1, 2, sizeof(OMXSOFT_FRAME));
+	port->def.format.video.eColorFormat = OMX_COLOR_FormatYUV420PackedPlanar;
+
+	omxsoft_clock_port_init(&sched->sc, &sched->port_data[OMXSOFT_SCHED_CLOCK], 12);
+
+	omxsoft_comp_init(&sched->sc, name, pAppData, pCallbacks, sched->port_data, ARRAY_SIZE(sched->port_data), omxsoftsched_worker);
+
+	*pHandle = (OMX_HANDLETYPE) sched;
+	return OMX_ErrorNone;
+}
+
+/* Video renderer
+ *
+ * Input 90. A null display: one frame per refresh at display_hz. */
+
+typedef struct _OMX_SOFTVRENDER {
+	OMX_SOFTCOMP sc;
+	GOMX_PORT port_data[1];
+	int64_t vsync;
+} OMX_SOFTVRENDER;
+
+static void *omxsoftvrender_worker(void *ptr)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) ptr;
+	OMX_SOFTVRENDER *rend = (OMX_SOFTVRENDER *) comp;
+	OMX_BUFFERHEADERTYPE *buf;
+	int64_t period = 1000000 / rend->sc.config.display_hz;
+	int64_t now;
+
+	CINFO(comp, 0, "worker started");
+
+	pthread_mutex_lock(&comp->mutex);
+	while (comp->wanted_state == OMX_StateExecuting) {
+		if (!rend->sc.cur) {
+			rend->sc.cur = (OMX_BUFFERHEADERTYPE *) gomxq_dequeue(&rend->sc.inq);
+			if (!rend->sc.cur) {
+				omxsoft_wait(&rend->sc, -1);
+				continue;
+			}
+			rend->vsync = (omxsoft_now() / period + 1) * period;
+		}
+		buf = rend->sc.cur;
+
+		if (buf->nFilledLen) {
+			now = omxsoft_now();
+			if (now < rend->vsync) {
+				omxsoft_wait(&rend->sc, rend->vsync - now);
+				continue;
+			}
+			OMXSOFT_STAT_ADD(frames_presented, 1);
+		}
+		if (buf->nFlags & OMX_BUFFERFLAG_EOS) {
+			CDEBUG(comp, 0, "end-of-stream");
+			__gomx_event(comp, OMX_EventBufferFlag, rend->port_data[0].def.nPortIndex, buf->nFlags, 0);
+		}
+		if (rend->sc.cur) __omxsoft_input_done(&rend->sc);
+	}
+	pthread_mutex_unlock(&comp->mutex);
+	CINFO(comp, 0, "worker stopped");
+	return 0;
+}
+
+static OMX_ERRORTYPE omxsoftvrender_create(OMX_HANDLETYPE *pHandle, const char *name, OMX_PTR pAppData, OMX_CALLBACKTYPE *pCallbacks)
+{
+	OMX_SOFTVRENDER *rend;
+	GOMX_PORT *port;
+
+	rend = (OMX_SOFTVRENDER *) calloc(1, sizeof *rend);
+	if (!rend) return OMX_ErrorInsufficientResources;
+
+	port = &rend->port_data[0];
+	omxsoft_port_init(port, 90, OMX_DirInput, OMX_PortDomainVideo, 1, 1, sizeof(OMXSOFT_FRAME));
+	port->def.format.video.eColorFormat = OMX_COLOR_FormatYUV420PackedPlanar;
+	port->do_buffer = omxsoft_input_do_buffer;
+	port->flush = omxsoft_input_flush;
+
+	omxsoft_comp_init(&rend->sc, name, pAppData, pCallbacks, rend->port_data, ARRAY_SIZE(rend->port_data), omxsoftvrender_worker);
+
+	*pHandle = (OMX_HANDLETYPE) rend;
+	return OMX_ErrorNone;
+}
+
+/* Filters: image_fx (190/191), audio_decode (120/121), audio_mixer (231/230)
+ *
+ * One input and one output port. Each input buffer is converted into as
+ * many output buffers as it takes; the first carries its timestamp and
+ * flags, the last its end of frame/stream. */
+
+typedef struct _OMX_SOFTFILTER OMX_SOFTFILTER;
+
+struct _OMX_SOFTFILTER {
+	OMX_SOFTCOMP sc;
+	GOMX_PORT port_data[2];
+	GOMX_PORT *in, *out;
+	OMX_U32 in_offset;
+	OMX_AUDIO_PARAM_PCMMODETYPE pcm_in, pcm_out;
+	bool pcm_in_valid;
+	/* consumes a codec config buffer, optional */
+	void (*codec_config)(OMX_SOFTFILTER *, OMX_BUFFERHEADERTYPE *);
+	/* converts what fits, called without the lock */
+	size_t (*convert)(OMX_SOFTFILTER *, const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len, size_t *written);
+};
+
+static size_t omxsoftfilter_copy(OMX_SOFTFILTER *f, const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len, size_t *written)
+{
+	size_t n = src_len < dst_len ? src_len : dst_len;
+	memcpy(dst, src, n);
+	*written = n;
+	return n;
+}
+
+static size_t omxsoft_pcm_frame_size(const OMX_AUDIO_PARAM_PCMMODETYPE *pcm)
+{
+	return pcm->nChannels * pcm->nBitPerSample / 8;
+}
+
+static size_t omxsoftfilter_copy_frames(OMX_SOFTFILTER *f, const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len, size_t *written)
+{
+	size_t frame = omxsoft_pcm_frame_size(&f->pcm_out);
+	size_t n = src_len < dst_len ? src_len : dst_len;
+
+	/* a partial frame at the end of the input is passed as is */
+	if (frame && n < src_len) n -= n % frame;
+	memcpy(dst, src, n);
+	*written = n;
+	return n;
+}
+
+static int32_t omxsoft_read_sample(const uint8_t *p, unsigned int bytes)
+{
+	switch (bytes) {
+	case 1: return (int32_t)((uint32_t)(p[0] ^ 0x80) << 24);
+	case 2: return (int32_t)((uint32_t)p[0] << 16 | (uint32_t)p[1] << 24);
+	case 3: return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+	default: return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+	}
+}
+
+static void omxsoft_write_sample(uint8_t *p, unsigned int bytes, int32_t v)
+{
+	uint32_t u = (uint32_t) v;
+	switch (bytes) {
+	case 1: p[0] = (uint8_t)(u >> 24) ^ 0x80; break;
+	case 2: p[0] = u >> 16; p[1] = u >> 24; break;
+	case 3: p[0] = u >> 8; p[1] = u >> 16; p[2] = u >> 24; break;
+	default: p[0] = u; p[1] = u >> 8; p[2] = u >> 16; p[3] = u >> 24; break;
+	}
+}
+
+/* Channel count and sample size conversion, extra input channels are
+ * dropped and missing ones left silent. Signed little endian only. */
+static size_t omxsoftfilter_mix(OMX_SOFTFILTER *f, const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len, size_t *written)
+{
+	unsigned int in_ch = f->pcm_in.nChannels, out_ch = f->pcm_out.nChannels;
+	unsigned int in_bytes = f->pcm_in.nBitPerSample / 8, out_bytes = f->pcm_out.nBitPerSample / 8;
+	size_t in_frame = in_ch * in_bytes, out_frame = out_ch * out_bytes;
+	size_t frames;
+
+	if (!in_frame || !out_frame || (in_ch == out_ch && in_bytes == out_bytes))
+		return omxsoftfilter_copy(f, src, src_len, dst, dst_len, written);
+
+	frames = src_len / in_frame;
+	if (frames > dst_len / out_frame) frames = dst_len / out_frame;
+	for (size_t i = 0; i < frames; i++) {
+		for (unsigned int c = 0; c < out_ch; c++) {
+			int32_t v = c < in_ch ? omxsoft_read_sample(src + c * in_bytes, in_bytes) : 0;
+			omxsoft_write_sample(dst + c * out_bytes, out_bytes, v);
+		}
+		src += in_frame;
+		dst += out_frame;
+	}
+	*written = frames * out_frame;
+	/* drop a trailing partial frame */
+	if (frames == src_len / in_frame && src_len % in_frame)
+		return src_len;
+	return frames * in_frame;
+}
+
+static void omxsoft_pcm_default(OMX_AUDIO_PARAM_PCMMODETYPE *pcm, OMX_U32 port)
+{
+	static const OMX_AUDIO_CHANNELTYPE map[] = {
+		OMX_AUDIO_ChannelLF, OMX_AUDIO_ChannelRF, OMX_AUDIO_ChannelCF, OMX_AUDIO_ChannelLFE,
+		OMX_AUDIO_ChannelLR, OMX_AUDIO_ChannelRR, OMX_AUDIO_ChannelLS, OMX_AUDIO_ChannelRS,
+	};
+
+	omx_init(*pcm);
+	pcm->nPortIndex = port;
+	if (!pcm->nChannels) pcm->nChannels = 2;
+	pcm->eNumData = OMX_NumericalDataSigned;
+	pcm->eEndian = OMX_EndianLittle;
+	pcm->bInterleaved = OMX_TRUE;
+	if (!pcm->nBitPerSample) pcm->nBitPerSample = 16;
+	if (!pcm->nSamplingRate) pcm->nSamplingRate = 48000;
+	pcm->ePCMMode = OMX_AUDIO_PCMModeLinear;
+	for (size_t i = 0; i < ARRAY_SIZE(map) && i < OMX_AUDIO_MAXCHANNELS; i++)
+		pcm->eChannelMapping[i] = i < pcm->nChannels ? map[i] : OMX_AUDIO_ChannelNone;
+}
+
+/* WAVEFORMATEX(TENSIBLE) from COMXAudio, read field by field */
+static void omxsoftfilter_wave_config(OMX_SOFTFILTER *f, OMX_BUFFERHEADERTYPE *buf)
+{
+	const uint8_t *p = buf->pBuffer + buf->nOffset;
+	OMX_AUDIO_PARAM_PCMMODETYPE *pcm = &f->pcm_out;
+
+	if (buf->nFilledLen < 16) {
+		CINFO(&f->sc.gcomp, f->in, "short codec config, %u bytes", buf->nFilledLen);
+		return;
+	}
+	memset(pcm, 0, sizeof *pcm);
+	pcm->nChannels = p[2] | p[3] << 8;
+	pcm->nSamplingRate = p[4] | p[5] << 8 | p[6] << 16 | (OMX_U32) p[7] << 24;
+	pcm->nBitPerSample = p[14] | p[15] << 8;
+	if (pcm->nChannels > OMX_AUDIO_MAXCHANNELS) pcm->nChannels = OMX_AUDIO_MAXCHANNELS;
+	omxsoft_pcm_default(pcm, f->out->def.nPortIndex);
+
+	CINFO(&f->sc.gcomp, f->out, "%u channels, %u Hz, %u bits",
+		(unsigned) pcm->nChannels, (unsigned) pcm->nSamplingRate, (unsigned) pcm->nBitPerSample);
+	__gomx_event(&f->sc.gcomp, OMX_EventPortSettingsChanged, f->out->def.nPortIndex, 0, 0);
+}
+
+/* The mixer takes the format of whatever feeds it */
+static void __omxsoftfilter_query_input(OMX_SOFTFILTER *f)
+{
+	GOMX_COMPONENT *comp = &f->sc.gcomp;
+	OMX_AUDIO_PARAM_PCMMODETYPE pcm;
+
+	if (f->pcm_in_valid || !f->in->tunnel_comp) return;
+
+	omx_init(pcm);
+	pcm.nPortIndex = f->in->tunnel_port;
+	pthread_mutex_unlock(&comp->mutex);
+	OMX_ERRORTYPE r = OMX_GetParameter(f->in->tunnel_comp, OMX_IndexParamAudioPcm, &pcm);
+	pthread_mutex_lock(&comp->mutex);
+	if (r == OMX_ErrorNone) {
+		pcm.nPortIndex = f->in->def.nPortIndex;
+		f->pcm_in = pcm;
+	}
+	f->pcm_in_valid = true;
+}
+
+static void *omxsoftfilter_worker(void *ptr)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) ptr;
+	OMX_SOFTFILTER *f = (OMX_SOFTFILTER *) comp;
+	OMX_BUFFERHEADERTYPE *buf, *hdr;
+	size_t consumed, written;
+	OMX_U32 flags;
+
+	CINFO(comp, 0, "worker started");
+
+	pthread_mutex_lock(&comp->mutex);
+	while (comp->wanted_state == OMX_StateExecuting) {
+		if (!f->sc.cur) {
+			f->sc.cur = (OMX_BUFFERHEADERTYPE *) gomxq_dequeue(&f->sc.inq);
+			f->in_offset = 0;
+			if (!f->sc.cur) {
+				omxsoft_wait(&f->sc, -1);
+				continue;
+			}
+		}
+		buf = f->sc.cur;
+
+		if (buf->nFlags & OMX_BUFFERFLAG_CODECCONFIG) {
+			if (f->codec_config) f->codec_config(f, buf);
+			if (f->sc.cur) __omxsoft_input_done(&f->sc);
+			continue;
+		}
+		if (f->convert == omxsoftfilter_mix) {
+			__omxsoft_set_busy(&f->sc, true);
+			__omxsoftfilter_query_input(f);
+			__omxsoft_set_busy(&f->sc, false);
+		}
+
+		if (!(hdr = __omxsoft_get_output(f->out))) {
+			omxsoft_wait(&f->sc, -1);
+			continue;
+		}
+
+		__omxsoft_set_busy(&f->sc, true);
+		pthread_mutex_unlock(&comp->mutex);
+		consumed = f->convert(f, buf->pBuffer + buf->nOffset + f->in_offset, buf->nFilledLen - f->in_offset,
+				      hdr->pBuffer, hdr->nAllocLen, &written);
+		pthread_mutex_lock(&comp->mutex);
+
+		hdr->nOffset = 0;
+		hdr->nFilledLen = written;
+		hdr->nTimeStamp = buf->nTimeStamp;
+		if (f->in_offset == 0)
+			hdr->nFlags = buf->nFlags & ~(OMX_BUFFERFLAG_EOS | OMX_BUFFERFLAG_ENDOFFRAME);
+		else
+			hdr->nFlags = OMX_BUFFERFLAG_TIME_UNKNOWN;
+		if (f->in_offset + consumed >= buf->nFilledLen)
+			hdr->nFlags |= buf->nFlags & (OMX_BUFFERFLAG_EOS | OMX_BUFFERFLAG_ENDOFFRAME);
+		flags = hdr->nFlags;
+
+		if (__omxsoft_send(comp, f->out, hdr) != OMX_ErrorNone) {
+			__omxsoft_set_busy(&f->sc, false);
+			omxsoft_wait(&f->sc, -1);
+			continue;
+		}
+		__omxsoft_set_busy(&f->sc, false);
+		/* like the firmware, COMXAudio::IsEOS() waits for it on audio_decode */
+		if (flags & OMX_BUFFERFLAG_EOS)
+			__gomx_event(comp, OMX_EventBufferFlag, f->out->def.nPortIndex, flags, 0);
+
+		f->in_offset += consumed;
+		if (f->in_offset >= buf->nFilledLen)
+			__omxsoft_input_done(&f->sc);
+	}
+	pthread_mutex_unlock(&comp->mutex);
+	CINFO(comp, 0, "worker stopped");
+	return 0;
+}
+
+static OMX_ERRORTYPE omxsoftfilter_get_parameter(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nParamIndex, OMX_PTR pComponentParameterStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	OMX_SOFTFILTER *f = (OMX_SOFTFILTER *) hComponent;
+	OMX_AUDIO_PARAM_PCMMODETYPE *pmt;
+	OMX_ERRORTYPE r;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	switch (nParamIndex) {
+	case OMX_IndexParamAudioPcm:
+		if ((r = omx_cast(pmt, pComponentParameterStructure))) return r;
+		pthread_mutex_lock(&comp->mutex);
+		if (pmt->nPortIndex == f->out->def.nPortIndex)
+			memcpy(pmt, &f->pcm_out, sizeof *pmt);
+		else if (pmt->nPortIndex == f->in->def.nPortIndex)
+			memcpy(pmt, &f->pcm_in, sizeof *pmt);
+		else
+			r = OMX_ErrorBadPortIndex;
+		pthread_mutex_unlock(&comp->mutex);
+		return r;
+	default:
+		return gomx_get_parameter(hComponent, nParamIndex, pComponentParameterStructure);
+	}
+}
+
+static OMX_ERRORTYPE omxsoftfilter_set_parameter(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nParamIndex, OMX_PTR pComponentParameterStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	OMX_SOFTFILTER *f = (OMX_SOFTFILTER *) hComponent;
+	OMX_AUDIO_PARAM_PCMMODETYPE *pmt;
+	OMX_AUDIO_PARAM_PORTFORMATTYPE *pft;
+	OMX_ERRORTYPE r;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	switch (nParamIndex) {
+	case OMX_IndexParamAudioPcm:
+		if ((r = omx_cast(pmt, pComponentParameterStructure))) return r;
+		if (pmt->ePCMMode != OMX_AUDIO_PCMModeLinear || pmt->eNumData != OMX_NumericalDataSigned ||
+		    pmt->eEndian != OMX_EndianLittle || pmt->nBitPerSample % 8 || pmt->nBitPerSample > 32 ||
+		    !pmt->nChannels || pmt->nChannels > OMX_AUDIO_MAXCHANNELS)
+			return OMX_ErrorUnsupportedSetting;
+		pthread_mutex_lock(&comp->mutex);
+		if (pmt->nPortIndex == f->out->def.nPortIndex) {
+			memcpy(&f->pcm_out, pmt, sizeof *pmt);
+		} else if (pmt->nPortIndex == f->in->def.nPortIndex) {
+			memcpy(&f->pcm_in, pmt, sizeof *pmt);
+			f->pcm_in_valid = true;
+		} else {
+			r = OMX_ErrorBadPortIndex;
+		}
+		pthread_mutex_unlock(&comp->mutex);
+		return r;
+	case OMX_IndexParamAudioPortFormat:
+		/* no compressed audio, so no passthrough either */
+		if ((r = omx_cast(pft, pComponentParameterStructure))) return r;
+		if (pft->eEncoding != OMX_AUDIO_CodingPCM)
+			return OMX_ErrorUnsupportedSetting;
+		return OMX_ErrorNone;
+	default:
+		return omxsoft_set_parameter(hComponent, nParamIndex, pComponentParameterStructure);
+	}
+}
+
+static OMX_ERRORTYPE omxsoftfilter_get_config(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nIndex, OMX_PTR pComponentConfigStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	OMX_CONFIG_BRCMAUDIOMAXSAMPLETYPE *mst;
+	OMX_ERRORTYPE r;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	switch ((int) nIndex) {
+	case OMX_IndexConfigBrcmAudioMaxSample:
+		if ((r = omx_cast(mst, pComponentConfigStructure))) return r;
+		mst->nMaxSample = 0;
+		mst->nTimeStamp = omx_ticks_from_s64(0);
+		break;
+	default:
+		CINFO(comp, 0, "UNSUPPORTED %x, %p", nIndex, pComponentConfigStructure);
+		return OMX_ErrorNotImplemented;
+	}
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE omxsoftfilter_flush(GOMX_COMPONENT *comp, GOMX_PORT *port)
+{
+	OMX_SOFTFILTER *f = (OMX_SOFTFILTER *) comp;
+
+	if (port == f->in)
+		return omxsoft_input_flush(comp, port);
+	while (f->sc.busy)
+		pthread_cond_wait(&f->sc.cond_busy, &comp->mutex);
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE omxsoftfilter_create(OMX_HANDLETYPE *pHandle, const char *name, OMX_PTR pAppData, OMX_CALLBACKTYPE *pCallbacks)
+{
+	OMX_SOFTFILTER *f;
+	const char *type = strrchr(name, '.') + 1;
+	bool mixer = strcmp(type, "audio_mixer") == 0;
+
+	f = (OMX_SOFTFILTER *) calloc(1, sizeof *f);
+	if (!f) return OMX_ErrorInsufficientResources;
+
+	/* the firmware mixer has its output port first */
+	f->out = &f->port_data[mixer ? 0 : 1];
+	f->in = &f->port_data[mixer ? 1 : 0];
+
+	if (strcmp(type, "image_fx") == 0) {
+		omxsoft_port_init(f->in, 190, OMX_DirInput, OMX_PortDomainImage, 1, 1, sizeof(OMXSOFT_FRAME));
+		omxsoft_port_init(f->out, 191, OMX_DirOutput, OMX_PortDomainImage, 1, 2, sizeof(OMXSOFT_FRAME));
+		f->in->def.format.image.eColorFormat = OMX_COLOR_FormatYUV420PackedPlanar;
+		f->out->def.format.image.eColorFormat = OMX_COLOR_FormatYUV420PackedPlanar;
+		f->convert = omxsoftfilter_copy;
+	} else {
+		if (mixer) {
+			omxsoft_port_init(f->out, 230, OMX_DirOutput, OMX_PortDomainAudio, 1, 4, 8 * 1024);
+			omxsoft_port_init(f->in, 231, OMX_DirInput, OMX_PortDomainAudio, 1, 1, 8 * 1024);
+			f->convert = omxsoftfilter_mix;
+		} else {
+			omxsoft_port_init(f->in, 120, OMX_DirInput, OMX_PortDomainAudio, 1, 16, 16 * 1024);
+			omxsoft_port_init(f->out, 121, OMX_DirOutput, OMX_PortDomainAudio, 1, 4, 8 * 1024);
+			f->codec_config = omxsoftfilter_wave_config;
+			f->convert = omxsoftfilter_copy_frames;
+		}
+		f->in->def.format.audio.cMIMEType = (char *) "raw/audio";
+		f->in->def.format.audio.eEncoding = OMX_AUDIO_CodingPCM;
+		f->out->def.format.audio.cMIMEType = (char *) "raw/audio";
+		f->out->def.format.audio.eEncoding = OMX_AUDIO_CodingPCM;
+		omxsoft_pcm_default(&f->pcm_in, f->in->def.nPortIndex);
+		omxsoft_pcm_default(&f->pcm_out, f->out->def.nPortIndex);
+	}
+	f->in->do_buffer = omxsoft_input_do_buffer;
+	f->in->flush = omxsoftfilter_flush;
+	f->out->flush = omxsoftfilter_flush;
+
+	omxsoft_comp_init(&f->sc, name, pAppData, pCallbacks, f->port_data, ARRAY_SIZE(f->port_data), omxsoftfilter_worker);
+	f->sc.gcomp.omx.GetParameter = omxsoftfilter_get_parameter;
+	f->sc.gcomp.omx.SetParameter = omxsoftfilter_set_parameter;
+	f->sc.gcomp.omx.GetConfig = omxsoftfilter_get_config;
+
+	*pHandle = (OMX_HANDLETYPE) f;
+	return OMX_ErrorNone;
+}
+
+/* Audio renderer
+ *
+ * Input 100, clock 101. A null device holding audio_latency_ms of audio,
+ * drained at the sample rate. Audio is held until the media time reaches
+ * it and then reported to the clock as the audio reference, like the
+ * firmware and the ALSA sink do. */
+
+#define OMXSOFT_ARENDER_AUDIO	0
+#define OMXSOFT_ARENDER_CLOCK	1
+
+typedef struct _OMX_SOFTARENDER {
+	OMX_SOFTCOMP sc;
+	GOMX_PORT port_data[2];
+	OMX_AUDIO_PARAM_PCMMODETYPE pcm;
+	size_t frame_size, play_queue_size;
+	int64_t device_end, starttime;
+	bool start_sent, draining, playing;
+} OMX_SOFTARENDER;
+
+/* Simulated time of audio queued in the device */
+static int64_t __omxsoftarender_delay(OMX_SOFTARENDER *rend, int64_t now)
+{
+	return rend->device_end > now ? rend->device_end - now : 0;
+}
+
+static OMX_ERRORTYPE omxsoftarender_set_parameter(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nParamIndex, OMX_PTR pComponentParameterStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	OMX_SOFTARENDER *rend = (OMX_SOFTARENDER *) hComponent;
+	OMX_AUDIO_PARAM_PCMMODETYPE *pmt;
+	GOMX_PORT *port;
+	OMX_ERRORTYPE r;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	switch (nParamIndex) {
+	case OMX_IndexParamAudioPcm:
+		if ((r = omx_cast(pmt, pComponentParameterStructure))) return r;
+		if (!(port = gomx_get_port(comp, pmt->nPortIndex))) return OMX_ErrorBadPortIndex;
+		if (port != &rend->port_data[OMXSOFT_ARENDER_AUDIO]) return OMX_ErrorBadParameter;
+		if (comp->state != OMX_StateLoaded && port->def.bEnabled)
+			return OMX_ErrorIncorrectStateOperation;
+		if (!pmt->nChannels || pmt->nBitPerSample % 8 || !pmt->nSamplingRate)
+			return OMX_ErrorBadParameter;
+		pthread_mutex_lock(&comp->mutex);
+		memcpy(&rend->pcm, pmt, sizeof *pmt);
+		rend->frame_size = omxsoft_pcm_frame_size(pmt);
+		pthread_mutex_unlock(&comp->mutex);
+		break;
+	default:
+		return omxsoft_set_parameter(hComponent, nParamIndex, pComponentParameterStructure);
+	}
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE omxsoftarender_get_config(OMX_HANDLETYPE hComponent, OMX_INDEXTYPE nIndex, OMX_PTR pComponentConfigStructure)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) hComponent;
+	OMX_SOFTARENDER *rend = (OMX_SOFTARENDER *) hComponent;
+	OMX_PARAM_U32TYPE *u32param;
+	OMX_ERRORTYPE r;
+
+	if (comp->state == OMX_StateInvalid) return OMX_ErrorInvalidState;
+
+	switch (nIndex) {
+	case OMX_IndexConfigAudioRenderingLatency:
+		if ((r = omx_cast(u32param, pComponentConfigStructure))) return r;
+		/* Number of samples received but not played */
+		pthread_mutex_lock(&comp->mutex);
+		u32param->nU32 = 0;
+		if (rend->frame_size) {
+			u32param->nU32 = rend->play_queue_size / rend->frame_size;
+			u32param->nU32 += __omxsoftarender_delay(rend, omxsoft_now()) * rend->pcm.nSamplingRate / 1000000;
+		}
+		pthread_mutex_unlock(&comp->mutex);
+		break;
+	default:
+		CINFO(comp, 0, "UNSUPPORTED %x, %p", nIndex, pComponentConfigStructure);
+		return OMX_ErrorNotImplemented;
+	}
+	return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE omxsoftarender_audio_do_buffer(GOMX_COMPONENT *comp, GOMX_PORT *port, OMX_BUFFERHEADERTYPE *buf)
+{
+	OMX_SOFTARENDER *rend = (OMX_SOFTARENDER *) comp;
+	rend->play_queue_size += buf->nFilledLen;
+	return omxsoft_input_do_buffer(comp, port, buf);
+}
+
+static OMX_ERRORTYPE omxsoftarender_audio_flush(GOMX_COMPONENT *comp, GOMX_PORT *port)
+{
+	OMX_SOFTARENDER *rend = (OMX_SOFTARENDER *) comp;
+	omxsoft_input_flush(comp, port);
+	rend->play_queue_size = 0;
+	rend->device_end = 0;
+	rend->draining = false;
+	rend->playing = false;
+	return OMX_ErrorNone;
+}
+
+static void __omxsoftarender_done(OMX_SOFTARENDER *rend)
+{
+	rend->play_queue_size -= rend->sc.cur->nFilledLen;
+	rend->start_sent = false;
+	rend->draining = false;
+	__omxsoft_input_done(&rend->sc);
+}
+
+static void *omxsoftarender_worker(void *ptr)
+{
+	GOMX_COMPONENT *comp = (GOMX_COMPONENT *) ptr;
+	OMX_SOFTARENDER *rend = (OMX_SOFTARENDER *) comp;
+	GOMX_PORT *clock = &rend->port_data[OMXSOFT_ARENDER_CLOCK];
+	int64_t latency = (int64_t) rend->sc.config.audio_latency_ms * 1000;
+	OMX_BUFFERHEADERTYPE *buf;
+	int64_t now, pts, delay, wait;
+	bool clocked;
+
+	CINFO(comp, 0, "worker started");
+
+	pthread_mutex_lock(&comp->mutex);
+	while (comp->wanted_state == OMX_StateExecuting) {
+		clocked = clock->tunnel_comp && clock->def.bEnabled;
+		now = omxsoft_now();
+		delay = __omxsoftarender_delay(rend, now);
+
+		if (!rend->sc.cur) {
+			/* keep the device buffer at the target latency, and
+			 * nothing is taken while paused */
+			if (delay > latency || (clocked && rend->sc.timeref.scale == 0)) {
+				omxsoft_wait(&rend->sc, delay > latency ? delay - latency : -1);
+				continue;
+			}
+			rend->sc.cur = (OMX_BUFFERHEADERTYPE *) gomxq_dequeue(&rend->sc.inq);
+			if (!rend->sc.cur) {
+				if (rend->playing && delay == 0) {
+					OMXSOFT_STAT_ADD(audio_underruns, 1);
+					rend->playing = false;
+				}
+				omxsoft_wait(&rend->sc, delay ? delay : -1);
+				continue;
+			}
+		}
+		buf = rend->sc.cur;
+		pts = omx_ticks_to_s64(buf->nTimeStamp);
+
+		if (rend->draining) {
+			if (delay) {
+				omxsoft_wait(&rend->sc, delay);
+				continue;
+			}
+			CDEBUG(comp, 0, "end-of-stream");
+			rend->playing = false;
+			__gomx_event(comp, OMX_EventBufferFlag, rend->port_data[OMXSOFT_ARENDER_AUDIO].def.nPortIndex, buf->nFlags, 0);
+			__omxsoftarender_done(rend);
+			continue;
+		}
+
+		if (clocked && !(buf->nFlags & OMX_BUFFERFLAG_TIME_UNKNOWN)) {
+			if (!rend->start_sent && (buf->nFlags & (OMX_BUFFERFLAG_STARTTIME | OMX_BUFFERFLAG_DISCONTINUITY))) {
+				CINFO(comp, 0, "STARTTIME nTimeStamp=%lld", (long long) pts);
+				rend->starttime = pts;
+				__omxsoft_set_busy(&rend->sc, true);
+				__omxsoft_client_start_time(&rend->sc, buf->nTimeStamp);
+				__omxsoft_set_busy(&rend->sc, false);
+			}
+			rend->start_sent = true;
+
+			/* play once the audio already queued runs up to pts */
+			wait = omxsoft_timeref_until(&rend->sc.timeref, pts - delay, now);
+			if (wait != 0) {
+				omxsoft_wait(&rend->sc, wait);
+				continue;
+			}
+
+			if (pts - delay >= rend->starttime) {
+				OMX_TIME_CONFIG_TIMESTAMPTYPE tst;
+				omx_init(tst);
+				tst.nPortIndex = clock->tunnel_port;
+				tst.nTimestamp = omx_ticks_from_s64(pts - delay);
+				__omxsoft_set_busy(&rend->sc, true);
+				pthread_mutex_unlock(&comp->mutex);
+				OMX_SetConfig(clock->tunnel_comp, OMX_IndexConfigTimeCurrentAudioReference, &tst);
+				pthread_mutex_lock(&comp->mutex);
+				__omxsoft_set_busy(&rend->sc, false);
+			}
+		}
+
+		if (!(buf->nFlags & (OMX_BUFFERFLAG_DECODEONLY | OMX_BUFFERFLAG_CODECCONFIG | OMX_BUFFERFLAG_DATACORRUPT)) &&
+		    rend->frame_size && buf->nFilledLen) {
+			size_t frames = buf->nFilledLen / rend->frame_size;
+			const volatile uint8_t *p = buf->pBuffer + buf->nOffset;
+			uint8_t sum = 0;
+
+			/* the DMA to the device reads every sample */
+			for (OMX_U32 i = 0; i < buf->nFilledLen; i++)
+				sum ^= p[i];
+			(void) sum;
+
+			if (rend->device_end < now) rend->device_end = now;
+			rend->device_end += (int64_t) frames * 1000000 / rend->pcm.nSamplingRate;
+			rend->playing = true;
+			OMXSOFT_STAT_ADD(audio_frames_played, frames);
+		}
+
+		if (buf->nFlags & OMX_BUFFERFLAG_EOS) {
+			rend->draining = true;
+			continue;
+		}
+		__omxsoftarender_done(rend);
+	}
+	pthread_mutex_unlock(&comp->mutex);
+	CINFO(comp, 0, "worker stopped");
+	return 0;
+}
+
+static OMX_ERRORTYPE omxsoftarender_create(OMX_HANDLETYPE *pHandle, const char *name, OMX_PTR pAppData, OMX_CALLBACKTYPE *pCallbacks)
+{
+	OMX_SOFTARENDER *rend;
+	GOMX_PORT *port;
+
+	rend = (OMX_SOFTARENDER *) calloc(1, sizeof *rend);
+	if (!rend) return OMX_ErrorInsufficientResources;
+
+	port = &rend->port_data[OMXSOFT_ARENDER_AUDIO];
+	omxsoft_port_init(port, 100, OMX_DirInput, OMX_PortDomainAudio, 4, 4, 8 * 1024);
+	port->def.format.audio.cMIMEType = (char *) "raw/audio";
+	port->def.format.audio.eEncoding = OMX_AUDIO_CodingPCM;
+	port->do_buffer = omxsoftarender_audio_do_buffer;
+	port->flush = omxsoftarender_audio_flush;
+
+	omxsoft_clock_port_init(&rend->sc, &rend->port_data[OMXSOFT_ARENDER_CLOCK], 101);
+
+	omxsoft_pcm_default(&rend->pcm, 100);
+	rend->frame_size = omxsoft_pcm_frame_size(&rend->pcm);
+
+	omxsoft_comp_init(&rend->sc, name, pAppData, pCallbacks, rend->port_data, ARRAY_SIZE(rend->port_data), omxsoftarender_worker);
+	rend->sc.gcomp.omx.SetParameter = omxsoftarender_set_parameter;
+	rend->sc.gcomp.omx.GetConfig = omxsoftarender_get_config;
+
+	*pHandle = (OMX_HANDLETYPE) rend;
+	return OMX_ErrorNone;
+}
+
+/* OMX IL core */
+
+static const struct {
+	const char *name;
+	OMX_ERRORTYPE (*create)(OMX_HANDLETYPE *, const char *, OMX_PTR, OMX_CALLBACKTYPE *);
+} omxsoft_components[] = {
+	{ "OMX.soft.clock",		omxsoftclock_create },
+	{ "OMX.soft.video_decode",	omxsoftvdec_create },
+	{ "OMX.soft.video_scheduler",	omxsoftsched_create },
+	{ "OMX.soft.video_render",	omxsoftvrender_create },
+	{ "OMX.soft.null_sink",		omxsoftvrender_create },
+	{ "OMX.soft.image_fx",		omxsoftfilter_create },
+	{ "OMX.soft.audio_decode",	omxsoftfilter_create },
+	{ "OMX.soft.audio_mixer",	omxsoftfilter_create },
+	{ "OMX.soft.audio_render",	omxsoftarender_create },
+};
+
+OMX_ERRORTYPE OMXSOFT_Init(void)
+{
+	pthread_mutex_lock(&omxsoft_lock);
+	if (omxsoft_refcount++ == 0) {
+		omxsoft_base_mono = omxsoft_mono_us();
+		omxsoft_base_time = 0;
+	}
+	pthread_mutex_unlock(&omxsoft_lock);
+	return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE OMXSOFT_Deinit(void)
+{
+	pthread_mutex_lock(&omxsoft_lock);
+	if (omxsoft_refcount > 0) omxsoft_refcount--;
+	pthread_mutex_unlock(&omxsoft_lock);
+	return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE OMXSOFT_GetHandle(OMX_HANDLETYPE *pHandle, OMX_STRING cComponentName,
+				OMX_PTR pAppData, OMX_CALLBACKTYPE *pCallBacks)
+{
+	const char *type;
+
+	if (!pHandle || !cComponentName || !pCallBacks) return OMX_ErrorBadParameter;
+
+	if (strncmp(cComponentName, "OMX.broadcom.", 13) == 0)
+		type = cComponentName + 13;
+	else if (strncmp(cComponentName, "OMX.soft.", 9) == 0)
+		type = cComponentName + 9;
+	else
+		return OMX_ErrorComponentNotFound;
+
+	for (size_t i = 0; i < ARRAY_SIZE(omxsoft_components); i++) {
+		if (strcmp(omxsoft_components[i].name + 9, type) == 0)
+			return omxsoft_components[i].create(pHandle, omxsoft_components[i].name, pAppData, pCallBacks);
+	}
+	CLog::Log(LOGERROR, "OMXSOFT_GetHandle: %s is not provided by the software core", cComponentName);
+	return OMX_ErrorComponentNotFound;
+}
+
+OMX_ERRORTYPE OMXSOFT_FreeHandle(OMX_HANDLETYPE hComponent)
+{
+	if (!hComponent) return OMX_ErrorBadParameter;
+	return ((OMX_COMPONENTTYPE*)hComponent)->ComponentDeInit(hComponent);
+}
+
+/* OMX IL 1.1.2 section 3.4.1: output side first, then the input side has
+ * the final say; a failed input undoes the output. NULL tears down. */
+OMX_ERRORTYPE OMXSOFT_SetupTunnel(OMX_HANDLETYPE hOutput, OMX_U32 nPortOutput,
+				  OMX_HANDLETYPE hInput, OMX_U32 nPortInput)
+{
+	OMX_COMPONENTTYPE *out = (OMX_COMPONENTTYPE *) hOutput;
+	OMX_COMPONENTTYPE *in = (OMX_COMPONENTTYPE *) hInput;
+	OMX_TUNNELSETUPTYPE tunnel;
+	OMX_ERRORTYPE r;
+
+	tunnel.nTunnelFlags = 0;
+	tunnel.eSupplier = OMX_BufferSupplyUnspecified;
+
+	if (out) {
+		r = out->ComponentTunnelRequest(hOutput, nPortOutput, hInput, nPortInput, &tunnel);
+		if (r != OMX_ErrorNone) return r;
+	}
+	if (in) {
+		r = in->ComponentTunnelRequest(hInput, nPortInput, hOutput, nPortOutput, &tunnel);
+		if (r != OMX_ErrorNone) {
+			if (out) out->ComponentTunnelRequest(hOutput, nPortOutput, 0, 0, 0);
+			return OMX_ErrorPortsNotCompatible;
+		}
+	}
+	return OMX_ErrorNone;
+}
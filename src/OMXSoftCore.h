@@ -0,0 +1,62 @@
+#pragma once
+/*
+ * Software OMX IL core
+ *
+ * This Program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * Null stand-ins for the Broadcom components omxplayer uses (clock,
+ * video_decode, video_scheduler, video_render, image_fx, audio_decode,
+ * audio_mixer, audio_render), built on the OMXGeneric.h framework. They use
+ * the firmware's port numbers, buffer counts and event sequences, consume
+ * every buffer and pace output against a simulated clock, so the whole
+ * player runs headless on a machine without VideoCore. Build with
+ * USE_SOFT_OMX to have DllOMX load this core instead of libopenmaxil; the
+ * names are also reachable as OMX.soft.* through OMXALSA_GetHandle.
+ */
+
+#include <stdint.h>
+#include <IL/OMX_Core.h>
+
+typedef struct _OMXSOFT_CONFIG {
+	unsigned int decode_us;		/* time video_decode spends per frame */
+	unsigned int display_hz;	/* video_render refresh rate */
+	unsigned int audio_latency_ms;	/* audio_render device buffer */
+	double speed;			/* rate of the simulated clock, 1.0 is real time */
+	int clock_drift_ppm;		/* rate error of the clock component, to test sync */
+} OMXSOFT_CONFIG;
+
+typedef struct _OMXSOFT_STATS {
+	uint64_t input_buffers;		/* buffers emptied by the decoders */
+	uint64_t input_bytes;
+	uint64_t frames_decoded;
+	uint64_t frames_presented;
+	uint64_t frames_late;		/* presented after their pts */
+	uint64_t frames_dropped;	/* decode-only frames never presented */
+	uint64_t audio_frames_played;
+	uint64_t audio_underruns;
+} OMXSOFT_STATS;
+
+/* Applies to components created afterwards, except speed which is global */
+void OMXSOFT_SetConfig(const OMXSOFT_CONFIG *config);
+void OMXSOFT_GetConfig(OMXSOFT_CONFIG *config);
+void OMXSOFT_GetStats(OMXSOFT_STATS *stats);
+void OMXSOFT_ResetStats(void);
+
+OMX_ERRORTYPE OMXSOFT_Init(void);
+OMX_ERRORTYPE OMXSOFT_Deinit(void);
+
+/* Accepts OMX.broadcom.<name> and OMX.soft.<name> */
+OMX_ERRORTYPE OMXSOFT_GetHandle(
+    OMX_HANDLETYPE *pHandle,
+    OMX_STRING cComponentName,
+    OMX_PTR pAppData,
+    OMX_CALLBACKTYPE *pCallBacks);
+
+OMX_ERRORTYPE OMXSOFT_FreeHandle(OMX_HANDLETYPE hComponent);
+
+OMX_ERRORTYPE OMXSOFT_SetupTunnel(
+    OMX_HANDLETYPE hOutput, OMX_U32 nPortOutput,
+    OMX_HANDLETYPE hInput, OMX_U32 nPortInput);
@@ -148,6 +148,9 @@ COMXVideo::COMXVideo() : m_video_codec_name("")
     m_failed_eos        = false;
     m_settings_changed  = false;
     m_setStartTime      = false;
+    m_convert_annexb    = false;
+    m_zero_copy         = false;
+    m_input_pool        = NULL;
     m_transform         = OMX_DISPLAY_ROT0;
     m_pixel_aspect      = 1.0f;
     frameCounter = 0;
@@ -222,8 +225,17 @@ bool COMXVideo::SendDecoderConfig()
     CSingleLock lock (m_critSection);
     OMX_ERRORTYPE error   = OMX_ErrorNone;
     
+    uint8_t *extradata = (uint8_t *)m_config.hints.extradata;
+    int extrasize = m_config.hints.extrasize;
+    if(m_convert_annexb)
+    {
+        // the decoder is in start code mode, give it SPS/PPS the same way
+        extradata = m_converter.GetSpsPpsData();
+        extrasize = m_converter.GetSpsPpsSize();
+    }
+    
     /* send decoder config */
-    if(m_config.hints.extrasize > 0 && m_config.hints.extradata != NULL)
+    if(extrasize > 0 && extradata != NULL)
     {
         OMX_BUFFERHEADERTYPE *omx_buffer = m_omx_decoder.GetInputBuffer();
         
@@ -234,10 +246,10 @@ bool COMXVideo::SendDecoderConfig()
         }
         
         omx_buffer->nOffset = 0;
-        omx_buffer->nFilledLen = std::min((OMX_U32)m_config.hints.extrasize, omx_buffer->nAllocLen);
+        omx_buffer->nFilledLen = std::min((OMX_U32)extrasize, omx_buffer->nAllocLen);
         
         memset((unsigned char *)omx_buffer->pBuffer, 0x0, omx_buffer->nAllocLen);
-        memcpy((unsigned char *)omx_buffer->pBuffer, m_config.hints.extradata, omx_buffer->nFilledLen);
+        memcpy((unsigned char *)omx_buffer->pBuffer, extradata, omx_buffer->nFilledLen);
         omx_buffer->nFlags = OMX_BUFFERFLAG_CODECCONFIG | OMX_BUFFERFLAG_ENDOFFRAME;
         
         error = m_omx_decoder.EmptyThisBuffer(omx_buffer);
@@ -626,6 +638,12 @@ void COMXVideo::onFillBuffer(OMX_HANDLETYPE hComponent, OMX_BUFFERHEADERTYPE* pB
 }
 
 
+// zero copy input, the decoder is done with a packet's memory
+static void ReleaseInputPacket(void *opaque)
+{
+    OMXReader::FreePacket((OMXPacket *)opaque);
+}
+
 bool COMXVideo::Open(OMXClock *clock, const OMXVideoConfig &config)
 {
     CSingleLock lock (m_critSection);
@@ -823,6 +841,27 @@ bool COMXVideo::Open(OMXClock *clock, const OMXVideoConfig &config)
     portParam.nPortIndex = VIDEO_DECODE_INPUT_PORT;
     portParam.nBufferCountActual = m_config.fifo_size ? m_config.fifo_size * 1024 * 1024 / portParam.nBufferSize : 80;
     
+    // every block of the zero copy pool gets a buffer of its own on top
+    std::vector<OMX_U8*> inputBlocks;
+    if(m_config.zero_copy_input && m_config.input_pool)
+    {
+        const std::vector<uint8_t*>& blocks = m_config.input_pool->GetBlocks();
+        bool fits = m_config.input_pool->GetBlockSize() >= portParam.nBufferSize;
+        for(size_t i = 0; fits && i < blocks.size(); i++)
+        {
+            fits = portParam.nBufferAlignment <= 1 || ((uintptr_t)blocks[i] % portParam.nBufferAlignment) == 0;
+        }
+        if(fits)
+        {
+            inputBlocks.assign(blocks.begin(), blocks.end());
+        }
+        else
+        {
+            ofLog(OF_LOG_NOTICE, "COMXVideo::Open zero copy blocks don't suit the decoder input, copying\n");
+        }
+    }
+    portParam.nBufferCountActual += inputBlocks.size();
+    
     portParam.format.video.nFrameWidth  = m_config.hints.width;
     portParam.format.video.nFrameHeight = m_config.hints.height;
     
@@ -861,7 +900,18 @@ bool COMXVideo::Open(OMXClock *clock, const OMXVideoConfig &config)
         return false;
     }
     
-    if(NaluFormatStartCodes(m_config.hints.codec, (uint8_t *)m_config.hints.extradata, m_config.hints.extrasize))
+    if(m_config.convert_annexb && !NaluFormatStartCodes(m_config.hints.codec, (uint8_t *)m_config.hints.extradata, m_config.hints.extrasize))
+    {
+        m_convert_annexb = m_converter.Open(m_config.hints.codec, (uint8_t *)m_config.hints.extradata, m_config.hints.extrasize, true) &&
+                           m_converter.NeedConvert();
+        if(!m_convert_annexb)
+        {
+            m_converter.Close();
+        }
+        ofLog(OF_LOG_NOTICE, "COMXVideo::Open Annex B conversion %s\n", m_convert_annexb ? "on" : "not possible");
+    }
+    
+    if(m_convert_annexb || NaluFormatStartCodes(m_config.hints.codec, (uint8_t *)m_config.hints.extradata, m_config.hints.extrasize))
     {
         OMX_NALSTREAMFORMATTYPE nalStreamFormat;
         OMX_INIT_STRUCTURE(nalStreamFormat);
@@ -879,8 +929,17 @@ bool COMXVideo::Open(OMXClock *clock, const OMXVideoConfig &config)
         //ofLog() << "NaluFormatStartCodes FAILED";
     }
     
+    // packets are submitted as they are, which rules out converting them
+    m_zero_copy = !inputBlocks.empty() && !m_convert_annexb;
+    if(!inputBlocks.empty())
+    {
+        m_input_pool = m_config.input_pool;
+        m_input_pool->Ref();
+        m_omx_decoder.SetInputDataRelease(ReleaseInputPacket);
+    }
+    
     // Alloc buffers for the omx input port.
-    error = m_omx_decoder.AllocInputBuffers();
+    error = m_omx_decoder.AllocInputBuffers(false, &inputBlocks, m_input_pool ? m_input_pool->GetBlockSize() : 0);
     if (error != OMX_ErrorNone)
     {
         ofLog(OF_LOG_NOTICE, "COMXVideo::Open AllocOMXInputBuffers error (%s)\n", omxErrorTypes[error].c_str());
@@ -981,6 +1040,16 @@ void COMXVideo::Close()
     }
     m_omx_render.Deinitialize();
     
+    m_converter.Close();
+    m_convert_annexb = false;
+    m_zero_copy      = false;
+    // the decoder let go of its blocks, packets still queued hold the pool
+    if(m_input_pool)
+    {
+        m_input_pool->Unref();
+        m_input_pool = NULL;
+    }
+    
     m_is_open       = false;
     
     m_video_codec_name  = "";
@@ -1001,13 +1070,104 @@ unsigned int COMXVideo::GetFreeSpace()
     return m_omx_decoder.GetInputBufferSpace();
 }
 
+// no m_critSection here, CancelWait() has to get through while Decode() waits
+bool COMXVideo::WaitForFreeSpace(unsigned int size, long timeout)
+{
+    return m_omx_decoder.WaitForInputSpace(size, timeout);
+}
+
+void COMXVideo::CancelWait(bool cancel)
+{
+    m_omx_decoder.CancelInputWait(cancel);
+}
+
 unsigned int COMXVideo::GetSize()
 {
     CSingleLock lock (m_critSection);
     return m_omx_decoder.GetInputBufferSize();
 }
 
-int COMXVideo::Decode(uint8_t *pData, int iSize, double dts, double pts)
+OMX_U32 COMXVideo::InputFlags(double dts, double pts, bool decodeOnly)
+{
+    OMX_U32 nFlags = 0;
+    
+    if(decodeOnly)
+    {
+        // the start time goes on the first frame that is actually shown,
+        // otherwise the clock would wait for the frames skipped here
+        nFlags |= OMX_BUFFERFLAG_DECODEONLY;
+    }
+    else if(m_setStartTime)
+    {
+        nFlags |= OMX_BUFFERFLAG_STARTTIME;
+        ofLog(OF_LOG_NOTICE, "OMXVideo::Decode VDec : setStartTime %f\n", (pts == DVD_NOPTS_VALUE ? 0.0 : pts) / DVD_TIME_BASE);
+        m_setStartTime = false;
+    }
+    if (pts == DVD_NOPTS_VALUE && dts == DVD_NOPTS_VALUE)
+        nFlags |= OMX_BUFFERFLAG_TIME_UNKNOWN;
+    else if (pts == DVD_NOPTS_VALUE)
+        nFlags |= OMX_BUFFERFLAG_TIME_IS_DTS;
+    
+    return nFlags;
+}
+
+bool COMXVideo::HandlePortEvents()
+{
+    OMX_ERRORTYPE error = m_omx_decoder.WaitForEvent(OMX_EventPortSettingsChanged, 0);
+    if (error == OMX_ErrorNone)
+    {
+        if(!PortSettingsChanged())
+        {
+            ofLog(OF_LOG_NOTICE, "%s::%s - error PortSettingsChanged error(%s)\n", CLASSNAME, __func__, omxErrorTypes[error].c_str());
+            return false;
+        }
+    }
+    error = m_omx_decoder.WaitForEvent(OMX_EventParamOrConfigChanged, 0);
+    if (error == OMX_ErrorNone)
+    {
+        if(!PortSettingsChanged())
+        {
+            ofLog(OF_LOG_NOTICE, "%s::%s - error PortSettingsChanged (EventParamOrConfigChanged) error(%s)\n", CLASSNAME, __func__, omxErrorTypes[error].c_str());
+        }
+    }
+    return true;
+}
+
+bool COMXVideo::DecodePacket(OMXPacket *pkt, double dts, double pts)
+{
+    CSingleLock lock (m_critSection);
+    OMX_ERRORTYPE error;
+    
+    // packets outside the registered blocks, from the reader's own pool or
+    // too big for a block, are still copied
+    OMX_BUFFERHEADERTYPE *omx_buffer = NULL;
+    if(m_zero_copy && !m_drop_state && m_is_open)
+    {
+        // from here on the decoder owns the packet, EmptyBufferDone frees it
+        omx_buffer = m_omx_decoder.AttachInputData(pkt->data, pkt->size, pkt);
+    }
+    if(omx_buffer == NULL)
+    {
+        int ret = Decode(pkt->data, pkt->size, dts, pts, pkt->decode_only);
+        OMXReader::FreePacket(pkt);
+        return ret;
+    }
+    
+    omx_buffer->nFlags = InputFlags(dts, pts, pkt->decode_only) | OMX_BUFFERFLAG_ENDOFFRAME;
+    omx_buffer->nTimeStamp = ToOMXTime((uint64_t)(pts != DVD_NOPTS_VALUE ? pts : dts != DVD_NOPTS_VALUE ? dts : 0));
+    
+    error = m_omx_decoder.EmptyThisBuffer(omx_buffer);
+    if (error != OMX_ErrorNone)
+    {
+        ofLog(OF_LOG_NOTICE, "%s::%s - OMX_EmptyThisBuffer() failed with result(%s)\n", CLASSNAME, __func__, omxErrorTypes[error].c_str());
+        m_omx_decoder.DecoderEmptyBufferDone(m_omx_decoder.GetComponent(), omx_buffer);
+        return false;
+    }
+    
+    return HandlePortEvents();
+}
+
+int COMXVideo::Decode(uint8_t *pData, int iSize, double dts, double pts, bool decodeOnly)
 {
     CSingleLock lock (m_critSection);
     OMX_ERRORTYPE error;
@@ -1022,20 +1182,16 @@ int COMXVideo::Decode(uint8_t *pData, int iSize, double dts, double pts)
     
     if (demuxer_content && demuxer_bytes > 0)
     {
-        OMX_U32 nFlags = 0;
+        OMX_U32 nFlags = InputFlags(dts, pts, decodeOnly);
         
-        if(m_setStartTime)
+        if(m_convert_annexb && !m_converter.ConvertBegin(demuxer_content, demuxer_bytes))
         {
-            nFlags |= OMX_BUFFERFLAG_STARTTIME;
-            ofLog(OF_LOG_NOTICE, "OMXVideo::Decode VDec : setStartTime %f\n", (pts == DVD_NOPTS_VALUE ? 0.0 : pts) / DVD_TIME_BASE);
-            m_setStartTime = false;
+            // the decoder can't make anything of a broken packet, skip it
+            return true;
         }
-        if (pts == DVD_NOPTS_VALUE && dts == DVD_NOPTS_VALUE)
-            nFlags |= OMX_BUFFERFLAG_TIME_UNKNOWN;
-        else if (pts == DVD_NOPTS_VALUE)
-            nFlags |= OMX_BUFFERFLAG_TIME_IS_DTS;
         
-        while(demuxer_bytes)
+        bool done = false;
+        while(!done)
         {
             // 500ms timeout
             OMX_BUFFERHEADERTYPE *omx_buffer = m_omx_decoder.GetInputBuffer(500);
@@ -1050,13 +1206,24 @@ int COMXVideo::Decode(uint8_t *pData, int iSize, double dts, double pts)
   
             
             omx_buffer->nTimeStamp = ToOMXTime((uint64_t)(pts != DVD_NOPTS_VALUE ? pts : dts != DVD_NOPTS_VALUE ? dts : 0));
-            omx_buffer->nFilledLen = std::min((OMX_U32)demuxer_bytes, omx_buffer->nAllocLen);
-            memcpy(omx_buffer->pBuffer, demuxer_content, omx_buffer->nFilledLen);
-            
-            demuxer_bytes -= omx_buffer->nFilledLen;
-            demuxer_content += omx_buffer->nFilledLen;
+            if(m_convert_annexb)
+            {
+                // converted right into the input buffer, a packet that needs
+                // more than one buffer simply carries on in the next
+                omx_buffer->nFilledLen = m_converter.ConvertWrite(omx_buffer->pBuffer, omx_buffer->nAllocLen);
+                done = m_converter.ConvertDone();
+            }
+            else
+            {
+                omx_buffer->nFilledLen = std::min((OMX_U32)demuxer_bytes, omx_buffer->nAllocLen);
+                memcpy(omx_buffer->pBuffer, demuxer_content, omx_buffer->nFilledLen);
+                
+                demuxer_bytes -= omx_buffer->nFilledLen;
+                demuxer_content += omx_buffer->nFilledLen;
+                done = demuxer_bytes == 0;
+            }
             
-            if(demuxer_bytes == 0)
+            if(done)
                 omx_buffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
             
             error = m_omx_decoder.EmptyThisBuffer(omx_buffer);
@@ -1068,23 +1235,8 @@ int COMXVideo::Decode(uint8_t *pData, int iSize, double dts, double pts)
             }
             //ofLog(OF_LOG_NOTICE, "VideD: dts:%.0f pts:%.0f size:%d)\n", dts, pts, iSize);
             
-            error = m_omx_decoder.WaitForEvent(OMX_EventPortSettingsChanged, 0);
-            if (error == OMX_ErrorNone)
-            {
-                if(!PortSettingsChanged())
-                {
-                    ofLog(OF_LOG_NOTICE, "%s::%s - error PortSettingsChanged error(%s)\n", CLASSNAME, __func__, omxErrorTypes[error].c_str());
-                    return false;
-                }
-            }
-            error = m_omx_decoder.WaitForEvent(OMX_EventParamOrConfigChanged, 0);
-            if (error == OMX_ErrorNone)
-            {
-                if(!PortSettingsChanged())
-                {
-                    ofLog(OF_LOG_NOTICE, "%s::%s - error PortSettingsChanged (EventParamOrConfigChanged) error(%s)\n", CLASSNAME, __func__, omxErrorTypes[error].c_str());
-                }
-            }
+            if(!HandlePortEvents())
+                return false;
         }
         return true;
     }
@@ -30,6 +30,7 @@
 
 #include "OMXClock.h"
 #include "OMXReader.h"
+#include "BitstreamConverter.h"
 
 #include "guilib/Geometry.h"
 #include "utils/SingleLock.h"
@@ -39,6 +40,10 @@
 #include <EGL/eglext.h>
 
 #define VIDEO_BUFFERS 60
+// zero_copy_input: video packets are demuxed into this many blocks the
+// decoder registered, bigger ones and any beyond are copied as usual
+#define VIDEO_INPUT_BLOCK_SIZE (256 * 1024)
+#define VIDEO_INPUT_BLOCKS     32
 
 enum EDEINTERLACEMODE
 {
@@ -73,8 +78,14 @@ public:
     EGLImageKHR eglImage;
     OMX_IMAGEFILTERTYPE filterType;
     bool enableFilters;
+    bool convert_annexb;
+    bool zero_copy_input;
+    OMXPacketPool *input_pool; // zero_copy_input: fixed pool the decoder registers the blocks of
     OMXVideoConfig()
     {
+        convert_annexb = false;
+        zero_copy_input = false;
+        input_pool = NULL;
         enableFilters = false;
         filterType = OMX_ImageFilterNone;
         eglImage = NULL;
@@ -116,8 +127,13 @@ public:
     void PortSettingsChangedLogger(OMX_PARAM_PORTDEFINITIONTYPE port_image, int interlaceEMode);
     void Close(void);
     unsigned int GetFreeSpace();
+    bool WaitForFreeSpace(unsigned int size, long timeout);
+    void CancelWait(bool cancel);
     unsigned int GetSize();
-    int  Decode(uint8_t *pData, int iSize, double dts, double pts);
+    int  Decode(uint8_t *pData, int iSize, double dts, double pts, bool decodeOnly = false);
+    // takes pkt over. with zero_copy_input a packet in a block of input_pool
+    // goes to the decoder as it is and back to the pool once it is read
+    bool DecodePacket(OMXPacket *pkt, double dts, double pts);
     void Reset(void);
     void SetDropState(bool bDrop);
     std::string GetDecoderName() { return m_video_codec_name; };
@@ -175,6 +191,15 @@ protected:
     CCriticalSection  m_critSection;
     
     bool filtersEnabled;
+    
+    OMX_U32 InputFlags(double dts, double pts, bool decodeOnly);
+    bool HandlePortEvents();
+    bool              m_zero_copy;
+    OMXPacketPool    *m_input_pool;      // registered with the decoder while open
+    
+    // avcC to Annex B while filling the input buffers, see OMXVideoConfig::convert_annexb
+    CBitstreamConverter m_converter;
+    bool              m_convert_annexb;
 };
 
 #endif
@@ -0,0 +1,93 @@
+#pragma once
+
+// Internal to PCMUtils.cpp and the kernels that are built in files of their
+// own, see utils/CPUFeatures.h. Not part of the PCMUtils interface.
+
+#include <stdint.h>
+#include <math.h>
+#include <algorithm>
+
+// more input channels than CPCMRemap ever has (PCM_MAX_CH)
+#define PCM_MAX_TAPS 32
+
+// the input channels feeding one output channel
+struct PCMTap
+{
+  float        level;
+  const float *src;
+};
+
+static inline unsigned int collect_taps(PCMTap *taps, const float *row, const float *const *in, unsigned int in_channels)
+{
+  unsigned int count = 0;
+  for(unsigned int c = 0; c < in_channels && c < PCM_MAX_TAPS; c++)
+  {
+    if(row[c] == 0.0f)
+      continue;
+    taps[count].level = row[c];
+    taps[count].src   = in[c];
+    count++;
+  }
+  return count;
+}
+
+static inline float mix_sample(const PCMTap *taps, unsigned int count, unsigned int s)
+{
+  float acc = 0.0f;
+  for(unsigned int t = 0; t < count; t++)
+    acc += taps[t].level * taps[t].src[s];
+  return acc;
+}
+
+static inline int16_t to_s16(float x)
+{
+  x *= 32768.0f;
+  x = std::min(std::max(x, -32768.0f), 32767.0f);
+  return (int16_t)lrintf(x);
+}
+
+static inline int32_t to_s32(float x)
+{
+  x *= 2147483648.0f;
+  // 2^31 itself doesn't fit, the float just below it does
+  x = std::min(std::max(x, -2147483648.0f), 2147483520.0f);
+  return (int32_t)lrintf(x);
+}
+
+struct PCMKernelTable
+{
+  const char *name;
+  void  (*mix)(float *const *out, unsigned int out_channels, const float *const *in, unsigned int in_channels,
+               const float *matrix, unsigned int samples);
+  float (*peak)(float *peaks, const float *const *buf, unsigned int channels, unsigned int samples);
+  void  (*scale)(float *const *buf, unsigned int channels, const float *gains, unsigned int samples);
+  void  (*s16_to_planar)(float *const *out, const int16_t *in, unsigned int channels, unsigned int samples);
+  void  (*planar_to_s16)(int16_t *out, const float *const *in, unsigned int channels, unsigned int samples);
+  void  (*planar_to_s32)(int32_t *out, const float *const *in, unsigned int channels, unsigned int samples);
+};
+
+// the plain C kernels in PCMUtils.cpp, also used for what the vector loops leave over
+void pcm_mix_c(float *const *out, unsigned int out_channels, const float *const *in, unsigned int in_channels,
+               const float *matrix, unsigned int samples);
+float pcm_peak_c(float *peaks, const float *const *buf, unsigned int channels, unsigned int samples);
+void pcm_scale_c(float *const *buf, unsigned int channels, const float *gains, unsigned int samples);
+void pcm_s16_to_planar_c(float *const *out, const int16_t *in, unsigned int channels, unsigned int samples);
+void pcm_planar_to_s16_c(int16_t *out, const float *const *in, unsigned int channels, unsigned int samples);
+void pcm_planar_to_s32_c(int32_t *out, const float *const *in, unsigned int channels, unsigned int samples);
+
+// hands the samples left over after the vector loop to the C kernel
+template<typename T, void (*kernel)(T *, const float *const *, unsigned int, unsigned int)>
+static inline void planar_tail(T *out, const float *const *in, unsigned int channels, unsigned int s, unsigned int samples)
+{
+  if(s >= samples)
+    return;
+  const float *tail[PCM_MAX_TAPS];
+  for(unsigned int c = 0; c < channels && c < PCM_MAX_TAPS; c++)
+    tail[c] = in[c] + s;
+  kernel(out, tail, std::min(channels, (unsigned int)PCM_MAX_TAPS), samples - s);
+}
+
+#if defined(__arm__) || defined(__aarch64__)
+// PCMUtilsNeon.cpp, only install it once cpu_has_neon() said yes
+extern const PCMKernelTable pcm_kernels_neon;
+#endif
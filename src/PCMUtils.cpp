@@ -0,0 +1,561 @@
+#include "PCMUtils.h"
+#include "PCMKernels.h"
+#include "utils/CPUFeatures.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define PCM_HAVE_SSE2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PCM_HAVE_AVX2
+#endif
+#elif defined(CPU_HAVE_NEON_KERNELS)
+#define PCM_HAVE_NEON
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// plain C
+
+void pcm_mix_c(float *const *out, unsigned int out_channels, const float *const *in, unsigned int in_channels,
+                 const float *matrix, unsigned int samples)
+{
+  PCMTap taps[PCM_MAX_TAPS];
+  for(unsigned int o = 0; o < out_channels; o++)
+  {
+    unsigned int count = collect_taps(taps, matrix + o * in_channels, in, in_channels);
+    float *dst = out[o];
+    for(unsigned int s = 0; s < samples; s++)
+      dst[s] = mix_sample(taps, count, s);
+  }
+}
+
+float pcm_peak_c(float *peaks, const float *const *buf, unsigned int channels, unsigned int samples)
+{
+  float peak = 0.0f;
+  for(unsigned int s = 0; s < samples; s++)
+  {
+    float max = 0.0f;
+    for(unsigned int c = 0; c < channels; c++)
+      max = std::max(max, fabsf(buf[c][s]));
+    peaks[s] = max;
+    peak = std::max(peak, max);
+  }
+  return peak;
+}
+
+void pcm_scale_c(float *const *buf, unsigned int channels, const float *gains, unsigned int samples)
+{
+  for(unsigned int c = 0; c < channels; c++)
+  {
+    float *p = buf[c];
+    for(unsigned int s = 0; s < samples; s++)
+      p[s] *= gains[s];
+  }
+}
+
+void pcm_s16_to_planar_c(float *const *out, const int16_t *in, unsigned int channels, unsigned int samples)
+{
+  for(unsigned int s = 0; s < samples; s++, in += channels)
+    for(unsigned int c = 0; c < channels; c++)
+      out[c][s] = in[c] * (1.0f / 32768.0f);
+}
+
+void pcm_planar_to_s16_c(int16_t *out, const float *const *in, unsigned int channels, unsigned int samples)
+{
+  for(unsigned int s = 0; s < samples; s++, out += channels)
+    for(unsigned int c = 0; c < channels; c++)
+      out[c] = to_s16(in[c][s]);
+}
+
+void pcm_planar_to_s32_c(int32_t *out, const float *const *in, unsigned int channels, unsigned int samples)
+{
+  for(unsigned int s = 0; s < samples; s++, out += channels)
+    for(unsigned int c = 0; c < channels; c++)
+      out[c] = to_s32(in[c][s]);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// SSE2 and AVX2
+
+#if defined(PCM_HAVE_SSE2)
+static void mix_sse2(float *const *out, unsigned int out_channels, const float *const *in, unsigned int in_channels,
+                     const float *matrix, unsigned int samples)
+{
+  PCMTap taps[PCM_MAX_TAPS];
+  for(unsigned int o = 0; o < out_channels; o++)
+  {
+    unsigned int count = collect_taps(taps, matrix + o * in_channels, in, in_channels);
+    float *dst = out[o];
+    unsigned int s = 0;
+    for(; s + 8 <= samples; s += 8)
+    {
+      __m128 acc0 = _mm_setzero_ps();
+      __m128 acc1 = _mm_setzero_ps();
+      for(unsigned int t = 0; t < count; t++)
+      {
+        __m128 level = _mm_set1_ps(taps[t].level);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(level, _mm_loadu_ps(taps[t].src + s)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(level, _mm_loadu_ps(taps[t].src + s + 4)));
+      }
+      _mm_storeu_ps(dst + s, acc0);
+      _mm_storeu_ps(dst + s + 4, acc1);
+    }
+    for(; s < samples; s++)
+      dst[s] = mix_sample(taps, count, s);
+  }
+}
+
+static float peak_sse2(float *peaks, const float *const *buf, unsigned int channels, unsigned int samples)
+{
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  __m128 peak = _mm_setzero_ps();
+  unsigned int s = 0;
+  for(; s + 4 <= samples; s += 4)
+  {
+    __m128 max = _mm_setzero_ps();
+    for(unsigned int c = 0; c < channels; c++)
+      max = _mm_max_ps(max, _mm_and_ps(_mm_loadu_ps(buf[c] + s), abs_mask));
+    _mm_storeu_ps(peaks + s, max);
+    peak = _mm_max_ps(peak, max);
+  }
+  peak = _mm_max_ps(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(1, 0, 3, 2)));
+  peak = _mm_max_ps(peak, _mm_shuffle_ps(peak, peak, _MM_SHUFFLE(2, 3, 0, 1)));
+  float result = _mm_cvtss_f32(peak);
+  const float *tail[PCM_MAX_TAPS];
+  for(unsigned int c = 0; c < channels && c < PCM_MAX_TAPS; c++)
+    tail[c] = buf[c] + s;
+  if(s < samples)
+    result = std::max(result, pcm_peak_c(peaks + s, tail, std::min(channels, (unsigned int)PCM_MAX_TAPS), samples - s));
+  return result;
+}
+
+static void scale_sse2(float *const *buf, unsigned int channels, const float *gains, unsigned int samples)
+{
+  for(unsigned int c = 0; c < channels; c++)
+  {
+    float *p = buf[c];
+    unsigned int s = 0;
+    for(; s + 4 <= samples; s += 4)
+      _mm_storeu_ps(p + s, _mm_mul_ps(_mm_loadu_ps(p + s), _mm_loadu_ps(gains + s)));
+    for(; s < samples; s++)
+      p[s] *= gains[s];
+  }
+}
+
+static void s16_to_planar_sse2(float *const *out, const int16_t *in, unsigned int channels, unsigned int samples)
+{
+  if(channels != 2)
+  {
+    pcm_s16_to_planar_c(out, in, channels, samples);
+    return;
+  }
+
+  const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  float *left = out[0], *right = out[1];
+  unsigned int s = 0;
+  for(; s + 4 <= samples; s += 4, in += 8)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *)in);
+    // sign extend by putting the samples into the top half and shifting back
+    __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+    _mm_storeu_ps(left + s,  _mm_mul_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)), scale));
+    _mm_storeu_ps(right + s, _mm_mul_ps(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)), scale));
+  }
+  for(; s < samples; s++, in += 2)
+  {
+    left[s]  = in[0] * (1.0f / 32768.0f);
+    right[s] = in[1] * (1.0f / 32768.0f);
+  }
+}
+
+static inline __m128i to_s32_sse2(__m128 x)
+{
+  x = _mm_mul_ps(x, _mm_set1_ps(32768.0f));
+  x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f));
+  return _mm_cvtps_epi32(x);
+}
+
+static void planar_to_s16_sse2(int16_t *out, const float *const *in, unsigned int channels, unsigned int samples)
+{
+  unsigned int s = 0;
+  switch(channels)
+  {
+    case 1:
+      for(; s + 8 <= samples; s += 8, out += 8)
+        _mm_storeu_si128((__m128i *)out, _mm_packs_epi32(to_s32_sse2(_mm_loadu_ps(in[0] + s)), to_s32_sse2(_mm_loadu_ps(in[0] + s + 4))));
+      break;
+    case 2:
+      for(; s + 4 <= samples; s += 4, out += 8)
+      {
+        __m128i l = to_s32_sse2(_mm_loadu_ps(in[0] + s));
+        __m128i r = to_s32_sse2(_mm_loadu_ps(in[1] + s));
+        _mm_storeu_si128((__m128i *)out, _mm_packs_epi32(_mm_unpacklo_epi32(l, r), _mm_unpackhi_epi32(l, r)));
+      }
+      break;
+    case 4:
+      for(; s + 4 <= samples; s += 4, out += 16)
+      {
+        __m128 r0 = _mm_loadu_ps(in[0] + s), r1 = _mm_loadu_ps(in[1] + s);
+        __m128 r2 = _mm_loadu_ps(in[2] + s), r3 = _mm_loadu_ps(in[3] + s);
+        // rows become frames
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_si128((__m128i *)out,       _mm_packs_epi32(to_s32_sse2(r0), to_s32_sse2(r1)));
+        _mm_storeu_si128((__m128i *)(out + 8), _mm_packs_epi32(to_s32_sse2(r2), to_s32_sse2(r3)));
+      }
+      break;
+    case 8:
+      for(; s + 4 <= samples; s += 4, out += 32)
+      {
+        __m128 a0 = _mm_loadu_ps(in[0] + s), a1 = _mm_loadu_ps(in[1] + s);
+        __m128 a2 = _mm_loadu_ps(in[2] + s), a3 = _mm_loadu_ps(in[3] + s);
+        __m128 b0 = _mm_loadu_ps(in[4] + s), b1 = _mm_loadu_ps(in[5] + s);
+        __m128 b2 = _mm_loadu_ps(in[6] + s), b3 = _mm_loadu_ps(in[7] + s);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        _mm_storeu_si128((__m128i *)out,        _mm_packs_epi32(to_s32_sse2(a0), to_s32_sse2(b0)));
+        _mm_storeu_si128((__m128i *)(out + 8),  _mm_packs_epi32(to_s32_sse2(a1), to_s32_sse2(b1)));
+        _mm_storeu_si128((__m128i *)(out + 16), _mm_packs_epi32(to_s32_sse2(a2), to_s32_sse2(b2)));
+        _mm_storeu_si128((__m128i *)(out + 24), _mm_packs_epi32(to_s32_sse2(a3), to_s32_sse2(b3)));
+      }
+      break;
+  }
+  planar_tail<int16_t, pcm_planar_to_s16_c>(out, in, channels, s, samples);
+}
+
+static inline __m128i to_s32_full_sse2(__m128 x)
+{
+  x = _mm_mul_ps(x, _mm_set1_ps(2147483648.0f));
+  x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-2147483648.0f)), _mm_set1_ps(2147483520.0f));
+  return _mm_cvtps_epi32(x);
+}
+
+// the first n of the 4 lanes
+static inline void store_s32_sse2(int32_t *dst, __m128i v, unsigned int n)
+{
+  if(n == 4)
+  {
+    _mm_storeu_si128((__m128i *)dst, v);
+    return;
+  }
+  if(n >= 2)
+  {
+    _mm_storel_epi64((__m128i *)dst, v);
+    v = _mm_srli_si128(v, 8);
+    dst += 2;
+    n   -= 2;
+  }
+  if(n)
+    *dst = _mm_cvtsi128_si32(v);
+}
+
+static void planar_to_s32_sse2(int32_t *out, const float *const *in, unsigned int channels, unsigned int samples)
+{
+  unsigned int s = 0;
+  if(channels == 1)
+  {
+    for(; s + 4 <= samples; s += 4, out += 4)
+      _mm_storeu_si128((__m128i *)out, to_s32_full_sse2(_mm_loadu_ps(in[0] + s)));
+  }
+  else if(channels == 2)
+  {
+    for(; s + 4 <= samples; s += 4, out += 8)
+    {
+      __m128i l = to_s32_full_sse2(_mm_loadu_ps(in[0] + s));
+      __m128i r = to_s32_full_sse2(_mm_loadu_ps(in[1] + s));
+      _mm_storeu_si128((__m128i *)out,       _mm_unpacklo_epi32(l, r));
+      _mm_storeu_si128((__m128i *)(out + 4), _mm_unpackhi_epi32(l, r));
+    }
+  }
+  else
+  {
+    // 4 samples of up to 4 channels at a time, transposed into 4 partial frames
+    const __m128 zero = _mm_setzero_ps();
+    for(; s + 4 <= samples; s += 4, out += 4 * channels)
+    {
+      for(unsigned int c = 0; c < channels; c += 4)
+      {
+        unsigned int n = std::min(channels - c, 4u);
+        __m128 r0 = _mm_loadu_ps(in[c] + s);
+        __m128 r1 = n > 1 ? _mm_loadu_ps(in[c + 1] + s) : zero;
+        __m128 r2 = n > 2 ? _mm_loadu_ps(in[c + 2] + s) : zero;
+        __m128 r3 = n > 3 ? _mm_loadu_ps(in[c + 3] + s) : zero;
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        store_s32_sse2(out + c,                to_s32_full_sse2(r0), n);
+        store_s32_sse2(out + channels + c,     to_s32_full_sse2(r1), n);
+        store_s32_sse2(out + 2 * channels + c, to_s32_full_sse2(r2), n);
+        store_s32_sse2(out + 3 * channels + c, to_s32_full_sse2(r3), n);
+      }
+    }
+  }
+  planar_tail<int32_t, pcm_planar_to_s32_c>(out, in, channels, s, samples);
+}
+
+static bool simd_supported(void)
+{
+  return __builtin_cpu_supports("sse2");
+}
+
+static const char *simd_name = "sse2";
+
+#if defined(PCM_HAVE_AVX2)
+__attribute__((target("avx2")))
+static void mix_avx2(float *const *out, unsigned int out_channels, const float *const *in, unsigned int in_channels,
+                     const float *matrix, unsigned int samples)
+{
+  PCMTap taps[PCM_MAX_TAPS];
+  for(unsigned int o = 0; o < out_channels; o++)
+  {
+    unsigned int count = collect_taps(taps, matrix + o * in_channels, in, in_channels);
+    float *dst = out[o];
+    unsigned int s = 0;
+    for(; s + 16 <= samples; s += 16)
+    {
+      __m256 acc0 = _mm256_setzero_ps();
+      __m256 acc1 = _mm256_setzero_ps();
+      for(unsigned int t = 0; t < count; t++)
+      {
+        __m256 level = _mm256_set1_ps(taps[t].level);
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(level, _mm256_loadu_ps(taps[t].src + s)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(level, _mm256_loadu_ps(taps[t].src + s + 8)));
+      }
+      _mm256_storeu_ps(dst + s, acc0);
+      _mm256_storeu_ps(dst + s + 8, acc1);
+    }
+    for(; s < samples; s++)
+      dst[s] = mix_sample(taps, count, s);
+  }
+}
+
+__attribute__((target("avx2")))
+static float peak_avx2(float *peaks, const float *const *buf, unsigned int channels, unsigned int samples)
+{
+  const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+  __m256 peak = _mm256_setzero_ps();
+  unsigned int s = 0;
+  for(; s + 8 <= samples; s += 8)
+  {
+    __m256 max = _mm256_setzero_ps();
+    for(unsigned int c = 0; c < channels; c++)
+      max = _mm256_max_ps(max, _mm256_and_ps(_mm256_loadu_ps(buf[c] + s), abs_mask));
+    _mm256_storeu_ps(peaks + s, max);
+    peak = _mm256_max_ps(peak, max);
+  }
+  float lanes[8];
+  _mm256_storeu_ps(lanes, peak);
+  float result = *std::max_element(lanes, lanes + 8);
+  const float *tail[PCM_MAX_TAPS];
+  for(unsigned int c = 0; c < channels && c < PCM_MAX_TAPS; c++)
+    tail[c] = buf[c] + s;
+  if(s < samples)
+    result = std::max(result, pcm_peak_c(peaks + s, tail, std::min(channels, (unsigned int)PCM_MAX_TAPS), samples - s));
+  return result;
+}
+
+__attribute__((target("avx2")))
+static void scale_avx2(float *const *buf, unsigned int channels, const float *gains, unsigned int samples)
+{
+  for(unsigned int c = 0; c < channels; c++)
+  {
+    float *p = buf[c];
+    unsigned int s = 0;
+    for(; s + 8 <= samples; s += 8)
+      _mm256_storeu_ps(p + s, _mm256_mul_ps(_mm256_loadu_ps(p + s), _mm256_loadu_ps(gains + s)));
+    for(; s < samples; s++)
+      p[s] *= gains[s];
+  }
+}
+
+static bool avx2_supported(void)
+{
+  return __builtin_cpu_supports("avx2");
+}
+#endif
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////
+
+static const PCMKernelTable kernels_c = { "c", pcm_mix_c, pcm_peak_c, pcm_scale_c, pcm_s16_to_planar_c, pcm_planar_to_s16_c, pcm_planar_to_s32_c };
+#if defined(PCM_HAVE_SSE2)
+static const PCMKernelTable kernels_simd = { simd_name, mix_sse2, peak_sse2, scale_sse2, s16_to_planar_sse2, planar_to_s16_sse2, planar_to_s32_sse2 };
+#if defined(PCM_HAVE_AVX2)
+static const PCMKernelTable kernels_avx2 = { "avx2", mix_avx2, peak_avx2, scale_avx2, s16_to_planar_sse2, planar_to_s16_sse2, planar_to_s32_sse2 };
+#endif
+#elif defined(PCM_HAVE_NEON)
+static const PCMKernelTable &kernels_simd = pcm_kernels_neon;
+
+static bool simd_supported(void)
+{
+  return cpu_has_neon();
+}
+#endif
+
+static const PCMKernelTable *kernels = NULL;
+
+// picks the kernels on first use
+static inline const PCMKernelTable *pcm_kernels(void)
+{
+  if(!kernels)
+    pcm_set_kernels(PCM_KERNELS_AUTO);
+  return kernels;
+}
+
+bool pcm_set_kernels(PCMKernels which)
+{
+  switch(which)
+  {
+    case PCM_KERNELS_AUTO:
+      if(pcm_set_kernels(PCM_KERNELS_AVX2))
+        return true;
+      if(pcm_set_kernels(PCM_KERNELS_SIMD))
+        return true;
+      return pcm_set_kernels(PCM_KERNELS_C);
+    case PCM_KERNELS_C:
+      kernels = &kernels_c;
+      return true;
+    case PCM_KERNELS_SIMD:
+#if defined(PCM_HAVE_SSE2) || defined(PCM_HAVE_NEON)
+      if(!simd_supported())
+        return false;
+      kernels = &kernels_simd;
+      return true;
+#else
+      return false;
+#endif
+    case PCM_KERNELS_AVX2:
+#if defined(PCM_HAVE_AVX2)
+      if(!avx2_supported())
+        return false;
+      kernels = &kernels_avx2;
+      return true;
+#else
+      return false;
+#endif
+  }
+  return false;
+}
+
+const char *pcm_get_kernels_name(void)
+{
+  return pcm_kernels()->name;
+}
+
+void pcm_mix(float *const *out, unsigned int out_channels, const float *const *in, unsigned int in_channels,
+             const float *matrix, unsigned int samples)
+{
+  pcm_kernels()->mix(out, out_channels, in, in_channels, matrix, samples);
+}
+
+float pcm_peak(float *peaks, const float *const *buf, unsigned int channels, unsigned int samples)
+{
+  return pcm_kernels()->peak(peaks, buf, channels, samples);
+}
+
+void pcm_scale(float *const *buf, unsigned int channels, const float *gains, unsigned int samples)
+{
+  pcm_kernels()->scale(buf, channels, gains, samples);
+}
+
+void pcm_s16_to_planar(float *const *out, const int16_t *in, unsigned int channels, unsigned int samples)
+{
+  pcm_kernels()->s16_to_planar(out, in, channels, samples);
+}
+
+void pcm_planar_to_s16(int16_t *out, const float *const *in, unsigned int channels, unsigned int samples)
+{
+  pcm_kernels()->planar_to_s16(out, in, channels, samples);
+}
+
+void pcm_planar_to_s32(int32_t *out, const float *const *in, unsigned int channels, unsigned int samples)
+{
+  pcm_kernels()->planar_to_s32(out, in, channels, samples);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////
+// channel maps
+
+struct PCMMaskChannel
+{
+  uint64_t         mask;
+  enum PCMChannels channel;
+};
+
+static const PCMMaskChannel mask_order[] =
+{
+  { 0x00001, PCM_FRONT_LEFT            },
+  { 0x00002, PCM_FRONT_RIGHT           },
+  { 0x00004, PCM_FRONT_CENTER          },
+  { 0x00008, PCM_LOW_FREQUENCY         },
+  { 0x00010, PCM_BACK_LEFT             },
+  { 0x00020, PCM_BACK_RIGHT            },
+  { 0x00040, PCM_FRONT_LEFT_OF_CENTER  },
+  { 0x00080, PCM_FRONT_RIGHT_OF_CENTER },
+  { 0x00100, PCM_BACK_CENTER           },
+  { 0x00200, PCM_SIDE_LEFT             },
+  { 0x00400, PCM_SIDE_RIGHT            },
+  { 0x00800, PCM_TOP_CENTER            },
+  { 0x01000, PCM_TOP_FRONT_LEFT        },
+  { 0x02000, PCM_TOP_FRONT_CENTER      },
+  { 0x04000, PCM_TOP_FRONT_RIGHT       },
+  { 0x08000, PCM_TOP_BACK_LEFT         },
+  { 0x10000, PCM_TOP_BACK_CENTER       },
+  { 0x20000, PCM_TOP_BACK_RIGHT        }
+};
+
+// See CEA spec: Table 20, Audio InfoFrame data byte 4 for the ordering here
+static const PCMMaskChannel cea_order[] =
+{
+  { 0x00001, PCM_FRONT_LEFT    },
+  { 0x00002, PCM_FRONT_RIGHT   },
+  { 0x00008, PCM_LOW_FREQUENCY },
+  { 0x00004, PCM_FRONT_CENTER  },
+  { 0x00010, PCM_BACK_LEFT     },
+  { 0x00020, PCM_BACK_RIGHT    },
+  { 0x00200, PCM_SIDE_LEFT     },
+  { 0x00400, PCM_SIDE_RIGHT    }
+};
+
+static int build_channel_map(enum PCMChannels *channelMap, uint64_t mask, const PCMMaskChannel *order, unsigned int count)
+{
+  int index = 0;
+  for(unsigned int i = 0; i < count; i++)
+    if(mask & order[i].mask)
+      channelMap[index++] = order[i].channel;
+  int channels = index;
+  while(index < PCM_MAX_CH)
+    channelMap[index++] = PCM_INVALID;
+  return channels;
+}
+
+void pcm_build_channel_map(enum PCMChannels *channelMap, uint64_t mask)
+{
+  build_channel_map(channelMap, mask, mask_order, sizeof(mask_order) / sizeof(mask_order[0]));
+}
+
+int pcm_build_channel_map_cea(enum PCMChannels *channelMap, uint64_t mask)
+{
+  int num_channels = build_channel_map(channelMap, mask, cea_order, sizeof(cea_order) / sizeof(cea_order[0]));
+  // round up to power of 2
+  return num_channels > 4 ? 8 : num_channels > 2 ? 4 : num_channels;
+}
+
+uint64_t pcm_get_channel_layout(enum PCMLayout layout)
+{
+  static const uint64_t layouts[PCM_MAX_LAYOUT] = {
+    /* 2.0 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT,
+    /* 2.1 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_LOW_FREQUENCY,
+    /* 3.0 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER,
+    /* 3.1 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER | 1<<PCM_LOW_FREQUENCY,
+    /* 4.0 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT,
+    /* 4.1 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT | 1<<PCM_LOW_FREQUENCY,
+    /* 5.0 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT,
+    /* 5.1 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT | 1<<PCM_LOW_FREQUENCY,
+    /* 7.0 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER | 1<<PCM_SIDE_LEFT | 1<<PCM_SIDE_RIGHT | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT,
+    /* 7.1 */ 1<<PCM_FRONT_LEFT | 1<<PCM_FRONT_RIGHT | 1<<PCM_FRONT_CENTER | 1<<PCM_SIDE_LEFT | 1<<PCM_SIDE_RIGHT | 1<<PCM_BACK_LEFT | 1<<PCM_BACK_RIGHT | 1<<PCM_LOW_FREQUENCY
+  };
+  return (unsigned int)layout < PCM_MAX_LAYOUT ? layouts[(int)layout] : 0;
+}
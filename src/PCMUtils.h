@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "utils/PCMRemap.h"
+
+// Sample kernels for the software audio path (CPCMRemap). Samples are float
+// with 1.0 as full scale and kept planar, one array per channel, so every
+// kernel runs along the samples of a channel and vectorises the same way for
+// any channel count. Nothing in here depends on ffmpeg or OMX.
+
+enum PCMKernels
+{
+  PCM_KERNELS_AUTO = 0, // best ones the cpu supports
+  PCM_KERNELS_C,        // plain loops
+  PCM_KERNELS_SIMD,     // SSE2 or NEON
+  PCM_KERNELS_AVX2      // x86 only, SSE2 where AVX2 doesn't help
+};
+
+// false if the kernels aren't built in or the cpu can't run them
+bool pcm_set_kernels(PCMKernels kernels);
+const char *pcm_get_kernels_name(void);
+
+// out[o][s] = sum over c of matrix[o * in_channels + c] * in[c][s]
+void pcm_mix(float *const *out, unsigned int out_channels,
+             const float *const *in, unsigned int in_channels,
+             const float *matrix, unsigned int samples);
+// peaks[s] = largest |buf[c][s]| over the channels, returns the largest of those
+float pcm_peak(float *peaks, const float *const *buf, unsigned int channels, unsigned int samples);
+// buf[c][s] *= gains[s]
+void pcm_scale(float *const *buf, unsigned int channels, const float *gains, unsigned int samples);
+
+// interleaved S16 to planar float
+void pcm_s16_to_planar(float *const *out, const int16_t *in, unsigned int channels, unsigned int samples);
+// planar float to interleaved S16, clipped and rounded to nearest
+void pcm_planar_to_s16(int16_t *out, const float *const *in, unsigned int channels, unsigned int samples);
+// planar float to interleaved S32, clipped, rounding may differ by 1 between kernels
+void pcm_planar_to_s32(int32_t *out, const float *const *in, unsigned int channels, unsigned int samples);
+
+// Channel maps for CPCMRemap. Masks use the WAVEFORMATEXTENSIBLE dwChannelMask
+// bits, which are the same as ffmpeg's AV_CH_* ones. The maps are filled up to
+// PCM_MAX_CH with PCM_INVALID.
+
+// the channels of mask in mask order, as decoders output them
+void pcm_build_channel_map(enum PCMChannels *channelMap, uint64_t mask);
+// the channels of mask in CEA-861 order, returns the channel count rounded up
+// to 2, 4 or 8 as HDMI sinks want it
+int pcm_build_channel_map_cea(enum PCMChannels *channelMap, uint64_t mask);
+// the mask of a speaker layout, 0 for an unknown one
+uint64_t pcm_get_channel_layout(enum PCMLayout layout);
@@ -0,0 +1,257 @@
+#include "PCMKernels.h"
+
+// NEON kernels. PCMUtils.cpp only installs them once cpu_has_neon() said yes,
+// so this file alone is built with NEON enabled.
+
+#if defined(__arm__) || defined(__aarch64__)
+
+#if defined(__arm__) && !defined(__ARM_NEON)
+#pragma GCC target("fpu=neon")
+#endif
+#include <arm_neon.h>
+
+static void mix_neon(float *const *out, unsigned int out_channels, const float *const *in, unsigned int in_channels,
+                     const float *matrix, unsigned int samples)
+{
+  PCMTap taps[PCM_MAX_TAPS];
+  for(unsigned int o = 0; o < out_channels; o++)
+  {
+    unsigned int count = collect_taps(taps, matrix + o * in_channels, in, in_channels);
+    float *dst = out[o];
+    unsigned int s = 0;
+    for(; s + 8 <= samples; s += 8)
+    {
+      float32x4_t acc0 = vdupq_n_f32(0.0f);
+      float32x4_t acc1 = vdupq_n_f32(0.0f);
+      for(unsigned int t = 0; t < count; t++)
+      {
+        acc0 = vmlaq_n_f32(acc0, vld1q_f32(taps[t].src + s), taps[t].level);
+        acc1 = vmlaq_n_f32(acc1, vld1q_f32(taps[t].src + s + 4), taps[t].level);
+      }
+      vst1q_f32(dst + s, acc0);
+      vst1q_f32(dst + s + 4, acc1);
+    }
+    for(; s < samples; s++)
+      dst[s] = mix_sample(taps, count, s);
+  }
+}
+
+static float peak_neon(float *peaks, const float *const *buf, unsigned int channels, unsigned int samples)
+{
+  float32x4_t peak = vdupq_n_f32(0.0f);
+  unsigned int s = 0;
+  for(; s + 4 <= samples; s += 4)
+  {
+    float32x4_t max = vdupq_n_f32(0.0f);
+    for(unsigned int c = 0; c < channels; c++)
+      max = vmaxq_f32(max, vabsq_f32(vld1q_f32(buf[c] + s)));
+    vst1q_f32(peaks + s, max);
+    peak = vmaxq_f32(peak, max);
+  }
+#if defined(__aarch64__)
+  float result = vmaxvq_f32(peak);
+#else
+  float32x2_t m = vpmax_f32(vget_low_f32(peak), vget_high_f32(peak));
+  m = vpmax_f32(m, m);
+  float result = vget_lane_f32(m, 0);
+#endif
+  const float *tail[PCM_MAX_TAPS];
+  for(unsigned int c = 0; c < channels && c < PCM_MAX_TAPS; c++)
+    tail[c] = buf[c] + s;
+  if(s < samples)
+    result = std::max(result, pcm_peak_c(peaks + s, tail, std::min(channels, (unsigned int)PCM_MAX_TAPS), samples - s));
+  return result;
+}
+
+static void scale_neon(float *const *buf, unsigned int channels, const float *gains, unsigned int samples)
+{
+  for(unsigned int c = 0; c < channels; c++)
+  {
+    float *p = buf[c];
+    unsigned int s = 0;
+    for(; s + 4 <= samples; s += 4)
+      vst1q_f32(p + s, vmulq_f32(vld1q_f32(p + s), vld1q_f32(gains + s)));
+    for(; s < samples; s++)
+      p[s] *= gains[s];
+  }
+}
+
+static void s16_to_planar_neon(float *const *out, const int16_t *in, unsigned int channels, unsigned int samples)
+{
+  if(channels != 2)
+  {
+    pcm_s16_to_planar_c(out, in, channels, samples);
+    return;
+  }
+
+  float *left = out[0], *right = out[1];
+  unsigned int s = 0;
+  for(; s + 4 <= samples; s += 4, in += 8)
+  {
+    int16x4x2_t v = vld2_s16(in);
+    vst1q_f32(left + s,  vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(v.val[0])), 1.0f / 32768.0f));
+    vst1q_f32(right + s, vmulq_n_f32(vcvtq_f32_s32(vmovl_s16(v.val[1])), 1.0f / 32768.0f));
+  }
+  for(; s < samples; s++, in += 2)
+  {
+    left[s]  = in[0] * (1.0f / 32768.0f);
+    right[s] = in[1] * (1.0f / 32768.0f);
+  }
+}
+
+static inline int16x4_t to_s16_neon(float32x4_t x)
+{
+  x = vmulq_n_f32(x, 32768.0f);
+  x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(-32768.0f)), vdupq_n_f32(32767.0f));
+#if defined(__aarch64__)
+  int32x4_t i = vcvtnq_s32_f32(x);
+#else
+  // vcvt truncates, add 0.5 away from zero first
+  uint32x4_t sign = vandq_u32(vreinterpretq_u32_f32(x), vdupq_n_u32(0x80000000));
+  float32x4_t half = vreinterpretq_f32_u32(vorrq_u32(sign, vreinterpretq_u32_f32(vdupq_n_f32(0.5f))));
+  int32x4_t i = vcvtq_s32_f32(vaddq_f32(x, half));
+#endif
+  return vqmovn_s32(i);
+}
+
+static void planar_to_s16_neon(int16_t *out, const float *const *in, unsigned int channels, unsigned int samples)
+{
+  unsigned int s = 0;
+  switch(channels)
+  {
+    case 1:
+      for(; s + 4 <= samples; s += 4, out += 4)
+        vst1_s16(out, to_s16_neon(vld1q_f32(in[0] + s)));
+      break;
+    case 2:
+      for(; s + 4 <= samples; s += 4, out += 8)
+      {
+        int16x4x2_t v;
+        v.val[0] = to_s16_neon(vld1q_f32(in[0] + s));
+        v.val[1] = to_s16_neon(vld1q_f32(in[1] + s));
+        vst2_s16(out, v);
+      }
+      break;
+    case 4:
+      for(; s + 4 <= samples; s += 4, out += 16)
+      {
+        int16x4x4_t v;
+        for(int c = 0; c < 4; c++)
+          v.val[c] = to_s16_neon(vld1q_f32(in[c] + s));
+        vst4_s16(out, v);
+      }
+      break;
+    case 8:
+      for(; s + 4 <= samples; s += 4, out += 32)
+      {
+        int16x4_t v[8];
+        for(int c = 0; c < 8; c++)
+          v[c] = to_s16_neon(vld1q_f32(in[c] + s));
+        // pairs of channels, then pairs of pairs: q.val[n] holds 4 channels of frame n
+        int16x4x2_t p01 = vzip_s16(v[0], v[1]), p23 = vzip_s16(v[2], v[3]);
+        int16x4x2_t p45 = vzip_s16(v[4], v[5]), p67 = vzip_s16(v[6], v[7]);
+        int32x2x2_t lo0 = vzip_s32(vreinterpret_s32_s16(p01.val[0]), vreinterpret_s32_s16(p23.val[0]));
+        int32x2x2_t lo1 = vzip_s32(vreinterpret_s32_s16(p01.val[1]), vreinterpret_s32_s16(p23.val[1]));
+        int32x2x2_t hi0 = vzip_s32(vreinterpret_s32_s16(p45.val[0]), vreinterpret_s32_s16(p67.val[0]));
+        int32x2x2_t hi1 = vzip_s32(vreinterpret_s32_s16(p45.val[1]), vreinterpret_s32_s16(p67.val[1]));
+        vst1q_s16(out,      vreinterpretq_s16_s32(vcombine_s32(lo0.val[0], hi0.val[0])));
+        vst1q_s16(out + 8,  vreinterpretq_s16_s32(vcombine_s32(lo0.val[1], hi0.val[1])));
+        vst1q_s16(out + 16, vreinterpretq_s16_s32(vcombine_s32(lo1.val[0], hi1.val[0])));
+        vst1q_s16(out + 24, vreinterpretq_s16_s32(vcombine_s32(lo1.val[1], hi1.val[1])));
+      }
+      break;
+  }
+  planar_tail<int16_t, pcm_planar_to_s16_c>(out, in, channels, s, samples);
+}
+
+static inline int32x4_t to_s32_full_neon(float32x4_t x)
+{
+  // fixed point conversion with 31 fraction bits saturates by itself, it truncates instead of rounding
+  return vcvtq_n_s32_f32(x, 31);
+}
+
+static inline void transpose_s32_neon(int32x4_t &a, int32x4_t &b, int32x4_t &c, int32x4_t &d)
+{
+  int32x4x2_t ab = vtrnq_s32(a, b);
+  int32x4x2_t cd = vtrnq_s32(c, d);
+  a = vcombine_s32(vget_low_s32(ab.val[0]),  vget_low_s32(cd.val[0]));
+  b = vcombine_s32(vget_low_s32(ab.val[1]),  vget_low_s32(cd.val[1]));
+  c = vcombine_s32(vget_high_s32(ab.val[0]), vget_high_s32(cd.val[0]));
+  d = vcombine_s32(vget_high_s32(ab.val[1]), vget_high_s32(cd.val[1]));
+}
+
+// the first n of the 4 lanes
+static inline void store_s32_neon(int32_t *dst, int32x4_t v, unsigned int n)
+{
+  switch(n)
+  {
+    case 4:
+      vst1q_s32(dst, v);
+      break;
+    case 3:
+      vst1_s32(dst, vget_low_s32(v));
+      vst1q_lane_s32(dst + 2, v, 2);
+      break;
+    case 2:
+      vst1_s32(dst, vget_low_s32(v));
+      break;
+    default:
+      vst1q_lane_s32(dst, v, 0);
+      break;
+  }
+}
+
+static void planar_to_s32_neon(int32_t *out, const float *const *in, unsigned int channels, unsigned int samples)
+{
+  unsigned int s = 0;
+  switch(channels)
+  {
+    case 1:
+      for(; s + 4 <= samples; s += 4, out += 4)
+        vst1q_s32(out, to_s32_full_neon(vld1q_f32(in[0] + s)));
+      break;
+    case 2:
+      for(; s + 4 <= samples; s += 4, out += 8)
+      {
+        int32x4x2_t v;
+        v.val[0] = to_s32_full_neon(vld1q_f32(in[0] + s));
+        v.val[1] = to_s32_full_neon(vld1q_f32(in[1] + s));
+        vst2q_s32(out, v);
+      }
+      break;
+    case 4:
+      for(; s + 4 <= samples; s += 4, out += 16)
+      {
+        int32x4x4_t v;
+        for(int c = 0; c < 4; c++)
+          v.val[c] = to_s32_full_neon(vld1q_f32(in[c] + s));
+        vst4q_s32(out, v);
+      }
+      break;
+    default:
+      // 4 samples of up to 4 channels at a time, transposed into 4 partial frames
+      for(; s + 4 <= samples; s += 4, out += 4 * channels)
+      {
+        for(unsigned int c = 0; c < channels; c += 4)
+        {
+          unsigned int n = std::min(channels - c, 4u);
+          int32x4_t zero = vdupq_n_s32(0);
+          int32x4_t r0 = to_s32_full_neon(vld1q_f32(in[c] + s));
+          int32x4_t r1 = n > 1 ? to_s32_full_neon(vld1q_f32(in[c + 1] + s)) : zero;
+          int32x4_t r2 = n > 2 ? to_s32_full_neon(vld1q_f32(in[c + 2] + s)) : zero;
+          int32x4_t r3 = n > 3 ? to_s32_full_neon(vld1q_f32(in[c + 3] + s)) : zero;
+          transpose_s32_neon(r0, r1, r2, r3);
+          store_s32_neon(out + c,                r0, n);
+          store_s32_neon(out + channels + c,     r1, n);
+          store_s32_neon(out + 2 * channels + c, r2, n);
+          store_s32_neon(out + 3 * channels + c, r3, n);
+        }
+      }
+      break;
+  }
+  planar_tail<int32_t, pcm_planar_to_s32_c>(out, in, channels, s, samples);
+}
+
+const PCMKernelTable pcm_kernels_neon = { "neon", mix_neon, peak_neon, scale_neon, s16_to_planar_neon, planar_to_s16_neon, planar_to_s32_neon };
+
+#endif
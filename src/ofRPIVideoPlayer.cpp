@@ -20,6 +20,12 @@ void ofRPIVideoPlayer::onVideoLoop(ofxOMXPlayer* player)
 
 }
 
+void ofRPIVideoPlayer::onVideoLoaded(ofxOMXPlayer* player, bool success)
+{
+    videoHasEnded = false;
+    update();
+}
+
 ofRPIVideoPlayer::ofRPIVideoPlayer()
 {
     pixelFormat = OF_PIXELS_RGBA;
@@ -77,7 +83,16 @@ void ofRPIVideoPlayer::disablePixels()
 
 void ofRPIVideoPlayer::loadAsync(string name)
 {
-    load(name);
+    settings.videoPath = name;
+    settings.useHDMIForAudio = true;
+    settings.enableTexture = true;
+    settings.enableLooping = true;
+    settings.enableAudio = true;
+    
+    settings.listener = this;
+    openState = false;
+    videoHasEnded = false;
+    omxPlayer.setupAsync(settings);
 }
 
 void ofRPIVideoPlayer::play()
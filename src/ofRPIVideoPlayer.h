@@ -56,6 +56,7 @@ protected:
     bool videoHasEnded;
     void onVideoEnd(ofxOMXPlayer*);
     void onVideoLoop(ofxOMXPlayer*);
+    void onVideoLoaded(ofxOMXPlayer*, bool success);
 
     ofxOMXPlayerSettings settings;
     bool openOMXPlayer(ofxOMXPlayerSettings);
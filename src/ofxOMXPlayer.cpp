@@ -33,6 +33,8 @@ ofxOMXPlayer::ofxOMXPlayer()
     listener = nullptr;
     engineNeedsRestart = false;
     pendingLoopMessage = false;
+    pendingAdvanceMessage = false;
+    advanceNeedsRestart = false;
     OMX_Init();
     av_register_all();
     avformat_network_init();
@@ -63,6 +65,20 @@ bool ofxOMXPlayer::setup(ofxOMXPlayerSettings settings_)
     return result;
 }
 
+bool ofxOMXPlayer::setupAsync(ofxOMXPlayerSettings settings_)
+{
+    settings = settings_;
+    if(settings.listener)
+    {
+        listener = settings.listener;  
+    }
+    if(isOpen() || isLoading())
+    {
+        engine.close();
+    }
+    return engine.setupAsync(settings);
+}
+
 
 void ofxOMXPlayer::start()
 {
@@ -77,6 +93,23 @@ void ofxOMXPlayer::loadMovie(string videoPath)
     engineNeedsRestart = true;
 }
 
+bool ofxOMXPlayer::loadMovieAsync(string videoPath)
+{
+    settings.videoPath = videoPath;
+    return setupAsync(settings);
+}
+
+//opens videoPath in the background and plays it straight after the current movie
+bool ofxOMXPlayer::queueMovie(string videoPath)
+{
+    return engine.setNextMovie(videoPath);
+}
+
+bool ofxOMXPlayer::isLoading()
+{
+    return engine.isLoading();
+}
+
 void ofxOMXPlayer::reopen()
 {
     engineNeedsRestart = true;
@@ -86,27 +119,27 @@ void ofxOMXPlayer::reopen()
 
 int ofxOMXPlayer::getWidth()
 {
-    return engine.videoWidth; 
+    return engine.getMovieInfo().videoWidth; 
 }
 
 int ofxOMXPlayer::getHeight()
 {
-    return engine.videoHeight; 
+    return engine.getMovieInfo().videoHeight; 
 }
 
 float ofxOMXPlayer::getFPS()
 {
-    return engine.videoFrameRate;
+    return engine.getMovieInfo().videoFrameRate;
 }
 
 int ofxOMXPlayer::getTotalNumFrames()
 {
-    return engine.totalNumFrames;
+    return engine.getMovieInfo().totalNumFrames;
 }
 
 float ofxOMXPlayer::getDurationInSeconds()
 {
-    return engine.duration;
+    return engine.getMovieInfo().duration;
 }
 
 ofTexture& ofxOMXPlayer::getTextureReference()
@@ -163,7 +196,7 @@ float ofxOMXPlayer::getPlaybackSpeed()
 
 float ofxOMXPlayer::getMediaTime()
 {
-    float t = (float)(engine.omxClock.OMXMediaTime()*1e-6);
+    float t = (float)(engine.getItemMediaTime()*1e-6);
     return t;
 }
 
@@ -205,11 +238,13 @@ bool ofxOMXPlayer::isFrameNew()
 
 COMXStreamInfo&  ofxOMXPlayer::getVideoStreamInfo()
 {
-    return engine.m_config_video.hints;
+    videoStreamInfo = engine.getMovieInfo().videoHints;
+    return videoStreamInfo;
 }
 COMXStreamInfo&  ofxOMXPlayer::getAudioStreamInfo()
 {
-    return engine.m_config_audio.hints;
+    audioStreamInfo = engine.getMovieInfo().audioHints;
+    return audioStreamInfo;
 }
 
 string ofxOMXPlayer::getRandomVideo(string path)
@@ -282,6 +317,86 @@ string ofxOMXPlayer::getInfo()
         
         info << "FILTER: " << currentFilterName << endl; 
         
+        ofxOMXPlayerReaderStats readerStats = engine.getReaderStats();
+        OMXReaderCopyStats& copyStats = readerStats.copy;
+        if(copyStats.media_seconds > 0)
+        {
+            info << "PACKET KB COPIED PER MEDIA SEC: " << (copyStats.bytes_copied / copyStats.media_seconds) / 1024 << endl;
+            info << "PACKET KB ADOPTED PER MEDIA SEC: " << (copyStats.bytes_adopted / copyStats.media_seconds) / 1024 << endl;
+            info << "PACKET KB DROPPED PER MEDIA SEC: " << (copyStats.bytes_dropped / copyStats.media_seconds) / 1024 << endl;
+        }
+        
+        OMXReaderIOStats& ioStats = readerStats.io;
+        if(ioStats.buffer_size)
+        {
+            info << "AVIO BUFFER KB: " << ioStats.buffer_size / 1024 << " READS PER SEC: " << ioStats.reads_per_sec << " STDIO READS PER SEC: " << ioStats.stdio_reads_per_sec << " INPUT KB PER SEC: " << ioStats.kb_per_sec << endl;
+        }
+        
+        if(readerStats.prefetching)
+        {
+            OMXReaderPrefetchStats& prefetchStats = readerStats.prefetch;
+            info << "PREFETCH KB: " << prefetchStats.bytes / 1024 << " SECS: " << prefetchStats.seconds << " UNDERRUNS: " << prefetchStats.underruns << endl;
+        }
+        
+        OMXReaderProbeStats& probeStats = readerStats.probe;
+        info << "PROBE MS: " << probeStats.probe_ms << " CACHE HIT: " << probeStats.cache_hit << " SAVED MS: " << probeStats.saved_ms << endl;
+        
+        if(readerStats.seekIndexSize)
+        {
+            info << "SEEK INDEX KEYFRAMES: " << readerStats.seekIndexSize << " LAST SEEK MS: " << engine.lastSeekMs << " DECODE ONLY: " << engine.lastSeekDecodeOnly << endl;
+        }
+        
+        ofxOMXPlayerPlaylistStats playlistStats = engine.getPlaylistStats();
+        if(playlistStats.spliced || playlistStats.restarted)
+        {
+            info << "PLAYLIST SPLICED: " << playlistStats.spliced << " RESTARTED: " << playlistStats.restarted << " LAST GAP MS: " << playlistStats.lastGapMs << " MAX GAP MS: " << playlistStats.maxGapMs << " OPEN MS: " << playlistStats.lastOpenMs << endl;
+        }
+        
+        OMXClockStats clockStats = engine.omxClock.GetStats();
+        info << "CLOCK SAMPLES: " << clockStats.samples << " ERROR MS: " << clockStats.error / 1000.0 << " AVG: " << clockStats.error_avg / 1000.0 << " MAX: " << clockStats.error_max / 1000.0 << endl;
+        OMXClockGroupMemberStats syncStats;
+        if(getClockSyncStats(syncStats))
+        {
+            if(syncStats.master)
+            {
+                info << "CLOCK GROUP: MASTER" << endl;
+            }else
+            {
+                info << "CLOCK GROUP DRIFT MS: " << syncStats.drift / 1000.0 << " AVG: " << syncStats.drift_avg / 1000.0 << " MAX: " << syncStats.drift_max / 1000.0 << " SPEED: " << syncStats.speed << " LOCKED: " << syncStats.locked << " SNAPS: " << syncStats.snaps << " SEEKS: " << syncStats.seeks << endl;
+            }
+        }
+        OMXLiveLatencyStats liveStats;
+        if(getLiveLatencyStats(liveStats))
+        {
+            info << "LIVE LATENCY MS: " << liveStats.measured * 1000.0 << " TARGET: " << liveStats.target * 1000.0 << " ERROR AVG: " << liveStats.error_avg * 1000.0 << " RATIO: " << liveStats.applied << " UNDERRUNS: " << liveStats.underruns << endl;
+        }
+        OMXNetSyncStats netStats;
+        if(getNetSyncStats(netStats))
+        {
+            if(netStats.leader)
+            {
+                info << "NET SYNC LEADER GENERATION: " << netStats.generation << " BEACONS: " << netStats.beacons_sent << endl;
+            }else
+            {
+                info << "NET SYNC DRIFT MS: " << netStats.follower.drift / 1000.0 << " MAX: " << netStats.follower.drift_max / 1000.0 << " OFFSET US: " << netStats.offset << " SKEW PPM: " << netStats.skew << " DELAY US: " << netStats.delay << " LOST: " << netStats.beacons_lost << " SEEKS: " << netStats.seeks << endl;
+            }
+        }
+        
+        OMXPacketQueueStats videoQueueStats = engine.m_player_video.GetQueueStats();
+        info << "VIDEO DECODER STALLS: " << engine.m_player_video.GetDecoderStalls() << " BLOCKED SECS: " << engine.m_player_video.GetDecoderBlockedTime() << endl;
+        info << "VIDEO QUEUE STALLS: " << videoQueueStats.stalls << " BLOCKED SECS: " << videoQueueStats.blocked_us / 1000000.0 << endl;
+        if(engine.getMovieInfo().hasAudio)
+        {
+            OMXPacketQueueStats audioQueueStats = engine.m_player_audio.GetQueueStats();
+            info << "AUDIO DECODER STALLS: " << engine.m_player_audio.GetDecoderStalls() << " BLOCKED SECS: " << engine.m_player_audio.GetDecoderBlockedTime() << endl;
+            info << "AUDIO QUEUE STALLS: " << audioQueueStats.stalls << " BLOCKED SECS: " << audioQueueStats.blocked_us / 1000000.0 << endl;
+            OMXAudioOutputStats outputStats;
+            if(engine.m_player_audio.GetOutputStats(outputStats))
+            {
+                info << "ALSA LATENCY MS: " << outputStats.latency * 1000 << " MAX: " << outputStats.latency_max * 1000 << " BUFFER MS: " << outputStats.buffer * 1000 << " PERIOD MS: " << outputStats.period * 1000 << " XRUNS: " << outputStats.xruns << " MMAP: " << outputStats.mmap << " RESAMPLING: " << outputStats.resampling << endl;
+            }
+        }
+        
         
     }else
     {
@@ -310,8 +425,47 @@ void ofxOMXPlayer::onVideoLoop(bool needsRestart)
     engineNeedsRestart = needsRestart;
 }
 
+void ofxOMXPlayer::onPlaylistAdvance(string videoPath, bool needsRestart)
+{
+    ofLogNotice(__func__) << videoPath << " needsRestart: " << needsRestart;
+    nextVideoPath = videoPath;
+    advanceNeedsRestart = needsRestart;
+    pendingAdvanceMessage = true;
+}
+
+void ofxOMXPlayer::onLoaded(bool success)
+{
+    if(success)
+    {
+        engine.listener = this; 
+        currentFilterName = findFilterName(engine.m_config_video.filterType);
+    }
+    if(listener)
+    {
+        listener->onVideoLoaded(this, success);
+    }
+}
+
 void ofxOMXPlayer::onUpdate(ofEventArgs& eventArgs)
 {
+    if(engine.isLoading())
+    {
+        ofxOMXPlayerLoadState loadState = engine.updateLoad();
+        if(loadState == LOAD_DONE || loadState == LOAD_FAILED)
+        {
+            onLoaded(loadState == LOAD_DONE);
+        }
+    }
+    bool didAdvance = pendingAdvanceMessage;
+    if(didAdvance)
+    {
+        pendingAdvanceMessage = false;
+        settings.videoPath = nextVideoPath;
+        if(advanceNeedsRestart)
+        {
+            engineNeedsRestart = true;
+        }
+    }
     if(engineNeedsRestart)
     {
         engineNeedsRestart = false;
@@ -342,6 +496,11 @@ void ofxOMXPlayer::onUpdate(ofEventArgs& eventArgs)
         }
     }
     
+    //after any restart so the listener can queue the movie after this one
+    if(didAdvance && listener)
+    {
+        listener->onPlaylistAdvance(this);
+    }
 }
 
 
@@ -360,6 +519,77 @@ void ofxOMXPlayer::disableLooping()
     engine.m_loop = false; 
 }
 
+#pragma mark CLOCK GROUP
+
+void ofxOMXPlayer::setClockGroup(OMXClockGroup* group)
+{
+    settings.clockGroup = group;
+    engine.setClockGroup(group);
+}
+
+void ofxOMXPlayer::setClockMaster()
+{
+    if(engine.m_clock_group)
+    {
+        engine.m_clock_group->SetMaster(&engine.omxClock);
+    }
+}
+
+bool ofxOMXPlayer::isClockMaster()
+{
+    return engine.m_clock_group && engine.m_clock_group->IsMaster(&engine.omxClock);
+}
+
+bool ofxOMXPlayer::getClockSyncStats(OMXClockGroupMemberStats& stats)
+{
+    if(!engine.m_clock_group)
+    {
+        return false;
+    }
+    return engine.m_clock_group->GetStats(&engine.omxClock, stats);
+}
+
+#pragma mark NET SYNC
+
+void ofxOMXPlayer::setNetSync(OMXNetSync* netSync)
+{
+    settings.netSync = netSync;
+    engine.m_net_sync = netSync;
+}
+
+bool ofxOMXPlayer::getNetSyncStats(OMXNetSyncStats& stats)
+{
+    if(!engine.m_net_sync)
+    {
+        return false;
+    }
+    stats = engine.m_net_sync->GetStats();
+    return true;
+}
+
+#pragma mark LIVE LATENCY
+
+void ofxOMXPlayer::setLiveLatencyConfig(const OMXLiveLatencyConfig& config)
+{
+    settings.liveLatency = config;
+    engine.m_live_latency.SetConfig(config);
+}
+
+OMXLiveLatencyConfig ofxOMXPlayer::getLiveLatencyConfig()
+{
+    return engine.m_live_latency.GetConfig();
+}
+
+bool ofxOMXPlayer::getLiveLatencyStats(OMXLiveLatencyStats& stats)
+{
+    if(!engine.getMovieInfo().isLive)
+    {
+        return false;
+    }
+    stats = engine.m_live_latency.GetStats();
+    return true;
+}
+
 #pragma mark DRAWING
 
 void ofxOMXPlayer::draw(float x, float y, float w, float h)
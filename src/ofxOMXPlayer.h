@@ -7,6 +7,10 @@ class ofxOMXPlayerListener
 public:
     virtual void onVideoEnd(ofxOMXPlayer*) = 0;
     virtual void onVideoLoop(ofxOMXPlayer*) = 0;
+    //called from the update event when setupAsync/loadMovieAsync finishes
+    virtual void onVideoLoaded(ofxOMXPlayer*, bool success) {};
+    //called from the update event when a movie from queueMovie starts playing
+    virtual void onPlaylistAdvance(ofxOMXPlayer*) {};
     
 };
 class ImageFilter
@@ -31,15 +35,25 @@ public:
     ofxOMXPlayerListener* listener;
     bool engineNeedsRestart;
     bool pendingLoopMessage;
+    bool pendingAdvanceMessage;
+    bool advanceNeedsRestart;
+    string nextVideoPath;
     vector<ImageFilter>imageFilters;
     string currentFilterName;
+    //copies of the engine's published hints, handed out by reference
+    COMXStreamInfo videoStreamInfo;
+    COMXStreamInfo audioStreamInfo;
     int playerID;
     
 #pragma mark SETUP
     ofxOMXPlayer();
     bool setup(ofxOMXPlayerSettings settings_);
+    bool setupAsync(ofxOMXPlayerSettings settings_);
     void start();
     void loadMovie(string videoPath);
+    bool loadMovieAsync(string videoPath);
+    bool queueMovie(string videoPath);
+    bool isLoading();
     void reopen();
     void close();
 
@@ -73,7 +87,9 @@ public:
 #pragma mark LISTENERS
     void onVideoEnd();
     void onVideoLoop(bool needsRestart);
+    void onPlaylistAdvance(string videoPath, bool needsRestart);
     void onUpdate(ofEventArgs& eventArgs);
+    void onLoaded(bool success);
 
 #pragma mark DRAWING
     void draw(float x, float y, float w, float h);
@@ -101,6 +117,24 @@ public:
     void restartMovie();
     void enableLooping();
     void disableLooping();
+#pragma mark CLOCK GROUP
+    //frame-lock to the other players in group, NULL to play on our own
+    void setClockGroup(OMXClockGroup* group);
+    void setClockMaster();
+    bool isClockMaster();
+    //drift against the master, false when not in a group
+    bool getClockSyncStats(OMXClockGroupMemberStats& stats);
+#pragma mark NET SYNC
+    //lead or follow players on other hosts, NULL to stop. the OMXNetSync is started by the caller
+    void setNetSync(OMXNetSync* netSync);
+    //offset to the leader and drift, false without a net sync
+    bool getNetSyncStats(OMXNetSyncStats& stats);
+#pragma mark LIVE LATENCY
+    //target fifo and controller for live streams, takes effect right away
+    void setLiveLatencyConfig(const OMXLiveLatencyConfig& config);
+    OMXLiveLatencyConfig getLiveLatencyConfig();
+    //target, measured latency, ratio and underruns, false unless playing a live stream
+    bool getLiveLatencyStats(OMXLiveLatencyStats& stats);
 #pragma mark PLAYBACK AUDIO
     
     void increaseVolume();
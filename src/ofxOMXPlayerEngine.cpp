@@ -61,12 +61,68 @@ bool ofxOMXPlayerEngine::TRICKPLAY(int speed)
     return (speed < 0 || speed > 4 * DVD_PLAYSPEED_NORMAL);
 }
 
+//sources that can only be played as they arrive
+static bool isLiveURL(const string& url)
+{
+    static const char* schemes[] = { "rtsp://", "rtsps://", "rtmp://", "rtmps://", "rtp://", "udp://", "srt://", "mms://", "mmsh://" };
+    for(size_t i = 0; i < sizeof(schemes) / sizeof(schemes[0]); i++)
+    {
+        if(strncasecmp(url.c_str(), schemes[i], strlen(schemes[i])) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+//the net sync tells movies apart by this, the hosts of a wall keep their
+//copies at different paths but under the same name
+static uint32_t hashItemName(const string& path)
+{
+    size_t slash = path.find_last_of('/');
+    uint32_t hash = 2166136261u;
+    for(size_t i = (slash == string::npos) ? 0 : slash + 1; i < path.size(); i++)
+    {
+        hash = (hash ^ (uint8_t)path[i]) * 16777619u;
+    }
+    return hash;
+}
+
 #pragma mark SETUP
 
 ofxOMXPlayerEngine::ofxOMXPlayerEngine()
 {
     eglImage = NULL;
     
+    m_omx_reader = &m_readers[0];
+    m_next_reader = &m_readers[1];
+    m_video_pool = NULL;
+    m_clock_group = NULL;
+    m_net_sync = NULL;
+    m_next_state = NEXT_NONE;
+    m_next_pkt = NULL;
+    m_next_ready_time = 0;
+    m_next_cancel = false;
+    m_retired_reader = NULL;
+    m_retired_video_mark = 0;
+    m_retired_audio_mark = 0;
+    m_pts_offset = 0;
+    m_prev_pts_offset = 0;
+    m_splice_pts = 0;
+    m_item = 0;
+    m_prev_item = 0;
+    m_last_pts_end = DVD_NOPTS_VALUE;
+    m_splice_pending = false;
+    m_gap_start = 0;
+    m_gap_paused_at = 0;
+    m_gap_time = 0;
+    memset(&playlistStats, 0, sizeof(playlistStats));
+    
+    pthread_mutex_init(&m_load_lock, NULL);
+    pthread_cond_init(&m_load_cond, NULL);
+    m_load_state = LOAD_IDLE;
+    m_load_cancel = false;
+    
     speeds.push_back(createSpeed(0.0625));
     speeds.push_back(createSpeed(0.125));
     speeds.push_back(createSpeed(0.25));
@@ -110,7 +166,6 @@ void ofxOMXPlayerEngine::clear()
     m_stats = false;
     m_tv_show_info = false;
     m_Pause = false;
-    m_latency = 0.0f;
     m_loop = true;
     m_stop = false;
     m_NativeDeinterlace = false;
@@ -129,6 +184,11 @@ void ofxOMXPlayerEngine::clear()
     m_threshold      = -1.0f;
     m_incr = 0;
     last_seek_pos = 0;
+    m_seek_target_time = -1;
+    m_exact_seek_pts = DVD_NOPTS_VALUE;
+    m_seek_start_time = 0;
+    lastSeekMs = 0;
+    lastSeekDecodeOnly = 0;
     m_omx_pkt = NULL;
     m_send_eos = false;
     m_incr = 0;
@@ -140,9 +200,40 @@ void ofxOMXPlayerEngine::clear()
     m_lavfdopts = "";
     currentSpeed = normalSpeedIndex;
     
+    pthread_mutex_lock(&m_load_lock);
+    m_movie_info = ofxOMXPlayerMovieInfo();
+    pthread_mutex_unlock(&m_load_lock);
 }
 
 bool ofxOMXPlayerEngine::setup(ofxOMXPlayerSettings settings)
+{
+    m_settings = settings;
+    bool didOpen = openReader(settings);
+    if(didOpen && m_has_video && useTexture)
+    {
+        didOpen = generateEGLImage();
+        if(!didOpen)
+        {
+            ofLogError() << "generateEGLImage FAILED";
+        }
+    }
+    if(didOpen)
+    {
+        didOpen = openPlayers(settings);
+    }
+    if(didOpen)
+    {
+        publishMovieInfo();
+        startPlayback(settings);
+    }else
+    {
+        abortSetup();
+    }
+    return didOpen;
+}
+
+//probe the file and work out the video/audio config, safe to run off the main thread
+bool ofxOMXPlayerEngine::openReader(ofxOMXPlayerSettings& settings)
 {
     
     if(!settings.directDrawRectangle.isZero())
@@ -157,10 +248,30 @@ bool ofxOMXPlayerEngine::setup(ofxOMXPlayerSettings settings)
     }
     
     m_config_video.layer = settings.layer;
+    m_config_video.convert_annexb = settings.enableAnnexB;
+    m_config_video.zero_copy_input = settings.enableZeroCopyDecode;
+    if(settings.enableZeroCopyDecode && !m_video_pool)
+    {
+        m_video_pool = new OMXPacketPool(VIDEO_INPUT_BLOCK_SIZE, VIDEO_INPUT_BLOCKS);
+    }
+    m_config_video.input_pool = settings.enableZeroCopyDecode ? m_video_pool : NULL;
     
     m_filename = settings.videoPath;
     useTexture = settings.enableTexture;
     m_loop = settings.enableLooping;
+    setClockGroup(settings.clockGroup);
+    m_net_sync = settings.netSync;
+    m_config_audio.is_live = settings.enableLiveStream || isLiveURL(m_filename);
+    if(m_config_audio.is_live)
+    {
+        ofLog() << "LIVE SOURCE, HOLDING THE FIFO AT " << settings.liveLatency.target << "s";
+    }
+    m_live_latency.SetConfig(settings.liveLatency);
+    m_live_latency.Reset();
+    if(!settings.liveLatencyTrace.empty() && !m_live_latency.StartTrace(settings.liveLatencyTrace))
+    {
+        ofLogError(__func__) << "could not write the live latency trace to " << settings.liveLatencyTrace;
+    }
     
     CLog::SetLogLevel(settings.debugLevel);
     CLog::Init(settings.logDirectory.c_str(), settings.logToOF);
@@ -183,48 +294,45 @@ bool ofxOMXPlayerEngine::setup(ofxOMXPlayerSettings settings)
     }
     
     
-    bool didOpen = true;
     //m_config_video.filterType = OMX_ImageFilterCartoon;
     m_config_video.useTexture = useTexture;
-    bool m_dump_format = true;
-    bool m_config_audio_is_live = false;
-    
     
-    bool didOpenReader = m_omx_reader.Open(m_filename.c_str(),
-                                           m_dump_format,
-                                           m_config_audio_is_live,
-                                           m_timeout,
-                                           m_cookie.c_str(),
-                                           m_user_agent.c_str(),
-                                           m_lavfdopts.c_str());
+    bool didOpenReader = openReaderFile(m_omx_reader, m_filename);
     ofLog() << "didOpenReader: " << didOpenReader;
     
     
-    ofLog() << "VideoStreamCount(): " << m_omx_reader.VideoStreamCount();
-    ofLog() << "AudioStreamCount(): " << m_omx_reader.AudioStreamCount();
-    ofLog() << "CanSeek(): " << m_omx_reader.CanSeek();
+    ofLog() << "VideoStreamCount(): " << m_omx_reader->VideoStreamCount();
+    ofLog() << "AudioStreamCount(): " << m_omx_reader->AudioStreamCount();
+    ofLog() << "CanSeek(): " << m_omx_reader->CanSeek();
     ofLog() << "useTexture: " << useTexture;
     
     if(!didOpenReader)
     {
-        didOpen = false;
         ofLogError() << "READER COULD NOT OPEN " << m_filename;
         
-        return didOpen;
+        return false;
     }
+    pthread_mutex_lock(&m_load_lock);
+    m_pts_offset = 0;
+    m_prev_pts_offset = 0;
+    m_splice_pts = 0;
+    m_item = m_prev_item = hashItemName(m_filename);
+    pthread_mutex_unlock(&m_load_lock);
+    m_last_pts_end = DVD_NOPTS_VALUE;
+    m_splice_pending = false;
     omxClock.OMXInitialize();
     omxClock.OMXStateIdle();
     omxClock.OMXStop();
     omxClock.OMXPause();
     
-    m_omx_reader.GetHints(OMXSTREAM_AUDIO, m_config_audio.hints);
-    m_omx_reader.GetHints(OMXSTREAM_VIDEO, m_config_video.hints);
+    m_omx_reader->GetHints(OMXSTREAM_AUDIO, m_config_audio.hints);
+    m_omx_reader->GetHints(OMXSTREAM_VIDEO, m_config_video.hints);
     
     
-    m_has_video     = m_omx_reader.VideoStreamCount();
+    m_has_video     = m_omx_reader->VideoStreamCount();
     if(settings.enableAudio)
     {
-        m_has_audio = m_omx_reader.AudioStreamCount();
+        m_has_audio = m_omx_reader->AudioStreamCount();
         
     }
     
@@ -258,69 +366,81 @@ bool ofxOMXPlayerEngine::setup(ofxOMXPlayerSettings settings)
         duration = m_config_video.hints.nb_frames / videoFrameRate;
         
         m_config_video.enableFilters = settings.enableFilters;
-        if(useTexture)
+        if(!useTexture && settings.setDisplayResolution)
         {
-            bool didCreateEGLImage = generateEGLImage();
-            if(!didCreateEGLImage)
-            {
-                didOpen = false;
-                ofLogError() << "generateEGLImage FAILED";
-                
-                return didOpen;
-            }
-            m_config_video.eglImage = eglImage;
+            SetVideoMode(m_config_video.hints.width,
+                         m_config_video.hints.height,
+                         m_config_video.hints.fpsrate,
+                         m_config_video.hints.fpsscale);
             
-        }else
-        {
             
-            if(settings.setDisplayResolution)
+            TV_DISPLAY_STATE_T current_tv_state;
+            memset(&current_tv_state, 0, sizeof(TV_DISPLAY_STATE_T));
+            vc_tv_get_display_state(&current_tv_state);
+            if(current_tv_state.state & ( VC_HDMI_HDMI | VC_HDMI_DVI ))
             {
-                SetVideoMode(m_config_video.hints.width,
-                             m_config_video.hints.height,
-                             m_config_video.hints.fpsrate,
-                             m_config_video.hints.fpsscale);
-                
-                
-                TV_DISPLAY_STATE_T current_tv_state;
-                memset(&current_tv_state, 0, sizeof(TV_DISPLAY_STATE_T));
-                vc_tv_get_display_state(&current_tv_state);
-                if(current_tv_state.state & ( VC_HDMI_HDMI | VC_HDMI_DVI ))
-                {
-                    //HDMI or DVI on
-                    m_config_video.display_aspect = get_display_aspect_ratio((HDMI_ASPECT_T)current_tv_state.display.hdmi.aspect_ratio);
-                } else 
-                {
-                    //composite on
-                    m_config_video.display_aspect = get_display_aspect_ratio((SDTV_ASPECT_T)current_tv_state.display.sdtv.display_options.aspect);
-                }
-                m_config_video.display_aspect *= (float)current_tv_state.display.hdmi.height/(float)current_tv_state.display.hdmi.width;
-                
-                ofLog() << "height: " << current_tv_state.display.hdmi.height;
-                ofLog() << "width: " << current_tv_state.display.hdmi.width;
-                
-                
-                ofLog() << "m_config_video.display_aspect: " << m_config_video.display_aspect;
-                if(m_config_video.hdmi_clock_sync)
-                {
-                    omxClock.HDMIClockSync();
-                }
+                //HDMI or DVI on
+                m_config_video.display_aspect = get_display_aspect_ratio((HDMI_ASPECT_T)current_tv_state.display.hdmi.aspect_ratio);
+            } else 
+            {
+                //composite on
+                m_config_video.display_aspect = get_display_aspect_ratio((SDTV_ASPECT_T)current_tv_state.display.sdtv.display_options.aspect);
             }
+            m_config_video.display_aspect *= (float)current_tv_state.display.hdmi.height/(float)current_tv_state.display.hdmi.width;
+            
+            ofLog() << "height: " << current_tv_state.display.hdmi.height;
+            ofLog() << "width: " << current_tv_state.display.hdmi.width;
             
             
+            ofLog() << "m_config_video.display_aspect: " << m_config_video.display_aspect;
+            if(m_config_video.hdmi_clock_sync)
+            {
+                omxClock.HDMIClockSync();
+            }
         }
-        
-        
-        bool didVideoOpen =  m_player_video.Open(&omxClock, m_config_video);
-        if(didVideoOpen && useTexture)
+    }
+    return true;
+}
+
+bool ofxOMXPlayerEngine::openReaderFile(OMXReader* reader, string filename)
+{
+    bool m_dump_format = true;
+    
+    reader->SetZeroCopy(m_settings.enableZeroCopyPackets);
+    reader->SetVideoPacketPool(m_settings.enableZeroCopyDecode ? m_video_pool : NULL);
+    reader->SetMmap(m_settings.enableMmapFile);
+    reader->SetIOBufferSize(m_settings.ioBufferKB * 1024);
+    reader->SetAdaptiveIOBuffer(m_settings.enableAdaptiveIOBuffer);
+    reader->SetSeekIndex(m_settings.enableSeekIndex, m_settings.probeCacheDirectory);
+    reader->SetProbeCache(m_settings.enableProbeCache ? m_settings.probeCacheDirectory : "");
+    reader->SetStreamEnabled(OMXSTREAM_AUDIO, m_settings.enableAudio);
+    //there is no subtitle renderer, don't even demux them
+    reader->SetStreamEnabled(OMXSTREAM_SUBTITLE, false);
+    reader->ResetCopyStats();
+    return reader->Open(filename.c_str(),
+                        m_dump_format,
+                        m_config_audio.is_live,
+                        m_timeout,
+                        m_cookie.c_str(),
+                        m_user_agent.c_str(),
+                        m_lavfdopts.c_str());
+}
+
+//bring up the OMX decoders, expects the EGLImage to exist already when using textures
+bool ofxOMXPlayerEngine::openPlayers(ofxOMXPlayerSettings& settings)
+{
+    if(m_has_video)
+    {
+        if(useTexture)
         {
-            ofAddListener(ofEvents().update, this, &ofxOMXPlayerEngine::onUpdate);
-            
+            m_config_video.eglImage = eglImage;
         }
+        
+        bool didVideoOpen =  m_player_video.Open(&omxClock, m_config_video, m_omx_reader);
         if(!didVideoOpen)
         {
-            didOpen = false;
             ofLogError() << "VIDEO OPEN FAILED";
-            return didOpen;
+            return false;
         }
     }
     
@@ -328,6 +448,16 @@ bool ofxOMXPlayerEngine::setup(ofxOMXPlayerSettings settings)
     
     if(m_has_audio)
     {
+        m_config_audio.pack_s32 = settings.enableAudioS32Packing;
+        if (m_config_audio.device == "" && !settings.alsaDevice.empty())
+        {
+            m_config_audio.device = "omx:alsa";
+            m_config_audio.subdevice = settings.alsaDevice;
+            m_config_audio.alsa_buffer_ms = settings.alsaBufferMS ? settings.alsaBufferMS : (settings.enableAlsaLowLatency ? 40 : 0);
+            m_config_audio.alsa_period_ms = settings.alsaPeriodMS;
+            m_config_audio.alsa_mmap = settings.enableAlsaLowLatency;
+            m_config_audio.soft_downmix = settings.enableAlsaSoftDownmix;
+        }
         if (m_config_audio.device == "")
         {
             if(settings.useHDMIForAudio)
@@ -355,13 +485,12 @@ bool ofxOMXPlayerEngine::setup(ofxOMXPlayerSettings settings)
         {
             m_config_audio.passthrough = false;
         }
-        bool didAudioOpen = m_player_audio.Open(&omxClock, m_config_audio, &m_omx_reader);
+        bool didAudioOpen = m_player_audio.Open(&omxClock, m_config_audio, m_omx_reader);
         
         if(!didAudioOpen)
         {
-            didOpen = false;
             ofLogError() << "AUDIO OPEN FAILED";
-            return didOpen;
+            return false;
         }else
         {
             if (m_threshold < 0.0f)
@@ -383,17 +512,617 @@ bool ofxOMXPlayerEngine::setup(ofxOMXPlayerSettings settings)
             m_player_audio.SetVolume(pow(10, m_Volume / 2000.0));
         }
     }
+    return true;
+}
+
+//main thread only, registers with the OF update event and starts playing
+void ofxOMXPlayerEngine::startPlayback(ofxOMXPlayerSettings& settings)
+{
+    if(m_has_video && useTexture)
+    {
+        ofAddListener(ofEvents().update, this, &ofxOMXPlayerEngine::onUpdate);
+    }
+    if(settings.enablePrefetch)
+    {
+        m_omx_reader->StartPrefetch(settings.prefetchKB * 1024, settings.prefetchSeconds);
+    }
+    isOpen = true;
+    if(settings.autoStart)
+    {
+        startThread(); 
+        
+    }
+}
+
+//undo whatever a failed or cancelled setup got through
+void ofxOMXPlayerEngine::abortSetup()
+{
+    m_player_video.Close();
+    m_player_audio.Close();
+    m_omx_reader->Close();
+    omxClock.OMXDeinitialize();
+    isOpen = false;
+}
+
+#pragma mark ASYNC SETUP
+
+void ofxOMXPlayerLoader::threadedFunction()
+{
+    if(preload)
+    {
+        engine->preloadThreaded();
+    }else
+    {
+        engine->loadThreaded();
+    }
+}
+
+bool ofxOMXPlayerEngine::setupAsync(ofxOMXPlayerSettings settings)
+{
+    if(isLoading())
+    {
+        ofLogError(__func__) << "ALREADY LOADING " << m_settings.videoPath;
+        return false;
+    }
+    m_settings = settings;
+    m_load_cancel = false;
+    setLoadState(LOAD_OPENING);
+    loader.engine = this;
+    loader.preload = false;
+    loader.startThread();
+    return true;
+}
+
+void ofxOMXPlayerEngine::loadThreaded()
+{
+    bool didOpen = openReader(m_settings);
+    if(didOpen && m_has_video && useTexture)
+    {
+        //the EGLImage needs the GL context, let updateLoad() make it and wait
+        pthread_mutex_lock(&m_load_lock);
+        m_load_state = LOAD_NEEDS_EGL;
+        while(m_load_state == LOAD_NEEDS_EGL && !m_load_cancel)
+        {
+            pthread_cond_wait(&m_load_cond, &m_load_lock);
+        }
+        pthread_mutex_unlock(&m_load_lock);
+    }
+    if(didOpen && !m_load_cancel)
+    {
+        didOpen = openPlayers(m_settings);
+    }
+    if(!didOpen || m_load_cancel)
+    {
+        didOpen = false;
+        abortSetup();
+    }
+    if(didOpen)
+    {
+        publishMovieInfo();
+    }
+    setLoadState(didOpen ? LOAD_DONE : LOAD_FAILED);
+}
+
+ofxOMXPlayerLoadState ofxOMXPlayerEngine::updateLoad()
+{
+    ofxOMXPlayerLoadState state = getLoadState();
+    switch(state)
+    {
+        case LOAD_NEEDS_EGL:
+        {
+            bool didCreateEGLImage = generateEGLImage();
+            if(!didCreateEGLImage)
+            {
+                ofLogError() << "generateEGLImage FAILED";
+                m_load_cancel = true;
+            }
+            pthread_mutex_lock(&m_load_lock);
+            m_load_state = LOAD_OPENING_DECODERS;
+            pthread_cond_broadcast(&m_load_cond);
+            pthread_mutex_unlock(&m_load_lock);
+            break;
+        }
+        case LOAD_DONE:
+        case LOAD_FAILED:
+        {
+            loader.waitForThread(false);
+            if(state == LOAD_DONE)
+            {
+                startPlayback(m_settings);
+            }
+            setLoadState(LOAD_IDLE);
+            break;
+        }
+        default:
+        {
+            break;
+        }
+    }
+    return state;
+}
+
+void ofxOMXPlayerEngine::cancelLoad()
+{
+    if(!isLoading())
+    {
+        return;
+    }
+    pthread_mutex_lock(&m_load_lock);
+    m_load_cancel = true;
+    pthread_cond_broadcast(&m_load_cond);
+    pthread_mutex_unlock(&m_load_lock);
+    
+    loader.waitForThread(false);
+    if(getLoadState() == LOAD_DONE)
+    {
+        //finished before it saw the cancel, nobody started playing yet
+        abortSetup();
+    }
+    setLoadState(LOAD_IDLE);
+}
+
+bool ofxOMXPlayerEngine::isLoading()
+{
+    return getLoadState() != LOAD_IDLE;
+}
+
+ofxOMXPlayerLoadState ofxOMXPlayerEngine::getLoadState()
+{
+    pthread_mutex_lock(&m_load_lock);
+    ofxOMXPlayerLoadState state = m_load_state;
+    pthread_mutex_unlock(&m_load_lock);
+    return state;
+}
+
+void ofxOMXPlayerEngine::setLoadState(ofxOMXPlayerLoadState state)
+{
+    pthread_mutex_lock(&m_load_lock);
+    m_load_state = state;
+    pthread_cond_broadcast(&m_load_cond);
+    pthread_mutex_unlock(&m_load_lock);
+}
+
+#pragma mark PLAYLIST
+
+bool ofxOMXPlayerEngine::setNextMovie(string videoPath)
+{
+    if(!isOpen)
+    {
+        ofLogError(__func__) << "NOT OPEN, USE setup FOR " << videoPath;
+        return false;
+    }
+    cancelNextMovie();
+    
+    pthread_mutex_lock(&m_load_lock);
+    m_next_filename = videoPath;
+    m_next_state = NEXT_LOADING;
+    pthread_mutex_unlock(&m_load_lock);
+    
+    preloader.engine = this;
+    preloader.preload = true;
+    preloader.startThread();
+    return true;
+}
+
+void ofxOMXPlayerEngine::cancelNextMovie()
+{
+    //a preload still waiting for the retired reader gives up
+    pthread_mutex_lock(&m_load_lock);
+    m_next_cancel = true;
+    pthread_cond_broadcast(&m_load_cond);
+    pthread_mutex_unlock(&m_load_lock);
+    
+    if(preloader.isThreadRunning())
+    {
+        preloader.waitForThread(false);
+    }
+    pthread_mutex_lock(&m_load_lock);
+    m_next_cancel = false;
+    if(m_next_state != NEXT_NONE)
+    {
+        if(m_next_pkt)
+        {
+            OMXReader::FreePacket(m_next_pkt);
+            m_next_pkt = NULL;
+        }
+        //the engine thread closes it once the players are done with it
+        if(m_next_reader != m_retired_reader)
+        {
+            m_next_reader->Close();
+        }
+        m_next_state = NEXT_NONE;
+    }
+    pthread_mutex_unlock(&m_load_lock);
+}
+
+bool ofxOMXPlayerEngine::hasNextMovie()
+{
+    pthread_mutex_lock(&m_load_lock);
+    bool result = m_next_state != NEXT_NONE;
+    pthread_mutex_unlock(&m_load_lock);
+    return result;
+}
+
+void ofxOMXPlayerEngine::preloadThreaded()
+{
+    uint64_t startTime = ofGetElapsedTimeMicros();
     
+    //the spare reader is the one spliced away from, wait until the engine
+    //thread closed it
+    pthread_mutex_lock(&m_load_lock);
+    while(m_retired_reader && !m_next_cancel)
+    {
+        pthread_cond_wait(&m_load_cond, &m_load_lock);
+    }
+    bool cancelled = m_next_cancel;
+    pthread_mutex_unlock(&m_load_lock);
+    
+    bool didOpen = false;
+    OMXPacket* pkt = NULL;
+    if(!cancelled)
+    {
+        //or it may still hold the movie before the current one
+        m_next_reader->Close();
+        didOpen = openReaderFile(m_next_reader, m_next_filename);
+    }
     if(didOpen)
     {
-        if(settings.autoStart)
+        m_next_reader->GetHints(OMXSTREAM_VIDEO, m_next_video_hints);
+        m_next_reader->GetHints(OMXSTREAM_AUDIO, m_next_audio_hints);
+        
+        //read the first packet now so the splice doesn't wait on the disk
+        pkt = m_next_reader->Read();
+        didOpen = (pkt != NULL);
+        if(didOpen && m_settings.enablePrefetch)
         {
-            startThread(); 
-            
+            m_next_reader->StartPrefetch(m_settings.prefetchKB * 1024, m_settings.prefetchSeconds);
         }
     }
-    isOpen = didOpen;
-    return didOpen;
+    if(!didOpen && !cancelled)
+    {
+        ofLogError(__func__) << "COULD NOT OPEN NEXT MOVIE " << m_next_filename;
+    }
+    
+    pthread_mutex_lock(&m_load_lock);
+    m_next_pkt = pkt;
+    m_next_state = didOpen ? NEXT_READY : NEXT_FAILED;
+    m_next_ready_time = ofGetElapsedTimeMicros();
+    playlistStats.lastOpenMs = (m_next_ready_time - startTime) / 1000.0;
+    pthread_mutex_unlock(&m_load_lock);
+}
+
+//called with m_load_lock held once the next movie is ready
+bool ofxOMXPlayerEngine::canSplice()
+{
+    if(m_last_pts_end == DVD_NOPTS_VALUE)
+    {
+        return false;
+    }
+    if(m_has_video != (m_next_reader->VideoStreamCount() > 0))
+    {
+        return false;
+    }
+    if(m_has_video)
+    {
+        COMXStreamInfo& current = m_config_video.hints;
+        COMXStreamInfo& next = m_next_video_hints;
+        if(current.codec != next.codec ||
+           current.width != next.width ||
+           current.height != next.height ||
+           current.fpsrate != next.fpsrate ||
+           current.fpsscale != next.fpsscale ||
+           current.extrasize != next.extrasize ||
+           m_omx_reader->GetVideoIndex() != m_next_reader->GetVideoIndex())
+        {
+            return false;
+        }
+        //the decoder was configured with the old SPS/PPS
+        if(current.extrasize && memcmp(current.extradata, next.extradata, current.extrasize) != 0)
+        {
+            return false;
+        }
+    }
+    if(m_has_audio)
+    {
+        COMXStreamInfo& current = m_config_audio.hints;
+        COMXStreamInfo& next = m_next_audio_hints;
+        if(!m_next_reader->AudioStreamCount() ||
+           current.codec != next.codec ||
+           current.channels != next.channels ||
+           current.samplerate != next.samplerate ||
+           current.bitspersample != next.bitspersample ||
+           current.extrasize != next.extrasize ||
+           m_omx_reader->GetAudioIndex() != m_next_reader->GetAudioIndex())
+        {
+            return false;
+        }
+        if(current.extrasize && memcmp(current.extradata, next.extradata, current.extrasize) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//engine thread, at demuxer EOF. Hands the decoders the next reader's packets
+//shifted to start where the last frame of this movie ends
+bool ofxOMXPlayerEngine::spliceNextMovie()
+{
+    pthread_mutex_lock(&m_load_lock);
+    if(m_next_state != NEXT_READY || !canSplice())
+    {
+        pthread_mutex_unlock(&m_load_lock);
+        return false;
+    }
+    OMXPacket* pkt = m_next_pkt;
+    double firstPts = (pkt->pts != DVD_NOPTS_VALUE) ? pkt->pts : pkt->dts;
+    if(firstPts == DVD_NOPTS_VALUE)
+    {
+        firstPts = 0;
+    }
+    
+    m_prev_pts_offset = m_pts_offset;
+    m_pts_offset = m_last_pts_end - firstPts;
+    m_splice_pts = m_last_pts_end;
+    m_prev_item = m_item;
+    m_item = hashItemName(m_next_filename);
+    
+    //every packet of the previous movie is queued by now, the engine thread
+    //is the only one pushing
+    OMXReader* previous = m_omx_reader;
+    m_omx_reader = m_next_reader;
+    m_next_reader = previous;
+    m_retired_reader = previous;
+    m_retired_video_mark = m_player_video.GetQueueStats().pushed;
+    m_retired_audio_mark = m_player_audio.GetQueueStats().pushed;
+    m_next_pkt = NULL;
+    m_next_state = NEXT_NONE;
+    string filename = m_next_filename;
+    m_config_video.hints = m_next_video_hints;
+    m_config_audio.hints = m_next_audio_hints;
+    
+    playlistStats.spliced++;
+    playlistStats.lastLeadMs = (ofGetElapsedTimeMicros() - m_next_ready_time) / 1000.0;
+    pthread_mutex_unlock(&m_load_lock);
+    
+    m_player_video.SetReader(m_omx_reader, m_retired_video_mark);
+    m_player_audio.SetReader(m_omx_reader, m_retired_audio_mark);
+    m_filename = filename;
+    totalNumFrames = m_config_video.hints.nb_frames;
+    duration = totalNumFrames / videoFrameRate;
+    publishMovieInfo();
+    
+    m_last_pts_end = DVD_NOPTS_VALUE;
+    m_omx_pkt = pkt;
+    offsetPacket(m_omx_pkt);
+    m_send_eos = false;
+    
+    m_splice_pending = true;
+    m_gap_paused_at = 0;
+    m_gap_time = 0;
+    
+    ofLog() << "SPLICED " << filename << " AT " << m_splice_pts;
+    if(listener)
+    {
+        listener->onPlaylistAdvance(filename, false);
+    }
+    return true;
+}
+
+//engine thread. A player that popped past its mark has freed every packet
+//the retired reader queued, Process() only pops once the last one is done.
+//The players copied their codec extradata, nothing else points into it
+void ofxOMXPlayerEngine::closeRetiredReader(bool force)
+{
+    if(!m_retired_reader)
+    {
+        return;
+    }
+    if(!force)
+    {
+        if(m_has_video && m_player_video.GetQueueStats().popped <= m_retired_video_mark)
+        {
+            return;
+        }
+        if(m_has_audio && m_player_audio.GetQueueStats().popped <= m_retired_audio_mark)
+        {
+            return;
+        }
+    }
+    m_retired_reader->Close();
+    
+    pthread_mutex_lock(&m_load_lock);
+    m_retired_reader = NULL;
+    pthread_cond_broadcast(&m_load_cond);
+    pthread_mutex_unlock(&m_load_lock);
+}
+
+//moves a freshly read packet onto the running timeline and remembers where the movie ends
+void ofxOMXPlayerEngine::markSeekPacket()
+{
+    //allow for rounding between the frame time and the stream time base
+    double target = m_exact_seek_pts - DVD_MSEC_TO_TIME(1);
+    double pts = m_omx_pkt->pts != DVD_NOPTS_VALUE ? m_omx_pkt->pts : m_omx_pkt->dts;
+    if(pts == DVD_NOPTS_VALUE)
+    {
+        return;
+    }
+    
+    bool done = false;
+    if(m_has_video && m_omx_reader->IsActive(OMXSTREAM_VIDEO, m_omx_pkt->stream_index))
+    {
+        if(pts < target)
+        {
+            m_omx_pkt->decode_only = true;
+            lastSeekDecodeOnly++;
+        }
+        //with b-frames a later packet can still show before the target,
+        //once the decode time passes it nothing else can
+        if(m_omx_pkt->dts != DVD_NOPTS_VALUE)
+        {
+            done = m_omx_pkt->dts >= target;
+        }else
+        {
+            done = pts >= target + DVD_MSEC_TO_TIME(500);
+        }
+    }
+    else if(m_omx_pkt->codec_type == AVMEDIA_TYPE_AUDIO)
+    {
+        if(pts < target)
+        {
+            m_omx_reader->FreePacket(m_omx_pkt);
+            m_omx_pkt = NULL;
+        }else
+        {
+            done = !m_has_video;
+        }
+    }
+    
+    if(done)
+    {
+        m_exact_seek_pts = DVD_NOPTS_VALUE;
+        lastSeekMs = ofGetElapsedTimeMillis() - m_seek_start_time;
+        ofLog(OF_LOG_VERBOSE, "exact seek took %.0f ms, %d frames decode only", lastSeekMs, lastSeekDecodeOnly);
+    }
+}
+
+void ofxOMXPlayerEngine::offsetPacket(OMXPacket* pkt)
+{
+    if(!pkt)
+    {
+        return;
+    }
+    if(m_pts_offset != 0)
+    {
+        if(pkt->pts != DVD_NOPTS_VALUE)
+        {
+            pkt->pts += m_pts_offset;
+        }
+        if(pkt->dts != DVD_NOPTS_VALUE)
+        {
+            pkt->dts += m_pts_offset;
+        }
+    }
+    
+    bool isTimeline = m_has_video ? m_omx_reader->IsActive(OMXSTREAM_VIDEO, pkt->stream_index) : (pkt->codec_type == AVMEDIA_TYPE_AUDIO);
+    double pts = (pkt->pts != DVD_NOPTS_VALUE) ? pkt->pts : pkt->dts;
+    if(isTimeline && pts != DVD_NOPTS_VALUE)
+    {
+        double frameDuration = pkt->duration;
+        if(frameDuration == DVD_NOPTS_VALUE || frameDuration <= 0)
+        {
+            frameDuration = m_has_video ? (double)DVD_TIME_BASE / videoFrameRate : 0;
+        }
+        if(m_last_pts_end == DVD_NOPTS_VALUE || pts + frameDuration > m_last_pts_end)
+        {
+            m_last_pts_end = pts + frameDuration;
+        }
+    }
+}
+
+void ofxOMXPlayerEngine::recordGap(double gap)
+{
+    pthread_mutex_lock(&m_load_lock);
+    playlistStats.lastGapMs = gap / 1000.0;
+    playlistStats.maxGapMs = std::max(playlistStats.maxGapMs, playlistStats.lastGapMs);
+    pthread_mutex_unlock(&m_load_lock);
+    ofLog() << "PLAYLIST GAP MS: " << gap / 1000.0;
+}
+
+ofxOMXPlayerPlaylistStats ofxOMXPlayerEngine::getPlaylistStats()
+{
+    pthread_mutex_lock(&m_load_lock);
+    ofxOMXPlayerPlaylistStats stats = playlistStats;
+    pthread_mutex_unlock(&m_load_lock);
+    return stats;
+}
+
+void ofxOMXPlayerEngine::setClockGroup(OMXClockGroup* group)
+{
+    if(group == m_clock_group)
+    {
+        return;
+    }
+    if(m_clock_group)
+    {
+        m_clock_group->Leave(&omxClock);
+    }
+    m_clock_group = group;
+    if(m_clock_group)
+    {
+        m_clock_group->Join(&omxClock);
+    }
+}
+
+double ofxOMXPlayerEngine::getItemMediaTime()
+{
+    return getItemMediaTime(omxClock.OMXMediaTime());
+}
+
+double ofxOMXPlayerEngine::getItemMediaTime(double t)
+{
+    pthread_mutex_lock(&m_load_lock);
+    //frames of the previous movie may still be on screen
+    double offset = (t < m_splice_pts) ? m_prev_pts_offset : m_pts_offset;
+    pthread_mutex_unlock(&m_load_lock);
+    return t - offset;
+}
+
+//the movie on screen at clock time t, as getItemMediaTime()
+uint32_t ofxOMXPlayerEngine::getItemId(double t)
+{
+    pthread_mutex_lock(&m_load_lock);
+    uint32_t item = (t < m_splice_pts) ? m_prev_item : m_item;
+    pthread_mutex_unlock(&m_load_lock);
+    return item;
+}
+
+//the thread that set the movie up publishes it once it is complete
+void ofxOMXPlayerEngine::publishMovieInfo()
+{
+    ofxOMXPlayerMovieInfo info;
+    info.filename = m_filename;
+    info.videoWidth = videoWidth;
+    info.videoHeight = videoHeight;
+    info.videoFrameRate = videoFrameRate;
+    info.totalNumFrames = totalNumFrames;
+    info.duration = duration;
+    info.hasVideo = m_has_video;
+    info.hasAudio = m_has_audio;
+    info.isLive = m_config_audio.is_live;
+    info.videoHints = m_config_video.hints;
+    info.audioHints = m_config_audio.hints;
+    
+    pthread_mutex_lock(&m_load_lock);
+    m_movie_info = info;
+    pthread_mutex_unlock(&m_load_lock);
+}
+
+ofxOMXPlayerMovieInfo ofxOMXPlayerEngine::getMovieInfo()
+{
+    pthread_mutex_lock(&m_load_lock);
+    ofxOMXPlayerMovieInfo info = m_movie_info;
+    pthread_mutex_unlock(&m_load_lock);
+    return info;
+}
+
+ofxOMXPlayerReaderStats ofxOMXPlayerEngine::getReaderStats()
+{
+    ofxOMXPlayerReaderStats stats;
+    memset(&stats, 0, sizeof(stats));
+    //spliceNextMovie swaps m_omx_reader on the engine thread
+    pthread_mutex_lock(&m_load_lock);
+    stats.copy = m_omx_reader->GetCopyStats();
+    stats.io = m_omx_reader->GetIOStats();
+    stats.prefetching = m_omx_reader->IsPrefetching();
+    if(stats.prefetching)
+    {
+        stats.prefetch = m_omx_reader->GetPrefetchStats();
+    }
+    stats.probe = m_omx_reader->GetProbeStats();
+    stats.seekIndexSize = m_omx_reader->GetSeekIndexSize();
+    pthread_mutex_unlock(&m_load_lock);
+    return stats;
 }
 
 
@@ -685,26 +1414,51 @@ void ofxOMXPlayerEngine::threadedFunction()
                 
                 if (!m_chapter_seek)
                 {
-                    pts = omxClock.OMXMediaTime();
+                    pts = getItemMediaTime();
                     
-                    seek_pos = (pts ? pts / DVD_TIME_BASE : last_seek_pos) + m_incr;
+                    bool exact = m_seek_target_time >= 0;
+                    if(exact)
+                    {
+                        seek_pos = m_seek_target_time;
+                    }else
+                    {
+                        seek_pos = (pts ? pts / DVD_TIME_BASE : last_seek_pos) + m_incr;
+                    }
                     last_seek_pos = seek_pos;
                     
                     seek_pos *= 1000.0;
                     
-                    if(m_omx_reader.SeekTime((int)seek_pos, m_incr < 0.0f, &startpts))
+                    if(m_omx_reader->SeekTime((int)seek_pos, exact || m_incr < 0.0f, &startpts))
                     {
                         unsigned t = (unsigned)(startpts*1e-6);
-                        auto dur = m_omx_reader.GetStreamLength() / 1000;
+                        auto dur = m_omx_reader->GetStreamLength() / 1000;
                         ofLog(OF_LOG_NOTICE, "m_omx_reader Seek\n%02d:%02d:%02d / %02d:%02d:%02d",
                               (t/3600), (t/60)%60, t%60, (dur/3600), (dur/60)%60, dur%60);
                         FlushStreams(startpts);
+                        
+                        //the clock is back on the reader's own timeline
+                        pthread_mutex_lock(&m_load_lock);
+                        m_pts_offset = 0;
+                        m_prev_pts_offset = 0;
+                        m_splice_pts = 0;
+                        m_prev_item = m_item;
+                        pthread_mutex_unlock(&m_load_lock);
+                        m_last_pts_end = DVD_NOPTS_VALUE;
+                        m_splice_pending = false;
+                        
+                        //the reader lands on the keyframe before the target,
+                        //frames up to the target are decoded but not shown
+                        if(exact)
+                        {
+                            m_exact_seek_pts = m_seek_target_time * DVD_TIME_BASE;
+                            lastSeekDecodeOnly = 0;
+                        }
                     }
                 }
                 
                 sentStarted = false;
                 
-                if (m_omx_reader.IsEof())
+                if (m_omx_reader->IsEof())
                 {
                     doExit();
                 }
@@ -722,17 +1476,18 @@ void ofxOMXPlayerEngine::threadedFunction()
                 m_packet_after_seek = false;
                 m_seek_flush = false;
                 m_incr = 0;
+                m_seek_target_time = -1;
             }
             else if(m_packet_after_seek && TRICKPLAY(omxClock.OMXPlaySpeed()))
             {
                 double seek_pos     = 0;
                 double pts          = 0;
                 
-                pts = omxClock.OMXMediaTime();
+                pts = getItemMediaTime();
                 seek_pos = (pts / DVD_TIME_BASE);
                 
                 seek_pos *= 1000.0;
-                if(m_omx_reader.SeekTime((int)seek_pos, omxClock.OMXPlaySpeed() < 0, &startpts))
+                if(m_omx_reader->SeekTime((int)seek_pos, omxClock.OMXPlaySpeed() < 0, &startpts))
                 {
                     //FlushStreams(DVD_NOPTS_VALUE);
                 }
@@ -752,10 +1507,24 @@ void ofxOMXPlayerEngine::threadedFunction()
             if (update)
             {
                 /* when the video/audio fifos are low, we pause clock, when high we resume */
-                double stamp = omxClock.OMXMediaTime();
+                /* this is the only place that refreshes the clock snapshot, everybody else interpolates */
+                double stamp = omxClock.OMXSampleMediaTime();
                 double audio_pts = m_player_audio.GetCurrentPTS();
                 double video_pts = m_player_video.GetCurrentPTS();
                 
+                if(m_splice_pending && !omxClock.OMXIsPaused() && stamp >= m_splice_pts)
+                {
+                    m_splice_pending = false;
+                    recordGap(m_gap_time);
+                }
+                closeRetiredReader(false);
+                if(m_gap_start && !omxClock.OMXIsPaused() && stamp > 0)
+                {
+                    //first clock movement after a playlist restart
+                    recordGap(now - m_gap_start);
+                    m_gap_start = 0;
+                }
+                
                 if (0 && omxClock.OMXIsPaused())
                 {
                     double old_stamp = stamp;
@@ -831,42 +1600,59 @@ void ofxOMXPlayerEngine::threadedFunction()
                         latency = audio_fifo;
                     else if (!m_has_audio && m_has_video && video_pts != DVD_NOPTS_VALUE)
                         latency = video_fifo;
-                    if (!m_Pause && latency != DVD_NOPTS_VALUE)
+                    if (m_Pause)
                     {
-                        if (omxClock.OMXIsPaused())
+                        if (!omxClock.OMXIsPaused())
                         {
-                            if (latency > m_threshold)
+                            omxClock.OMXPause();
+                        }
+                    }
+                    else if (latency != DVD_NOPTS_VALUE)
+                    {
+                        // a full input or the end of the stream resumes whatever the fifo, there is nothing more coming
+                        bool blocked = m_omx_reader->IsEof() || m_omx_pkt;
+                        switch (m_live_latency.Update(now / DVD_TIME_BASE, stamp / DVD_TIME_BASE, latency, omxClock.OMXIsPaused(), blocked))
+                        {
+                            case OMX_LIVE_LATENCY_PAUSE:
+                            {
+                                ofLog(OF_LOG_NOTICE, "Live underrun %.2f, pause until %.2f\n", latency, m_live_latency.GetStats().target);
+                                omxClock.OMXPause();
+                                break;
+                            }
+                            case OMX_LIVE_LATENCY_RESUME:
                             {
-                                ofLog(OF_LOG_NOTICE,  "Resume %.2f,%.2f (%d,%d,%d,%d) EOF:%d PKT:%p\n", audio_fifo, video_fifo, audio_fifo_low, video_fifo_low, audio_fifo_high, video_fifo_high, m_omx_reader.IsEof(), m_omx_pkt);
+                                ofLog(OF_LOG_NOTICE, "Live resume %.2f EOF:%d PKT:%p\n", latency, m_omx_reader->IsEof(), m_omx_pkt);
                                 omxClock.OMXResume();
-                                m_latency = latency;
+                                break;
                             }
+                            default:
+                                break;
                         }
-                        else
+                        
+                        // the ratio only moves in steps the clock can take, so this rarely touches it
+                        int speed = (int)lrint(m_live_latency.GetRatio() * DVD_PLAYSPEED_NORMAL);
+                        if (speed != omxClock.OMXPlaySpeed())
                         {
-                            m_latency = m_latency*0.99f + latency*0.01f;
-                            float speed = 1.0f;
-                            if (m_latency < 0.5f*m_threshold)
-                                speed = 0.990f;
-                            else if (m_latency < 0.9f*m_threshold)
-                                speed = 0.999f;
-                            else if (m_latency > 2.0f*m_threshold)
-                                speed = 1.010f;
-                            else if (m_latency > 1.1f*m_threshold)
-                                speed = 1.001f;
-                            
-                            omxClock.OMXSetSpeed(createSpeed(speed));
-                            omxClock.OMXSetSpeed(createSpeed(speed), true, true);
-                            ofLog(OF_LOG_NOTICE,  "Live: %.2f (%.2f) S:%.3f T:%.2f\n", m_latency, latency, speed, m_threshold);
+                            omxClock.OMXSetSpeed(speed);
+                            if (!omxClock.OMXIsPaused())
+                            {
+                                omxClock.OMXSetSpeed(speed, true, true);
+                            }
+                            ofLog(OF_LOG_VERBOSE, "Live: %.2f (%.2f) S:%.3f T:%.2f\n", m_live_latency.GetStats().measured, latency, (float)speed / DVD_PLAYSPEED_NORMAL, m_live_latency.GetStats().target);
                         }
                     }
                 }
-                else if(!m_Pause && (m_omx_reader.IsEof() || m_omx_pkt || TRICKPLAY(omxClock.OMXPlaySpeed()) || (audio_fifo_high && video_fifo_high)))
+                else if(!m_Pause && (m_omx_reader->IsEof() || m_omx_pkt || TRICKPLAY(omxClock.OMXPlaySpeed()) || (audio_fifo_high && video_fifo_high)))
                 {
                     if (omxClock.OMXIsPaused())
                     {
-                        ofLog(OF_LOG_NOTICE, "Resume %.2f,%.2f (%d,%d,%d,%d) EOF:%d PKT:%p\n", audio_fifo, video_fifo, audio_fifo_low, video_fifo_low, audio_fifo_high, video_fifo_high, m_omx_reader.IsEof(), m_omx_pkt);
+                        ofLog(OF_LOG_NOTICE, "Resume %.2f,%.2f (%d,%d,%d,%d) EOF:%d PKT:%p\n", audio_fifo, video_fifo, audio_fifo_low, video_fifo_low, audio_fifo_high, video_fifo_high, m_omx_reader->IsEof(), m_omx_pkt);
                         omxClock.OMXResume();
+                        if(m_gap_paused_at)
+                        {
+                            m_gap_time += now - m_gap_paused_at;
+                            m_gap_paused_at = 0;
+                        }
                     }
                 }
                 else if (m_Pause || audio_fifo_low || video_fifo_low)
@@ -879,7 +1665,38 @@ void ofxOMXPlayerEngine::threadedFunction()
                             ofLog(OF_LOG_NOTICE, "Pause %.2f,%.2f (%d,%d,%d,%d) %.2f\n", audio_fifo, video_fifo, audio_fifo_low, video_fifo_low, audio_fifo_high, video_fifo_high, m_threshold);
                         }
                         omxClock.OMXPause();
+                        if(m_splice_pending)
+                        {
+                            m_gap_paused_at = now;
+                        }
+                    }
+                }
+                
+                // keep in step with the master clock of the group by adjusting speed, like the live case above,
+                // and seek onto it when too far off, the master's clock runs on the same timeline as ours
+                if (m_clock_group && !m_config_audio.is_live && !m_Pause)
+                {
+                    double groupSeekTime;
+                    if (m_clock_group->GetSeek(&omxClock, groupSeekTime))
+                    {
+                        double clockTime = omxClock.OMXMediaTime();
+                        seekToTimeInSeconds((groupSeekTime - (clockTime - getItemMediaTime(clockTime)) + DVD_MSEC_TO_TIME(lastSeekMs)) / DVD_TIME_BASE);
                     }
+                    m_clock_group->Sync(&omxClock, (double)DVD_TIME_BASE / (videoFrameRate ? videoFrameRate : 25));
+                }
+                
+                // players on other hosts: the leader sends its clock even while paused, followers steer onto it
+                // and seek when too far off, aiming at where the leader will be once the seek is done
+                if (m_net_sync && !m_config_audio.is_live && (m_net_sync->IsLeader() || !m_Pause))
+                {
+                    double netSeekTime;
+                    if (m_net_sync->GetSeek(netSeekTime))
+                    {
+                        seekToTimeInSeconds((netSeekTime + DVD_MSEC_TO_TIME(lastSeekMs)) / DVD_TIME_BASE);
+                    }
+                    double clockTime = omxClock.OMXMediaTime();
+                    m_net_sync->Sync(&omxClock, (double)DVD_TIME_BASE / (videoFrameRate ? videoFrameRate : 25),
+                                     clockTime - getItemMediaTime(clockTime), getItemId(clockTime));
                 }
             }
             if (!sentStarted)
@@ -890,12 +1707,24 @@ void ofxOMXPlayerEngine::threadedFunction()
             }
             
             if(!m_omx_pkt)
-                m_omx_pkt = m_omx_reader.Read();
+            {
+                m_omx_pkt = m_omx_reader->Read();
+                offsetPacket(m_omx_pkt);
+                if(m_omx_pkt && m_exact_seek_pts != DVD_NOPTS_VALUE)
+                {
+                    markSeekPacket();
+                }
+            }
             
             if(m_omx_pkt)
                 m_send_eos = false;
             
-            if(m_omx_reader.IsEof() && !m_omx_pkt)
+            if(m_omx_reader->IsEof() && !m_omx_pkt && spliceNextMovie())
+            {
+                continue;
+            }
+            
+            if(m_omx_reader->IsEof() && !m_omx_pkt)
             {
                 // demuxer EOF, but may have not played out data yet
                 if ( (m_has_video && m_player_video.GetCached()) ||
@@ -917,6 +1746,22 @@ void ofxOMXPlayerEngine::threadedFunction()
                 }
                 ofLog() << "REACHED END OF STREAM";
                 
+                if(hasNextMovie())
+                {
+                    //next movie didn't match the running decoders or wasn't ready in time
+                    ofLog() << "PLAYLIST WILL ADVANCE VIA RESTART";
+                    pthread_mutex_lock(&m_load_lock);
+                    string filename = m_next_filename;
+                    playlistStats.restarted++;
+                    pthread_mutex_unlock(&m_load_lock);
+                    m_gap_start = now;
+                    if(listener)
+                    {
+                        listener->onPlaylistAdvance(filename, true);
+                    }
+                    break;
+                }
+                
                 if (m_loop)
                 {
                     ofLog() << "SHOULD LOOP";
@@ -924,7 +1769,7 @@ void ofxOMXPlayerEngine::threadedFunction()
                     bool needsRestart = false;
                     if(totalNumFrames)
                     {
-                        m_incr = m_loop_from - (omxClock.OMXMediaTime() ? omxClock.OMXMediaTime() / DVD_TIME_BASE : last_seek_pos); 
+                        m_incr = m_loop_from - (omxClock.OMXMediaTime() ? getItemMediaTime() / DVD_TIME_BASE : last_seek_pos); 
                     }else
                     {
                         ofLog() << "WILL LOOP VIA RESTART";
@@ -951,7 +1796,7 @@ void ofxOMXPlayerEngine::threadedFunction()
                 break;
             }
             
-            if(m_has_video && m_omx_pkt && m_omx_reader.IsActive(OMXSTREAM_VIDEO, m_omx_pkt->stream_index))
+            if(m_has_video && m_omx_pkt && m_omx_reader->IsActive(OMXSTREAM_VIDEO, m_omx_pkt->stream_index))
             {
                 if (TRICKPLAY(omxClock.OMXPlaySpeed()))
                 {
@@ -960,20 +1805,20 @@ void ofxOMXPlayerEngine::threadedFunction()
                 if(m_player_video.AddPacket(m_omx_pkt))
                     m_omx_pkt = NULL;
                 else
-                    OMXClock::OMXSleep(10);
+                    m_player_video.WaitForSpace(m_omx_pkt, 10);
             }
             else if(m_has_audio && m_omx_pkt && !TRICKPLAY(omxClock.OMXPlaySpeed()) && m_omx_pkt->codec_type == AVMEDIA_TYPE_AUDIO)
             {
                 if(m_player_audio.AddPacket(m_omx_pkt))
                     m_omx_pkt = NULL;
                 else
-                    OMXClock::OMXSleep(10);
+                    m_player_audio.WaitForSpace(m_omx_pkt, 10);
             }
             else
             {
                 if(m_omx_pkt)
                 {
-                    m_omx_reader.FreePacket(m_omx_pkt);
+                    m_omx_reader->FreePacket(m_omx_pkt);
                     m_omx_pkt = NULL;
                 }
                 else
@@ -993,7 +1838,9 @@ void ofxOMXPlayerEngine::SetSpeed()
     
     //currentPlaybackSpeed = speeds[playspeed_current]/1000.0f;
     ofLog(OF_LOG_NOTICE, "Playspeed: %d", speed);
-    m_omx_reader.SetSpeed(speed);
+    pthread_mutex_lock(&m_load_lock);
+    m_omx_reader->SetSpeed(speed);
+    pthread_mutex_unlock(&m_load_lock);
     
     // flush when in trickplay mode
     if (TRICKPLAY(speed) || TRICKPLAY(omxClock.OMXPlaySpeed()))
@@ -1008,14 +1855,18 @@ void ofxOMXPlayerEngine::SetSpeed()
 void ofxOMXPlayerEngine::seekToFrame(int frameTarget)
 {
     lock();
-    int fps =  videoFrameRate;
+    double fps = videoFrameRate;
+    if(m_config_video.hints.fpsrate && m_config_video.hints.fpsscale)
+    {
+        fps = (double)m_config_video.hints.fpsrate / m_config_video.hints.fpsscale;
+    }
     
-    double seekTime = frameTarget/fps;
-    printf("seekTime %lf\n", seekTime);
-    double oldPos = omxClock.OMXMediaTime()*1e-6;
-    m_incr = seekTime-oldPos;
+    double seekTime = frameTarget / fps;
+    m_seek_start_time = ofGetElapsedTimeMillis();
+    m_seek_target_time = seekTime;
+    m_seek_flush = true;
     
-    ofLog() << "frameTarget: " << frameTarget << " seekTime: " << seekTime << " m_incr: " << m_incr;
+    ofLog() << "frameTarget: " << frameTarget << " seekTime: " << seekTime;
     unlock();
     
 }
@@ -1023,9 +1874,10 @@ void ofxOMXPlayerEngine::seekToFrame(int frameTarget)
 void ofxOMXPlayerEngine::seekToTimeInSeconds(double timeInSeconds)
 {
     lock();
-    double oldPos = omxClock.OMXMediaTime()*1e-6;
-    m_incr = timeInSeconds-oldPos;
-    ofLog() << "seekToTimeInSeconds: " << m_incr;
+    m_seek_start_time = ofGetElapsedTimeMillis();
+    m_seek_target_time = std::max(timeInSeconds, 0.0);
+    m_seek_flush = true;
+    ofLog() << "seekToTimeInSeconds: " << m_seek_target_time;
     unlock();
 }
 
@@ -1321,7 +2173,7 @@ void ofxOMXPlayerEngine::FlushStreams(double pts)
     
     if(m_omx_pkt)
     {
-        m_omx_reader.FreePacket(m_omx_pkt);
+        m_omx_reader->FreePacket(m_omx_pkt);
         m_omx_pkt = NULL;
     }
 }
@@ -1359,11 +2211,14 @@ void ofxOMXPlayerEngine::doExit()
     
     if(m_omx_pkt)
     {
-        m_omx_reader.FreePacket(m_omx_pkt);
+        m_omx_reader->FreePacket(m_omx_pkt);
         m_omx_pkt = NULL;
     }
     
-    m_omx_reader.Close();
+    //the players freed whatever they still held
+    closeRetiredReader(true);
+    m_omx_reader->Close();
+    cancelNextMovie();
     
     omxClock.OMXDeinitialize();
     
@@ -1391,6 +2246,7 @@ void ofxOMXPlayerEngine::doExit()
 
 void ofxOMXPlayerEngine::close(bool clearTextures)//default clearTextures = false
 {
+    cancelLoad();
     ofRemoveListener(ofEvents().update, this, &ofxOMXPlayerEngine::onUpdate);
     listener = nullptr;
     lock();
@@ -1410,12 +2266,21 @@ void ofxOMXPlayerEngine::close(bool clearTextures)//default clearTextures = fals
 ofxOMXPlayerEngine::~ofxOMXPlayerEngine()
 {
     close();
+    setClockGroup(NULL);
+    //the readers and packets still out hold it until they are gone
+    if(m_video_pool)
+    {
+        m_video_pool->Unref();
+        m_video_pool = NULL;
+    }
     destroyEGLImage();
     if(pixels)
     {
         delete[] pixels;
         pixels = NULL;
     }
+    pthread_cond_destroy(&m_load_cond);
+    pthread_mutex_destroy(&m_load_lock);
 }
 
 
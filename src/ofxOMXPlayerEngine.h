@@ -4,6 +4,9 @@
 #include "ofxOMXPlayerSettings.h"
 #include "OMXReader.h"
 #include "OMXClock.h"
+#include "OMXClockGroup.h"
+#include "OMXNetSync.h"
+#include "OMXLiveLatency.h"
 #include "OMXAudio.h"
 #include "OMXPlayerVideo.h"
 #include "OMXPlayerAudio.h"
@@ -12,6 +15,8 @@
 #include <EGL/egl.h>
 #include <EGL/eglplatform.h>
 #include <EGL/eglext.h>
+#include <pthread.h>
+#include <atomic>
 
 class EngineListener
 {
@@ -20,6 +25,75 @@ public:
     virtual ~EngineListener(){};
     virtual void onVideoEnd() = 0;
     virtual void onVideoLoop(bool needsRestart)= 0;
+    virtual void onPlaylistAdvance(string videoPath, bool needsRestart) {};
+};
+
+enum ofxOMXPlayerLoadState
+{
+    LOAD_IDLE,
+    LOAD_OPENING,           //worker opens the file and probes the streams
+    LOAD_NEEDS_EGL,         //waiting for the main thread to create the EGLImage
+    LOAD_OPENING_DECODERS,  //worker brings up the OMX components
+    LOAD_DONE,
+    LOAD_FAILED
+};
+
+enum ofxOMXPlayerNextState
+{
+    NEXT_NONE,
+    NEXT_LOADING,   //next movie is being opened and probed
+    NEXT_READY,     //reader open and first packet read
+    NEXT_FAILED
+};
+
+typedef struct ofxOMXPlayerPlaylistStats
+{
+    int spliced;        //movies joined onto the running decoders
+    int restarted;      //movies that needed the engine to be set up again
+    double lastGapMs;   //time the clock stood still at the last change
+    double maxGapMs;
+    double lastOpenMs;  //time taken to open and probe the last queued movie
+    double lastLeadMs;  //how long the queued movie was ready before it was needed
+} ofxOMXPlayerPlaylistStats;
+
+//what the current reader reports, taken under the lock the playlist swaps it with
+typedef struct ofxOMXPlayerReaderStats
+{
+    OMXReaderCopyStats copy;
+    OMXReaderIOStats io;
+    bool prefetching;
+    OMXReaderPrefetchStats prefetch;
+    OMXReaderProbeStats probe;
+    size_t seekIndexSize;
+} ofxOMXPlayerReaderStats;
+
+//what the player's getters report. openReader may run on the loader thread,
+//so this is copied under m_load_lock once a movie is ready and read from there
+typedef struct ofxOMXPlayerMovieInfo
+{
+    string filename;
+    int videoWidth;
+    int videoHeight;
+    int videoFrameRate;
+    int totalNumFrames;
+    int duration;
+    bool hasVideo;
+    bool hasAudio;
+    bool isLive;
+    COMXStreamInfo videoHints;
+    COMXStreamInfo audioHints;
+} ofxOMXPlayerMovieInfo;
+
+class ofxOMXPlayerEngine;
+
+//runs the blocking part of ofxOMXPlayerEngine::setupAsync or setNextMovie
+class ofxOMXPlayerLoader : public ofThread
+{
+public:
+    ofxOMXPlayerLoader(){ engine = NULL; preload = false; };
+    ofxOMXPlayerEngine* engine;
+    bool preload;
+    void threadedFunction();
 };
 
 
@@ -31,8 +105,11 @@ class ofxOMXPlayerEngine : public ofThread
 public:
     
     
-    OMXReader m_omx_reader;
+    OMXReader* m_omx_reader;
     OMXClock omxClock;
+    OMXClockGroup* m_clock_group;
+    OMXNetSync* m_net_sync;
+    OMXLiveLatency m_live_latency;
     
     OMXAudioConfig    m_config_audio;
     OMXVideoConfig    m_config_video;
@@ -48,6 +125,9 @@ public:
     bool m_has_audio;
     double m_incr;
     double last_seek_pos;
+    double m_seek_target_time;  //absolute seek in seconds, < 0 when none is pending
+    double m_exact_seek_pts;    //frames before this are decoded but not shown
+    double m_seek_start_time;
     OMXPacket *m_omx_pkt;
     bool m_send_eos;
     double m_loop_from;
@@ -58,8 +138,7 @@ public:
     bool m_stats;
     bool m_tv_show_info;
     bool m_Pause;
-    float m_latency;
-    bool m_loop;
+    std::atomic<bool> m_loop;
     bool m_stop;
     bool m_NativeDeinterlace;
     bool m_refresh;
@@ -92,6 +171,8 @@ public:
     int videoFrameRate;
     int duration;
     bool isOpen;
+    double lastSeekMs;          //time from seek request until the target frame was read
+    int lastSeekDecodeOnly;     //frames decoded but not shown to get there
     
     EngineListener* listener;
     bool hasNewFrame;
@@ -111,6 +192,34 @@ public:
     void clear();
     bool setup(ofxOMXPlayerSettings settings);
     void threadedFunction();
+    
+    //open/probe and decoder setup on a worker thread, call updateLoad() from the main thread
+    bool setupAsync(ofxOMXPlayerSettings settings);
+    ofxOMXPlayerLoadState updateLoad();
+    void cancelLoad();
+    bool isLoading();
+    void loadThreaded();
+    
+    //playlist, the next movie is opened ahead of time and joined onto the
+    //running decoders when codec and size match, otherwise the engine restarts
+    bool setNextMovie(string videoPath);
+    void cancelNextMovie();
+    bool hasNextMovie();
+    void preloadThreaded();
+    ofxOMXPlayerPlaylistStats getPlaylistStats();
+    ofxOMXPlayerReaderStats getReaderStats();
+    ofxOMXPlayerMovieInfo getMovieInfo();
+    //follow the master clock of group, NULL to leave
+    void setClockGroup(OMXClockGroup* group);
+    //media time relative to the start of the current movie
+    double getItemMediaTime();
+    double getItemMediaTime(double clockTime); //the same for a clock time read before
+    uint32_t getItemId(double clockTime);
+    
+    bool openReader(ofxOMXPlayerSettings& settings);
+    bool openPlayers(ofxOMXPlayerSettings& settings);
+    void startPlayback(ofxOMXPlayerSettings& settings);
+    void abortSetup();
 
     void updatePixels();
     bool generateEGLImage();
@@ -152,5 +261,58 @@ public:
     void doExit();
     ~ofxOMXPlayerEngine();
     
+private:
+    ofxOMXPlayerLoadState getLoadState();
+    void setLoadState(ofxOMXPlayerLoadState state);
+    bool openReaderFile(OMXReader* reader, string filename);
+    bool canSplice();
+    bool spliceNextMovie();
+    void closeRetiredReader(bool force);
+    void publishMovieInfo();
+    void offsetPacket(OMXPacket* pkt);
+    void markSeekPacket();
+    void recordGap(double gap);
+    
+    ofxOMXPlayerLoader loader;
+    ofxOMXPlayerSettings m_settings;
+    ofxOMXPlayerLoadState m_load_state;
+    std::atomic<bool> m_load_cancel;
+    pthread_mutex_t m_load_lock;
+    pthread_cond_t m_load_cond;
+    
+    OMXReader m_readers[2];
+    OMXReader* m_next_reader;
+    //both readers demux into it, see OMXVideoConfig::input_pool
+    OMXPacketPool* m_video_pool;
+    ofxOMXPlayerLoader preloader;
+    ofxOMXPlayerNextState m_next_state;
+    string m_next_filename;
+    OMXPacket* m_next_pkt;
+    COMXStreamInfo m_next_video_hints;
+    COMXStreamInfo m_next_audio_hints;
+    uint64_t m_next_ready_time;
+    bool m_next_cancel;
+    
+    //the reader spliced away from owns the packets of its movie still queued
+    //in the players, it stays open until both popped past m_retired_*_mark
+    OMXReader* m_retired_reader;
+    uint64_t m_retired_video_mark;
+    uint64_t m_retired_audio_mark;
+    
+    //packets of the current movie are shifted by m_pts_offset so the clock
+    //runs on across movies, m_splice_pts is where the current movie starts
+    double m_pts_offset;
+    double m_prev_pts_offset;
+    double m_splice_pts;
+    //and the ids of both movies handed to the net sync, see getItemId()
+    uint32_t m_item;
+    uint32_t m_prev_item;
+    double m_last_pts_end;
+    bool m_splice_pending;
+    double m_gap_start;
+    double m_gap_paused_at;
+    double m_gap_time;
+    ofxOMXPlayerPlaylistStats playlistStats;
+    ofxOMXPlayerMovieInfo m_movie_info;
 };
 
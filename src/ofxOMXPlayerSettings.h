@@ -8,9 +8,12 @@
 #include <IL/OMX_Video.h>
 #include <IL/OMX_Broadcom.h>
 #include "utils/log.h"
+#include "OMXLiveLatency.h"
 #define __func__ __PRETTY_FUNCTION__
 
 class ofxOMXPlayerListener;
+class OMXClockGroup;
+class OMXNetSync;
 class ofxOMXPlayerSettings
 {
 public:
@@ -34,6 +37,29 @@ public:
         logToOF = true;
         setDisplayResolution = false;
         layer = 0;
+        enableZeroCopyPackets = false;
+        enableMmapFile = false;
+        ioBufferKB = 32;
+        enableAdaptiveIOBuffer = false;
+        enablePrefetch = false;
+        prefetchKB = 8192;
+        prefetchSeconds = 2.0;
+        enableSeekIndex = false;
+        enableProbeCache = false;
+        enableAnnexB = false;
+        enableZeroCopyDecode = false;
+        alsaDevice = "";
+        enableAlsaLowLatency = false;
+        alsaBufferMS = 0;
+        alsaPeriodMS = 0;
+        enableAlsaSoftDownmix = false;
+        enableAudioS32Packing = false;
+        clockGroup = NULL;
+        netSync = NULL;
+        enableLiveStream = false;
+        liveLatency = OMXLiveLatency::Defaults();
+        liveLatencyTrace = "";
+        probeCacheDirectory = ofToDataPath("probecache", true);
     }
     bool enableFilters;
     OMX_IMAGEFILTERTYPE filter;
@@ -53,6 +79,34 @@ public:
     uint layer;
     ofxOMXPlayerListener* listener;
     
+    bool enableZeroCopyPackets; //reference demuxer buffers instead of copying every packet
+    
+    bool enableMmapFile;    //read local files through mmap instead of stdio
+    int ioBufferKB;         //AVIO buffer for local files, 4 - 1024
+    bool enableAdaptiveIOBuffer; //grow the AVIO buffer while reads keep filling it
+    bool enablePrefetch;    //demux on its own thread, helps with slow SD cards/network storage
+    int prefetchKB;         //max KB of packets read ahead
+    float prefetchSeconds;  //max seconds of media read ahead
+    bool enableSeekIndex;   //index keyframes (cached in probeCacheDirectory) for fast, frame accurate seeks
+    bool enableProbeCache;  //remember stream info of local files so reopening them is faster
+    string probeCacheDirectory; //probe cache and seek indexes of local files
+    bool enableAnnexB;      //feed H.264 from mp4/mkv to the decoder as Annex B, converted while filling its buffers
+    bool enableZeroCopyDecode; //give packet memory to the video decoder (OMX_UseBuffer) instead of copying it, not with enableAnnexB
+    
+    string alsaDevice;      //play audio through ALSA instead of the OMX renderers, e.g. "default", "hw:0,0" or "null", 15 chars max
+    bool enableAlsaLowLatency; //40 ms ALSA buffer written through mmap, alsaBufferMS/alsaPeriodMS still apply
+    int alsaBufferMS;       //ALSA device buffer, 0 = 200 ms (40 ms with enableAlsaLowLatency)
+    int alsaPeriodMS;       //0 = a quarter of the buffer
+    bool enableAlsaSoftDownmix; //downmix on the CPU (PCMUtils) instead of the GPU audio_mixer
+    bool enableAudioS32Packing; //convert float audio to S32 on the CPU instead of sending it to the GPU as planar float
+    
+    OMXClockGroup* clockGroup; //frame-lock to the other players in the group, the first one to join is the master
+    OMXNetSync* netSync;       //follow or lead players on other hosts, started with StartLeader()/StartFollower()
+    
+    bool enableLiveStream;            //play videoPath as it arrives, rtsp/rtmp/rtp/udp/srt/mms urls are always live
+    OMXLiveLatencyConfig liveLatency; //fifo target and controller gains for live streams, tune with tools/live-latency-replay
+    string liveLatencyTrace;          //record the fifo of live streams to this file for tools/live-latency-replay
+    
     bool setDisplayResolution; //direct only
     ofRectangle directDrawRectangle;
     
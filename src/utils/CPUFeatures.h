@@ -0,0 +1,27 @@
+#pragma once
+
+// Runtime checks for the SIMD kernels. The NEON ones live in *Neon.cpp files
+// that enable NEON for themselves only, everything else is built for the
+// baseline ARMv6 of the Pi 1/Zero and must not call them unless this says so.
+
+#if defined(__arm__) && !defined(__aarch64__)
+#include <sys/auxv.h>
+#ifndef HWCAP_NEON
+#define HWCAP_NEON (1 << 12)
+#endif
+#endif
+
+#if defined(__arm__) || defined(__aarch64__)
+#define CPU_HAVE_NEON_KERNELS
+#endif
+
+static inline bool cpu_has_neon(void)
+{
+#if defined(__aarch64__)
+  return true;
+#elif defined(__arm__)
+  return (getauxval(AT_HWCAP) & HWCAP_NEON) != 0;
+#else
+  return false;
+#endif
+}
@@ -27,10 +27,12 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <algorithm>
 
 #include "MathUtils.h"
 #include "PCMRemap.h"
 #include "utils/log.h"
+#include "PCMUtils.h"
 #ifdef _WIN32
 #include "../win32/PlatformDefs.h"
 #endif
@@ -169,6 +171,8 @@ CPCMRemap::CPCMRemap() :
   m_outChannels (0),
   m_inSampleSize(0),
   m_ignoreLayout(false),
+  m_mixGain     (-1.0f),
+  m_levelSum    (0.0f),
   m_buf(NULL),
   m_bufsize(0),
   m_attenuation (1.0),
@@ -176,6 +180,8 @@ CPCMRemap::CPCMRemap() :
   m_attenuationMin(1.0),
   m_sampleRate  (48000.0), //safe default
   m_holdCounter (0),
+  m_holdSamples (0),
+  m_releaseScale(0.0f),
   m_limiterEnabled(false)
 {
   Dispose();
@@ -373,6 +379,10 @@ void CPCMRemap::BuildMap()
 
   for(out_ch = 0; out_ch < m_outChannels; ++out_ch)
   {
+    /* padding in the output layout, nothing maps there */
+    if (m_outMap[out_ch] == PCM_INVALID)
+      continue;
+
     float scale = 0;
     int count = 0;
     for(dst = m_lookupMap[m_outMap[out_ch]]; dst->channel != PCM_INVALID; ++dst)
@@ -405,6 +415,9 @@ void CPCMRemap::BuildMap()
   /* adjust the channels that are too loud */
   for(out_ch = 0; out_ch < m_outChannels; ++out_ch)
   {
+    if (m_outMap[out_ch] == PCM_INVALID)
+      continue;
+
     CStdString s = "", f;
     for(dst = m_lookupMap[m_outMap[out_ch]]; dst->channel != PCM_INVALID; ++dst)
     {
@@ -419,6 +432,33 @@ void CPCMRemap::BuildMap()
     }
     CLog::Log(LOGDEBUG, "CPCMRemap: %s = %s\n", PCMChannelStr(m_outMap[out_ch]).c_str(), s.c_str());
   }
+
+  BuildMatrix();
+}
+
+/*
+  flattens the lookup table into a dense out x in matrix for the mixing
+  kernels, channels that aren't mapped get a row or column of zeros
+*/
+void CPCMRemap::BuildMatrix()
+{
+  memset(m_matrix, 0, sizeof(m_matrix));
+  m_levelSum = 0.0f;
+  m_mixGain  = -1.0f;
+
+  for (unsigned int out_ch = 0; out_ch < m_outChannels; ++out_ch)
+  {
+    if (m_outMap[out_ch] == PCM_INVALID)
+      continue;
+
+    float sum = 0.0f;
+    for (struct PCMMapInfo *info = m_lookupMap[m_outMap[out_ch]]; info->channel != PCM_INVALID; ++info)
+    {
+      m_matrix[out_ch * m_inChannels + (info->in_offset >> 1)] += info->level;
+      sum += info->level;
+    }
+    m_levelSum = std::max(m_levelSum, sum);
+  }
 }
 
 void CPCMRemap::DumpMap(CStdString info, unsigned int channels, enum PCMChannels *channelMap)
@@ -481,6 +521,9 @@ enum PCMChannels *CPCMRemap::SetInputFormat(unsigned int channels, enum PCMChann
   m_attenuation = 1.0;
   m_attenuationInc = 1.0;
   m_holdCounter = 0;
+  /* the limiter holds for 25ms and releases over 100ms */
+  m_holdSamples  = MathUtils::round_int(m_sampleRate * 0.025f);
+  m_releaseScale = 1.0f / (m_sampleRate * 0.1f);
 
   return m_layoutMap;
 }
@@ -502,31 +545,64 @@ void CPCMRemap::SetOutputFormat(unsigned int channels, enum PCMChannels *channel
   m_holdCounter = 0;
 }
 
-#if 0
-void CPCMRemap::Remap(void *data, void *out, unsigned int samples, long drc)
+/* samples per pass through the kernels, small enough to stay in cache */
+#define PCM_REMAP_BLOCK 256
+
+/* mix interleaved S16 input into out, which must be pre-allocated */
+void CPCMRemap::Remap(const int16_t *in, int16_t *out, unsigned int samples, float gain /*= 1.0f*/)
 {
-  float gain = 1.0f;
-  if (drc > 0)
-    gain = pow(10.0f, (float)drc / 1000.0f);
+  if (!CanRemap())
+  {
+    memset(out, 0, samples * m_outChannels * sizeof(int16_t));
+    return;
+  }
 
-  Remap(data, out, samples, gain);
+  /* the input block goes after the output block and the limiter gains */
+  CheckBufferSize((m_outChannels + 1 + m_inChannels) * PCM_REMAP_BLOCK * sizeof(float));
+  float *planes[PCM_MAX_CH];
+  for (unsigned int ch = 0; ch < m_inChannels; ch++)
+    planes[ch] = m_buf + (m_outChannels + 1 + ch) * PCM_REMAP_BLOCK;
+
+  while (samples > 0)
+  {
+    unsigned int count = std::min(samples, (unsigned int)PCM_REMAP_BLOCK);
+    pcm_s16_to_planar(planes, in, m_inChannels, count);
+    RemapBlock(planes, out, count, gain);
+    in      += count * m_inChannels;
+    out     += count * m_outChannels;
+    samples -= count;
+  }
 }
 
-/* remap the supplied data into out, which must be pre-allocated */
-void CPCMRemap::Remap(void *data, void *out, unsigned int samples, float gain /*= 1.0f*/)
+/* mix planar float input into out, which must be pre-allocated */
+void CPCMRemap::Remap(const float* const* in, int16_t *out, unsigned int samples, float gain /*= 1.0f*/)
 {
-  CheckBufferSize(samples * m_outChannels * sizeof(float));
+  if (!CanRemap())
+  {
+    memset(out, 0, samples * m_outChannels * sizeof(int16_t));
+    return;
+  }
 
-  //set output buffer to 0
-  memset(out, 0, samples * m_outChannels * m_inSampleSize);
+  CheckBufferSize((m_outChannels + 1) * PCM_REMAP_BLOCK * sizeof(float));
+  const float *planes[PCM_MAX_CH];
+  for (unsigned int done = 0; done < samples; done += PCM_REMAP_BLOCK)
+  {
+    for (unsigned int ch = 0; ch < m_inChannels; ch++)
+      planes[ch] = in[ch] + done;
+    RemapBlock(planes, out + done * m_outChannels, std::min(samples - done, (unsigned int)PCM_REMAP_BLOCK), gain);
+  }
+}
 
-  //set intermediate buffer to 0
-  memset(m_buf, 0, m_bufsize);
+void CPCMRemap::RemapBlock(const float* const* in, int16_t* out, unsigned int samples, float gain)
+{
+  ProcessInput(in, samples, gain);
+  ProcessLimiter(samples, gain);
+  ProcessOutput(out, samples);
+}
 
-  ProcessInput(data, out, samples, gain);
-  //AddGain(m_buf, samples * m_outChannels, gain);
-  //ProcessLimiter(samples, gain);
-  ProcessOutput(out, samples, gain);
+bool CPCMRemap::CanRemap()
+{
+  return (m_inSet && m_outSet);
 }
 
 void CPCMRemap::CheckBufferSize(int size)
@@ -538,72 +614,27 @@ void CPCMRemap::CheckBufferSize(int size)
   }
 }
 
-void CPCMRemap::ProcessInput(void* data, void* out, unsigned int samples, float gain)
+/* mixes one block into the output planes at the start of m_buf, the gain is folded into the matrix */
+void CPCMRemap::ProcessInput(const float* const* in, unsigned int samples, float gain)
 {
-  for (unsigned int ch = 0; ch < m_outChannels; ch++)
+  if (gain != m_mixGain)
   {
-    struct PCMMapInfo *info = m_lookupMap[m_outMap[ch]];
-    if (info->channel == PCM_INVALID)
-      continue;
-
-    if (info->copy && gain == 1.0f) //do direct copy
-    {
-      uint8_t* src = (uint8_t*)data + info->in_offset;
-      uint8_t* dst = (uint8_t*)out  + ch * m_inSampleSize;
-      uint8_t* dstend = dst + samples * m_outStride;
-      while (dst < dstend)
-      {
-        *(float*)dst = *(float*)src;
-        src += m_inStride;
-        dst += m_outStride;
-      }
-    }
-    else //needs some volume change or mixing, put into intermediate buffer
-    {
-      for(; info->channel != PCM_INVALID; info++)
-      {
-        uint8_t* src = (uint8_t*)data + info->in_offset;
-        float*   dst = m_buf + ch;
-        float*   dstend = dst + samples * m_outChannels;
-        while (dst < dstend)
-        {
-          *dst += (float)(*(float*)src) * info->level;
-          src += m_inStride;
-          dst += m_outChannels;
-        }
-      }
-    }
+    for (unsigned int i = 0; i < m_outChannels * m_inChannels; i++)
+      m_mixMatrix[i] = m_matrix[i] * gain;
+    m_mixGain = gain;
   }
-}
 
-void CPCMRemap::AddGain(float* buf, unsigned int samples, float gain)
-{
-  if (gain != 1.0f) //needs a gain change
-  {
-    float* ptr = m_buf;
-    float* end = m_buf + samples;
-    while (ptr < end)
-      *(ptr++) *= gain;
-  }
+  float *planes[PCM_MAX_CH];
+  for (unsigned int ch = 0; ch < m_outChannels; ch++)
+    planes[ch] = m_buf + ch * PCM_REMAP_BLOCK;
+
+  pcm_mix(planes, m_outChannels, in, m_inChannels, m_mixMatrix, samples);
 }
 
 void CPCMRemap::ProcessLimiter(unsigned int samples, float gain)
 {
   //check total gain for each output channel
-  float highestgain = 1.0f;
-  for (unsigned int ch = 0; ch < m_outChannels; ch++)
-  {
-    struct PCMMapInfo *info = m_lookupMap[m_outMap[ch]];
-    if (info->channel == PCM_INVALID)
-      continue;
-
-    float chgain = 0.0f;
-    for(; info->channel != PCM_INVALID; info++)
-      chgain += info->level * gain;
-
-    if (chgain > highestgain)
-      highestgain = chgain;
-  }
+  float highestgain = std::max(1.0f, m_levelSum * gain);
 
   m_attenuationMin = 1.0f;
 
@@ -618,16 +649,24 @@ void CPCMRemap::ProcessLimiter(unsigned int samples, float gain)
       m_limiterEnabled = true;
     }
 
+    float *planes[PCM_MAX_CH];
+    for (unsigned int ch = 0; ch < m_outChannels; ch++)
+      planes[ch] = m_buf + ch * PCM_REMAP_BLOCK;
+
+    //for each collection of samples, get the highest absolute value
+    float *gains = m_buf + m_outChannels * PCM_REMAP_BLOCK;
+    float peak = pcm_peak(gains, planes, m_outChannels, samples);
+
+    //nothing clips and nothing to hold or release, leave the block alone
+    if (m_attenuation == 1.0f && m_holdCounter == 0 && peak <= 1.0f)
+    {
+      m_attenuationInc = 0.0f;
+      return;
+    }
+
     for (unsigned int i = 0; i < samples; i++)
     {
-      //for each collection of samples, get the highest absolute value
-      float maxAbs = 0.0f;
-      for (unsigned int outch = 0; outch < m_outChannels; outch++)
-      {
-        float absval = fabs(m_buf[i * m_outChannels + outch]) / 32768.0f;
-        if (maxAbs < absval)
-          maxAbs = absval;
-      }
+      float maxAbs = gains[i];
 
       //if attenuatedAbs is higher than 1.0f, audio is clipping
       float attenuatedAbs = maxAbs * m_attenuation;
@@ -640,18 +679,17 @@ void CPCMRemap::ProcessLimiter(unsigned int samples, float gain)
         //value to add to m_attenuation to make it 1.0f
         m_attenuationInc = 1.0f - m_attenuation;
         //amount of samples to hold m_attenuation
-        m_holdCounter = MathUtils::round_int(m_sampleRate * 0.025f);
+        m_holdCounter = m_holdSamples;
       }
       else if (m_attenuation < 1.0f && attenuatedAbs > 0.95f)
       {
         //if we're attenuating and we get within 5% of clipping, hold m_attenuation
         m_attenuationInc = 1.0f - m_attenuation;
-        m_holdCounter = MathUtils::round_int(m_sampleRate * 0.025f);
+        m_holdCounter = m_holdSamples;
       }
 
-      //apply attenuation
-      for (unsigned int outch = 0; outch < m_outChannels; outch++)
-        m_buf[i * m_outChannels + outch] *= m_attenuation;
+      //attenuation of this sample, applied to all channels below
+      gains[i] = m_attenuation;
 
       if (m_holdCounter)
       {
@@ -661,7 +699,7 @@ void CPCMRemap::ProcessLimiter(unsigned int samples, float gain)
       else if (m_attenuationInc > 0.0f)
       {
         //move m_attenuation to 1.0 in g_advancedSettings.m_limiterRelease seconds
-        m_attenuation += m_attenuationInc / m_sampleRate / 0.1f;
+        m_attenuation += m_attenuationInc * m_releaseScale;
         if (m_attenuation > 1.0f)
         {
           m_attenuation = 1.0f;
@@ -669,6 +707,8 @@ void CPCMRemap::ProcessLimiter(unsigned int samples, float gain)
         }
       }
     }
+
+    pcm_scale(planes, m_outChannels, gains, samples);
   }
   else
   {
@@ -685,51 +725,16 @@ void CPCMRemap::ProcessLimiter(unsigned int samples, float gain)
   }
 }
 
-void CPCMRemap::ProcessOutput(void* out, unsigned int samples, float gain)
+void CPCMRemap::ProcessOutput(int16_t* out, unsigned int samples)
 {
-  //copy from intermediate buffer to output
+  //interleave, clip and round the output planes
+  const float *planes[PCM_MAX_CH];
   for (unsigned int ch = 0; ch < m_outChannels; ch++)
-  {
-    struct PCMMapInfo *info = m_lookupMap[m_outMap[ch]];
-    if (info->channel == PCM_INVALID)
-      continue;
+    planes[ch] = m_buf + ch * PCM_REMAP_BLOCK;
 
-    if (!info->copy || gain != 1.0f)
-    {
-      float* src = m_buf + ch;
-      uint8_t* dst = (uint8_t*)out + ch * m_inSampleSize;
-      uint8_t* dstend = dst + samples * m_outStride;
-
-      while(dst < dstend)
-      {
-        *(float*)dst = MathUtils::round_int(std::min(std::max(*src, -1.0f), 1.0f));
-        src += m_outChannels;
-        dst += m_outStride;
-      }
-    }
-  }
+  pcm_planar_to_s16(out, planes, m_outChannels, samples);
 }
 
-bool CPCMRemap::CanRemap()
-{
-  return (m_inSet && m_outSet);
-}
-
-int CPCMRemap::InBytesToFrames(int bytes)
-{
-  return bytes / m_inSampleSize / m_inChannels;
-}
-
-int CPCMRemap::FramesToOutBytes(int frames)
-{
-  return frames * m_inSampleSize * m_outChannels;
-}
-
-int CPCMRemap::FramesToInBytes(int frames)
-{
-  return frames * m_inSampleSize * m_inChannels;
-}
-#endif
 CStdString CPCMRemap::PCMChannelStr(enum PCMChannels ename)
 {
   const char* PCMChannelName[] =
@@ -801,11 +806,14 @@ void CPCMRemap::GetDownmixMatrix(float *downmix)
 
   for (unsigned int ch = 0; ch < m_outChannels; ch++)
   {
+    if (m_outMap[ch] == PCM_INVALID)
+      continue;
+
     struct PCMMapInfo *info = m_lookupMap[m_outMap[ch]];
     if (info->channel == PCM_INVALID)
       continue;
 
     for(; info->channel != PCM_INVALID; info++)
-      downmix[8*ch + (info->in_offset>>1)] = info->level;
+      downmix[8*ch + (info->in_offset>>1)] += info->level;
   }
 }
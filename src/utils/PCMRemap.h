@@ -104,6 +104,10 @@ protected:
   struct PCMMapInfo  m_lookupMap[PCM_MAX_CH + 1][PCM_MAX_CH + 1];
   int                m_counts[PCM_MAX_CH];
 
+  float              m_matrix[PCM_MAX_CH * PCM_MAX_CH];    //!< dense out x in levels from m_lookupMap
+  float              m_mixMatrix[PCM_MAX_CH * PCM_MAX_CH]; //!< m_matrix times m_mixGain
+  float              m_mixGain;
+  float              m_levelSum;                           //!< sum of the levels of the loudest output
   float*             m_buf;
   int                m_bufsize;
   float              m_attenuation;
@@ -111,6 +115,8 @@ protected:
   float              m_attenuationMin; //lowest attenuation value during a call of Remap(), used for the codec info
   float              m_sampleRate;
   unsigned int       m_holdCounter;
+  unsigned int       m_holdSamples;
+  float              m_releaseScale;
   bool               m_limiterEnabled;
   bool               m_dontnormalize;
 
@@ -122,11 +128,12 @@ protected:
   CStdString         PCMChannelStr(enum PCMChannels ename);
   CStdString         PCMLayoutStr(enum PCMLayout ename);
 
+  void               BuildMatrix();
   void               CheckBufferSize(int size);
-  void               ProcessInput(void* data, void* out, unsigned int samples, float gain);
-  void               AddGain(float* buf, unsigned int samples, float gain);
+  void               RemapBlock(const float* const* in, int16_t* out, unsigned int samples, float gain);
+  void               ProcessInput(const float* const* in, unsigned int samples, float gain);
   void               ProcessLimiter(unsigned int samples, float gain);
-  void               ProcessOutput(void* out, unsigned int samples, float gain);
+  void               ProcessOutput(int16_t* out, unsigned int samples);
 
 public:
 
@@ -136,14 +143,13 @@ public:
   void Reset();
   enum PCMChannels *SetInputFormat (unsigned int channels, enum PCMChannels *channelMap, unsigned int sampleSize, unsigned int sampleRate, enum PCMLayout channelLayout, bool dontnormalize);
   void SetOutputFormat(unsigned int channels, enum PCMChannels *channelMap, bool ignoreLayout = false);
-#if 0
-  void Remap(void *data, void *out, unsigned int samples, long drc);
-  void Remap(void *data, void *out, unsigned int samples, float gain = 1.0f);
+  /* software mixing for renderers without the Broadcom audio_mixer: the
+     input (interleaved S16 or planar float) is mixed with the dense matrix
+     in blocks, limited and written as interleaved S16 with the output
+     channel count. out must hold samples * output channels values */
+  void Remap(const int16_t *in, int16_t *out, unsigned int samples, float gain = 1.0f);
+  void Remap(const float* const* in, int16_t *out, unsigned int samples, float gain = 1.0f);
   bool CanRemap();
-  int  InBytesToFrames (int bytes );
-  int  FramesToOutBytes(int frames);
-  int  FramesToInBytes (int frames);
-#endif
   float GetCurrentAttenuation() { return m_attenuationMin; }
   void               GetDownmixMatrix(float *downmix);
 };
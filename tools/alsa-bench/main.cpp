@@ -0,0 +1,459 @@
+// Drives OMX.alsa.audio_render (src/OMXAlsa.cpp) the way COMXAudio does,
+// without the rest of the player: PCM parameters and OMX_IndexConfigAlsaLatency
+// are set, a clock buffer gives the timescale, and a multi tone S16 signal is
+// fed through the component's input buffers until EOS. Prints a JSON report
+// with the buffer and period the device accepted, the write method, the
+// latency the sink measured while playing, xruns and cpu time per second of
+// audio.
+//
+// No sound hardware needed: ALSA's null plugin takes anything, e.g.
+//   ./alsa-bench -D null -b 20 -p 5 -m
+// and the file plugin records what the sink wrote, which -w compares with
+// the signal sent (bit exact unless the sink resampled):
+//   ./alsa-bench -D "file:'o.raw'" -w o.raw
+// Device names are limited to 15 characters by the OMX destination config.
+// Needs ALSA, libswresample and the VideoCore IL headers to build.
+
+#include "BenchUtils.h"
+#include "OMXAlsa.h"
+#include "utils/log.h"
+
+#include <IL/OMX_Core.h>
+#include <IL/OMX_Component.h>
+#include <IL/OMX_Broadcom.h>
+
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct Options
+{
+  std::string   device;
+  unsigned int  rate;
+  unsigned int  channels;
+  unsigned int  buffer_ms;
+  unsigned int  period_ms;
+  bool          mmap;
+  double        scale;
+  double        seconds;
+  std::string   compare;
+};
+
+// what the component reports through its callbacks
+struct Events
+{
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+  int             commands;
+  bool            error;
+  bool            eos;
+  std::vector<OMX_BUFFERHEADERTYPE*> free_buffers;
+};
+
+static Events g_events;
+
+static OMX_ERRORTYPE OnEvent(OMX_HANDLETYPE, OMX_PTR, OMX_EVENTTYPE event, OMX_U32 data1, OMX_U32 data2, OMX_PTR)
+{
+  pthread_mutex_lock(&g_events.lock);
+  if(event == OMX_EventCmdComplete)
+    g_events.commands++;
+  else if(event == OMX_EventError && data1 != (OMX_U32)OMX_ErrorPortUnpopulated)
+  {
+    fprintf(stderr, "component error 0x%08x %u\n", (unsigned int)data1, (unsigned int)data2);
+    g_events.error = true;
+  }
+  else if(event == OMX_EventBufferFlag && (data2 & OMX_BUFFERFLAG_EOS))
+    g_events.eos = true;
+  pthread_cond_broadcast(&g_events.cond);
+  pthread_mutex_unlock(&g_events.lock);
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE OnEmptyBufferDone(OMX_HANDLETYPE, OMX_PTR, OMX_BUFFERHEADERTYPE *buffer)
+{
+  pthread_mutex_lock(&g_events.lock);
+  if(buffer->nInputPortIndex == 0)
+    g_events.free_buffers.push_back(buffer);
+  pthread_cond_broadcast(&g_events.cond);
+  pthread_mutex_unlock(&g_events.lock);
+  return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE OnFillBufferDone(OMX_HANDLETYPE, OMX_PTR, OMX_BUFFERHEADERTYPE *)
+{
+  return OMX_ErrorNone;
+}
+
+static double CpuSeconds()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+}
+
+template <class T> static void InitStructure(T &s)
+{
+  memset(&s, 0, sizeof(s));
+  s.nSize = sizeof(s);
+  s.nVersion.nVersion = OMX_VERSION;
+}
+
+// false on an error event or after 5 s
+static bool WaitFor(bool (*done)(int), int arg)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_sec += 5;
+  pthread_mutex_lock(&g_events.lock);
+  while(!done(arg) && !g_events.error)
+  {
+    if(pthread_cond_timedwait(&g_events.cond, &g_events.lock, &ts) != 0)
+      break;
+  }
+  bool ok = done(arg) && !g_events.error;
+  pthread_mutex_unlock(&g_events.lock);
+  return ok;
+}
+
+static bool CommandsDone(int n) { return g_events.commands >= n; }
+static bool EOSDone(int)        { return g_events.eos; }
+
+static bool SetState(OMX_HANDLETYPE handle, OMX_STATETYPE state, std::vector<OMX_BUFFERHEADERTYPE*> *buffers,
+                     const OMX_PARAM_PORTDEFINITIONTYPE *ports)
+{
+  int n = g_events.commands + 1;
+  if(OMX_SendCommand(handle, OMX_CommandStateSet, state, NULL) != OMX_ErrorNone)
+    return false;
+  // buffers are allocated for Loaded -> Idle and freed for Idle -> Loaded.
+  // The component takes them once its thread started the transition, ones
+  // freed before that make it report OMX_ErrorPortUnpopulated
+  if(state == OMX_StateIdle && buffers->empty())
+  {
+    for(int p = 0; p < 2; p++)
+    {
+      for(OMX_U32 i = 0; i < ports[p].nBufferCountActual; i++)
+      {
+        OMX_BUFFERHEADERTYPE *buffer = NULL;
+        OMX_ERRORTYPE err;
+        for(int tries = 0; tries < 1000; tries++)
+        {
+          err = OMX_AllocateBuffer(handle, &buffer, ports[p].nPortIndex, NULL, ports[p].nBufferSize);
+          if(err != OMX_ErrorIncorrectStateOperation)
+            break;
+          usleep(1000);
+        }
+        if(err != OMX_ErrorNone)
+          return false;
+        buffers->push_back(buffer);
+      }
+    }
+  }
+  else if(state == OMX_StateLoaded)
+  {
+    for(size_t i = 0; i < buffers->size(); i++)
+      OMX_FreeBuffer(handle, (*buffers)[i]->nInputPortIndex, (*buffers)[i]);
+    buffers->clear();
+  }
+  return WaitFor(CommandsDone, n);
+}
+
+static int16_t Sample(uint64_t frame, unsigned int channel, unsigned int rate)
+{
+  return (int16_t)lrint(8000.0 * sin(2.0 * M_PI * 220.0 * (channel + 1) * frame / rate));
+}
+
+struct Result
+{
+  bool          ok;
+  double        wall_seconds;
+  double        cpu_seconds;
+  double        latency_avg_ms;
+  double        latency_max_ms;
+  unsigned int  samples;
+  std::string   compare;
+  OMX_CONFIG_ALSALATENCYTYPE latency;
+};
+
+static bool Run(const Options &options, Result &result)
+{
+  OMX_CALLBACKTYPE callbacks = { OnEvent, OnEmptyBufferDone, OnFillBufferDone };
+  OMX_HANDLETYPE handle = NULL;
+  if(OMXALSA_GetHandle(&handle, (OMX_STRING)"OMX.alsa.audio_render", NULL, &callbacks) != OMX_ErrorNone)
+  {
+    fprintf(stderr, "no OMX.alsa.audio_render\n");
+    return false;
+  }
+
+  OMX_AUDIO_PARAM_PCMMODETYPE pcm;
+  InitStructure(pcm);
+  pcm.nPortIndex    = 0;
+  pcm.nChannels     = options.channels;
+  pcm.eNumData      = OMX_NumericalDataSigned;
+  pcm.eEndian       = OMX_EndianLittle;
+  pcm.bInterleaved  = OMX_TRUE;
+  pcm.nBitPerSample = 16;
+  pcm.nSamplingRate = options.rate;
+  pcm.ePCMMode      = OMX_AUDIO_PCMModeLinear;
+
+  OMX_CONFIG_BRCMAUDIODESTINATIONTYPE dest;
+  InitStructure(dest);
+  strncpy((char *)dest.sName, options.device.c_str(), sizeof(dest.sName) - 1);
+
+  OMX_CONFIG_ALSALATENCYTYPE latency;
+  InitStructure(latency);
+  latency.nBufferTime = options.buffer_ms * 1000;
+  latency.nPeriodTime = options.period_ms * 1000;
+  latency.bMmap       = options.mmap ? OMX_TRUE : OMX_FALSE;
+
+  OMX_PARAM_PORTDEFINITIONTYPE ports[2];
+  for(int p = 0; p < 2; p++)
+  {
+    InitStructure(ports[p]);
+    ports[p].nPortIndex = p;
+  }
+
+  std::vector<OMX_BUFFERHEADERTYPE*> buffers;
+  bool ok = OMX_SetParameter(handle, OMX_IndexParamAudioPcm, &pcm) == OMX_ErrorNone &&
+            OMX_SetConfig(handle, OMX_IndexConfigBrcmAudioDestination, &dest) == OMX_ErrorNone &&
+            OMX_SetConfig(handle, OMX_IndexConfigAlsaLatency, &latency) == OMX_ErrorNone &&
+            OMX_GetParameter(handle, OMX_IndexParamPortDefinition, &ports[0]) == OMX_ErrorNone &&
+            OMX_GetParameter(handle, OMX_IndexParamPortDefinition, &ports[1]) == OMX_ErrorNone &&
+            SetState(handle, OMX_StateIdle, &buffers, ports);
+
+  for(size_t i = 0; ok && i < buffers.size(); i++)
+  {
+    if(buffers[i]->nInputPortIndex == 0)
+      g_events.free_buffers.push_back(buffers[i]);
+  }
+
+  double start = Now(), cpu_start = CpuSeconds();
+  ok = ok && SetState(handle, OMX_StateExecuting, &buffers, ports);
+
+  // without a clock tunnel the sink waits for a timescale from its clock port
+  if(ok)
+  {
+    for(size_t i = 0; i < buffers.size(); i++)
+    {
+      if(buffers[i]->nInputPortIndex != 1)
+        continue;
+      OMX_TIME_MEDIATIMETYPE *media_time = (OMX_TIME_MEDIATIMETYPE *)buffers[i]->pBuffer;
+      InitStructure(*media_time);
+      media_time->eState = OMX_TIME_ClockStateRunning;
+      media_time->xScale = (OMX_S32)lrint(options.scale * 0x10000);
+      buffers[i]->nFilledLen = sizeof(*media_time);
+      ok = OMX_EmptyThisBuffer(handle, buffers[i]) == OMX_ErrorNone;
+      break;
+    }
+  }
+
+  const unsigned int frame_size = options.channels * 2;
+  const uint64_t total_frames = (uint64_t)(options.seconds * options.rate);
+  uint64_t frame = 0;
+  double latency_sum = 0;
+  std::vector<int16_t> sent;
+  if(!options.compare.empty())
+    sent.reserve(total_frames * options.channels);
+
+  while(ok && frame < total_frames)
+  {
+    pthread_mutex_lock(&g_events.lock);
+    while(g_events.free_buffers.empty() && !g_events.error)
+      pthread_cond_wait(&g_events.cond, &g_events.lock);
+    OMX_BUFFERHEADERTYPE *buffer = NULL;
+    if(!g_events.error)
+    {
+      buffer = g_events.free_buffers.back();
+      g_events.free_buffers.pop_back();
+    }
+    pthread_mutex_unlock(&g_events.lock);
+    if(!buffer)
+    {
+      ok = false;
+      break;
+    }
+
+    unsigned int frames = std::min((uint64_t)(buffer->nAllocLen / frame_size), total_frames - frame);
+    int16_t *out = (int16_t *)buffer->pBuffer;
+    for(unsigned int f = 0; f < frames; f++)
+    {
+      for(unsigned int c = 0; c < options.channels; c++)
+        *out++ = Sample(frame + f, c, options.rate);
+    }
+    if(!options.compare.empty())
+      sent.insert(sent.end(), (int16_t *)buffer->pBuffer, out);
+    frame += frames;
+
+    buffer->nOffset    = 0;
+    buffer->nFilledLen = frames * frame_size;
+    buffer->nFlags     = frame == frames ? OMX_BUFFERFLAG_STARTTIME : 0;
+    if(frame >= total_frames)
+      buffer->nFlags |= OMX_BUFFERFLAG_EOS;
+    ok = OMX_EmptyThisBuffer(handle, buffer) == OMX_ErrorNone;
+
+    OMX_CONFIG_ALSALATENCYTYPE now;
+    InitStructure(now);
+    if(ok && OMX_GetConfig(handle, OMX_IndexConfigAlsaLatency, &now) == OMX_ErrorNone && now.nSampleRate)
+    {
+      latency_sum += 1000.0 * now.nDelay / now.nSampleRate;
+      result.samples++;
+    }
+  }
+  ok = ok && WaitFor(EOSDone, 0);
+
+  result.wall_seconds = Now() - start;
+  result.cpu_seconds  = CpuSeconds() - cpu_start;
+  InitStructure(result.latency);
+  if(OMX_GetConfig(handle, OMX_IndexConfigAlsaLatency, &result.latency) == OMX_ErrorNone && result.latency.nSampleRate)
+  {
+    result.latency_avg_ms = result.samples ? latency_sum / result.samples : 0;
+    result.latency_max_ms = 1000.0 * result.latency.nDelayMax / result.latency.nSampleRate;
+  }
+
+  OMX_STATETYPE state = OMX_StateInvalid;
+  OMX_GetState(handle, &state);
+  if(state == OMX_StateExecuting)
+    SetState(handle, OMX_StateIdle, &buffers, ports) && SetState(handle, OMX_StateLoaded, &buffers, ports);
+  else if(state == OMX_StateIdle)
+    SetState(handle, OMX_StateLoaded, &buffers, ports);
+  for(size_t i = 0; i < buffers.size(); i++)
+    OMX_FreeBuffer(handle, buffers[i]->nInputPortIndex, buffers[i]);
+  OMXALSA_FreeHandle(handle);
+
+  // the file plugin wrote exactly what the sink handed to ALSA
+  if(ok && !options.compare.empty())
+  {
+    FILE *fp = fopen(options.compare.c_str(), "rb");
+    std::vector<int16_t> written(sent.size() + 1);
+    size_t n = fp ? fread(&written[0], sizeof(int16_t), written.size(), fp) : 0;
+    if(fp)
+      fclose(fp);
+    if(!fp)
+      result.compare = "unreadable";
+    else if(n != sent.size())
+      result.compare = "length differs";
+    else if(memcmp(&written[0], &sent[0], n * sizeof(int16_t)) != 0)
+      result.compare = "samples differ";
+    else
+      result.compare = "identical";
+    ok = result.compare == "identical" || result.latency.bResampling == OMX_TRUE;
+  }
+  return ok;
+}
+
+static void Usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-D device] [-r rate] [-c channels] [-b ms] [-p ms] [-m] [-s scale] [-t seconds] [-w file] [-v]\n", name);
+  fprintf(stderr, "  -D  ALSA device, default null\n");
+  fprintf(stderr, "  -r  sample rate, default 48000\n");
+  fprintf(stderr, "  -c  channels, default 2\n");
+  fprintf(stderr, "  -b  device buffer in ms, default 200\n");
+  fprintf(stderr, "  -p  period in ms, default a quarter of the buffer\n");
+  fprintf(stderr, "  -m  write through mmap\n");
+  fprintf(stderr, "  -s  clock timescale, anything but 1 makes the sink compensate, default 1\n");
+  fprintf(stderr, "  -t  seconds of audio, default 5\n");
+  fprintf(stderr, "  -w  compare the file a file plugin device wrote with the signal\n");
+  fprintf(stderr, "  -v  log what the component logs\n");
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  options.device    = "null";
+  options.rate      = 48000;
+  options.channels  = 2;
+  options.buffer_ms = 0;
+  options.period_ms = 0;
+  options.mmap      = false;
+  options.scale     = 1.0;
+  options.seconds   = 5.0;
+
+  int opt;
+  while((opt = getopt(argc, argv, "D:r:c:b:p:ms:t:w:vh")) != -1)
+  {
+    switch(opt)
+    {
+      case 'D':
+        options.device = optarg;
+        break;
+      case 'r':
+        options.rate = std::max(8000, atoi(optarg));
+        break;
+      case 'c':
+        options.channels = std::min(std::max(atoi(optarg), 1), 8);
+        break;
+      case 'b':
+        options.buffer_ms = std::max(0, atoi(optarg));
+        break;
+      case 'p':
+        options.period_ms = std::max(0, atoi(optarg));
+        break;
+      case 'm':
+        options.mmap = true;
+        break;
+      case 's':
+        options.scale = atof(optarg);
+        break;
+      case 't':
+        options.seconds = atof(optarg);
+        break;
+      case 'w':
+        options.compare = optarg;
+        break;
+      case 'v':
+        SetBenchLogLevel(LOGDEBUG);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  if(options.device.size() > 15)
+  {
+    fprintf(stderr, "device name longer than 15 characters, define it in ~/.asoundrc\n");
+    return 1;
+  }
+
+  pthread_mutex_init(&g_events.lock, NULL);
+  pthread_cond_init(&g_events.cond, NULL);
+  g_events.commands = 0;
+  g_events.error = false;
+  g_events.eos = false;
+
+  Result result;
+  memset(&result.latency, 0, sizeof(result.latency));
+  result.wall_seconds = result.cpu_seconds = result.latency_avg_ms = result.latency_max_ms = 0;
+  result.samples = 0;
+  result.ok = Run(options, result);
+
+  const OMX_CONFIG_ALSALATENCYTYPE &l = result.latency;
+  double rate = l.nSampleRate ? l.nSampleRate : options.rate;
+  printf("{\n");
+  printf("  \"device\": \"%s\",\n", options.device.c_str());
+  printf("  \"ok\": %s,\n", result.ok ? "true" : "false");
+  printf("  \"sample_rate\": %u,\n", (unsigned int)l.nSampleRate);
+  printf("  \"channels\": %u,\n", options.channels);
+  printf("  \"buffer_ms\": %.2f,\n", 1000.0 * l.nBufferSize / rate);
+  printf("  \"period_ms\": %.2f,\n", 1000.0 * l.nPeriodSize / rate);
+  printf("  \"mmap\": %s,\n", l.bMmapActive == OMX_TRUE ? "true" : "false");
+  printf("  \"resampling\": %s,\n", l.bResampling == OMX_TRUE ? "true" : "false");
+  printf("  \"audio_seconds\": %.3f,\n", options.seconds);
+  printf("  \"wall_seconds\": %.3f,\n", result.wall_seconds);
+  printf("  \"cpu_per_audio_second\": %.5f,\n", options.seconds > 0 ? result.cpu_seconds / options.seconds : 0);
+  printf("  \"latency_avg_ms\": %.2f,\n", result.latency_avg_ms);
+  printf("  \"latency_max_ms\": %.2f,\n", result.latency_max_ms);
+  printf("  \"xruns\": %u", (unsigned int)l.nXruns);
+  if(!options.compare.empty())
+    printf(",\n  \"compare\": \"%s\"", result.compare.c_str());
+  printf("\n}\n");
+
+  return result.ok ? 0 : 1;
+}
@@ -0,0 +1,339 @@
+// Micro-benchmark for the H.264 bitstream helpers in src/BitstreamUtils.cpp.
+//
+// Takes raw Annex B H.264 streams, e.g. captured with
+//   ffmpeg -i movie.mp4 -c:v copy -bsf:v h264_mp4toannexb -an movie.h264
+// splits them into access units and reports MB/s of input for every start
+// code scanner and conversion mode CBitstreamConverter uses. Builds on any
+// Linux box, no OMX or ffmpeg needed.
+
+#include "BenchUtils.h"
+#include "BitstreamUtils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+typedef std::vector<uint8_t> Packet;
+
+static bool ReadFile(const char *path, Packet &data)
+{
+  FILE *fp = fopen(path, "rb");
+  if(!fp)
+    return false;
+
+  uint8_t chunk[65536];
+  size_t  got;
+  while((got = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    data.insert(data.end(), chunk, chunk + got);
+  fclose(fp);
+  return !data.empty();
+}
+
+// cuts the stream into access units: a new one starts with the first slice
+// of a picture or with parameter sets/SEI/AUD after a slice
+static void SplitAccessUnits(const Packet &data, std::vector<Packet> &units, Packet &sps_pps)
+{
+  const uint8_t *begin = &data[0];
+  const uint8_t *end   = begin + data.size();
+  const uint8_t *p     = bitstream_find_startcode(begin, end);
+  const uint8_t *unit  = p;
+  bool           vcl   = false;
+
+  while(p < end)
+  {
+    const uint8_t *nal = p + 3;
+    const uint8_t *next = bitstream_find_startcode(nal, end);
+    // a zero before the next start code belongs to it
+    const uint8_t *nal_end = next;
+    while(nal_end > nal && nal_end < end && nal_end[-1] == 0)
+      nal_end--;
+
+    if(nal < end)
+    {
+      int type = nal[0] & 0x1f;
+      bool is_vcl = type == 1 || type == 5;
+      bool first_slice = is_vcl && nal + 1 < end && (nal[1] & 0x80);
+
+      if(vcl && (first_slice || type == 6 || type == 7 || type == 8 || type == 9))
+      {
+        units.push_back(Packet(unit, p));
+        unit = p;
+        vcl  = false;
+      }
+      vcl |= is_vcl;
+
+      if(type == 7 || type == 8)
+      {
+        static const uint8_t header[4] = { 0, 0, 0, 1 };
+        sps_pps.insert(sps_pps.end(), header, header + 4);
+        sps_pps.insert(sps_pps.end(), nal, nal_end);
+      }
+    }
+    p = next;
+  }
+  if(unit < end)
+    units.push_back(Packet(unit, end));
+}
+
+// per NAL realloc as CBitstreamConverter did it before, for comparison
+static void LegacyAllocAndCopy(uint8_t **poutbuf, int *poutbuf_size,
+  const uint8_t *sps_pps, uint32_t sps_pps_size, const uint8_t *in, uint32_t in_size)
+{
+  uint32_t offset = *poutbuf_size;
+  uint8_t nal_header_size = offset ? 3 : 4;
+
+  *poutbuf_size += sps_pps_size + in_size + nal_header_size;
+  *poutbuf = (uint8_t*)realloc(*poutbuf, *poutbuf_size);
+  if (sps_pps)
+    memcpy(*poutbuf + offset, sps_pps, sps_pps_size);
+
+  memcpy(*poutbuf + sps_pps_size + nal_header_size + offset, in, in_size);
+  uint8_t *header = *poutbuf + offset + sps_pps_size;
+  if (!offset)
+    *header++ = 0;
+  header[0] = 0;
+  header[1] = 0;
+  header[2] = 1;
+}
+
+static bool LegacyAvccToAnnexb(const uint8_t *buf, int size, const uint8_t *sps_pps, int sps_pps_size,
+  uint8_t *first_idr, uint8_t **out, int *out_size)
+{
+  const uint8_t *end = buf + size;
+  do
+  {
+    if(end - buf < 4)
+      return false;
+    uint32_t nal_size = (uint32_t)buf[0] << 24 | buf[1] << 16 | buf[2] << 8 | buf[3];
+    buf += 4;
+    if(nal_size > (uint32_t)(end - buf))
+      return false;
+    int type = *buf & 0x1f;
+    if(*first_idr && type == 5)
+    {
+      LegacyAllocAndCopy(out, out_size, sps_pps, sps_pps_size, buf, nal_size);
+      *first_idr = 0;
+    }
+    else
+    {
+      LegacyAllocAndCopy(out, out_size, NULL, 0, buf, nal_size);
+      if(!*first_idr && type == 1)
+        *first_idr = 1;
+    }
+    buf += nal_size;
+  } while(buf < end);
+  return true;
+}
+
+struct Bench
+{
+  const char *name;
+  size_t      bytes;    // input bytes per pass
+  int         passes;
+  double      seconds;
+};
+
+static void Report(const Bench &bench)
+{
+  double mb = (double)bench.bytes * bench.passes / (1024.0 * 1024.0);
+  printf("  %-26s %10.1f MB/s  (%d passes)\n", bench.name, bench.seconds > 0 ? mb / bench.seconds : 0.0, bench.passes);
+}
+
+// runs pass() until min_seconds have gone by
+template<typename F> static Bench Run(const char *name, size_t bytes, double min_seconds, F pass)
+{
+  Bench bench = { name, bytes, 0, 0 };
+  double start = Now();
+  do
+  {
+    pass();
+    bench.passes++;
+    bench.seconds = Now() - start;
+  } while(bench.seconds < min_seconds);
+  return bench;
+}
+
+static size_t TotalSize(const std::vector<Packet> &packets)
+{
+  size_t size = 0;
+  for(size_t i = 0; i < packets.size(); i++)
+    size += packets[i].size();
+  return size;
+}
+
+static int BenchFile(const char *path, double min_seconds)
+{
+  Packet data;
+  if(!ReadFile(path, data))
+  {
+    fprintf(stderr, "could not read %s\n", path);
+    return 1;
+  }
+
+  std::vector<Packet> annexb;
+  Packet sps_pps;
+  SplitAccessUnits(data, annexb, sps_pps);
+  if(annexb.empty())
+  {
+    fprintf(stderr, "%s: no NAL units found\n", path);
+    return 1;
+  }
+
+  // avcC packets to feed the other direction, and a sanity check on the way
+  CBitstreamBuffer out;
+  std::vector<Packet> avcc, nal3;
+  bool nal3_ok = true;
+  for(size_t i = 0; i < annexb.size(); i++)
+  {
+    int size = bitstream_annexb_to_avcc(&out, &annexb[i][0], annexb[i].size());
+    if(size <= 0)
+      continue;
+    avcc.push_back(Packet(out.Data(), out.Data() + size));
+
+    Packet p3;
+    for(const uint8_t *p = out.Data(), *end = p + size; p < end; )
+    {
+      uint32_t nal_size = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+      if(nal_size >= (1 << 24))
+        nal3_ok = false;
+      p3.push_back(nal_size >> 16);
+      p3.push_back(nal_size >> 8);
+      p3.push_back(nal_size);
+      p3.insert(p3.end(), p + 4, p + 4 + nal_size);
+      p += 4 + nal_size;
+    }
+    nal3.push_back(p3);
+  }
+
+  // avcC -> Annex B -> avcC has to give back the same bytes
+  CBitstreamBuffer back;
+  uint8_t first_idr = 0;
+  for(size_t i = 0; i < avcc.size(); i++)
+  {
+    int size = bitstream_avcc_to_annexb(&out, &avcc[i][0], avcc[i].size(), 4, NULL, 0, &first_idr);
+    int again = size > 0 ? bitstream_annexb_to_avcc(&back, out.Data(), size) : -1;
+    if(again != (int)avcc[i].size() || memcmp(back.Data(), &avcc[i][0], again) != 0)
+    {
+      fprintf(stderr, "%s: round trip mismatch in access unit %zu\n", path, i);
+      return 1;
+    }
+  }
+
+  printf("%s: %zu bytes, %zu access units, %zu bytes of SPS/PPS\n", path, data.size(), annexb.size(), sps_pps.size());
+
+  const BitstreamScanner scanners[] = { BITSTREAM_SCANNER_C, BITSTREAM_SCANNER_WORD, BITSTREAM_SCANNER_SIMD };
+  size_t expected = 0;
+  for(size_t s = 0; s < sizeof(scanners) / sizeof(scanners[0]); s++)
+  {
+    if(!bitstream_set_scanner(scanners[s]))
+      continue;
+
+    std::string name = std::string("startcode-") + bitstream_get_scanner_name();
+    size_t found = 0;
+    Bench bench = Run(name.c_str(), data.size(), min_seconds, [&]()
+    {
+      found = 0;
+      const uint8_t *end = &data[0] + data.size();
+      for(const uint8_t *p = bitstream_find_startcode(&data[0], end); p < end; p = bitstream_find_startcode(p + 3, end))
+        found++;
+    });
+    if(!expected)
+      expected = found;
+    else if(found != expected)
+      fprintf(stderr, "  %s found %zu start codes, expected %zu\n", name.c_str(), found, expected);
+    Report(bench);
+  }
+  bitstream_set_scanner(BITSTREAM_SCANNER_AUTO);
+
+  Report(Run("annexb-to-avcc", data.size(), min_seconds, [&]()
+  {
+    for(size_t i = 0; i < annexb.size(); i++)
+      bitstream_annexb_to_avcc(&out, &annexb[i][0], annexb[i].size());
+  }));
+
+  size_t avcc_size = TotalSize(avcc);
+  Report(Run("avcc-to-annexb", avcc_size, min_seconds, [&]()
+  {
+    uint8_t first_idr = 1;
+    for(size_t i = 0; i < avcc.size(); i++)
+      bitstream_avcc_to_annexb(&out, &avcc[i][0], avcc[i].size(), 4, sps_pps.empty() ? NULL : &sps_pps[0], sps_pps.size(), &first_idr);
+  }));
+
+  // straight into decoder sized input buffers, like COMXVideo::Decode()
+  std::vector<uint8_t> input(80 * 1024);
+  Report(Run("avcc-to-annexb (scatter)", avcc_size, min_seconds, [&]()
+  {
+    uint8_t first_idr = 1;
+    CBitstreamAnnexBWriter writer;
+    for(size_t i = 0; i < avcc.size(); i++)
+    {
+      if(!writer.Begin(&avcc[i][0], avcc[i].size(), 4, sps_pps.empty() ? NULL : &sps_pps[0], sps_pps.size(), &first_idr))
+        continue;
+      while(!writer.IsDone())
+        writer.Write(&input[0], input.size());
+    }
+  }));
+
+  Report(Run("avcc-to-annexb (realloc)", avcc_size, min_seconds, [&]()
+  {
+    uint8_t first_idr = 1;
+    for(size_t i = 0; i < avcc.size(); i++)
+    {
+      uint8_t *buf = NULL;
+      int size = 0;
+      LegacyAvccToAnnexb(&avcc[i][0], avcc[i].size(), sps_pps.empty() ? NULL : &sps_pps[0], sps_pps.size(), &first_idr, &buf, &size);
+      free(buf);
+    }
+  }));
+
+  if(nal3_ok)
+  {
+    Report(Run("nal3-to-nal4", TotalSize(nal3), min_seconds, [&]()
+    {
+      for(size_t i = 0; i < nal3.size(); i++)
+        bitstream_nal3_to_nal4(&out, &nal3[i][0], nal3[i].size());
+    }));
+  }
+
+  printf("  output buffer grew %u times to %zu bytes\n", out.Grows(), out.Capacity());
+  return 0;
+}
+
+static void Usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-t seconds] file.h264 [file.h264 ...]\n", name);
+  fprintf(stderr, "  -t  minimum run time of every mode, default 1\n");
+}
+
+int main(int argc, char **argv)
+{
+  double min_seconds = 1.0;
+  int opt;
+  while((opt = getopt(argc, argv, "t:h")) != -1)
+  {
+    switch(opt)
+    {
+      case 't':
+        min_seconds = atof(optarg);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(optind >= argc)
+  {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  int ret = 0;
+  for(int i = optind; i < argc; i++)
+    ret |= BenchFile(argv[i], min_seconds);
+  return ret;
+}
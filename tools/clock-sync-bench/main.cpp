@@ -0,0 +1,236 @@
+// Runs several OMXClocks in one OMXClockGroup on the software OMX core, the
+// way the players of a video wall run: every clock component gets its own
+// rate error and a later start than the one before, and one thread per
+// member samples its clock and calls OMXClockGroup::Sync() every 20ms like
+// the engine loop does. Prints a JSON report with the drift of every member
+// against the master, how long it took to get within a frame and how often
+// it was nudged or seeked, and exits with 1 when a follower ends up more than
+// a frame off, so it can run as a check:
+//   ./clock-sync-bench -n 4 -d 500 -t 30
+// -u leaves the group out to show how far the clocks drift on their own.
+// Needs ffmpeg and the VideoCore headers to build, no display or GPU to run.
+
+#include "BenchUtils.h"
+#include "OMXClock.h"
+#include "OMXClockGroup.h"
+#include "OMXCore.h"
+#include "OMXSoftCore.h"
+#include "utils/log.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+struct Options
+{
+  int    members;
+  int    drift_ppm;   // largest rate error, members get spread over +-drift_ppm
+  int    offset_ms;   // start offset of the last member, the others in between
+  double fps;
+  double seconds;
+  bool   group;
+};
+
+struct Member
+{
+  OMXClock  clock;
+  int       drift_ppm;
+  double    offset;     // us the clock starts behind the master
+  double    drift;      // against the master at the end, us
+  pthread_t thread;
+};
+
+static OMXClockGroup     g_group;
+static std::atomic<bool> g_stop(false);
+static Options           g_options;
+
+static void *MemberThread(void *arg)
+{
+  Member *member = (Member *)arg;
+  double frame_time = DVD_TIME_BASE / g_options.fps;
+
+  while(!g_stop)
+  {
+    member->clock.OMXSampleMediaTime();
+    if(g_options.group)
+    {
+      // no decoders to flush, a seek only has to move the clock
+      double seek_time;
+      if(g_group.GetSeek(&member->clock, seek_time))
+        member->clock.OMXMediaTime(seek_time);
+      g_group.Sync(&member->clock, frame_time);
+    }
+    OMXClock::OMXSleep(20);
+  }
+  return NULL;
+}
+
+static bool StartClock(Member &member)
+{
+  OMXSOFT_CONFIG config;
+  OMXSOFT_GetConfig(&config);
+  config.clock_drift_ppm = member.drift_ppm;
+  OMXSOFT_SetConfig(&config);
+
+  OMXClock &clock = member.clock;
+  if(!clock.OMXInitialize())
+    return false;
+  // nothing gets tunneled to the clock here, its ports would hold up Idle
+  clock.GetOMXClock()->DisableAllPorts();
+  if(!clock.OMXStateExecute())
+    return false;
+  clock.OMXSetReferenceClock(false);
+
+  // no decoders to wait for, start the clock by hand at the member's offset
+  OMX_TIME_CONFIG_CLOCKSTATETYPE state;
+  OMX_INIT_STRUCTURE(state);
+  state.eState = OMX_TIME_ClockStateRunning;
+  state.nStartTime = ToOMXTime((int64_t)(DVD_SEC_TO_TIME(1) - member.offset));
+  return clock.GetOMXClock()->SetConfig(OMX_IndexConfigTimeClockState, &state) == OMX_ErrorNone;
+}
+
+static void Usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-n members] [-d ppm] [-o ms] [-f fps] [-t seconds] [-u] [-v]\n", name);
+  fprintf(stderr, "  -n  clocks in the group, the first one is the master, default 3\n");
+  fprintf(stderr, "  -d  largest clock rate error in ppm, default 500\n");
+  fprintf(stderr, "  -o  how much later the last member starts in ms, default 120\n");
+  fprintf(stderr, "  -f  frame rate the members are held to within a frame of, default 25\n");
+  fprintf(stderr, "  -t  seconds to run, default 20\n");
+  fprintf(stderr, "  -u  don't sync, just measure the drift\n");
+  fprintf(stderr, "  -v  log what the clocks log\n");
+}
+
+int main(int argc, char **argv)
+{
+  g_options.members   = 3;
+  g_options.drift_ppm = 500;
+  g_options.offset_ms = 120;
+  g_options.fps       = 25.0;
+  g_options.seconds   = 20.0;
+  g_options.group     = true;
+
+  int opt;
+  while((opt = getopt(argc, argv, "n:d:o:f:t:uvh")) != -1)
+  {
+    switch(opt)
+    {
+      case 'n':
+        g_options.members = std::min(std::max(atoi(optarg), 2), 16);
+        break;
+      case 'd':
+        g_options.drift_ppm = abs(atoi(optarg));
+        break;
+      case 'o':
+        g_options.offset_ms = std::max(0, atoi(optarg));
+        break;
+      case 'f':
+        g_options.fps = std::max(1.0, atof(optarg));
+        break;
+      case 't':
+        g_options.seconds = std::max(1.0, atof(optarg));
+        break;
+      case 'u':
+        g_options.group = false;
+        break;
+      case 'v':
+        SetBenchLogLevel(LOGDEBUG);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  COMXCore core;
+  if(!core.Initialize())
+  {
+    fprintf(stderr, "OMX core failed to initialize\n");
+    return 1;
+  }
+
+  int count = g_options.members;
+  std::vector<Member *> members;
+  bool ok = true;
+  for(int i = 0; i < count && ok; i++)
+  {
+    Member *member = new Member;
+    // master is exact, followers alternate fast/slow up to drift_ppm
+    int step = (i + 1) / 2;
+    int steps = count / 2;
+    member->drift_ppm = i == 0 ? 0 : (i & 1 ? 1 : -1) * g_options.drift_ppm * step / std::max(steps, 1);
+    member->offset = DVD_MSEC_TO_TIME((double)g_options.offset_ms * i / (count - 1));
+    member->drift = 0.0;
+    members.push_back(member);
+    g_group.Join(&member->clock);
+    ok = StartClock(*member);
+  }
+
+  if(ok)
+  {
+    for(int i = 0; i < count; i++)
+      pthread_create(&members[i]->thread, NULL, MemberThread, members[i]);
+
+    OMXClock::OMXSleep((unsigned int)(g_options.seconds * 1000));
+
+    // both read lock-free at the same instant, so this is the real offset
+    for(int i = 1; i < count; i++)
+      members[i]->drift = members[i]->clock.OMXMediaTime() - members[0]->clock.OMXMediaTime();
+
+    g_stop = true;
+    for(int i = 0; i < count; i++)
+      pthread_join(members[i]->thread, NULL);
+  }
+
+  std::vector<OMXClockGroupMemberStats> stats = g_group.GetStats();
+  double frame_time = DVD_TIME_BASE / g_options.fps;
+  double max_drift = 0.0;
+
+  printf("{\n");
+  printf("  \"ok\": %s,\n", ok ? "true" : "false");
+  printf("  \"synced\": %s,\n", g_options.group ? "true" : "false");
+  printf("  \"seconds\": %.1f,\n", g_options.seconds);
+  printf("  \"frame_ms\": %.2f,\n", frame_time / 1000.0);
+  printf("  \"members\": [\n");
+  for(int i = 0; i < (int)members.size(); i++)
+  {
+    Member *member = members[i];
+    const OMXClockGroupMemberStats &s = stats[i];
+    OMXClockStats clock_stats = member->clock.GetStats();
+    if(i > 0)
+      max_drift = std::max(max_drift, fabs(member->drift));
+    printf("    { \"master\": %s, \"clock_drift_ppm\": %d, \"start_offset_ms\": %.1f, ",
+           s.master ? "true" : "false", member->drift_ppm, member->offset / 1000.0);
+    printf("\"drift_ms\": %.3f, \"drift_avg_ms\": %.3f, \"drift_max_ms\": %.3f, ",
+           member->drift / 1000.0, s.drift_avg / 1000.0, s.drift_max / 1000.0);
+    printf("\"lock_ms\": %.0f, \"nudges\": %llu, \"snaps\": %llu, \"seeks\": %llu, \"speed\": %.3f, ",
+           s.lock_time / 1000.0, (unsigned long long)s.nudges, (unsigned long long)s.snaps, (unsigned long long)s.seeks, s.speed);
+    printf("\"clock_samples\": %llu, \"clock_error_max_ms\": %.3f }%s\n",
+           (unsigned long long)clock_stats.samples, clock_stats.error_max / 1000.0,
+           i + 1 < (int)members.size() ? "," : "");
+  }
+  printf("  ],\n");
+  printf("  \"max_drift_ms\": %.3f,\n", max_drift / 1000.0);
+  printf("  \"within_frame\": %s\n", max_drift <= frame_time ? "true" : "false");
+  printf("}\n");
+
+  for(int i = 0; i < (int)members.size(); i++)
+  {
+    g_group.Leave(&members[i]->clock);
+    members[i]->clock.OMXStop();
+    members[i]->clock.OMXStateIdle();
+    members[i]->clock.OMXDeinitialize();
+    delete members[i];
+  }
+  core.Deinitialize();
+
+  return ok && max_drift <= frame_time ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+#include "BenchUtils.h"
+#include "utils/log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int  g_log_level = LOGNONE;
+static bool g_log_pid   = false;
+
+void SetBenchLogLevel(int level)
+{
+  g_log_level = level;
+}
+
+void SetBenchLogPid(bool pid)
+{
+  g_log_pid = pid;
+}
+
+void CLog::Log(int loglevel, const char *format, ...)
+{
+  if(loglevel < g_log_level)
+    return;
+  char line[1024];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(line, sizeof(line), format, args);
+  va_end(args);
+  size_t len = strlen(line);
+  const char *newline = len && line[len - 1] == '\n' ? "" : "\n";
+  if(g_log_pid)
+    fprintf(stderr, "[%d] %s%s", (int)getpid(), line, newline);
+  else
+    fprintf(stderr, "%s%s", line, newline);
+}
+
+double Now()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+int64_t NowNs()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// Helpers shared by the benches in tools/, built in through common.mk.
+
+#include <stdint.h>
+
+// utils/log.cpp goes through ofLog, the benches define CLog::Log to write to
+// stderr instead. Nothing is logged below level, LOGNONE (the default) turns
+// it off and LOGDEBUG is what -v sets.
+void SetBenchLogLevel(int level);
+// prefix every line with the pid, for benches that fork
+void SetBenchLogPid(bool pid);
+
+// CLOCK_MONOTONIC in seconds and in nanoseconds
+double Now();
+int64_t NowNs();
@@ -0,0 +1,7 @@
+# Shared bench helpers, see BenchUtils.h. Include it after SOURCES and
+# BENCH_FLAGS are set, the bench's include path has to reach src/ for
+# utils/log.h.
+COMMON_DIR     := $(dir $(lastword $(MAKEFILE_LIST)))
+BENCH_FLAGS    += -I$(COMMON_DIR)
+SOURCES        += $(COMMON_DIR)BenchUtils.cpp
+COMMON_HEADERS  = $(COMMON_DIR)BenchUtils.h
@@ -0,0 +1,366 @@
+// Replays the fifo of a live stream through OMXLiveLatency to tune it offline.
+//
+// The input is a trace recorded by the player with liveLatencyTrace set, or a
+// synthetic stream: packets produced by a source clock skew_ppm off ours,
+// delivered with a base delay, random jitter and now and then a stall that
+// releases everything at once. From a trace the bench takes where the input
+// was at every line (media + latency), which doesn't depend on how the clock
+// was steered, and plays it again with the controller given on the command
+// line, moving a simulated clock at the ratio it hands out and pausing it when
+// it says so.
+//
+// Prints a JSON report of how well the latency held the target once settled,
+// the ratio range, underruns and how long the fifo was really empty, and exits
+// with 1 when it ran empty while playing:
+//   ./live-latency-replay -t 300 -k 80 -j 40 -b 60:1500
+//   ./live-latency-replay -i live.trace -T 500 -P 0.03 -I 0.0002
+// -L plays the same input with the step table the engine used before.
+
+#include "OMXLiveLatency.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct Options
+{
+  std::string input;
+  std::string output;
+  double seconds;
+  double tick;        // s between updates of a synthetic stream
+  double skew_ppm;    // source clock against ours
+  double delay;       // s
+  double jitter;      // s
+  double packet;      // media per packet, s
+  double stall_every; // s, 0 for none
+  double stall;       // s
+  double settle;      // s before the latency counts
+  unsigned int seed;
+  bool legacy;
+};
+
+// where the input is at a moment: media time of the newest decoded packet
+struct Sample
+{
+  double time;
+  double head;
+};
+
+static Options g_options;
+
+static void Usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-i trace] [-o trace] [-t s] [-u ms] [-k ppm] [-d ms] [-j ms] [-b every:ms] [-s seed]\n"
+                  "       [-T ms] [-M ms] [-P kp] [-I ki] [-R ratio] [-Q step] [-F s] [-r part] [-w s] [-L]\n", name);
+  fprintf(stderr, "  -i  replay a trace recorded by the player instead of a synthetic stream\n");
+  fprintf(stderr, "  -o  write the replay as a trace\n");
+  fprintf(stderr, "  -t  seconds of synthetic stream, default 300\n");
+  fprintf(stderr, "  -u  ms between updates, default 20\n");
+  fprintf(stderr, "  -k  source clock skew in ppm, default 100\n");
+  fprintf(stderr, "  -d  network delay in ms, default 50\n");
+  fprintf(stderr, "  -j  random extra delay up to ms, default 40\n");
+  fprintf(stderr, "  -b  stall the network every s for ms, default none\n");
+  fprintf(stderr, "  -s  random seed\n");
+  fprintf(stderr, "  -T  target latency in ms, -M the most underruns raise it to\n");
+  fprintf(stderr, "  -P -I  proportional and integral gain, -R largest ratio change, -Q its step\n");
+  fprintf(stderr, "  -F  latency filter time constant in s\n");
+  fprintf(stderr, "  -r  part of the target the fifo refills to before resuming\n");
+  fprintf(stderr, "  -w  seconds to settle before the latency counts, default 60\n");
+  fprintf(stderr, "  -L  use the old step table instead\n");
+}
+
+static double Random()
+{
+  return rand_r(&g_options.seed) / (RAND_MAX + 1.0);
+}
+
+// packets produced every options.packet by a clock running skew_ppm fast,
+// arriving in order after the delay, the jitter and any stall in the way
+static void Generate(std::vector<Sample> &samples)
+{
+  const Options &o = g_options;
+  std::vector<double> arrival;
+  std::vector<double> media;
+  double rate = 1.0 + o.skew_ppm * 1e-6;
+  double last = 0.0;
+  for(double pts = 0.0; pts / rate < o.seconds; pts += o.packet)
+  {
+    double produced = pts / rate;
+    double at = produced + o.delay + o.jitter * Random();
+    if(o.stall_every > 0.0)
+    {
+      double start = floor(at / o.stall_every) * o.stall_every;
+      if(start > 0.0 && at < start + o.stall)
+        at = start + o.stall;
+    }
+    last = std::max(last, at);
+    arrival.push_back(last);
+    media.push_back(pts);
+  }
+
+  size_t next = 0;
+  double head = -1.0;
+  for(double now = 0.0; now < o.seconds; now += o.tick)
+  {
+    while(next < arrival.size() && arrival[next] <= now)
+      head = media[next++];
+    if(head >= 0.0)
+    {
+      Sample sample = { now, head };
+      samples.push_back(sample);
+    }
+  }
+}
+
+static bool Load(std::vector<Sample> &samples)
+{
+  FILE *file = fopen(g_options.input.c_str(), "r");
+  if(!file)
+  {
+    fprintf(stderr, "can't open %s\n", g_options.input.c_str());
+    return false;
+  }
+  char line[256];
+  while(fgets(line, sizeof(line), file))
+  {
+    double time, media, latency;
+    if(line[0] == '#' || sscanf(line, "%lf %lf %lf", &time, &media, &latency) != 3)
+      continue;
+    Sample sample = { time, media + latency };
+    samples.push_back(sample);
+  }
+  fclose(file);
+  if(samples.size() < 2)
+  {
+    fprintf(stderr, "%s has no samples\n", g_options.input.c_str());
+    return false;
+  }
+  return true;
+}
+
+// what ofxOMXPlayerEngine did before OMXLiveLatency: an EMA of the fifo and
+// four fixed speeds around a threshold, never pausing once it played
+struct Legacy
+{
+  double latency;
+
+  Legacy() : latency(0.0) {}
+
+  OMXLiveLatencyAction Update(double fifo, bool paused, double threshold, double &ratio)
+  {
+    if(paused)
+    {
+      if(fifo > threshold)
+      {
+        latency = fifo;
+        return OMX_LIVE_LATENCY_RESUME;
+      }
+      return OMX_LIVE_LATENCY_HOLD;
+    }
+    latency = latency * 0.99 + fifo * 0.01;
+    ratio = 1.0;
+    if(latency < 0.5 * threshold)
+      ratio = 0.990;
+    else if(latency < 0.9 * threshold)
+      ratio = 0.999;
+    else if(latency > 2.0 * threshold)
+      ratio = 1.010;
+    else if(latency > 1.1 * threshold)
+      ratio = 1.001;
+    return OMX_LIVE_LATENCY_HOLD;
+  }
+};
+
+int main(int argc, char **argv)
+{
+  g_options.seconds     = 300.0;
+  g_options.tick        = 0.02;
+  g_options.skew_ppm    = 100.0;
+  g_options.delay       = 0.05;
+  g_options.jitter      = 0.04;
+  g_options.packet      = 0.024;
+  g_options.stall_every = 0.0;
+  g_options.stall       = 0.0;
+  g_options.settle      = 60.0;
+  g_options.seed        = 1;
+  g_options.legacy      = false;
+
+  OMXLiveLatencyConfig config = OMXLiveLatency::Defaults();
+  bool target_max_set = false;
+
+  int opt;
+  while((opt = getopt(argc, argv, "i:o:t:u:k:d:j:b:s:T:M:P:I:R:Q:F:r:w:Lh")) != -1)
+  {
+    switch(opt)
+    {
+      case 'i': g_options.input = optarg; break;
+      case 'o': g_options.output = optarg; break;
+      case 't': g_options.seconds = std::max(1.0, atof(optarg)); break;
+      case 'u': g_options.tick = std::max(1.0, atof(optarg)) / 1000.0; break;
+      case 'k': g_options.skew_ppm = atof(optarg); break;
+      case 'd': g_options.delay = std::max(0.0, atof(optarg)) / 1000.0; break;
+      case 'j': g_options.jitter = std::max(0.0, atof(optarg)) / 1000.0; break;
+      case 'b':
+        if(sscanf(optarg, "%lf:%lf", &g_options.stall_every, &g_options.stall) != 2)
+        {
+          Usage(argv[0]);
+          return 1;
+        }
+        g_options.stall /= 1000.0;
+        break;
+      case 's': g_options.seed = (unsigned int)atoi(optarg); break;
+      case 'T': config.target = atof(optarg) / 1000.0; break;
+      case 'M': config.target_max = atof(optarg) / 1000.0; target_max_set = true; break;
+      case 'P': config.kp = atof(optarg); break;
+      case 'I': config.ki = atof(optarg); break;
+      case 'R': config.max_ratio = atof(optarg); break;
+      case 'Q': config.ratio_step = atof(optarg); break;
+      case 'F': config.filter = atof(optarg); break;
+      case 'r': config.resume_level = atof(optarg); break;
+      case 'w': g_options.settle = std::max(0.0, atof(optarg)); break;
+      case 'L': g_options.legacy = true; break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  if(!target_max_set)
+    config.target_max = config.target;
+
+  std::vector<Sample> samples;
+  if(g_options.input.empty())
+    Generate(samples);
+  else if(!Load(samples))
+    return 1;
+  if(samples.empty())
+  {
+    fprintf(stderr, "no input arrived\n");
+    return 1;
+  }
+
+  OMXLiveLatency controller;
+  controller.SetConfig(config);
+  config = controller.GetConfig();
+  if(!g_options.output.empty() && !controller.StartTrace(g_options.output))
+  {
+    fprintf(stderr, "can't write %s\n", g_options.output.c_str());
+    return 1;
+  }
+  Legacy legacy;
+
+  // the clock starts paused on the first packet, like the engine after open
+  double start = samples[0].time;
+  double media = samples[0].head;
+  double ratio = 1.0;
+  bool paused = true;
+  double last = start;
+
+  double sum = 0.0, sum2 = 0.0, low = 1e9, high = -1e9;
+  double ratio_low = 1.0, ratio_high = 1.0;
+  double starved = 0.0;
+  uint64_t counted = 0, legacy_changes = 0, set_speed_calls = 0, starves = 0;
+  bool starving = false;
+  std::vector<double> errors;
+
+  for(size_t i = 0; i < samples.size(); i++)
+  {
+    double now = samples[i].time;
+    double dt = now - last;
+    last = now;
+    if(!paused)
+      media += dt * ratio;
+
+    double latency = samples[i].head - media;
+    if(!paused && latency < 0.0)
+    {
+      // nothing decoded for the clock to play, that's a glitch
+      starved += dt;
+      if(!starving)
+        starves++;
+      starving = true;
+    }
+    else
+      starving = false;
+
+    OMXLiveLatencyAction action;
+    if(g_options.legacy)
+    {
+      double was = ratio;
+      action = legacy.Update(latency, paused, config.target, ratio);
+      if(ratio != was)
+        legacy_changes++;
+      // it set the speed twice on every update while playing
+      if(!paused)
+        set_speed_calls += 2;
+    }
+    else
+    {
+      double was = ratio;
+      action = controller.Update(now, media, latency, paused, false);
+      ratio = controller.GetRatio();
+      // the engine only touches the clock when the ratio moved
+      if(ratio != was)
+        set_speed_calls += paused ? 1 : 2;
+    }
+    if(action == OMX_LIVE_LATENCY_PAUSE)
+      paused = true;
+    else if(action == OMX_LIVE_LATENCY_RESUME)
+      paused = false;
+
+    if(now - start >= g_options.settle && !paused)
+    {
+      double target = g_options.legacy ? config.target : controller.GetStats().target;
+      sum += latency;
+      sum2 += latency * latency;
+      low = std::min(low, latency);
+      high = std::max(high, latency);
+      errors.push_back(fabs(latency - target));
+      ratio_low = std::min(ratio_low, ratio);
+      ratio_high = std::max(ratio_high, ratio);
+      counted++;
+    }
+  }
+  controller.StopTrace();
+
+  OMXLiveLatencyStats stats = controller.GetStats();
+  double mean = counted ? sum / counted : 0.0;
+  double deviation = counted ? sqrt(std::max(sum2 / counted - mean * mean, 0.0)) : 0.0;
+  double p95 = 0.0;
+  if(!errors.empty())
+  {
+    size_t at = std::min(errors.size() - 1, (size_t)(errors.size() * 0.95));
+    std::nth_element(errors.begin(), errors.begin() + at, errors.end());
+    p95 = errors[at];
+  }
+
+  printf("{\n");
+  printf("  \"controller\": \"%s\",\n", g_options.legacy ? "legacy" : "pi");
+  printf("  \"input\": \"%s\",\n", g_options.input.empty() ? "synthetic" : g_options.input.c_str());
+  printf("  \"seconds\": %.1f,\n", samples.back().time - start);
+  if(g_options.input.empty())
+    printf("  \"skew_ppm\": %.1f, \"delay_ms\": %.1f, \"jitter_ms\": %.1f, \"stall_every_s\": %.1f, \"stall_ms\": %.0f,\n",
+           g_options.skew_ppm, g_options.delay * 1000.0, g_options.jitter * 1000.0, g_options.stall_every, g_options.stall * 1000.0);
+  printf("  \"target_ms\": %.0f, \"target_max_ms\": %.0f, \"kp\": %g, \"ki\": %g, \"max_ratio\": %g, \"ratio_step\": %g, \"filter_s\": %g,\n",
+         config.target * 1000.0, config.target_max * 1000.0, config.kp, config.ki, config.max_ratio, config.ratio_step, config.filter);
+  printf("  \"final_target_ms\": %.0f,\n", (g_options.legacy ? config.target : stats.target) * 1000.0);
+  printf("  \"latency_mean_ms\": %.1f, \"latency_stddev_ms\": %.1f, \"latency_min_ms\": %.1f, \"latency_max_ms\": %.1f,\n",
+         mean * 1000.0, deviation * 1000.0, counted ? low * 1000.0 : 0.0, counted ? high * 1000.0 : 0.0);
+  printf("  \"error_p95_ms\": %.1f,\n", p95 * 1000.0);
+  printf("  \"ratio_min\": %.4f, \"ratio_max\": %.4f,\n", ratio_low, ratio_high);
+  if(!g_options.legacy)
+    printf("  \"integral_ppm\": %.0f,\n", stats.integral * 1e6);
+  printf("  \"ratio_changes\": %llu,\n", (unsigned long long)(g_options.legacy ? legacy_changes : stats.ratio_changes));
+  printf("  \"set_speed_calls\": %llu,\n", (unsigned long long)set_speed_calls);
+  printf("  \"underruns\": %llu,\n", (unsigned long long)stats.underruns);
+  printf("  \"paused_ms\": %.0f,\n", stats.paused_time * 1000.0);
+  printf("  \"starves\": %llu,\n", (unsigned long long)starves);
+  printf("  \"starved_ms\": %.0f\n", starved * 1000.0);
+  printf("}\n");
+
+  return starved > 0.0 ? 1 : 0;
+}
@@ -0,0 +1,475 @@
+// Runs an OMXNetSync leader and followers as separate processes on one host,
+// each with its own OMXClock on the software OMX core, talking over the
+// network stack like the Pis of a video wall do. Every clock component gets
+// its own rate error and start offset, and -l/-D/-j/-k add packet loss, delay,
+// jitter and host clock skew to every node. Every other follower's clock runs
+// a minute ahead of its position in the movie, as after a playlist splice. The leader also shares its clock
+// through memory so each follower can tell how far off it really is, not just
+// how far off it thinks it is.
+//
+// Prints a JSON report with the real drift of every follower, how well it
+// estimated offset and skew and how often it nudged or seeked, and exits with
+// 1 when a follower isn't within a frame over the last quarter of the run:
+//   ./net-sync-bench -n 6 -l 10 -D 5 -j 20 -k 100 -s 15 -t 60
+// -r leader / -r follower run a single node instead, for trying it across
+// hosts; those report only what the node itself can see.
+// Needs ffmpeg and the VideoCore headers to build, no display or GPU to run.
+
+#include "BenchUtils.h"
+#include "OMXClock.h"
+#include "OMXNetSync.h"
+#include "OMXCore.h"
+#include "OMXSoftCore.h"
+#include "utils/log.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <string>
+#include <vector>
+
+struct Options
+{
+  int         nodes;
+  int         drift_ppm;   // largest clock component rate error
+  int         offset_ms;   // start offset of the last node
+  double      fps;
+  double      seconds;
+  double      seek_every;  // leader jumps 10s ahead this often, 0 never
+  float       loss;
+  double      delay_ms;
+  double      jitter_ms;
+  double      skew_ppm;    // largest host clock skew
+  std::string address;
+  int         port;
+  int         role;        // -1 all in one, 0 leader, 1 follower
+};
+
+struct Node
+{
+  int    index;
+  int    drift_ppm;
+  double skew_ppm;
+  double offset;           // us the clock starts behind the leader's
+  double item_offset;      // us the clock is ahead of the position in the movie
+};
+
+// the leader's media time as its clock really is, shared with the followers
+struct Truth
+{
+  std::atomic<uint32_t> seq;
+  std::atomic<double>   media;
+  std::atomic<double>   host;
+  std::atomic<double>   speed;
+  std::atomic<double>   seek_host;   // when the leader last seeked
+  double                leader_skew_ppm;
+};
+
+static Options g_options;
+static Truth  *g_truth = NULL;
+
+static double HostTime()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec * 1000000.0 + now.tv_nsec / 1000;
+}
+
+static void PublishTruth(double media, double host, double speed)
+{
+  uint32_t seq = g_truth->seq.load(std::memory_order_relaxed);
+  g_truth->seq.store(seq + 1, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_release);
+  g_truth->media.store(media, std::memory_order_relaxed);
+  g_truth->host.store(host, std::memory_order_relaxed);
+  g_truth->speed.store(speed, std::memory_order_relaxed);
+  g_truth->seq.store(seq + 2, std::memory_order_release);
+}
+
+static double ReadTruth(double now)
+{
+  for(;;)
+  {
+    uint32_t seq = g_truth->seq.load(std::memory_order_acquire);
+    if(seq & 1)
+      continue;
+    double media = g_truth->media.load(std::memory_order_relaxed);
+    double host  = g_truth->host.load(std::memory_order_relaxed);
+    double speed = g_truth->speed.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(g_truth->seq.load(std::memory_order_relaxed) == seq)
+      return media + (now - host) * speed;
+  }
+}
+
+static bool StartClock(OMXClock &clock, const Node &node)
+{
+  OMXSOFT_CONFIG config;
+  OMXSOFT_GetConfig(&config);
+  config.clock_drift_ppm = node.drift_ppm;
+  OMXSOFT_SetConfig(&config);
+
+  if(!clock.OMXInitialize())
+    return false;
+  // nothing gets tunneled to the clock here, its ports would hold up Idle
+  clock.GetOMXClock()->DisableAllPorts();
+  if(!clock.OMXStateExecute())
+    return false;
+  clock.OMXSetReferenceClock(false);
+
+  // no decoders to wait for, start the clock by hand at the node's offset
+  OMX_TIME_CONFIG_CLOCKSTATETYPE state;
+  OMX_INIT_STRUCTURE(state);
+  state.eState = OMX_TIME_ClockStateRunning;
+  state.nStartTime = ToOMXTime((int64_t)(DVD_SEC_TO_TIME(1) + node.item_offset - node.offset));
+  return clock.GetOMXClock()->SetConfig(OMX_IndexConfigTimeClockState, &state) == OMX_ErrorNone;
+}
+
+// runs one node, writes its JSON object to out and returns 0 when it kept up
+static int RunNode(const Node &node, bool leader, FILE *out)
+{
+  COMXCore core;
+  if(!core.Initialize())
+  {
+    fprintf(stderr, "OMX core failed to initialize\n");
+    return 1;
+  }
+
+  OMXClock clock;
+  OMXNetSync sync;
+  OMXNetSyncFaults faults;
+  faults.loss     = g_options.loss;
+  faults.delay    = g_options.delay_ms * 1000.0;
+  faults.jitter   = g_options.jitter_ms * 1000.0;
+  faults.skew_ppm = node.skew_ppm;
+  sync.SetFaults(faults);
+
+  bool ok = StartClock(clock, node) &&
+            (leader ? sync.StartLeader(g_options.address, g_options.port)
+                    : sync.StartFollower(g_options.address, g_options.port));
+
+  double frame_time = DVD_TIME_BASE / g_options.fps;
+  double start = HostTime();
+  double end = start + g_options.seconds * 1000000.0;
+  double settle = end - g_options.seconds * 250000.0;
+  double next_seek = g_options.seek_every > 0.0 ? start + g_options.seek_every * 1000000.0 : 0.0;
+  double drift = 0.0, settled_max = 0.0;
+  double seek_seen = 0.0, recovery_max = 0.0;
+  bool recovering = false;
+  double offset_error = 0.0, skew_error = 0.0;
+  bool measured = false;
+
+  while(ok && HostTime() < end)
+  {
+    clock.OMXSampleMediaTime();
+    double now = HostTime();
+    if(leader)
+    {
+      if(next_seek && now >= next_seek)
+      {
+        clock.OMXMediaTime(clock.OMXMediaTime() + DVD_SEC_TO_TIME(10));
+        next_seek += g_options.seek_every * 1000000.0;
+        if(g_truth)
+          g_truth->seek_host = HostTime();
+      }
+      if(g_truth)
+      {
+        double speed = clock.OMXIsPaused() ? 0.0 : (double)clock.OMXPlaySpeed() / DVD_PLAYSPEED_NORMAL;
+        PublishTruth(clock.OMXMediaTime(), HostTime(), speed);
+      }
+      sync.Sync(&clock, frame_time);
+    }
+    else
+    {
+      // a player would seek its reader here, the bench just moves the clock
+      double seek_time;
+      if(sync.GetSeek(seek_time))
+        clock.OMXMediaTime(seek_time + node.item_offset);
+      sync.Sync(&clock, frame_time, node.item_offset);
+
+      if(g_truth && sync.GetStats().synced)
+      {
+        now = HostTime();
+        drift = clock.OMXMediaTime() - node.item_offset - ReadTruth(now);
+        measured = true;
+
+        // time from a leader seek until back within a frame is reported on
+        // its own and doesn't count against the settled drift
+        double seek_host = g_truth->seek_host;
+        if(seek_host != seek_seen)
+        {
+          seek_seen = seek_host;
+          recovering = true;
+        }
+        if(recovering && fabs(drift) <= frame_time)
+        {
+          recovery_max = std::max(recovery_max, now - seek_seen);
+          recovering = false;
+        }
+        if(now >= settle && !recovering)
+          settled_max = std::max(settled_max, fabs(drift));
+      }
+    }
+    OMXClock::OMXSleep(20);
+  }
+
+  OMXNetSyncStats stats = sync.GetStats();
+  if(!leader && g_truth && stats.synced)
+  {
+    // both host clocks are the shared monotonic one scaled by their skew
+    double skew = g_truth->leader_skew_ppm - node.skew_ppm;
+    offset_error = stats.offset - HostTime() * skew * 1e-6;
+    skew_error = stats.skew - skew;
+  }
+  OMXClockStats clock_stats = clock.GetStats();
+
+  fprintf(out, "{ \"node\": %d, \"role\": \"%s\", \"ok\": %s, \"clock_drift_ppm\": %d, \"host_skew_ppm\": %.1f, "
+          "\"start_offset_ms\": %.1f, \"item_offset_ms\": %.0f, ",
+          node.index, leader ? "leader" : "follower", ok ? "true" : "false", node.drift_ppm, node.skew_ppm,
+          node.offset / 1000.0, node.item_offset / 1000.0);
+  if(leader)
+  {
+    fprintf(out, "\"beacons_sent\": %llu, \"generation\": %u, \"dropped\": %llu",
+            (unsigned long long)stats.beacons_sent, stats.generation, (unsigned long long)stats.dropped);
+  }
+  else
+  {
+    fprintf(out, "\"synced\": %s, ", stats.synced ? "true" : "false");
+    if(g_truth)
+    {
+      fprintf(out, "\"drift_ms\": %.3f, \"settled_max_ms\": %.3f, \"seek_recovery_ms\": %.0f, "
+              "\"offset_error_us\": %.1f, \"skew_error_ppm\": %.2f, ",
+              drift / 1000.0, settled_max / 1000.0, recovery_max / 1000.0, offset_error, skew_error);
+    }
+    fprintf(out, "\"est_drift_ms\": %.3f, \"lock_ms\": %.0f, \"nudges\": %llu, \"snaps\": %llu, \"seeks\": %llu, \"speed\": %.3f, ",
+            stats.follower.drift / 1000.0, stats.follower.lock_time / 1000.0,
+            (unsigned long long)stats.follower.nudges, (unsigned long long)stats.follower.snaps,
+            (unsigned long long)stats.seeks, stats.follower.speed);
+    fprintf(out, "\"skew_ppm\": %.2f, \"delay_us\": %.0f, \"requests\": %llu, \"responses\": %llu, "
+            "\"beacons_received\": %llu, \"beacons_lost\": %llu, \"generation\": %u, \"dropped\": %llu, "
+            "\"clock_error_max_ms\": %.3f",
+            stats.skew, stats.delay, (unsigned long long)stats.requests, (unsigned long long)stats.responses,
+            (unsigned long long)stats.beacons_received, (unsigned long long)stats.beacons_lost,
+            stats.generation, (unsigned long long)stats.dropped, clock_stats.error_max / 1000.0);
+  }
+  fprintf(out, " }");
+  fflush(out);
+
+  sync.Stop();
+  clock.OMXStop();
+  clock.OMXStateIdle();
+  clock.OMXDeinitialize();
+  core.Deinitialize();
+
+  if(!ok)
+    return 1;
+  if(leader || !g_truth)
+    return 0;
+  return measured && !recovering && settled_max <= frame_time ? 0 : 1;
+}
+
+static void Usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-n nodes] [-d ppm] [-o ms] [-f fps] [-t seconds] [-s seconds]\n"
+                  "          [-l loss%%] [-D ms] [-j ms] [-k ppm] [-a address] [-p port] [-r leader|follower] [-v]\n", name);
+  fprintf(stderr, "  -n  processes, the first one leads, default 4\n");
+  fprintf(stderr, "  -d  largest clock component rate error in ppm, default 500\n");
+  fprintf(stderr, "  -o  how much later the last node's clock starts in ms, default 120\n");
+  fprintf(stderr, "  -f  frame rate the followers are held to within a frame of, default 25\n");
+  fprintf(stderr, "  -t  seconds to run, default 30\n");
+  fprintf(stderr, "  -s  leader seeks 10s ahead every this many seconds, default never\n");
+  fprintf(stderr, "  -l  percentage of packets every node drops\n");
+  fprintf(stderr, "  -D  ms every packet is delayed\n");
+  fprintf(stderr, "  -j  up to this many ms of extra random delay\n");
+  fprintf(stderr, "  -k  largest host clock skew of a follower in ppm\n");
+  fprintf(stderr, "  -a  address the leader sends to, default %s\n", OMX_NET_SYNC_ADDRESS);
+  fprintf(stderr, "  -p  port, default %d\n", OMX_NET_SYNC_PORT);
+  fprintf(stderr, "  -r  run only this node\n");
+  fprintf(stderr, "  -v  log what the nodes log\n");
+}
+
+int main(int argc, char **argv)
+{
+  // the nodes are forked, tell their log lines apart
+  SetBenchLogPid(true);
+
+  g_options.nodes      = 4;
+  g_options.drift_ppm  = 500;
+  g_options.offset_ms  = 120;
+  g_options.fps        = 25.0;
+  g_options.seconds    = 30.0;
+  g_options.seek_every = 0.0;
+  g_options.loss       = 0.0f;
+  g_options.delay_ms   = 0.0;
+  g_options.jitter_ms  = 0.0;
+  g_options.skew_ppm   = 0.0;
+  g_options.address    = OMX_NET_SYNC_ADDRESS;
+  g_options.port       = OMX_NET_SYNC_PORT;
+  g_options.role       = -1;
+
+  int opt;
+  while((opt = getopt(argc, argv, "n:d:o:f:t:s:l:D:j:k:a:p:r:vh")) != -1)
+  {
+    switch(opt)
+    {
+      case 'n':
+        g_options.nodes = std::min(std::max(atoi(optarg), 2), 32);
+        break;
+      case 'd':
+        g_options.drift_ppm = abs(atoi(optarg));
+        break;
+      case 'o':
+        g_options.offset_ms = std::max(0, atoi(optarg));
+        break;
+      case 'f':
+        g_options.fps = std::max(1.0, atof(optarg));
+        break;
+      case 't':
+        g_options.seconds = std::max(1.0, atof(optarg));
+        break;
+      case 's':
+        g_options.seek_every = std::max(0.0, atof(optarg));
+        break;
+      case 'l':
+        g_options.loss = std::min(std::max((float)atof(optarg), 0.0f), 100.0f) / 100.0f;
+        break;
+      case 'D':
+        g_options.delay_ms = std::max(0.0, atof(optarg));
+        break;
+      case 'j':
+        g_options.jitter_ms = std::max(0.0, atof(optarg));
+        break;
+      case 'k':
+        g_options.skew_ppm = fabs(atof(optarg));
+        break;
+      case 'a':
+        g_options.address = optarg;
+        break;
+      case 'p':
+        g_options.port = atoi(optarg);
+        break;
+      case 'r':
+        if(!strcmp(optarg, "leader"))
+          g_options.role = 0;
+        else if(!strcmp(optarg, "follower"))
+          g_options.role = 1;
+        else
+        {
+          Usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'v':
+        SetBenchLogLevel(LOGDEBUG);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  int count = g_options.nodes;
+  std::vector<Node> nodes(count);
+  for(int i = 0; i < count; i++)
+  {
+    // leader is exact, followers alternate fast/slow up to the limits
+    int step = (i + 1) / 2;
+    int steps = std::max(count / 2, 1);
+    int sign = i & 1 ? 1 : -1;
+    nodes[i].index     = i;
+    nodes[i].drift_ppm = i == 0 ? 0 : sign * g_options.drift_ppm * step / steps;
+    nodes[i].skew_ppm  = i == 0 ? 0.0 : -sign * g_options.skew_ppm * step / steps;
+    nodes[i].offset    = DVD_MSEC_TO_TIME((double)g_options.offset_ms * i / (count - 1));
+    nodes[i].item_offset = i & 1 ? DVD_SEC_TO_TIME(60) : 0.0;
+  }
+
+  if(g_options.role >= 0)
+  {
+    Node node = nodes[g_options.role];
+    node.offset = 0.0;
+    node.item_offset = 0.0;
+    int ret = RunNode(node, g_options.role == 0, stdout);
+    printf("\n");
+    return ret;
+  }
+
+  // shared before the fork, so every node sees the leader's writes
+  void *shared = mmap(NULL, sizeof(Truth), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(shared == MAP_FAILED)
+  {
+    perror("mmap");
+    return 1;
+  }
+  g_truth = new(shared) Truth;
+  g_truth->seq = 0;
+  g_truth->media = 0.0;
+  g_truth->host = 0.0;
+  g_truth->speed = 0.0;
+  g_truth->seek_host = 0.0;
+  g_truth->leader_skew_ppm = nodes[0].skew_ppm;
+
+  std::vector<pid_t> pids(count);
+  std::vector<FILE *> reports(count);
+  for(int i = 0; i < count; i++)
+  {
+    int fds[2];
+    if(pipe(fds) != 0)
+    {
+      perror("pipe");
+      return 1;
+    }
+    fflush(stdout);
+    pids[i] = fork();
+    if(pids[i] == 0)
+    {
+      close(fds[0]);
+      FILE *out = fdopen(fds[1], "w");
+      int ret = RunNode(nodes[i], i == 0, out);
+      fclose(out);
+      _exit(ret);
+    }
+    close(fds[1]);
+    reports[i] = fdopen(fds[0], "r");
+  }
+
+  double frame_time = DVD_TIME_BASE / g_options.fps;
+  bool passed = true;
+
+  printf("{\n");
+  printf("  \"seconds\": %.1f,\n", g_options.seconds);
+  printf("  \"frame_ms\": %.2f,\n", frame_time / 1000.0);
+  printf("  \"loss_pct\": %.1f, \"delay_ms\": %.1f, \"jitter_ms\": %.1f, \"skew_ppm\": %.1f, \"seek_every_s\": %.1f,\n",
+         g_options.loss * 100.0f, g_options.delay_ms, g_options.jitter_ms, g_options.skew_ppm, g_options.seek_every);
+  printf("  \"nodes\": [\n");
+  for(int i = 0; i < count; i++)
+  {
+    char line[4096];
+    std::string report;
+    while(fgets(line, sizeof(line), reports[i]))
+      report += line;
+    fclose(reports[i]);
+
+    int status = 0;
+    waitpid(pids[i], &status, 0);
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      passed = false;
+    if(report.empty())
+      report = "{ \"node\": " + std::to_string(i) + ", \"ok\": false }";
+    printf("    %s%s\n", report.c_str(), i + 1 < count ? "," : "");
+  }
+  printf("  ],\n");
+  printf("  \"within_frame\": %s\n", passed ? "true" : "false");
+  printf("}\n");
+
+  munmap(shared, sizeof(Truth));
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,210 @@
+// Measures what OMXReader::Read() copies per second of media, with the
+// payload memcpy'd into pooled packets and with the demuxer's AVBufferRef
+// adopted instead (ofxOMXPlayerSettings::enableZeroCopyPackets).
+//
+// Every file is demuxed in both modes, as fast as it goes, with up to -q
+// packets held before they are freed the way the player queues hold them.
+// COMXVideo::Decode() copies every payload into an OMX input buffer once more
+// in either mode, the report counts that as decoder_copied. Prints JSON:
+// bytes copied, adopted and demux throughput per mode and how much of the
+// copying zero copy saved, e.g.
+//   ./packet-copy-bench -n 3 movie-1080p.mp4 movie-4k.mkv > copies.json
+// Needs ffmpeg and the VideoCore headers to build, no display or GPU to run.
+
+#include "BenchUtils.h"
+#include "OMXReader.h"
+#include "utils/log.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include <vector>
+
+struct Options
+{
+  int    passes;
+  size_t held;    // packets in flight before the oldest is freed
+  bool   mmap;
+};
+
+struct ModeResult
+{
+  bool     ok;
+  uint64_t packets;
+  uint64_t bytes;          // payload handed out
+  uint64_t bytes_copied;   // memcpy'd by Read()
+  uint64_t bytes_adopted;  // referenced without a copy
+  double   media_seconds;
+  double   seconds;        // fastest pass
+  uint64_t pool_misses;    // fresh packet allocations of the fastest pass
+  double   pool_hit_rate;
+};
+
+static bool RunPass(const char *path, bool zero_copy, const Options &options, ModeResult &result)
+{
+  OMXReader reader;
+  reader.SetZeroCopy(zero_copy);
+  reader.SetMmap(options.mmap);
+  if(!reader.Open(path, false))
+  {
+    fprintf(stderr, "could not open %s\n", path);
+    return false;
+  }
+  reader.ResetCopyStats();
+
+  std::deque<OMXPacket *> held;
+  uint64_t packets = 0, bytes = 0;
+  double start = Now();
+
+  while(true)
+  {
+    OMXPacket *pkt = reader.Read();
+    if(!pkt)
+    {
+      if(reader.IsEof())
+        break;
+      continue;
+    }
+    packets++;
+    bytes += pkt->size;
+
+    held.push_back(pkt);
+    if(held.size() > options.held)
+    {
+      OMXReader::FreePacket(held.front());
+      held.pop_front();
+    }
+  }
+  while(!held.empty())
+  {
+    OMXReader::FreePacket(held.front());
+    held.pop_front();
+  }
+
+  double seconds = Now() - start;
+  if(!result.ok || seconds < result.seconds)
+  {
+    OMXReaderCopyStats copies = reader.GetCopyStats();
+    OMXPacketPoolStats pool = reader.GetPacketPoolStats();
+    result.ok            = true;
+    result.packets       = packets;
+    result.bytes         = bytes;
+    result.bytes_copied  = copies.bytes_copied;
+    result.bytes_adopted = copies.bytes_adopted;
+    result.media_seconds = copies.media_seconds;
+    result.seconds       = seconds;
+    result.pool_misses   = pool.misses;
+    result.pool_hit_rate = reader.GetPacketPoolHitRate();
+  }
+  reader.Close();
+  return true;
+}
+
+static double PerMediaSecond(uint64_t bytes, double media_seconds)
+{
+  return media_seconds > 0.0 ? bytes / media_seconds / (1024.0 * 1024.0) : 0.0;
+}
+
+static void PrintMode(const char *name, const ModeResult &r, bool last)
+{
+  printf("        \"%s\": { ", name);
+  printf("\"packets\": %llu, \"mb\": %.2f, \"media_s\": %.2f, ",
+         (unsigned long long)r.packets, r.bytes / (1024.0 * 1024.0), r.media_seconds);
+  printf("\"copied_mb_per_media_s\": %.3f, \"adopted_mb_per_media_s\": %.3f, ",
+         PerMediaSecond(r.bytes_copied, r.media_seconds), PerMediaSecond(r.bytes_adopted, r.media_seconds));
+  // Read()'s copy, if any, plus the one into the decoder's input buffers
+  printf("\"total_copied_mb_per_media_s\": %.3f, ",
+         PerMediaSecond(r.bytes_copied + r.bytes, r.media_seconds));
+  printf("\"demux_s\": %.3f, \"demux_mb_s\": %.1f, \"packets_s\": %.0f, ",
+         r.seconds, r.seconds > 0.0 ? r.bytes / r.seconds / (1024.0 * 1024.0) : 0.0,
+         r.seconds > 0.0 ? r.packets / r.seconds : 0.0);
+  printf("\"pool_misses\": %llu, \"pool_hit_rate\": %.4f }%s\n",
+         (unsigned long long)r.pool_misses, r.pool_hit_rate, last ? "" : ",");
+}
+
+static void Usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-n passes] [-q packets] [-m] [-v] file...\n", name);
+  fprintf(stderr, "  -n  passes per mode, the fastest counts, default 3\n");
+  fprintf(stderr, "  -q  packets held before freeing, default 100\n");
+  fprintf(stderr, "  -m  read through mmap\n");
+  fprintf(stderr, "  -v  log what the reader logs\n");
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  options.passes = 3;
+  options.held   = 100;
+  options.mmap   = false;
+
+  int opt;
+  while((opt = getopt(argc, argv, "n:q:mvh")) != -1)
+  {
+    switch(opt)
+    {
+      case 'n':
+        options.passes = std::max(1, atoi(optarg));
+        break;
+      case 'q':
+        options.held = (size_t)std::max(0, atoi(optarg));
+        break;
+      case 'm':
+        options.mmap = true;
+        break;
+      case 'v':
+        SetBenchLogLevel(LOGDEBUG);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  if(optind >= argc)
+  {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  bool ok = true;
+  printf("{\n");
+  printf("  \"passes\": %d,\n", options.passes);
+  printf("  \"held\": %u,\n", (unsigned int)options.held);
+  printf("  \"files\": [\n");
+  for(int i = optind; i < argc; i++)
+  {
+    ModeResult copy, zero;
+    memset(&copy, 0, sizeof(copy));
+    memset(&zero, 0, sizeof(zero));
+    // alternate so neither mode gets the warmer page cache
+    for(int pass = 0; pass < options.passes; pass++)
+    {
+      if(!RunPass(argv[i], false, options, copy) || !RunPass(argv[i], true, options, zero))
+        break;
+    }
+    ok = ok && copy.ok && zero.ok;
+
+    double before = PerMediaSecond(copy.bytes_copied + copy.bytes, copy.media_seconds);
+    double after  = PerMediaSecond(zero.bytes_copied + zero.bytes, zero.media_seconds);
+
+    printf("    {\n");
+    printf("      \"name\": \"%s\",\n", argv[i]);
+    printf("      \"ok\": %s,\n", copy.ok && zero.ok ? "true" : "false");
+    printf("      \"modes\": {\n");
+    PrintMode("copy", copy, false);
+    PrintMode("zero_copy", zero, true);
+    printf("      },\n");
+    printf("      \"copies_saved_pct\": %.1f\n", before > 0.0 ? 100.0 * (before - after) / before : 0.0);
+    printf("    }%s\n", i + 1 < argc ? "," : "");
+  }
+  printf("  ]\n");
+  printf("}\n");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+// Drives an OMXPacketQueue from a producer and a consumer thread the way the
+// engine thread and OMXPlayerVideo/OMXPlayerAudio::Process() drive it: the
+// producer pushes at a fixed rate and waits in WaitForSpace() when the queue
+// is full, the consumer pops and parks in Wait() when it is empty. Prints a
+// JSON report with the enqueue->dequeue latency percentiles, the throughput
+// and the queue's park/stall counters for every rate, 0 meaning as fast as
+// it goes, and exits with 1 when a paced run couldn't keep up its rate:
+//   ./packet-queue-bench -r 1000,10000,100000,0 -t 5 > queue.json
+// Needs nothing but a compiler to build and run.
+
+#include "BenchUtils.h"
+#include "OMXPacketQueue.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+// paced producers sleep until this close to the next packet, then spin
+#define SPIN_NS 100000
+
+struct Options
+{
+  std::vector<int> rates;   // pkt/s, 0 for unthrottled
+  double   seconds;         // per paced rate
+  int      count;           // packets of the unthrottled run
+  int      size;            // bytes per packet
+  uint64_t max_bytes;
+};
+
+struct Run
+{
+  OMXPacketQueue      *queue;
+  char                *packets;    // OMX_PACKET_QUEUE_SLOTS of them, the queue only passes the pointers around
+  int                  count;
+  int                  rate;
+  // push time of every packet, the ring is FIFO so the n-th pop is the n-th push
+  std::vector<int64_t> pushed_ns;
+  std::vector<int64_t> latency_ns;
+};
+
+static void SleepUntilNs(int64_t due)
+{
+  int64_t now = NowNs();
+  if(due - now > SPIN_NS)
+  {
+    struct timespec ts;
+    int64_t wake = due - SPIN_NS;
+    ts.tv_sec  = wake / 1000000000LL;
+    ts.tv_nsec = wake % 1000000000LL;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+  }
+  while(NowNs() < due)
+    ;
+}
+
+static void *ConsumerThread(void *arg)
+{
+  Run *run = (Run *)arg;
+  int popped = 0;
+
+  while(popped < run->count)
+  {
+    OMXPacket *pkt = run->queue->Pop();
+    if(!pkt)
+    {
+      run->queue->Wait();
+      continue;
+    }
+    run->latency_ns[popped] = NowNs() - run->pushed_ns[popped];
+    popped++;
+  }
+  return NULL;
+}
+
+static double Percentile(const std::vector<int64_t> &sorted, double p)
+{
+  if(sorted.empty())
+    return 0.0;
+  size_t index = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+  return sorted[index] / 1000.0;
+}
+
+static bool RunRate(const Options &options, int rate, bool last)
+{
+  OMXPacketQueue queue;
+  queue.SetMaxBytes(options.max_bytes);
+
+  std::vector<char> packets(OMX_PACKET_QUEUE_SLOTS);
+
+  Run run;
+  run.queue   = &queue;
+  run.packets = &packets[0];
+  run.rate    = rate;
+  run.count   = rate > 0 ? std::max(1, (int)(rate * options.seconds)) : options.count;
+  run.pushed_ns.resize(run.count);
+  run.latency_ns.resize(run.count);
+
+  pthread_t consumer;
+  if(pthread_create(&consumer, NULL, ConsumerThread, &run) != 0)
+  {
+    fprintf(stderr, "could not start the consumer thread\n");
+    return false;
+  }
+
+  int64_t start = NowNs();
+  for(int i = 0; i < run.count; i++)
+  {
+    if(rate > 0)
+      SleepUntilNs(start + (int64_t)i * 1000000000LL / rate);
+
+    OMXPacket *pkt = (OMXPacket *)&run.packets[i & (OMX_PACKET_QUEUE_SLOTS - 1)];
+    run.pushed_ns[i] = NowNs();
+    while(!queue.Push(pkt, options.size))
+      queue.WaitForSpace(options.size, 100);
+  }
+  pthread_join(consumer, NULL);
+  double seconds = (NowNs() - start) / 1e9;
+
+  OMXPacketQueueStats stats = queue.GetStats();
+  double packets_s = seconds > 0.0 ? run.count / seconds : 0.0;
+  // a paced run has to keep its rate, give it 5% for the last interval and timer slack
+  bool ok = rate <= 0 || packets_s >= rate * 0.95;
+
+  std::sort(run.latency_ns.begin(), run.latency_ns.end());
+  printf("    { \"rate\": %d, \"ok\": %s, \"packets\": %d, \"seconds\": %.3f, \"packets_s\": %.0f, ",
+         rate, ok ? "true" : "false", run.count, seconds, packets_s);
+  printf("\"latency_us\": { \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, \"p999\": %.2f, \"max\": %.2f }, ",
+         Percentile(run.latency_ns, 0.5), Percentile(run.latency_ns, 0.9), Percentile(run.latency_ns, 0.99),
+         Percentile(run.latency_ns, 0.999), run.latency_ns.back() / 1000.0);
+  printf("\"parks\": %llu, \"stalls\": %llu, \"rejected\": %llu, \"blocked_us\": %llu }%s\n",
+         (unsigned long long)stats.parks, (unsigned long long)stats.stalls,
+         (unsigned long long)stats.rejected, (unsigned long long)stats.blocked_us, last ? "" : ",");
+  return ok;
+}
+
+static void Usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-r rates] [-t seconds] [-n packets] [-s bytes] [-q MB]\n", name);
+  fprintf(stderr, "  -r  comma separated pkt/s, 0 for as fast as it goes, default 1000,10000,100000,0\n");
+  fprintf(stderr, "  -t  seconds per paced rate, default 2\n");
+  fprintf(stderr, "  -n  packets of the unthrottled run, default 2000000\n");
+  fprintf(stderr, "  -s  bytes per packet, default 4096\n");
+  fprintf(stderr, "  -q  queue size in MB like OMXVideoConfig::queue_size, default 10\n");
+}
+
+static bool ParseRates(const char *arg, std::vector<int> &rates)
+{
+  rates.clear();
+  const char *p = arg;
+  while(*p)
+  {
+    char *end;
+    long rate = strtol(p, &end, 10);
+    if(end == p || rate < 0)
+      return false;
+    rates.push_back((int)rate);
+    p = *end == ',' ? end + 1 : end;
+    if(*end && *end != ',')
+      return false;
+  }
+  return !rates.empty();
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  options.seconds   = 2.0;
+  options.count     = 2000000;
+  options.size      = 4096;
+  options.max_bytes = 10 * 1024 * 1024;
+  ParseRates("1000,10000,100000,0", options.rates);
+
+  int opt;
+  while((opt = getopt(argc, argv, "r:t:n:s:q:h")) != -1)
+  {
+    switch(opt)
+    {
+      case 'r':
+        if(!ParseRates(optarg, options.rates))
+        {
+          Usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 't':
+        options.seconds = std::max(0.1, atof(optarg));
+        break;
+      case 'n':
+        options.count = std::max(1, atoi(optarg));
+        break;
+      case 's':
+        options.size = std::max(1, atoi(optarg));
+        break;
+      case 'q':
+        options.max_bytes = (uint64_t)(std::max(0.001, atof(optarg)) * 1024 * 1024);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+  if((uint64_t)options.size >= options.max_bytes)
+  {
+    fprintf(stderr, "a %d byte packet never fits a %llu byte queue\n", options.size, (unsigned long long)options.max_bytes);
+    return 1;
+  }
+
+  bool ok = true;
+  printf("{\n");
+  printf("  \"slots\": %d,\n", OMX_PACKET_QUEUE_SLOTS);
+  printf("  \"max_bytes\": %llu,\n", (unsigned long long)options.max_bytes);
+  printf("  \"packet_bytes\": %d,\n", options.size);
+  printf("  \"runs\": [\n");
+  for(size_t i = 0; i < options.rates.size(); i++)
+  {
+    if(!RunRate(options, options.rates[i], i + 1 == options.rates.size()))
+      ok = false;
+    fflush(stdout);
+  }
+  printf("  ],\n");
+  printf("  \"ok\": %s\n", ok ? "true" : "false");
+  printf("}\n");
+
+  return ok ? 0 : 1;
+}
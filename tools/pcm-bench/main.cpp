@@ -0,0 +1,448 @@
+// Micro-benchmark for the software downmix in src/utils/PCMRemap.cpp and the
+// kernels in src/PCMUtils.cpp.
+//
+// Mixes a few seconds of synthetic S16 and planar float audio through
+// CPCMRemap with every kernel set the cpu supports, checks the result against
+// a straightforward interleaved scalar mix (the way CPCMRemap used to do it)
+// and reports input samples per second. Then packs planar float frames into
+// interleaved S16/S32 decoder buffers the way COMXAudio::AddFrame() does with
+// OMXAudioConfig::pack_s32, next to the per channel memcpy of planar buffers
+// it does by default. Builds on any Linux box, no OMX or ffmpeg needed.
+
+#include "BenchUtils.h"
+#include "PCMUtils.h"
+#include "utils/PCMRemap.h"
+#include "utils/log.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static const unsigned int SAMPLE_RATE = 48000;
+// what AddPackets() hands over for one decoded AC3 frame
+static const unsigned int PACKET_SAMPLES = 1536;
+
+struct Layout
+{
+  const char       *name;
+  unsigned int      channels;
+  enum PCMChannels  map[8];
+};
+
+// input in ffmpeg order, output in CEA order padded like BuildChannelMapCEA() does
+static const Layout g_stereo   = { "2.0", 2, { PCM_FRONT_LEFT, PCM_FRONT_RIGHT } };
+static const Layout g_surround = { "5.1", 6, { PCM_FRONT_LEFT, PCM_FRONT_RIGHT, PCM_FRONT_CENTER, PCM_LOW_FREQUENCY, PCM_BACK_LEFT, PCM_BACK_RIGHT } };
+static const Layout g_wide     = { "7.1", 8, { PCM_FRONT_LEFT, PCM_FRONT_RIGHT, PCM_FRONT_CENTER, PCM_LOW_FREQUENCY, PCM_BACK_LEFT, PCM_BACK_RIGHT, PCM_SIDE_LEFT, PCM_SIDE_RIGHT } };
+static const Layout g_out_2_0  = { "2.0", 2, { PCM_FRONT_LEFT, PCM_FRONT_RIGHT } };
+static const Layout g_out_5_1  = { "5.1", 8, { PCM_FRONT_LEFT, PCM_FRONT_RIGHT, PCM_LOW_FREQUENCY, PCM_FRONT_CENTER, PCM_BACK_LEFT, PCM_BACK_RIGHT, PCM_INVALID, PCM_INVALID } };
+
+struct Case
+{
+  const Layout   *in;
+  const Layout   *out;
+  enum PCMLayout  layout;
+  bool            dontnormalize; // levels can add up past 1, so the limiter kicks in
+  float           gain;
+};
+
+static const Case g_cases[] =
+{
+  { &g_stereo,   &g_out_2_0, PCM_LAYOUT_2_0, false, 1.0f },
+  { &g_stereo,   &g_out_2_0, PCM_LAYOUT_2_0, false, 2.0f },
+  { &g_surround, &g_out_2_0, PCM_LAYOUT_2_0, false, 1.0f },
+  { &g_surround, &g_out_2_0, PCM_LAYOUT_2_0, true,  1.0f },
+  { &g_wide,     &g_out_2_0, PCM_LAYOUT_2_0, true,  0.8f },
+  { &g_wide,     &g_out_5_1, PCM_LAYOUT_5_1, false, 1.0f },
+};
+
+// a tone per channel with the odd loud burst, so the limiter has work to do
+static void MakeSignal(std::vector<float> &planar, unsigned int channels, unsigned int samples)
+{
+  planar.resize(channels * samples);
+  unsigned int seed = 1;
+  for(unsigned int c = 0; c < channels; c++)
+  {
+    float freq = 110.0f * (c + 1) / SAMPLE_RATE;
+    for(unsigned int s = 0; s < samples; s++)
+    {
+      float level = (s / (SAMPLE_RATE / 4)) % 3 == 2 ? 0.98f : 0.4f;
+      seed = seed * 1103515245 + 12345;
+      float noise = ((seed >> 16) & 0x7fff) / 32768.0f - 0.5f;
+      planar[c * samples + s] = level * sinf(2.0f * (float)M_PI * freq * s) + 0.02f * noise;
+    }
+  }
+}
+
+// the old CPCMRemap::Remap(): interleaved strided mix, then the gain, then the
+// limiter on S16 scaled values, one sample at a time
+class CLegacyRemap
+{
+public:
+  CLegacyRemap(const float *matrix, unsigned int in_channels, unsigned int out_channels, float gain)
+    : m_in(in_channels), m_out(out_channels), m_gain(gain),
+      m_attenuation(1.0f), m_attenuationInc(0.0f), m_holdCounter(0)
+  {
+    memcpy(m_matrix, matrix, sizeof(m_matrix));
+    m_highestGain = 1.0f;
+    for(unsigned int o = 0; o < m_out; o++)
+    {
+      float sum = 0.0f;
+      for(unsigned int i = 0; i < m_in; i++)
+        sum += m_matrix[8 * o + i] * gain;
+      m_highestGain = std::max(m_highestGain, sum);
+    }
+  }
+
+  void Remap(const int16_t *in, int16_t *out, unsigned int samples)
+  {
+    m_buf.assign(samples * m_out, 0.0f);
+    for(unsigned int o = 0; o < m_out; o++)
+      for(unsigned int i = 0; i < m_in; i++)
+      {
+        float level = m_matrix[8 * o + i];
+        if(level == 0.0f)
+          continue;
+        const int16_t *src = in + i;
+        for(float *dst = &m_buf[o], *end = dst + samples * m_out; dst < end; dst += m_out, src += m_in)
+          *dst += *src * level;
+      }
+
+    if(m_gain != 1.0f)
+      for(size_t i = 0; i < m_buf.size(); i++)
+        m_buf[i] *= m_gain;
+
+    if(m_highestGain > 1.0001f)
+      Limiter(samples);
+
+    for(size_t i = 0; i < m_buf.size(); i++)
+      out[i] = (int16_t)lrintf(std::min(std::max(m_buf[i], -32768.0f), 32767.0f));
+  }
+
+private:
+  void Limiter(unsigned int samples)
+  {
+    for(unsigned int i = 0; i < samples; i++)
+    {
+      float *frame = &m_buf[i * m_out];
+      float maxAbs = 0.0f;
+      for(unsigned int o = 0; o < m_out; o++)
+        maxAbs = std::max(maxAbs, fabsf(frame[o]) / 32768.0f);
+
+      float attenuatedAbs = maxAbs * m_attenuation;
+      if(attenuatedAbs > 1.0f)
+      {
+        m_attenuation = 1.0f / maxAbs;
+        m_attenuationInc = 1.0f - m_attenuation;
+        m_holdCounter = lrintf(SAMPLE_RATE * 0.025f);
+      }
+      else if(m_attenuation < 1.0f && attenuatedAbs > 0.95f)
+      {
+        m_attenuationInc = 1.0f - m_attenuation;
+        m_holdCounter = lrintf(SAMPLE_RATE * 0.025f);
+      }
+
+      for(unsigned int o = 0; o < m_out; o++)
+        frame[o] *= m_attenuation;
+
+      if(m_holdCounter)
+        m_holdCounter--;
+      else if(m_attenuationInc > 0.0f)
+      {
+        m_attenuation += m_attenuationInc / SAMPLE_RATE / 0.1f;
+        if(m_attenuation > 1.0f)
+        {
+          m_attenuation = 1.0f;
+          m_attenuationInc = 0.0f;
+        }
+      }
+    }
+  }
+
+  float              m_matrix[8 * 8];
+  unsigned int       m_in;
+  unsigned int       m_out;
+  float              m_gain;
+  float              m_highestGain;
+  float              m_attenuation;
+  float              m_attenuationInc;
+  int                m_holdCounter;
+  std::vector<float> m_buf;
+};
+
+static bool SetupRemap(CPCMRemap &remap, const Case &c)
+{
+  enum PCMChannels in_map[8], out_map[8];
+  memcpy(in_map, c.in->map, sizeof(in_map));
+  memcpy(out_map, c.out->map, sizeof(out_map));
+  remap.Reset();
+  remap.SetInputFormat(c.in->channels, in_map, sizeof(int16_t), SAMPLE_RATE, c.layout, c.dontnormalize);
+  remap.SetOutputFormat(c.out->channels, out_map);
+  return remap.CanRemap();
+}
+
+// largest difference in LSB
+static int Compare(const std::vector<int16_t> &a, const std::vector<int16_t> &b)
+{
+  int diff = 0;
+  for(size_t i = 0; i < a.size(); i++)
+    diff = std::max(diff, abs(a[i] - b[i]));
+  return diff;
+}
+
+static void Report(const char *name, unsigned int samples, int passes, double seconds, int diff)
+{
+  double rate = seconds > 0 ? (double)samples * passes / seconds / 1e6 : 0.0;
+  if(diff < 0)
+    printf("    %-18s %8.1f Msamples/s\n", name, rate);
+  else
+    printf("    %-18s %8.1f Msamples/s  max diff %d\n", name, rate, diff);
+}
+
+// runs pass() until min_seconds have gone by, returns the passes done
+template<typename F> static int Run(double min_seconds, double &seconds, F pass)
+{
+  int passes = 0;
+  double start = Now();
+  do
+  {
+    pass();
+    passes++;
+    seconds = Now() - start;
+  } while(seconds < min_seconds);
+  return passes;
+}
+
+static int BenchCase(const Case &c, double min_seconds, int tolerance)
+{
+  const unsigned int samples = SAMPLE_RATE * 4 / PACKET_SAMPLES * PACKET_SAMPLES;
+  const unsigned int in_ch  = c.in->channels;
+  const unsigned int out_ch = c.out->channels;
+
+  std::vector<float> planar;
+  MakeSignal(planar, in_ch, samples);
+  std::vector<int16_t> interleaved(in_ch * samples);
+  std::vector<const float *> planes(in_ch);
+  for(unsigned int ch = 0; ch < in_ch; ch++)
+  {
+    planes[ch] = &planar[ch * samples];
+    for(unsigned int s = 0; s < samples; s++)
+      interleaved[s * in_ch + ch] = (int16_t)lrintf(std::min(std::max(planes[ch][s] * 32768.0f, -32768.0f), 32767.0f));
+  }
+  // the reference reads the S16, so quantise the float input the same way
+  for(unsigned int ch = 0; ch < in_ch; ch++)
+    for(unsigned int s = 0; s < samples; s++)
+      planar[ch * samples + s] = interleaved[s * in_ch + ch] / 32768.0f;
+
+  CPCMRemap remap;
+  if(!SetupRemap(remap, c))
+  {
+    fprintf(stderr, "%s -> %s: remap not set up\n", c.in->name, c.out->name);
+    return 1;
+  }
+  float matrix[8 * 8];
+  remap.GetDownmixMatrix(matrix);
+
+  printf("  %s -> %s%s gain %.1f\n", c.in->name, c.out->name, c.dontnormalize ? " (not normalised)" : "", c.gain);
+
+  std::vector<int16_t> expected(out_ch * samples), out(out_ch * samples);
+  double seconds;
+  int passes = Run(min_seconds, seconds, [&]()
+  {
+    CLegacyRemap legacy(matrix, in_ch, out_ch, c.gain);
+    for(unsigned int s = 0; s < samples; s += PACKET_SAMPLES)
+      legacy.Remap(&interleaved[s * in_ch], &expected[s * out_ch], PACKET_SAMPLES);
+  });
+  Report("legacy-s16", samples, passes, seconds, -1);
+
+  int ret = 0;
+  const PCMKernels kernels[] = { PCM_KERNELS_C, PCM_KERNELS_SIMD, PCM_KERNELS_AVX2 };
+  for(size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+  {
+    if(!pcm_set_kernels(kernels[k]))
+      continue;
+
+    // a fresh remap every pass so the limiter starts from the same state
+    std::string name = std::string(pcm_get_kernels_name()) + "-s16";
+    passes = Run(min_seconds, seconds, [&]()
+    {
+      SetupRemap(remap, c);
+      for(unsigned int s = 0; s < samples; s += PACKET_SAMPLES)
+        remap.Remap(&interleaved[s * in_ch], &out[s * out_ch], PACKET_SAMPLES, c.gain);
+    });
+    int diff = Compare(expected, out);
+    Report(name.c_str(), samples, passes, seconds, diff);
+    if(diff > tolerance)
+      ret = 1;
+
+    name = std::string(pcm_get_kernels_name()) + "-float";
+    std::vector<const float *> packet(in_ch);
+    passes = Run(min_seconds, seconds, [&]()
+    {
+      SetupRemap(remap, c);
+      for(unsigned int s = 0; s < samples; s += PACKET_SAMPLES)
+      {
+        for(unsigned int ch = 0; ch < in_ch; ch++)
+          packet[ch] = planes[ch] + s;
+        remap.Remap(&packet[0], &out[s * out_ch], PACKET_SAMPLES, c.gain);
+      }
+    });
+    diff = Compare(expected, out);
+    Report(name.c_str(), samples, passes, seconds, diff);
+    if(diff > tolerance)
+      ret = 1;
+  }
+  pcm_set_kernels(PCM_KERNELS_AUTO);
+
+  if(ret)
+    fprintf(stderr, "  %s -> %s: output differs from the scalar mix by more than %d LSB\n", c.in->name, c.out->name, tolerance);
+  return ret;
+}
+
+// largest difference between two S32 buffers
+static int64_t Compare(const std::vector<int32_t> &a, const std::vector<int32_t> &b)
+{
+  int64_t diff = 0;
+  for(size_t i = 0; i < a.size(); i++)
+    diff = std::max(diff, std::abs((int64_t)a[i] - (int64_t)b[i]));
+  return diff;
+}
+
+// planar float frames into 32 KB decoder buffers, several frames to a buffer
+static int BenchPack(unsigned int channels, double min_seconds)
+{
+  const unsigned int samples = SAMPLE_RATE * 4 / PACKET_SAMPLES * PACKET_SAMPLES;
+  const unsigned int buffer_bytes = 32 * 1024;
+
+  std::vector<float> planar;
+  MakeSignal(planar, channels, samples);
+  std::vector<const float *> planes(channels);
+
+  printf("  pack %u channels\n", channels);
+
+  // what GetData() and AddPackets() did: frames concatenated into one buffer,
+  // then one memcpy per channel per frame into planar decoder buffers
+  const unsigned int frame_bytes = PACKET_SAMPLES * sizeof(float);
+  const unsigned int frames_per_buffer = std::max(1u, buffer_bytes / (frame_bytes * channels));
+  std::vector<uint8_t> concat(frames_per_buffer * frame_bytes * channels);
+  std::vector<uint8_t> buffer(frames_per_buffer * frame_bytes * channels);
+  double seconds;
+  int passes = Run(min_seconds, seconds, [&]()
+  {
+    for(unsigned int s = 0; s < samples; s += PACKET_SAMPLES * frames_per_buffer)
+    {
+      unsigned int frames = std::min(samples - s, PACKET_SAMPLES * frames_per_buffer) / PACKET_SAMPLES;
+      for(unsigned int f = 0; f < frames; f++)
+        for(unsigned int c = 0; c < channels; c++)
+          memcpy(&concat[(f * channels + c) * frame_bytes], &planar[c * samples + s + f * PACKET_SAMPLES], frame_bytes);
+      for(unsigned int f = 0; f < frames; f++)
+        for(unsigned int c = 0; c < channels; c++)
+          memcpy(&buffer[(c * frames + f) * frame_bytes], &concat[(f * channels + c) * frame_bytes], frame_bytes);
+    }
+  });
+  Report("legacy-planar-copy", samples, passes, seconds, -1);
+
+  std::vector<int32_t> expected32(channels * samples), out32(channels * samples);
+  std::vector<int16_t> expected16(channels * samples), out16(channels * samples);
+  int ret = 0;
+  const PCMKernels kernels[] = { PCM_KERNELS_C, PCM_KERNELS_SIMD, PCM_KERNELS_AVX2 };
+  for(size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+  {
+    if(!pcm_set_kernels(kernels[k]))
+      continue;
+
+    std::string name = std::string(pcm_get_kernels_name()) + "-s32";
+    passes = Run(min_seconds, seconds, [&]()
+    {
+      for(unsigned int s = 0; s < samples; s += PACKET_SAMPLES)
+      {
+        for(unsigned int c = 0; c < channels; c++)
+          planes[c] = &planar[c * samples + s];
+        pcm_planar_to_s32(&out32[s * channels], &planes[0], channels, PACKET_SAMPLES);
+      }
+    });
+    if(kernels[k] == PCM_KERNELS_C)
+      expected32 = out32;
+    // kernels may round or truncate the bits below 24
+    int64_t diff32 = Compare(expected32, out32);
+    Report(name.c_str(), samples, passes, seconds, (int)std::min(diff32, (int64_t)INT32_MAX));
+    if(diff32 > 256)
+      ret = 1;
+
+    name = std::string(pcm_get_kernels_name()) + "-s16";
+    passes = Run(min_seconds, seconds, [&]()
+    {
+      for(unsigned int s = 0; s < samples; s += PACKET_SAMPLES)
+      {
+        for(unsigned int c = 0; c < channels; c++)
+          planes[c] = &planar[c * samples + s];
+        pcm_planar_to_s16(&out16[s * channels], &planes[0], channels, PACKET_SAMPLES);
+      }
+    });
+    if(kernels[k] == PCM_KERNELS_C)
+      expected16 = out16;
+    int diff16 = Compare(expected16, out16);
+    Report(name.c_str(), samples, passes, seconds, diff16);
+    if(diff16 > 0)
+      ret = 1;
+  }
+  pcm_set_kernels(PCM_KERNELS_AUTO);
+
+  // the S32 has to be the float scaled up, whichever kernel made it
+  for(size_t i = 0; i < out32.size() && !ret; i++)
+  {
+    unsigned int c = i % channels, s = i / channels;
+    if(fabsf(out32[i] / 2147483648.0f - planar[c * samples + s]) > 1e-6f)
+      ret = 1;
+  }
+  if(ret)
+    fprintf(stderr, "  pack %u channels: kernels disagree\n", channels);
+  return ret;
+}
+
+static void Usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-t seconds] [-d lsb] [-v]\n", name);
+  fprintf(stderr, "  -t  minimum run time of every mode, default 0.5\n");
+  fprintf(stderr, "  -d  largest difference to the scalar mix that still passes, default 2\n");
+  fprintf(stderr, "  -v  log what CPCMRemap logs\n");
+}
+
+int main(int argc, char **argv)
+{
+  double min_seconds = 0.5;
+  int tolerance = 2;
+  int opt;
+  while((opt = getopt(argc, argv, "t:d:vh")) != -1)
+  {
+    switch(opt)
+    {
+      case 't':
+        min_seconds = atof(optarg);
+        break;
+      case 'd':
+        tolerance = atoi(optarg);
+        break;
+      case 'v':
+        SetBenchLogLevel(LOGDEBUG);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  int ret = 0;
+  for(size_t i = 0; i < sizeof(g_cases) / sizeof(g_cases[0]); i++)
+    ret |= BenchCase(g_cases[i], min_seconds, tolerance);
+  const unsigned int pack_channels[] = { 1, 2, 6, 8 };
+  for(size_t i = 0; i < sizeof(pack_channels) / sizeof(pack_channels[0]); i++)
+    ret |= BenchPack(pack_channels[i], min_seconds);
+  return ret;
+}
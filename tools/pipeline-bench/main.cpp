@@ -0,0 +1,546 @@
+// Headless benchmark for the decode side of the player.
+//
+// Runs every file of a corpus through the same classes the player uses,
+// as fast as they go and into null sinks:
+//   demux          OMXReader::Read()
+//   video_convert  CBitstreamConverter, Annex B written into 80 KB scratch
+//                  buffers the way COMXVideo::Decode() fills decoder buffers
+//   audio_decode   COMXAudioCodecOMX::Decode() + GetFrame()
+//   audio_remap    CPCMRemap::Remap(), the software downmix used for omx:alsa
+// and prints a JSON report to stdout: per stage packets/s, MB/s, audio
+// samples/s, p50/p99 latency per packet and heap allocations per packet,
+// plus the peak RSS of the process. Diff it between commits, e.g.
+//   ./pipeline-bench -n 3 corpus/*.mp4 > before.json
+// Needs ffmpeg and the VideoCore headers to build, no display or GPU to run.
+
+#include "BenchUtils.h"
+#include "OMXReader.h"
+#include "BitstreamConverter.h"
+#include "OMXAudioCodecOMX.h"
+#include "OMXClock.h"
+#include "PCMUtils.h"
+#include "utils/PCMRemap.h"
+#include "utils/log.h"
+
+#include <errno.h>
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// heap allocations, counted by wrapping the glibc allocator. Per stage
+// figures use the calling thread's count, the totals include the demux
+// thread when prefetching
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t nmemb, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_memalign(size_t alignment, size_t size);
+extern "C" void  __libc_free(void *ptr);
+
+static std::atomic<uint64_t> g_allocs(0);
+static __thread uint64_t     t_allocs;
+
+static inline void CountAlloc()
+{
+  g_allocs.fetch_add(1, std::memory_order_relaxed);
+  t_allocs++;
+}
+
+extern "C" void *malloc(size_t size)
+{
+  CountAlloc();
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t nmemb, size_t size)
+{
+  CountAlloc();
+  return __libc_calloc(nmemb, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+  CountAlloc();
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void *memalign(size_t alignment, size_t size)
+{
+  CountAlloc();
+  return __libc_memalign(alignment, size);
+}
+
+extern "C" void *aligned_alloc(size_t alignment, size_t size)
+{
+  CountAlloc();
+  return __libc_memalign(alignment, size);
+}
+
+extern "C" int posix_memalign(void **ptr, size_t alignment, size_t size)
+{
+  CountAlloc();
+  void *p = __libc_memalign(alignment, size);
+  if(!p)
+    return ENOMEM;
+  *ptr = p;
+  return 0;
+}
+
+extern "C" void free(void *ptr)
+{
+  __libc_free(ptr);
+}
+
+struct Stage
+{
+  uint64_t            packets;
+  uint64_t            bytes;    // input bytes
+  uint64_t            samples;  // audio frames, 0 for video stages
+  uint64_t            allocs;
+  double              seconds;
+  std::vector<double> latency;  // seconds per packet
+
+  Stage() : packets(0), bytes(0), samples(0), allocs(0), seconds(0) {}
+
+  void Add(const Stage &other)
+  {
+    packets += other.packets;
+    bytes   += other.bytes;
+    samples += other.samples;
+    allocs  += other.allocs;
+    seconds += other.seconds;
+    latency.insert(latency.end(), other.latency.begin(), other.latency.end());
+  }
+};
+
+enum
+{
+  STAGE_DEMUX,
+  STAGE_VIDEO_CONVERT,
+  STAGE_AUDIO_DECODE,
+  STAGE_AUDIO_REMAP,
+  STAGE_COUNT
+};
+
+static const char *g_stage_names[STAGE_COUNT] = { "demux", "video_convert", "audio_decode", "audio_remap" };
+
+// brackets one packet's worth of work in a stage
+class StageTimer
+{
+public:
+  StageTimer(Stage &stage) : m_stage(stage), m_allocs(t_allocs), m_start(Now()) {}
+  void Done(uint64_t bytes, uint64_t samples = 0)
+  {
+    double elapsed = Now() - m_start;
+    m_stage.allocs += t_allocs - m_allocs;
+    m_stage.packets++;
+    m_stage.bytes   += bytes;
+    m_stage.samples += samples;
+    m_stage.seconds += elapsed;
+    m_stage.latency.push_back(elapsed);
+  }
+private:
+  Stage    &m_stage;
+  uint64_t  m_allocs;
+  double    m_start;
+};
+
+struct FileResult
+{
+  std::string name;
+  bool        ok;
+  double      wall_seconds;
+  uint64_t    allocs;         // process wide, all threads
+  uint64_t    pool_allocs;
+  uint64_t    pool_hits;
+  uint64_t    bytes_copied;
+  uint64_t    bytes_adopted;
+  double      media_seconds;
+  Stage       stages[STAGE_COUNT];
+};
+
+struct Options
+{
+  int          passes;
+  bool         zero_copy;
+  bool         mmap;
+  unsigned int prefetch_kb;
+  bool         video;
+  bool         audio;
+  PCMLayout    layout;
+};
+
+// the software downmix COMXAudio does for omx:alsa, which has no audio_mixer
+struct Downmix
+{
+  bool                 enabled;
+  unsigned int         in_channels;
+  unsigned int         out_channels;
+  CPCMRemap            remap;
+  std::vector<int16_t> out;
+};
+
+static bool SetupDownmix(Downmix &mix, COMXAudioCodecOMX &codec, PCMLayout layout, int samplerate)
+{
+  mix.enabled = false;
+  mix.in_channels = codec.GetChannels();
+  uint64_t channel_map = codec.GetChannelMap();
+  if(!channel_map || mix.in_channels == 0 || mix.in_channels > 8)
+    return false;
+
+  if(channel_map == (AV_CH_FRONT_LEFT | AV_CH_FRONT_RIGHT) || channel_map == AV_CH_FRONT_CENTER)
+    layout = PCM_LAYOUT_2_0;
+
+  enum PCMChannels in_layout[PCM_MAX_CH];
+  enum PCMChannels out_layout[PCM_MAX_CH];
+  pcm_build_channel_map(in_layout, channel_map);
+  mix.out_channels = pcm_build_channel_map_cea(out_layout, pcm_get_channel_layout(layout));
+
+  mix.remap.Reset();
+  mix.remap.SetInputFormat(mix.in_channels, in_layout, codec.GetBitsPerSample() / 8, samplerate, layout, false);
+  mix.remap.SetOutputFormat(mix.out_channels, out_layout);
+  mix.enabled = mix.remap.CanRemap();
+  return mix.enabled;
+}
+
+// frames as GetFrame() hands them out: S16 interleaved, float planar
+static unsigned int ApplyDownmix(Downmix &mix, uint8_t **planes, unsigned int samples, int bits)
+{
+  mix.out.resize(samples * mix.out_channels);
+  int16_t *out = &mix.out[0];
+
+  if(bits == 16)
+    mix.remap.Remap((const int16_t *)planes[0], out, samples);
+  else
+    mix.remap.Remap((const float *const *)planes, out, samples);
+  return samples;
+}
+
+static bool BenchFile(const char *path, const Options &options, FileResult &result)
+{
+  result.name = path;
+  result.ok   = false;
+
+  OMXReader reader;
+  reader.SetZeroCopy(options.zero_copy);
+  reader.SetMmap(options.mmap);
+  if(!reader.Open(path, false))
+  {
+    fprintf(stderr, "could not open %s\n", path);
+    return false;
+  }
+  if(!options.video)
+    reader.SetStreamEnabled(OMXSTREAM_VIDEO, false);
+  if(!options.audio)
+    reader.SetStreamEnabled(OMXSTREAM_AUDIO, false);
+
+  bool has_video = options.video && reader.VideoStreamCount() > 0;
+  bool has_audio = options.audio && reader.AudioStreamCount() > 0;
+
+  CBitstreamConverter converter;
+  bool convert = false;
+  std::vector<uint8_t> scratch(80 * 1024);
+  if(has_video)
+  {
+    COMXStreamInfo hints;
+    reader.GetHints(OMXSTREAM_VIDEO, hints);
+    convert = converter.Open(hints.codec, (uint8_t *)hints.extradata, hints.extrasize, true) && converter.NeedConvert();
+  }
+
+  COMXAudioCodecOMX codec;
+  Downmix mix;
+  mix.enabled = false;
+  int bits = 0;
+  if(has_audio)
+  {
+    COMXStreamInfo hints;
+    reader.GetHints(OMXSTREAM_AUDIO, hints);
+    if(!codec.Open(hints, options.layout))
+    {
+      fprintf(stderr, "%s: no decoder for the audio stream\n", path);
+      has_audio = false;
+    }
+    else
+    {
+      bits = codec.GetBitsPerSample();
+      SetupDownmix(mix, codec, options.layout, codec.GetSampleRate());
+    }
+  }
+
+  if(options.prefetch_kb)
+    reader.StartPrefetch(options.prefetch_kb * 1024, 0);
+
+  uint64_t allocs = g_allocs.load();
+  double start = Now();
+
+  while(true)
+  {
+    StageTimer demux(result.stages[STAGE_DEMUX]);
+    OMXPacket *pkt = reader.Read();
+    if(!pkt)
+    {
+      if(reader.IsEof())
+        break;
+      continue;
+    }
+    demux.Done(pkt->size);
+
+    if(has_video && reader.IsActive(OMXSTREAM_VIDEO, pkt->stream_index))
+    {
+      StageTimer timer(result.stages[STAGE_VIDEO_CONVERT]);
+      if(convert)
+      {
+        if(converter.ConvertBegin(pkt->data, pkt->size))
+        {
+          while(!converter.ConvertDone())
+            converter.ConvertWrite(&scratch[0], scratch.size());
+        }
+      }
+      else
+      {
+        // same copy into decoder sized buffers when there is nothing to convert
+        for(int offset = 0; offset < pkt->size; offset += scratch.size())
+          memcpy(&scratch[0], pkt->data + offset, std::min((int)scratch.size(), pkt->size - offset));
+      }
+      timer.Done(pkt->size);
+    }
+    else if(has_audio && reader.IsActive(OMXSTREAM_AUDIO, pkt->stream_index))
+    {
+      const uint8_t *data = pkt->data;
+      int            size = pkt->size;
+      double dts = pkt->dts, pts = pkt->pts;
+      while(size > 0)
+      {
+        StageTimer timer(result.stages[STAGE_AUDIO_DECODE]);
+        int len = codec.Decode((BYTE *)data, size, dts, pts);
+        if(len < 0 || len > size)
+        {
+          codec.Reset();
+          break;
+        }
+        data += len;
+        size -= len;
+
+        uint8_t **planes;
+        int samples = codec.GetFrame(&planes, dts, pts);
+        timer.Done(len, samples > 0 ? samples : 0);
+
+        if(samples <= 0 || !mix.enabled)
+          continue;
+
+        StageTimer remap(result.stages[STAGE_AUDIO_REMAP]);
+        ApplyDownmix(mix, planes, samples, bits);
+        remap.Done(samples * codec.GetChannels() * (bits >> 3), samples);
+      }
+    }
+
+    OMXReader::FreePacket(pkt);
+  }
+
+  result.wall_seconds = Now() - start;
+  result.allocs = g_allocs.load() - allocs;
+
+  OMXPacketPoolStats pool = reader.GetPacketPoolStats();
+  OMXReaderCopyStats copy = reader.GetCopyStats();
+  result.pool_allocs   = pool.allocs;
+  result.pool_hits     = pool.hits;
+  result.bytes_copied  = copy.bytes_copied;
+  result.bytes_adopted = copy.bytes_adopted;
+  result.media_seconds = copy.media_seconds;
+
+  if(has_audio)
+    codec.Dispose();
+  converter.Close();
+  reader.Close();
+  result.ok = true;
+  return true;
+}
+
+static double Percentile(std::vector<double> &values, double p)
+{
+  if(values.empty())
+    return 0.0;
+  size_t n = std::min(values.size() - 1, (size_t)(p * values.size()));
+  std::nth_element(values.begin(), values.begin() + n, values.end());
+  return values[n];
+}
+
+static double PerSecond(double value, double seconds)
+{
+  return seconds > 0 ? value / seconds : 0.0;
+}
+
+static void PrintStage(const char *name, Stage &stage, bool last)
+{
+  printf("        \"%s\": {\n", name);
+  printf("          \"packets\": %llu,\n", (unsigned long long)stage.packets);
+  printf("          \"bytes\": %llu,\n", (unsigned long long)stage.bytes);
+  printf("          \"seconds\": %.6f,\n", stage.seconds);
+  printf("          \"packets_per_sec\": %.1f,\n", PerSecond(stage.packets, stage.seconds));
+  printf("          \"mb_per_sec\": %.3f,\n", PerSecond(stage.bytes / (1024.0 * 1024.0), stage.seconds));
+  printf("          \"samples_per_sec\": %.1f,\n", PerSecond(stage.samples, stage.seconds));
+  printf("          \"p50_us\": %.2f,\n", Percentile(stage.latency, 0.50) * 1e6);
+  printf("          \"p99_us\": %.2f,\n", Percentile(stage.latency, 0.99) * 1e6);
+  printf("          \"allocs_per_packet\": %.3f\n", stage.packets ? (double)stage.allocs / stage.packets : 0.0);
+  printf("        }%s\n", last ? "" : ",");
+}
+
+static void PrintString(const std::string &value)
+{
+  putchar('"');
+  for(size_t i = 0; i < value.size(); i++)
+  {
+    unsigned char c = value[i];
+    if(c == '"' || c == '\\')
+      printf("\\%c", c);
+    else if(c < 0x20)
+      printf("\\u%04x", c);
+    else
+      putchar(c);
+  }
+  putchar('"');
+}
+
+static void PrintResult(FileResult &result, bool last)
+{
+  uint64_t packets = result.stages[STAGE_DEMUX].packets;
+  printf("    {\n");
+  printf("      \"file\": ");
+  PrintString(result.name);
+  printf(",\n");
+  printf("      \"ok\": %s,\n", result.ok ? "true" : "false");
+  printf("      \"wall_seconds\": %.6f,\n", result.wall_seconds);
+  printf("      \"media_seconds\": %.3f,\n", result.media_seconds);
+  printf("      \"realtime_factor\": %.2f,\n", PerSecond(result.media_seconds, result.wall_seconds));
+  printf("      \"allocs_per_packet\": %.3f,\n", packets ? (double)result.allocs / packets : 0.0);
+  printf("      \"packet_pool_hit_rate\": %.4f,\n", result.pool_allocs ? (double)result.pool_hits / result.pool_allocs : 0.0);
+  printf("      \"bytes_copied\": %llu,\n", (unsigned long long)result.bytes_copied);
+  printf("      \"bytes_adopted\": %llu,\n", (unsigned long long)result.bytes_adopted);
+  printf("      \"stages\": {\n");
+  for(int i = 0; i < STAGE_COUNT; i++)
+    PrintStage(g_stage_names[i], result.stages[i], i == STAGE_COUNT - 1);
+  printf("      }\n");
+  printf("    }%s\n", last ? "" : ",");
+}
+
+static void Usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-n passes] [-z] [-m] [-p kb] [-l layout] [-V] [-A] [-v] file [file ...]\n", name);
+  fprintf(stderr, "  -n  times every file is run, default 1\n");
+  fprintf(stderr, "  -z  zero copy packets\n");
+  fprintf(stderr, "  -m  read files through mmap\n");
+  fprintf(stderr, "  -p  demux on a prefetch thread with a queue of kb kilobytes\n");
+  fprintf(stderr, "  -l  downmix layout, 0 (2.0) to 9 (7.1), default 0\n");
+  fprintf(stderr, "  -V  skip video, -A skip audio\n");
+  fprintf(stderr, "  -v  log to stderr\n");
+}
+
+int main(int argc, char **argv)
+{
+  Options options;
+  options.passes      = 1;
+  options.zero_copy   = false;
+  options.mmap        = false;
+  options.prefetch_kb = 0;
+  options.video       = true;
+  options.audio       = true;
+  options.layout      = PCM_LAYOUT_2_0;
+
+  int opt;
+  while((opt = getopt(argc, argv, "n:zmp:l:VAvh")) != -1)
+  {
+    switch(opt)
+    {
+      case 'n':
+        options.passes = std::max(1, atoi(optarg));
+        break;
+      case 'z':
+        options.zero_copy = true;
+        break;
+      case 'm':
+        options.mmap = true;
+        break;
+      case 'p':
+        options.prefetch_kb = atoi(optarg);
+        break;
+      case 'l':
+        options.layout = (PCMLayout)std::min(std::max(atoi(optarg), 0), (int)PCM_MAX_LAYOUT - 1);
+        break;
+      case 'V':
+        options.video = false;
+        break;
+      case 'A':
+        options.audio = false;
+        break;
+      case 'v':
+        SetBenchLogLevel(LOGDEBUG);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if(optind >= argc)
+  {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  std::vector<FileResult> results;
+  FileResult total;
+  total.name = "total";
+  total.ok = true;
+  total.wall_seconds = total.media_seconds = 0;
+  total.allocs = total.pool_allocs = total.pool_hits = total.bytes_copied = total.bytes_adopted = 0;
+
+  for(int pass = 0; pass < options.passes; pass++)
+  {
+    for(int i = optind; i < argc; i++)
+    {
+      FileResult result;
+      result.wall_seconds = result.media_seconds = 0;
+      result.allocs = result.pool_allocs = result.pool_hits = result.bytes_copied = result.bytes_adopted = 0;
+      BenchFile(argv[i], options, result);
+
+      total.ok            &= result.ok;
+      total.wall_seconds  += result.wall_seconds;
+      total.media_seconds += result.media_seconds;
+      total.allocs        += result.allocs;
+      total.pool_allocs   += result.pool_allocs;
+      total.pool_hits     += result.pool_hits;
+      total.bytes_copied  += result.bytes_copied;
+      total.bytes_adopted += result.bytes_adopted;
+      for(int s = 0; s < STAGE_COUNT; s++)
+        total.stages[s].Add(result.stages[s]);
+      results.push_back(result);
+    }
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  printf("{\n");
+  printf("  \"passes\": %d,\n", options.passes);
+  printf("  \"zero_copy\": %s,\n", options.zero_copy ? "true" : "false");
+  printf("  \"mmap\": %s,\n", options.mmap ? "true" : "false");
+  printf("  \"prefetch_kb\": %u,\n", options.prefetch_kb);
+  printf("  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+  printf("  \"files\": [\n");
+  for(size_t i = 0; i < results.size(); i++)
+    PrintResult(results[i], i == results.size() - 1);
+  printf("  ],\n");
+  printf("  \"total\":\n");
+  PrintResult(total, true);
+  printf("}\n");
+
+  return total.ok ? 0 : 1;
+}
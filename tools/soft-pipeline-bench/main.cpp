@@ -0,0 +1,447 @@
+// Plays a synthetic stream end to end on the software OMX core, the way the
+// engine does: an OMXClock waiting for the start time of both streams and
+// resumed once they are buffered, a COMXAudio on omx:local (audio_decode ->
+// audio_mixer -> audio_render) fed S16 PCM with timestamps, and the video
+// chain of COMXVideo, video_decode -> video_scheduler -> video_render with the
+// clock tunneled to the scheduler, set up when the decoder reports its port
+// settings. COMXVideo itself needs openFrameworks and EGL, so Open(),
+// PortSettingsChanged(), Decode() and Close() are followed step by step here.
+//
+// Waits for end of stream on both renders and checks OMXSOFT_GetStats(): every
+// frame decoded, nearly all of them presented on time, every audio sample
+// played without an underrun, and the clock at the end of the stream. Prints
+// a JSON report and exits with 1 when any of that fails, so it can run as a
+// check without a Pi:
+//   ./soft-pipeline-bench -t 10
+// -x runs it faster, which only leaves out the check for late frames.
+// Needs ffmpeg and the VideoCore headers to build, no display or GPU to run.
+
+#include "BenchUtils.h"
+#include "OMXAudio.h"
+#include "OMXClock.h"
+#include "OMXCore.h"
+#include "OMXSoftCore.h"
+#include "utils/log.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// the firmware's port numbers, see OMXVideo.cpp
+#define VIDEO_DECODE_OUTPUT_PORT    131
+#define VIDEO_SCHEDULER_INPUT_PORT  10
+#define VIDEO_SCHEDULER_OUTPUT_PORT 11
+#define VIDEO_SCHEDULER_CLOCK_PORT  12
+#define OMX_CLOCK_OUTPUT_PORT_1     81
+
+struct Options
+{
+  double seconds;
+  double fps;
+  int    samplerate;
+  double speed;       // simulated clock against real time
+};
+
+static Options g_options;
+static std::atomic<bool> g_abort(false);
+
+class Video
+{
+public:
+  Video() : m_clock(NULL), m_settings_changed(false), m_start_time(true), m_frames(0) {}
+
+  bool Open(OMXClock *clock)
+  {
+    m_clock = clock;
+    if(!m_decoder.Initialize("OMX.broadcom.video_decode", OMX_IndexParamVideoInit) ||
+       m_decoder.SetStateForComponent(OMX_StateIdle) != OMX_ErrorNone)
+      return false;
+
+    OMX_VIDEO_PARAM_PORTFORMATTYPE format;
+    OMX_INIT_STRUCTURE(format);
+    format.nPortIndex = m_decoder.GetInputPort();
+    format.eCompressionFormat = OMX_VIDEO_CodingAVC;
+    format.xFramerate = (OMX_U32)(g_options.fps * (1 << 16));
+    if(m_decoder.SetParameter(OMX_IndexParamVideoPortFormat, &format) != OMX_ErrorNone)
+      return false;
+
+    return m_decoder.AllocInputBuffers() == OMX_ErrorNone &&
+           m_decoder.SetStateForComponent(OMX_StateExecuting) == OMX_ErrorNone;
+  }
+
+  // COMXVideo::Decode(), one buffer a frame
+  bool Decode(const uint8_t *data, unsigned int size, double pts)
+  {
+    unsigned int offset = 0;
+    while(offset < size)
+    {
+      OMX_BUFFERHEADERTYPE *buffer = m_decoder.GetInputBuffer(200);
+      if(!buffer)
+      {
+        // the decoder holds its input until the tunnels are up
+        if(!HandlePortEvents() || g_abort)
+          return false;
+        continue;
+      }
+
+      buffer->nFlags  = m_start_time ? OMX_BUFFERFLAG_STARTTIME : 0;
+      buffer->nOffset = 0;
+      buffer->nFilledLen = std::min(size - offset, (unsigned int)buffer->nAllocLen);
+      buffer->nTimeStamp = ToOMXTime((uint64_t)pts);
+      memcpy(buffer->pBuffer, data + offset, buffer->nFilledLen);
+      offset += buffer->nFilledLen;
+      if(offset == size)
+        buffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+      m_start_time = false;
+
+      if(m_decoder.EmptyThisBuffer(buffer) != OMX_ErrorNone)
+      {
+        m_decoder.DecoderEmptyBufferDone(m_decoder.GetComponent(), buffer);
+        return false;
+      }
+    }
+    m_frames++;
+    return HandlePortEvents();
+  }
+
+  bool HandlePortEvents()
+  {
+    if(m_decoder.WaitForEvent(OMX_EventPortSettingsChanged, 0) != OMX_ErrorNone)
+      return true;
+    return PortSettingsChanged();
+  }
+
+  void SubmitEOS()
+  {
+    OMX_BUFFERHEADERTYPE *buffer = m_decoder.GetInputBuffer(1000);
+    if(!buffer)
+      return;
+    buffer->nOffset    = 0;
+    buffer->nFilledLen = 0;
+    buffer->nTimeStamp = ToOMXTime(0LL);
+    buffer->nFlags     = OMX_BUFFERFLAG_ENDOFFRAME | OMX_BUFFERFLAG_EOS | OMX_BUFFERFLAG_TIME_UNKNOWN;
+    if(m_decoder.EmptyThisBuffer(buffer) != OMX_ErrorNone)
+      m_decoder.DecoderEmptyBufferDone(m_decoder.GetComponent(), buffer);
+  }
+
+  bool IsEOS() const { return m_render.IsEOS(); }
+  bool Full() const { return m_decoder.GetInputBufferSpace() == 0; }
+  int Frames() const { return m_frames; }
+
+  // COMXVideo::Close()
+  void Close()
+  {
+    m_tunnel_clock.Deestablish();
+    m_tunnel_decoder.Deestablish();
+    m_tunnel_sched.Deestablish();
+    m_decoder.FlushInput();
+    m_sched.Deinitialize();
+    m_decoder.Deinitialize();
+    m_render.Deinitialize();
+  }
+
+private:
+  // COMXVideo::PortSettingsChanged() with video_render, no filters
+  bool PortSettingsChanged()
+  {
+    if(m_settings_changed)
+    {
+      m_decoder.DisablePort(VIDEO_DECODE_OUTPUT_PORT, true);
+      m_decoder.EnablePort(VIDEO_DECODE_OUTPUT_PORT, true);
+      return true;
+    }
+
+    if(!m_render.Initialize("OMX.broadcom.video_render", OMX_IndexParamVideoInit) ||
+       !m_sched.Initialize("OMX.broadcom.video_scheduler", OMX_IndexParamVideoInit))
+      return false;
+    m_render.ResetEos();
+
+    m_tunnel_decoder.Initialize(&m_decoder, VIDEO_DECODE_OUTPUT_PORT, &m_sched, VIDEO_SCHEDULER_INPUT_PORT);
+    m_tunnel_sched.Initialize(&m_sched, VIDEO_SCHEDULER_OUTPUT_PORT, &m_render, m_render.GetInputPort());
+    m_tunnel_clock.Initialize(m_clock->GetOMXClock(), OMX_CLOCK_OUTPUT_PORT_1, &m_sched, VIDEO_SCHEDULER_CLOCK_PORT);
+
+    if(m_tunnel_clock.Establish() != OMX_ErrorNone ||
+       m_tunnel_decoder.Establish() != OMX_ErrorNone ||
+       m_tunnel_sched.Establish() != OMX_ErrorNone)
+      return false;
+
+    if(m_sched.SetStateForComponent(OMX_StateExecuting) != OMX_ErrorNone ||
+       m_render.SetStateForComponent(OMX_StateExecuting) != OMX_ErrorNone)
+      return false;
+
+    m_settings_changed = true;
+    return true;
+  }
+
+  OMXClock          *m_clock;
+  COMXCoreComponent  m_decoder;
+  COMXCoreComponent  m_sched;
+  COMXCoreComponent  m_render;
+  COMXCoreTunel      m_tunnel_decoder;
+  COMXCoreTunel      m_tunnel_sched;
+  COMXCoreTunel      m_tunnel_clock;
+  bool               m_settings_changed;
+  bool               m_start_time;
+  int                m_frames;
+};
+
+struct Stream
+{
+  Video       video;
+  COMXAudio   audio;
+  int         frames;        // to send
+  uint64_t    samples;
+  std::atomic<double>   video_buffered;  // seconds of media submitted
+  std::atomic<double>   audio_buffered;
+  std::atomic<uint64_t> samples_sent;
+  std::atomic<bool>     video_failed;
+};
+
+// read from the component, OMXClock::OMXMediaTime() interpolates in real
+// time which is off when the simulated clock runs faster
+static double MediaTime(OMXClock &clock)
+{
+  OMX_TIME_CONFIG_TIMESTAMPTYPE timeStamp;
+  OMX_INIT_STRUCTURE(timeStamp);
+  timeStamp.nPortIndex = clock.GetOMXClock()->GetInputPort();
+  if(clock.GetOMXClock()->GetConfig(OMX_IndexConfigTimeCurrentMediaTime, &timeStamp) != OMX_ErrorNone)
+    return 0.0;
+  return FromOMXTime(timeStamp.nTimestamp) / DVD_TIME_BASE;
+}
+
+static void *VideoThread(void *arg)
+{
+  Stream &stream = *(Stream *)arg;
+  std::vector<uint8_t> payload(32 * 1024);
+
+  for(int i = 0; i < stream.frames && !g_abort; i++)
+  {
+    // sizes of a few KB with a key frame every second, like a low rate stream
+    unsigned int size = i % (int)g_options.fps == 0 ? 30 * 1024 : 2048 + (i * 7919) % 8192;
+    for(unsigned int j = 0; j < size; j++)
+      payload[j] = (uint8_t)(i + j * 13);
+
+    double pts = DVD_SEC_TO_TIME(i / g_options.fps);
+    if(!stream.video.Decode(&payload[0], size, pts))
+    {
+      stream.video_failed = true;
+      return NULL;
+    }
+    stream.video_buffered = (i + 1) / g_options.fps;
+  }
+  stream.video.SubmitEOS();
+  return NULL;
+}
+
+static void *AudioThread(void *arg)
+{
+  Stream &stream = *(Stream *)arg;
+  const unsigned int packet = 1024;
+  std::vector<int16_t> pcm(packet * 2);
+
+  uint64_t sent = 0;
+  while(sent < stream.samples && !g_abort)
+  {
+    unsigned int samples = (unsigned int)std::min<uint64_t>(packet, stream.samples - sent);
+    for(unsigned int i = 0; i < samples; i++)
+    {
+      int16_t s = (int16_t)(8000.0 * sin(2.0 * M_PI * 440.0 * (sent + i) / g_options.samplerate));
+      pcm[i * 2] = pcm[i * 2 + 1] = s;
+    }
+
+    // OMXPlayerAudio waits for room rather than have AddPackets() give up
+    unsigned int len = samples * 2 * sizeof(int16_t);
+    if(!stream.audio.WaitForSpace(len, 200))
+      continue;
+
+    double pts = DVD_SEC_TO_TIME((double)sent / g_options.samplerate);
+    stream.audio.AddPackets(&pcm[0], len, pts, pts);
+    sent += samples;
+    stream.samples_sent = sent;
+    stream.audio_buffered = (double)sent / g_options.samplerate;
+  }
+  stream.audio.SubmitEOS();
+  return NULL;
+}
+
+static void Usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-t seconds] [-f fps] [-r samplerate] [-x speed] [-v]\n", name);
+  fprintf(stderr, "  -t  length of the stream, default 5\n");
+  fprintf(stderr, "  -f  video frame rate, default 25\n");
+  fprintf(stderr, "  -r  audio sample rate, default 48000\n");
+  fprintf(stderr, "  -x  run the simulated clock this much faster than real time, default 1\n");
+  fprintf(stderr, "  -v  log what the components log\n");
+}
+
+int main(int argc, char **argv)
+{
+  g_options.seconds    = 5.0;
+  g_options.fps        = 25.0;
+  g_options.samplerate = 48000;
+  g_options.speed      = 1.0;
+
+  int opt;
+  while((opt = getopt(argc, argv, "t:f:r:x:vh")) != -1)
+  {
+    switch(opt)
+    {
+      case 't':
+        g_options.seconds = std::max(1.0, atof(optarg));
+        break;
+      case 'f':
+        g_options.fps = std::min(std::max(1.0, atof(optarg)), 120.0);
+        break;
+      case 'r':
+        g_options.samplerate = std::min(std::max(atoi(optarg), 8000), 192000);
+        break;
+      case 'x':
+        g_options.speed = std::min(std::max(atof(optarg), 0.25), 16.0);
+        break;
+      case 'v':
+        SetBenchLogLevel(LOGDEBUG);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  COMXCore core;
+  if(!core.Initialize())
+  {
+    fprintf(stderr, "OMX core failed to initialize\n");
+    return 1;
+  }
+
+  OMXSOFT_CONFIG config;
+  OMXSOFT_GetConfig(&config);
+  config.speed = g_options.speed;
+  OMXSOFT_SetConfig(&config);
+  OMXSOFT_ResetStats();
+
+  // ofxOMXPlayerEngine::openPlayer()
+  OMXClock clock;
+  if(!clock.OMXInitialize())
+  {
+    fprintf(stderr, "clock failed to initialize\n");
+    return 1;
+  }
+  clock.OMXStateIdle();
+  clock.OMXStop();
+  clock.OMXPause();
+
+  Stream *stream = new Stream;
+  stream->frames  = (int)(g_options.seconds * g_options.fps);
+  stream->samples = (uint64_t)(g_options.seconds * g_options.samplerate);
+  stream->video_buffered = 0.0;
+  stream->audio_buffered = 0.0;
+  stream->samples_sent   = 0;
+  stream->video_failed   = false;
+
+  OMXAudioConfig audio_config;
+  audio_config.device = "omx:local";
+  audio_config.hints.codec = AV_CODEC_ID_PCM_S16LE;
+  audio_config.hints.samplerate = g_options.samplerate;
+  audio_config.hints.channels = 2;
+  audio_config.hints.bitspersample = 16;
+
+  bool ok = stream->video.Open(&clock);
+  if(!ok)
+    fprintf(stderr, "video failed to open\n");
+  if(ok && !(ok = stream->audio.Initialize(&clock, audio_config, AV_CH_LAYOUT_STEREO, 16)))
+    fprintf(stderr, "audio failed to open\n");
+  if(!ok)
+    return 1;
+
+  clock.OMXReset(true, true);
+  clock.OMXStateExecute();
+
+  pthread_t video_thread, audio_thread;
+  pthread_create(&video_thread, NULL, VideoThread, stream);
+  pthread_create(&audio_thread, NULL, AudioThread, stream);
+
+  // the engine resumes the clock once both queues hold some data or a
+  // decoder can't take more
+  double start = Now();
+  double deadline = start + 10.0 + g_options.seconds * 2.0 / g_options.speed;
+  while(Now() < deadline && !stream->video_failed &&
+        ((stream->video_buffered < 0.5 && !stream->video.Full()) ||
+         (stream->audio_buffered < 0.5 && stream->audio.GetSpace() > 0)))
+    OMXClock::OMXSleep(10);
+  clock.OMXResume();
+  double resumed = Now();
+
+  bool eos = false;
+  double media_end = 0.0;
+  while(Now() < deadline && !stream->video_failed)
+  {
+    if(stream->video.IsEOS() && stream->audio.IsEOS())
+    {
+      eos = true;
+      media_end = MediaTime(clock);
+      break;
+    }
+    OMXClock::OMXSleep(10);
+  }
+  double played = Now() - resumed;
+
+  g_abort = true;
+  stream->audio.CancelWait(true);
+  pthread_join(video_thread, NULL);
+  pthread_join(audio_thread, NULL);
+
+  OMXSOFT_STATS stats;
+  OMXSOFT_GetStats(&stats);
+
+  clock.OMXStop();
+  clock.OMXStateIdle();
+  stream->video.Close();
+  stream->audio.Deinitialize();
+  clock.OMXDeinitialize();
+
+  int frames = stream->video.Frames();
+  uint64_t samples = stream->samples_sent;
+  // the last frame and the tail of the audio play out after the clock passed them
+  bool clock_ok = fabs(media_end - g_options.seconds) < 0.5;
+  // a faster clock multiplies the host's scheduling jitter, lateness is only
+  // judged in real time
+  bool video_ok = frames == stream->frames &&
+                  stats.frames_decoded == (uint64_t)frames &&
+                  stats.frames_presented + stats.frames_dropped >= (uint64_t)frames * 98 / 100 &&
+                  (stats.frames_late <= (uint64_t)frames * 2 / 100 || g_options.speed > 1.0);
+  bool audio_ok = samples == stream->samples &&
+                  stats.audio_frames_played == samples &&
+                  stats.audio_underruns == 0;
+  bool pass = eos && clock_ok && video_ok && audio_ok;
+
+  printf("{\n");
+  printf("  \"seconds\": %.1f,\n", g_options.seconds);
+  printf("  \"fps\": %.3f,\n", g_options.fps);
+  printf("  \"samplerate\": %d,\n", g_options.samplerate);
+  printf("  \"speed\": %.2f,\n", g_options.speed);
+  printf("  \"eos\": %s,\n", eos ? "true" : "false");
+  printf("  \"played_seconds\": %.3f,\n", played);
+  printf("  \"media_end\": %.3f,\n", media_end);
+  printf("  \"frames_sent\": %d,\n", frames);
+  printf("  \"frames_decoded\": %llu,\n", (unsigned long long)stats.frames_decoded);
+  printf("  \"frames_presented\": %llu,\n", (unsigned long long)stats.frames_presented);
+  printf("  \"frames_late\": %llu,\n", (unsigned long long)stats.frames_late);
+  printf("  \"frames_dropped\": %llu,\n", (unsigned long long)stats.frames_dropped);
+  printf("  \"decoder_input_buffers\": %llu,\n", (unsigned long long)stats.input_buffers);
+  printf("  \"samples_sent\": %llu,\n", (unsigned long long)samples);
+  printf("  \"audio_frames_played\": %llu,\n", (unsigned long long)stats.audio_frames_played);
+  printf("  \"audio_underruns\": %llu,\n", (unsigned long long)stats.audio_underruns);
+  printf("  \"pass\": %s\n", pass ? "true" : "false");
+  printf("}\n");
+
+  delete stream;
+  core.Deinitialize();
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,335 @@
+// Feeds OMX.soft.video_decode the way COMXVideo does with zero copy decode:
+// packets demuxed into the blocks of a fixed OMXPacketPool go to the decoder
+// in the buffer header registered for their block, everything else is copied
+// into the port's own buffers. Checks the lifecycle end to end and exits with
+// 1 when it breaks:
+//   - every attached packet comes back through the release callback once,
+//     and only after the decoder emptied it
+//   - the decoder read as many bytes as were submitted, either way
+//   - a header pointed away from its registered memory is refused
+//   - packets still queued in the decoder when it is torn down are released,
+//     after the owner of the pool dropped it
+// Prints a JSON report with how many bytes went without a copy.
+//   ./zero-copy-bench -n 2000 -b 16
+// Build with CXXFLAGS="-g -fsanitize=address" to have a use after free of
+// the pool or a block show up. Needs ffmpeg and the VideoCore headers to
+// build, no display or GPU to run.
+
+#include "BenchUtils.h"
+#include "OMXCore.h"
+#include "OMXPacketPool.h"
+#include "OMXReader.h"
+#include "OMXSoftCore.h"
+#include "utils/log.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <set>
+
+struct Options
+{
+  int          packets;
+  unsigned int blocks;
+  unsigned int block_kb;
+};
+
+static Options g_options;
+
+// attached packets the decoder has not handed back yet
+static pthread_mutex_t        g_flight_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::set<OMXPacket *>  g_in_flight;
+static std::atomic<uint64_t>  g_released(0);
+static std::atomic<uint64_t>  g_unknown(0);   // released without being attached, or twice
+static std::atomic<uint64_t>  g_early(0);     // released before the decoder counted a buffer for it
+
+static void Usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-n packets] [-b blocks] [-s block_kb] [-v]\n", name);
+}
+
+static void ReleasePacket(void *opaque)
+{
+  OMXPacket *pkt = (OMXPacket *)opaque;
+
+  pthread_mutex_lock(&g_flight_lock);
+  bool known = g_in_flight.erase(pkt) == 1;
+  pthread_mutex_unlock(&g_flight_lock);
+  if(!known)
+  {
+    g_unknown++;
+    return;
+  }
+
+  // the decoder counts a buffer before it hands it back
+  OMXSOFT_STATS stats;
+  OMXSOFT_GetStats(&stats);
+  if(stats.input_buffers < ++g_released)
+    g_early++;
+
+  OMXPacketPool::Release(pkt);
+}
+
+static void Fill(OMXPacket *pkt, uint32_t seed)
+{
+  for(int i = 0; i < pkt->size; i++)
+    pkt->data[i] = (uint8_t)(seed + i * 31);
+}
+
+// COMXVideo::Decode(), for packets outside the blocks
+static bool Copy(COMXCoreComponent &dec, const OMXPacket *pkt, uint64_t &buffers)
+{
+  unsigned int offset = 0;
+  while(offset < (unsigned int)pkt->size)
+  {
+    OMX_BUFFERHEADERTYPE *buffer = dec.GetInputBuffer(500);
+    if(!buffer)
+      return false;
+
+    buffer->nFlags     = 0;
+    buffer->nOffset    = 0;
+    buffer->nFilledLen = std::min((unsigned int)pkt->size - offset, (unsigned int)buffer->nAllocLen);
+    memcpy(buffer->pBuffer, pkt->data + offset, buffer->nFilledLen);
+    offset += buffer->nFilledLen;
+
+    if(dec.EmptyThisBuffer(buffer) != OMX_ErrorNone)
+    {
+      dec.DecoderEmptyBufferDone(dec.GetComponent(), buffer);
+      return false;
+    }
+    buffers++;
+  }
+  return true;
+}
+
+// COMXVideo::DecodePacket(), NULL header if the packet isn't in a block
+static OMX_BUFFERHEADERTYPE *Attach(COMXCoreComponent &dec, OMXPacket *pkt, OMX_U32 flags)
+{
+  pthread_mutex_lock(&g_flight_lock);
+  g_in_flight.insert(pkt);
+  pthread_mutex_unlock(&g_flight_lock);
+
+  OMX_BUFFERHEADERTYPE *buffer = dec.AttachInputData(pkt->data, pkt->size, pkt);
+  if(!buffer)
+  {
+    pthread_mutex_lock(&g_flight_lock);
+    g_in_flight.erase(pkt);
+    pthread_mutex_unlock(&g_flight_lock);
+    return NULL;
+  }
+
+  buffer->nFlags = flags;
+  if(dec.EmptyThisBuffer(buffer) != OMX_ErrorNone)
+    dec.DecoderEmptyBufferDone(dec.GetComponent(), buffer);
+  return buffer;
+}
+
+// points a free header at memory it wasn't registered with, the framework
+// has to refuse it rather than let the decoder read from there
+static bool MovedBufferRefused(COMXCoreComponent &dec)
+{
+  static OMX_U8 elsewhere[64];
+
+  OMX_BUFFERHEADERTYPE *buffer = dec.GetInputBuffer(500);
+  if(!buffer)
+    return false;
+
+  OMX_U8 *registered = buffer->pBuffer;
+  buffer->pBuffer    = elsewhere;
+  buffer->nFlags     = 0;
+  buffer->nOffset    = 0;
+  buffer->nFilledLen = sizeof(elsewhere);
+  OMX_ERRORTYPE omx_err = dec.EmptyThisBuffer(buffer);
+  buffer->pBuffer    = registered;
+
+  // an accepted buffer comes back from the decoder by itself
+  if(omx_err == OMX_ErrorNone)
+    return false;
+  dec.DecoderEmptyBufferDone(dec.GetComponent(), buffer);
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  g_options.packets  = 2000;
+  g_options.blocks   = 16;
+  g_options.block_kb = 256;
+
+  int opt;
+  while((opt = getopt(argc, argv, "n:b:s:vh")) != -1)
+  {
+    switch(opt)
+    {
+      case 'n':
+        g_options.packets = std::max(atoi(optarg), 1);
+        break;
+      case 'b':
+        g_options.blocks = std::min(std::max(atoi(optarg), 1), 64);
+        break;
+      case 's':
+        g_options.block_kb = std::max(atoi(optarg), 80);
+        break;
+      case 'v':
+        SetBenchLogLevel(LOGDEBUG);
+        break;
+      default:
+        Usage(argv[0]);
+        return 1;
+    }
+  }
+
+  COMXCore core;
+  if(!core.Initialize())
+  {
+    fprintf(stderr, "OMX core failed to initialize\n");
+    return 1;
+  }
+
+  // the engine's pool, and the heap pool of the reader for everything else
+  unsigned int block_size = g_options.block_kb * 1024;
+  OMXPacketPool *blocks = new OMXPacketPool(block_size, g_options.blocks);
+  OMXPacketPool *heap = new OMXPacketPool();
+
+  // COMXVideo::Open(), without a tunnel: the output port stays disabled
+  COMXCoreComponent dec;
+  OMX_PARAM_PORTDEFINITIONTYPE port;
+  OMX_INIT_STRUCTURE(port);
+  bool ok = dec.Initialize("OMX.broadcom.video_decode", OMX_IndexParamVideoInit) &&
+            dec.DisableAllPorts() == OMX_ErrorNone &&
+            dec.SetStateForComponent(OMX_StateIdle) == OMX_ErrorNone;
+  if(ok)
+  {
+    port.nPortIndex = dec.GetInputPort();
+    ok = dec.GetParameter(OMX_IndexParamPortDefinition, &port) == OMX_ErrorNone;
+  }
+  unsigned int copy_buffers = port.nBufferCountActual;
+  std::vector<OMX_U8 *> registered(blocks->GetBlocks().begin(), blocks->GetBlocks().end());
+  for(size_t i = 0; ok && i < registered.size(); i++)
+    ok = port.nBufferAlignment <= 1 || ((uintptr_t)registered[i] % port.nBufferAlignment) == 0;
+  if(ok)
+  {
+    port.nBufferCountActual += registered.size();
+    ok = dec.SetParameter(OMX_IndexParamPortDefinition, &port) == OMX_ErrorNone;
+  }
+  if(ok)
+  {
+    blocks->Ref();
+    dec.SetInputDataRelease(ReleasePacket);
+    ok = dec.AllocInputBuffers(false, &registered, blocks->GetBlockSize()) == OMX_ErrorNone &&
+         dec.SetStateForComponent(OMX_StateExecuting) == OMX_ErrorNone;
+  }
+  if(!ok)
+  {
+    fprintf(stderr, "%s failed to open\n", dec.GetName().c_str());
+    return 1;
+  }
+
+  // packets of 1 KB up to 1.5 blocks, no ENDOFFRAME so the decoder never
+  // has a frame it can't put out and empties every buffer
+  uint64_t attached = 0, copied = 0, attached_bytes = 0, copied_bytes = 0, copy_buffers_sent = 0;
+  uint32_t seed = 0x2545f491;
+  double start = Now();
+  for(int i = 0; ok && i < g_options.packets; i++)
+  {
+    seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+    int size = 1024 + seed % (i % 16 == 15 ? block_size + block_size / 2 : 64 * 1024);
+
+    OMXPacket *pkt = blocks->Alloc(size);
+    if(!pkt)
+      pkt = heap->Alloc(size);
+    if(!pkt)
+    {
+      ok = false;
+      break;
+    }
+    Fill(pkt, seed);
+
+    if(Attach(dec, pkt, 0))
+    {
+      attached++;
+      attached_bytes += size;
+      continue;
+    }
+    ok = Copy(dec, pkt, copy_buffers_sent);
+    copied++;
+    copied_bytes += size;
+    OMXPacketPool::Release(pkt);
+  }
+  dec.WaitForInputDone(2000);
+  double elapsed = Now() - start;
+
+  OMXSOFT_STATS stats;
+  OMXSOFT_GetStats(&stats);
+  uint64_t released = g_released;
+  bool bytes_match = stats.input_bytes == attached_bytes + copied_bytes;
+  bool all_back = released == attached && blocks->GetStats().bytes_in_use == 0;
+  bool refused = ok && MovedBufferRefused(dec);
+
+  // frames with ENDOFFRAME: the first one can't be put out and the decoder
+  // stops taking input, so the rest stay queued
+  uint64_t torn_down = 0;
+  for(unsigned int i = 0; ok && i < g_options.blocks; i++)
+  {
+    OMXPacket *pkt = blocks->Alloc(4096);
+    if(!pkt)
+      break;
+    Fill(pkt, i);
+    if(!Attach(dec, pkt, OMX_BUFFERFLAG_ENDOFFRAME))
+    {
+      OMXPacketPool::Release(pkt);
+      break;
+    }
+    torn_down++;
+  }
+  usleep(100 * 1000);
+  pthread_mutex_lock(&g_flight_lock);
+  size_t queued = g_in_flight.size();
+  pthread_mutex_unlock(&g_flight_lock);
+
+  // the reader goes first, then COMXVideo::Close()
+  blocks->Unref();
+  dec.Deinitialize();
+  blocks->Unref();
+  blocks = NULL;
+
+  pthread_mutex_lock(&g_flight_lock);
+  size_t leaked = g_in_flight.size();
+  pthread_mutex_unlock(&g_flight_lock);
+  bool teardown = queued > 0 && leaked == 0 && g_released == attached + torn_down;
+
+  OMXPacketPoolStats heap_stats = heap->GetStats();
+  heap->Unref();
+  core.Deinitialize();
+
+  bool pass = ok && bytes_match && all_back && refused && teardown &&
+              g_unknown == 0 && g_early == 0;
+
+  printf("{\n");
+  printf("  \"packets\": %d,\n", g_options.packets);
+  printf("  \"blocks\": %u,\n", g_options.blocks);
+  printf("  \"block_size\": %u,\n", block_size);
+  printf("  \"copy_buffers\": %u,\n", copy_buffers);
+  printf("  \"attached\": %llu,\n", (unsigned long long)attached);
+  printf("  \"copied\": %llu,\n", (unsigned long long)copied);
+  printf("  \"copy_buffers_sent\": %llu,\n", (unsigned long long)copy_buffers_sent);
+  printf("  \"zero_copy_share\": %.3f,\n", attached_bytes + copied_bytes ? (double)attached_bytes / (attached_bytes + copied_bytes) : 0.0);
+  printf("  \"heap_allocs\": %llu,\n", (unsigned long long)heap_stats.allocs);
+  printf("  \"decoder_buffers\": %llu,\n", (unsigned long long)stats.input_buffers);
+  printf("  \"decoder_bytes\": %llu,\n", (unsigned long long)stats.input_bytes);
+  printf("  \"submitted_bytes\": %llu,\n", (unsigned long long)(attached_bytes + copied_bytes));
+  printf("  \"released\": %llu,\n", (unsigned long long)released);
+  printf("  \"released_unknown\": %llu,\n", (unsigned long long)g_unknown.load());
+  printf("  \"released_early\": %llu,\n", (unsigned long long)g_early.load());
+  printf("  \"moved_buffer_refused\": %s,\n", refused ? "true" : "false");
+  printf("  \"queued_at_teardown\": %llu,\n", (unsigned long long)queued);
+  printf("  \"leaked_at_teardown\": %llu,\n", (unsigned long long)leaked);
+  printf("  \"seconds\": %.3f,\n", elapsed);
+  printf("  \"pass\": %s\n", pass ? "true" : "false");
+  printf("}\n");
+
+  return pass ? 0 : 1;
+}